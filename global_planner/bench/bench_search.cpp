@@ -0,0 +1,228 @@
+#include <benchmark/benchmark.h>
+#include <sys/resource.h>
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <octomap/OcTree.h>
+#include <octomap/octomap.h>
+#include <octomap_msgs/Octomap.h>
+#include <octomap_msgs/conversions.h>
+
+#include "global_planner/global_planner.h"
+#include "global_planner/search_tools.h"
+
+using namespace global_planner;
+
+namespace {
+
+const int kMaxIterations = 100000;  // Large enough for the biggest map
+const int kNumSearches = 8;         // Per map, if no goal file is given
+const double kAltitude = 3.5;       // Of the generated starts and goals
+
+struct Search {
+  Cell start;
+  GoalCell goal;
+};
+
+typedef std::function<std::unique_ptr<octomap::OcTree>()> MapFactory;
+
+// A map and the searches that are run on it. The map is only created once a
+// benchmark of it runs, so that filtered benchmarks cost nothing.
+struct Scene {
+  MapFactory create_map;
+  std::unique_ptr<octomap::OcTree> tree;
+  std::vector<Search> searches;
+  bool is_created = false;
+
+  void create();
+};
+
+// Goals read from a file, one "x y z" per line like the waypoint files of
+// global_planner_node. The searches go from each goal to the next one.
+std::vector<Cell> goals_from_file;
+
+// The walls of MockDataNode::createWall, repeated every 20 m along the x-axis
+// of a size x size/2 m map. Every wall has a gap and there is random clutter
+// in between, a search has to weave through all walls.
+std::unique_ptr<octomap::OcTree> createWallMap(int size) {
+  std::unique_ptr<octomap::OcTree> tree(new octomap::OcTree(1.0));
+  std::mt19937 rng(size);
+  const int width = size / 4;
+  std::uniform_int_distribution<int> gap(-width + 2, width - 2);
+  for (int x = 10; x < size - 5; x += 20) {
+    const int gap_y = gap(rng);
+    for (int y = -width; y <= width; ++y) {
+      for (int z = 0; z <= 12; ++z) {
+        if (std::abs(y - gap_y) > 1) {
+          tree->setNodeValue(x + 0.5, y + 0.5, z + 0.5, 2.0f);
+        }
+      }
+    }
+  }
+  std::uniform_int_distribution<int> clutter_x(0, size - 1);
+  std::uniform_int_distribution<int> clutter_y(-width, width);
+  std::uniform_int_distribution<int> clutter_z(0, 8);
+  for (int i = 0; i < size * width / 10; ++i) {
+    tree->setNodeValue(clutter_x(rng) + 0.5, clutter_y(rng) + 0.5,
+                       clutter_z(rng) + 0.5, 1.0f);
+  }
+  return tree;
+}
+
+// Searches between the goals of the goal file, or between random Cells at the
+// two ends of the map
+std::vector<Search> createSearches(const octomap::OcTree& tree) {
+  std::vector<Search> searches;
+  if (goals_from_file.size() > 1) {
+    for (std::size_t i = 1; i < goals_from_file.size(); ++i) {
+      searches.push_back({goals_from_file[i - 1], goals_from_file[i]});
+    }
+    return searches;
+  }
+  double min_x, min_y, min_z, max_x, max_y, max_z;
+  tree.getMetricMin(min_x, min_y, min_z);
+  tree.getMetricMax(max_x, max_y, max_z);
+  const double length = std::min(5.0, (max_x - min_x) / 4);
+  std::mt19937 rng(kNumSearches);
+  std::uniform_real_distribution<double> start_x(min_x, min_x + length);
+  std::uniform_real_distribution<double> goal_x(max_x - length, max_x);
+  std::uniform_real_distribution<double> y(min_y, max_y);
+  for (int i = 0; i < kNumSearches; ++i) {
+    const Cell start(start_x(rng), y(rng), kAltitude);
+    const Cell goal(goal_x(rng), y(rng), kAltitude);
+    searches.push_back({start, GoalCell(goal, 3.0)});
+  }
+  return searches;
+}
+
+void Scene::create() {
+  if (!is_created) {
+    tree = create_map();
+    if (tree) {
+      searches = createSearches(*tree);
+    }
+    is_created = true;
+  }
+}
+
+// Process wide, the scenes should run one map size at a time and from small
+// to large for it to be the peak of the current map
+double peakMemoryMB() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+// Runs the searches of a scene with the node type, the risk of the map is
+// computed once before the timing like on a map update of the node
+template <typename NodeType>
+void BM_FindSmoothPath(benchmark::State& state,
+                       std::shared_ptr<Scene> shared_scene) {
+  Scene& scene = *shared_scene;
+  scene.create();
+  if (!scene.tree || scene.tree->size() == 0) {
+    state.SkipWithError("Empty or unreadable map");
+    return;
+  }
+  GlobalPlanner planner;
+  octomap_msgs::Octomap msg;
+  octomap_msgs::fullMapToMsg(*scene.tree, msg);
+  planner.updateFullOctomap(msg);
+
+  int64_t num_iter = 0;
+  double search_time = 0.0;
+  int num_found = 0;
+  double path_cost = 0.0;
+  for (auto _ : state) {
+    for (const Search& search : scene.searches) {
+      planner.setGoal(search.goal);
+      std::vector<Cell> path;
+      SearchInfo info =
+          findSmoothPath(&planner, path, NodeType(search.start, search.start),
+                         search.goal, kMaxIterations);
+      num_iter += info.num_iter;
+      search_time += info.search_time;
+      if (info.found_path) {
+        num_found++;
+        path_cost += planner.getPathInfo(path).cost;
+      }
+      benchmark::DoNotOptimize(path.data());
+    }
+  }
+
+  const double num_searches = state.iterations() * scene.searches.size();
+  state.counters["iterations"] = num_iter / num_searches;
+  state.counters["us_per_expansion"] =
+      search_time / std::max<int64_t>(1, num_iter);
+  state.counters["path_cost"] = path_cost / std::max(1, num_found);
+  state.counters["found"] = num_found / num_searches;
+  state.counters["map_voxels"] = static_cast<double>(scene.tree->size());
+  state.counters["risk_cache_cells"] =
+      static_cast<double>(planner.risk_cache_.size());
+  state.counters["risk_cache_hit_rate"] = planner.risk_cache_.stats().hitRate();
+  state.counters["peak_memory_mb"] = peakMemoryMB();
+}
+
+// Binary (.bt) or full (.ot) maps, e.g. saved by octomap_saver
+std::unique_ptr<octomap::OcTree> loadMap(const std::string& filename) {
+  std::unique_ptr<octomap::OcTree> tree;
+  if (filename.size() > 3 &&
+      filename.compare(filename.size() - 3, 3, ".bt") == 0) {
+    tree.reset(new octomap::OcTree(filename));
+  } else {
+    tree.reset(dynamic_cast<octomap::OcTree*>(
+        octomap::AbstractOcTree::read(filename)));
+  }
+  return tree;
+}
+
+// Both node types search the same scene
+void registerScene(const std::string& name, const MapFactory& create_map) {
+  std::shared_ptr<Scene> scene = std::make_shared<Scene>();
+  scene->create_map = create_map;
+  benchmark::RegisterBenchmark(("BM_FindSmoothPath<SpeedNode>/" + name).c_str(),
+                               BM_FindSmoothPath<SpeedNode>, scene)
+      ->Unit(benchmark::kMillisecond);
+  benchmark::RegisterBenchmark(
+      ("BM_FindSmoothPath<NodeWithoutSmooth>/" + name).c_str(),
+      BM_FindSmoothPath<NodeWithoutSmooth>, scene)
+      ->Unit(benchmark::kMillisecond);
+}
+
+}  // namespace
+
+// The arguments that are left after the benchmark flags are a goal file
+// (--goals=<file>) and recorded maps
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  std::vector<std::string> map_files;
+  const std::string goals_flag = "--goals=";
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg.compare(0, goals_flag.size(), goals_flag) == 0) {
+      std::ifstream goal_file(arg.substr(goals_flag.size()));
+      double x, y, z;
+      while (goal_file >> x >> y >> z) {
+        goals_from_file.push_back(Cell(x, y, z));
+      }
+    } else {
+      map_files.push_back(arg);
+    }
+  }
+
+  for (int size : {64, 128, 256, 512}) {
+    registerScene("Walls" + std::to_string(size),
+                  [size] { return createWallMap(size); });
+  }
+  for (const std::string& file : map_files) {
+    registerScene(file.substr(file.find_last_of('/') + 1),
+                  [file] { return loadMap(file); });
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,205 @@
+#ifndef GLOBAL_PLANNER_ANYTIME_SEARCH_H_
+#define GLOBAL_PLANNER_ANYTIME_SEARCH_H_
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <queue>
+#include <vector>
+
+#include "global_planner/cell.h"
+#include "global_planner/node.h"
+#include "global_planner/node_table.h"
+#include "global_planner/search_tools.h"
+
+namespace global_planner {
+
+typedef std::chrono::steady_clock SearchClock;
+
+// Anytime Repairing A* (ARA*) from s to t. Every call of improvePath() searches
+// with the current overestimate_factor_ of the planner and starts from the
+// state of the previous call: the nodes that were open or became inconsistent
+// are re-queued with their new priorities, the rest of the search tree is
+// kept. Lowering the overestimate factor between calls therefore refines the
+// last path instead of searching from scratch.
+template <typename GlobalPlanner, typename NodeType>
+class AnytimeSearch {
+ public:
+  AnytimeSearch(GlobalPlanner* global_planner, const NodeType& s,
+                const GoalCell& t)
+      : global_planner_(global_planner), s_(s), t_(t), nodes_(1 << 12) {
+    const PackedNode s_packed(s.cell_, s.parent_);
+    s_index_ = nodes_.findOrInsert(NodeType::searchKey(s_packed), s_packed);
+    nodes_[s_index_].distance = 0.0;
+    open_.push_back(s_index_);
+  }
+
+  // Returns a path iff a node within the plan radius of t was reached before
+  // max_iterations expansions or the deadline
+  template <typename Visitor>
+  SearchInfo improvePath(std::vector<Cell>& path, int max_iterations,
+                         SearchClock::time_point deadline, Visitor& visitor) {
+    std::clock_t start_time = std::clock();
+    visitor.init();
+
+    // Nodes expanded with the last overestimate factor may be expanded again
+    for (std::size_t i = 0; i < nodes_.size(); ++i) {
+      nodes_[i].closed = false;
+    }
+    std::sort(open_.begin(), open_.end());
+    open_.erase(std::unique(open_.begin(), open_.end()), open_.end());
+    std::priority_queue<IndexNodeDistancePair,
+                        std::vector<IndexNodeDistancePair>, CompareDist>
+        pq;
+    for (int index : open_) {
+      pq.push(IndexNodeDistancePair(index, priority(index, getNode(index))));
+    }
+    open_.clear();
+
+    int goal_index = -1;
+    int num_iter = 0;
+    Cell neighbor_cells[NodeType::kMaxNeighbors];
+    while (!pq.empty() && num_iter < max_iterations) {
+      // The clock is only read every few expansions
+      if ((num_iter & 63) == 0 && (SearchClock::now() > deadline ||
+                                   global_planner_->isSearchCancelled())) {
+        break;
+      }
+      int u_index = pq.top().first;
+      pq.pop();
+      if (nodes_[u_index].closed) {
+        continue;
+      }
+      const NodeType u = getNode(u_index);
+      visitor.popNode(u);
+      if (t_.withinPlanRadius(u.cell_) ||
+          global_planner_->meetsReverseSearch(u.cell_, t_)) {
+        // Found a path, u stays open for the next call
+        goal_index = u_index;
+        open_.push_back(u_index);
+        break;
+      }
+      nodes_[u_index].closed = true;
+      num_iter++;
+
+      const double u_dist = nodes_[u_index].distance;
+      int num_neighbors = u.getNeighborCells(neighbor_cells);
+      for (int i = 0; i < num_neighbors; ++i) {
+        const NodeType v(neighbor_cells[i], u.cell_);
+        if (!global_planner_->isLegal(v)) {
+          continue;
+        }
+        const PackedNode v_packed(v.cell_, v.parent_);
+        int v_index =
+            nodes_.findOrInsert(NodeType::searchKey(v_packed), v_packed);
+        double new_dist = u_dist + global_planner_->getEdgeCost(u, v);
+        if (new_dist < nodes_[v_index].distance) {
+          nodes_[v_index].node = v_packed;
+          nodes_[v_index].parent = u_index;
+          nodes_[v_index].distance = new_dist;
+          if (nodes_[v_index].closed) {
+            // Inconsistent, it is only expanded again by the next call
+            inconsistent_.push_back(v_index);
+          } else {
+            pq.push(IndexNodeDistancePair(v_index, priority(v_index, v)));
+          }
+          visitor.perNeighbor(u, v);
+        }
+      }
+    }
+
+    // Keep the frontier for the next call
+    while (!pq.empty()) {
+      if (!nodes_[pq.top().first].closed) {
+        open_.push_back(pq.top().first);
+      }
+      pq.pop();
+    }
+    open_.insert(open_.end(), inconsistent_.begin(), inconsistent_.end());
+    inconsistent_.clear();
+    double total_time = clocksToMicroSec(start_time, std::clock());
+
+    if (goal_index < 0) {
+      return SearchInfo(false, num_iter, total_time);
+    }
+    path.clear();
+    for (int walker = goal_index; walker != s_index_;
+         walker = nodes_[walker].parent) {
+      path.push_back(nodes_[walker].node.cell());
+    }
+    path.push_back(s_.cell_);
+    path.push_back(s_.parent_);
+    std::reverse(path.begin(), path.end());
+    if (!t_.withinPlanRadius(path.back()) &&
+        !followReverseSearch(global_planner_, path)) {
+      return SearchInfo(false, num_iter, total_time);
+    }
+    return SearchInfo(true, num_iter, total_time);
+  }
+
+ private:
+  GlobalPlanner* global_planner_;
+  NodeType s_;
+  GoalCell t_;
+  NodeTable nodes_;
+  int s_index_;
+  std::vector<int> open_;          // Frontier between calls
+  std::vector<int> inconsistent_;  // Improved after they were expanded
+
+  // The packed parent offset of the start may be shortened, use the original
+  NodeType getNode(int index) const {
+    return index == s_index_ ? s_
+                             : NodeType(nodes_[index].node.cell(),
+                                        nodes_[index].node.parent());
+  }
+
+  double priority(int index, const NodeType& node) {
+    return nodes_[index].distance + global_planner_->getHeuristic(node, t_);
+  }
+};
+
+// Anytime search from s to t. The overestimate factor starts at
+// max_overestimate_factor and is lowered after every path found until it
+// drops below min_overestimate_factor, the deadline passes or max_iterations
+// expansions were used. path is the last path found, overestimate_factor_ of
+// the planner is left at the factor of the next refinement.
+template <typename GlobalPlanner, typename NodeType, typename Visitor>
+bool findAnytimePath(GlobalPlanner* global_planner, std::vector<Cell>& path,
+                     const NodeType& s, const GoalCell& t,
+                     double max_overestimate_factor,
+                     double min_overestimate_factor,
+                     SearchClock::time_point deadline, int max_iterations,
+                     Visitor& visitor, const std::string& node_type = "ARA*") {
+  AnytimeSearch<GlobalPlanner, NodeType> search(global_planner, s, t);
+  bool found_path = false;
+  int iter_left = max_iterations;
+  global_planner->overestimate_factor_ = max_overestimate_factor;
+  while (global_planner->overestimate_factor_ >= min_overestimate_factor &&
+         iter_left > 0 && SearchClock::now() < deadline) {
+    std::vector<Cell> new_path;
+    const MemoStats risk_cache_start = global_planner->risk_cache_.stats();
+    SearchInfo search_info =
+        search.improvePath(new_path, iter_left, deadline, visitor);
+    search_info.risk_cache =
+        global_planner->risk_cache_.stats() - risk_cache_start;
+    printSearchInfo(search_info, node_type,
+                    global_planner->overestimate_factor_);
+    if (!search_info.found_path) {
+      break;
+    }
+    PathInfo path_info = global_planner->getPathInfo(new_path);
+    printf("(cost: %2.2f, dist: %2.2f, risk: %2.2f, smooth: %2.2f) \n",
+           path_info.cost, path_info.dist, path_info.risk,
+           path_info.smoothness);
+    path = new_path;
+    found_path = true;
+    iter_left -= search_info.num_iter;
+    global_planner->overestimate_factor_ =
+        (global_planner->overestimate_factor_ - 1.0) / 4.0 + 1.0;
+  }
+  return found_path;
+}
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_ANYTIME_SEARCH_H_
@@ -2,6 +2,7 @@
 #define GLOBAL_PLANNER_CELL
 
 #include <math.h>  // abs
+#include <cstdint>
 #include <string>
 #include <tuple>
 
@@ -11,8 +12,13 @@
 
 namespace global_planner {
 
-double CELL_SCALE = 1.0;
+// Edge length of a Cell [m], defined in cell.cpp
+extern double CELL_SCALE;
 
+// The indices of a Cell are packed into a 64 bit key, 21 bits per index
+// offset by 2^20 to be non-negative. The indices are therefore limited to
+// [-2^20, 2^20). Keys compare in the order of the indices (x first), and
+// neighbors are found by adding the keys of the offsets.
 class Cell {
  public:
   Cell();
@@ -23,14 +29,14 @@ class Cell {
   // Cell(Eigen::Vector3d point);
 
   // Get the indices of the Cell
-  int xIndex() const;
-  int yIndex() const;
-  int zIndex() const;
+  int xIndex() const { return keyToIndex(key_ >> 42); }
+  int yIndex() const { return keyToIndex(key_ >> 21); }
+  int zIndex() const { return keyToIndex(key_); }
 
   // Get the coordinates of the center-point of the Cell
-  double xPos() const;
-  double yPos() const;
-  double zPos() const;
+  double xPos() const { return CELL_SCALE * (xIndex() + 0.5); }
+  double yPos() const { return CELL_SCALE * (yIndex() + 0.5); }
+  double zPos() const { return CELL_SCALE * (zIndex() + 0.5); }
 
   geometry_msgs::Point toPoint() const;
 
@@ -43,23 +49,55 @@ class Cell {
 
   Cell getNeighborFromYaw(double yaw) const;
   std::vector<Cell> getFlowNeighbors() const;
+  int getFlowNeighbors(Cell* neighbors) const;  // Writes 6 Cells, returns 6
   std::vector<Cell> getDiagonalNeighbors() const;
+  int getDiagonalNeighbors(Cell* neighbors) const;  // Writes 4, returns 4
   std::vector<Cell> getNeighbors() const;
+  int getNeighbors(Cell* neighbors) const;  // Writes 10 Cells, returns 10
+  Cell getCoarseCell(int level) const;
+  Cell getFineCell(int level) const;
 
   std::string asString() const;
 
-  // Member variables
-  std::tuple<int, int, int> tpl_;
+  uint64_t key() const { return key_; }
+  static Cell fromKey(uint64_t key) {
+    Cell cell;
+    cell.key_ = key;
+    return cell;
+  }
+
+  // The key of the indices, they are offset to be non-negative
+  static constexpr uint64_t indicesToKey(int x, int y, int z) {
+    return (static_cast<uint64_t>(x + kIndexOffset) & kIndexMask) << 42 |
+           (static_cast<uint64_t>(y + kIndexOffset) & kIndexMask) << 21 |
+           (static_cast<uint64_t>(z + kIndexOffset) & kIndexMask);
+  }
+  // Added to a key, it gives the key of the Cell at the offset. The borrows
+  // of negative offsets cancel as long as the indices stay within the limits.
+  static constexpr uint64_t offsetToKey(int dx, int dy, int dz) {
+    return (static_cast<uint64_t>(dx) << 42) +
+           (static_cast<uint64_t>(dy) << 21) + static_cast<uint64_t>(dz);
+  }
+
+ private:
+  static constexpr int kIndexOffset = 1 << 20;
+  static constexpr uint64_t kIndexMask = (uint64_t(1) << 21) - 1;
+
+  static int keyToIndex(uint64_t bits) {
+    return static_cast<int>(bits & kIndexMask) - kIndexOffset;
+  }
+
+  uint64_t key_ = indicesToKey(0, 0, 0);
 };
 
 inline bool operator==(const Cell& lhs, const Cell& rhs) {
-  return lhs.tpl_ == rhs.tpl_;
+  return lhs.key() == rhs.key();
 }
 inline bool operator!=(const Cell& lhs, const Cell& rhs) {
   return !operator==(lhs, rhs);
 }
 inline bool operator<(const Cell& lhs, const Cell& rhs) {
-  return lhs.tpl_ < rhs.tpl_;
+  return lhs.key() < rhs.key();
 }
 inline bool operator>(const Cell& lhs, const Cell& rhs) {
   return operator<(rhs, lhs);
@@ -116,11 +154,10 @@ namespace std {
 
 template <>
 struct hash<global_planner::Cell> {
+  // The keys are unique, and the standard containers take them modulo a prime
+  // number of buckets. Mixing the bits would only scatter neighboring Cells.
   std::size_t operator()(const global_planner::Cell& cell) const {
-    return (std::get<0>(cell.tpl_) << 20) ^ (std::get<1>(cell.tpl_) << 10) ^
-           std::get<2>(cell.tpl_);
-    // return (std::get<0>(cell.tpl_) * 18397) + (std::get<1>(cell.tpl_) *
-    // 20483) + (std::get<2>(cell.tpl_) * 29303);
+    return static_cast<std::size_t>(cell.key());
   }
 };
 
@@ -3,7 +3,9 @@
 
 #include <math.h>     // abs
 #include <algorithm>  // std::reverse
+#include <atomic>
 #include <limits>     // numeric_limits
+#include <memory>     // std::shared_ptr
 #include <queue>      // std::priority_queue
 #include <string>
 #include <tuple>
@@ -22,11 +24,16 @@
 #include <global_planner/GlobalPlannerNodeConfig.h>
 #include <global_planner/PathWithRiskMsg.h>
 #include "global_planner/analysis.h"
+#include "global_planner/anytime_search.h"
 #include "global_planner/bezier.h"
 #include "global_planner/cell.h"
 #include "global_planner/common.h"
 #include "global_planner/common_ros.h"
+#include "global_planner/map_tiles.h"
+#include "global_planner/memo_table.h"
 #include "global_planner/node.h"
+#include "global_planner/occupancy_map.h"
+#include "global_planner/risk_grid.h"
 #include "global_planner/search_tools.h"
 #include "global_planner/visitor.h"
 
@@ -34,7 +41,10 @@ namespace global_planner {
 
 class GlobalPlanner {
  public:
-  octomap::OcTree* octree_ = NULL;
+  std::shared_ptr<octomap::OcTree> octree_;  // Shared with copies of the
+                                             // planner, changes replace it
+  std::shared_ptr<const MapTiles> map_tiles_;  // Saved map of the site, the
+                                               // Cells of octree_ override it
   // std::vector<double> alt_prior_ {  1.0, 0.1, 0.05, 0.05, 0.05, 0.05, 0.05,
   // 0.05, 0.05, 0.05, 0.05, 0.05}; std::vector<double> alt_prior_ { 0.1, 0.1,
   // 0.1, 0.1, 0.1, 0.1, 0.1,
@@ -48,21 +58,38 @@ class GlobalPlanner {
   std::vector<double> accumulated_alt_prior_;  // accumulated_alt_prior_[i] =
                                                // sum(alt_prior_[0:i])
 
-  std::unordered_map<Cell, double> risk_cache_;  // Cache of getRisk(Cell)
-  std::unordered_map<Cell, double>
-      bubble_risk_cache_;  // Cache the risk of the safest path from Cell to t
-  std::unordered_map<Node, double> heuristic_cache_;  // Cache of
-                                                      // getHeuristic(Node) (and
-                                                      // later reverse search)
-  double bubble_cost_ = 0.0;  // Minimum risk for the safest path from a cell
-                              // outside of the bubble to t
-  double bubble_radius_ =
-      0.0;  // The maximum distance from a cell within the bubble to t
-
-  std::unordered_set<Cell>
-      occupied_;  // Cells which have at some point contained an obstacle point
+  MemoTable<Cell, double> risk_cache_;  // Cache of getRisk(Cell) outside of
+                                       // risk_grid_
+  RiskGrid risk_grid_;  // getRisk(Cell) of the explored planning volume
+  RiskGrid single_risk_grid_;  // getSingleCellRisk of risk_grid_ and its border
+  static const int kRiskGridMargin = 16;  // Cells around the explored area
+  RiskGrid reverse_cost_;  // Cost from a Cell to reverse_goal_, INFINITY if the
+                           // reverse search did not expand the Cell
+  Cell reverse_goal_ = Cell(0.5, 0.5, 0.5);
+  double reverse_bound_ = 0.0;  // Minimum cost from a Cell that is not in
+                                // reverse_cost_ to reverse_goal_
+  static const int kReverseSearchRadius = 32;  // XY-size of reverse_cost_
+  std::unordered_map<Cell, double> corridor_;  // Coarse Cells a search may
+                                              // enter and their distance to
+                                              // the goal along the coarse
+                                              // path, no limit if empty
+  int corridor_level_ = 0;  // Octree levels of corridor_ above the Cells
+  static const int kMinCoarsePathLength = 4;  // In coarse Cells
+  static const int kCoarseSearchMargin = 8;   // In coarse Cells
+
+  std::shared_ptr<OccupancyMap> occupied_ =
+      std::make_shared<OccupancyMap>();  // Cells which have at some point
+                                         // contained an obstacle point, shared
+                                         // like octree_
   std::unordered_set<Cell>
-      path_cells_;  // Cells that are on current path, and may not be blocked
+      changed_occupied_cells_;  // Added to or evicted from occupied_ since
+                                // the last map update
+  std::unordered_map<Cell, std::vector<int> >
+      path_cells_;  // Cells that are on current path, and the indices of the
+                    // path Nodes that contain them
+  std::vector<double> path_node_risk_;  // getRisk(Node) of curr_path_ from
+                                        // index 2 on
+  std::unordered_set<int> dirty_path_nodes_;  // Path Nodes whose risk changed
 
   // TODO: rename and remove not needed
   std::vector<Cell> path_back_;
@@ -72,7 +99,7 @@ class GlobalPlanner {
   GoalCell goal_pos_ = GoalCell(0.5, 0.5, 3.5);
   bool going_back_ = true;  // we start by just finding the start position
 
-  double overestimate_factor_ = max_overestimate_factor_;
+  double overestimate_factor_ = 2.0;  // max_overestimate_factor_ at start
   std::vector<Cell> curr_path_;
   PathInfo curr_path_info_;
   SearchVisitor<std::unordered_set<Cell>, std::unordered_map<Cell, double> >
@@ -94,6 +121,11 @@ class GlobalPlanner {
   double min_overestimate_factor_ = 1.03;
   double max_overestimate_factor_ = 2.0;
   int max_iterations_ = 2000;
+  bool use_reverse_search_ = false;
+  int reverse_search_iterations_ = 2000;
+  bool bidirectional_search_ = false;  // Stop at Cells of the reverse search
+  int hierarchical_levels_ = 0;  // Plan on a coarser octree level first
+  static const int kRepairMargin = 2;  // Path cells kept free around a repair
   bool goal_is_blocked_ = false;
   bool current_cell_blocked_ = false;
   bool goal_must_be_free_ =
@@ -102,11 +134,15 @@ class GlobalPlanner {
       true;  // The current orientation is factored into the smoothness
   bool use_risk_heuristics_ = true;
   bool use_speedup_heuristics_ = true;
-  std::string default_node_type_ = "SpeedNode";
+  SearchNodeType default_node_type_ = SearchNodeType::SpeedNode;
+  const std::atomic<bool>* cancel_search_ = nullptr;  // Searches stop early
+                                                     // once it is set
 
   GlobalPlanner();
   ~GlobalPlanner();
 
+  void copySearchInputs(const GlobalPlanner& planner);
+
   void calculateAccumulatedHeightPrior();
 
   void setPose(const geometry_msgs::PoseStamped& new_pose);
@@ -114,6 +150,37 @@ class GlobalPlanner {
   void setPath(const std::vector<Cell>& path);
 
   bool updateFullOctomap(const octomap_msgs::Octomap& msg);
+  bool updateOctomapRegion(const octomap_msgs::Octomap& msg);
+  bool loadMapTiles(const std::string& path);
+  bool saveMapTiles(const std::string& path) const;
+  void getChangedCells(const octomap::OcTree& prev, const octomap::OcTree& next,
+                       std::unordered_set<Cell>& changed_cells,
+                       bool only_removed = false);
+  void invalidateRisk(std::unordered_set<Cell>& changed_cells);
+  void invalidatePathRisk(const Cell& cell);
+  void resetRisk();
+  void buildRiskGrid();
+  double getGridRisk(const Cell& cell);
+
+  // Adds the Cells of the obstacle points of a cloud to occupied_
+  template <typename PointCloud>
+  void addOccupiedPoints(const PointCloud& cloud) {
+    std::vector<Cell> changed_cells;
+    unshareOccupied();
+    occupied_->insertPoints(cloud, changed_cells);
+    changed_occupied_cells_.insert(changed_cells.begin(),
+                                   changed_cells.end());
+  }
+  // Adds the Cells of keys from OccupancyMap::pointKeys to occupied_
+  void addOccupiedKeys(const std::vector<uint64_t>& keys) {
+    std::vector<Cell> changed_cells;
+    unshareOccupied();
+    occupied_->insertKeys(keys, changed_cells);
+    changed_occupied_cells_.insert(changed_cells.begin(),
+                                   changed_cells.end());
+  }
+  void unshareOccupied();
+  bool isCurrentPathOk();
 
   void getOpenNeighbors(const Cell& cell,
                         std::vector<CellDistancePair>& neighbors, bool is_3D);
@@ -121,9 +188,17 @@ class GlobalPlanner {
 
   double getEdgeDist(const Cell& u, const Cell& v);
   double getSingleCellRisk(const Cell& cell);
+  double getMeasuredRisk(const Cell& cell, double log_odds);
+  int getOctreeDepth() const;
   double getAltPrior(const Cell& cell);
   bool isOccupied(const Cell& cell);
+  bool isSearchCancelled() const {
+    return cancel_search_ && cancel_search_->load();
+  }
   bool isLegal(const Node& node);
+  bool isCoarseLegal(const Cell& coarse_cell, int level);
+  double getCoarseRisk(const Cell& coarse_cell, int level);
+  void setCorridor(const std::vector<Cell>& coarse_path, int level);
   double getRisk(const Cell& cell);
   double getRisk(const Node& node);
   double getRiskOfCurve(const std::vector<geometry_msgs::PoseStamped>& msg);
@@ -131,20 +206,27 @@ class GlobalPlanner {
   double getEdgeCost(const Node& u, const Node& v);
 
   double riskHeuristic(const Cell& u, const Cell& goal);
-  double riskHeuristicReverseCache(const Cell& u, const Cell& goal);
   double smoothnessHeuristic(const Node& u, const Cell& goal);
   double altitudeHeuristic(const Cell& u, const Cell& goal);
   double getHeuristic(const Node& u, const Cell& goal);
+  bool meetsReverseSearch(const Cell& cell, const Cell& goal);
 
   geometry_msgs::PoseStamped createPoseMsg(const Cell& cell, double yaw);
   nav_msgs::Path getPathMsg();
   nav_msgs::Path getPathMsg(const std::vector<Cell>& path);
+  void getPathMsg(const std::vector<Cell>& path, nav_msgs::Path& path_msg);
   PathWithRiskMsg getPathWithRiskMsg();
   PathInfo getPathInfo(const std::vector<Cell>& path);
 
-  NodePtr getStartNode(const Cell& start, const Cell& parent,
-                       const std::string& type);
+  bool anytimeSearch(SearchNodeType type, std::vector<Cell>& path,
+                     const Cell& start, const Cell& parent,
+                     const GoalCell& goal, double max_overestimate_factor,
+                     SearchClock::time_point deadline, int max_iterations);
+  SearchInfo searchPath(SearchNodeType type, std::vector<Cell>& path,
+                        const Cell& start, const Cell& parent,
+                        const GoalCell& goal, int max_iterations);
   bool findPath(std::vector<Cell>& path);
+  bool repairPath();
 
   bool getGlobalPath();
   void goBack();
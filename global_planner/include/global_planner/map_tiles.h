@@ -0,0 +1,303 @@
+#ifndef GLOBAL_PLANNER_MAP_TILES_H_
+#define GLOBAL_PLANNER_MAP_TILES_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "global_planner/cell.h"
+
+namespace global_planner {
+
+// Saved map of a site, read through a read-only memory mapping so that opening
+// it takes no time and only the tiles that are looked up are paged in. Like
+// OccupancyMap the Cells are grouped in tiles of 16 x 16 x 16 Cells, a tile
+// holds the octree log-odds of its Cells (NaN if unknown) and the bits of the
+// Cells which have been in occupied_.
+//
+// File layout, all in host byte order:
+//   Header
+//   uint64_t keys[num_tiles]  sorted, see tileKey()
+//   Tile tiles[num_tiles]     in the order of the keys
+class MapTiles {
+ public:
+  static const int kTileBits = 4;
+  static const int kTileSize = 1 << kTileBits;  // Cells per axis
+  static const int kTileCells = kTileSize * kTileSize * kTileSize;
+  static const int kTileWords = kTileCells / 64;
+
+  struct Tile {
+    float log_odds[kTileCells];
+    uint64_t occupied[kTileWords];
+  };
+
+  MapTiles() = default;
+  MapTiles(const MapTiles&) = delete;
+  MapTiles& operator=(const MapTiles&) = delete;
+  ~MapTiles() { close(); }
+
+  // Maps the file, returns false if it can not be read or was saved with a
+  // different Cell size
+  bool open(const std::string& path) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+        static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+      ::close(fd);
+      return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // The mapping keeps the file open
+    if (data == MAP_FAILED) {
+      return false;
+    }
+    // The lookups jump around the file, read-ahead would page in tiles far
+    // away from the planning corridor
+    madvise(data, st.st_size, MADV_RANDOM);
+    data_ = static_cast<const char*>(data);
+    size_ = st.st_size;
+
+    // The size of the index and the tiles is bounded by the file size before
+    // it is computed, a corrupt num_tiles must not overflow it
+    const Header& header = *reinterpret_cast<const Header*>(data_);
+    const std::size_t max_tiles =
+        (size_ - sizeof(Header)) / (sizeof(uint64_t) + sizeof(Tile));
+    if (std::memcmp(header.magic, magic(), sizeof(header.magic)) != 0 ||
+        header.version != kVersion || header.tile_size != kTileSize ||
+        header.cell_scale != CELL_SCALE || header.num_tiles > max_tiles) {
+      close();
+      return false;
+    }
+    const std::size_t index_end =
+        sizeof(Header) + header.num_tiles * sizeof(uint64_t);
+    keys_ = reinterpret_cast<const uint64_t*>(data_ + sizeof(Header));
+    tiles_ = reinterpret_cast<const Tile*>(data_ + index_end);
+    num_tiles_ = header.num_tiles;
+    return true;
+  }
+
+  void close() {
+    if (data_) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+    data_ = nullptr;
+    size_ = 0;
+    keys_ = nullptr;
+    tiles_ = nullptr;
+    num_tiles_ = 0;
+  }
+
+  bool empty() const { return num_tiles_ == 0; }
+  std::size_t numTiles() const { return num_tiles_; }
+
+  // Returns the tile containing the Cell with the indices x, y and z, nullptr
+  // if the map has no tile there
+  const Tile* findTile(int x, int y, int z) const {
+    const uint64_t key = tileKey(x, y, z);
+    const uint64_t* end = keys_ + num_tiles_;
+    const uint64_t* it = std::lower_bound(keys_, end, key);
+    if (it == end || *it != key) {
+      return nullptr;
+    }
+    return tiles_ + (it - keys_);
+  }
+
+  // Returns false if the log-odds of the Cell are unknown
+  bool find(const Cell& cell, float& log_odds) const {
+    const Tile* tile = findTile(cell.xIndex(), cell.yIndex(), cell.zIndex());
+    if (!tile) {
+      return false;
+    }
+    log_odds = tile->log_odds[cellIndex(cell.xIndex(), cell.yIndex(),
+                                        cell.zIndex())];
+    return !std::isnan(log_odds);
+  }
+
+  bool isOccupied(const Cell& cell) const {
+    const Tile* tile = findTile(cell.xIndex(), cell.yIndex(), cell.zIndex());
+    return tile && isOccupied(*tile, cellIndex(cell.xIndex(), cell.yIndex(),
+                                               cell.zIndex()));
+  }
+
+  // Highest known log-odds of the Cells from lo to hi, both included, returns
+  // false if none of them is known
+  bool findMax(const Cell& lo, const Cell& hi, float& log_odds) const {
+    bool found = false;
+    for (int z = lo.zIndex(); z <= hi.zIndex(); ++z) {
+      for (int y = lo.yIndex(); y <= hi.yIndex(); ++y) {
+        const Tile* tile = nullptr;
+        for (int x = lo.xIndex(); x <= hi.xIndex(); ++x) {
+          if (!tile || (x & (kTileSize - 1)) == 0) {
+            tile = findTile(x, y, z);
+          }
+          const float value = tile ? tile->log_odds[cellIndex(x, y, z)] : NAN;
+          if (!std::isnan(value) && (!found || value > log_odds)) {
+            log_odds = value;
+            found = true;
+          }
+        }
+      }
+    }
+    return found;
+  }
+
+  // Index of a Cell in the arrays of its tile
+  static int cellIndex(int x, int y, int z) {
+    const int mask = kTileSize - 1;
+    return (x & mask) | (y & mask) << kTileBits | (z & mask) << 2 * kTileBits;
+  }
+  static bool isOccupied(const Tile& tile, int index) {
+    return (tile.occupied[index >> 6] >> (index & 63)) & 1;
+  }
+
+  // Same packing as the tiles of OccupancyMap
+  static uint64_t tileKey(int x, int y, int z) {
+    return packKey(x >> kTileBits, y >> kTileBits, z >> kTileBits);
+  }
+
+ private:
+  friend class MapTilesWriter;
+
+  static const char* magic() { return "GPTILES"; }  // 8 bytes with the 0
+  static const uint32_t kVersion = 1;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t tile_size;
+    double cell_scale;
+    uint64_t num_tiles;
+  };
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+  const uint64_t* keys_ = nullptr;
+  const Tile* tiles_ = nullptr;
+  std::size_t num_tiles_ = 0;
+
+  static uint64_t packKey(int x, int y, int z) {
+    return (uint64_t(x + (1 << 20)) & 0x1FFFFF) << 42 |
+           (uint64_t(y + (1 << 20)) & 0x1FFFFF) << 21 |
+           (uint64_t(z + (1 << 20)) & 0x1FFFFF);
+  }
+};
+
+// Collects the Cells of the live map and writes them, merged with the tiles
+// of a previously saved map, to a new file. Only the tiles that were set are
+// kept in memory, the others are copied from the mapping.
+class MapTilesWriter {
+ public:
+  void setLogOdds(int x, int y, int z, float log_odds) {
+    getTile(x, y, z).log_odds[MapTiles::cellIndex(x, y, z)] = log_odds;
+  }
+  void setOccupied(int x, int y, int z) {
+    const int index = MapTiles::cellIndex(x, y, z);
+    getTile(x, y, z).occupied[index >> 6] |= uint64_t(1) << (index & 63);
+  }
+
+  std::size_t numTiles() const { return tiles_.size(); }
+
+  // Writes the tiles to path, the Cells which were not set keep the values of
+  // base. The file is replaced only once it is complete, so base may be a
+  // mapping of path itself.
+  bool save(const std::string& path, const MapTiles* base = nullptr) const {
+    // Merge the sorted keys of both maps
+    std::vector<uint64_t> keys;
+    keys.reserve(tiles_.size() + (base ? base->num_tiles_ : 0));
+    auto it = tiles_.begin();
+    for (std::size_t i = 0; base && i < base->num_tiles_; ++i) {
+      const uint64_t key = base->keys_[i];
+      for (; it != tiles_.end() && it->first < key; ++it) {
+        keys.push_back(it->first);
+      }
+      keys.push_back(key);
+      if (it != tiles_.end() && it->first == key) {
+        ++it;
+      }
+    }
+    for (; it != tiles_.end(); ++it) {
+      keys.push_back(it->first);
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    FILE* file = std::fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    MapTiles::Header header;
+    std::memcpy(header.magic, MapTiles::magic(), sizeof(header.magic));
+    header.version = MapTiles::kVersion;
+    header.tile_size = MapTiles::kTileSize;
+    header.cell_scale = CELL_SCALE;
+    header.num_tiles = keys.size();
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+    ok = ok && std::fwrite(keys.data(), sizeof(uint64_t), keys.size(),
+                           file) == keys.size();
+
+    MapTiles::Tile tile;
+    std::size_t base_index = 0;
+    for (std::size_t i = 0; ok && i < keys.size(); ++i) {
+      const MapTiles::Tile* base_tile = nullptr;
+      if (base && base_index < base->num_tiles_ &&
+          base->keys_[base_index] == keys[i]) {
+        base_tile = base->tiles_ + base_index;
+        ++base_index;
+      }
+      auto live = tiles_.find(keys[i]);
+      if (live == tiles_.end()) {
+        ok = std::fwrite(base_tile, sizeof(tile), 1, file) == 1;
+        continue;
+      }
+      tile = live->second;
+      if (base_tile) {
+        for (int c = 0; c < MapTiles::kTileCells; ++c) {
+          if (std::isnan(tile.log_odds[c])) {
+            tile.log_odds[c] = base_tile->log_odds[c];
+          }
+        }
+        for (int w = 0; w < MapTiles::kTileWords; ++w) {
+          tile.occupied[w] |= base_tile->occupied[w];
+        }
+      }
+      ok = std::fwrite(&tile, sizeof(tile), 1, file) == 1;
+    }
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  std::map<uint64_t, MapTiles::Tile> tiles_;  // Sorted like the file index
+
+  MapTiles::Tile& getTile(int x, int y, int z) {
+    auto inserted =
+        tiles_.emplace(MapTiles::tileKey(x, y, z), MapTiles::Tile());
+    MapTiles::Tile& tile = inserted.first->second;
+    if (inserted.second) {
+      std::fill(tile.log_odds, tile.log_odds + MapTiles::kTileCells, NAN);
+      std::fill(tile.occupied, tile.occupied + MapTiles::kTileWords, 0);
+    }
+    return tile;
+  }
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_MAP_TILES_H_
@@ -0,0 +1,162 @@
+#ifndef GLOBAL_PLANNER_MEMO_TABLE_H_
+#define GLOBAL_PLANNER_MEMO_TABLE_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace global_planner {
+
+// Lookups of a MemoTable
+struct MemoStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;  // Entries replaced to make room for a new one
+
+  double hitRate() const {
+    uint64_t lookups = hits + misses;
+    return lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+  }
+};
+
+inline MemoStats operator-(const MemoStats& lhs, const MemoStats& rhs) {
+  MemoStats diff;
+  diff.hits = lhs.hits - rhs.hits;
+  diff.misses = lhs.misses - rhs.misses;
+  diff.evictions = lhs.evictions - rhs.evictions;
+  return diff;
+}
+
+// Memoisation table of a fixed capacity. The slots are allocated once and
+// grouped into sets of kWays contiguous slots, a key can only be stored in its
+// set. A full set replaces its least recently used entry, so the memory stays
+// bounded and the table never rehashes.
+template <typename Key, typename Value, typename Hash = std::hash<Key> >
+class MemoTable {
+ public:
+  static const std::size_t kWays = 4;
+
+  explicit MemoTable(std::size_t capacity = 1 << 16) { setCapacity(capacity); }
+
+  // Allocates at least capacity slots, the entries are forgotten unless the
+  // number of slots stays the same
+  void setCapacity(std::size_t capacity) {
+    std::size_t sets = 1;
+    while (sets * kWays < capacity) {
+      sets *= 2;
+    }
+    if (sets * kWays != slots_.size()) {
+      set_mask_ = sets - 1;
+      slots_.resize(sets * kWays);
+      reset();
+    }
+  }
+
+  // Returns the value of key, or nullptr if it is not stored
+  const Value* find(const Key& key) {
+    startTick();
+    Slot* slot = findSlot(key);
+    if (!slot) {
+      stats_.misses++;
+      return nullptr;
+    }
+    stats_.hits++;
+    slot->last_use = ++tick_;
+    return &slot->value;
+  }
+
+  void insert(const Key& key, const Value& value) {
+    startTick();
+    Slot* slot = findSlot(key);
+    if (!slot) {
+      // Empty and cleared slots have the oldest uses of the set
+      Slot* set = &slots_[setIndex(key)];
+      slot = set;
+      for (std::size_t i = 1; i < kWays; ++i) {
+        if (set[i].last_use < slot->last_use) {
+          slot = &set[i];
+        }
+      }
+      if (isUsed(*slot)) {
+        stats_.evictions++;
+      } else {
+        size_++;
+      }
+      slot->key = key;
+    }
+    slot->value = value;
+    slot->last_use = ++tick_;
+  }
+
+  void erase(const Key& key) {
+    Slot* slot = findSlot(key);
+    if (slot) {
+      slot->last_use = 0;
+      size_--;
+    }
+  }
+
+  // Forgets all entries without touching the slots
+  void clear() {
+    clear_tick_ = tick_;
+    size_ = 0;
+  }
+
+  bool empty() const { return size_ == 0; }
+  std::size_t size() const { return size_; }
+  std::size_t capacity() const { return slots_.size(); }
+  const MemoStats& stats() const { return stats_; }
+
+ private:
+  struct Slot {
+    Key key = Key();
+    Value value = Value();
+    uint32_t last_use = 0;  // Tick of the last use, 0 for an empty slot
+  };
+  std::vector<Slot> slots_;
+  std::size_t set_mask_ = 0;
+  uint32_t tick_ = 0;
+  uint32_t clear_tick_ = 0;  // Slots last used up to it are empty
+  std::size_t size_ = 0;
+  MemoStats stats_;
+
+  bool isUsed(const Slot& slot) const { return slot.last_use > clear_tick_; }
+
+  void reset() {
+    slots_.assign(slots_.size(), Slot());
+    tick_ = 0;
+    clear_tick_ = 0;
+    size_ = 0;
+  }
+
+  void startTick() {
+    if (tick_ == UINT32_MAX) {
+      // The uses would wrap around, start over with empty slots
+      reset();
+    }
+  }
+
+  // Spreads neighboring keys over the sets. The indices of a Cell are in the
+  // high bits of its key, so all bits are folded into the low ones
+  std::size_t setIndex(const Key& key) const {
+    uint64_t h = static_cast<uint64_t>(Hash()(key));
+    h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDull;
+    h = (h ^ (h >> 33)) * 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return (static_cast<std::size_t>(h) & set_mask_) * kWays;
+  }
+
+  Slot* findSlot(const Key& key) {
+    Slot* set = &slots_[setIndex(key)];
+    for (std::size_t i = 0; i < kWays; ++i) {
+      if (isUsed(set[i]) && set[i].key == key) {
+        return &set[i];
+      }
+    }
+    return nullptr;
+  }
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_MEMO_TABLE_H_
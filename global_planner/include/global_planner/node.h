@@ -1,6 +1,9 @@
 #ifndef GLOBAL_PLANNER_NODE
 #define GLOBAL_PLANNER_NODE
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <string>
 #include <unordered_set>
 
@@ -9,6 +12,58 @@
 
 namespace global_planner {
 
+// A Cell and the offset to its parent packed into 64 bits, the value type the
+// search keeps its nodes in. The indices of the Cell are limited to 19, 19 and
+// 11 bits and the offset to [-15, 15] per axis, longer offsets are shortened
+// along their direction.
+class PackedNode {
+ public:
+  PackedNode() = default;
+  PackedNode(const Cell& cell, const Cell& parent) {
+    int dx = parent.xIndex() - cell.xIndex();
+    int dy = parent.yIndex() - cell.yIndex();
+    int dz = parent.zIndex() - cell.zIndex();
+    int max_offset =
+        std::max(std::abs(dx), std::max(std::abs(dy), std::abs(dz)));
+    if (max_offset > kMaxOffset) {
+      dx = dx * kMaxOffset / max_offset;
+      dy = dy * kMaxOffset / max_offset;
+      dz = dz * kMaxOffset / max_offset;
+    }
+    bits_ = field(cell.xIndex(), 19, 45) | field(cell.yIndex(), 19, 26) |
+            field(cell.zIndex(), 11, 15) | field(dx, 5, 10) |
+            field(dy, 5, 5) | field(dz, 5, 0);
+  }
+
+  Cell cell() const {
+    return Cell(std::tuple<int, int, int>(extract(19, 45), extract(19, 26),
+                                          extract(11, 15)));
+  }
+  Cell parent() const {
+    return Cell(std::tuple<int, int, int>(extract(19, 45) + extract(5, 10),
+                                          extract(19, 26) + extract(5, 5),
+                                          extract(11, 15) + extract(5, 0)));
+  }
+
+  uint64_t bits() const { return bits_; }
+  // Identifies the Cell only, for nodes which ignore their parent
+  uint64_t cellBits() const { return bits_ >> 15; }
+
+ private:
+  static const int kMaxOffset = 15;
+  uint64_t bits_ = 0;
+
+  static uint64_t field(int value, int width, int shift) {
+    return (static_cast<uint64_t>(value) & ((uint64_t(1) << width) - 1))
+           << shift;
+  }
+  // Sign extends the field by shifting it to the top of the word first
+  int extract(int width, int shift) const {
+    int64_t top = static_cast<int64_t>(bits_ << (64 - width - shift));
+    return static_cast<int>(top >> (64 - width));
+  }
+};
+
 class Node {
  public:
   Node() = default;
@@ -27,26 +82,48 @@ class Node {
   virtual double getXYRotation(const Node& other) const;
   std::string asString() const;
 
+  // Statically dispatched counterparts of nextNode, getNeighbors and isEqual
+  // for the search templated on the node type. The neighbor Cells are written
+  // to a buffer of kMaxNeighbors Cells, the count is returned.
+  static const int kMaxNeighbors = 16;
+  int getNeighborCells(Cell* cells) const;
+  static uint64_t searchKey(const PackedNode& node) { return node.bits(); }
+
   Cell cell_;
   Cell parent_;
 };
 
-bool operator==(const Node& lhs, const Node& rhs) { return lhs.isEqual(rhs); }
-bool operator<(const Node& lhs, const Node& rhs) { return lhs.isSmaller(rhs); }
-bool operator!=(const Node& lhs, const Node& rhs) {
+inline bool operator==(const Node& lhs, const Node& rhs) {
+  return lhs.isEqual(rhs);
+}
+inline bool operator<(const Node& lhs, const Node& rhs) {
+  return lhs.isSmaller(rhs);
+}
+inline bool operator!=(const Node& lhs, const Node& rhs) {
   return !operator==(lhs, rhs);
 }
-bool operator>(const Node& lhs, const Node& rhs) { return operator<(rhs, lhs); }
-bool operator<=(const Node& lhs, const Node& rhs) {
+inline bool operator>(const Node& lhs, const Node& rhs) {
+  return operator<(rhs, lhs);
+}
+inline bool operator<=(const Node& lhs, const Node& rhs) {
   return !operator>(lhs, rhs);
 }
-bool operator>=(const Node& lhs, const Node& rhs) {
+inline bool operator>=(const Node& lhs, const Node& rhs) {
   return !operator<(lhs, rhs);
 }
 
+// The node types a search can run with, default_node_type_ in the dynamic
+// reconfigure parameters
+enum class SearchNodeType { Node, NodeWithoutSmooth, SpeedNode };
+
+// Unknown names fall back to SearchNodeType::SpeedNode
+SearchNodeType toSearchNodeType(const std::string& name);
+std::string searchNodeTypeName(SearchNodeType type);
+
 typedef std::shared_ptr<Node> NodePtr;
 typedef std::pair<Node, double> NodeDistancePair;
 typedef std::pair<NodePtr, double> PointerNodeDistancePair;
+typedef std::pair<int, double> IndexNodeDistancePair;  // Index in a NodeTable
 
 class CompareDist {
  public:
@@ -60,6 +137,10 @@ class CompareDist {
                   const PointerNodeDistancePair& n2) {
     return n1.second > n2.second;
   }
+  bool operator()(const IndexNodeDistancePair& n1,
+                  const IndexNodeDistancePair& n2) {
+    return n1.second > n2.second;
+  }
 };
 
 // Node that only represents 3D position, ignores parent
@@ -79,9 +160,11 @@ class NodeWithoutSmooth : public Node {
   }
 
   double getRotation(const Node& other) const { return 0.0; }
+
+  static uint64_t searchKey(const PackedNode& node) { return node.cellBits(); }
 };
 
-double SPEEDNODE_RADIUS = 5.0;
+extern double SPEEDNODE_RADIUS;  // Defined in node.cpp
 // Node represents 3D position, orientation and speed
 // TODO: Needs to check the risk of Cells between cell and parent
 class SpeedNode : public Node {
@@ -106,6 +189,21 @@ class SpeedNode : public Node {
     }
     return neighbors;
   }
+
+  int getNeighborCells(Cell* cells) const {
+    Cell extrapolate_cell = (cell_ - parent_) + cell_;
+    int num_neighbors = 0;
+    cells[num_neighbors++] = extrapolate_cell;
+    Cell neighbor_cells[kMaxNeighbors];
+    int num_candidates = extrapolate_cell.getNeighbors(neighbor_cells);
+    for (int i = 0; i < num_candidates; ++i) {
+      double dist = cell_.distance3D(neighbor_cells[i]);
+      if (dist > 0 && dist < SPEEDNODE_RADIUS) {
+        cells[num_neighbors++] = neighbor_cells[i];
+      }
+    }
+    return num_neighbors;
+  }
 };
 
 struct HashNodePtr {
@@ -0,0 +1,87 @@
+#ifndef GLOBAL_PLANNER_NODE_TABLE_H_
+#define GLOBAL_PLANNER_NODE_TABLE_H_
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "global_planner/node.h"
+
+namespace global_planner {
+
+// Search state of every node an A* search has reached. The states are stored
+// contiguously and found through an open addressing table with linear
+// probing on the search key of the node, so a neighbor needs a single probe
+// sequence instead of one lookup per container.
+class NodeTable {
+ public:
+  struct Entry {
+    uint64_t key;     // Node::searchKey() of the node type
+    PackedNode node;  // Cell and parent of the best known path
+    double distance;  // Cost of the best known path from the start
+    int parent;       // Index of the predecessor, -1 for the start
+    bool closed;      // True once the node has been expanded
+  };
+
+  explicit NodeTable(std::size_t expected_nodes = 1024) {
+    std::size_t slots = 16;
+    while (slots < 2 * expected_nodes) {
+      slots *= 2;
+    }
+    slots_.assign(slots, -1);
+    entries_.reserve(expected_nodes);
+  }
+
+  // Returns the index of the entry with key, a new node is added with an
+  // infinite distance and without a parent
+  int findOrInsert(uint64_t key, const PackedNode& node) {
+    std::size_t mask = slots_.size() - 1;
+    for (std::size_t slot = mix(key) & mask;; slot = (slot + 1) & mask) {
+      int index = slots_[slot];
+      if (index < 0) {
+        index = static_cast<int>(entries_.size());
+        entries_.push_back(Entry{key, node, INFINITY, -1, false});
+        slots_[slot] = index;
+        // Keep the load factor at one half to keep the probe sequences short
+        if (2 * entries_.size() > slots_.size()) {
+          grow();
+        }
+        return index;
+      }
+      if (entries_[index].key == key) {
+        return index;
+      }
+    }
+  }
+
+  Entry& operator[](int index) { return entries_[index]; }
+  const Entry& operator[](int index) const { return entries_[index]; }
+  std::size_t size() const { return entries_.size(); }
+
+ private:
+  std::vector<Entry> entries_;
+  std::vector<int> slots_;  // Index into entries_, -1 for an empty slot
+
+  // Neighboring nodes differ in a few bits of their keys, spread them over
+  // the whole word before masking
+  static std::size_t mix(uint64_t key) {
+    uint64_t h = key * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(h ^ (h >> 32));
+  }
+
+  void grow() {
+    slots_.assign(2 * slots_.size(), -1);
+    std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = 0; i < entries_.size(); ++i) {
+      std::size_t slot = mix(entries_[i].key) & mask;
+      while (slots_[slot] >= 0) {
+        slot = (slot + 1) & mask;
+      }
+      slots_[slot] = static_cast<int>(i);
+    }
+  }
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_NODE_TABLE_H_
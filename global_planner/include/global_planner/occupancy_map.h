@@ -0,0 +1,244 @@
+#ifndef GLOBAL_PLANNER_OCCUPANCY_MAP_H_
+#define GLOBAL_PLANNER_OCCUPANCY_MAP_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "global_planner/cell.h"
+
+namespace global_planner {
+
+// Set of Cells stored as one bit per Cell. The Cells are grouped in tiles of
+// 16 x 16 x 16 Cells, a tile is a 512 byte bitmap which is only allocated
+// once one of its Cells is inserted. When insertKeys() exceeds max_tiles, the
+// tiles which have not been written to for the longest time are dropped, and
+// their Cells are reported as changed like the inserted ones.
+class OccupancyMap {
+ public:
+  static const int kTileBits = 4;
+  static const int kTileSize = 1 << kTileBits;  // Cells per axis
+  static const int kTileWords = kTileSize * kTileSize * kTileSize / 64;
+
+  explicit OccupancyMap(std::size_t max_tiles = 1 << 16)
+      : max_tiles_(std::max<std::size_t>(1, max_tiles)) {}
+
+  // Returns true iff the Cell was not in the map before. Tiles are only
+  // dropped by insertKeys()
+  bool insert(const Cell& cell) {
+    return insert(cell.xIndex(), cell.yIndex(), cell.zIndex());
+  }
+  bool insert(int x, int y, int z) {
+    // Every write gets its own count, so the age of two tiles never ties
+    Tile& tile = getTile(tileKey(x, y, z));
+    tile.last_write = ++write_count_;
+    uint64_t& word = tile.words[bitIndex(x, y, z) >> 6];
+    const uint64_t bit = uint64_t(1) << (bitIndex(x, y, z) & 63);
+    if (word & bit) {
+      return false;
+    }
+    word |= bit;
+    ++size_;
+    return true;
+  }
+
+  bool contains(const Cell& cell) const {
+    return contains(cell.xIndex(), cell.yIndex(), cell.zIndex());
+  }
+  bool contains(int x, int y, int z) const {
+    auto it = tiles_.find(tileKey(x, y, z));
+    if (it == tiles_.end()) {
+      return false;
+    }
+    const int bit = bitIndex(x, y, z);
+    return (it->second.words[bit >> 6] >> (bit & 63)) & 1;
+  }
+
+  // Inserts the Cells of a cloud of points (anything with x, y and z), points
+  // which are not finite or out of the range of a key are skipped. The keys
+  // of all points are computed in one pass and deduplicated before any tile
+  // is touched. The Cells that were not in the map before, and the Cells of
+  // the tiles that were dropped to make room, are appended to changed_cells.
+  template <typename PointCloud>
+  void insertPoints(const PointCloud& cloud,
+                    std::vector<Cell>& changed_cells) {
+    pointKeys(cloud, keys_);
+    insertKeys(keys_, changed_cells);
+  }
+
+  // Writes the sorted keys of the distinct Cells of a cloud to keys. It does
+  // not touch a map, so it can run without the lock of the map.
+  template <typename PointCloud>
+  static void pointKeys(const PointCloud& cloud, std::vector<uint64_t>& keys) {
+    // Without branches on the points, NaN, infinite and far away points get
+    // an invalid key. The indices of a key have 21 bits, larger ones would
+    // alias Cells on the other side of the map
+    keys.resize(cloud.size());
+    const double scale = CELL_SCALE;
+    const double max_index = 1 << 20;
+    std::size_t i = 0;
+    for (const auto& p : cloud) {
+      // Same rounding as the Cell constructor
+      const double x = p.x / scale;
+      const double y = p.y / scale;
+      const double z = p.z / scale;
+      // NaN fails every comparison
+      const bool is_valid = (std::fabs(x) < max_index) &
+                            (std::fabs(y) < max_index) &
+                            (std::fabs(z) < max_index);
+      const uint64_t key = cellKey(floorToInt(is_valid ? x : 0.0),
+                                   floorToInt(is_valid ? y : 0.0),
+                                   floorToInt(is_valid ? z : 0.0));
+      keys[i++] = is_valid ? key : uint64_t(kInvalidKey);
+    }
+
+    // Adjacent points of a depth image mostly fall in the same Cell, dropping
+    // repeated keys removes most duplicates before sorting
+    std::size_t n = 0;
+    for (std::size_t j = 0; j < keys.size(); ++j) {
+      if (keys[j] != kInvalidKey && (n == 0 || keys[n - 1] != keys[j])) {
+        keys[n++] = keys[j];
+      }
+    }
+    keys.resize(n);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  }
+
+  // Inserts the Cells of keys from pointKeys(), the Cells that were not in the
+  // map before and the Cells of evicted tiles are appended to changed_cells
+  void insertKeys(const std::vector<uint64_t>& keys,
+                  std::vector<Cell>& changed_cells) {
+    // Only the distinct Cells of the cloud reach the tiles
+    for (uint64_t key : keys) {
+      const int x = keyToIndex(key >> 42);
+      const int y = keyToIndex(key >> 21);
+      const int z = keyToIndex(key);
+      if (insert(x, y, z)) {
+        changed_cells.push_back(Cell(std::tuple<int, int, int>(x, y, z)));
+      }
+    }
+    evictTiles(changed_cells);
+  }
+
+  // Calls f(x, y, z) with the indices of every Cell in the map
+  template <typename Function>
+  void forEach(Function f) const {
+    for (const auto& tile : tiles_) {
+      forEachInTile(tile.first, tile.second, f);
+    }
+  }
+
+  void clear() {
+    tiles_.clear();
+    size_ = 0;
+  }
+
+  std::size_t size() const { return size_; }  // Number of Cells
+  std::size_t numTiles() const { return tiles_.size(); }
+  std::size_t memoryUsage() const { return tiles_.size() * sizeof(Tile); }
+
+ private:
+  struct Tile {
+    uint64_t words[kTileWords] = {};
+    uint64_t last_write = 0;
+  };
+
+  // Tile keys are already spread over the whole word by tileKey()
+  struct KeyHash {
+    std::size_t operator()(uint64_t key) const {
+      return static_cast<std::size_t>(key * 0x9E3779B97F4A7C15ull >> 16);
+    }
+  };
+
+  std::unordered_map<uint64_t, Tile, KeyHash> tiles_;
+  std::size_t max_tiles_;
+  std::size_t size_ = 0;
+  uint64_t write_count_ = 0;
+  std::vector<uint64_t> keys_;  // Reused by insertPoints
+  static const uint64_t kInvalidKey = ~uint64_t(0);  // Not a cellKey()
+
+  // 21 bits per axis, the indices are offset to be non-negative
+  static uint64_t cellKey(int x, int y, int z) {
+    return (uint64_t(x + (1 << 20)) & 0x1FFFFF) << 42 |
+           (uint64_t(y + (1 << 20)) & 0x1FFFFF) << 21 |
+           (uint64_t(z + (1 << 20)) & 0x1FFFFF);
+  }
+  // std::floor() is a library call without SSE4.1
+  static int floorToInt(double value) {
+    const int truncated = static_cast<int>(value);
+    return truncated - (value < truncated);
+  }
+  static int keyToIndex(uint64_t bits) {
+    return static_cast<int>(bits & 0x1FFFFF) - (1 << 20);
+  }
+  static uint64_t tileKey(int x, int y, int z) {
+    // Arithmetic shifts round negative indices down
+    return cellKey(x >> kTileBits, y >> kTileBits, z >> kTileBits);
+  }
+  static int bitIndex(int x, int y, int z) {
+    const int mask = kTileSize - 1;
+    return (x & mask) | (y & mask) << kTileBits | (z & mask) << 2 * kTileBits;
+  }
+
+  Tile& getTile(uint64_t key) { return tiles_[key]; }
+
+  template <typename Function>
+  static void forEachInTile(uint64_t key, const Tile& tile, Function f) {
+    const int mask = kTileSize - 1;
+    const int x = keyToIndex(key >> 42) * kTileSize;
+    const int y = keyToIndex(key >> 21) * kTileSize;
+    const int z = keyToIndex(key) * kTileSize;
+    for (int w = 0; w < kTileWords; ++w) {
+      for (uint64_t word = tile.words[w]; word; word &= word - 1) {
+        const int bit = w * 64 + __builtin_ctzll(word);
+        f(x + (bit & mask), y + (bit >> kTileBits & mask),
+          z + (bit >> 2 * kTileBits));
+      }
+    }
+  }
+
+  // Drops the least recently written tiles until an eighth of max_tiles is
+  // free again, so that the scan is only needed every few frames. This
+  // includes tiles of the current batch if it alone exceeds max_tiles. The
+  // Cells of the dropped tiles are appended to removed_cells.
+  void evictTiles(std::vector<Cell>& removed_cells) {
+    if (tiles_.size() <= max_tiles_) {
+      return;
+    }
+    std::vector<uint64_t> ages;
+    ages.reserve(tiles_.size());
+    for (const auto& tile : tiles_) {
+      ages.push_back(tile.second.last_write);
+    }
+    const std::size_t keep = max_tiles_ - max_tiles_ / 8;
+    std::nth_element(ages.begin(), ages.end() - keep, ages.end());
+    const uint64_t oldest_kept = *(ages.end() - keep);
+    for (auto it = tiles_.begin(); it != tiles_.end();) {
+      if (it->second.last_write < oldest_kept) {
+        size_ -= countCells(it->second);
+        forEachInTile(it->first, it->second, [&](int x, int y, int z) {
+          removed_cells.push_back(Cell(std::tuple<int, int, int>(x, y, z)));
+        });
+        it = tiles_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  static std::size_t countCells(const Tile& tile) {
+    std::size_t count = 0;
+    for (uint64_t word : tile.words) {
+      count += __builtin_popcountll(word);
+    }
+    return count;
+  }
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_OCCUPANCY_MAP_H_
@@ -0,0 +1,80 @@
+#ifndef GLOBAL_PLANNER_RISK_GRID_H_
+#define GLOBAL_PLANNER_RISK_GRID_H_
+
+#include <tuple>
+#include <vector>
+
+#include "global_planner/cell.h"
+
+namespace global_planner {
+
+// Dense grid of values over an axis aligned box of Cells. The values are
+// stored x-major in one flat array, so reading the value of a Cell is a bounds
+// check and a single indexed load.
+class RiskGrid {
+ public:
+  // Resizes the grid to the Cells from min to max, both included, and sets
+  // every value to value
+  void reset(const Cell& min, const Cell& max, double value = 0.0) {
+    min_ = min;
+    max_ = max;
+    size_x_ = max.xIndex() - min.xIndex() + 1;
+    size_y_ = max.yIndex() - min.yIndex() + 1;
+    int size_z = max.zIndex() - min.zIndex() + 1;
+    if (size_x_ <= 0 || size_y_ <= 0 || size_z <= 0) {
+      clear();
+      return;
+    }
+    values_.assign(static_cast<std::size_t>(size_x_) * size_y_ * size_z,
+                   value);
+  }
+
+  void clear() {
+    values_.clear();
+    size_x_ = 0;
+    size_y_ = 0;
+  }
+
+  bool empty() const { return values_.empty(); }
+
+  bool contains(int x, int y, int z) const {
+    return !values_.empty() && min_.xIndex() <= x && x <= max_.xIndex() &&
+           min_.yIndex() <= y && y <= max_.yIndex() && min_.zIndex() <= z &&
+           z <= max_.zIndex();
+  }
+  bool contains(const Cell& cell) const {
+    return contains(cell.xIndex(), cell.yIndex(), cell.zIndex());
+  }
+
+  // The Cell has to be contained in the grid
+  double& at(int x, int y, int z) { return values_[index(x, y, z)]; }
+  double at(int x, int y, int z) const { return values_[index(x, y, z)]; }
+  double& operator[](const Cell& cell) {
+    return at(cell.xIndex(), cell.yIndex(), cell.zIndex());
+  }
+  double operator[](const Cell& cell) const {
+    return at(cell.xIndex(), cell.yIndex(), cell.zIndex());
+  }
+
+  const Cell& min() const { return min_; }
+  const Cell& max() const { return max_; }
+  std::size_t size() const { return values_.size(); }
+
+ private:
+  Cell min_ = Cell(std::tuple<int, int, int>(0, 0, 0));
+  Cell max_ = Cell(std::tuple<int, int, int>(0, 0, 0));
+  int size_x_ = 0;
+  int size_y_ = 0;
+  std::vector<double> values_;
+
+  std::size_t index(int x, int y, int z) const {
+    return (static_cast<std::size_t>(z - min_.zIndex()) * size_y_ +
+            (y - min_.yIndex())) *
+               size_x_ +
+           (x - min_.xIndex());
+  }
+};
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_RISK_GRID_H_
@@ -5,7 +5,10 @@
 
 #include "global_planner/bezier.h"
 #include "global_planner/cell.h"
+#include "global_planner/memo_table.h"
 #include "global_planner/node.h"
+#include "global_planner/node_table.h"
+#include "global_planner/risk_grid.h"
 #include "global_planner/visitor.h"
 
 // This file consists of general search tools
@@ -29,6 +32,7 @@ struct SearchInfo {
   bool found_path;
   int num_iter;
   double search_time;  // in micro seconds
+  MemoStats risk_cache;  // Lookups of the risk cache during the search
 };
 
 void printSearchInfo(SearchInfo info, std::string node_type = "Node",
@@ -37,21 +41,27 @@ void printSearchInfo(SearchInfo info, std::string node_type = "Node",
   std::cout << std::setw(20) << std::left << node_type << std::setw(10)
             << std::setprecision(3) << avg_time << std::setw(10)
             << std::setprecision(3) << overestimate_factor << std::setw(10)
-            << info.num_iter << std::setw(10) << 0.0;
+            << info.num_iter << std::setw(10) << 0.0 << std::setw(10)
+            << std::setprecision(3) << info.risk_cache.hitRate();
 }
 
 // Returns a path where corners are smoothed with quadratic Bezier-curves
-nav_msgs::Path smoothPath(const nav_msgs::Path& path) {
+// Writes path with Bezier curves in the corners to smooth_path, reusing its
+// poses instead of allocating a curve for every corner
+void smoothPath(const nav_msgs::Path& path, nav_msgs::Path& smooth_path,
+                int num_steps = 10) {
   if (path.poses.size() < 3) {
-    return path;
+    smooth_path = path;
+    return;
   }
 
-  nav_msgs::Path smooth_path;
   smooth_path.header = path.header;
+  smooth_path.poses.resize((path.poses.size() - 2) * (num_steps + 1) + 2);
 
   // Repeat the first and last points to get the first half of the first edge
   // and the second half of the last edge
-  smooth_path.poses.push_back((path.poses.front()));
+  size_t n = 0;
+  smooth_path.poses[n++] = path.poses.front();
   for (int i = 2; i < path.poses.size(); i++) {
     geometry_msgs::Point p0 = path.poses[i - 2].pose.position;
     geometry_msgs::Point p1 = path.poses[i - 1].pose.position;
@@ -59,160 +69,222 @@ nav_msgs::Path smoothPath(const nav_msgs::Path& path) {
     p0 = middlePoint(p0, p1);
     p2 = middlePoint(p1, p2);
 
-    std::vector<geometry_msgs::Point> smooth_turn =
-        threePointBezier(p0, p1, p2);
-    for (const auto& point : smooth_turn) {
-      geometry_msgs::PoseStamped pose_msg =
-          path.poses.front();  // Copy the original header info
-      pose_msg.pose.position = point;
-      smooth_path.poses.push_back(pose_msg);
+    for (int step = 0; step <= num_steps; ++step) {
+      double t = static_cast<double>(step) / num_steps;
+      geometry_msgs::PoseStamped& pose_msg = smooth_path.poses[n++];
+      pose_msg = path.poses.front();  // Copy the original header info
+      pose_msg.pose.position.x = quadraticBezier(p0.x, p1.x, p2.x, t);
+      pose_msg.pose.position.y = quadraticBezier(p0.y, p1.y, p2.y, t);
+      pose_msg.pose.position.z = quadraticBezier(p0.z, p1.z, p2.z, t);
     }
   }
-  smooth_path.poses.push_back((path.poses.back()));
+  smooth_path.poses[n++] = path.poses.back();
+}
+
+nav_msgs::Path smoothPath(const nav_msgs::Path& path) {
+  nav_msgs::Path smooth_path;
+  smoothPath(path, smooth_path);
   return smooth_path;
 }
 
-// Returns a simpler path without increasing the cost much. It iteratively
-// removes the vertices which can be removed without increasing the cost by more
-// than simplify_margin
+// Returns true if no Cell on the straight way from u to v has a risk of
+// max_risk or more. The Cells are sampled like in Node::getCells, without
+// collecting them in a set
+template <typename GlobalPlanner>
+bool isInLineOfSight(GlobalPlanner* global_planner, const Cell& u,
+                     const Cell& v, double max_risk) {
+  int dx = v.xIndex() - u.xIndex();
+  int dy = v.yIndex() - u.yIndex();
+  int dz = v.zIndex() - u.zIndex();
+  int steps = 2 * std::max(std::abs(dx), std::max(std::abs(dy), std::abs(dz)));
+  double x_step = steps > 0 ? (v.xPos() - u.xPos()) / steps : 0.0;
+  double y_step = steps > 0 ? (v.yPos() - u.yPos()) / steps : 0.0;
+  double z_step = steps > 0 ? (v.zPos() - u.zPos()) / steps : 0.0;
+  for (int i = 1; i <= steps; ++i) {
+    double x = u.xPos() + x_step * i;
+    double y = u.yPos() + y_step * i;
+    double z = u.zPos() + z_step * i;
+    const Cell cells[4] = {
+        Cell(x + 0.1, y + 0.1, z), Cell(x + 0.1, y - 0.1, z),
+        Cell(x - 0.1, y + 0.1, z), Cell(x - 0.1, y - 0.1, z)};
+    for (const Cell& cell : cells) {
+      if (global_planner->getRisk(cell) >= max_risk) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Writes a simpler path without increasing the cost much to simple_path. In a
+// single pass, the path is pulled straight from the last kept vertex to the
+// furthest of the next max_lookahead vertices which is in line of sight, i.e.
+// no Cell on the way is riskier than max_cell_risk_, and whose edge costs at
+// most simplify_margin times the edges it replaces. The costs are the edge
+// costs of the search, getEdgeCost(), so a shortcut includes the distance,
+// the up and down costs, the risk and the turn from the previous edge. The
+// costs along the path are computed once into path_costs, simple_path and
+// path_costs are reused between calls. max_lookahead bounds the Cells sampled
+// per vertex on long straight paths
 template <typename GlobalPlanner>
-std::vector<Cell> simplifyPath(GlobalPlanner* global_planner,
-                               std::vector<Cell>& path,
-                               double simplify_margin = 1.01,
-                               double max_iter = 100,
-                               bool decelerate_at_end = true) {
+void simplifyPath(GlobalPlanner* global_planner, const std::vector<Cell>& path,
+                  std::vector<Cell>& simple_path,
+                  std::vector<double>& path_costs,
+                  double simplify_margin = 1.01,
+                  bool decelerate_at_end = true, size_t max_lookahead = 16) {
   if (path.size() < 3) {
     // Can not simplify a trivial path
-    return path;
+    simple_path = path;
+    return;
   }
 
-  // Start with the original path
-  std::vector<Cell> curr_path = path;
-  for (int j = 0; j < max_iter; ++j) {
-    // The first two vertices cannot be removed
-    std::vector<Cell> simple_path{curr_path[0], curr_path[1]};
-    int i = 3;
-    for (; i < curr_path.size(); i += 2) {
-      Node parent(curr_path[i - 2], curr_path[i - 3]);
-      Node u(curr_path[i - 1], curr_path[i - 2]);
-      Node v(curr_path[i], curr_path[i - 1]);
-      Node w(curr_path[i], curr_path[i - 2]);
-      // w is the new edge instead of u and v
-      double curr_cost = global_planner->getEdgeCost(parent, u) +
-                         global_planner->getEdgeCost(u, v);
-      double new_cost = global_planner->getEdgeCost(parent, w);
-      if (new_cost > simplify_margin * curr_cost) {
-        // The cost of w is too high, can't simplify this part of the path
-        simple_path.push_back(curr_path[i - 1]);
-      }
-      simple_path.push_back(curr_path[i]);
-    }
-
-    // Make sure to add the last vertex
-    if (i == curr_path.size()) {
-      simple_path.push_back(curr_path[i - 1]);
-    }
+  // path_costs[i] is the cost from the second vertex of the path to vertex i
+  path_costs.resize(path.size());
+  path_costs[0] = 0.0;
+  path_costs[1] = 0.0;
+  for (size_t i = 2; i < path.size(); ++i) {
+    path_costs[i] =
+        path_costs[i - 1] +
+        global_planner->getEdgeCost(Node(path[i - 1], path[i - 2]),
+                                    Node(path[i], path[i - 1]));
+  }
 
-    if (simple_path.size() == curr_path.size()) {
-      // Last iteration didn't remove any vertices, can't simplify more
-      break;
+  // The first two vertices cannot be removed
+  simple_path.assign(path.begin(), path.begin() + 2);
+  size_t anchor = 1;
+  while (anchor + 1 < path.size()) {
+    const Node parent(simple_path.back(), simple_path[simple_path.size() - 2]);
+    const size_t last = std::min(path.size() - 1, anchor + max_lookahead);
+    size_t furthest = anchor + 1;
+    for (size_t j = anchor + 2; j <= last; ++j) {
+      double path_cost = path_costs[j] - path_costs[anchor];
+      double straight_cost =
+          global_planner->getEdgeCost(parent, Node(path[j], path[anchor]));
+      if (straight_cost <= simplify_margin * path_cost &&
+          isInLineOfSight(global_planner, path[anchor], path[j],
+                          global_planner->max_cell_risk_)) {
+        furthest = j;
+      }
     }
-    curr_path = simple_path;
+    simple_path.push_back(path[furthest]);
+    anchor = furthest;
   }
 
   if (decelerate_at_end) {
     // Doubling the last point gives a triplet which stops at the end
-    curr_path.push_back(curr_path.back());
+    simple_path.push_back(simple_path.back());
   }
-  return curr_path;
 }
 
-template <typename GlobalPlanner>
+template <typename GlobalPlanner, typename NodeType>
 SearchInfo findSmoothPath(GlobalPlanner* global_planner,
-                          std::vector<Cell>& path, const NodePtr& s,
+                          std::vector<Cell>& path, const NodeType& s,
                           const GoalCell& t, int max_iterations = 2000) {
   NullVisitor visitor;
   return findSmoothPath(global_planner, path, s, t, max_iterations, visitor);
 }
 
-// A* to find a path from start to t, true iff it found a path
-template <typename GlobalPlanner, typename Visitor>
+// A* to find a path from start to t, true iff it found a path. NodeType is
+// Node or one of its subclasses, its neighbors and search key are resolved at
+// compile time and the nodes are kept as PackedNode values, so an expansion
+// does not allocate.
+template <typename GlobalPlanner, typename NodeType, typename Visitor>
 SearchInfo findSmoothPath(GlobalPlanner* global_planner,
-                          std::vector<Cell>& path, const NodePtr& s,
+                          std::vector<Cell>& path, const NodeType& s,
                           const GoalCell& t, int max_iterations,
                           Visitor& visitor) {
   // Initialize containers
-  NodePtr best_goal_node;
+  int best_goal_index = -1;
   visitor.init();
 
-  std::unordered_set<NodePtr, HashNodePtr, EqualsNodePtr> seen_nodes;
-  std::unordered_map<NodePtr, NodePtr, HashNodePtr, EqualsNodePtr> parent;
-  std::unordered_map<NodePtr, double, HashNodePtr, EqualsNodePtr> distance;
-  std::priority_queue<PointerNodeDistancePair,
-                      std::vector<PointerNodeDistancePair>, CompareDist>
-      pq;
-  pq.push(std::make_pair(s, 0.0));
-  distance[s] = 0.0;
+  // Every expanded node reaches about ten neighbors, larger searches grow
+  // the containers
+  const std::size_t expected_nodes = std::min(10 * max_iterations, 1 << 12);
+  NodeTable nodes(expected_nodes);
+  std::vector<IndexNodeDistancePair> pq_storage;
+  pq_storage.reserve(expected_nodes);
+  std::priority_queue<IndexNodeDistancePair,
+                      std::vector<IndexNodeDistancePair>, CompareDist>
+      pq(CompareDist(), std::move(pq_storage));
+  const PackedNode s_packed(s.cell_, s.parent_);
+  int s_index = nodes.findOrInsert(NodeType::searchKey(s_packed), s_packed);
+  nodes[s_index].distance = 0.0;
+  pq.push(std::make_pair(s_index, 0.0));
   int num_iter = 0;
+  Cell neighbor_cells[NodeType::kMaxNeighbors];
 
   std::clock_t start_time = std::clock();
   while (!pq.empty() && num_iter < max_iterations) {
-    PointerNodeDistancePair u_node_dist = pq.top();
+    if ((num_iter & 63) == 63 && global_planner->isSearchCancelled()) {
+      break;
+    }
+    int u_index = pq.top().first;
     pq.pop();
-    NodePtr u = u_node_dist.first;
-    if (seen_nodes.find(u) != seen_nodes.end()) {
+    if (nodes[u_index].closed) {
       continue;
     }
-    seen_nodes.insert(u);
+    nodes[u_index].closed = true;
+    // The packed offset of the start may be shortened, use the original
+    const NodeType u = u_index == s_index
+                           ? s
+                           : NodeType(nodes[u_index].node.cell(),
+                                      nodes[u_index].node.parent());
+    const double u_dist = nodes[u_index].distance;
     visitor.popNode(u);
 
-    if (t.withinPlanRadius(u->cell_)) {
-      best_goal_node = u;
-      break;  // Found a path
+    if (t.withinPlanRadius(u.cell_) ||
+        global_planner->meetsReverseSearch(u.cell_, t)) {
+      best_goal_index = u_index;
+      break;  // Found a path, or the rest of it from the reverse search
     }
     num_iter++;
 
-    for (const NodePtr& v : u->getNeighbors()) {
-      if (!global_planner->isLegal(*v)) {
+    int num_neighbors = u.getNeighborCells(neighbor_cells);
+    for (int i = 0; i < num_neighbors; ++i) {
+      const NodeType v(neighbor_cells[i], u.cell_);
+      if (!global_planner->isLegal(v)) {
         continue;
       }
-      double new_dist = distance[u] + global_planner->getEdgeCost(*u, *v);
-      double old_dist = getWithDefault(distance, v, INFINITY);
-      if (new_dist < old_dist) {
-        // Found a better path to v, have to add v to the queue
-        parent[v] = u;
-        distance[v] = new_dist;
+      // The table may grow, so entries are only accessed through the index
+      const PackedNode v_packed(v.cell_, v.parent_);
+      int v_index = nodes.findOrInsert(NodeType::searchKey(v_packed), v_packed);
+      if (nodes[v_index].closed) {
+        continue;
+      }
+      double new_dist = u_dist + global_planner->getEdgeCost(u, v);
+      if (new_dist < nodes[v_index].distance) {
+        // Found a better path to v, have to add v to the queue. Nodes which
+        // ignore their parent in comparisons keep the parent of the best path
+        nodes[v_index].node = v_packed;
+        nodes[v_index].parent = u_index;
+        nodes[v_index].distance = new_dist;
         // TODO: try Dynamic Weighting instead of a constant overestimate_factor
         double overestimated_heuristic =
-            new_dist + global_planner->getHeuristic(*v, t);
-        pq.push(PointerNodeDistancePair(v, overestimated_heuristic));
+            new_dist + global_planner->getHeuristic(v, t);
+        pq.push(IndexNodeDistancePair(v_index, overestimated_heuristic));
         visitor.perNeighbor(u, v);
       }
     }
   }
   double total_time = clocksToMicroSec(start_time, std::clock());
-  // printf("%2.2f" total_time);
-  double average_iter_time = total_time / num_iter;
 
-  if (best_goal_node == nullptr || !t.withinPlanRadius(best_goal_node->cell_)) {
+  if (best_goal_index < 0) {
     return SearchInfo(false, num_iter, total_time);  // No path found
   }
 
   // Get the path by walking from t back to s (excluding s)
-  NodePtr walker = best_goal_node;
-  while (walker != s) {
-    path.push_back(walker->cell_);
-    walker = parent[walker];
+  for (int walker = best_goal_index; walker != s_index;
+       walker = nodes[walker].parent) {
+    path.push_back(nodes[walker].node.cell());
   }
-  path.push_back(s->cell_);
-  path.push_back(s->parent_);
+  path.push_back(s.cell_);
+  path.push_back(s.parent_);
   std::reverse(path.begin(), path.end());
+  if (!t.withinPlanRadius(path.back()) &&
+      !followReverseSearch(global_planner, path)) {
+    return SearchInfo(false, num_iter, total_time);
+  }
 
-  // printPathStats(this, path, s->parent_, s->cell_, t,
-  // distance[best_goal_node]); ROS_INFO("Found path with %d iterations,
-  // itDistSquared: %.3f", num_iter, num_iter / squared(path.size())); printf("
-  // %2.1f µs \t\t %d \t\t %2.2f \t", average_iter_time, num_iter,
-  // distance[best_goal_node]);
   return SearchInfo(true, num_iter, total_time);
 }
 
@@ -246,44 +318,216 @@ bool find2DPath(GlobalPlanner* global_planner, std::vector<Cell>& path,
   return false;
 }
 
-// TODO: Run search backwards to quickly find impossible scenarios and/or find
-// exact heuristics for nodes close to goal
+// Dijkstra from t backwards over the Cells, with the edges and the legality
+// of Node. Fills reverse_cost_ of the planner with the cost of the cheapest
+// path from a Cell to t, which is the edge cost without smoothness and
+// therefore a lower bound for every node type. The search expands at most
+// max_iterations Cells within kReverseSearchRadius of t. Returns false iff s
+// can not reach t: every Cell connected to t was expanded without reaching s.
 template <typename GlobalPlanner>
-bool reverseSearch(GlobalPlanner* global_planner, const Cell& t) {
-  std::map<Cell, double> cost;
+bool reverseSearch(GlobalPlanner* global_planner, const Cell& s,
+                   const GoalCell& t, int max_iterations) {
+  const int radius = GlobalPlanner::kReverseSearchRadius;
+  const int max_z = std::max(
+      t.zIndex(), Cell(t.xPos(), t.yPos(), global_planner->max_altitude_)
+                      .zIndex());
+  RiskGrid& cost = global_planner->reverse_cost_;
+  cost.reset(Cell(std::tuple<int, int, int>(t.xIndex() - radius,
+                                            t.yIndex() - radius, 0)),
+             Cell(std::tuple<int, int, int>(t.xIndex() + radius,
+                                            t.yIndex() + radius, max_z)),
+             INFINITY);
+  global_planner->reverse_goal_ = t;
   std::priority_queue<CellDistancePair, std::vector<CellDistancePair>,
                       CompareDist>
       pq;
-  std::unordered_set<Cell> seen_cells;
-  int num_iter = 0;
-  cost[t] = global_planner->getRisk(t);
-  pq.push(std::make_pair(t, cost[t]));
 
-  while (!pq.empty() && num_iter++ < 100) {
-    CellDistancePair u_cell_dist = pq.top();
+  // Every Cell within the plan radius of t ends a search
+  const int goal_radius = std::ceil(t.radius_ / CELL_SCALE);
+  for (int x = -goal_radius; x <= goal_radius; ++x) {
+    for (int y = -goal_radius; y <= goal_radius; ++y) {
+      for (int z = -goal_radius; z <= goal_radius; ++z) {
+        Cell goal(std::tuple<int, int, int>(t.xIndex() + x, t.yIndex() + y,
+                                            t.zIndex() + z));
+        if (cost.contains(goal) && t.withinPlanRadius(goal)) {
+          cost[goal] = 0.0;
+          pq.push(std::make_pair(goal, 0.0));
+        }
+      }
+    }
+  }
+
+  // Lowest cost of a Cell whose legal neighbor is outside of the grid
+  double clipped_cost = INFINITY;
+  int num_iter = 0;
+  Cell neighbors[10];
+  while (!pq.empty() && num_iter < max_iterations) {
+    const Cell u = pq.top().first;
+    const double u_cost = pq.top().second;
     pq.pop();
-    Cell u = u_cell_dist.first;
-    if (seen_cells.find(u) != seen_cells.end()) {
-      continue;
+    if (u_cost > cost[u]) {
+      continue;  // Already expanded with a lower cost
     }
-    seen_cells.insert(u);
-    global_planner->bubble_risk_cache_[u] = cost[u];
-    global_planner->bubble_cost_ = cost[u];
-    global_planner->bubble_radius_ =
-        std::max(global_planner->bubble_radius_, u.distance3D(t));
-
-    for (const Cell& v : u.getNeighbors()) {
-      double new_cost = cost[u] +
-                        u.distance3D(v) * global_planner->risk_factor_ *
-                            global_planner->getRisk(v);
-      double old_cost = getWithDefault(cost, v, INFINITY);
-      if (new_cost < old_cost) {
+    num_iter++;
+
+    // v is a predecessor of u, the forward search moves from v to u
+    int num_neighbors = u.getNeighbors(neighbors);
+    for (int i = 0; i < num_neighbors; ++i) {
+      const Cell& v = neighbors[i];
+      const Node edge(u, v);
+      if (!global_planner->isLegal(edge)) {
+        continue;
+      }
+      if (!cost.contains(v)) {
+        clipped_cost = std::min(clipped_cost, u_cost);
+        continue;
+      }
+      double new_cost = u_cost + global_planner->getEdgeDist(v, u) +
+                        global_planner->risk_factor_ *
+                            global_planner->getRisk(edge);
+      if (new_cost < cost[v]) {
         cost[v] = new_cost;
         pq.push(std::make_pair(v, new_cost));
       }
     }
   }
-  // TODO: return?
+
+  // The Cells left in the queue were not expanded, every path through them
+  // or through the Cells outside of the grid costs at least reverse_bound_
+  const bool is_exhausted = pq.empty();
+  global_planner->reverse_bound_ =
+      std::min(clipped_cost, is_exhausted ? INFINITY : pq.top().second);
+  while (!pq.empty()) {
+    if (pq.top().second <= cost[pq.top().first]) {
+      cost[pq.top().first] = INFINITY;
+    }
+    pq.pop();
+  }
+  bool s_reached = cost.contains(s) && cost[s] < INFINITY;
+  return s_reached || !is_exhausted || clipped_cost < INFINITY;
+}
+
+// Extends a path that ends in a Cell expanded by reverseSearch() to the goal
+// of the reverse search, true iff it reached the goal
+template <typename GlobalPlanner>
+bool followReverseSearch(GlobalPlanner* global_planner,
+                         std::vector<Cell>& path) {
+  const RiskGrid& cost = global_planner->reverse_cost_;
+  Cell u = path.back();
+  Cell neighbors[10];
+  while (cost.contains(u) && 0.0 < cost[u] && cost[u] < INFINITY) {
+    // The next Cell is the one the cost of u was computed from
+    double best_cost = INFINITY;
+    int best_index = -1;
+    int num_neighbors = u.getNeighbors(neighbors);
+    for (int i = 0; i < num_neighbors; ++i) {
+      const Cell& v = neighbors[i];
+      if (!cost.contains(v) || cost[v] >= cost[u]) {
+        continue;
+      }
+      const Node edge(v, u);
+      if (!global_planner->isLegal(edge)) {
+        continue;
+      }
+      double v_cost = cost[v] + global_planner->getEdgeDist(u, v) +
+                      global_planner->risk_factor_ *
+                          global_planner->getRisk(edge);
+      if (v_cost < best_cost) {
+        best_cost = v_cost;
+        best_index = i;
+      }
+    }
+    if (best_index < 0) {
+      return false;
+    }
+    u = neighbors[best_index];
+    path.push_back(u);
+  }
+  return cost.contains(u) && cost[u] == 0.0;
+}
+
+// A* over the coarse Cells of the octree level that is level depths above
+// the Cells, fills path with the coarse Cells from the one of s to the one of
+// t. Coarse Cells with obstacles are expensive but not illegal, the risk of a
+// coarse Cell is the highest risk within it. The search stays within
+// kCoarseSearchMargin coarse Cells of the XY-box spanned by s and t, without
+// the bound it would flood the cheap unexplored space around an expensive
+// goal.
+template <typename GlobalPlanner>
+SearchInfo findCoarsePath(GlobalPlanner* global_planner,
+                          std::vector<Cell>& path, const Cell& s,
+                          const Cell& t, int level, int max_iterations) {
+  const Cell coarse_s = s.getCoarseCell(level);
+  const Cell coarse_t = t.getCoarseCell(level);
+  const double scale = 1 << level;
+  const int margin = GlobalPlanner::kCoarseSearchMargin;
+  const int min_x = std::min(coarse_s.xIndex(), coarse_t.xIndex()) - margin;
+  const int max_x = std::max(coarse_s.xIndex(), coarse_t.xIndex()) + margin;
+  const int min_y = std::min(coarse_s.yIndex(), coarse_t.yIndex()) - margin;
+  const int max_y = std::max(coarse_s.yIndex(), coarse_t.yIndex()) + margin;
+  std::unordered_map<Cell, Cell> parent;
+  std::unordered_map<Cell, double> distance;
+  std::unordered_set<Cell> seen;
+  std::priority_queue<CellDistancePair, std::vector<CellDistancePair>,
+                      CompareDist>
+      pq;
+  pq.push(std::make_pair(coarse_s, 0.0));
+  distance[coarse_s] = 0.0;
+  int num_iter = 0;
+  bool found_path = false;
+  Cell neighbors[10];
+
+  std::clock_t start_time = std::clock();
+  while (!pq.empty() && num_iter < max_iterations) {
+    Cell u = pq.top().first;
+    pq.pop();
+    if (!seen.insert(u).second) {
+      continue;
+    }
+    num_iter++;
+    if (u == coarse_t) {
+      found_path = true;
+      break;
+    }
+
+    const double u_dist = distance[u];
+    int num_neighbors = u.getNeighbors(neighbors);
+    for (int i = 0; i < num_neighbors; ++i) {
+      const Cell& v = neighbors[i];
+      if (v.xIndex() < min_x || max_x < v.xIndex() || v.yIndex() < min_y ||
+          max_y < v.yIndex()) {
+        continue;
+      }
+      if (v != coarse_t && !global_planner->isCoarseLegal(v, level)) {
+        continue;
+      }
+      // Positions of coarse Cells are in units of scale Cells
+      double risk = global_planner->getCoarseRisk(v, level);
+      double new_dist =
+          u_dist + scale * (global_planner->getEdgeDist(u, v) +
+                            global_planner->risk_factor_ * risk *
+                                u.distance3D(v));
+      double old_dist = getWithDefault(distance, v, INFINITY);
+      if (new_dist < old_dist) {
+        parent[v] = u;
+        distance[v] = new_dist;
+        double heuristic = global_planner->max_overestimate_factor_ * scale *
+                           v.diagDistance2D(coarse_t);
+        pq.push(std::make_pair(v, new_dist + heuristic));
+      }
+    }
+  }
+  double total_time = clocksToMicroSec(start_time, std::clock());
+
+  if (found_path) {
+    path.clear();
+    for (Cell walker = coarse_t; walker != coarse_s; walker = parent[walker]) {
+      path.push_back(walker);
+    }
+    path.push_back(coarse_s);
+    std::reverse(path.begin(), path.end());
+  }
+  return SearchInfo(found_path, num_iter, total_time);
 }
 
 // A* to find a path from s to t, true iff it found a path
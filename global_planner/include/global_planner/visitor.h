@@ -15,10 +15,13 @@ class SearchVisitor {
     seen_.clear();
     seen_count_.clear();
   }
-  void popNode(NodePtr u) {}
-  void perNeighbor(NodePtr u, NodePtr v) {
-    seen_count_[v->cell_] = 1.0 + getWithDefault(seen_count_, v->cell_, 0.0);
-    seen_.insert(v->cell_);
+  template <typename NodeType>
+  void popNode(const NodeType& u) {}
+
+  template <typename NodeType>
+  void perNeighbor(const NodeType& u, const NodeType& v) {
+    seen_count_[v.cell_] = 1.0 + getWithDefault(seen_count_, v.cell_, 0.0);
+    seen_.insert(v.cell_);
   }
 };
 
@@ -28,11 +31,11 @@ class NullVisitor {
 
   void init() {}
 
-  template <typename NodePtr>
-  void popNode(NodePtr u) {}
+  template <typename NodeType>
+  void popNode(const NodeType& u) {}
 
-  template <typename NodePtr>
-  void perNeighbor(NodePtr u, NodePtr v) {}
+  template <typename NodeType>
+  void perNeighbor(const NodeType& u, const NodeType& v) {}
 };
 
 }  // namespace global_planner
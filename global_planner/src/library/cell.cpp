@@ -2,22 +2,27 @@
 
 namespace global_planner {
 
+double CELL_SCALE = 1.0;
+
+// Key offsets of the neighbors, in the order of the vector versions
+const uint64_t kFlowNeighborOffsets[6] = {
+    Cell::offsetToKey(1, 0, 0),  Cell::offsetToKey(-1, 0, 0),
+    Cell::offsetToKey(0, 1, 0),  Cell::offsetToKey(0, -1, 0),
+    Cell::offsetToKey(0, 0, 1),  Cell::offsetToKey(0, 0, -1)};
+const uint64_t kDiagonalNeighborOffsets[4] = {
+    Cell::offsetToKey(1, 1, 0), Cell::offsetToKey(-1, 1, 0),
+    Cell::offsetToKey(1, -1, 0), Cell::offsetToKey(-1, -1, 0)};
+
 Cell::Cell() = default;
-Cell::Cell(std::tuple<int, int, int> new_tuple) : tpl_(new_tuple) {}
+Cell::Cell(std::tuple<int, int, int> new_tuple)
+    : key_(indicesToKey(std::get<0>(new_tuple), std::get<1>(new_tuple),
+                        std::get<2>(new_tuple))) {}
 Cell::Cell(double x, double y, double z)
-    : tpl_(floor(x / CELL_SCALE), floor(y / CELL_SCALE),
-           floor(z / CELL_SCALE)) {}
+    : key_(indicesToKey(floor(x / CELL_SCALE), floor(y / CELL_SCALE),
+                        floor(z / CELL_SCALE))) {}
 Cell::Cell(double x, double y) : Cell(x, y, 0.0) {}
 Cell::Cell(geometry_msgs::Point point) : Cell(point.x, point.y, point.z) {}
 
-int Cell::xIndex() const { return std::get<0>(tpl_); }
-int Cell::yIndex() const { return std::get<1>(tpl_); }
-int Cell::zIndex() const { return std::get<2>(tpl_); }
-
-double Cell::xPos() const { return CELL_SCALE * (xIndex() + 0.5); }
-double Cell::yPos() const { return CELL_SCALE * (yIndex() + 0.5); }
-double Cell::zPos() const { return CELL_SCALE * (zIndex() + 0.5); }
-
 geometry_msgs::Point Cell::toPoint() const {
   geometry_msgs::Point point;
   point.x = xPos();
@@ -71,37 +76,59 @@ Cell Cell::getNeighborFromYaw(double yaw) const {
 
 // Returns the neighbors of the Cell whose risk influences the Cell
 std::vector<Cell> Cell::getFlowNeighbors() const {
-  return std::vector<Cell>{
-      Cell(std::tuple<int, int, int>(xIndex() + 1, yIndex(), zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex() - 1, yIndex(), zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex(), yIndex() + 1, zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex(), yIndex() - 1, zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex(), yIndex(), zIndex() + 1)),
-      Cell(std::tuple<int, int, int>(xIndex(), yIndex(), zIndex() - 1))};
+  std::vector<Cell> neighbors(6);
+  getFlowNeighbors(neighbors.data());
+  return neighbors;
+}
+
+int Cell::getFlowNeighbors(Cell* neighbors) const {
+  for (int i = 0; i < 6; ++i) {
+    neighbors[i] = fromKey(key_ + kFlowNeighborOffsets[i]);
+  }
+  return 6;
 }
 
 // Returns the neighbors of the Cell that are diagonal to the cell in the
 // XY-plane
 std::vector<Cell> Cell::getDiagonalNeighbors() const {
-  return std::vector<Cell>{
-      Cell(std::tuple<int, int, int>(xIndex() + 1, yIndex() + 1, zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex() - 1, yIndex() + 1, zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex() + 1, yIndex() - 1, zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex() - 1, yIndex() - 1, zIndex()))};
+  std::vector<Cell> neighbors(4);
+  getDiagonalNeighbors(neighbors.data());
+  return neighbors;
+}
+
+int Cell::getDiagonalNeighbors(Cell* neighbors) const {
+  for (int i = 0; i < 4; ++i) {
+    neighbors[i] = fromKey(key_ + kDiagonalNeighborOffsets[i]);
+  }
+  return 4;
 }
 
 std::vector<Cell> Cell::getNeighbors() const {
-  return std::vector<Cell>{
-      Cell(std::tuple<int, int, int>(xIndex() + 1, yIndex(), zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex() - 1, yIndex(), zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex(), yIndex() + 1, zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex(), yIndex() - 1, zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex(), yIndex(), zIndex() + 1)),
-      Cell(std::tuple<int, int, int>(xIndex(), yIndex(), zIndex() - 1)),
-      Cell(std::tuple<int, int, int>(xIndex() + 1, yIndex() + 1, zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex() - 1, yIndex() + 1, zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex() + 1, yIndex() - 1, zIndex())),
-      Cell(std::tuple<int, int, int>(xIndex() - 1, yIndex() - 1, zIndex()))};
+  std::vector<Cell> neighbors(10);
+  getNeighbors(neighbors.data());
+  return neighbors;
+}
+
+// The flow neighbors followed by the diagonal neighbors
+int Cell::getNeighbors(Cell* neighbors) const {
+  getFlowNeighbors(neighbors);
+  getDiagonalNeighbors(neighbors + 6);
+  return 10;
+}
+
+// Returns the Cell of an octree level that is level depths above the Cells,
+// its indices are the indices of this Cell divided by 2^level (rounded down)
+Cell Cell::getCoarseCell(int level) const {
+  return Cell(std::tuple<int, int, int>(xIndex() >> level, yIndex() >> level,
+                                        zIndex() >> level));
+}
+
+// Returns the Cell in the middle of the coarse Cell this is on level
+Cell Cell::getFineCell(int level) const {
+  const int size = 1 << level;
+  return Cell(std::tuple<int, int, int>(xIndex() * size + size / 2,
+                                        yIndex() * size + size / 2,
+                                        zIndex() * size + size / 2));
 }
 
 std::string Cell::asString() const {
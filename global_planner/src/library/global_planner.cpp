@@ -13,9 +13,111 @@ double nextYaw(Cell u, Cell v, double last_yaw) {
   return std::atan2(dy, dx);
 }
 
+// Inserts the Cells covered by the octree leaf of the given center and size.
+// Leaves above the depth of a Cell are pruned and cover several Cells
+void insertLeafCells(const octomap::point3d& center, double size,
+                     std::unordered_set<Cell>& cells) {
+  const double first = std::min(size, double(CELL_SCALE)) / 2;
+  for (double x = first; x < size; x += CELL_SCALE) {
+    for (double y = first; y < size; y += CELL_SCALE) {
+      for (double z = first; z < size; z += CELL_SCALE) {
+        cells.insert(Cell(center.x() - size / 2 + x, center.y() - size / 2 + y,
+                          center.z() - size / 2 + z));
+      }
+    }
+  }
+}
+
+// Makes the node of tree at key and depth a leaf of log_odds, the way
+// OcTree::setNodeValue() does at the finest depth: a pruned parent is
+// expanded, the children of the node are deleted and its parents are updated
+// and pruned again on the way back up
+void setLeafValue(octomap::OcTree& tree, const octomap::OcTreeKey& key,
+                  unsigned int depth, float log_odds) {
+  if (!tree.getRoot()) {
+    // Only setNodeValue() can create the root, the finest node it adds is
+    // deleted again below
+    tree.setNodeValue(key, log_odds);
+  }
+  const unsigned int tree_depth = tree.getTreeDepth();
+  std::vector<octomap::OcTreeNode*> parents;
+  octomap::OcTreeNode* node = tree.getRoot();
+  bool is_new = false;
+  for (unsigned int d = 0; d < depth; ++d) {
+    const unsigned int pos = octomap::computeChildIdx(key, tree_depth - d - 1);
+    if (!tree.nodeChildExists(node, pos)) {
+      if (!tree.nodeHasChildren(node) && !is_new) {
+        // The children of a pruned leaf keep its value
+        tree.expandNode(node);
+      } else {
+        tree.createNodeChild(node, pos);
+        is_new = true;
+      }
+    }
+    parents.push_back(node);
+    node = tree.getNodeChild(node, pos);
+  }
+
+  for (unsigned int i = 0; i < 8; ++i) {
+    if (tree.nodeChildExists(node, i)) {
+      tree.deleteNodeChild(node, i);
+    }
+  }
+  node->setLogOdds(log_odds);
+  for (auto it = parents.rbegin(); it != parents.rend(); ++it) {
+    if (!tree.pruneNode(*it)) {
+      (*it)->updateOccupancyChildren();
+    }
+  }
+}
+
 GlobalPlanner::GlobalPlanner() { calculateAccumulatedHeightPrior(); }
 GlobalPlanner::~GlobalPlanner() {}
 
+// Copies what getGlobalPath() reads from planner, so a copy can search while
+// planner keeps changing. The maps are shared, the caches, the visitor and the
+// path back are left out and start empty
+void GlobalPlanner::copySearchInputs(const GlobalPlanner& planner) {
+  octree_ = planner.octree_;
+  map_tiles_ = planner.map_tiles_;
+  occupied_ = planner.occupied_;
+  risk_grid_ = planner.risk_grid_;
+  risk_cache_.setCapacity(planner.risk_cache_.capacity());
+
+  curr_pos_ = planner.curr_pos_;
+  curr_yaw_ = planner.curr_yaw_;
+  curr_vel_ = planner.curr_vel_;
+  goal_pos_ = planner.goal_pos_;
+  going_back_ = planner.going_back_;
+  overestimate_factor_ = planner.overestimate_factor_;
+  goal_is_blocked_ = planner.goal_is_blocked_;
+  current_cell_blocked_ = planner.current_cell_blocked_;
+
+  min_altitude_ = planner.min_altitude_;
+  max_altitude_ = planner.max_altitude_;
+  max_cell_risk_ = planner.max_cell_risk_;
+  smooth_factor_ = planner.smooth_factor_;
+  vert_to_hor_cost_ = planner.vert_to_hor_cost_;
+  risk_factor_ = planner.risk_factor_;
+  neighbor_risk_flow_ = planner.neighbor_risk_flow_;
+  expore_penalty_ = planner.expore_penalty_;
+  up_cost_ = planner.up_cost_;
+  down_cost_ = planner.down_cost_;
+  search_time_ = planner.search_time_;
+  min_overestimate_factor_ = planner.min_overestimate_factor_;
+  max_overestimate_factor_ = planner.max_overestimate_factor_;
+  max_iterations_ = planner.max_iterations_;
+  use_reverse_search_ = planner.use_reverse_search_;
+  reverse_search_iterations_ = planner.reverse_search_iterations_;
+  bidirectional_search_ = planner.bidirectional_search_;
+  hierarchical_levels_ = planner.hierarchical_levels_;
+  goal_must_be_free_ = planner.goal_must_be_free_;
+  use_current_yaw_ = planner.use_current_yaw_;
+  use_risk_heuristics_ = planner.use_risk_heuristics_;
+  use_speedup_heuristics_ = planner.use_speedup_heuristics_;
+  default_node_type_ = planner.default_node_type_;
+}
+
 // Fills accumulated_alt_prior_ such that accumulated_alt_prior_[i] =
 // sum(alt_prior_[0:i]) Used to get the pior risk of vertical movement
 void GlobalPlanner::calculateAccumulatedHeightPrior() {
@@ -43,8 +145,7 @@ void GlobalPlanner::setGoal(const GoalCell& goal) {
   goal_pos_ = goal;
   going_back_ = false;
   goal_is_blocked_ = false;
-  heuristic_cache_.clear();
-  bubble_risk_cache_.clear();
+  reverse_cost_.clear();
 }
 
 // Sets path to be the current path
@@ -53,28 +154,405 @@ void GlobalPlanner::setPath(const std::vector<Cell>& path) {
   curr_path_ = path;
 
   path_cells_.clear();
+  path_node_risk_.clear();
+  dirty_path_nodes_.clear();
   for (int i = 2; i < path.size(); ++i) {
     Node node(path[i], path[i - 1]);
     for (const Cell& cell : node.getCells()) {
-      path_cells_.insert(cell);
+      path_cells_[cell].push_back(i);
+    }
+    path_node_risk_.push_back(getRisk(node));
+  }
+}
+
+// Marks the Nodes of curr_path_ whose risk depends on cell
+void GlobalPlanner::invalidatePathRisk(const Cell& cell) {
+  auto it = path_cells_.find(cell);
+  if (it != path_cells_.end()) {
+    dirty_path_nodes_.insert(it->second.begin(), it->second.end());
+  }
+  Cell neighbors[6];
+  cell.getFlowNeighbors(neighbors);
+  for (const Cell& neighbor : neighbors) {
+    it = path_cells_.find(neighbor);
+    if (it != path_cells_.end()) {
+      dirty_path_nodes_.insert(it->second.begin(), it->second.end());
     }
   }
 }
 
 // Returns false iff current path has an obstacle
 // Going through the octomap can take more than 50 ms for 100m x 100m explored
-// map
+// map. The new map is compared with the old one, so only the risk of the cells
+// that changed has to be recomputed
 bool GlobalPlanner::updateFullOctomap(const octomap_msgs::Octomap& msg) {
-  risk_cache_.clear();
-  octomap::AbstractOcTree* tree = octomap_msgs::msgToMap(msg);
+  // A map of another type is deleted with the unique_ptr
+  std::unique_ptr<octomap::AbstractOcTree> map(octomap_msgs::msgToMap(msg));
+  octomap::OcTree* tree = dynamic_cast<octomap::OcTree*>(map.get());
+  if (!tree) {
+    return true;
+  }
+  map.release();
+  std::unordered_set<Cell> changed_cells;
+  bool is_incremental =
+      octree_ && octree_->getResolution() == tree->getResolution();
+  if (is_incremental) {
+    getChangedCells(*octree_, *tree, changed_cells);
+    getChangedCells(*tree, *octree_, changed_cells, true);
+  }
+  // Copies of the planner keep the previous tree
+  octree_.reset(tree);
+  if (is_incremental) {
+    invalidateRisk(changed_cells);
+  } else {
+    resetRisk();
+  }
+  return isCurrentPathOk();
+}
+
+// Opens a map saved by saveMapTiles() as the map of the Cells that octree_
+// does not know, replacing the previous one. Only the index is read, the tiles
+// are paged in when the planner looks at them.
+bool GlobalPlanner::loadMapTiles(const std::string& path) {
+  std::shared_ptr<MapTiles> map_tiles = std::make_shared<MapTiles>();
+  const bool is_open = map_tiles->open(path);
+  // Copies of the planner keep the previous map
+  map_tiles_.reset();
+  if (is_open) {
+    map_tiles_ = map_tiles;
+  }
+  resetRisk();
+  return is_open;
+}
+
+// Saves octree_ and occupied_, merged into the Cells of map_tiles_, in the
+// format of MapTiles
+bool GlobalPlanner::saveMapTiles(const std::string& path) const {
+  MapTilesWriter writer;
   if (octree_) {
-    delete octree_;
+    // A pruned node sets all the Cells it covers
+    const int depth = getOctreeDepth();
+    for (auto it = octree_->begin_leafs(depth), end = octree_->end_leafs();
+         it != end; ++it) {
+      const double half_size = it.getSize() / 2;
+      const octomap::point3d center = it.getCoordinate();
+      const Cell lo(center.x() - half_size + CELL_SCALE / 2,
+                    center.y() - half_size + CELL_SCALE / 2,
+                    center.z() - half_size + CELL_SCALE / 2);
+      const Cell hi(center.x() + half_size - CELL_SCALE / 2,
+                    center.y() + half_size - CELL_SCALE / 2,
+                    center.z() + half_size - CELL_SCALE / 2);
+      for (int z = lo.zIndex(); z <= hi.zIndex(); ++z) {
+        for (int y = lo.yIndex(); y <= hi.yIndex(); ++y) {
+          for (int x = lo.xIndex(); x <= hi.xIndex(); ++x) {
+            writer.setLogOdds(x, y, z, it->getLogOdds());
+          }
+        }
+      }
+    }
+  }
+  occupied_->forEach(
+      [&writer](int x, int y, int z) { writer.setOccupied(x, y, z); });
+  return writer.save(path, map_tiles_.get());
+}
+
+// Returns false iff current path has an obstacle
+// msg only contains the voxels of a bounded region (e.g. around the vehicle),
+// they are merged into octree_ and only the changed voxels invalidate risk
+bool GlobalPlanner::updateOctomapRegion(const octomap_msgs::Octomap& msg) {
+  std::unique_ptr<octomap::AbstractOcTree> map(octomap_msgs::msgToMap(msg));
+  octomap::OcTree* region = dynamic_cast<octomap::OcTree*>(map.get());
+  if (!region) {
+    return true;
+  }
+  if (!octree_ || octree_->getResolution() != region->getResolution()) {
+    // Nothing to merge into yet
+    map.release();
+    octree_.reset(region);
+    resetRisk();
+    return isCurrentPathOk();
+  }
+  if (octree_.use_count() > 1) {
+    // A copy of the planner still searches the current tree
+    octree_ = std::make_shared<octomap::OcTree>(*octree_);
+  }
+
+  std::unordered_set<Cell> changed_cells;
+  for (auto it = region->begin_leafs(), end = region->end_leafs(); it != end;
+       ++it) {
+    // A pruned leaf is only unchanged if octree_ is not refined there
+    const float log_odds = it->getLogOdds();
+    octomap::OcTreeNode* node = octree_->search(it.getKey(), it.getDepth());
+    if (node && node->getLogOdds() == log_odds &&
+        !octree_->nodeHasChildren(node)) {
+      continue;
+    }
+    setLeafValue(*octree_, it.getKey(), it.getDepth(), log_odds);
+    insertLeafCells(it.getCoordinate(), it.getSize(), changed_cells);
+  }
+
+  invalidateRisk(changed_cells);
+  return isCurrentPathOk();
+}
+
+// Inserts the Cells of next whose value at the depth of a Cell differs from
+// the one in prev. If only_removed, only the Cells unknown in prev are added
+void GlobalPlanner::getChangedCells(const octomap::OcTree& prev,
+                                    const octomap::OcTree& next,
+                                    std::unordered_set<Cell>& changed_cells,
+                                    bool only_removed) {
+  const unsigned int depth = getOctreeDepth();
+  for (auto it = next.begin_leafs(depth), end = next.end_leafs(); it != end;
+       ++it) {
+    octomap::OcTreeNode* prev_node = prev.search(it.getKey(), it.getDepth());
+    // A pruned leaf in next is only unchanged if prev is not refined there
+    if (only_removed ? prev_node != NULL
+                     : prev_node &&
+                           prev_node->getLogOdds() == it->getLogOdds() &&
+                           (it.getDepth() == depth ||
+                            !prev.nodeHasChildren(prev_node))) {
+      continue;
+    }
+    insertLeafCells(it.getCoordinate(), it.getSize(), changed_cells);
+  }
+}
+
+// Recomputes the risk of the changed Cells and of the Cells that have them as
+// flow neighbors. Cells added to or evicted from occupied_ since the last
+// update count as changed
+void GlobalPlanner::invalidateRisk(std::unordered_set<Cell>& changed_cells) {
+  changed_cells.insert(changed_occupied_cells_.begin(),
+                       changed_occupied_cells_.end());
+  changed_occupied_cells_.clear();
+  for (const Cell& cell : changed_cells) {
+    invalidatePathRisk(cell);
+  }
+
+  // Clearing is cheaper once most of the cache is affected
+  if (2 * changed_cells.size() > risk_cache_.size()) {
+    risk_cache_.clear();
+  } else {
+    for (const Cell& cell : changed_cells) {
+      risk_cache_.erase(cell);
+      Cell neighbors[6];
+      cell.getFlowNeighbors(neighbors);
+      for (const Cell& neighbor : neighbors) {
+        risk_cache_.erase(neighbor);
+      }
+    }
+  }
+
+  const Cell& min = risk_grid_.min();
+  const Cell& max = risk_grid_.max();
+  for (const Cell& cell : changed_cells) {
+    if (risk_grid_.empty() || cell.xIndex() < min.xIndex() ||
+        cell.xIndex() > max.xIndex() || cell.yIndex() < min.yIndex() ||
+        cell.yIndex() > max.yIndex()) {
+      // The map grew out of the grid
+      buildRiskGrid();
+      return;
+    }
+  }
+  for (const Cell& cell : changed_cells) {
+    if (single_risk_grid_.contains(cell)) {
+      single_risk_grid_[cell] = getSingleCellRisk(cell);
+    }
+  }
+  for (const Cell& cell : changed_cells) {
+    if (risk_grid_.contains(cell)) {
+      risk_grid_[cell] = getGridRisk(cell);
+    }
+    Cell neighbors[6];
+    cell.getFlowNeighbors(neighbors);
+    for (const Cell& neighbor : neighbors) {
+      if (risk_grid_.contains(neighbor)) {
+        risk_grid_[neighbor] = getGridRisk(neighbor);
+      }
+    }
+  }
+}
+
+// Forgets all risk, needed when the map or the risk parameters are replaced
+void GlobalPlanner::resetRisk() {
+  risk_cache_.clear();
+  changed_occupied_cells_.clear();
+  buildRiskGrid();
+}
+
+// Fills risk_grid_ with getRisk(Cell) for the explored area, extended by
+// kRiskGridMargin Cells, between min_altitude_ and max_altitude_
+void GlobalPlanner::buildRiskGrid() {
+  for (int i = 0; i < path_node_risk_.size(); ++i) {
+    dirty_path_nodes_.insert(i + 2);
+  }
+  risk_grid_.clear();
+  single_risk_grid_.clear();
+  if (!octree_ || octree_->size() == 0) {
+    return;
+  }
+
+  double min_x, min_y, min_z, max_x, max_y, max_z;
+  octree_->getMetricMin(min_x, min_y, min_z);
+  octree_->getMetricMax(max_x, max_y, max_z);
+  const Cell min_cell(min_x, min_y, min_altitude_);
+  const Cell max_cell(max_x, max_y, max_altitude_);
+  int max_z_index = max_cell.zIndex();
+  // getAltPrior() is only defined up to the top of alt_prior_
+  while (max_z_index >= min_cell.zIndex() &&
+         std::round(CELL_SCALE * (max_z_index + 1.5)) >= alt_prior_.size()) {
+    --max_z_index;
+  }
+  const Cell min(std::tuple<int, int, int>(min_cell.xIndex() - kRiskGridMargin,
+                                           min_cell.yIndex() - kRiskGridMargin,
+                                           min_cell.zIndex()));
+  const Cell max(std::tuple<int, int, int>(max_cell.xIndex() + kRiskGridMargin,
+                                           max_cell.yIndex() + kRiskGridMargin,
+                                           max_z_index));
+  const Cell one(std::tuple<int, int, int>(1, 1, 1));
+  single_risk_grid_.reset(min - one, max + one);
+  if (single_risk_grid_.empty()) {
+    return;
+  }
+
+  // The risk of unexplored Cells only depends on the altitude
+  const Cell& single_min = single_risk_grid_.min();
+  const Cell& single_max = single_risk_grid_.max();
+  for (int z = single_min.zIndex(); z <= single_max.zIndex(); ++z) {
+    const Cell layer(std::tuple<int, int, int>(0, 0, z));
+    // Same as getSingleCellRisk() without a node
+    const double risk = z < 1 ? 1.0 : expore_penalty_ * getAltPrior(layer);
+    for (int y = single_min.yIndex(); y <= single_max.yIndex(); ++y) {
+      for (int x = single_min.xIndex(); x <= single_max.xIndex(); ++x) {
+        single_risk_grid_.at(x, y, z) = risk;
+      }
+    }
+  }
+
+  // The saved map sets the Cells it knows, octree_ overrides them below
+  if (map_tiles_) {
+    for (int z = std::max(single_min.zIndex(), 1); z <= single_max.zIndex();
+         ++z) {
+      for (int y = single_min.yIndex(); y <= single_max.yIndex(); ++y) {
+        const MapTiles::Tile* tile = nullptr;
+        for (int x = single_min.xIndex(); x <= single_max.xIndex(); ++x) {
+          if (x == single_min.xIndex() ||
+              (x & (MapTiles::kTileSize - 1)) == 0) {
+            tile = map_tiles_->findTile(x, y, z);
+          }
+          if (!tile) {
+            continue;
+          }
+          const float log_odds = tile->log_odds[MapTiles::cellIndex(x, y, z)];
+          if (!std::isnan(log_odds)) {
+            const Cell cell(std::tuple<int, int, int>(x, y, z));
+            single_risk_grid_.at(x, y, z) = getMeasuredRisk(cell, log_odds);
+          }
+        }
+      }
+    }
+  }
+
+  // Every node at the depth of a Cell, or pruned above it, sets the risk of
+  // the Cells it covers
+  const int depth = getOctreeDepth();
+  for (auto it = octree_->begin_leafs(depth), end = octree_->end_leafs();
+       it != end; ++it) {
+    const double half_size = it.getSize() / 2;
+    const octomap::point3d center = it.getCoordinate();
+    const Cell lo(center.x() - half_size + CELL_SCALE / 2,
+                  center.y() - half_size + CELL_SCALE / 2,
+                  center.z() - half_size + CELL_SCALE / 2);
+    const Cell hi(center.x() + half_size - CELL_SCALE / 2,
+                  center.y() + half_size - CELL_SCALE / 2,
+                  center.z() + half_size - CELL_SCALE / 2);
+    const int z_begin = std::max({lo.zIndex(), single_min.zIndex(), 1});
+    const int z_end = std::min(hi.zIndex(), single_max.zIndex());
+    const int y_begin = std::max(lo.yIndex(), single_min.yIndex());
+    const int y_end = std::min(hi.yIndex(), single_max.yIndex());
+    const int x_begin = std::max(lo.xIndex(), single_min.xIndex());
+    const int x_end = std::min(hi.xIndex(), single_max.xIndex());
+    for (int z = z_begin; z <= z_end; ++z) {
+      for (int y = y_begin; y <= y_end; ++y) {
+        for (int x = x_begin; x <= x_end; ++x) {
+          const Cell cell(std::tuple<int, int, int>(x, y, z));
+          single_risk_grid_.at(x, y, z) =
+              getMeasuredRisk(cell, it->getLogOdds());
+        }
+      }
+    }
+  }
+
+  // Separable neighbor flow, one pass per axis. The terms are added in the
+  // order of getFlowNeighbors() so that the sums equal the ones of getRisk()
+  risk_grid_.reset(min, max);
+  const double flow = neighbor_risk_flow_;
+  for (int z = min.zIndex(); z <= max.zIndex(); ++z) {
+    for (int y = min.yIndex(); y <= max.yIndex(); ++y) {
+      for (int x = min.xIndex(); x <= max.xIndex(); ++x) {
+        risk_grid_.at(x, y, z) = single_risk_grid_.at(x, y, z);
+      }
+    }
+  }
+  for (int z = min.zIndex(); z <= max.zIndex(); ++z) {
+    for (int y = min.yIndex(); y <= max.yIndex(); ++y) {
+      for (int x = min.xIndex(); x <= max.xIndex(); ++x) {
+        risk_grid_.at(x, y, z) += flow * single_risk_grid_.at(x + 1, y, z);
+        risk_grid_.at(x, y, z) += flow * single_risk_grid_.at(x - 1, y, z);
+      }
+    }
+  }
+  for (int z = min.zIndex(); z <= max.zIndex(); ++z) {
+    for (int y = min.yIndex(); y <= max.yIndex(); ++y) {
+      for (int x = min.xIndex(); x <= max.xIndex(); ++x) {
+        risk_grid_.at(x, y, z) += flow * single_risk_grid_.at(x, y + 1, z);
+        risk_grid_.at(x, y, z) += flow * single_risk_grid_.at(x, y - 1, z);
+      }
+    }
   }
-  octree_ = dynamic_cast<octomap::OcTree*>(tree);
+  for (int z = min.zIndex(); z <= max.zIndex(); ++z) {
+    for (int y = min.yIndex(); y <= max.yIndex(); ++y) {
+      for (int x = min.xIndex(); x <= max.xIndex(); ++x) {
+        risk_grid_.at(x, y, z) += flow * single_risk_grid_.at(x, y, z + 1);
+        risk_grid_.at(x, y, z) += flow * single_risk_grid_.at(x, y, z - 1);
+      }
+    }
+  }
+}
 
-  // Check if the risk of the current path has increased
+// The risk of a Cell of risk_grid_, computed from single_risk_grid_
+double GlobalPlanner::getGridRisk(const Cell& cell) {
+  double risk = single_risk_grid_[cell];
+  Cell neighbors[6];
+  cell.getFlowNeighbors(neighbors);
+  for (const Cell& neighbor : neighbors) {
+    risk += neighbor_risk_flow_ * single_risk_grid_[neighbor];
+  }
+  return risk;
+}
+
+// Gives occupied_ its own copy before it is changed, while a copy of the
+// planner still searches the shared one
+void GlobalPlanner::unshareOccupied() {
+  if (occupied_.use_count() > 1) {
+    occupied_ = std::make_shared<OccupancyMap>(*occupied_);
+  }
+}
+
+// Returns false if the risk of the current path has increased
+// Only the Nodes of the path that touch changed Cells are evaluated again, the
+// risk of the others is kept from the last check
+bool GlobalPlanner::isCurrentPathOk() {
   if (!curr_path_.empty()) {
-    PathInfo new_info = getPathInfo(curr_path_);
+    for (int i : dirty_path_nodes_) {
+      path_node_risk_[i - 2] = getRisk(Node(curr_path_[i], curr_path_[i - 1]));
+    }
+    dirty_path_nodes_.clear();
+
+    PathInfo new_info = {};
+    for (double node_risk : path_node_risk_) {
+      new_info.risk += risk_factor_ * node_risk;
+      new_info.is_blocked |= node_risk > max_cell_risk_;
+    }
     if (new_info.is_blocked || new_info.risk > curr_path_info_.risk + 10) {
       ROS_INFO("Risk increase");
       return false;
@@ -122,7 +600,9 @@ void GlobalPlanner::getOpenNeighbors(const Cell& cell,
 
 // Returns true if cell has an occupied neighbor
 bool GlobalPlanner::isNearWall(const Cell& cell) {
-  for (const Cell& neighbor : cell.getDiagonalNeighbors()) {
+  Cell neighbors[4];
+  cell.getDiagonalNeighbors(neighbors);
+  for (const Cell& neighbor : neighbors) {
     if (isOccupied(neighbor)) {
       return true;
     }
@@ -141,37 +621,52 @@ double GlobalPlanner::getEdgeDist(const Cell& u, const Cell& v) {
 
 // Risk without looking at the neighbors
 double GlobalPlanner::getSingleCellRisk(const Cell& cell) {
-  if (cell.zIndex() < 1 || !octree_) {
+  if (cell.zIndex() < 1 || (!octree_ && !map_tiles_)) {
     return 1.0;  // Octomap does not keep track of the ground
   }
   // octomap::OcTreeNode* node = octree_->search(cell.xPos(), cell.yPos(),
   // cell.zPos());
-  int octree_depth = std::min(16, 17 - int(CELL_SCALE + 0.1));
   octomap::OcTreeNode* node =
-      octree_->search(cell.xPos(), cell.yPos(), cell.zPos(), octree_depth);
+      octree_ ? octree_->search(cell.xPos(), cell.yPos(), cell.zPos(),
+                                getOctreeDepth())
+              : nullptr;
   if (node) {
-    // TODO: posterior in log-space
-    double log_odds = node->getValue();
-    // double parentLogOdds = parent->getValue();
-    double post_prob =
-        posterior(getAltPrior(cell), octomap::probability(log_odds));
-    // double post_prob = posterior(0.06, octomap::probability(log_odds));
-    // // If the cell has been seen
-    if (occupied_.find(cell) != occupied_.end()) {
-      // If an obstacle has at some point been spotted it is 'known space'
-      return post_prob;
-    } else if (log_odds > 0) {
-      // ROS_INFO("Cell %s is not in occupied_ but has > 50\% risk",
-      // cell.asString().c_str());
-      return post_prob;
-    }
-    // No obstacle spotted (all measurements hint towards it being free)
-    return expore_penalty_ * post_prob;
+    return getMeasuredRisk(cell, node->getValue());
+  }
+  float log_odds;
+  if (map_tiles_ && map_tiles_->find(cell, log_odds)) {
+    return getMeasuredRisk(cell, log_odds);
   }
   // No measurements at all
   return expore_penalty_ * getAltPrior(cell);  // Risk for unexplored cells
 }
 
+// Risk of a Cell above the ground whose octree node has the value log_odds
+double GlobalPlanner::getMeasuredRisk(const Cell& cell, double log_odds) {
+  // TODO: posterior in log-space
+  // double parentLogOdds = parent->getValue();
+  double post_prob =
+      posterior(getAltPrior(cell), octomap::probability(log_odds));
+  // double post_prob = posterior(0.06, octomap::probability(log_odds));
+  // // If the cell has been seen
+  if (occupied_->contains(cell) ||
+      (map_tiles_ && map_tiles_->isOccupied(cell))) {
+    // If an obstacle has at some point been spotted it is 'known space'
+    return post_prob;
+  } else if (log_odds > 0) {
+    // ROS_INFO("Cell %s is not in occupied_ but has > 50\% risk",
+    // cell.asString().c_str());
+    return post_prob;
+  }
+  // No obstacle spotted (all measurements hint towards it being free)
+  return expore_penalty_ * post_prob;
+}
+
+// The depth of the octree at which a node covers a Cell
+int GlobalPlanner::getOctreeDepth() const {
+  return std::min(16, 17 - int(CELL_SCALE + 0.1));
+}
+
 double GlobalPlanner::getAltPrior(const Cell& cell) {
   // return alt_prior_[cell.zIndex()];
   return alt_prior_[std::round(cell.zPos())];
@@ -182,20 +677,103 @@ bool GlobalPlanner::isOccupied(const Cell& cell) {
 }
 
 bool GlobalPlanner::isLegal(const Node& node) {
+  if (!corridor_.empty() &&
+      !corridor_.count(node.cell_.getCoarseCell(corridor_level_))) {
+    return false;
+  }
   return node.cell_.zPos() < max_altitude_ && getRisk(node) < max_cell_risk_;
 }
 
+// True iff the coarse Cell overlaps the allowed altitudes
+bool GlobalPlanner::isCoarseLegal(const Cell& coarse_cell, int level) {
+  const double size = CELL_SCALE * (1 << level);
+  return (coarse_cell.zIndex() + 1) * size > min_altitude_ &&
+         coarse_cell.zIndex() * size < max_altitude_;
+}
+
+// Risk of the octree node that covers the coarse Cell. Inner nodes of an
+// octree keep the highest log-odds of their children, so a single occupied
+// Cell makes the whole coarse Cell risky.
+double GlobalPlanner::getCoarseRisk(const Cell& coarse_cell, int level) {
+  if (!octree_ && !map_tiles_) {
+    return 1.0;
+  }
+  const Cell center = coarse_cell.getFineCell(level);
+  const int depth = std::max(1, getOctreeDepth() - level);
+  octomap::OcTreeNode* node =
+      octree_ ? octree_->search(center.xPos(), center.yPos(), center.zPos(),
+                                depth)
+              : nullptr;
+  // The prior decreases with the altitude, use the lowest Cell above ground
+  const double prior = getAltPrior(Cell(std::tuple<int, int, int>(
+      center.xIndex(), center.yIndex(),
+      std::max(1, coarse_cell.zIndex() * (1 << level)))));
+  float log_odds = 0.f;
+  if (node) {
+    log_odds = node->getValue();
+  } else {
+    // Like an inner octree node, the saved map keeps the highest log-odds of
+    // the Cells of the coarse Cell
+    const int span = 1 << level;
+    const Cell lo(std::tuple<int, int, int>(coarse_cell.xIndex() * span,
+                                            coarse_cell.yIndex() * span,
+                                            coarse_cell.zIndex() * span));
+    const Cell hi(std::tuple<int, int, int>(lo.xIndex() + span - 1,
+                                            lo.yIndex() + span - 1,
+                                            lo.zIndex() + span - 1));
+    if (!map_tiles_ || !map_tiles_->findMax(lo, hi, log_odds)) {
+      return expore_penalty_ * prior;
+    }
+  }
+  double post_prob = posterior(prior, octomap::probability(log_odds));
+  return log_odds > 0 ? post_prob : expore_penalty_ * post_prob;
+}
+
+// Restricts the searches to the coarse path and the coarse Cells around it,
+// an empty path removes the restriction
+void GlobalPlanner::setCorridor(const std::vector<Cell>& coarse_path,
+                                int level) {
+  corridor_.clear();
+  corridor_level_ = level;
+  const double scale = 1 << level;
+  double dist_to_goal = 0.0;
+  for (int i = coarse_path.size() - 1; i >= 0; --i) {
+    if (i + 1 < static_cast<int>(coarse_path.size())) {
+      dist_to_goal += scale * coarse_path[i].distance3D(coarse_path[i + 1]);
+    }
+    for (int x = -1; x <= 1; ++x) {
+      for (int y = -1; y <= 1; ++y) {
+        for (int z = -1; z <= 1; ++z) {
+          Cell cell(std::tuple<int, int, int>(coarse_path[i].xIndex() + x,
+                                              coarse_path[i].yIndex() + y,
+                                              coarse_path[i].zIndex() + z));
+          double dist = dist_to_goal + scale * cell.distance3D(coarse_path[i]);
+          auto it = corridor_.find(cell);
+          if (it == corridor_.end() || dist < it->second) {
+            corridor_[cell] = dist;
+          }
+        }
+      }
+    }
+  }
+}
+
 double GlobalPlanner::getRisk(const Cell& cell) {
-  if (risk_cache_.find(cell) != risk_cache_.end()) {
-    return risk_cache_[cell];
+  if (risk_grid_.contains(cell)) {
+    return risk_grid_[cell];
+  }
+  if (const double* cached_risk = risk_cache_.find(cell)) {
+    return *cached_risk;
   }
 
   double risk = getSingleCellRisk(cell);
-  for (const Cell& neighbor : cell.getFlowNeighbors()) {
+  Cell neighbors[6];
+  cell.getFlowNeighbors(neighbors);
+  for (const Cell& neighbor : neighbors) {
     risk += neighbor_risk_flow_ * getSingleCellRisk(neighbor);
   }
 
-  risk_cache_[cell] = risk;
+  risk_cache_.insert(cell, risk);
   return risk;
 }
 
@@ -224,11 +802,20 @@ double GlobalPlanner::getRiskOfCurve(
   auto points = threePointBezier(msg[0].pose.position, msg[1].pose.position,
                                  msg[2].pose.position, 4 * num_steps);
 
+  // Consecutive points mostly fall into the same Cell, the risk of each run of
+  // points is only looked up once
   double risk = 0.0;
   visitor_.seen_.clear();
-  for (auto point : points) {
-    risk += getRisk(Cell(point));
-    visitor_.seen_.insert(Cell(point));
+  int i = 0;
+  while (i < points.size()) {
+    Cell cell(points[i]);
+    int run = 1;
+    while (i + run < points.size() && Cell(points[i + run]) == cell) {
+      ++run;
+    }
+    risk += run * getRisk(cell);
+    visitor_.seen_.insert(cell);
+    i += run;
   }
   return risk;
 }
@@ -255,8 +842,6 @@ double GlobalPlanner::getEdgeCost(const Node& u, const Node& v) {
 // Returns a heuristic for the cost of risk for going from u to goal
 // The heuristic is the cost of risk through unknown environment
 double GlobalPlanner::riskHeuristic(const Cell& u, const Cell& goal) {
-  // return riskHeuristicReverseCache(u, goal);  // REVERSE_SEARCH
-
   if (u == goal) {
     return 0.0;
   }
@@ -274,24 +859,6 @@ double GlobalPlanner::riskHeuristic(const Cell& u, const Cell& goal) {
   return xy_risk + z_risk + goal_risk;
 }
 
-double GlobalPlanner::riskHeuristicReverseCache(const Cell& u,
-                                                const Cell& goal) {
-  if (bubble_risk_cache_.find(u) != bubble_risk_cache_.end()) {
-    return bubble_risk_cache_[u];
-  }
-  if (u == goal) {
-    return 0.0;
-  }
-  double dist_to_bubble =
-      std::max(0.0, u.diagDistance3D(goal) - bubble_radius_);
-  double unexplored_risk =
-      (1.0 + 6.0 * neighbor_risk_flow_) * expore_penalty_ * risk_factor_;
-  double heuristic =
-      bubble_cost_ + dist_to_bubble * unexplored_risk * getAltPrior(u);
-  // bubble_risk_cache_[u] = heuristic;
-  return heuristic;
-}
-
 // Returns a heuristic for the cost of turning for going from u to goal
 double GlobalPlanner::smoothnessHeuristic(const Node& u, const Cell& goal) {
   if (u.cell_.xIndex() == goal.xIndex() && u.cell_.yIndex() == goal.yIndex()) {
@@ -331,13 +898,16 @@ double GlobalPlanner::altitudeHeuristic(const Cell& u, const Cell& goal) {
 
 // Returns a heuristic of going from u to goal
 double GlobalPlanner::getHeuristic(const Node& u, const Cell& goal) {
-  if (heuristic_cache_.find(u) != heuristic_cache_.end()) {
-    // return heuristic_cache_[u];    // TODO: Needs to account for different
-    // overestimating factors
+  // Only overestimate the distance. Within a corridor the distance along the
+  // coarse path, less the size of a coarse Cell, is a better estimate
+  double dist = u.cell_.diagDistance2D(goal);
+  if (!corridor_.empty()) {
+    auto it = corridor_.find(u.cell_.getCoarseCell(corridor_level_));
+    if (it != corridor_.end()) {
+      dist = std::max(dist, it->second - CELL_SCALE * (1 << corridor_level_));
+    }
   }
-
-  // Only overestimate the distance
-  double heuristic = overestimate_factor_ * u.cell_.diagDistance2D(goal);
+  double heuristic = overestimate_factor_ * dist;
   heuristic += altitudeHeuristic(
       u.cell_, goal);  // Lower bound cost due to altitude change
   heuristic += smoothnessHeuristic(u, goal);  // Lower bound cost due to turning
@@ -346,13 +916,34 @@ double GlobalPlanner::getHeuristic(const Node& u, const Cell& goal) {
         u.cell_,
         goal);  // Risk through a straight-line path of unexplored space
   }
+  if (use_reverse_search_ && goal == reverse_goal_ && !reverse_cost_.empty()) {
+    // The reverse search gives a lower bound on everything but smoothness,
+    // within its grid the exact one
+    bool is_expanded =
+        reverse_cost_.contains(u.cell_) && reverse_cost_[u.cell_] < INFINITY;
+    double reverse_cost = is_expanded ? reverse_cost_[u.cell_] : reverse_bound_;
+    double reverse_heuristic =
+        reverse_cost + (overestimate_factor_ - 1.0) *
+                           u.cell_.diagDistance2D(goal) +
+        smoothnessHeuristic(u, goal);
+    if (is_expanded || reverse_heuristic > heuristic) {
+      heuristic = reverse_heuristic;
+    }
+  }
   if (use_speedup_heuristics_) {
     heuristic += visitor_.seen_count_[u.cell_];
   }
-  heuristic_cache_[u] = heuristic;
   return heuristic;
 }
 
+// True iff a search to goal can stop at cell and take the rest of the path
+// from the reverse search
+bool GlobalPlanner::meetsReverseSearch(const Cell& cell, const Cell& goal) {
+  return bidirectional_search_ && use_reverse_search_ &&
+         goal == reverse_goal_ && reverse_cost_.contains(cell) &&
+         reverse_cost_[cell] < INFINITY;
+}
+
 geometry_msgs::PoseStamped GlobalPlanner::createPoseMsg(const Cell& cell,
                                                         double yaw) {
   geometry_msgs::PoseStamped pose_msg;
@@ -366,28 +957,30 @@ nav_msgs::Path GlobalPlanner::getPathMsg() { return getPathMsg(curr_path_); }
 
 nav_msgs::Path GlobalPlanner::getPathMsg(const std::vector<Cell>& path) {
   nav_msgs::Path path_msg;
-  path_msg.header.frame_id = "/world";
+  getPathMsg(path, path_msg);
+  return path_msg;
+}
 
+// Writes the path to path_msg, reusing the poses it already holds
+void GlobalPlanner::getPathMsg(const std::vector<Cell>& path,
+                               nav_msgs::Path& path_msg) {
+  path_msg.header.frame_id = "/world";
+  path_msg.poses.resize(path.size());
   if (path.size() == 0) {
-    return path_msg;
+    return;
   }
 
-  // Use actual position instead of the center of the cell
   double last_yaw = curr_yaw_;
-
-  for (int i = 0; i < path.size() - 1; ++i) {
-    Cell p = path[i];
-    double new_yaw = nextYaw(p, path[i + 1], last_yaw);
-    // if (new_yaw != last_yaw) {   // only publish corner points
-    path_msg.poses.push_back(createPoseMsg(p, new_yaw));
-    // }
-    last_yaw = new_yaw;
-  }
-  Cell last_point =
-      path[path.size() -
-           1];  // Last point should have the same yaw as the previous point
-  path_msg.poses.push_back(createPoseMsg(last_point, last_yaw));
-  return path_msg;
+  for (int i = 0; i < path.size(); ++i) {
+    // Last point should have the same yaw as the previous point
+    if (i + 1 < path.size()) {
+      last_yaw = nextYaw(path[i], path[i + 1], last_yaw);
+    }
+    geometry_msgs::PoseStamped& pose_msg = path_msg.poses[i];
+    pose_msg.header.frame_id = "/world";
+    pose_msg.pose.position = path[i].toPoint();
+    pose_msg.pose.orientation = tf::createQuaternionMsgFromYaw(last_yaw);
+  }
 }
 
 PathWithRiskMsg GlobalPlanner::getPathWithRiskMsg() {
@@ -420,18 +1013,56 @@ PathInfo GlobalPlanner::getPathInfo(const std::vector<Cell>& path) {
   return path_info;
 }
 
-// Chooses the node-type of the search
-NodePtr GlobalPlanner::getStartNode(const Cell& start, const Cell& parent,
-                                    const std::string& type) {
-  if (type == "Node") {
-    return NodePtr(new Node(start, parent));
-  }
-  if (type == "NodeWithoutSmooth") {
-    return NodePtr(new NodeWithoutSmooth(start, parent));
+// Runs the search with the node type chosen at runtime
+SearchInfo GlobalPlanner::searchPath(SearchNodeType type,
+                                     std::vector<Cell>& path,
+                                     const Cell& start, const Cell& parent,
+                                     const GoalCell& goal,
+                                     int max_iterations) {
+  const MemoStats risk_cache_start = risk_cache_.stats();
+  SearchInfo search_info;
+  switch (type) {
+    case SearchNodeType::Node:
+      search_info = findSmoothPath(this, path, Node(start, parent), goal,
+                                   max_iterations, visitor_);
+      break;
+    case SearchNodeType::NodeWithoutSmooth:
+      search_info = findSmoothPath(this, path, NodeWithoutSmooth(start, parent),
+                                   goal, max_iterations, visitor_);
+      break;
+    case SearchNodeType::SpeedNode:
+      search_info = findSmoothPath(this, path, SpeedNode(start, parent), goal,
+                                   max_iterations, visitor_);
+      break;
   }
-  if (type == "SpeedNode") {
-    return NodePtr(new SpeedNode(start, parent));
+  search_info.risk_cache = risk_cache_.stats() - risk_cache_start;
+  return search_info;
+}
+
+// Runs the anytime search with the node type chosen at runtime
+bool GlobalPlanner::anytimeSearch(SearchNodeType type, std::vector<Cell>& path,
+                                  const Cell& start, const Cell& parent,
+                                  const GoalCell& goal,
+                                  double max_overestimate_factor,
+                                  SearchClock::time_point deadline,
+                                  int max_iterations) {
+  const std::string name = searchNodeTypeName(type);
+  switch (type) {
+    case SearchNodeType::Node:
+      return findAnytimePath(this, path, Node(start, parent), goal,
+                             max_overestimate_factor, min_overestimate_factor_,
+                             deadline, max_iterations, visitor_, name);
+    case SearchNodeType::NodeWithoutSmooth:
+      return findAnytimePath(this, path, NodeWithoutSmooth(start, parent),
+                             goal, max_overestimate_factor,
+                             min_overestimate_factor_, deadline,
+                             max_iterations, visitor_, name);
+    case SearchNodeType::SpeedNode:
+      break;
   }
+  return findAnytimePath(this, path, SpeedNode(start, parent), goal,
+                         max_overestimate_factor, min_overestimate_factor_,
+                         deadline, max_iterations, visitor_, name);
 }
 
 // Calls different search functions to find a path
@@ -453,53 +1084,75 @@ bool GlobalPlanner::findPath(std::vector<Cell>& path) {
   ROS_INFO("curr_pos_: %2.2f,%2.2f,%2.2f\t s: %2.2f,%2.2f,%2.2f", curr_pos_.x,
            curr_pos_.y, curr_pos_.z, s.xPos(), s.yPos(), s.zPos());
 
+  // search_time_ is the time it takes to find a path, it is also the budget
+  // of the anytime search
+  const SearchClock::time_point deadline =
+      SearchClock::now() + std::chrono::duration_cast<SearchClock::duration>(
+                               std::chrono::duration<double>(search_time_));
   bool found_path = false;
-  double best_path_cost = INFINITY;
   overestimate_factor_ = max_overestimate_factor_;
   int iter_left = max_iterations_;
-  int last_iter = 0;
 
-  // reverseSearch(t); // REVERSE_SEARCH
+  // A goal that is walled in is found by the reverse search within its
+  // budget instead of by max_iterations_ of the forward search
+  if (!use_reverse_search_) {
+    reverse_cost_.clear();
+  } else if (!reverseSearch(this, s, t, reverse_search_iterations_)) {
+    ROS_INFO("  Goal %s can not be reached", t.asString().c_str());
+    return false;
+  }
 
-  printf("Search              iter_time overest   num_iter  path_cost \n");
-  while (overestimate_factor_ >= min_overestimate_factor_ &&
-         iter_left > last_iter) {
-    std::vector<Cell> new_path;
-    SearchInfo search_info;
-    std::string node_type = default_node_type_;
-    if (overestimate_factor_ > 1.5) {
-      // Use a cheap search for higher overestimate
-      // found_new_path = findPathOld(new_path, s, t, parent_of_s, true);  // No
-      // need to search with smoothness
-      node_type = "NodeWithoutSmooth";
+  printf("Search              iter_time overest   num_iter  path_cost "
+         "risk_hits\n");
+  const int level = std::min(hierarchical_levels_, getOctreeDepth() - 1);
+  if (level > 0 && s.getCoarseCell(level).diagDistance2D(t.getCoarseCell(
+                       level)) > kMinCoarsePathLength * CELL_SCALE) {
+    // Far goals are planned on a coarse octree level first, the searches
+    // below only refine the corridor around the coarse path. The coarse
+    // search is bounded by its box instead of an iteration budget.
+    std::vector<Cell> coarse_path;
+    const MemoStats risk_cache_start = risk_cache_.stats();
+    SearchInfo search_info = findCoarsePath(
+        this, coarse_path, s, t, level, std::numeric_limits<int>::max());
+    search_info.risk_cache = risk_cache_.stats() - risk_cache_start;
+    printSearchInfo(search_info, "Coarse", 1 << level);
+    printf("\n");
+    if (search_info.found_path) {
+      setCorridor(coarse_path, level);
     }
-
-    NodePtr start_node = getStartNode(s, parent_of_s, node_type);
-    search_info =
-        findSmoothPath(this, new_path, start_node, t, iter_left, visitor_);
-    printSearchInfo(search_info, node_type, overestimate_factor_);
-
+  }
+  if (overestimate_factor_ > 1.5) {
+    // Use a cheap search for higher overestimate
+    std::vector<Cell> new_path;
+    SearchInfo search_info = searchPath(SearchNodeType::NodeWithoutSmooth,
+                                        new_path, s, parent_of_s, t, iter_left);
+    printSearchInfo(search_info, "NodeWithoutSmooth", overestimate_factor_);
     if (search_info.found_path) {
       PathInfo path_info = getPathInfo(new_path);
       printf("(cost: %2.2f, dist: %2.2f, risk: %2.2f, smooth: %2.2f) \n",
              path_info.cost, path_info.dist, path_info.risk,
              path_info.smoothness);
-      if (true || path_info.cost <= best_path_cost) {
-        // TODO: always use the newest path?
-        best_path_cost = path_info.cost;
-        path = new_path;
-        found_path = true;
-      }
-    } else {
-      break;
+      path = new_path;
+      found_path = true;
+      iter_left -= search_info.num_iter;
+      overestimate_factor_ = (overestimate_factor_ - 1.0) / 4.0 + 1.0;
+    }
+  }
+  if (found_path || max_overestimate_factor_ <= 1.5) {
+    // Refine with the smooth search, which keeps its state between the
+    // overestimate factors
+    std::vector<Cell> new_path;
+    if (anytimeSearch(default_node_type_, new_path, s, parent_of_s, t,
+                      overestimate_factor_, deadline, iter_left)) {
+      path = new_path;
+      found_path = true;
     }
-    last_iter = search_info.num_iter;
-    iter_left -= last_iter;
-    overestimate_factor_ = (overestimate_factor_ - 1.0) / 4.0 + 1.0;
   }
 
+  setCorridor(std::vector<Cell>(), 0);
+
   // Last resort, try 2d search at max_altitude_
-  if (!found_path) {
+  if (!found_path && !isSearchCancelled()) {
     printf("No path found, search in 2D \n");
     max_iterations_ = 5000;
     found_path = find2DPath(this, path, s, t, parent_of_s, max_altitude_);
@@ -508,6 +1161,66 @@ bool GlobalPlanner::findPath(std::vector<Cell>& path) {
   return found_path;
 }
 
+// Replaces the blocked part of curr_path_ ahead of the vehicle by a new
+// segment and keeps the rest of the path. Returns false if there is nothing to
+// repair or no segment was found, then a new path has to be planned
+bool GlobalPlanner::repairPath() {
+  const std::vector<Cell>& path = curr_path_;
+  const int path_size = path.size();
+  if (going_back_ || path_size < 4) {
+    return false;
+  }
+
+  // Only the part ahead of the vehicle can be changed
+  Cell curr_cell(curr_pos_);
+  int curr_index = 0;
+  for (int i = 1; i < path_size; ++i) {
+    if (path[i].distance3D(curr_cell) <
+        path[curr_index].distance3D(curr_cell)) {
+      curr_index = i;
+    }
+  }
+  int first_blocked = -1;
+  int last_blocked = -1;
+  for (int i = std::max(2, curr_index + 1); i < path_size; ++i) {
+    if (getRisk(Node(path[i], path[i - 1])) > max_cell_risk_) {
+      first_blocked = first_blocked < 0 ? i : first_blocked;
+      last_blocked = i;
+    }
+  }
+  if (first_blocked < 0 || last_blocked == path_size - 1) {
+    return false;  // Not blocked, or the end of the path is blocked
+  }
+
+  // Reconnect a few cells before and after the blocked edges
+  const int begin =
+      std::max(first_blocked - kRepairMargin, std::max(2, curr_index + 2));
+  const int end = std::min(last_blocked + kRepairMargin, path_size - 1);
+  const SearchClock::time_point deadline =
+      SearchClock::now() + std::chrono::duration_cast<SearchClock::duration>(
+                               std::chrono::duration<double>(search_time_));
+  std::vector<Cell> segment;
+  printf("Repair              iter_time overest   num_iter  path_cost "
+         "risk_hits\n");
+  if (!anytimeSearch(default_node_type_, segment, path[begin - 1],
+                     path[begin - 2], GoalCell(path[end]),
+                     max_overestimate_factor_, deadline, max_iterations_)) {
+    return false;
+  }
+
+  // segment starts with path[begin - 2], path[begin - 1] and ends in path[end]
+  std::vector<Cell> new_path(path.begin(), path.begin() + begin - 2);
+  new_path.insert(new_path.end(), segment.begin(), segment.end());
+  new_path.insert(new_path.end(), path.begin() + end + 1, path.end());
+  if (getPathInfo(new_path).is_blocked) {
+    return false;
+  }
+  ROS_INFO("Repaired the path between %s and %s",
+           path[begin - 1].asString().c_str(), path[end].asString().c_str());
+  setPath(new_path);
+  return true;
+}
+
 // Returns true iff a path needs to be published, either a new path or a path
 // back The path is then stored in this.pathMsg
 bool GlobalPlanner::getGlobalPath() {
@@ -559,7 +1272,7 @@ void GlobalPlanner::goBack() {
       break;
     }
   }
-  curr_path_ = new_path;
+  setPath(new_path);
   goal_pos_ = GoalCell(new_path[new_path.size() - 1], 1.0);
 }
 
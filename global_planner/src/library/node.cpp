@@ -2,6 +2,8 @@
 
 namespace global_planner {
 
+double SPEEDNODE_RADIUS = 5.0;
+
 bool Node::isSmaller(const Node& other) const {
   return cell_ < other.cell_ ||
          (cell_ == other.cell_ && parent_ < other.parent_);
@@ -28,6 +30,10 @@ std::vector<NodePtr> Node::getNeighbors() const {
   return neighbors;
 }
 
+int Node::getNeighborCells(Cell* cells) const {
+  return cell_.getNeighbors(cells);
+}
+
 std::unordered_set<Cell> Node::getCells() const {
   std::unordered_set<Cell> cells;
   int dx = cell_.xIndex() - parent_.xIndex();
@@ -89,4 +95,26 @@ std::string Node::asString() const {
   return s;
 }
 
+SearchNodeType toSearchNodeType(const std::string& name) {
+  if (name == "Node") {
+    return SearchNodeType::Node;
+  }
+  if (name == "NodeWithoutSmooth") {
+    return SearchNodeType::NodeWithoutSmooth;
+  }
+  return SearchNodeType::SpeedNode;
+}
+
+std::string searchNodeTypeName(SearchNodeType type) {
+  switch (type) {
+    case SearchNodeType::Node:
+      return "Node";
+    case SearchNodeType::NodeWithoutSmooth:
+      return "NodeWithoutSmooth";
+    case SearchNodeType::SpeedNode:
+      return "SpeedNode";
+  }
+  return "SpeedNode";
+}
+
 }  // namespace global_planner
@@ -17,6 +17,9 @@ GlobalPlannerNode::GlobalPlannerNode() {
   // Subscribers
   octomap_full_sub_ = nh_.subscribe(
       "/octomap_full", 1, &GlobalPlannerNode::octomapFullCallback, this);
+  // Bounded region updates are small and must not be dropped
+  octomap_region_sub_ = nh_.subscribe(
+      "/octomap_region", 10, &GlobalPlannerNode::octomapRegionCallback, this);
   ground_truth_sub_ = nh_.subscribe("/mavros/local_position/pose", 1,
                                     &GlobalPlannerNode::positionCallback, this);
   velocity_sub_ = nh_.subscribe("/mavros/local_position/velocity", 1,
@@ -57,9 +60,42 @@ GlobalPlannerNode::GlobalPlannerNode() {
   actual_path_.header.frame_id = "/world";
   listener_.waitForTransform("/fcu", "/world", ros::Time(0),
                              ros::Duration(3.0));
+
+  planner_thread_ =
+      std::thread(&GlobalPlannerNode::plannerThreadFunction, this);
+  leg_thread_ = std::thread(&GlobalPlannerNode::legThreadFunction, this);
+  cloud_thread_ = std::thread(&GlobalPlannerNode::cloudThreadFunction, this);
 }
 
-GlobalPlannerNode::~GlobalPlannerNode() {}
+GlobalPlannerNode::~GlobalPlannerNode() {
+  should_exit_ = true;
+  plan_cancelled_ = true;
+  {
+    std::lock_guard<std::mutex> lock(planner_mutex_);
+    cancelLegs(legs_);
+  }
+  {
+    std::lock_guard<std::mutex> lock(plan_request_mutex_);
+    plan_request_cv_.notify_all();
+    leg_request_cv_.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lock(cloud_mutex_);
+    cloud_cv_.notify_all();
+  }
+  planner_thread_.join();
+  leg_thread_.join();
+  cloud_thread_.join();
+
+  if (save_map_tiles_ && !map_tiles_path_.empty()) {
+    std::lock_guard<std::mutex> lock(planner_mutex_);
+    if (global_planner_.saveMapTiles(map_tiles_path_)) {
+      ROS_INFO("Saved the map to %s", map_tiles_path_.c_str());
+    } else {
+      ROS_WARN("Could not save the map to %s", map_tiles_path_.c_str());
+    }
+  }
+}
 
 // Read Ros parameters
 void GlobalPlannerNode::readParams() {
@@ -68,6 +104,19 @@ void GlobalPlannerNode::readParams() {
   nh_.param<double>("start_pos_y", y, 0.5);
   nh_.param<double>("start_pos_z", z, 3.5);
   global_planner_.goal_pos_ = GoalCell(x, y, z);
+
+  nh_.param<std::string>("map_tiles", map_tiles_path_, "");
+  nh_.param<bool>("save_map_tiles", save_map_tiles_, false);
+  nh_.param<int>("depth_cloud_queue_size", cloud_queue_size_, 2);
+  cloud_queue_size_ = std::max(1, cloud_queue_size_);
+  if (!map_tiles_path_.empty()) {
+    if (global_planner_.loadMapTiles(map_tiles_path_)) {
+      ROS_INFO("Loaded %zu map tiles from %s",
+               global_planner_.map_tiles_->numTiles(), map_tiles_path_.c_str());
+    } else {
+      ROS_WARN("No map tiles in %s", map_tiles_path_.c_str());
+    }
+  }
 }
 
 // Sets a new goal, plans a path to it and publishes some info
@@ -76,6 +125,7 @@ void GlobalPlannerNode::setNewGoal(const GoalCell& goal) {
   global_planner_.setGoal(goal);
   publishGoal(goal);
   planPath();
+  requestLegPlans();
 }
 
 // Sets the next waypoint to be the current goal
@@ -83,8 +133,21 @@ void GlobalPlannerNode::popNextGoal() {
   if (!waypoints_.empty()) {
     // Set the first goal in waypoints_ as the new goal
     GoalCell new_goal = waypoints_.front();
+    std::vector<Cell> leg_path = takeLegPath(new_goal);
     waypoints_.erase(waypoints_.begin());
-    setNewGoal(new_goal);
+    if (leg_path.empty()) {
+      setNewGoal(new_goal);
+    } else {
+      // The leg was planned ahead, it is followed without waiting for a plan
+      ROS_INFO("========== Set goal : %s (planned ahead) ==========",
+               new_goal.asString().c_str());
+      cancelPlan();
+      global_planner_.setGoal(new_goal);
+      global_planner_.setPath(leg_path);
+      publishGoal(new_goal);
+      publishPath();
+      requestLegPlans();
+    }
   } else if (global_planner_.goal_is_blocked_) {
     // Goal is blocked but there is no other goal in waypoints_, just stop
     ROS_INFO("  STOP  ");
@@ -93,15 +156,136 @@ void GlobalPlannerNode::popNextGoal() {
   }
 }
 
-// Plans a new path and publishes it
+// Requests a new path, planner_thread_ plans and publishes it. A plan that
+// is still running is cancelled. Has to be called with planner_mutex_ locked
 void GlobalPlannerNode::planPath() {
-  std::clock_t start_time = std::clock();
-  if (global_planner_.octree_) {
-    ROS_INFO("OctoMap memory usage: %2.3f MB",
-             global_planner_.octree_->memoryUsage() / 1000000.0);
+  cancelPlan();
+  std::lock_guard<std::mutex> lock(plan_request_mutex_);
+  plan_requested_ = true;
+  repair_requested_ = false;
+  plan_request_cv_.notify_one();
+}
+
+// Requests a repair of the blocked part of the current path on
+// planner_thread_, which plans a whole new path if the repair fails. Has to be
+// called with planner_mutex_ locked
+void GlobalPlannerNode::repairPath() {
+  cancelPlan();
+  std::lock_guard<std::mutex> lock(plan_request_mutex_);
+  plan_requested_ = true;
+  repair_requested_ = true;
+  plan_request_cv_.notify_one();
+}
+
+// Returns true if a plan is running or requested, has to be called with
+// planner_mutex_ locked
+bool GlobalPlannerNode::isPlanPending() {
+  std::lock_guard<std::mutex> lock(plan_request_mutex_);
+  return is_planning_ || plan_requested_;
+}
+
+// Stops a plan that is still running and drops its result, has to be called
+// with planner_mutex_ locked
+void GlobalPlannerNode::cancelPlan() {
+  ++plan_generation_;
+  plan_cancelled_ = true;
+}
+
+// Plans on a copy of the search inputs of global_planner_, so the callbacks
+// are not blocked while it searches. The maps are shared with the copy, an
+// update replaces them.
+void GlobalPlannerNode::plannerThreadFunction() {
+  while (!should_exit_) {
+    {
+      std::unique_lock<std::mutex> lock(plan_request_mutex_);
+      plan_request_cv_.wait(lock,
+                            [this] { return plan_requested_ || should_exit_; });
+    }
+    if (should_exit_) {
+      break;
+    }
+
+    GlobalPlanner planner;
+    int generation;
+    int map_updates;
+    bool repair;
+    std::vector<Cell> blocked_path;
+    {
+      // cancelPlan() is called with planner_mutex_ locked, so the request,
+      // the cancel flag and the generation are taken together
+      std::lock_guard<std::mutex> lock(planner_mutex_);
+      {
+        std::lock_guard<std::mutex> request_lock(plan_request_mutex_);
+        plan_requested_ = false;
+        repair = repair_requested_;
+        repair_requested_ = false;
+      }
+      plan_cancelled_ = false;
+      generation = plan_generation_;
+      map_updates = num_map_updates_;
+      planner.copySearchInputs(global_planner_);
+      if (repair) {
+        blocked_path = global_planner_.curr_path_;
+        planner.curr_path_ = blocked_path;
+      }
+      is_planning_ = true;
+    }
+    planner.cancel_search_ = &plan_cancelled_;
+
+    std::clock_t start_time = std::clock();
+    if (planner.octree_) {
+      ROS_INFO("OctoMap memory usage: %2.3f MB",
+               planner.octree_->memoryUsage() / 1000000.0);
+    }
+    beginSearch();
+    bool repaired = repair && planner.repairPath();
+    bool found_path = repaired || planner.getGlobalPath();
+    endSearch();
+
+    std::lock_guard<std::mutex> lock(planner_mutex_);
+    is_planning_ = false;
+    if (plan_cancelled_ || generation != plan_generation_) {
+      // A newer goal arrived, its plan is already requested. A
+      // cancelled search is not a failed one and must not block the goal
+      ROS_INFO("Plan cancelled");
+      continue;
+    }
+    if (repaired) {
+      // Only the blocked part of the path was replaced, the path must not
+      // have been changed in the meantime, e.g. by goBack()
+      if (global_planner_.curr_path_ == blocked_path) {
+        global_planner_.setPath(planner.curr_path_);
+        publishPath();
+      } else {
+        planPath();
+        continue;
+      }
+    } else {
+      applyPlan(planner, found_path);
+      printf("Total time: %2.2f ms \n",
+             (std::clock() - start_time) / (double)(CLOCKS_PER_SEC / 1000));
+    }
+
+    // The search used the map of its start, setPath() evaluated the new path
+    // on the current one
+    if (found_path && map_updates != num_map_updates_ && !isPlanPending() &&
+        !global_planner_.isCurrentPathOk()) {
+      replanBadPath();
+    }
   }
+}
 
-  bool found_path = global_planner_.getGlobalPath();
+// Takes the result of a plan of the copy planner and publishes it, has to be
+// called with planner_mutex_ locked
+void GlobalPlannerNode::applyPlan(const GlobalPlanner& planner,
+                                  bool found_path) {
+  global_planner_.current_cell_blocked_ = planner.current_cell_blocked_;
+  global_planner_.goal_is_blocked_ = planner.goal_is_blocked_;
+  global_planner_.overestimate_factor_ = planner.overestimate_factor_;
+  global_planner_.visitor_ = planner.visitor_;
+  if (found_path) {
+    global_planner_.setPath(planner.curr_path_);
+  }
 
   // Publish even though no path is found
   publishExploredCells();
@@ -115,8 +299,164 @@ void GlobalPlannerNode::planPath() {
     // The path is not good enough, set an intermediate goal on the path
     setIntermediateGoal();
   }
-  printf("Total time: %2.2f ms \n",
-         (std::clock() - start_time) / (double)(CLOCKS_PER_SEC / 1000));
+}
+
+// Plans the legs that have no path, each on its own thread. Map updates and
+// new goals during the plans only request the legs again.
+void GlobalPlannerNode::legThreadFunction() {
+  while (!should_exit_) {
+    {
+      std::unique_lock<std::mutex> lock(plan_request_mutex_);
+      leg_request_cv_.wait(lock,
+                           [this] { return legs_requested_ || should_exit_; });
+      legs_requested_ = false;
+    }
+    if (should_exit_) {
+      break;
+    }
+
+    std::vector<Leg> legs;
+    GlobalPlanner planner;
+    {
+      std::lock_guard<std::mutex> lock(planner_mutex_);
+      if (should_exit_) {
+        break;  // The destructor cancels the legs with planner_mutex_ locked
+      }
+      updateLegs();
+      for (Leg& leg : legs_) {
+        if (leg.path.empty()) {
+          leg.cancel_search = std::make_shared<std::atomic<bool> >(false);
+          legs.push_back(leg);
+        }
+      }
+      if (legs.empty()) {
+        continue;
+      }
+      planner.copySearchInputs(global_planner_);
+    }
+
+    std::clock_t start_time = std::clock();
+    std::vector<GlobalPlanner> planners(legs.size(), planner);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < legs.size(); ++i) {
+      threads.push_back(std::thread(&GlobalPlannerNode::planLeg, this,
+                                    std::ref(planners[i]), std::ref(legs[i])));
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+
+    // The waypoints and the map may have changed in the meantime, a leg that
+    // was dropped or cancelled keeps no path
+    std::lock_guard<std::mutex> lock(planner_mutex_);
+    int num_planned = 0;
+    for (const Leg& planned : legs) {
+      if (planned.path.empty() || *planned.cancel_search) {
+        continue;
+      }
+      for (Leg& leg : legs_) {
+        if (leg.cancel_search == planned.cancel_search && leg.path.empty() &&
+            !global_planner_.getPathInfo(planned.path).is_blocked) {
+          leg.path = planned.path;
+          num_planned++;
+        }
+      }
+    }
+    ROS_INFO("Planned %d of %d legs ahead in %2.2f ms", num_planned,
+             static_cast<int>(legs.size()),
+             (std::clock() - start_time) / (double)(CLOCKS_PER_SEC / 1000));
+  }
+}
+
+// Plans the leg with a copy of the planner that hovers at its start. The
+// Cells of the leg and of the copy are of no use once CELL_SCALE has changed
+void GlobalPlannerNode::planLeg(GlobalPlanner& planner, Leg& leg) {
+  beginSearch();
+  if (leg.cell_scale == CELL_SCALE) {
+    planner.cancel_search_ = leg.cancel_search.get();
+    planner.curr_pos_ = leg.start.toPoint();
+    planner.curr_vel_ = geometry_msgs::Vector3();
+    planner.setGoal(leg.goal);
+    if (planner.getGlobalPath()) {
+      leg.path = planner.curr_path_;
+    }
+  }
+  endSearch();
+}
+
+// Matches legs_ with the first planned_legs_ahead_ waypoints and drops the
+// paths that are blocked in the current map. The plans of the legs that are
+// dropped are cancelled. Returns true iff one of the legs has no path. Has to
+// be called with planner_mutex_ locked
+bool GlobalPlannerNode::updateLegs() {
+  const int num_legs =
+      std::min(planned_legs_ahead_, static_cast<int>(waypoints_.size()));
+  std::vector<Leg> legs(num_legs);
+  bool needs_plan = false;
+  for (int i = 0; i < num_legs; ++i) {
+    legs[i].start = i == 0 ? global_planner_.goal_pos_ : waypoints_[i - 1];
+    legs[i].goal = waypoints_[i];
+    for (Leg& leg : legs_) {
+      if (leg.start == legs[i].start && leg.goal == legs[i].goal &&
+          leg.cell_scale == CELL_SCALE) {
+        legs[i].path.swap(leg.path);
+        legs[i].cancel_search.swap(leg.cancel_search);
+        break;
+      }
+    }
+    if (!legs[i].path.empty() &&
+        global_planner_.getPathInfo(legs[i].path).is_blocked) {
+      legs[i].path.clear();
+    }
+    needs_plan |= legs[i].path.empty();
+  }
+  legs_.swap(legs);
+  cancelLegs(legs);
+  return needs_plan;
+}
+
+// Returns the path of the leg from the current goal to goal, or an empty path
+// if it was not planned ahead or is blocked. Has to be called with
+// planner_mutex_ locked
+std::vector<Cell> GlobalPlannerNode::takeLegPath(const GoalCell& goal) {
+  std::vector<Cell> path;
+  updateLegs();
+  if (!legs_.empty() && legs_.front().goal == goal) {
+    path.swap(legs_.front().path);
+    cancelLegs(std::vector<Leg>(1, legs_.front()));
+    legs_.erase(legs_.begin());
+  }
+  return path;
+}
+
+// Wakes leg_thread_ to plan the legs that have no path
+void GlobalPlannerNode::requestLegPlans() {
+  std::lock_guard<std::mutex> lock(plan_request_mutex_);
+  legs_requested_ = true;
+  leg_request_cv_.notify_one();
+}
+
+// Stops the plans of legs that are still running, their results are dropped
+void GlobalPlannerNode::cancelLegs(const std::vector<Leg>& legs) {
+  for (const Leg& leg : legs) {
+    if (leg.cancel_search) {
+      *leg.cancel_search = true;
+    }
+  }
+}
+
+// The copies of the planner search concurrently, the globals of cell and node
+// are only changed while none of them is searching
+void GlobalPlannerNode::beginSearch() {
+  std::lock_guard<std::mutex> lock(search_mutex_);
+  ++num_searches_;
+}
+
+void GlobalPlannerNode::endSearch() {
+  std::lock_guard<std::mutex> lock(search_mutex_);
+  if (--num_searches_ == 0) {
+    search_cv_.notify_all();
+  }
 }
 
 // Sets a temporary goal on the path to the current goal
@@ -132,6 +472,24 @@ void GlobalPlannerNode::setIntermediateGoal() {
 
 void GlobalPlannerNode::dynamicReconfigureCallback(
     global_planner::GlobalPlannerNodeConfig& config, uint32_t level) {
+  // cell and node, globals which a running search also reads. The searches
+  // are cancelled and waited for before planner_mutex_ is taken, so the
+  // callbacks are not blocked while they finish
+  const bool changes_globals = level == 2 || level == 4;
+  std::unique_lock<std::mutex> search_lock(search_mutex_, std::defer_lock);
+  bool was_planning = false;
+  if (changes_globals) {
+    {
+      std::lock_guard<std::mutex> lock(planner_mutex_);
+      was_planning = is_planning_;
+      cancelPlan();
+      cancelLegs(legs_);
+    }
+    search_lock.lock();
+    search_cv_.wait(search_lock, [this] { return num_searches_ == 0; });
+  }
+
+  std::lock_guard<std::mutex> lock(planner_mutex_);
   // global_planner_
   global_planner_.min_altitude_ = config.min_altitude_;
   global_planner_.max_altitude_ = config.max_altitude_;
@@ -147,26 +505,45 @@ void GlobalPlannerNode::dynamicReconfigureCallback(
   global_planner_.min_overestimate_factor_ = config.min_overestimate_factor_;
   global_planner_.max_overestimate_factor_ = config.max_overestimate_factor_;
   global_planner_.max_iterations_ = config.max_iterations_;
+  global_planner_.use_reverse_search_ = config.use_reverse_search_;
+  global_planner_.reverse_search_iterations_ =
+      config.reverse_search_iterations_;
+  global_planner_.bidirectional_search_ = config.bidirectional_search_;
+  global_planner_.hierarchical_levels_ = config.hierarchical_levels_;
   global_planner_.goal_must_be_free_ = config.goal_must_be_free_;
   global_planner_.use_current_yaw_ = config.use_current_yaw_;
   global_planner_.use_risk_heuristics_ = config.use_risk_heuristics_;
   global_planner_.use_speedup_heuristics_ = config.use_speedup_heuristics_;
+  global_planner_.risk_cache_.setCapacity(config.risk_cache_size_);
 
   // global_planner_node
   clicked_goal_alt_ = config.clicked_goal_alt_;
   clicked_goal_radius_ = config.clicked_goal_radius_;
-  simplify_iterations_ = config.simplify_iterations_;
   simplify_margin_ = config.simplify_margin_;
+  planned_legs_ahead_ = config.planned_legs_ahead_;
 
-  // cell
+  // No search starts while search_lock is held
   if (level == 2) {
     CELL_SCALE = config.CELL_SCALE;
+    // A saved map only fits the Cell size it was saved with
+    if (!map_tiles_path_.empty()) {
+      global_planner_.loadMapTiles(map_tiles_path_);
+    }
+  } else if (level == 4) {
+    SPEEDNODE_RADIUS = config.SPEEDNODE_RADIUS;
+    global_planner_.default_node_type_ =
+        toSearchNodeType(config.default_node_type_);
   }
 
-  // node
-  if (level == 4) {
-    SPEEDNODE_RADIUS = config.SPEEDNODE_RADIUS;
-    global_planner_.default_node_type_ = config.default_node_type_;
+  // The cached risk depends on the parameters and the Cell size
+  global_planner_.resetRisk();
+
+  // A running or cancelled plan starts again with the new parameters
+  if (was_planning || is_planning_) {
+    planPath();
+  }
+  if (changes_globals) {
+    requestLegPlans();
   }
 }
 
@@ -174,6 +551,7 @@ void GlobalPlannerNode::velocityCallback(
     const geometry_msgs::TwistStamped& msg) {
   auto transformed_msg =
       transformTwistMsg(listener_, "world", "local_origin", msg);  // 90 deg fix
+  std::lock_guard<std::mutex> lock(planner_mutex_);
   global_planner_.curr_vel_ = transformed_msg.twist.linear;
 }
 
@@ -184,6 +562,11 @@ void GlobalPlannerNode::positionCallback(
   auto rot_msg = msg;
   listener_.transformPose("world", ros::Time(0), msg, "local_origin",
                           rot_msg);  // 90 deg fix
+  recent_poses_.push_back(rot_msg);
+  if (recent_poses_.size() > 100) {
+    recent_poses_.pop_front();
+  }
+  std::lock_guard<std::mutex> lock(planner_mutex_);
   global_planner_.setPose(rot_msg);
 
   // Check if a new goal is needed
@@ -193,8 +576,10 @@ void GlobalPlannerNode::positionCallback(
     popNextGoal();
   }
 
-  // If the current cell is blocked, try finding a path again
-  if (global_planner_.current_cell_blocked_) {
+  // If the current cell is blocked, try finding a path again. A plan that is
+  // running or requested is not restarted, a search takes longer than the
+  // time between two poses and would never finish
+  if (global_planner_.current_cell_blocked_ && !isPlanPending()) {
     planPath();
   }
 
@@ -218,6 +603,7 @@ void GlobalPlannerNode::positionCallback(
 
 void GlobalPlannerNode::clickedPointCallback(
     const geometry_msgs::PointStamped& msg) {
+  std::lock_guard<std::mutex> lock(planner_mutex_);
   printPointInfo(msg.point.x, msg.point.y, msg.point.z);
 
   geometry_msgs::PoseStamped pose;
@@ -238,6 +624,7 @@ void GlobalPlannerNode::clickedPointCallback(
 }
 
 void GlobalPlannerNode::threePointCallback(const nav_msgs::Path& msg) {
+  std::lock_guard<std::mutex> lock(planner_mutex_);
   double risk = global_planner_.getRiskOfCurve(msg.poses);
   ROS_INFO("Risk of curve: %2.2f \n", risk);
 
@@ -250,8 +637,8 @@ void GlobalPlannerNode::threePointCallback(const nav_msgs::Path& msg) {
     Cell s = Cell(interpolate(msg.poses[0].pose.position,
                               msg.poses[1].pose.position, 0.25));
     Cell t = GoalCell(Cell(msg.poses[2].pose.position), 5.0);
-    auto start_node = global_planner_.getStartNode(s, parent, "SpeedNode");
-    auto search_res = findSmoothPath(&global_planner_, new_path, start_node, t);
+    auto search_res =
+        findSmoothPath(&global_planner_, new_path, SpeedNode(s, parent), t);
     new_msg = global_planner_.getPathMsg(new_path);
   }
   three_points_revised_pub_.publish(smoothPath(new_msg));
@@ -259,12 +646,14 @@ void GlobalPlannerNode::threePointCallback(const nav_msgs::Path& msg) {
 
 void GlobalPlannerNode::moveBaseSimpleCallback(
     const geometry_msgs::PoseStamped& msg) {
+  std::lock_guard<std::mutex> lock(planner_mutex_);
   setNewGoal(GoalCell(msg.pose.position.x, msg.pose.position.y,
                       clicked_goal_alt_, clicked_goal_radius_));
 }
 
 void GlobalPlannerNode::fcuInputGoalCallback(
     const mavros_msgs::Trajectory& msg) {
+  std::lock_guard<std::mutex> lock(planner_mutex_);
   const GoalCell new_goal =
       GoalCell(msg.point_2.position.x, msg.point_2.position.y,
                msg.point_2.position.z, 1.0);
@@ -280,6 +669,7 @@ void GlobalPlannerNode::fcuInputGoalCallback(
 // If the laser senses something too close to current position, it is considered
 // a crash
 void GlobalPlannerNode::laserSensorCallback(const sensor_msgs::LaserScan& msg) {
+  std::lock_guard<std::mutex> lock(planner_mutex_);
   if (global_planner_.going_back_) {
     return;  // Don't deal with the same crash again
   }
@@ -305,44 +695,140 @@ void GlobalPlannerNode::octomapFullCallback(const octomap_msgs::Octomap& msg) {
     return;  // We get too many of those messages. Only process 1/10 of them
   }
 
-  bool current_path_is_ok = global_planner_.updateFullOctomap(msg);
+  std::lock_guard<std::mutex> lock(planner_mutex_);
+  checkPath(global_planner_.updateFullOctomap(msg));
+}
+
+// Merge the voxels of a bounded region and check if the current path is blocked
+void GlobalPlannerNode::octomapRegionCallback(
+    const octomap_msgs::Octomap& msg) {
+  std::lock_guard<std::mutex> lock(planner_mutex_);
+  checkPath(global_planner_.updateOctomapRegion(msg));
+}
+
+// Replan if the last octomap update blocked the current path. A plan that is
+// still running is not restarted, the updates arrive faster than a search
+// finishes. Its path is checked against the new map once it is applied.
+void GlobalPlannerNode::checkPath(bool current_path_is_ok) {
+  ++num_map_updates_;
+  if (updateLegs()) {
+    requestLegPlans();  // Only the blocked legs are planned again
+  }
   if (!current_path_is_ok) {
-    ROS_INFO("  Path is bad, planning a new path \n");
-    if (global_planner_.goal_pos_.is_temporary_) {
-      popNextGoal();  // Throw away temporary goal
-    } else {
-      planPath();  // Plan a whole new path
-    }
+    replanBadPath();
   }
 }
 
-// Go through obstacle points and store them
+// Replaces a current path that is blocked, has to be called with
+// planner_mutex_ locked
+void GlobalPlannerNode::replanBadPath() {
+  ROS_INFO("  Path is bad, planning a new path \n");
+  if (global_planner_.goal_pos_.is_temporary_) {
+    popNextGoal();  // Throw away temporary goal
+  } else {
+    repairPath();  // Falls back to a whole new path
+  }
+}
+
+// Queues a depth cloud with its transform to /world for cloudThreadFunction
 void GlobalPlannerNode::depthCameraCallback(
-    const sensor_msgs::PointCloud2& msg) {
+    const sensor_msgs::PointCloud2::ConstPtr& msg) {
   try {
-    // Transform msg from camera frame to world frame
-    ros::Time now = ros::Time::now();
-    listener_.waitForTransform("/world", "/camera_link", now,
-                               ros::Duration(5.0));
-    tf::StampedTransform transform;
-    listener_.lookupTransform("/world", "/camera_link", now, transform);
-    sensor_msgs::PointCloud2 transformed_msg;
-    pcl_ros::transformPointCloud("/world", transform, msg, transformed_msg);
-    pcl::PointCloud<pcl::PointXYZ>
-        cloud;  // Easier to loop through pcl::PointCloud
-    pcl::fromROSMsg(transformed_msg, cloud);
-
-    // Store the obstacle points
-    for (const auto& p : cloud) {
-      if (!std::isnan(p.x)) {
-        // TODO: Not all points end up here
-        Cell occupied_cell(p.x, p.y, p.z);
-        global_planner_.occupied_.insert(occupied_cell);
+    // The camera is fixed to the vehicle, its transform is looked up once
+    if (!has_camera_extrinsics_) {
+      if (!listener_.canTransform("/fcu", "/camera_link", ros::Time(0))) {
+        return;
       }
+      listener_.lookupTransform("/fcu", "/camera_link", ros::Time(0),
+                                camera_extrinsics_);
+      has_camera_extrinsics_ = true;
     }
   } catch (tf::TransformException const& ex) {
     ROS_DEBUG("%s", ex.what());
     ROS_WARN("Transformation not available (/world to /camera_link");
+    return;
+  }
+
+  // Transform msg from camera frame to world frame with the vehicle pose at
+  // the stamp of the cloud, interpolated between the poses around it. A cloud
+  // outside of recent_poses_ gets the closest pose
+  if (recent_poses_.empty()) {
+    return;
+  }
+  const ros::Time& stamp = msg->header.stamp;
+  auto next = std::lower_bound(
+      recent_poses_.begin(), recent_poses_.end(), stamp,
+      [](const geometry_msgs::PoseStamped& pose, const ros::Time& t) {
+        return pose.header.stamp < t;
+      });
+  tf::Pose vehicle_pose;
+  if (next == recent_poses_.begin() || next == recent_poses_.end()) {
+    auto closest = next == recent_poses_.end() ? next - 1 : next;
+    tf::poseMsgToTF(closest->pose, vehicle_pose);
+  } else {
+    tf::Pose prev_pose, next_pose;
+    tf::poseMsgToTF((next - 1)->pose, prev_pose);
+    tf::poseMsgToTF(next->pose, next_pose);
+    const double t = (stamp - (next - 1)->header.stamp).toSec() /
+                     (next->header.stamp - (next - 1)->header.stamp).toSec();
+    vehicle_pose.setOrigin(
+        prev_pose.getOrigin().lerp(next_pose.getOrigin(), t));
+    vehicle_pose.setRotation(
+        prev_pose.getRotation().slerp(next_pose.getRotation(), t));
+  }
+
+  std::lock_guard<std::mutex> lock(cloud_mutex_);
+  if (cloud_queue_.size() >= static_cast<std::size_t>(cloud_queue_size_)) {
+    cloud_queue_.pop_front();
+    dropped_clouds_++;
+  }
+  cloud_queue_.push_back(DepthCloud{msg, vehicle_pose * camera_extrinsics_});
+  cloud_cv_.notify_one();
+}
+
+// Inserts the queued depth clouds into the map. The points are transformed
+// and reduced to the keys of their Cells without planner_mutex_, the keys of
+// all clouds taken from the queue are then inserted at once.
+void GlobalPlannerNode::cloudThreadFunction() {
+  std::deque<DepthCloud> clouds;
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  std::vector<uint64_t> keys;
+  std::vector<uint64_t> batch_keys;
+  while (true) {
+    int dropped_clouds = 0;
+    {
+      std::unique_lock<std::mutex> lock(cloud_mutex_);
+      cloud_cv_.wait(lock,
+                     [this] { return should_exit_ || !cloud_queue_.empty(); });
+      if (should_exit_) {
+        return;
+      }
+      clouds.swap(cloud_queue_);
+      std::swap(dropped_clouds, dropped_clouds_);
+    }
+    if (dropped_clouds > 0) {
+      ROS_WARN_THROTTLE(5.0, "Dropped %d depth clouds, the map is behind",
+                        dropped_clouds);
+    }
+
+    batch_keys.clear();
+    for (const DepthCloud& depth_cloud : clouds) {
+      pcl::fromROSMsg(*depth_cloud.msg, cloud);
+      pcl_ros::transformPointCloud(cloud, cloud, depth_cloud.transform);
+      OccupancyMap::pointKeys(cloud, keys);
+      batch_keys.insert(batch_keys.end(), keys.begin(), keys.end());
+    }
+    if (clouds.size() > 1) {
+      std::sort(batch_keys.begin(), batch_keys.end());
+      batch_keys.erase(std::unique(batch_keys.begin(), batch_keys.end()),
+                       batch_keys.end());
+    }
+    clouds.clear();
+
+    // Store the obstacle points
+    // TODO: Not all points end up here
+    std::lock_guard<std::mutex> lock(planner_mutex_);
+    global_planner_.addOccupiedKeys(batch_keys);
   }
 }
 
@@ -361,20 +847,21 @@ void GlobalPlannerNode::publishGoal(const GoalCell& goal) {
 
 // Publish the current path
 void GlobalPlannerNode::publishPath() {
-  auto path_msg = global_planner_.getPathMsg();
-  PathWithRiskMsg risk_msg = global_planner_.getPathWithRiskMsg();
+  global_planner_.getPathMsg(global_planner_.curr_path_, path_msg_);
   // Always publish as temporary to remove any obsolete temporary path
-  global_temp_path_pub_.publish(path_msg);
+  global_temp_path_pub_.publish(path_msg_);
   if (!global_planner_.goal_pos_.is_temporary_) {
-    global_path_pub_.publish(path_msg);
+    global_path_pub_.publish(path_msg_);
   }
-  smooth_path_pub_.publish(smoothPath(path_msg));
-
-  auto simple_path = simplifyPath(&global_planner_, global_planner_.curr_path_,
-                                  simplify_iterations_, simplify_margin_);
-  auto simple_path_msg = global_planner_.getPathMsg(simple_path);
-  global_temp_path_pub_.publish(simple_path_msg);
-  smooth_path_pub_.publish(smoothPath(simple_path_msg));
+  smoothPath(path_msg_, smooth_path_msg_);
+  smooth_path_pub_.publish(smooth_path_msg_);
+
+  simplifyPath(&global_planner_, global_planner_.curr_path_, simple_path_,
+               simple_path_costs_, simplify_margin_);
+  global_planner_.getPathMsg(simple_path_, path_msg_);
+  global_temp_path_pub_.publish(path_msg_);
+  smoothPath(path_msg_, smooth_path_msg_);
+  smooth_path_pub_.publish(smooth_path_msg_);
 }
 
 // Publish the cells that were explored in the last search
@@ -3,9 +3,17 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <algorithm>
+#include <atomic>
 #include <boost/bind.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>  // std::ref
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 
 #include <geometry_msgs/PointStamped.h>
 #include <geometry_msgs/PoseStamped.h>
@@ -53,6 +61,12 @@ class GlobalPlannerNode {
 
   nav_msgs::Path actual_path_;
 
+  // Buffers for publishPath, reused to not allocate for every published path
+  nav_msgs::Path path_msg_;
+  nav_msgs::Path smooth_path_msg_;
+  std::vector<Cell> simple_path_;
+  std::vector<double> simple_path_costs_;
+
   int num_octomap_msg_ = 0;
   int num_pos_msg_ = 0;
   std::vector<geometry_msgs::PoseStamped> last_clicked_points;
@@ -60,12 +74,13 @@ class GlobalPlannerNode {
   // Dynamic Reconfiguration
   double clicked_goal_alt_;
   double clicked_goal_radius_;
-  int simplify_iterations_;
   double simplify_margin_;
+  int planned_legs_ahead_ = 0;
 
   // Subscribers
   ros::Subscriber octomap_sub_;
   ros::Subscriber octomap_full_sub_;
+  ros::Subscriber octomap_region_sub_;
   ros::Subscriber ground_truth_sub_;
   ros::Subscriber velocity_sub_;
   ros::Subscriber clicked_point_sub_;
@@ -89,11 +104,85 @@ class GlobalPlannerNode {
 
   tf::TransformListener listener_;
 
+  // Recent poses of the vehicle in /world and the static transform from the
+  // camera to the vehicle, together they replace the TF lookups of the depth
+  // clouds. The callbacks are served by a single thread.
+  std::deque<geometry_msgs::PoseStamped> recent_poses_;
+  tf::StampedTransform camera_extrinsics_;
+  bool has_camera_extrinsics_ = false;
+
+  // The depth clouds are inserted into the map on cloud_thread_, the callback
+  // only queues them with their transform. Once cloud_queue_size_ clouds are
+  // waiting, the oldest one is dropped instead of blocking the callbacks.
+  struct DepthCloud {
+    sensor_msgs::PointCloud2::ConstPtr msg;
+    tf::Transform transform;  // From the camera to /world
+  };
+  std::thread cloud_thread_;
+  std::mutex cloud_mutex_;
+  std::condition_variable cloud_cv_;
+  std::deque<DepthCloud> cloud_queue_;  // Guarded by cloud_mutex_
+  int dropped_clouds_ = 0;              // Guarded by cloud_mutex_
+  int cloud_queue_size_ = 2;
+
+  // Saved map of the site, loaded at startup and saved on shutdown if
+  // save_map_tiles_ is set, see GlobalPlanner::loadMapTiles
+  std::string map_tiles_path_;
+  bool save_map_tiles_ = false;
+
+  // The path to a waypoint, planned before the waypoint becomes the goal
+  struct Leg {
+    Cell start;
+    GoalCell goal = GoalCell(Cell());
+    double cell_scale = CELL_SCALE;  // The Cells are only valid with it
+    std::vector<Cell> path;  // Empty until it is planned or once it is blocked
+    std::shared_ptr<std::atomic<bool> >
+        cancel_search;  // Set once the leg is dropped while it is planned
+  };
+
+  // Planning runs on planner_thread_ with a copy of the search inputs of
+  // global_planner_, callbacks only request a plan. leg_thread_ plans the
+  // legs between the upcoming waypoints concurrently, each on its own copy.
+  // planner_mutex_ guards global_planner_, waypoints_ and legs_.
+  // num_searches_ counts the copies that are searching.
+  std::thread planner_thread_;
+  std::thread leg_thread_;
+  std::mutex planner_mutex_;
+  std::mutex search_mutex_;
+  std::condition_variable search_cv_;
+  int num_searches_ = 0;  // Guarded by search_mutex_
+  std::mutex plan_request_mutex_;
+  std::condition_variable plan_request_cv_;
+  std::condition_variable leg_request_cv_;
+  bool plan_requested_ = false;    // Guarded by plan_request_mutex_
+  bool repair_requested_ = false;  // Guarded by plan_request_mutex_
+  bool legs_requested_ = false;    // Guarded by plan_request_mutex_
+  std::vector<Leg> legs_;        // legs_[i] ends in waypoints_[i]
+  int plan_generation_ = 0;      // Increased by every request
+  int num_map_updates_ = 0;      // Increased by every octomap update
+  bool is_planning_ = false;
+  std::atomic<bool> plan_cancelled_{false};
+  std::atomic<bool> should_exit_{false};
+
   void readParams();
+  void plannerThreadFunction();
+  void applyPlan(const GlobalPlanner& planner, bool found_path);
+  void legThreadFunction();
+  void cloudThreadFunction();
+  void planLeg(GlobalPlanner& planner, Leg& leg);
+  bool updateLegs();
+  std::vector<Cell> takeLegPath(const GoalCell& goal);
+  void requestLegPlans();
+  void cancelLegs(const std::vector<Leg>& legs);
+  void beginSearch();
+  void endSearch();
 
   void setNewGoal(const GoalCell& goal);
   void popNextGoal();
   void planPath();
+  void repairPath();
+  void cancelPlan();
+  bool isPlanPending();
   void setIntermediateGoal();
 
   void dynamicReconfigureCallback(
@@ -105,7 +194,10 @@ class GlobalPlannerNode {
   void moveBaseSimpleCallback(const geometry_msgs::PoseStamped& msg);
   void laserSensorCallback(const sensor_msgs::LaserScan& msg);
   void octomapFullCallback(const octomap_msgs::Octomap& msg);
-  void depthCameraCallback(const sensor_msgs::PointCloud2& msg);
+  void octomapRegionCallback(const octomap_msgs::Octomap& msg);
+  void checkPath(bool current_path_is_ok);
+  void replanBadPath();
+  void depthCameraCallback(const sensor_msgs::PointCloud2::ConstPtr& msg);
   void fcuInputGoalCallback(const mavros_msgs::Trajectory& msg);
   void publishGoal(const GoalCell& goal);
   void publishPath();
@@ -87,19 +87,20 @@ double PathHandlerNode::getRiskOfCurve(
     const std::vector<geometry_msgs::PoseStamped>& poses) {
   double risk = 0.0;
   for (const auto& pose_msg : poses) {
-    tf::Vector3 point = toTfVector3(pose_msg.pose.position);
-    if (path_risk_.find(point) != path_risk_.end()) {
-      risk += path_risk_[point];
+    auto it = path_risk_.find(Cell(pose_msg.pose.position));
+    if (it != path_risk_.end()) {
+      risk += it->second.risk;
     }
   }
   return risk;
 }
 
 void PathHandlerNode::setCurrentPath(
-    const std::vector<geometry_msgs::PoseStamped>& poses) {
+    const std::vector<geometry_msgs::PoseStamped>& poses,
+    const std::vector<double>& risks) {
   speed_ = min_speed_;
   path_.clear();
-  path_risk_.clear();
+  setPathRisk(poses, risks);
 
   if (poses.size() < 2) {
     ROS_INFO("  Received empty path\n");
@@ -113,6 +114,39 @@ void PathHandlerNode::setCurrentPath(
   }
 }
 
+// Sets path_risk_ to the risks of the Cells of poses. Only the Cells after
+// the beginning that is the same as in the last path are updated, an empty
+// risks clears path_risk_
+void PathHandlerNode::setPathRisk(
+    const std::vector<geometry_msgs::PoseStamped>& poses,
+    const std::vector<double>& risks) {
+  std::vector<Cell> cells;
+  cells.reserve(risks.size());
+  for (int i = 0; i < risks.size(); ++i) {
+    cells.push_back(Cell(poses[i].pose.position));
+  }
+  int first_changed = 0;
+  while (first_changed < cells.size() &&
+         first_changed < path_risk_cells_.size() &&
+         cells[first_changed] == path_risk_cells_[first_changed] &&
+         risks[first_changed] == path_risks_[first_changed]) {
+    ++first_changed;
+  }
+
+  for (int i = first_changed; i < path_risk_cells_.size(); ++i) {
+    auto it = path_risk_.find(path_risk_cells_[i]);
+    if (it != path_risk_.end() && it->second.index >= first_changed) {
+      path_risk_.erase(it);
+    }
+  }
+  for (int i = first_changed; i < cells.size(); ++i) {
+    // A Cell already on the path keeps the risk of its first pose
+    path_risk_.insert({cells[i], CellRisk{risks[i], i}});
+  }
+  path_risk_cells_.swap(cells);
+  path_risks_ = risks;
+}
+
 void PathHandlerNode::dynamicReconfigureCallback(
     global_planner::PathHandlerNodeConfig& config, uint32_t level) {
   ignore_path_messages_ = config.ignore_path_messages_;
@@ -145,16 +179,12 @@ void PathHandlerNode::receivePath(const nav_msgs::Path& msg) {
 
 void PathHandlerNode::receivePathWithRisk(const PathWithRiskMsg& msg) {
   if (!ignore_path_messages_) {
-    setCurrentPath(msg.poses);
     if (msg.poses.size() != msg.risks.size()) {
       ROS_INFO("PathWithRiskMsg error: risks must be the same size as poses.");
       throw std::invalid_argument(
           "PathWithRiskMsg error: risks must be the same size as poses.");
     }
-    for (int i = 0; i < msg.poses.size(); ++i) {
-      tf::Vector3 point = toTfVector3(msg.poses[i].pose.position);
-      path_risk_[point] = msg.risks[i];
-    }
+    setCurrentPath(msg.poses, msg.risks);
   }
 }
 
@@ -2,7 +2,7 @@
 #define GLOBAL_PLANNER_PATH_HANDLER_NODE_H
 
 #include <math.h>
-#include <map>
+#include <unordered_map>
 #include <vector>
 
 #include <dynamic_reconfigure/server.h>
@@ -16,6 +16,7 @@
 
 #include <global_planner/PathHandlerNodeConfig.h>
 #include <global_planner/PathWithRiskMsg.h>
+#include "global_planner/cell.h"
 #include "global_planner/common.h"
 #include "global_planner/common_ros.h"
 
@@ -48,8 +49,17 @@ class PathHandlerNode {
   geometry_msgs::PoseStamped last_goal_;
   geometry_msgs::PoseStamped last_pos_;
 
+  // The risk of a Cell of the path and the index of the first pose in it
+  struct CellRisk {
+    double risk;
+    int index;
+  };
+
   std::vector<geometry_msgs::PoseStamped> path_;
-  std::map<tf::Vector3, double> path_risk_;
+  std::unordered_map<Cell, CellRisk> path_risk_;
+  std::vector<Cell> path_risk_cells_;  // The Cells of the poses of the last
+                                       // PathWithRiskMsg
+  std::vector<double> path_risks_;     // The risks of the last PathWithRiskMsg
 
   ros::Subscriber direct_goal_sub_;
   ros::Subscriber path_sub_;
@@ -70,7 +80,10 @@ class PathHandlerNode {
   bool shouldPublishThreePoints();
   bool isCloseToGoal();
   double getRiskOfCurve(const std::vector<geometry_msgs::PoseStamped>& poses);
-  void setCurrentPath(const std::vector<geometry_msgs::PoseStamped>& poses);
+  void setCurrentPath(const std::vector<geometry_msgs::PoseStamped>& poses,
+                      const std::vector<double>& risks = {});
+  void setPathRisk(const std::vector<geometry_msgs::PoseStamped>& poses,
+                   const std::vector<double>& risks);
   // Callbacks
   void dynamicReconfigureCallback(global_planner::PathHandlerNodeConfig& config,
                                   uint32_t level);
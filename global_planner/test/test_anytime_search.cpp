@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "global_planner/anytime_search.h"
+#include "global_planner/global_planner.h"
+#include "test_cells.h"
+
+using namespace global_planner;
+
+namespace {
+
+// True iff every Cell of the path is a neighbor of the one before
+bool isConnected(const std::vector<Cell>& path) {
+  for (size_t i = 1; i < path.size(); ++i) {
+    const int dx = std::abs(path[i].xIndex() - path[i - 1].xIndex());
+    const int dy = std::abs(path[i].yIndex() - path[i - 1].yIndex());
+    const int dz = std::abs(path[i].zIndex() - path[i - 1].zIndex());
+    if (std::max(dx, std::max(dy, dz)) != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+class AnytimeSearchTests : public ::testing::Test {
+ public:
+  GlobalPlanner planner;
+  NullVisitor visitor;
+  const Node s = Node(cellAt(0, 0, 3), cellAt(-1, 0, 3));
+  const GoalCell t = GoalCell(cellAt(10, 0, 3));
+
+  void SetUp() override {
+    planner.octree_ = std::make_shared<octomap::OcTree>(CELL_SCALE);
+
+    // A wall between s and t
+    for (int y = -2; y <= 2; ++y) {
+      for (int z = 1; z <= 5; ++z) {
+        setOccupied(cellAt(5, y, z));
+      }
+    }
+  }
+
+  // Without the smoothness and the risk heuristic, and without the heuristic
+  // of the Cells seen by earlier searches, the heuristic is consistent and
+  // a search with an overestimate factor of 1 finds the cheapest path
+  void useConsistentHeuristic() {
+    planner.smooth_factor_ = 0.0;
+    planner.use_risk_heuristics_ = false;
+    planner.use_speedup_heuristics_ = false;
+    planner.risk_factor_ = 50.0;  // Fewer nodes are as cheap as the path
+  }
+
+  void setOccupied(const Cell& cell) {
+    planner.octree_->setNodeValue(
+        octomap::point3d(cell.xPos(), cell.yPos(), cell.zPos()),
+        planner.octree_->getClampingThresMaxLog());
+  }
+
+  static SearchClock::time_point farDeadline() {
+    return SearchClock::now() + std::chrono::seconds(60);
+  }
+};
+
+TEST_F(AnytimeSearchTests, improvementsDoNotIncreaseCost) {
+  // GIVEN: an anytime search around the wall
+  useConsistentHeuristic();
+  AnytimeSearch<GlobalPlanner, Node> search(&planner, s, t);
+  const SearchClock::time_point deadline = farDeadline();
+  double last_cost = INFINITY;
+
+  for (double factor : {3.0, 2.0, 1.5, 1.2, 1.05, 1.0}) {
+    // WHEN: the path is improved with a lower overestimate factor
+    planner.overestimate_factor_ = factor;
+    std::vector<Cell> path;
+    const int max_iterations = 1000000;
+    ASSERT_TRUE(
+        search.improvePath(path, max_iterations, deadline, visitor).found_path)
+        << factor;
+
+    // THEN: the path goes from s to t and is not more expensive than the
+    // one of the last factor
+    EXPECT_EQ(s.parent_, path[0]);
+    EXPECT_EQ(s.cell_, path[1]);
+    EXPECT_EQ(t, path.back());
+    EXPECT_TRUE(isConnected(path));
+    EXPECT_FALSE(planner.getPathInfo(path).is_blocked);
+    const double cost = planner.getPathInfo(path).cost;
+    EXPECT_LE(cost, last_cost + 1e-9) << factor;
+    last_cost = cost;
+  }
+}
+
+TEST_F(AnytimeSearchTests, lastImprovementMatchesAStar) {
+  // GIVEN: an anytime search which was improved down to a factor of 1
+  useConsistentHeuristic();
+  AnytimeSearch<GlobalPlanner, Node> search(&planner, s, t);
+  const SearchClock::time_point deadline = farDeadline();
+  std::vector<Cell> anytime_path;
+  for (double factor : {2.0, 1.25, 1.0}) {
+    planner.overestimate_factor_ = factor;
+    ASSERT_TRUE(search.improvePath(anytime_path, 1000000, deadline, visitor)
+                    .found_path);
+  }
+
+  // WHEN: A* searches from scratch with a factor of 1
+  std::vector<Cell> a_star_path;
+  ASSERT_TRUE(findSmoothPath(&planner, a_star_path, s, t, 1000000).found_path);
+
+  // THEN: both paths are the cheapest one
+  EXPECT_NEAR(planner.getPathInfo(a_star_path).cost,
+              planner.getPathInfo(anytime_path).cost, 1e-6);
+}
+
+TEST_F(AnytimeSearchTests, repairBlockedPath) {
+  // GIVEN: a straight path above the wall from the vehicle to the goal
+  planner.default_node_type_ = SearchNodeType::Node;
+  planner.going_back_ = false;
+  std::vector<Cell> path;
+  for (int x = -1; x <= 20; ++x) {
+    path.push_back(cellAt(x, 0, 7));
+  }
+  planner.curr_pos_ = path[1].toPoint();
+  planner.setPath(path);
+  ASSERT_FALSE(planner.getPathInfo(path).is_blocked);
+
+  // WHEN: a Cell on the path becomes occupied and the path is repaired
+  const Cell blocked = cellAt(10, 0, 7);
+  setOccupied(blocked);
+  std::unordered_set<Cell> changed_cells = {blocked};
+  planner.invalidateRisk(changed_cells);
+  ASSERT_TRUE(planner.getPathInfo(path).is_blocked);
+  ASSERT_TRUE(planner.repairPath());
+
+  // THEN: the path keeps its ends and goes around the occupied Cell
+  const std::vector<Cell>& repaired = planner.curr_path_;
+  EXPECT_EQ(path[0], repaired[0]);
+  EXPECT_EQ(path[1], repaired[1]);
+  EXPECT_EQ(path.back(), repaired.back());
+  EXPECT_TRUE(isConnected(repaired));
+  EXPECT_EQ(repaired.end(),
+            std::find(repaired.begin(), repaired.end(), blocked));
+  EXPECT_FALSE(planner.getPathInfo(repaired).is_blocked);
+}
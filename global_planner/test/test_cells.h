@@ -0,0 +1,17 @@
+#ifndef GLOBAL_PLANNER_TEST_CELLS
+#define GLOBAL_PLANNER_TEST_CELLS
+
+#include <tuple>
+
+#include "global_planner/cell.h"
+
+namespace global_planner {
+
+// The Cell with the given indices
+inline Cell cellAt(int x, int y, int z) {
+  return Cell(std::tuple<int, int, int>(x, y, z));
+}
+
+}  // namespace global_planner
+
+#endif  // GLOBAL_PLANNER_TEST_CELLS
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+
+#include "global_planner/map_tiles.h"
+#include "test_cells.h"
+
+using namespace global_planner;
+
+class MapTilesTests : public ::testing::Test {
+ public:
+  std::string path;
+
+  void SetUp() override {
+    path = "/tmp/test_map_tiles_" + std::to_string(getpid());
+    std::remove(path.c_str());
+  }
+
+  void TearDown() override { std::remove(path.c_str()); }
+
+  // Overwrites num_tiles in the header of the file at path
+  void setNumTiles(uint64_t num_tiles) {
+    FILE* f = std::fopen(path.c_str(), "r+b");
+    ASSERT_TRUE(f != nullptr);
+    std::fseek(f, 24, SEEK_SET);
+    std::fwrite(&num_tiles, sizeof(num_tiles), 1, f);
+    std::fclose(f);
+  }
+};
+
+TEST_F(MapTilesTests, readAfterSave) {
+  // GIVEN: a map with Cells in two tiles, one of them at negative indices
+  MapTilesWriter writer;
+  writer.setLogOdds(1, 2, 3, 0.5f);
+  writer.setLogOdds(2, 2, 3, 1.5f);
+  writer.setOccupied(1, 2, 3);
+  writer.setLogOdds(-20, -1, 5, -2.f);
+  ASSERT_TRUE(writer.save(path));
+
+  // WHEN: we open the file
+  MapTiles tiles;
+  ASSERT_TRUE(tiles.open(path));
+
+  // THEN: the Cells are read back and the other Cells are unknown
+  EXPECT_EQ(2u, tiles.numTiles());
+  float log_odds = 0.f;
+  ASSERT_TRUE(tiles.find(cellAt(1, 2, 3), log_odds));
+  EXPECT_FLOAT_EQ(0.5f, log_odds);
+  ASSERT_TRUE(tiles.find(cellAt(-20, -1, 5), log_odds));
+  EXPECT_FLOAT_EQ(-2.f, log_odds);
+  EXPECT_FALSE(tiles.find(cellAt(3, 2, 3), log_odds));
+  EXPECT_FALSE(tiles.find(cellAt(100, 2, 3), log_odds));
+  EXPECT_TRUE(tiles.isOccupied(cellAt(1, 2, 3)));
+  EXPECT_FALSE(tiles.isOccupied(cellAt(2, 2, 3)));
+
+  // THEN: the maximum of a box only looks at the known Cells
+  ASSERT_TRUE(tiles.findMax(cellAt(0, 0, 0), cellAt(8, 8, 8), log_odds));
+  EXPECT_FLOAT_EQ(1.5f, log_odds);
+  EXPECT_FALSE(tiles.findMax(cellAt(4, 4, 4), cellAt(8, 8, 8), log_odds));
+}
+
+TEST_F(MapTilesTests, saveMergesWithBase) {
+  // GIVEN: a saved map that is open
+  MapTilesWriter first;
+  first.setLogOdds(1, 2, 3, 0.5f);
+  first.setLogOdds(40, 0, 0, 2.f);
+  ASSERT_TRUE(first.save(path));
+  MapTiles base;
+  ASSERT_TRUE(base.open(path));
+
+  // WHEN: new Cells are saved over it into the same file
+  MapTilesWriter second;
+  second.setLogOdds(1, 2, 3, -1.f);
+  second.setLogOdds(5, 2, 3, 1.f);
+  second.setOccupied(40, 0, 1);
+  ASSERT_TRUE(second.save(path, &base));
+  base.close();
+
+  // THEN: the new Cells replace the old ones, the others are kept
+  MapTiles tiles;
+  ASSERT_TRUE(tiles.open(path));
+  EXPECT_EQ(2u, tiles.numTiles());
+  float log_odds = 0.f;
+  ASSERT_TRUE(tiles.find(cellAt(1, 2, 3), log_odds));
+  EXPECT_FLOAT_EQ(-1.f, log_odds);
+  ASSERT_TRUE(tiles.find(cellAt(5, 2, 3), log_odds));
+  EXPECT_FLOAT_EQ(1.f, log_odds);
+  ASSERT_TRUE(tiles.find(cellAt(40, 0, 0), log_odds));
+  EXPECT_FLOAT_EQ(2.f, log_odds);
+  EXPECT_TRUE(tiles.isOccupied(cellAt(40, 0, 1)));
+}
+
+TEST_F(MapTilesTests, corruptFileIsRejected) {
+  // GIVEN: a saved map of one tile
+  MapTilesWriter writer;
+  writer.setLogOdds(1, 2, 3, 0.5f);
+  ASSERT_TRUE(writer.save(path));
+  MapTiles tiles;
+
+  // WHEN: num_tiles is set to a size whose index and tiles would wrap around
+  const uint64_t wrapping_tiles =
+      std::numeric_limits<uint64_t>::max() /
+          (sizeof(uint64_t) + sizeof(MapTiles::Tile)) +
+      1;
+  setNumTiles(wrapping_tiles);
+
+  // THEN: the file is rejected
+  EXPECT_FALSE(tiles.open(path));
+  EXPECT_TRUE(tiles.empty());
+
+  // WHEN: num_tiles is more than the file holds
+  setNumTiles(2);
+
+  // THEN: the file is rejected
+  EXPECT_FALSE(tiles.open(path));
+
+  // THEN: the original file is accepted
+  setNumTiles(1);
+  EXPECT_TRUE(tiles.open(path));
+
+  // THEN: a file of another Cell size is rejected
+  const double cell_scale = CELL_SCALE;
+  CELL_SCALE = 2.0 * cell_scale;
+  EXPECT_FALSE(tiles.open(path));
+  CELL_SCALE = cell_scale;
+
+  // THEN: a file shorter than the header and a missing file are rejected
+  FILE* f = std::fopen(path.c_str(), "wb");
+  ASSERT_TRUE(f != nullptr);
+  std::fputs("GPTILES", f);
+  std::fclose(f);
+  EXPECT_FALSE(tiles.open(path));
+  EXPECT_FALSE(tiles.open(path + "_missing"));
+}
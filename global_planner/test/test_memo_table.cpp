@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include "global_planner/memo_table.h"
+
+using namespace global_planner;
+
+TEST(MemoTable, findAfterInsert) {
+  // GIVEN: a table with two entries
+  MemoTable<int, double> table(16);
+  table.insert(1, 0.5);
+  table.insert(2, 1.5);
+
+  // WHEN: we look up a stored and a missing key
+  const double* stored = table.find(2);
+  const double* missing = table.find(3);
+
+  // THEN: only the stored one is found and both lookups are counted
+  ASSERT_TRUE(stored != nullptr);
+  EXPECT_DOUBLE_EQ(1.5, *stored);
+  EXPECT_TRUE(missing == nullptr);
+  EXPECT_EQ(2u, table.size());
+  EXPECT_EQ(1u, table.stats().hits);
+  EXPECT_EQ(1u, table.stats().misses);
+  EXPECT_EQ(0u, table.stats().evictions);
+  EXPECT_DOUBLE_EQ(0.5, table.stats().hitRate());
+
+  // WHEN: a stored key is inserted again
+  table.insert(2, 2.5);
+
+  // THEN: its value is replaced
+  EXPECT_EQ(2u, table.size());
+  ASSERT_TRUE(table.find(2) != nullptr);
+  EXPECT_DOUBLE_EQ(2.5, *table.find(2));
+}
+
+TEST(MemoTable, fullSetEvictsLeastRecentlyUsed) {
+  // GIVEN: a table of a single set that is full
+  typedef MemoTable<int, int> IntTable;
+  const std::size_t ways = IntTable::kWays;
+  IntTable table(ways);
+  ASSERT_EQ(ways, table.capacity());
+  const int n = static_cast<int>(ways);
+  for (int i = 0; i < n; ++i) {
+    table.insert(i, 10 * i);
+  }
+
+  // WHEN: the first key is used again and a new key is inserted
+  ASSERT_TRUE(table.find(0) != nullptr);
+  const MemoStats start = table.stats();
+  table.insert(n, 10 * n);
+
+  // THEN: the least recently used key is replaced and the size stays bounded
+  EXPECT_TRUE(table.find(0) != nullptr);
+  EXPECT_TRUE(table.find(1) == nullptr);
+  EXPECT_TRUE(table.find(n) != nullptr);
+  EXPECT_EQ(ways, table.size());
+  const MemoStats diff = table.stats() - start;
+  EXPECT_EQ(2u, diff.hits);
+  EXPECT_EQ(1u, diff.misses);
+  EXPECT_EQ(1u, diff.evictions);
+}
+
+TEST(MemoTable, clearAndEraseForgetEntries) {
+  // GIVEN: a table with three entries
+  MemoTable<int, int> table(64);
+  table.insert(1, 1);
+  table.insert(2, 2);
+  table.insert(3, 3);
+
+  // WHEN: one entry is erased
+  table.erase(2);
+
+  // THEN: only that one is forgotten
+  EXPECT_EQ(2u, table.size());
+  EXPECT_TRUE(table.find(2) == nullptr);
+  EXPECT_TRUE(table.find(1) != nullptr);
+
+  // WHEN: the table is cleared
+  table.clear();
+
+  // THEN: all entries are forgotten, the slots and the stats are kept
+  EXPECT_TRUE(table.empty());
+  EXPECT_TRUE(table.find(1) == nullptr);
+  EXPECT_TRUE(table.find(3) == nullptr);
+  EXPECT_EQ(64u, table.capacity());
+  EXPECT_EQ(1u, table.stats().hits);
+
+  // THEN: an entry stored after the clear is found
+  table.insert(3, 30);
+  ASSERT_TRUE(table.find(3) != nullptr);
+  EXPECT_EQ(30, *table.find(3));
+  EXPECT_EQ(1u, table.size());
+}
+
+TEST(MemoTable, capacityIsRoundedToWholeSets) {
+  // GIVEN: a table with an entry
+  MemoTable<int, int> table(16);
+  table.insert(1, 1);
+
+  // WHEN: the capacity is set to the same number of slots
+  table.setCapacity(16);
+
+  // THEN: the entries are kept
+  EXPECT_TRUE(table.find(1) != nullptr);
+
+  // WHEN: the capacity is not a power of two sets
+  table.setCapacity(20);
+
+  // THEN: it is rounded up and the entries are forgotten
+  EXPECT_EQ(32u, table.capacity());
+  EXPECT_TRUE(table.empty());
+  EXPECT_TRUE(table.find(1) == nullptr);
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include "global_planner/node.h"
+#include "test_cells.h"
+
+using namespace global_planner;
+
+TEST(PackedNode, roundTrip) {
+  // GIVEN: nodes with positive, negative and extreme indices, each with a
+  // parent within the offset range
+  const Cell cells[] = {cellAt(0, 0, 0),
+                        cellAt(5, -7, 3),
+                        cellAt(-1, -1, -1),
+                        cellAt(-300, 120000, -20),
+                        cellAt((1 << 18) - 16, -(1 << 18) + 16, 1000),
+                        cellAt(-(1 << 18) + 16, (1 << 18) - 16, -1000)};
+  const Cell offsets[] = {cellAt(0, 0, 0), cellAt(1, 0, -1),
+                          cellAt(-15, 15, 0), cellAt(15, -15, -15)};
+
+  for (const Cell& cell : cells) {
+    for (const Cell& offset : offsets) {
+      // WHEN: we pack and unpack them
+      const Cell parent = cell + offset;
+      const PackedNode node(cell, parent);
+
+      // THEN: the Cell and the parent are unchanged
+      EXPECT_EQ(cell, node.cell()) << cell.asString();
+      EXPECT_EQ(parent, node.parent()) << parent.asString();
+    }
+  }
+}
+
+TEST(PackedNode, farParentIsClamped) {
+  // GIVEN: a node whose parent is more than 15 Cells away
+  const Cell cell = cellAt(-10, 20, 5);
+  const Cell parent = cellAt(30, 0, 5);
+
+  // WHEN: we pack it
+  const PackedNode node(cell, parent);
+
+  // THEN: the Cell is kept and the parent moves along the offset to 15 Cells
+  EXPECT_EQ(cell, node.cell());
+  EXPECT_EQ(cellAt(5, 13, 5), node.parent());
+
+  // THEN: a negative far offset is clamped the same way
+  const PackedNode back(cell, cellAt(-10, -40, -25));
+  EXPECT_EQ(cell, back.cell());
+  EXPECT_EQ(cellAt(-10, 5, -2), back.parent());
+}
+
+TEST(PackedNode, keys) {
+  // GIVEN: two nodes of the same Cell with other parents
+  const Cell cell = cellAt(-3, 4, -5);
+  const PackedNode a(cell, cellAt(-2, 4, -5));
+  const PackedNode b(cell, cellAt(-3, 5, -5));
+  const PackedNode c(cellAt(-3, 4, -4), cellAt(-2, 4, -4));
+
+  // THEN: they differ in their bits but not in the bits of the Cell
+  EXPECT_NE(a.bits(), b.bits());
+  EXPECT_EQ(a.cellBits(), b.cellBits());
+  EXPECT_NE(a.cellBits(), c.cellBits());
+  EXPECT_EQ(PackedNode().cell(), cellAt(0, 0, 0));
+}
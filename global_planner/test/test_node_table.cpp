@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <tuple>
+
+#include "global_planner/node_table.h"
+
+using namespace global_planner;
+
+namespace {
+
+PackedNode packedNode(int x, int y, int z) {
+  Cell cell(std::tuple<int, int, int>(x, y, z));
+  return PackedNode(cell, cell);
+}
+
+}  // namespace
+
+TEST(NodeTable, findAfterInsert) {
+  // GIVEN: an empty table
+  NodeTable table;
+  EXPECT_EQ(0u, table.size());
+
+  // WHEN: we add two nodes
+  const PackedNode first = packedNode(1, 2, 3);
+  const PackedNode second = packedNode(1, 2, 4);
+  const int i = table.findOrInsert(first.bits(), first);
+  const int j = table.findOrInsert(second.bits(), second);
+
+  // THEN: they get their own entries without a path
+  EXPECT_NE(i, j);
+  EXPECT_EQ(2u, table.size());
+  EXPECT_EQ(first.bits(), table[i].key);
+  EXPECT_EQ(second.bits(), table[j].node.bits());
+  EXPECT_TRUE(std::isinf(table[i].distance));
+  EXPECT_EQ(-1, table[i].parent);
+  EXPECT_FALSE(table[i].closed);
+
+  // WHEN: the state of a node is changed and the node is reached again
+  table[j].distance = 2.5;
+  table[j].parent = i;
+  table[j].closed = true;
+  const int again = table.findOrInsert(second.bits(), second);
+
+  // THEN: the existing entry is found and kept
+  EXPECT_EQ(j, again);
+  EXPECT_EQ(2u, table.size());
+  EXPECT_DOUBLE_EQ(2.5, table[j].distance);
+  EXPECT_EQ(i, table[j].parent);
+  EXPECT_TRUE(table[j].closed);
+}
+
+TEST(NodeTable, growthKeepsEntries) {
+  // GIVEN: a table sized for a single node
+  NodeTable table(1);
+
+  // WHEN: many neighboring nodes are added
+  const int n = 20;
+  for (int x = -n; x < n; ++x) {
+    for (int y = -n; y < n; ++y) {
+      const PackedNode node = packedNode(x, y, x + y);
+      const int index = table.findOrInsert(node.bits(), node);
+      table[index].distance = x * 100 + y;
+    }
+  }
+
+  // THEN: every node is found again with its state and nothing is added
+  const std::size_t size = 4 * n * n;
+  EXPECT_EQ(size, table.size());
+  for (int x = -n; x < n; ++x) {
+    for (int y = -n; y < n; ++y) {
+      const PackedNode node = packedNode(x, y, x + y);
+      const int index = table.findOrInsert(node.bits(), node);
+      EXPECT_EQ(node.bits(), table[index].key);
+      EXPECT_DOUBLE_EQ(x * 100 + y, table[index].distance);
+    }
+  }
+  EXPECT_EQ(size, table.size());
+}
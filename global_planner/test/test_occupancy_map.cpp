@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include "global_planner/occupancy_map.h"
+
+using namespace global_planner;
+
+namespace {
+
+struct Point {
+  float x, y, z;
+};
+
+typedef std::tuple<int, int, int> Index;
+
+// Point in the middle of the Cell with the given indices
+Point cellCenter(int x, int y, int z) {
+  const float scale = static_cast<float>(CELL_SCALE);
+  return Point{(x + 0.5f) * scale, (y + 0.5f) * scale, (z + 0.5f) * scale};
+}
+
+std::set<Index> cellsOf(const OccupancyMap& map) {
+  std::set<Index> cells;
+  map.forEach([&](int x, int y, int z) { cells.insert(Index(x, y, z)); });
+  return cells;
+}
+
+std::set<Index> indicesOf(const std::vector<Cell>& cells) {
+  std::set<Index> indices;
+  for (const Cell& cell : cells) {
+    indices.insert(Index(cell.xIndex(), cell.yIndex(), cell.zIndex()));
+  }
+  return indices;
+}
+
+}  // namespace
+
+TEST(OccupancyMap, negativeIndices) {
+  // GIVEN: an empty map
+  OccupancyMap map;
+
+  // WHEN: we insert Cells on both sides of zero on every axis
+  EXPECT_TRUE(map.insert(-1, 0, 0));
+  EXPECT_TRUE(map.insert(0, -1, 0));
+  EXPECT_TRUE(map.insert(0, 0, -1));
+  EXPECT_TRUE(map.insert(-17, -33, -1000));
+  EXPECT_TRUE(map.insert(15, 16, 1000));
+
+  // THEN: they are found and do not alias their neighbors
+  EXPECT_TRUE(map.contains(-1, 0, 0));
+  EXPECT_TRUE(map.contains(0, -1, 0));
+  EXPECT_TRUE(map.contains(0, 0, -1));
+  EXPECT_TRUE(map.contains(-17, -33, -1000));
+  EXPECT_TRUE(map.contains(15, 16, 1000));
+  EXPECT_FALSE(map.contains(0, 0, 0));
+  EXPECT_FALSE(map.contains(-16, -33, -1000));
+  EXPECT_FALSE(map.contains(17, 33, 1000));
+  EXPECT_EQ(5u, map.size());
+
+  // THEN: a Cell inserted again is not new
+  EXPECT_FALSE(map.insert(-17, -33, -1000));
+  EXPECT_EQ(5u, map.size());
+}
+
+TEST(OccupancyMap, invalidPointsAreSkipped) {
+  // GIVEN: a cloud with duplicates, NaN, infinite and far away points
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const float inf = std::numeric_limits<float>::infinity();
+  const float far = static_cast<float>(CELL_SCALE * (1 << 21));
+  std::vector<Point> cloud = {cellCenter(1, 2, 3),   cellCenter(1, 2, 3),
+                              Point{nan, 0.f, 0.f},  Point{0.f, inf, 0.f},
+                              Point{0.f, 0.f, -inf}, Point{far, 0.f, 0.f},
+                              Point{0.f, -far, 0.f}, cellCenter(-4, -5, -6),
+                              cellCenter(1, 2, 3)};
+
+  // WHEN: the cloud is inserted
+  OccupancyMap map;
+  std::vector<Cell> changed_cells;
+  map.insertPoints(cloud, changed_cells);
+
+  // THEN: only the Cells of the valid points are inserted, each once
+  std::set<Index> expected = {Index(1, 2, 3), Index(-4, -5, -6)};
+  EXPECT_EQ(expected, cellsOf(map));
+  EXPECT_EQ(2u, map.size());
+  EXPECT_EQ(2u, changed_cells.size());
+  EXPECT_EQ(expected, indicesOf(changed_cells));
+  EXPECT_FALSE(map.contains(0, 0, 0));
+
+  // THEN: the same cloud again changes nothing
+  changed_cells.clear();
+  map.insertPoints(cloud, changed_cells);
+  EXPECT_TRUE(changed_cells.empty());
+}
+
+TEST(OccupancyMap, forEachVisitsEveryCell) {
+  // GIVEN: Cells spread over several tiles
+  OccupancyMap map;
+  std::set<Index> expected;
+  for (int x = -20; x <= 20; x += 3) {
+    for (int y = -5; y <= 40; y += 7) {
+      for (int z = -3; z <= 3; ++z) {
+        map.insert(x, y, z);
+        expected.insert(Index(x, y, z));
+      }
+    }
+  }
+
+  // WHEN: we iterate over the map
+  std::set<Index> cells = cellsOf(map);
+
+  // THEN: every Cell is visited once
+  EXPECT_EQ(expected, cells);
+  EXPECT_EQ(expected.size(), map.size());
+  EXPECT_GT(map.numTiles(), 1u);
+
+  // THEN: a cleared map is empty
+  map.clear();
+  EXPECT_EQ(0u, map.size());
+  EXPECT_TRUE(cellsOf(map).empty());
+}
+
+TEST(OccupancyMap, oldestTilesAreEvicted) {
+  // GIVEN: a map of at most eight tiles with one Cell in each of four tiles
+  const int tile = OccupancyMap::kTileSize;
+  OccupancyMap map(8);
+  std::vector<Cell> changed_cells;
+  std::vector<Point> old_cloud;
+  for (int i = 0; i < 4; ++i) {
+    old_cloud.push_back(cellCenter(i * tile, 0, 0));
+  }
+  map.insertPoints(old_cloud, changed_cells);
+  ASSERT_EQ(4u, map.numTiles());
+
+  // WHEN: one cloud adds ten more tiles
+  std::vector<Point> new_cloud;
+  for (int i = 0; i < 10; ++i) {
+    new_cloud.push_back(cellCenter(i * tile, tile, 0));
+  }
+  changed_cells.clear();
+  map.insertPoints(new_cloud, changed_cells);
+
+  // THEN: the map is bounded, all old tiles and the first new ones are gone
+  EXPECT_EQ(7u, map.numTiles());
+  EXPECT_EQ(7u, map.size());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_FALSE(map.contains(i * tile, 0, 0));
+  }
+  for (int i = 3; i < 10; ++i) {
+    EXPECT_TRUE(map.contains(i * tile, tile, 0));
+  }
+
+  // THEN: the inserted and the dropped Cells are reported as changed
+  std::set<Index> changed = indicesOf(changed_cells);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(1u, changed.count(Index(i * tile, 0, 0)));
+  }
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(1u, changed.count(Index(i * tile, tile, 0)));
+  }
+}
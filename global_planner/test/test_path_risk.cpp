@@ -0,0 +1,65 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "global_planner/global_planner.h"
+#include "test_cells.h"
+
+using namespace global_planner;
+
+class PathRiskTests : public ::testing::Test {
+ public:
+  GlobalPlanner planner;
+  std::vector<Cell> path;
+
+  void SetUp() override {
+    planner.octree_ = std::make_shared<octomap::OcTree>(CELL_SCALE);
+
+    // A straight path in free space
+    for (int x = -1; x <= 20; ++x) {
+      path.push_back(cellAt(x, 0, 7));
+    }
+    planner.curr_pos_ = path[1].toPoint();
+    planner.setPath(path);
+  }
+
+  // Occupies cell and lets the planner know that it changed
+  void setOccupied(const Cell& cell) {
+    planner.octree_->setNodeValue(
+        octomap::point3d(cell.xPos(), cell.yPos(), cell.zPos()),
+        planner.octree_->getClampingThresMaxLog());
+    std::unordered_set<Cell> changed_cells = {cell};
+    planner.invalidateRisk(changed_cells);
+  }
+};
+
+TEST_F(PathRiskTests, dirtyCellOnPath) {
+  // GIVEN: a path which is ok
+  ASSERT_TRUE(planner.isCurrentPathOk());
+  ASSERT_TRUE(planner.dirty_path_nodes_.empty());
+
+  // WHEN: a Cell on the path becomes occupied
+  setOccupied(cellAt(10, 0, 7));
+
+  // THEN: the Nodes of the path through it are marked to be checked again
+  EXPECT_FALSE(planner.dirty_path_nodes_.empty());
+
+  // THEN: the path is checked again and rejected
+  EXPECT_FALSE(planner.isCurrentPathOk());
+  EXPECT_TRUE(planner.dirty_path_nodes_.empty());
+}
+
+TEST_F(PathRiskTests, dirtyCellOffPath) {
+  // GIVEN: a path which is ok
+  ASSERT_TRUE(planner.isCurrentPathOk());
+
+  // WHEN: a Cell away from the path becomes occupied
+  setOccupied(cellAt(10, 8, 7));
+
+  // THEN: no Node of the path has to be checked again and the path is still
+  // accepted
+  EXPECT_TRUE(planner.dirty_path_nodes_.empty());
+  EXPECT_TRUE(planner.isCurrentPathOk());
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include <unordered_set>
+#include <vector>
+
+#include "global_planner/search_tools.h"
+#include "test_cells.h"
+
+using namespace global_planner;
+
+namespace {
+
+// Planner with the edge cost of GlobalPlanner without the risk and the up and
+// down costs: the distance plus the squared turn from the previous edge
+struct TestPlanner {
+  double max_cell_risk_ = 0.5;
+  double smooth_factor_ = 0.0;
+  std::unordered_set<Cell> blocked_;
+
+  double getRisk(const Cell& cell) { return blocked_.count(cell) ? 1.0 : 0.0; }
+
+  double getEdgeCost(const Node& u, const Node& v) {
+    double turn = u.getRotation(v);
+    return v.parent_.distance3D(v.cell_) + smooth_factor_ * turn * turn;
+  }
+};
+
+}  // namespace
+
+TEST(SimplifyPath, straightPath) {
+  // GIVEN: a straight path of 40 Cells
+  TestPlanner planner;
+  std::vector<Cell> path;
+  for (int x = 0; x < 40; ++x) {
+    path.push_back(cellAt(x, 0, 2));
+  }
+  std::vector<Cell> simple_path;
+  std::vector<double> path_costs;
+
+  // WHEN: we simplify it, looking at most 16 vertices ahead
+  simplifyPath(&planner, path, simple_path, path_costs, 1.01, true, 16);
+
+  // THEN: every shortcut spans the whole look ahead, the last vertex is
+  // doubled to stop at the end
+  const std::vector<Cell> expected = {path[0],  path[1],  path[17],
+                                      path[33], path[39], path[39]};
+  EXPECT_EQ(expected, simple_path);
+}
+
+TEST(SimplifyPath, furthestVertexInLineOfSight) {
+  // GIVEN: a path around a blocked Cell which is in the way from the second
+  // vertex to the fourth one, but not to the fifth one
+  TestPlanner planner;
+  planner.blocked_.insert(cellAt(1, 1, 2));
+  const std::vector<Cell> path = {cellAt(-1, 0, 2), cellAt(0, 0, 2),
+                                  cellAt(1, 0, 2), cellAt(2, 1, 2),
+                                  cellAt(4, 1, 2)};
+  std::vector<Cell> simple_path;
+  std::vector<double> path_costs;
+
+  // WHEN: we simplify it
+  simplifyPath(&planner, path, simple_path, path_costs, 1.01, false);
+
+  // THEN: the path is pulled straight past the vertex out of sight
+  const std::vector<Cell> expected = {path[0], path[1], path[4]};
+  EXPECT_EQ(expected, simple_path);
+}
+
+TEST(SimplifyPath, costOfTurns) {
+  // GIVEN: a path turning by 45 degrees at every vertex
+  TestPlanner planner;
+  const std::vector<Cell> path = {cellAt(0, 0, 2), cellAt(1, 0, 2),
+                                  cellAt(2, 1, 2), cellAt(2, 2, 2),
+                                  cellAt(1, 3, 2), cellAt(0, 3, 2)};
+  std::vector<Cell> simple_path;
+  std::vector<double> path_costs;
+
+  // WHEN: we simplify it by the distance only
+  simplifyPath(&planner, path, simple_path, path_costs, 1.01, false);
+
+  // THEN: it is a single straight edge
+  const std::vector<Cell> shortest = {path[0], path[1], path[5]};
+  EXPECT_EQ(shortest, simple_path);
+
+  // WHEN: we simplify it with the cost of the turns
+  planner.smooth_factor_ = 1.0;
+  simplifyPath(&planner, path, simple_path, path_costs, 1.01, false);
+
+  // THEN: the shortcut which turns by more than 90 degrees at once is
+  // rejected
+  const std::vector<Cell> smoothest = {path[0], path[1], path[4], path[5]};
+  EXPECT_EQ(smoothest, simple_path);
+}
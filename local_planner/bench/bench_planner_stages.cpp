@@ -0,0 +1,485 @@
+#include <benchmark/benchmark.h>
+
+#include "bench_scenes.h"
+#include "local_planner/box.h"
+#include "local_planner/common.h"
+#include "local_planner/depth_image.h"
+#include "local_planner/obstacle_memory.h"
+#include "local_planner/planner_functions.h"
+#include "local_planner/star_planner.h"
+#include "local_planner/tree_node.h"
+#include "local_planner/voxel_index.h"
+
+#include <pcl_conversions/pcl_conversions.h>
+#include <sensor_msgs/image_encodings.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Gazebo worlds of the repository, set by CMake
+#ifndef AVOIDANCE_WORLDS_DIR
+#define AVOIDANCE_WORLDS_DIR "../sim/worlds"
+#endif
+
+using namespace avoidance;
+
+// every heap allocation of the process is counted, operator new, the Eigen
+// and the pcl allocators all end up in malloc
+namespace {
+std::atomic<size_t> allocation_count{0};
+}
+
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(ptr, size);
+}
+}
+#endif
+
+namespace {
+
+/**
+* @brief input of the planner stages, the stages downstream of the cloud
+*        filter work on the cropped cloud, its voxels and its histogram
+**/
+struct StageScene {
+  std::string name;
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  Eigen::Vector3f position;
+  Eigen::Vector3f goal;
+  Box histogram_box = Box(7.f);
+  FOV fov;
+  pcl::PointCloud<pcl::PointXYZ> cropped_cloud;
+  VoxelIndex voxels;
+  ObstacleMemory obstacle_memory;
+  Histogram<ALPHA_RES> histogram;
+};
+
+// scenes selected by the benchmark argument: synthetic depth frames of
+// increasing resolution followed by the box worlds sampled ever more densely
+struct SceneSource {
+  const char* world;  // nullptr for a synthetic frame
+  int width;
+  int height;
+  float spacing;
+};
+const SceneSource scene_sources[] = {
+    {nullptr, 160, 120, 0.f},         {nullptr, 320, 240, 0.f},
+    {nullptr, 640, 480, 0.f},         {"boxes1", 0, 0, 0.2f},
+    {"boxes1", 0, 0, 0.05f},          {"boxes3", 0, 0, 0.2f},
+    {"boxes3", 0, 0, 0.05f},          {"boxes5", 0, 0, 0.2f},
+    {"boxes5", 0, 0, 0.05f},          {"test_city_2", 0, 0, 0.2f},
+    {"test_city_2", 0, 0, 0.05f},
+};
+const int n_scene_sources = sizeof(scene_sources) / sizeof(scene_sources[0]);
+
+std::unique_ptr<StageScene> makeScene(const SceneSource& source) {
+  std::unique_ptr<StageScene> scene(new StageScene());
+  if (source.world) {
+    std::vector<WorldBox> boxes = loadWorldBoxes(
+        std::string(AVOIDANCE_WORLDS_DIR) + "/" + source.world + ".world");
+    scene->name = std::string(source.world) + "@" +
+                  std::to_string(static_cast<int>(100 * source.spacing)) +
+                  "cm";
+    scene->cloud = sampleWorldBoxes(boxes, source.spacing);
+    scene->position = worldViewpoint(boxes);
+    Eigen::Vector3f forward = scene->position;
+    forward.z() = 0.f;
+    forward = forward.norm() > 0.f ? forward.normalized()
+                                   : Eigen::Vector3f::UnitX().eval();
+    scene->goal = scene->position + 10.f * forward;
+  } else {
+    scene->name = std::to_string(source.width) + "x" +
+                  std::to_string(source.height);
+    scene->position = Eigen::Vector3f(1.2f, 0.4f, 4.f);
+    scene->cloud =
+        depthCameraFrame(source.width, source.height, scene->position);
+    scene->goal = scene->position + Eigen::Vector3f(0.f, 10.f, 0.f);
+  }
+
+  scene->histogram_box.setBoxLimits(scene->position, 3.f);
+  Eigen::Vector3f closest_point;
+  float distance_to_closest_point;
+  int counter_backoff;
+  filterPointCloud(scene->cropped_cloud, closest_point,
+                   distance_to_closest_point, counter_backoff,
+                   {scene->cloud}, 200, 1.5f, scene->histogram_box,
+                   scene->position, 0.2f);
+  calculateFOV(87.f, 58.f, scene->fov, 0.f, 0.f);
+  scene->voxels.build(scene->cropped_cloud, 0.1f);
+  scene->obstacle_memory.update(scene->voxels, scene->position, scene->fov,
+                                true, 50, 14.f, 16);
+  generateNewHistogram(scene->histogram, scene->cropped_cloud,
+                       scene->position);
+  return scene;
+}
+
+const StageScene* stageScene(benchmark::State& state) {
+  static std::map<int, std::unique_ptr<StageScene>> scenes;
+  int index = static_cast<int>(state.range(0));
+  std::unique_ptr<StageScene>& scene = scenes[index];
+  if (!scene) {
+    scene = makeScene(scene_sources[index]);
+  }
+  if (scene->cloud.empty()) {
+    state.SkipWithError("world not found");
+    return nullptr;
+  }
+  state.SetLabel(scene->name);
+  return scene.get();
+}
+
+void allScenes(benchmark::internal::Benchmark* benchmark) {
+  for (int i = 0; i < n_scene_sources; i++) {
+    benchmark->Arg(i);
+  }
+}
+
+/**
+* @brief allocations done by the timed loop, divided by the number of
+*        iterations when reported
+**/
+class AllocationCounter {
+ public:
+  AllocationCounter() : start_(allocation_count.load()) {}
+  double count() const {
+    return static_cast<double>(allocation_count.load() - start_);
+  }
+
+ private:
+  size_t start_;
+};
+
+void reportStage(benchmark::State& state, const AllocationCounter& counter,
+                 size_t points) {
+  state.counters["allocs_per_call"] =
+      benchmark::Counter(counter.count(), benchmark::Counter::kAvgIterations);
+  if (points > 0) {
+    // inverted rate of points per iteration, printed in ns
+    state.counters["time_per_point"] = benchmark::Counter(
+        static_cast<double>(points),
+        benchmark::Counter::kIsIterationInvariantRate |
+            benchmark::Counter::kInvert);
+  }
+  state.counters["points"] = static_cast<double>(points);
+}
+}
+
+// cropping of the raw cloud to the histogram box, per raw point
+static void BM_FilterPointCloud(benchmark::State& state) {
+  const StageScene* scene = stageScene(state);
+  if (!scene) return;
+  std::vector<pcl::PointCloud<pcl::PointXYZ>> complete_cloud = {scene->cloud};
+  pcl::PointCloud<pcl::PointXYZ> cropped_cloud;
+  Eigen::Vector3f closest_point;
+  float distance_to_closest_point;
+  int counter_backoff;
+
+  AllocationCounter counter;
+  for (auto _ : state) {
+    filterPointCloud(cropped_cloud, closest_point, distance_to_closest_point,
+                     counter_backoff, complete_cloud, 200, 1.5f,
+                     scene->histogram_box, scene->position, 0.2f);
+    benchmark::DoNotOptimize(cropped_cloud.points.data());
+  }
+  reportStage(state, counter, scene->cloud.size());
+}
+BENCHMARK(BM_FilterPointCloud)
+    ->Apply(allScenes)
+    ->Unit(benchmark::kMicrosecond);
+
+// a 640x480 depth camera looking along x at a slanted wall, as depth image
+// and as the cloud the depth image conversion would publish
+struct DepthCameraFrame {
+  sensor_msgs::Image::Ptr image;
+  std::shared_ptr<DepthRays> rays;
+  sensor_msgs::PointCloud2::Ptr cloud;
+  std::vector<Eigen::Affine3f, Eigen::aligned_allocator<Eigen::Affine3f>>
+      transforms;
+  Box histogram_box = Box(8.f);
+  Eigen::Vector3f position = Eigen::Vector3f(0.f, 0.f, 3.f);
+};
+
+const DepthCameraFrame& depthCameraFrame() {
+  static DepthCameraFrame* frame = nullptr;
+  if (frame) return *frame;
+  frame = new DepthCameraFrame;
+  const int width = 640;
+  const int height = 480;
+  sensor_msgs::CameraInfo info;
+  info.width = width;
+  info.height = height;
+  info.K = {385.0, 0.0, 320.0, 0.0, 385.0, 240.0, 0.0, 0.0, 1.0};
+  info.P = {385.0, 0.0, 320.0, 0.0, 0.0, 385.0, 240.0, 0.0, 0.0, 0.0, 1.0, 0.0};
+  frame->rays = std::make_shared<DepthRays>();
+  frame->rays->update(info);
+
+  frame->image.reset(new sensor_msgs::Image);
+  sensor_msgs::Image& image = *frame->image;
+  image.width = width;
+  image.height = height;
+  image.encoding = sensor_msgs::image_encodings::TYPE_16UC1;
+  image.step = width * sizeof(uint16_t);
+  image.data.resize(image.step * height);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (int v = 0; v < height; v++) {
+    for (int u = 0; u < width; u++) {
+      uint16_t depth_mm = static_cast<uint16_t>(2000 + 6 * u + v);
+      std::memcpy(&image.data[v * image.step + u * sizeof(uint16_t)],
+                  &depth_mm, sizeof(depth_mm));
+      float depth = 0.001f * depth_mm;
+      cloud.push_back(pcl::PointXYZ(frame->rays->x()[u] * depth,
+                                    frame->rays->y()[v] * depth, depth));
+    }
+  }
+  frame->cloud.reset(new sensor_msgs::PointCloud2);
+  pcl::toROSMsg(cloud, *frame->cloud);
+
+  // optical frame: z forward, x right, y down
+  frame->transforms.resize(1, Eigen::Affine3f::Identity());
+  frame->transforms[0].linear() << 0.f, 0.f, 1.f, -1.f, 0.f, 0.f, 0.f, -1.f,
+      0.f;
+  frame->transforms[0].translation() = frame->position;
+  frame->histogram_box.setBoxLimits(frame->position, 3.f);
+  return *frame;
+}
+
+// ingest of the cloud published for a depth image, per pixel
+static void BM_FilterDepthCameraCloud(benchmark::State& state) {
+  const DepthCameraFrame& frame = depthCameraFrame();
+  std::vector<sensor_msgs::PointCloud2::ConstPtr> cloud_msgs = {frame.cloud};
+  pcl::PointCloud<pcl::PointXYZ> cropped_cloud;
+  Eigen::Vector3f closest_point;
+  float distance_to_closest_point;
+  int counter_backoff;
+
+  AllocationCounter counter;
+  for (auto _ : state) {
+    filterPointCloud(cropped_cloud, closest_point, distance_to_closest_point,
+                     counter_backoff, cloud_msgs, frame.transforms, 200, 1.5f,
+                     frame.histogram_box, frame.position, 0.2f);
+    benchmark::DoNotOptimize(cropped_cloud.points.data());
+  }
+  reportStage(state, counter, frame.image->width * frame.image->height);
+}
+BENCHMARK(BM_FilterDepthCameraCloud)->Unit(benchmark::kMicrosecond);
+
+// ingest of the depth image itself with a pixel stride, per pixel
+static void BM_FilterDepthImage(benchmark::State& state) {
+  const DepthCameraFrame& frame = depthCameraFrame();
+  std::vector<sensor_msgs::Image::ConstPtr> depth_images = {frame.image};
+  std::vector<std::shared_ptr<const DepthRays>> depth_rays = {frame.rays};
+  pcl::PointCloud<pcl::PointXYZ> cropped_cloud;
+  Eigen::Vector3f closest_point;
+  float distance_to_closest_point;
+  int counter_backoff;
+
+  AllocationCounter counter;
+  for (auto _ : state) {
+    filterPointCloud(cropped_cloud, closest_point, distance_to_closest_point,
+                     counter_backoff, depth_images, depth_rays,
+                     frame.transforms, static_cast<int>(state.range(0)), 200,
+                     1.5f, frame.histogram_box, frame.position, 0.2f);
+    benchmark::DoNotOptimize(cropped_cloud.points.data());
+  }
+  reportStage(state, counter, frame.image->width * frame.image->height);
+}
+BENCHMARK(BM_FilterDepthImage)
+    ->Arg(1)
+    ->Arg(2)
+    ->Unit(benchmark::kMicrosecond);
+
+// histogram of the cropped cloud, per cropped point
+static void BM_GenerateNewHistogram(benchmark::State& state) {
+  const StageScene* scene = stageScene(state);
+  if (!scene) return;
+  Histogram<ALPHA_RES> histogram;
+  HistogramWorkspace workspace;
+
+  AllocationCounter counter;
+  for (auto _ : state) {
+    generateNewHistogram(histogram, scene->cropped_cloud, scene->position,
+                         workspace);
+    benchmark::ClobberMemory();
+  }
+  reportStage(state, counter, scene->cropped_cloud.size());
+}
+BENCHMARK(BM_GenerateNewHistogram)
+    ->Apply(allScenes)
+    ->Unit(benchmark::kMicrosecond);
+
+// histogram of the obstacle memory, per remembered voxel
+static void BM_PropagateHistogram(benchmark::State& state) {
+  const StageScene* scene = stageScene(state);
+  if (!scene) return;
+  Histogram<ALPHA_RES> histogram;
+  HistogramWorkspace workspace;
+
+  AllocationCounter counter;
+  for (auto _ : state) {
+    propagateHistogram(histogram, scene->obstacle_memory, scene->position,
+                       workspace);
+    benchmark::ClobberMemory();
+  }
+  reportStage(state, counter, scene->obstacle_memory.size());
+}
+BENCHMARK(BM_PropagateHistogram)
+    ->Apply(allScenes)
+    ->Unit(benchmark::kMicrosecond);
+
+// cost matrix of the histogram of the cropped cloud
+static void BM_GetCostMatrix(benchmark::State& state) {
+  const StageScene* scene = stageScene(state);
+  if (!scene) return;
+  Eigen::Vector3f last_sent_waypoint =
+      scene->position + (scene->goal - scene->position).normalized();
+  CostMatrixWorkspace workspace;
+  Eigen::MatrixXf cost_matrix;
+
+  AllocationCounter counter;
+  for (auto _ : state) {
+    getCostMatrix(scene->histogram, scene->goal, scene->position, 90.f,
+                  last_sent_waypoint, costParameters(), false, 30.f,
+                  cost_matrix, workspace, nullptr);
+    benchmark::DoNotOptimize(cost_matrix.data());
+  }
+  reportStage(state, counter, 0);
+}
+BENCHMARK(BM_GetCostMatrix)
+    ->Apply(allScenes)
+    ->Unit(benchmark::kMicrosecond);
+
+// cost matrix of the same histogram at full resolution near the vehicle and
+// towards the goal only, including the resolution adaption
+static void BM_GetCostMatrixAdaptive(benchmark::State& state) {
+  const StageScene* scene = stageScene(state);
+  if (!scene) return;
+  Eigen::Vector3f last_sent_waypoint =
+      scene->position + (scene->goal - scene->position).normalized();
+  CostMatrixWorkspace workspace;
+  Eigen::MatrixXf cost_matrix;
+  Histogram<ALPHA_RES> histogram;
+
+  AllocationCounter counter;
+  for (auto _ : state) {
+    histogram = scene->histogram;
+    adaptHistogramResolution(histogram, scene->position, scene->goal, 4.f,
+                             30.f);
+    getCostMatrix(histogram, scene->goal, scene->position, 90.f,
+                  last_sent_waypoint, costParameters(), false, 30.f,
+                  cost_matrix, workspace, nullptr);
+    benchmark::DoNotOptimize(cost_matrix.data());
+  }
+  reportStage(state, counter, 0);
+}
+BENCHMARK(BM_GetCostMatrixAdaptive)
+    ->Apply(allScenes)
+    ->Unit(benchmark::kMicrosecond);
+
+// unit vectors of all bin centres evaluating the trigonometric functions, the
+// way the cost matrix computed them before the BinCenters table
+static void BM_BinDirectionsTrigonometric(benchmark::State& state) {
+  const Eigen::Vector3f origin(0.f, 0.f, 0.f);
+  for (auto _ : state) {
+    Eigen::Vector3f sum(0.f, 0.f, 0.f);
+    for (int e = 0; e < GRID_LENGTH_E; e++) {
+      for (int z = 0; z < GRID_LENGTH_Z; z++) {
+        PolarPoint p_pol = histogramIndexToPolar(e, z, ALPHA_RES, 1.f);
+        sum += polarToCartesian(p_pol, origin);
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * GRID_LENGTH_E * GRID_LENGTH_Z);
+}
+BENCHMARK(BM_BinDirectionsTrigonometric)->Unit(benchmark::kMicrosecond);
+
+// unit vectors of all bin centres looked up in the BinCenters table
+static void BM_BinDirectionsTable(benchmark::State& state) {
+  const BinCenters<ALPHA_RES>& bins = BinCenters<ALPHA_RES>::instance();
+  for (auto _ : state) {
+    Eigen::Vector3f sum(0.f, 0.f, 0.f);
+    for (int e = 0; e < GRID_LENGTH_E; e++) {
+      for (int z = 0; z < GRID_LENGTH_Z; z++) {
+        sum += bins.direction(e, z);
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * GRID_LENGTH_E * GRID_LENGTH_Z);
+}
+BENCHMARK(BM_BinDirectionsTable)->Unit(benchmark::kMicrosecond);
+
+// obstacle smoothing of the distance matrix of the histogram
+static void BM_SmoothPolarMatrix(benchmark::State& state) {
+  const StageScene* scene = stageScene(state);
+  if (!scene) return;
+  Eigen::MatrixXf distance_matrix(GRID_LENGTH_E, GRID_LENGTH_Z);
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      distance_matrix(e, z) = scene->histogram.dist(e, z);
+    }
+  }
+  Eigen::MatrixXf matrix;
+  CostMatrixWorkspace workspace;
+  const unsigned int radius = 30 / ALPHA_RES;
+
+  AllocationCounter counter;
+  for (auto _ : state) {
+    matrix = distance_matrix;
+    smoothPolarMatrix(matrix, radius, workspace);
+    benchmark::DoNotOptimize(matrix.data());
+  }
+  reportStage(state, counter, 0);
+}
+BENCHMARK(BM_SmoothPolarMatrix)
+    ->Apply(allScenes)
+    ->Unit(benchmark::kMicrosecond);
+
+// look-ahead tree on the voxels of the cropped cloud, per occupied voxel
+static void BM_BuildLookAheadTreeScene(benchmark::State& state) {
+  const StageScene* scene = stageScene(state);
+  if (!scene) return;
+  StarPlanner planner;
+  LocalPlannerNodeConfig config = LocalPlannerNodeConfig::__getDefault__();
+  planner.dynamicReconfigureSetStarParams(config, 1);
+  planner.setParams(costParameters());
+  planner.setFOV(87.0f, 58.0f);
+  planner.setObstacleMemory(scene->obstacle_memory);
+  planner.setCloud(scene->cropped_cloud, scene->voxels);
+  planner.setPose(scene->position, 0.0f);
+
+  AllocationCounter counter;
+  for (auto _ : state) {
+    // restarts the tree age so that every build plans from scratch
+    planner.setGoal(scene->goal);
+    planner.buildLookAheadTree();
+    benchmark::DoNotOptimize(planner.path_node_positions_.data());
+  }
+  reportStage(state, counter, scene->voxels.size());
+  state.counters["tree_nodes"] = static_cast<double>(planner.tree_.size());
+}
+BENCHMARK(BM_BuildLookAheadTreeScene)
+    ->Apply(allScenes)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,184 @@
+#ifndef BENCH_SCENES_H
+#define BENCH_SCENES_H
+
+#include "local_planner/common.h"
+
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace avoidance {
+
+/**
+* @brief     one synthetic depth camera frame, width x height rays over a 87x58
+*            degree field of view looking along +y and hitting a wavy surface
+*            1.5m to 6.5m in front of the camera
+* @param[in] width, height, image size
+* @param[in] position, camera position
+**/
+inline pcl::PointCloud<pcl::PointXYZ> depthCameraFrame(
+    int width, int height, const Eigen::Vector3f& position) {
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.points.reserve(width * height);
+  // the pattern is defined on a 640x480 image so that all sizes show the
+  // same scene
+  const float scale_u = 640.f / width, scale_v = 480.f / height;
+  for (int v = 0; v < height; v++) {
+    for (int u = 0; u < width; u++) {
+      float azimuth = (u / float(width) - 0.5f) * 87.f * DEG_TO_RAD;
+      float elevation = (v / float(height) - 0.5f) * 58.f * DEG_TO_RAD;
+      float pu = scale_u * u, pv = scale_v * v;
+      float depth = 4.f + 1.5f * std::sin(0.02f * pu) * std::cos(0.03f * pv) +
+                    std::sin(0.005f * (pu + pv));
+      cloud.push_back(pcl::PointXYZ(
+          position.x() + depth * std::cos(elevation) * std::sin(azimuth),
+          position.y() + depth * std::cos(elevation) * std::cos(azimuth),
+          position.z() + depth * std::sin(elevation)));
+    }
+  }
+  return cloud;
+}
+
+/**
+* @brief box of a Gazebo world, axis aligned up to the yaw angle
+**/
+struct WorldBox {
+  Eigen::Vector3f center;
+  Eigen::Vector3f size;
+  float yaw;
+};
+
+/**
+* @brief     reads the first n numbers of the text following a tag
+**/
+inline bool readTagValues(const std::string& text, size_t tag_begin,
+                          int n, float* values) {
+  size_t begin = text.find('>', tag_begin);
+  if (begin == std::string::npos) return false;
+  std::istringstream stream(text.substr(begin + 1, 200));
+  for (int i = 0; i < n; i++) {
+    if (!(stream >> values[i])) return false;
+  }
+  return true;
+}
+
+/**
+* @brief     extracts the box collision geometries of the models of a Gazebo
+*            world file
+* @details   only the poses in front of the first collision of a model are
+*            applied, which covers the model and link poses the worlds of the
+*            repository use. Ground planes and meshes are skipped.
+* @param[in] path, .world file
+* @returns   boxes, empty if the file cannot be read
+**/
+inline std::vector<WorldBox> loadWorldBoxes(const std::string& path) {
+  std::vector<WorldBox> boxes;
+  std::ifstream file(path);
+  if (!file) return boxes;
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  const std::string text = buffer.str();
+
+  size_t model = text.find("<model");
+  while (model != std::string::npos) {
+    size_t model_end = text.find("</model>", model);
+    if (model_end == std::string::npos) break;
+    size_t first_collision = text.find("<collision", model);
+
+    // compose the model and link poses
+    Eigen::Vector3f translation = Eigen::Vector3f::Zero();
+    float yaw = 0.f;
+    for (size_t pose = text.find("<pose", model);
+         pose < std::min(first_collision, model_end);
+         pose = text.find("<pose", pose + 1)) {
+      float p[6];
+      if (readTagValues(text, pose, 6, p)) {
+        const float c = std::cos(yaw), s = std::sin(yaw);
+        translation += Eigen::Vector3f(c * p[0] - s * p[1],
+                                       s * p[0] + c * p[1], p[2]);
+        yaw += p[5];
+      }
+    }
+
+    for (size_t collision = first_collision; collision < model_end;
+         collision = text.find("<collision", collision + 1)) {
+      size_t collision_end = text.find("</collision>", collision);
+      size_t box = text.find("<box>", collision);
+      if (box > collision_end) continue;
+      float size[3];
+      if (readTagValues(text, text.find("<size>", box), 3, size)) {
+        boxes.push_back(WorldBox{translation,
+                                 Eigen::Vector3f(size[0], size[1], size[2]),
+                                 yaw});
+      }
+    }
+    model = text.find("<model", model_end);
+  }
+  return boxes;
+}
+
+/**
+* @brief     samples the surfaces of the boxes of a world
+* @param[in] boxes, geometry of the world
+* @param[in] spacing, distance between neighbouring samples [m]
+**/
+inline pcl::PointCloud<pcl::PointXYZ> sampleWorldBoxes(
+    const std::vector<WorldBox>& boxes, float spacing) {
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (const WorldBox& box : boxes) {
+    const Eigen::Vector3f half = 0.5f * box.size;
+    const float c = std::cos(box.yaw), s = std::sin(box.yaw);
+    auto push = [&](float x, float y, float z) {
+      cloud.push_back(pcl::PointXYZ(box.center.x() + c * x - s * y,
+                                    box.center.y() + s * x + c * y,
+                                    box.center.z() + z));
+    };
+    // two faces per axis
+    for (int axis = 0; axis < 3; axis++) {
+      int a = (axis + 1) % 3, b = (axis + 2) % 3;
+      for (float side : {-1.f, 1.f}) {
+        for (float u = -half[a]; u <= half[a]; u += spacing) {
+          for (float v = -half[b]; v <= half[b]; v += spacing) {
+            Eigen::Vector3f p;
+            p[axis] = side * half[axis];
+            p[a] = u;
+            p[b] = v;
+            push(p.x(), p.y(), p.z());
+          }
+        }
+      }
+    }
+  }
+  return cloud;
+}
+
+/**
+* @brief     vehicle position from which a world is looked at, 4m in front of
+*            the box closest to the origin at 3m height
+**/
+inline Eigen::Vector3f worldViewpoint(const std::vector<WorldBox>& boxes) {
+  Eigen::Vector3f closest(10.f, 0.f, 3.f);
+  float min_distance = std::numeric_limits<float>::max();
+  for (const WorldBox& box : boxes) {
+    float distance = box.center.head<2>().norm();
+    if (distance < min_distance && distance > 1.f) {
+      min_distance = distance;
+      closest = box.center;
+    }
+  }
+  Eigen::Vector2f direction = closest.head<2>().normalized();
+  Eigen::Vector2f xy = closest.head<2>() - 4.f * direction;
+  return Eigen::Vector3f(xy.x(), xy.y(), 3.f);
+}
+}
+
+#endif  // BENCH_SCENES_H
@@ -0,0 +1,218 @@
+#include <benchmark/benchmark.h>
+
+#include "bench_scenes.h"
+#include "local_planner/common.h"
+#include "local_planner/planner_functions.h"
+#include "local_planner/star_planner.h"
+#include "local_planner/tree_node.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace avoidance;
+
+namespace {
+
+// a wall between the vehicle and the goal plus some random clutter
+struct StarPlannerScene {
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  ObstacleMemory obstacle_memory;
+  Eigen::Vector3f position = Eigen::Vector3f(1.2f, 0.4f, 4.f);
+  Eigen::Vector3f goal = Eigen::Vector3f(2.f, 14.f, 4.f);
+
+  StarPlannerScene() {
+    for (float x = -1.5f; x < 2.5f; x += 0.05f) {
+      for (float z = 3.f; z < 5.f; z += 0.05f) {
+        cloud.push_back(pcl::PointXYZ(x, 2.f, z));
+      }
+    }
+    // remember clutter all around the vehicle, then look at the wall so that
+    // the memory outside of the field of view is kept
+    pcl::PointCloud<pcl::PointXYZ> clutter;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> xy(-8.f, 8.f);
+    std::uniform_real_distribution<float> z(1.f, 7.f);
+    for (int i = 0; i < 5000; i++) {
+      clutter.push_back(pcl::PointXYZ(xy(rng), xy(rng), z(rng)));
+    }
+    FOV fov;
+    VoxelIndex voxels;
+    voxels.build(clutter, 0.1f);
+    obstacle_memory.update(voxels, position, fov, true, 20, 20.f, 0);
+    calculateFOV(59.f, 46.f, fov, 0.f, 0.f);
+    voxels.build(cloud, 0.1f);
+    obstacle_memory.update(voxels, position, fov, true, 20, 20.f, 0);
+  }
+
+  void setup(StarPlanner& planner, int batch_size) const {
+    LocalPlannerNodeConfig config = LocalPlannerNodeConfig::__getDefault__();
+    config.n_expanded_nodes_ = 30;
+    config.max_path_length_ = 6.0;
+    config.tree_expansion_batch_size_ = batch_size;
+    planner.dynamicReconfigureSetStarParams(config, 1);
+    planner.setParams(costParameters());
+    planner.setFOV(270.0f, 45.0f);
+    planner.setObstacleMemory(obstacle_memory);
+    planner.setCloud(cloud);
+    planner.setPose(position, 0.0f);
+    planner.setGoal(goal);
+  }
+};
+
+const StarPlannerScene& scene() {
+  static StarPlannerScene s;
+  return s;
+}
+
+// largest distance between corresponding nodes of two paths, a path which is
+// shorter than the other is compared against the other's last node
+float pathDeviation(const std::vector<Eigen::Vector3f>& a,
+                    const std::vector<Eigen::Vector3f>& b) {
+  size_t n = std::max(a.size(), b.size());
+  float deviation = 0.f;
+  for (size_t i = 0; i < n; i++) {
+    const Eigen::Vector3f& pa = a[std::min(i, a.size() - 1)];
+    const Eigen::Vector3f& pb = b[std::min(i, b.size() - 1)];
+    deviation = std::max(deviation, (pa - pb).norm());
+  }
+  return deviation;
+}
+
+// one dense depth camera frame
+const pcl::PointCloud<pcl::PointXYZ>& denseCloud() {
+  static pcl::PointCloud<pcl::PointXYZ> cloud =
+      depthCameraFrame(640, 480, scene().position);
+  return cloud;
+}
+
+const std::vector<Eigen::Vector3f>& serialPath() {
+  static std::vector<Eigen::Vector3f> path = [] {
+    StarPlanner planner;
+    scene().setup(planner, 1);
+    planner.buildLookAheadTree();
+    return planner.path_node_positions_;
+  }();
+  return path;
+}
+}
+
+// latency of a tree build and deviation of the chosen path from the serial
+// expansion, the argument is the expansion batch size
+static void BM_BuildLookAheadTree(benchmark::State& state) {
+  StarPlanner planner;
+  scene().setup(planner, static_cast<int>(state.range(0)));
+
+  for (auto _ : state) {
+    // restarts the tree age so that every build plans from scratch
+    planner.setGoal(scene().goal);
+    planner.buildLookAheadTree();
+  }
+
+  state.counters["tree_nodes"] = static_cast<double>(planner.tree_.size());
+  state.counters["path_nodes"] =
+      static_cast<double>(planner.path_node_positions_.size());
+  state.counters["path_deviation_m"] =
+      pathDeviation(serialPath(), planner.path_node_positions_);
+}
+BENCHMARK(BM_BuildLookAheadTree)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+// best candidates of the histogram of the scene, the argument selects the
+// full cost matrix (0) or the lazy sector evaluation (1)
+static void BM_BestCandidates(benchmark::State& state) {
+  const StarPlannerScene& s = scene();
+  Histogram<ALPHA_RES> histogram;
+  HistogramWorkspace histogram_workspace;
+  generateNewHistogram(histogram, s.cloud, s.position, histogram_workspace);
+  costParameters cost_params;
+  Eigen::Vector3f last_sent_waypoint = s.position + Eigen::Vector3f::UnitY();
+  CostMatrixWorkspace workspace;
+  Eigen::MatrixXf cost_matrix;
+  std::vector<candidateDirection> candidates;
+  const unsigned int n_candidates = static_cast<unsigned int>(state.range(1));
+
+  for (auto _ : state) {
+    if (state.range(0) == 0) {
+      getCostMatrix(histogram, s.goal, s.position, 90.f, last_sent_waypoint,
+                    cost_params, false, 30.f, cost_matrix, workspace, nullptr);
+      getBestCandidatesFromCostMatrix(cost_matrix, n_candidates, candidates);
+    } else {
+      getBestCandidatesFromHistogram(histogram, s.goal, s.position, 90.f,
+                                     last_sent_waypoint, cost_params, 30.f,
+                                     n_candidates, workspace, candidates);
+    }
+    benchmark::DoNotOptimize(candidates.data());
+  }
+}
+BENCHMARK(BM_BestCandidates)
+    ->Args({0, 1})
+    ->Args({1, 1})
+    ->Args({0, 50})
+    ->Args({1, 50})
+    ->Unit(benchmark::kMicrosecond);
+
+// downsampling of a dense frame followed by the histogram and the voxel index
+// build, the arguments are the voxel size in cm (0 disables the voxel grid)
+// and the point budget (0 disables it). The counters compare the histogram
+// with the one of the raw cloud.
+static void BM_DownsampleHistogram(benchmark::State& state) {
+  const Eigen::Vector3f& position = scene().position;
+  const pcl::PointCloud<pcl::PointXYZ>& raw = denseCloud();
+  const float voxel_size = 0.01f * state.range(0);
+  const size_t max_points = static_cast<size_t>(state.range(1));
+  HistogramWorkspace histogram_workspace;
+  Histogram<ALPHA_RES> raw_histogram;
+  generateNewHistogram(raw_histogram, raw, position, histogram_workspace);
+
+  DownsampleWorkspace workspace;
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  Histogram<ALPHA_RES> histogram;
+  VoxelIndex tree_voxels;
+  for (auto _ : state) {
+    state.PauseTiming();
+    cloud = raw;
+    state.ResumeTiming();
+    downsamplePointCloud(cloud, position, voxel_size, max_points, workspace);
+    generateNewHistogram(histogram, cloud, position, histogram_workspace);
+    // the voxels of the obstacle memory and the tree are built from the same
+    // cloud in every iteration of the planner
+    tree_voxels.build(cloud, 0.1f);
+    benchmark::ClobberMemory();
+  }
+
+  int bins_lost = 0, bins_added = 0, bins_occupied = 0;
+  float dist_error = 0.f;
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      bool raw_occupied = raw_histogram.dist(e, z) > 0.f;
+      bool occupied = histogram.dist(e, z) > 0.f;
+      bins_lost += raw_occupied && !occupied;
+      bins_added += !raw_occupied && occupied;
+      if (raw_occupied && occupied) {
+        bins_occupied++;
+        dist_error += std::abs(raw_histogram.dist(e, z) - histogram.dist(e, z));
+      }
+    }
+  }
+  state.counters["points"] = static_cast<double>(cloud.size());
+  state.counters["bins_lost"] = bins_lost;
+  state.counters["bins_added"] = bins_added;
+  state.counters["mean_dist_error_m"] =
+      bins_occupied > 0 ? dist_error / bins_occupied : 0.f;
+}
+BENCHMARK(BM_DownsampleHistogram)
+    ->Args({0, 0})
+    ->Args({2, 0})
+    ->Args({5, 0})
+    ->Args({10, 0})
+    ->Args({20, 0})
+    ->Args({0, 20000})
+    ->Args({5, 20000})
+    ->Args({0, 5000})
+    ->Unit(benchmark::kMillisecond);
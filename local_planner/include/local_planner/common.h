@@ -10,6 +10,8 @@
 
 #include <pcl/point_types.h>
 
+#include <cmath>
+
 namespace avoidance {
 
 struct PolarPoint {
@@ -52,6 +54,53 @@ float indexAngleDifference(float a, float b);
 **/
 PolarPoint histogramIndexToPolar(int e, int z, int res, float radius);
 
+/**
+* @brief     sine and cosine of the bin centre angles of a histogram of
+*            resolution RES, computed once on first use so that loops over the
+*            bins look them up instead of evaluating the trigonometric
+*            functions
+* @details   the values are the ones polarToCartesian computes for the angles
+*            of histogramIndexToPolar, results using the table are identical
+**/
+template <int RES>
+class BinCenters {
+ public:
+  static const int N_E = 180 / RES;
+  static const int N_Z = 360 / RES;
+
+  float cos_e[N_E];
+  float sin_e[N_E];
+  float cos_z[N_Z];
+  float sin_z[N_Z];
+
+  /**
+  * @brief     unit vector of the bin centre in the direction convention of
+  *            polarToCartesian
+  **/
+  Eigen::Vector3f direction(int e, int z) const {
+    return Eigen::Vector3f(cos_e[e] * sin_z[z], cos_e[e] * cos_z[z], sin_e[e]);
+  }
+
+  static const BinCenters& instance() {
+    static const BinCenters table;
+    return table;
+  }
+
+ private:
+  BinCenters() {
+    for (int e = 0; e < N_E; e++) {
+      float angle = histogramIndexToPolar(e, 0, RES, 1.f).e * DEG_TO_RAD;
+      cos_e[e] = std::cos(angle);
+      sin_e[e] = std::sin(angle);
+    }
+    for (int z = 0; z < N_Z; z++) {
+      float angle = histogramIndexToPolar(0, z, RES, 1.f).z * DEG_TO_RAD;
+      cos_z[z] = std::cos(angle);
+      sin_z[z] = std::sin(angle);
+    }
+  }
+};
+
 /**
 * @brief     Compute a cartesian point to polar CS
 * @param[in] position Position of the location to which to compute the bearing
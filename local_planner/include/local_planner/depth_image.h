@@ -0,0 +1,70 @@
+#ifndef DEPTH_IMAGE_H
+#define DEPTH_IMAGE_H
+
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/Image.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace avoidance {
+
+/**
+* @brief lookup table of the pixel rays of a rectified depth camera, built once
+*        from the intrinsics of the camera info
+* @details the ray of pixel (u, v) in the optical frame is (x(u), y(v), 1), a
+*          pixel of depth d is at d times its ray. The table is separable, so
+*          it has one entry per column and one per row instead of one per
+*          pixel.
+**/
+class DepthRays {
+ public:
+  DepthRays() = default;
+  ~DepthRays() = default;
+
+  /**
+  * @brief     fills the table from the projection of the camera info, the
+  *            camera matrix is used if the projection is not set
+  * @param[in] info, camera info of the depth image
+  * @returns   false if the intrinsics are not valid, the table is empty then
+  **/
+  bool update(const sensor_msgs::CameraInfo& info);
+
+  /**
+  * @brief     checks if the table was built from the same image size and
+  *            intrinsics, so it does not need to be built again
+  **/
+  bool matches(const sensor_msgs::CameraInfo& info) const;
+
+  /**
+  * @brief     checks if the table has the size of a depth image
+  **/
+  bool fits(const sensor_msgs::Image& image) const {
+    return image.width == x_.size() && image.height == y_.size();
+  }
+
+  bool empty() const { return x_.empty(); }
+  const std::vector<float>& x() const { return x_; }
+  const std::vector<float>& y() const { return y_; }
+
+ private:
+  double fx_ = 0.0;
+  double fy_ = 0.0;
+  double cx_ = 0.0;
+  double cy_ = 0.0;
+  std::vector<float> x_;  // per column
+  std::vector<float> y_;  // per row
+};
+
+/**
+* @brief      scale from the pixel values of a depth image to meters
+* @param[in]  encoding, encoding of the depth image
+* @param[out] scale, 0.001 for millimeters in 16UC1 and 1 for meters in 32FC1
+* @returns    false if the encoding is not a depth encoding
+**/
+bool depthImageScale(const std::string& encoding, float& scale);
+
+}  // namespace avoidance
+
+#endif  // DEPTH_IMAGE_H
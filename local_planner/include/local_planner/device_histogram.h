@@ -0,0 +1,52 @@
+#ifndef DEVICE_HISTOGRAM_H
+#define DEVICE_HISTOGRAM_H
+
+#include <cstddef>
+
+// Interface to the CUDA kernels of HistogramBatch, only built with the
+// LOCAL_PLANNER_CUDA option. It uses plain arrays so that device_histogram.cu
+// does not depend on Eigen or PCL.
+
+namespace avoidance {
+
+/**
+* @brief device memory of the voxels of the current frame and of the bin sums
+*        of a batch of histograms, grows with the largest batch
+**/
+struct DeviceHistogramBuffers;
+
+/**
+* @brief     allocates the device buffers on the current CUDA device
+* @returns   nullptr if there is no usable device
+**/
+DeviceHistogramBuffers* createDeviceHistogramBuffers();
+
+/**
+* @brief     frees the device buffers, nullptr is ignored
+**/
+void destroyDeviceHistogramBuffers(DeviceHistogramBuffers* buffers);
+
+/**
+* @brief     copies the voxel centroids and point counts to the device
+* @param[in] x, y, z, count, arrays of n voxels
+* @returns   false if device memory could not be allocated or written
+**/
+bool uploadDeviceVoxels(DeviceHistogramBuffers& buffers, const float* x,
+                        const float* y, const float* z, const int* count,
+                        size_t n);
+
+/**
+* @brief      bins the uploaded voxels around every origin in one kernel
+*             launch and computes the mean distance of every bin
+* @param[in]  origins, n_origins positions as consecutive x, y, z
+* @param[in]  res, resolution of the histograms in degrees
+* @param[out] dist, n_origins row-major histograms of (180 / res) x
+*             (360 / res) mean distances, 0 for empty bins
+* @returns    false if a CUDA call failed, dist is not valid then
+**/
+bool buildDeviceHistograms(DeviceHistogramBuffers& buffers,
+                           const float* origins, size_t n_origins, int res,
+                           float* dist);
+}
+
+#endif  // DEVICE_HISTOGRAM_H
@@ -0,0 +1,149 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include "avoidance_output.h"
+#include "candidate_direction.h"
+#include "stage_timer.h"
+
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace avoidance {
+
+/**
+* @brief occupied cell of the polar histogram in a FlightFrame
+**/
+struct RecordedCell {
+  uint16_t index;        ///< e * z_dim + z of the cell
+  uint16_t distance_cm;  ///< distance of the obstacle [cm]
+};
+
+/**
+* @brief inputs and decisions of one planner iteration, as far as they are
+*        needed to replay it offline
+**/
+struct FlightFrame {
+  double stamp = 0.0;  // ROS time of the iteration [s]
+  Eigen::Vector3f position = Eigen::Vector3f::Zero();
+  Eigen::Vector3f velocity = Eigen::Vector3f::Zero();
+  Eigen::Vector3f goal = Eigen::Vector3f::Zero();
+  Eigen::Vector3f last_sent_waypoint = Eigen::Vector3f::Zero();
+  float yaw = 0.f;    // [rad]
+  float pitch = 0.f;  // [rad]
+  float ground_distance = 0.f;
+  float h_fov = 0.f;  // field of view of all cameras [deg]
+  float v_fov = 0.f;  // [deg]
+  bool armed = false;
+  bool offboard = false;
+  bool mission = false;
+  waypoint_choice waypoint_type = hover;
+  int histogram_resolution = 0;  // [deg], 0 if the frame has no histogram
+  std::vector<RecordedCell> histogram;  // the empty cells are left out
+  std::vector<candidateDirection> candidates;
+  pcl::PointCloud<pcl::PointXYZ> cloud;  // the cropped and downsampled cloud
+  std::array<float, static_cast<size_t>(PlannerStage::count)> stage_ms{};
+};
+
+/**
+* @brief always-on recorder of the latest planner iterations in a
+*        memory-mapped ring of fixed size frames
+* @details every frame has a sequence number and a checksum like the slots of
+*          a SnapshotFile, a frame being written has sequence 0. The frames
+*          survive a crash of the node in the page cache and are read by the
+*          replay harness with readFlightRecording(). A write takes the
+*          candidates and the cloud from the planner and copies them into the
+*          mapping without a system call, with one memcpy each for the
+*          header, the histogram, the candidates and the points, followed by
+*          a checksum pass over the whole frame. A frame which does not fit is
+*          truncated, the points of the cloud are left out first, then the
+*          candidates.
+**/
+class FlightRecorder {
+ public:
+  FlightRecorder() = default;
+  ~FlightRecorder();
+  FlightRecorder(const FlightRecorder&) = delete;
+  FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+  /**
+  * @brief     opens or creates the recording, an existing file of the same
+  *            format and size keeps its frames and the sequence continues
+  * @param[in] path, location of the recording
+  * @param[in] num_frames, number of frames in the ring
+  * @param[in] frame_capacity, bytes of a frame
+  * @returns   true, if the file could be mapped
+  **/
+  bool open(const std::string& path, size_t num_frames,
+            size_t frame_capacity);
+
+  /**
+  * @brief     unmaps and closes the file
+  **/
+  void close();
+
+  bool isOpen() const { return data_ != nullptr; }
+
+  /**
+  * @brief     overwrites the oldest frame of the ring
+  * @param[in] frame, planner iteration
+  * @returns   true, if the frame was written
+  **/
+  bool write(const FlightFrame& frame) {
+    return write(frame, frame.candidates, frame.cloud);
+  }
+
+  /**
+  * @brief     overwrites the oldest frame of the ring with the candidates and
+  *            the cloud read in place, the ones of the frame are ignored
+  * @param[in] frame, planner iteration
+  * @param[in] candidates, candidate directions of the iteration
+  * @param[in] cloud, cropped and downsampled cloud of the iteration
+  * @returns   true, if the frame was written
+  **/
+  bool write(const FlightFrame& frame,
+             const std::vector<candidateDirection>& candidates,
+             const pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+  /**
+  * @brief     number of points which fit into a frame next to the histogram
+  *            and the candidates
+  * @param[in] num_cells, occupied cells of the histogram
+  * @param[in] num_candidates, candidate directions
+  **/
+  size_t pointCapacity(size_t num_cells, size_t num_candidates) const;
+
+  /**
+  * @brief     number of frames which were truncated since the recording was
+  *            opened
+  **/
+  size_t truncatedFrames() const { return truncated_frames_; }
+
+ private:
+  int fd_ = -1;
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  size_t num_frames_ = 0;
+  size_t frame_capacity_ = 0;
+  uint64_t sequence_ = 0;  // sequence number of the newest frame
+  size_t truncated_frames_ = 0;
+};
+
+/**
+* @brief      reads the complete frames of a recording
+* @param[in]  path, location of the recording
+* @param[out] frames, frames ordered from the oldest to the newest
+* @returns    false, if the file is not a recording
+**/
+bool readFlightRecording(const std::string& path,
+                         std::vector<FlightFrame>& frames);
+}
+
+#endif  // FLIGHT_RECORDER_H
@@ -3,38 +3,80 @@
 
 #include <math.h>
 #include <Eigen/Dense>
+#include <bitset>
 #include <vector>
 
+// Histogram resolution in degrees, can be set at build time with
+// -DHISTOGRAM_RESOLUTION=<res>
+#ifndef HISTOGRAM_RESOLUTION
+#define HISTOGRAM_RESOLUTION 6
+#endif
+
 namespace avoidance {
 
 // Be very careful choosing the resolution! Valid resolutions must fullfill:
 // 180 % (2 * ALPHA_RES) = 0
-// Examples of valid resolution values: 1, 3, 5, 6, 10, 15, 18, 30, 45, 60
-const int ALPHA_RES = 6;
+// Valid resolution values: 1, 2, 3, 5, 6, 9, 10, 15, 18, 30, 45, 90
+const int ALPHA_RES = HISTOGRAM_RESOLUTION;
 const int GRID_LENGTH_Z = 360 / ALPHA_RES;
 const int GRID_LENGTH_E = 180 / ALPHA_RES;
 
-class Histogram {
-  int resolution_;
-  int z_dim_;
-  int e_dim_;
-  Eigen::MatrixXi age_;
-  Eigen::MatrixXf dist_;
+static_assert(180 % (2 * ALPHA_RES) == 0,
+              "Invalid histogram resolution, see histogram.h");
+
+/**
+* @brief histogram cells inside the Field of View, a mask of the azimuth
+*        indices and the elevation indices strictly between e_min and e_max
+* @details the azimuth indices inside the FOV form one run, or two if the FOV
+*          wraps around index 0
+**/
+struct FOV {
+  std::bitset<GRID_LENGTH_Z> azimuth;
+  int e_min = 0;
+  int e_max = 0;
 
   /**
-  * @brief     wraps elevation and azimuth indeces around the histogram
-  * @param     x, elevation angle index
-  * @param     y, azimuth angle index
+  * @brief     membership tests of an elevation index, an azimuth index in
+  *            [0, GRID_LENGTH_Z) and a histogram cell
   **/
-  inline void wrapIndex(int &x, int &y) const {
-    x = x % e_dim_;
-    if (x < 0) x += e_dim_;
-    y = y % z_dim_;
-    if (y < 0) y += z_dim_;
+  inline bool containsElevation(int e) const { return e > e_min && e < e_max; }
+  inline bool containsAzimuth(int z) const { return azimuth[z]; }
+  inline bool contains(int e, int z) const {
+    return containsElevation(e) && containsAzimuth(z);
   }
+};
 
+/**
+* @brief polar histogram of obstacle distances and ages with a resolution of
+*        Res degrees in elevation and azimuth
+* @details the storage is fixed-size and row-major, cell (e, z) is found at
+*          e * z_dim + z of the underlying arrays. Blocks of 2x2 cells can be
+*          marked coarse, their four cells then hold the same obstacle and
+*          the cost of the block is evaluated once at a resolution of 2 * Res
+**/
+template <int Res>
+class Histogram {
  public:
-  Histogram(const int res);
+  static_assert(180 % Res == 0, "Invalid histogram resolution");
+  static const int resolution = Res;
+  static const int z_dim = 360 / Res;
+  static const int e_dim = 180 / Res;
+  static const int block_z_dim = (z_dim + 1) / 2;
+  static const int block_e_dim = (e_dim + 1) / 2;
+
+  // the cells of fine resolutions exceed the size Eigen allows for fixed-size
+  // matrices, e.g. 180x360 at 1 degree, and are allocated on the heap
+  static const bool is_dynamic =
+      e_dim * z_dim * sizeof(float) > EIGEN_STACK_ALLOCATION_LIMIT;
+  static const int rows = is_dynamic ? Eigen::Dynamic : e_dim;
+  static const int cols = is_dynamic ? Eigen::Dynamic : z_dim;
+
+  typedef Eigen::Matrix<int, rows, cols, Eigen::RowMajor | Eigen::DontAlign>
+      AgeMatrix;
+  typedef Eigen::Matrix<float, rows, cols, Eigen::RowMajor | Eigen::DontAlign>
+      DistMatrix;
+
+  Histogram() : age_(e_dim, z_dim), dist_(e_dim, z_dim) { setZero(); }
   ~Histogram() = default;
 
   /**
@@ -76,37 +118,157 @@ class Histogram {
   **/
   inline void set_dist(int x, int y, float value) { dist_(x, y) = value; }
 
+  /**
+  * @brief     unchecked access to the cell age for loops over the histogram
+  * @param[in] x, elevation angle index in [0, e_dim)
+  * @param[in] y, azimuth angle index in [0, z_dim)
+  **/
+  inline int& age(int x, int y) { return age_(x, y); }
+  inline int age(int x, int y) const { return age_(x, y); }
+
+  /**
+  * @brief     unchecked access to the cell distance for loops over the
+  *            histogram
+  * @param[in] x, elevation angle index in [0, e_dim)
+  * @param[in] y, azimuth angle index in [0, z_dim)
+  **/
+  inline float& dist(int x, int y) { return dist_(x, y); }
+  inline float dist(int x, int y) const { return dist_(x, y); }
+
+  /**
+  * @brief     unchecked access to the z_dim contiguous cells of an elevation
+  *            row for loops over the azimuth
+  * @param[in] x, elevation angle index in [0, e_dim)
+  **/
+  inline int* age_row(int x) { return age_.data() + x * z_dim; }
+  inline const int* age_row(int x) const { return age_.data() + x * z_dim; }
+  inline float* dist_row(int x) { return dist_.data() + x * z_dim; }
+  inline const float* dist_row(int x) const {
+    return dist_.data() + x * z_dim;
+  }
+
+  /**
+  * @brief     checks if a cell is part of a block at 2 * Res resolution
+  * @param[in] x, elevation angle index in [0, e_dim)
+  * @param[in] y, azimuth angle index in [0, z_dim)
+  **/
+  inline bool isCoarse(int x, int y) const {
+    return coarse_[(x / 2) * block_z_dim + y / 2];
+  }
+
+  /**
+  * @brief     marks the block of cells (2 * x, 2 * y) to (2 * x + 1, 2 * y + 1)
+  *            as coarse or fine, the cells are left unchanged
+  * @param[in] x, elevation index of the block in [0, block_e_dim)
+  * @param[in] y, azimuth index of the block in [0, block_z_dim)
+  **/
+  inline void setCoarse(int x, int y, bool value) {
+    coarse_[x * block_z_dim + y] = value;
+  }
+
+  /**
+  * @brief     true if any block is coarse
+  **/
+  inline bool hasCoarseCells() const { return coarse_.any(); }
+
   /**
   * @brief     Compute the upsampled version of the histogram
-  * @param[in] This object. Needs to be a histogram the larger bin size
-  *(ALPHA_RES * 2)
-  * @details   The histogram is upsampled to get the same histogram at regular
-  *bin size (ALPHA_RES).
+  * @details   The histogram is upsampled to get the same histogram at half the
+  *bin size (Res / 2).
   *            This means the histogram matrix will be double the size in each
   *dimension
-  * @returns   Modifies the object it is called from to have regular resolution
-  * @warning   Can only be called from a large bin size histogram
+  * @returns   histogram with Res / 2 resolution
   **/
-  void upsample();
+  Histogram<Res / 2> upsample() const;
 
   /**
   * @brief     Compute the downsampled version of the histogram
-  * @param[in] this object. Needs to be a histogram with regular bin size
-  *(ALPHA_RES)
-  * @details   The histogram is downsampled to get the same histogram at larger
-  *bin size (ALPHA_RES/2).
+  * @details   The histogram is downsampled to get the same histogram at
+  *double bin size (2 * Res).
   *            This means the histogram matrix will be half the size in each
   *dimension
-  * @returns   Modifies the object it is called from to have larger bins
-  * @warning   Can only be called from a regular bin size histogram
+  * @returns   histogram with 2 * Res resolution
+  **/
+  Histogram<2 * Res> downsample() const;
+
+  /**
+  * @brief     resets all histogram cells age and distance to zero and marks
+  *            all of them fine
   **/
-  void downsample();
+  inline void setZero() {
+    age_.setZero();
+    dist_.setZero();
+    coarse_.reset();
+  }
+
+ private:
+  AgeMatrix age_;
+  DistMatrix dist_;
+  std::bitset<block_e_dim * block_z_dim> coarse_;
 
   /**
-  * @brief     resets all histogram cells age and distance to zero
+  * @brief     wraps elevation and azimuth indeces around the histogram
+  * @param     x, elevation angle index
+  * @param     y, azimuth angle index
+  * @details   the dimensions are compile time constants and in-range indices
+  *            skip the modulo entirely
   **/
-  void setZero();
+  static inline void wrapIndex(int& x, int& y) {
+    if (static_cast<unsigned>(x) >= static_cast<unsigned>(e_dim)) {
+      x = x % e_dim;
+      if (x < 0) x += e_dim;
+    }
+    if (static_cast<unsigned>(y) >= static_cast<unsigned>(z_dim)) {
+      y = y % z_dim;
+      if (y < 0) y += z_dim;
+    }
+  }
 };
+
+template <int Res>
+Histogram<Res / 2> Histogram<Res>::upsample() const {
+  static_assert(Res % 2 == 0, "Cannot upsample an odd resolution histogram");
+  Histogram<Res / 2> high_res;
+  for (int i = 0; i < 2 * e_dim; ++i) {
+    for (int j = 0; j < 2 * z_dim; ++j) {
+      high_res.age(i, j) = age_(i / 2, j / 2);
+      high_res.dist(i, j) = dist_(i / 2, j / 2);
+    }
+  }
+  return high_res;
+}
+
+template <int Res>
+Histogram<2 * Res> Histogram<Res>::downsample() const {
+  static_assert(180 % (2 * Res) == 0,
+                "Cannot downsample to an invalid resolution");
+  Histogram<2 * Res> low_res;
+  for (int i = 0; i < e_dim / 2; ++i) {
+    for (int j = 0; j < z_dim / 2; ++j) {
+      low_res.age(i, j) =
+          static_cast<int>(age_.template block<2, 2>(2 * i, 2 * j).mean());
+      low_res.dist(i, j) = dist_.template block<2, 2>(2 * i, 2 * j).mean();
+    }
+  }
+  return low_res;
+}
+
+template <int Res>
+const int Histogram<Res>::resolution;
+template <int Res>
+const int Histogram<Res>::z_dim;
+template <int Res>
+const int Histogram<Res>::e_dim;
+template <int Res>
+const int Histogram<Res>::block_z_dim;
+template <int Res>
+const int Histogram<Res>::block_e_dim;
+template <int Res>
+const bool Histogram<Res>::is_dynamic;
+template <int Res>
+const int Histogram<Res>::rows;
+template <int Res>
+const int Histogram<Res>::cols;
 }
 
 #endif  // HISTOGRAM_H
@@ -0,0 +1,75 @@
+#ifndef HISTOGRAM_BATCH_H
+#define HISTOGRAM_BATCH_H
+
+#include "histogram.h"
+#include "planner_functions.h"
+#include "voxel_index.h"
+
+#include <Eigen/Dense>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace avoidance {
+
+struct DeviceHistogramBuffers;
+
+/**
+* @brief frees the device buffers, see device_histogram.h
+**/
+struct DeviceHistogramDeleter {
+  void operator()(DeviceHistogramBuffers* buffers) const;
+};
+
+/**
+* @brief builds the current frame histograms of several tree node origins from
+*        the same voxels in one call
+* @details with the LOCAL_PLANNER_CUDA build option the voxels are uploaded to
+*          the GPU once per frame and the histograms of a whole expansion batch
+*          are binned in a single kernel launch. Without the option, or if no
+*          device is found at runtime, the histograms are computed on the CPU
+*          with generateNewHistogram.
+**/
+class HistogramBatch {
+ public:
+  HistogramBatch();
+  ~HistogramBatch() = default;
+  HistogramBatch(const HistogramBatch&) = delete;
+  HistogramBatch& operator=(const HistogramBatch&) = delete;
+
+  /**
+  * @brief     checks if the histograms are computed on the GPU
+  **/
+  bool onDevice() const { return device_ != nullptr; }
+
+  /**
+  * @brief     sets the voxels of the current frame, on the GPU they are
+  *            copied to device memory and stay there until the next call
+  * @param[in] voxels, voxel index of the cropped cloud, must outlive the
+  *            following calls to build() on the CPU
+  **/
+  void setVoxels(const VoxelIndex& voxels);
+
+  /**
+  * @brief      calculates the histograms of the current frame voxels around
+  *             each origin, like generateNewHistogram
+  * @param[in]  origins, centers of the histograms
+  * @param[out] histograms, one per origin, the ages are not touched
+  * @details    the distances agree with the CPU up to the rounding of the
+  *             summation order, as the device adds the points of a bin up in
+  *             an arbitrary order
+  **/
+  void build(const std::vector<Eigen::Vector3f>& origins,
+             const std::vector<Histogram<ALPHA_RES>*>& histograms);
+
+ private:
+  const VoxelIndex* voxels_ = nullptr;
+  HistogramWorkspace workspace_;
+  std::unique_ptr<DeviceHistogramBuffers, DeviceHistogramDeleter> device_;
+  std::vector<float> origin_buffer_;
+  std::vector<float> dist_buffer_;
+};
+}
+
+#endif  // HISTOGRAM_BATCH_H
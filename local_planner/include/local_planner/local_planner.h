@@ -6,7 +6,14 @@
 #include "box.h"
 #include "candidate_direction.h"
 #include "cost_parameters.h"
+#include "depth_image.h"
+#include "flight_recorder.h"
 #include "histogram.h"
+#include "obstacle_memory.h"
+#include "planner_functions.h"
+#include "planner_snapshot.h"
+#include "thread_pool.h"
+#include "voxel_index.h"
 
 #include <dynamic_reconfigure/server.h>
 #include <local_planner/LocalPlannerNodeConfig.h>
@@ -18,6 +25,7 @@
 
 #include <tf/transform_listener.h>
 
+#include <sensor_msgs/Image.h>
 #include <sensor_msgs/LaserScan.h>
 #include <sensor_msgs/PointCloud2.h>
 
@@ -26,7 +34,9 @@
 
 #include <ros/time.h>
 #include <deque>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace avoidance {
@@ -48,13 +58,13 @@ class LocalPlanner {
   bool back_off_ = false;
   bool hist_is_empty_ = false;
 
-  int e_FOV_max_, e_FOV_min_;
   size_t dist_incline_window_size_ = 50;
   int origin_;
   int tree_age_ = 0;
   int children_per_node_;
   int n_expanded_nodes_;
   int reproj_age_;
+  int memory_confidence_decay_;
   int counter_close_points_backoff_ = 0;
 
   float curr_yaw_fcu_frame_;
@@ -73,23 +83,41 @@ class LocalPlanner {
   float costmap_direction_e_;
   float costmap_direction_z_;
   float smoothing_margin_degrees_ = 30.f;
+  float tree_voxel_size_ = 0.1f;
+  float cloud_voxel_size_ = 0.f;
+  int max_cloud_points_ = 0;
+  int depth_image_stride_ = 2;
+  bool lazy_cost_matrix_ = true;
+  bool adaptive_resolution_ = false;
+  float fine_resolution_distance_ = 4.f;
+  float fine_resolution_sector_ = 30.f;
 
   waypoint_choice waypoint_type_;
   ros::Time last_path_time_;
 
   std::vector<int> e_FOV_idx_;
-  std::vector<int> z_FOV_idx_;
+  FOV fov_;
   std::deque<float> goal_dist_incline_;
   std::vector<float> cost_path_candidates_;
   std::vector<int> cost_idx_sorted_;
   std::vector<int> closed_set_;
-  std::vector<int> reprojected_points_age_;
 
   std::vector<TreeNode> tree_;
   std::unique_ptr<StarPlanner> star_planner_;
   costParameters cost_params_;
 
-  pcl::PointCloud<pcl::PointXYZ> reprojected_points_, final_cloud_;
+  pcl::PointCloud<pcl::PointXYZ> final_cloud_;
+  pcl::PointCloud<pcl::PointXYZ> obstacle_distance_cloud_;  // scratch
+  VoxelIndex final_cloud_voxels_;
+  DownsampleWorkspace downsample_workspace_;
+  pcl::PointCloud<pcl::PointXYZ> recorded_cloud_;
+  DownsampleWorkspace recorded_workspace_;
+  ObstacleMemory obstacle_memory_;
+  HistogramWorkspace propagation_workspace_;
+  // one worker per camera besides the planner thread, null for one camera
+  std::shared_ptr<ThreadPool> histogram_pool_;
+  bool shared_pool_ = false;
+  std::vector<HistogramWorkspace> histogram_workspaces_;
 
   Eigen::Vector3f position_ = Eigen::Vector3f::Zero();
   Eigen::Vector3f velocity_ = Eigen::Vector3f::Zero();
@@ -99,17 +127,12 @@ class LocalPlanner {
   Eigen::Vector3f position_old_ = Eigen::Vector3f::Zero();
   Eigen::Vector3f closest_point_ = Eigen::Vector3f::Zero();
 
-  Histogram polar_histogram_ = Histogram(ALPHA_RES);
-  Histogram to_fcu_histogram_ = Histogram(ALPHA_RES);
+  Histogram<ALPHA_RES> polar_histogram_;
+  Histogram<ALPHA_RES> to_fcu_histogram_;
   Eigen::MatrixXf cost_matrix_;
+  CostMatrixWorkspace cost_workspace_;
   std::vector<candidateDirection> candidate_vector_;
 
-  /**
-  * @brief     reprojectes the histogram from the previous algorithm iteration
-  *around the current vehicle position
-  * @param     histogram, histogram from the previous algorith iteration
-  **/
-  void reprojectPoints(Histogram histogram);
   /**
   * @brief     calculates the cost function weights to fly around or over
   *obstacles based on the progress towards the goal over time
@@ -121,8 +144,11 @@ class LocalPlanner {
   void stopInFrontObstacles();
   /**
   * @brief     fills message to send histogram to the FCU
+  * @param[in] hist, histogram compressed in elevation
+  * @param[in] fov, the azimuth cells outside of it are unknown
   **/
-  void updateObstacleDistanceMsg(Histogram hist);
+  void updateObstacleDistanceMsg(const Histogram<ALPHA_RES>& hist,
+                                 const FOV& fov);
   /**
   * @brief      fills message to send empty histogram to the FCU
   **/
@@ -133,11 +159,29 @@ class LocalPlanner {
   **/
   void create2DObstacleRepresentation(const bool send_to_fcu);
   /**
+  * @brief      number of cameras of the current clouds or depth images
+  **/
+  size_t numCameras() const;
+  /**
+  * @brief      computes the FOV and filters and downsamples the camera clouds
+  * @param[out] cloud, filtered and downsampled cloud
+  * @param[out] fov, field of view of the cameras
+  * @param[out] box, histogram box around the current position
+  * @param[out] closest_point, closest point to the vehicle in the cloud
+  * @param[out] distance_to_closest_point, distance of the closest point
+  * @param[in, out] counter_close_points_backoff, frames in a row with points
+  *             closer than min_dist_backoff_
+  **/
+  void preparePointCloud(pcl::PointCloud<pcl::PointXYZ>& cloud, FOV& fov,
+                         Box& box, Eigen::Vector3f& closest_point,
+                         float& distance_to_closest_point,
+                         int& counter_close_points_backoff);
+  /**
   * @brief     generates an image represention of the polar histogram
   * @param     histogram, polar histogram representing obstacles
   * @returns   histogram image
   **/
-  void generateHistogramImage(Histogram &histogram);
+  void generateHistogramImage(const Histogram<ALPHA_RES>& histogram);
 
  public:
   float h_FOV_ = 59.0f;
@@ -153,6 +197,11 @@ class LocalPlanner {
   bool send_obstacles_fcu_ = false;
   bool stop_in_front_active_ = false;
   bool disable_rise_to_goal_altitude_ = false;
+  // if false the cost matrix is only built where needed to find the best
+  // directions and cost_image_data_ is left empty
+  bool generate_cost_image_ = true;
+  // if false histogram_image_data_ is left empty
+  bool generate_histogram_image_ = true;
 
   double timeout_critical_;
   double timeout_termination_;
@@ -166,6 +215,19 @@ class LocalPlanner {
 
   // complete_cloud_ contains n complete clouds from the cameras
   std::vector<pcl::PointCloud<pcl::PointXYZ>> complete_cloud_;
+  // raw messages from the cameras and their transform to local_origin, if
+  // set they are filtered in a single pass instead of complete_cloud_
+  std::vector<sensor_msgs::PointCloud2::ConstPtr> complete_cloud_msgs_;
+  std::vector<Eigen::Affine3f, Eigen::aligned_allocator<Eigen::Affine3f>>
+      complete_cloud_transforms_;
+  // depth images of the cameras and the rays of their pixels, if set they
+  // are used instead of complete_cloud_msgs_ with the same transforms
+  std::vector<sensor_msgs::Image::ConstPtr> complete_depth_images_;
+  std::vector<std::shared_ptr<const DepthRays>> complete_depth_rays_;
+  // Field of View of each camera of complete_cloud_msgs_, the FOV is the
+  // union of their frusta once they are known instead of h_FOV_ and v_FOV_
+  // around the vehicle heading
+  std::vector<CameraFOV> camera_FOVs_;
 
   LocalPlanner();
   ~LocalPlanner();
@@ -206,11 +268,14 @@ class LocalPlanner {
   /**
   * @brief     getter method to visualize pointcloud in rviz
   * @param     final_cloud, filtered pointcloud from the current camera frame
-  * @param     reprojected_points, pointcloud saved from previous frames
+  * @param     reprojected_points, obstacles saved from previous frames
+  * @param[in] get_reprojected_points, if false the obstacle memory is not
+  *            converted to a pointcloud and reprojected_points is left empty
   **/
   void getCloudsForVisualization(
       pcl::PointCloud<pcl::PointXYZ> &final_cloud,
-      pcl::PointCloud<pcl::PointXYZ> &reprojected_points);
+      pcl::PointCloud<pcl::PointXYZ> &reprojected_points,
+      bool get_reprojected_points);
   /**
   * @brief     setter method for vehicle velocity
   * @param[in]     vel, velocity message coming from the FCU
@@ -219,10 +284,11 @@ class LocalPlanner {
 
   /**
   * @brief     getter method to visualize the tree in rviz
-  * @param[in]     closed_set, velocity message coming from the FCU
-  * @param[in]     path_node_positions, velocity message coming from the FCU
+  * @param[out]    tree_edges, start and end position of the edge to every
+  *                expanded node, the tree itself is not copied
+  * @param[out]    path_node_positions, nodes of the chosen path
   **/
-  void getTree(std::vector<TreeNode> &tree, std::vector<int> &closed_set,
+  void getTree(std::vector<Eigen::Vector3f> &tree_edges,
                std::vector<Eigen::Vector3f> &path_node_positions);
   /**
   * @brief     setter method to send obstacle distance information to FCU
@@ -245,6 +311,47 @@ class LocalPlanner {
   * @brief     starts a iteration of the local planner algorithm
   **/
   void runPlanner();
+  /**
+  * @brief     updates only the obstacle distance message to the FCU from the
+  *            current clouds and the obstacle memory, without planning. Only
+  *            the message and the histogram sent to the FCU are changed, the
+  *            cloud, FOV, box, memory and back off state of the last planner
+  *            iteration are kept
+  **/
+  void runObstacleDistance();
+
+  /**
+  * @brief      copies the state of the planner needed for a warm restart
+  * @param[out] snapshot, obstacle memory, goal and take off state, the stamp
+  *             is left to the caller
+  **/
+  void getSnapshot(PlannerSnapshot &snapshot) const;
+  /**
+  * @brief      restores the state of a snapshot taken before a restart, the
+  *             histogram and the tree are built from it by the next iteration
+  * @param[in]  snapshot, state of the planner
+  **/
+  void restoreSnapshot(const PlannerSnapshot &snapshot);
+
+  /**
+  * @brief      writes the inputs and decisions of the last iteration to the
+  *             flight recorder, the candidates and the cloud are copied from
+  *             the planner straight into the recording. A cloud which does
+  *             not fit into a frame is downsampled to the points that do,
+  *             keeping the closest point of every occupied histogram bin
+  * @param[in]  recorder, open flight recorder
+  * @param[in,out] frame, buffer of the other fields which is reused, the
+  *             stamp and the stage timings are set by the caller
+  * @returns    true, if the frame was written
+  **/
+  bool writeFlightFrame(FlightRecorder &recorder, FlightFrame &frame);
+
+  /**
+  * @brief      runs the parallel stages on a pool shared with other planners
+  *             in the same process instead of pools of their own
+  * @param[in]  pool, shared workers, null to use own pools again
+  **/
+  void setThreadPool(const std::shared_ptr<ThreadPool> &pool);
 };
 }
 
@@ -2,12 +2,21 @@
 #define LOCAL_PLANNER_LOCAL_PLANNER_NODE_H
 
 #include "local_planner/avoidance_output.h"
+#include "local_planner/flight_recorder.h"
+#include "local_planner/planner_data.h"
+#include "local_planner/planner_snapshot.h"
+#include "local_planner/planning_trigger.h"
+#include "local_planner/pose_buffer.h"
+#include "local_planner/realtime.h"
+#include "local_planner/stage_timer.h"
+#include "local_planner/triple_buffer.h"
 
 #ifndef DISABLE_SIMULATION
 // include simulation
 #include "local_planner/rviz_world_loader.h"
 #endif
 
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <geometry_msgs/Point.h>
 #include <geometry_msgs/PoseArray.h>
 #include <geometry_msgs/TransformStamped.h>
@@ -24,24 +33,31 @@
 #include <pcl_conversions/pcl_conversions.h>  // fromROSMsg
 #include <pcl_ros/point_cloud.h>
 #include <pcl_ros/transforms.h>  // transformPointCloud
+#include <ros/callback_queue.h>
 #include <ros/ros.h>
 #include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/LaserScan.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <sensor_msgs/Range.h>
 #include <std_msgs/Bool.h>
 #include <std_msgs/Float64.h>
+#include <std_msgs/Header.h>
 #include <std_msgs/String.h>
 #include <tf/transform_listener.h>
 #include <visualization_msgs/Marker.h>
 #include <visualization_msgs/MarkerArray.h>
 #include <Eigen/Core>
+#include <Eigen/Geometry>
 #include <boost/bind.hpp>
 
 #include <dynamic_reconfigure/server.h>
 #include <local_planner/LocalPlannerNodeConfig.h>
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -49,14 +65,37 @@
 namespace avoidance {
 
 class LocalPlanner;
+class ThreadPool;
 class WaypointGenerator;
 
 struct cameraData {
   std::string topic_;
   ros::Subscriber pointcloud_sub_;
+  ros::Subscriber depth_image_sub_;
   ros::Subscriber camera_info_sub_;
-  sensor_msgs::PointCloud2 newest_cloud_msg_;
-  bool received_;
+  // latest-wins slot, a new cloud replaces the previous one even if it has
+  // not been planned on yet
+  sensor_msgs::PointCloud2::ConstPtr newest_cloud_msg_;
+  // the same for a camera which sends depth images instead of clouds
+  sensor_msgs::Image::ConstPtr newest_depth_msg_;
+  // pixel rays of the depth images, replaced when the intrinsics change
+  std::shared_ptr<const DepthRays> depth_rays_;
+  ros::Time receive_time_;  // time the newest cloud arrived
+  bool received_;           // true if the cloud arrived after the last plan
+  CameraFOV fov_;           // from the camera info
+  // static transform from the camera to the body frame, looked up once
+  UnalignedAffine3f extrinsics_;
+  bool has_extrinsics_ = false;
+
+  /**
+  * @brief     header of the newest cloud or depth image, null if none has
+  *            arrived yet
+  **/
+  const std_msgs::Header* newestHeader() const {
+    if (newest_depth_msg_) return &newest_depth_msg_->header;
+    if (newest_cloud_msg_) return &newest_cloud_msg_->header;
+    return nullptr;
+  }
 };
 
 /**
@@ -103,6 +142,33 @@ enum class MAV_STATE {
 class LocalPlannerNode {
  public:
   LocalPlannerNode(const bool tf_spin_thread = true);
+
+  /**
+  * @brief     constructs the node on a given private node handle, all
+  *            subscriptions are served by the callback queue of that handle
+  * @param[in] nh, private node handle the parameters are read from
+  * @param[in] tf_spin_thread, true if the transform listener should use its
+  *            own spinner thread
+  **/
+  LocalPlannerNode(const ros::NodeHandle& nh, const bool tf_spin_thread = true);
+
+  /**
+  * @brief     constructs one of several nodes hosted in the same process
+  * @param[in] nh, private node handle the parameters are read from
+  * @param[in] topic_nh, node handle the topics are resolved in, it has to
+  *            use the callback queue of nh
+  * @param[in] tf_listener, transform listener shared with the other nodes,
+  *            null for an own one
+  * @param[in] pool, workers shared with the other nodes which run the
+  *            planner and visualization iterations instead of threads of
+  *            the node, see start(), null for own pools and threads
+  * @param[in] tf_spin_thread, true if an own transform listener should use
+  *            its own spinner thread
+  **/
+  LocalPlannerNode(const ros::NodeHandle& nh, const ros::NodeHandle& topic_nh,
+                   tf::TransformListener* tf_listener,
+                   const std::shared_ptr<ThreadPool>& pool,
+                   const bool tf_spin_thread = true);
   ~LocalPlannerNode();
 
   mavros_msgs::CompanionProcessStatus status_msg_;
@@ -116,13 +182,13 @@ class LocalPlannerNode {
   std::atomic<bool> should_exit_{false};
 
   std::vector<cameraData> cameras_;
+  bool depth_image_input_ = false;  // the cameras send depth images
 
   ModelParameters model_params_;
 
   ros::CallbackQueue pointcloud_queue_;
   ros::CallbackQueue main_queue_;
 
-  std::vector<Eigen::Vector3f> path_node_positions_;
   geometry_msgs::PoseStamped hover_point_;
   geometry_msgs::PoseStamped newest_pose_;
   geometry_msgs::PoseStamped last_pose_;
@@ -134,9 +200,11 @@ class LocalPlannerNode {
 
   ros::Time last_wp_time_;
   ros::Time t_status_sent_;
+  ros::Time t_timing_sent_;
 
   std::unique_ptr<LocalPlanner> local_planner_;
   std::unique_ptr<WaypointGenerator> wp_generator_;
+  std::shared_ptr<ThreadPool> cloud_pool_;
 
   ros::Publisher world_pub_;
   ros::Publisher drone_pub_;
@@ -149,14 +217,22 @@ class LocalPlannerNode {
   ros::ServiceClient mavros_set_mode_client_;
   ros::ServiceClient get_px4_param_client_;
   ros::Publisher mavros_system_status_pub_;
-  tf::TransformListener* tf_listener_;
+  tf::TransformListener* tf_listener_;  ///< own or shared with other nodes
 
-  std::mutex running_mutex_;  ///< guard against concurrent access to input &
-                              /// output data (point cloud, position, ...)
+  std::mutex running_mutex_;  ///< guard against concurrent access to the
+                              /// planner parameters while it is running
+
+  TripleBuffer<plannerInput> planner_input_;    ///< main loop -> planner
+  TripleBuffer<plannerOutput> planner_output_;  ///< planner -> main loop
 
   std::mutex data_ready_mutex_;
   std::condition_variable data_ready_cv_;
 
+  TripleBuffer<plannerVisualization>
+      planner_visualization_;  ///< planner -> visualization thread
+  std::mutex visualization_ready_mutex_;
+  std::condition_variable visualization_ready_cv_;
+
   /**
   * @brief     publishes velocity setpoint for visualization in Rviz
   * @param[in] wp, velocity setpoint
@@ -165,11 +241,136 @@ class LocalPlannerNode {
   void publishSetpoint(const geometry_msgs::Twist& wp,
                        waypoint_choice& waypoint_type);
 
+  /**
+  * @brief     runs the main loop of the node until ROS shuts down or
+  *            should_exit_ is set, starting and joining the planner and
+  *            visualization threads
+  * @param     callback_queue, queue the subscriptions of the node handle are
+  *            served from
+  **/
+  void run(ros::CallbackQueue& callback_queue);
+
+  /**
+  * @brief     waits for the inputs of the node, see waitUntilReady, and
+  *            starts the planner and visualization threads unless the node
+  *            is hosted on a shared pool
+  * @param     callback_queue, queue the subscriptions of the node handle are
+  *            served from
+  **/
+  void start(ros::CallbackQueue& callback_queue);
+
+  /**
+  * @brief     non-blocking counterpart of start() for a host which starts
+  *            several nodes on one thread: serves the callbacks which are
+  *            ready and starts the node once its inputs are available or
+  *            startup_timeout_ has passed since the first call
+  * @param     callback_queue, queue the subscriptions of the node handle are
+  *            served from
+  * @returns   true, if the node was started
+  **/
+  bool startOnce(ros::CallbackQueue& callback_queue);
+
+  /**
+  * @brief     serves the callbacks which are ready and runs an iteration of
+  *            the main loop if a setpoint is due, without blocking. Used by
+  *            a host which schedules several nodes on one thread
+  * @param     callback_queue, queue the subscriptions of the node handle are
+  *            served from
+  * @returns   true, if an iteration was run
+  **/
+  bool spinOnce(ros::CallbackQueue& callback_queue);
+
+  /**
+  * @brief     stops the node and waits for its threads or pool tasks
+  **/
+  void stop();
+
   /**
   * @brief     handles threads for data publication and subscription
   **/
   void threadFunction();
 
+  /**
+  * @brief     runs the planner on the newest input snapshot, only called
+  *            from the planner thread or the planner task
+  **/
+  void planIteration();
+
+  /**
+  * @brief     iteration of the main loop, sends the setpoint and hands new
+  *            clouds to the planner
+  **/
+  void runIteration();
+
+  /**
+  * @brief     serves the callbacks until the next setpoint of the fixed
+  *            setpoint_rate_ is due and a recent pose is available, so the
+  *            waypoint generator runs independently of the pose and planner
+  *            rates
+  * @param     callback_queue, queue the subscriptions of the node handle are
+  *            served from
+  **/
+  void waitForSetpointTime(ros::CallbackQueue& callback_queue);
+
+  /**
+  * @brief     checks if the next setpoint is due and a recent pose is
+  *            available
+  * @param[in] now, current time
+  **/
+  bool setpointDue(const ros::Time& now) const;
+
+  /**
+  * @brief     serves the callbacks until a pose and the vehicle state have
+  *            been received and the transforms of the cameras which sent
+  *            data are available, at most for startup_timeout_
+  * @param     callback_queue, queue the subscriptions of the node handle are
+  *            served from
+  **/
+  void waitUntilReady(ros::CallbackQueue& callback_queue);
+
+  /**
+  * @brief     checks if a pose and the vehicle state have been received and
+  *            the transforms of the cameras which sent data are available
+  **/
+  bool isReady();
+
+  /**
+  * @brief     restores the snapshot and starts the planner and visualization
+  *            threads unless the node is hosted on a shared pool
+  **/
+  void startPlanning();
+
+  /**
+  * @brief     restores the planner state of the snapshot file if it is newer
+  *            than snapshot_max_age_
+  **/
+  void restoreSnapshot();
+
+  /**
+  * @brief     writes the planner state to the snapshot file, only called from
+  *            the planner thread while it holds running_mutex_
+  **/
+  void writeSnapshot();
+
+  /**
+  * @brief     writes the last iteration to the flight recorder, only called
+  *            from the planner thread while it holds running_mutex_
+  * @param[in] planner_ms, time spent in the running iteration [ms]
+  **/
+  void writeFlightFrame(double planner_ms);
+
+  /**
+  * @brief     builds and publishes the Rviz visualization of the planner
+  *            iterations at low priority, it only works on the snapshots of
+  *            planner_visualization_ and never locks running_mutex_
+  **/
+  void visualizationThreadFunction();
+
+  /**
+  * @brief     publishes the newest visualization snapshot, if there is one
+  **/
+  void publishVisualization();
+
   void updatePlanner();
 
   /**
@@ -180,12 +381,64 @@ class LocalPlannerNode {
   bool canUpdatePlannerInfo();
 
   /**
-  * @brief     updates the local planner agorithm with the latest pointcloud,
-  *            vehicle position, velocity, state, and distance to ground, goal,
-  *setpoint sent to the FCU
+  * @brief      transform from the frame of the newest cloud of a camera to
+  *             local_origin at the time the cloud was taken
+  * @details    with cache_extrinsics_ it is composed of the static camera
+  *             extrinsics, looked up once, and the vehicle pose from
+  *             pose_buffer_, otherwise it is looked up in the TF buffer
+  * @param[in]  index, camera index
+  * @param[out] transform, transform of the cloud, may be null to only check
+  *             if it is available
+  * @returns    true, if the transformation is available
+  **/
+  bool cloudTransform(size_t index, Eigen::Affine3f* transform);
+
+  /**
+  * @brief     checks if the latest cloud of a camera is handed to the planner,
+  *            the triggers other than allCameras leave out clouds older than
+  *            max_cloud_age_
+  * @param[in] index, camera index
+  * @param[in] now, current time
+  * @returns   true, if the cloud is used
+  **/
+  bool isCloudUsable(size_t index, const ros::Time& now) const;
+
+  /**
+  * @brief     checks if an obstacle distance update between the planner
+  *            iterations is due, it needs a cloud newer than the last one
+  *            used, obstacle_distance_rate_ to have elapsed and no snapshot
+  *            waiting for the planner
+  * @param[in] now, current time
+  * @returns   true, if the obstacle distance should be updated
+  **/
+  bool obstacleDistanceDue(const ros::Time& now);
+
+  /**
+  * @brief     newest timestamp of the clouds handed to the planner
+  * @param[in] now, current time
+  **/
+  ros::Time newestUsableCloudStamp(const ros::Time& now) const;
+
+  /**
+  * @brief     prepares the newest pointcloud of each camera for the planner on
+  *            the cloud thread pool, writing into the planner input snapshot
+  **/
+  void stageCameraClouds();
+
+  /**
+  * @brief     publishes a snapshot of the latest pointcloud, vehicle position,
+  *            velocity, state, and distance to ground, goal, setpoint sent to
+  *the FCU for the planner thread
   **/
   void updatePlannerInfo();
 
+  /**
+  * @brief     updates the local planner agorithm with an input snapshot, only
+  *            called from the planner thread
+  * @param     input, snapshot, its buffers are swapped with the planner ones
+  **/
+  void applyPlannerInput(plannerInput& input);
+
   /**
   * @brief     computes the number of available pointclouds
   * @ returns  number of pointclouds
@@ -222,6 +475,13 @@ class LocalPlannerNode {
   void publishWaypoints(bool hover);
   void publishSystemStatus();
 
+  /**
+  * @brief     publishes p50, p99 and max latency of every planner stage and
+  *the age of the latest cloud of every camera on the diagnostics topic and
+  *appends the collected events to the stage trace
+  **/
+  void publishStageTimings();
+
   /**
   * @brief     check healthiness of the avoidance system to trigger failsafe in
   *the FCU
@@ -235,9 +495,29 @@ class LocalPlannerNode {
                      bool& planner_is_healthy, bool& hover);
 
   const ros::NodeHandle& nodeHandle() const { return nh_; }
+  StageTimings& stageTimings() { return stage_timings_; }
 
  private:
   ros::NodeHandle nh_;
+  ros::NodeHandle topic_nh_;
+  std::unique_ptr<tf::TransformListener> own_tf_listener_;
+
+  // hosted nodes run the planner and visualization iterations as tasks on
+  // the shared pool, at most one of each is queued or running at a time
+  bool hosted_ = false;
+  bool planner_task_active_ = false;        ///< guarded by data_ready_mutex_
+  bool visualization_task_active_ = false;  ///< by visualization_ready_mutex_
+  std::thread worker_;
+  std::thread visualizer_;
+
+  // state of the main loop kept between the iterations
+  ros::Time start_time_;
+  bool planner_is_healthy_ = true;
+  bool startup_ = true;
+
+  // stage timings of this node, selected on its threads and pool tasks
+  StageTimings stage_timings_;
+  std::string diagnostics_name_;
   avoidance::LocalPlannerNodeConfig rqt_param_config_;
 
   mavros_msgs::Altitude ground_distance_msg_;
@@ -276,12 +556,70 @@ class LocalPlannerNode {
   ros::Publisher smoothed_wp_pub_;
   ros::Publisher histogram_image_pub_;
   ros::Publisher cost_image_pub_;
+  ros::Publisher latency_pub_;
+  ros::Publisher stage_timing_pub_;
+
+  ChromeTraceWriter stage_trace_writer_;
+  std::vector<TraceEvent> trace_events_;
 
   std::vector<float> algo_time;
 
   geometry_msgs::TwistStamped vel_msg_;
   bool armed_, offboard_, mission_, new_goal_;
   bool data_ready_ = false;
+  bool visualization_ready_ = false;
+  uint32_t goal_seq_ = 0;          // sequence of the goal sent to the planner
+  uint32_t applied_goal_seq_ = 0;  // sequence of the goal set in the planner
+  ros::Time planned_cloud_stamp_;  // cloud stamp of the current planner output
+
+  PlanningTrigger planning_trigger_ = PlanningTrigger::allCameras;
+  double planning_rate_ = 10.0;   // rate of the fixedRate trigger [Hz]
+  double max_cloud_age_ = 0.5;    // oldest cloud the planner may reuse [s]
+  ros::Time last_plan_time_;      // time the last snapshot was handed over
+  double setpoint_rate_ = 50.0;   // rate of the setpoints, 0 is per pose [Hz]
+  // obstacle distance sent to the FCU between the planner iterations
+  double obstacle_distance_rate_ = 30.0;  // 0 sends it with the plan only [Hz]
+  ros::Time last_obstacle_distance_time_;    // time the last one was due
+  ros::Time obstacle_distance_cloud_stamp_;  // newest cloud it was built from
+  sensor_msgs::LaserScan obstacle_distance_msg_;  // storage kept between msgs
+  ros::Time next_setpoint_time_;  // time the next setpoint is due
+  ros::Time last_pose_time_;      // time the newest pose was received
+  bool pose_is_fresh_ = false;    // the due setpoint has a recent pose
+  bool state_received_ = false;   // a vehicle state has been received
+
+  // vehicle poses for the transforms of the clouds, see cloudTransform
+  PoseBuffer pose_buffer_;
+  bool cache_extrinsics_ = true;
+  std::string body_frame_ = "fcu";  // frame of the vehicle pose
+  std::string world_frame_ = "/local_origin";  // frame the plan is made in
+
+  // snapshot of the planner state for a warm restart of the node
+  SnapshotFile snapshot_file_;
+  PlannerSnapshot snapshot_;         // storage kept between snapshots
+  double snapshot_period_ = 1.0;     // time between snapshots [s]
+  double snapshot_max_age_ = 10.0;   // older snapshots are not restored [s]
+  double startup_timeout_ = 2.0;     // longest wait for the inputs [s]
+  ros::WallTime startup_deadline_;   // end of the wait of startOnce()
+  ros::Time last_snapshot_time_;     // time the last snapshot was written
+
+  // ring of the latest planner iterations for the replay harness
+  FlightRecorder flight_recorder_;
+  FlightFrame flight_frame_;  // storage kept between frames
+  // stage totals at the last frame, a frame gets the time since then
+  std::array<double, static_cast<size_t>(PlannerStage::count)>
+      recorded_stage_ms_{};
+
+  // real time profile of the planner and ingest threads, see realtime.h
+  bool realtime_profile_ = false;
+  ThreadProfile planner_profile_;
+  ThreadProfile ingest_profile_;
+  bool lock_memory_ = true;
+  int realtime_warmup_ = 20;  // planner iterations before locking the memory
+  // deadline overruns per stage at the last diagnostics and status message
+  std::array<size_t, static_cast<size_t>(PlannerStage::count)>
+      reported_overruns_{};
+  std::array<size_t, static_cast<size_t>(PlannerStage::count)>
+      status_overruns_{};
 
   dynamic_reconfigure::Server<avoidance::LocalPlannerNodeConfig>* server_;
   boost::recursive_mutex config_mutex_;
@@ -297,8 +635,11 @@ class LocalPlannerNode {
   /**
   * @brief     subscribes to all the camera topics and camera info
   * @param     camera_topics, array with the pointcloud topics strings
+  * @param     depth_images, true if the topics are depth images instead of
+  *            pointclouds
   **/
-  void initializeCameraSubscribers(std::vector<std::string>& camera_topics);
+  void initializeCameraSubscribers(std::vector<std::string>& camera_topics,
+                                   bool depth_images);
 
   /**
   * @brief     callaback for vehicle position and orientation
@@ -314,6 +655,12 @@ class LocalPlannerNode {
   void pointCloudCallback(const sensor_msgs::PointCloud2::ConstPtr& msg,
                           int index);
   /**
+  * @brief     callaback for depth images, used instead of the pointcloud
+  * @param[in] msg, depth image message in 16UC1 or 32FC1
+  * @param[in] index, camera instance number
+  **/
+  void depthImageCallback(const sensor_msgs::Image::ConstPtr& msg, int index);
+  /**
   * @brief     callaback for camera information
   * @param[in] msg, camera information message
   * @param[in] index, camera info instace number
@@ -342,6 +689,28 @@ class LocalPlannerNode {
   **/
   void publishPlannerData();
   /**
+  * @brief     hands the staged input to the planner thread, or to a planner
+  *            task on the shared pool of a hosted node
+  **/
+  void wakePlanner();
+  /**
+  * @brief     pool tasks of a hosted node which run the planner and
+  *            visualization iterations until no new snapshot is waiting
+  **/
+  void plannerTask();
+  void visualizationTask();
+  /**
+  * @brief     publishes the obstacle distance message of the planner to the
+  *            FCU, the message storage is reused
+  **/
+  void publishObstacleDistance();
+  /**
+  * @brief     copies the planner data needed by the visualization topics
+  *            which have subscribers, called from the planner thread
+  * @param[out] data, snapshot for the visualization thread
+  **/
+  void fillPlannerVisualization(plannerVisualization& data);
+  /**
   * @brief     publishes current and previous setpoints, current and previous
   *vehicle position and flown path for Rviz visualization
   **/
@@ -381,26 +750,31 @@ class LocalPlannerNode {
   void printPointInfo(double x, double y, double z);
   /**
   * @brief     publishes goal position for Rviz visualization
+  * @param[in] data, snapshot of the planner iteration
   **/
-  void publishGoal();
+  void publishGoal(const plannerVisualization& data);
   /**
   * @brief     publishes bounding box that is used to filter the pointcloud for
   *Rviz visualization
+  * @param[in] data, snapshot of the planner iteration
   **/
-  void publishBox();
+  void publishBox(const plannerVisualization& data);
   /**
   * @brief     publishes takeoff position and goal altitude to be reached for
   *Rviz visualization
+  * @param[in] data, snapshot of the planner iteration
   **/
-  void publishReachHeight();
+  void publishReachHeight(const plannerVisualization& data);
   /**
   * @brief     publishes tree for Rviz visualization
+  * @param[in] data, snapshot of the planner iteration
   **/
-  void publishTree();
+  void publishTree(const plannerVisualization& data);
   /**
   * @brief     publishes polar histogram image for Rviz visualization
+  * @param[in] data, snapshot of the planner iteration
   **/
-  void publishDataImages();
+  void publishDataImages(const plannerVisualization& data);
   /**
   * @brief     publishes ground plane visualization for Rviz
   **/
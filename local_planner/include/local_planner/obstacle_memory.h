@@ -0,0 +1,126 @@
+#ifndef OBSTACLE_MEMORY_H
+#define OBSTACLE_MEMORY_H
+
+#include "histogram.h"
+#include "voxel_index.h"
+
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace avoidance {
+
+// log-odds added to the confidence of a voxel each frame it is measured
+const int CONFIDENCE_HIT = 64;
+const int CONFIDENCE_MAX = 255;
+
+/**
+* @brief world frame memory of the obstacles seen in previous frames, stored
+*        as voxel centroids with the number of frames since each voxel was
+*        last seen and a log-odds confidence
+* @details the memory replaces everything inside the current field of view by
+*          the voxels of the current frame and ages the voxels outside of it.
+*          Since the voxels are kept in world frame they only need to be
+*          binned around the new position when the vehicle moves. The buffers
+*          are kept between updates and only grow.
+*          Every frame a voxel is measured raises its confidence, every frame
+*          it ages outside of the field of view lowers it in proportion to its
+*          distance. Voxels seen once far away are forgotten after a few
+*          frames while close obstacles seen repeatedly are kept up to the
+*          maximum age.
+**/
+class ObstacleMemory {
+ public:
+  ObstacleMemory() = default;
+  ~ObstacleMemory() = default;
+
+  /**
+  * @brief     merges the voxels of the current frame into the memory
+  * @param[in] voxels, voxel index of the current frame filtered pointcloud,
+  *            voxels in memory are matched by the voxel size of this index
+  * @param[in] position, current vehicle position
+  * @param[in] fov, histogram cells inside the FOV
+  * @param[in] age_voxels, if false the voxels outside of the FOV keep their age
+  * @param[in] max_age, voxels reaching this age are forgotten
+  * @param[in] max_distance, voxels further away from the vehicle are forgotten
+  * @param[in] confidence_decay, confidence lost per frame by a voxel at
+  *            max_distance outside of the FOV, closer voxels lose less but at
+  *            least one. Voxels without confidence left are forgotten, 0
+  *            forgets voxels by age only
+  **/
+  void update(const VoxelIndex& voxels, const Eigen::Vector3f& position,
+              const FOV& fov, bool age_voxels, int max_age,
+              float max_distance, int confidence_decay);
+
+  /**
+  * @brief     removes all voxels
+  **/
+  void clear();
+
+  /**
+  * @brief     replaces the memory by the given voxels, e.g. of a snapshot
+  *            taken before a restart
+  * @param[in] x, y, z, count, age, confidence, arrays of the same size, see
+  *            the getters
+  **/
+  void assign(const std::vector<float>& x, const std::vector<float>& y,
+              const std::vector<float>& z, const std::vector<int>& count,
+              const std::vector<int>& age,
+              const std::vector<uint8_t>& confidence);
+
+  /**
+  * @brief     getter method for the number of voxels in memory
+  **/
+  size_t size() const { return age_.size(); }
+  bool empty() const { return age_.empty(); }
+
+  /**
+  * @brief     getter methods for the voxel centroids, point counts, ages and
+  *            confidences, all arrays have size() elements
+  **/
+  const std::vector<float>& x() const { return x_; }
+  const std::vector<float>& y() const { return y_; }
+  const std::vector<float>& z() const { return z_; }
+  const std::vector<int>& count() const { return count_; }
+  const std::vector<int>& age() const { return age_; }
+  const std::vector<uint8_t>& confidence() const { return confidence_; }
+
+  /**
+  * @brief     copies the voxel centroids into a pointcloud for visualization
+  * @param[out] cloud, voxel centroids
+  **/
+  void toCloud(pcl::PointCloud<pcl::PointXYZ>& cloud) const;
+
+ private:
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<float> z_;
+  std::vector<int> count_;
+  std::vector<int> age_;
+  std::vector<uint8_t> confidence_;
+  std::vector<uint64_t> keys_;
+
+  // scratch buffers of update
+  std::vector<int> bin_;
+  std::vector<float> dist_;
+  std::vector<int> slots_;
+
+  /**
+  * @brief     truncates the memory to the first n voxels
+  **/
+  void resize(size_t n);
+
+  /**
+  * @brief     appends a voxel to the memory
+  **/
+  void push_back(uint64_t key, float x, float y, float z, int count, int age,
+                 int confidence);
+};
+}
+
+#endif  // OBSTACLE_MEMORY_H
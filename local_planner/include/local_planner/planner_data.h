@@ -0,0 +1,86 @@
+#pragma once
+
+#include "avoidance_output.h"
+#include "planner_functions.h"
+
+#include <geometry_msgs/Point.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/TwistStamped.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <ros/time.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace avoidance {
+
+// snapshot of everything the planner needs for one iteration
+struct plannerInput {
+  // one per camera, shared with the subscriber so the buffers are never copied
+  std::vector<sensor_msgs::PointCloud2::ConstPtr> cloud_msgs;
+  std::vector<Eigen::Affine3f, Eigen::aligned_allocator<Eigen::Affine3f>>
+      cloud_transforms;  // camera frame to local_origin, one per camera
+  // one per camera if the cameras send depth images instead of clouds
+  std::vector<sensor_msgs::Image::ConstPtr> depth_images;
+  std::vector<std::shared_ptr<const DepthRays>> depth_rays;
+  std::vector<CameraFOV> camera_FOVs;  // one per camera
+  ros::Time cloud_stamp;  // oldest timestamp of the clouds
+  bool obstacle_distance_only;  // only the obstacle distance to the FCU is due
+
+  geometry_msgs::PoseStamped pose;
+  geometry_msgs::TwistStamped velocity;
+  bool armed;
+  bool offboard;
+  bool mission;
+
+  geometry_msgs::Point goal;
+  uint32_t goal_seq;  // incremented every time a new goal is set
+
+  float ground_distance;
+  geometry_msgs::Point last_sent_waypoint;
+  geometry_msgs::Point last_adapted_waypoint;  // only drawn in the cost image
+};
+
+// result of one planner iteration
+struct plannerOutput {
+  avoidanceOutput avoidance_output;
+  bool stop_in_front_active;     // true if the planner moved the goal
+  Eigen::Vector3f goal;          // goal used by the planner
+  ros::Time cloud_stamp;         // timestamp of the clouds used
+};
+
+// data of one planner iteration for the Rviz visualization, only the parts
+// which had a subscriber when the iteration finished are filled in
+struct plannerVisualization {
+  Eigen::Vector3f position;
+  Eigen::Vector3f goal;
+  Eigen::Vector3f take_off_pose;
+  double starting_height;
+  float box_radius;
+  float box_zmin;
+
+  bool publish_final_cloud;
+  bool publish_reprojected_points;
+  pcl::PointCloud<pcl::PointXYZ> final_cloud;
+  pcl::PointCloud<pcl::PointXYZ> reprojected_points;
+
+  bool publish_tree;
+  std::vector<Eigen::Vector3f> tree_edges;  // start and end of each edge
+  std::vector<Eigen::Vector3f> path_node_positions;
+
+  bool publish_histogram_image;
+  bool publish_cost_image;
+  std::vector<uint8_t> histogram_image;
+  std::vector<uint8_t> cost_image;
+  // marked in the cost image
+  geometry_msgs::PoseStamped pose;
+  geometry_msgs::Point waypoint;
+  geometry_msgs::Point adapted_waypoint;
+};
+}
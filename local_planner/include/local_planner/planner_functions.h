@@ -5,18 +5,84 @@
 #include "candidate_direction.h"
 #include "common.h"
 #include "cost_parameters.h"
+#include "depth_image.h"
 #include "histogram.h"
+#include "obstacle_memory.h"
+#include "polar_binning.h"
+#include "thread_pool.h"
+#include "voxel_index.h"
 
 #include <Eigen/Dense>
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <memory>
 #include <queue>
+#include <utility>
 #include <vector>
 
 namespace avoidance {
 
+/**
+* @brief scratch buffers of the histogram generation, reusing them between
+*        calls avoids allocating for every histogram
+**/
+struct HistogramWorkspace {
+  PolarBinningBuffer binning;
+  std::vector<int> counter;
+  std::vector<int> age_sum;
+  std::vector<float> dist_sum;
+};
+
+/**
+* @brief scratch buffers of the cost matrix computation and smoothing, reusing
+*        them between calls avoids allocating for every cost matrix
+**/
+struct CostMatrixWorkspace {
+  Eigen::MatrixXf distance_matrix;
+  Eigen::MatrixXf smoothed_columns;
+  Eigen::ArrayXf line;
+  std::vector<double> box_sum;
+  // lazily evaluated goal and smoothness costs, NAN if not computed yet
+  Eigen::MatrixXf other_costs;
+  std::vector<int> step_sizes;
+  std::vector<std::pair<float, int>> sector_bounds;
+  // goal and smoothness costs of the coarse blocks, NAN if not computed yet
+  Eigen::MatrixXf coarse_costs;
+  // one row of the cost matrix, evaluated for all azimuth angles at once
+  Eigen::ArrayXf row_costs;
+  Eigen::ArrayXf row_distance_costs;
+  Eigen::ArrayXf candidate_x;
+  Eigen::ArrayXf candidate_y;
+};
+
+/**
+* @brief scratch buffers of the cloud downsampling, reusing them between calls
+*        avoids allocating for every frame
+**/
+struct DownsampleWorkspace {
+  VoxelIndex voxels;
+  PolarBinningBuffer binning;
+  std::vector<int> closest_in_bin;  // closest point of every bin, -1 if empty
+  std::vector<int> centroid_bins;
+  std::vector<char> bin_covered;
+  pcl::PointCloud<pcl::PointXYZ> candidates;
+  pcl::PointCloud<pcl::PointXYZ> output;
+};
+
+/**
+* @brief horizontal and vertical Field of View of a single camera [deg], zero
+*        while it is unknown
+**/
+struct CameraFOV {
+  float h_FOV = 0.f;
+  float v_FOV = 0.f;
+};
+
 /**
 * @brief      crops the pointcloud so that only the points inside the bounding
 *box around the vehicle position are considered
@@ -43,35 +109,160 @@ void filterPointCloud(
     int min_cloud_size, float min_dist_backoff, Box histogram_box,
     const Eigen::Vector3f& position, float min_realsense_dist);
 
+/**
+* @brief      fused ingest of the raw sensor messages: in a single pass over
+*             each message buffer the NaN padding is skipped, the points are
+*             transformed to the local_origin frame and cropped to the bounding
+*             box and the sensor range
+* @param[out] cropped_cloud, filtered pointcloud, its capacity is reused
+*             between calls
+* @param[out] closest_point, closest point to the vehicle
+* @param[out] distance_to_closest_point, distance between the
+*vehicle and closest_point [m]
+* @param[out] counter_backoff, number of points closer than min_dist_backoff to
+*the vehicle
+* @param[in]  cloud_msgs, array of raw pointcloud messages from the sensors,
+*null entries are skipped
+* @param[in]  transforms, sensor frame to local_origin transform for each
+*message
+* @param[in]  min_cloud_size, minimum number of points in a pointcloud for it to
+*be considered
+* @param[in]  min_dist_backoff, distance bewteen the vehicle and a point in the
+*cloud at which going backwards is considered [m]
+* @param[in]  histogram_box, geometry definition of the bounding box
+* @param[in]  position, current vehicle position
+* @param[in]  min_realsense_dist, minimum sensor range [m]
+**/
+void filterPointCloud(
+    pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+    Eigen::Vector3f& closest_point, float& distance_to_closest_point,
+    int& counter_backoff,
+    const std::vector<sensor_msgs::PointCloud2::ConstPtr>& cloud_msgs,
+    const std::vector<Eigen::Affine3f,
+                      Eigen::aligned_allocator<Eigen::Affine3f>>& transforms,
+    int min_cloud_size, float min_dist_backoff, Box histogram_box,
+    const Eigen::Vector3f& position, float min_realsense_dist);
+
+/**
+* @brief      ingest of depth images without a pointcloud: every stride-th
+*             pixel in both directions is projected along its ray of the lookup
+*             table, transformed to the local_origin frame and cropped to the
+*             bounding box and the sensor range
+* @param[out] cropped_cloud, filtered pointcloud, its capacity is reused
+*             between calls
+* @param[out] closest_point, closest point to the vehicle
+* @param[out] distance_to_closest_point, distance between the
+*vehicle and closest_point [m]
+* @param[out] counter_backoff, number of points closer than min_dist_backoff to
+*the vehicle
+* @param[in]  depth_images, array of depth images from the sensors in 16UC1 or
+*32FC1, null entries and images which do not fit their rays are skipped
+* @param[in]  depth_rays, pixel rays of each image
+* @param[in]  transforms, optical frame to local_origin transform for each
+*image
+* @param[in]  stride, pixel step of the sampling, 1 uses every pixel
+* @param[in]  min_cloud_size, minimum number of points in a pointcloud for it to
+*be considered
+* @param[in]  min_dist_backoff, distance bewteen the vehicle and a point in the
+*cloud at which going backwards is considered [m]
+* @param[in]  histogram_box, geometry definition of the bounding box
+* @param[in]  position, current vehicle position
+* @param[in]  min_realsense_dist, minimum sensor range [m]
+**/
+void filterPointCloud(
+    pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+    Eigen::Vector3f& closest_point, float& distance_to_closest_point,
+    int& counter_backoff,
+    const std::vector<sensor_msgs::Image::ConstPtr>& depth_images,
+    const std::vector<std::shared_ptr<const DepthRays>>& depth_rays,
+    const std::vector<Eigen::Affine3f,
+                      Eigen::aligned_allocator<Eigen::Affine3f>>& transforms,
+    int stride, int min_cloud_size, float min_dist_backoff, Box histogram_box,
+    const Eigen::Vector3f& position, float min_realsense_dist);
+
+/**
+* @brief      reduces the cropped pointcloud before the histograms are built
+* @param      cloud, cropped pointcloud, replaced by the downsampled one
+* @param[in]  position, current vehicle position
+* @param[in]  voxel_size, edge length of the voxels whose centroids replace the
+*points [m], no voxel grid is used if <= 0
+* @param[in]  max_points, point budget of the output, not limited if 0
+* @param      workspace, scratch buffers of the downsampling
+* @details    every histogram bin occupied by the cropped cloud keeps at least
+*its point closest to the vehicle, so the occupancy of the new histogram does
+*not change. If the budget is smaller than the number of occupied bins, it is
+*exceeded by these points.
+**/
+void downsamplePointCloud(pcl::PointCloud<pcl::PointXYZ>& cloud,
+                          const Eigen::Vector3f& position, float voxel_size,
+                          size_t max_points, DownsampleWorkspace& workspace);
+
 /**
 * @brief      calculates the histogram cells within the Field of View
 * @param[in]  h_FOV, horizontal Field of View [rad]
 * @param[in]  v_FOV, vertical Field of View [rad]
-* @param[out] z_FOV_idx, array of azimuth indexes inside the FOV
-* @param[out] e_FOV_min, minimum elevation index inside the FOV
-* @param[out] e_FOV_max, maximum elevation index inside the FOV
+* @param[out] fov, azimuth mask and elevation range inside the FOV
 * @param[in]  yaw, vehicle yaw [rad]
 * @param[in]  pitch, vehicle pitch [rad]
 * @note azimuth angle is wrapped, elevation is not
 **/
-void calculateFOV(float h_FOV, float v_FOV, std::vector<int>& z_FOV_idx,
-                  int& e_FOV_min, int& e_FOV_max, float yaw_fcu_frame,
+void calculateFOV(float h_FOV, float v_FOV, FOV& fov, float yaw_fcu_frame,
                   float pitch_fcu_frame);
 
+/**
+* @brief      calculates the histogram cells within the union of the frusta of
+*the cameras which contributed a cloud
+* @param[in]  camera_FOVs, Field of View of each camera
+* @param[in]  cloud_msgs, pointcloud of each camera, cameras without one are
+*skipped
+* @param[in]  transforms, camera frame to local_origin of each camera, the
+*camera looks along the z axis of its frame
+* @param[out] fov, union of the azimuth masks and the smallest elevation range
+*covering all of the cameras
+* @returns    false if no camera with a known Field of View has a cloud, fov is
+*empty then
+**/
+bool calculateFOV(
+    const std::vector<CameraFOV>& camera_FOVs,
+    const std::vector<sensor_msgs::PointCloud2::ConstPtr>& cloud_msgs,
+    const std::vector<Eigen::Affine3f,
+                      Eigen::aligned_allocator<Eigen::Affine3f>>& transforms,
+    FOV& fov);
+
+/**
+* @brief      calculates the histogram cells within the union of the frusta of
+*the cameras which contributed a depth image
+* @param[in]  camera_FOVs, Field of View of each camera
+* @param[in]  depth_images, depth image of each camera, cameras without one are
+*skipped
+* @param[in]  transforms, optical frame to local_origin of each camera
+* @param[out] fov, union of the azimuth masks and the smallest elevation range
+*covering all of the cameras
+* @returns    false if none of the cameras has a known Field of View
+**/
+bool calculateFOV(
+    const std::vector<CameraFOV>& camera_FOVs,
+    const std::vector<sensor_msgs::Image::ConstPtr>& depth_images,
+    const std::vector<Eigen::Affine3f,
+                      Eigen::aligned_allocator<Eigen::Affine3f>>& transforms,
+    FOV& fov);
+
 /**
 * @brief     calculates a histogram from older pointcloud data around the
 *current vehicle postion
-* @param[]   polar_histogram_est, histogram calculated from reprojected_points
-* @param[in] reprojected_points, previous iterations occupied histogram bins
-*reprojected in 3D space
-* @param[in] reprojected_points_age, age of each reprojected point
-* @param[]   position, current vehicle positon
+* @param[out] polar_histogram_est, histogram calculated from the memory, the
+*            age of each cell is the mean age of its voxels
+* @param[in] memory, obstacles of previous frames in world frame
+* @param[in] position, current vehicle positon
+* @param     workspace, scratch buffers reused between calls
 **/
-void propagateHistogram(
-    Histogram& polar_histogram_est,
-    const pcl::PointCloud<pcl::PointXYZ>& reprojected_points,
-    const std::vector<int>& reprojected_points_age,
-    const Eigen::Vector3f& position);
+void propagateHistogram(Histogram<ALPHA_RES>& polar_histogram_est,
+                        const ObstacleMemory& memory,
+                        const Eigen::Vector3f& position);
+void propagateHistogram(Histogram<ALPHA_RES>& polar_histogram_est,
+                        const ObstacleMemory& memory,
+                        const Eigen::Vector3f& position,
+                        HistogramWorkspace& workspace);
 
 /**
 * @brief      calculates a histogram from the current frame pointcloud around
@@ -80,9 +271,42 @@ void propagateHistogram(
 * @param[in]  cropped_cloud, current frame filtered pointcloud
 * @param[in]  position, current vehicle position
 **/
-void generateNewHistogram(Histogram& polar_histogram,
+void generateNewHistogram(Histogram<ALPHA_RES>& polar_histogram,
                           const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
                           const Eigen::Vector3f& position);
+void generateNewHistogram(Histogram<ALPHA_RES>& polar_histogram,
+                          const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+                          const Eigen::Vector3f& position,
+                          HistogramWorkspace& workspace);
+
+/**
+* @brief      calculates the histogram of the current frame pointcloud like
+*generateNewHistogram, the cloud is split into blocks which are binned
+*concurrently into the sums of their own workspace and then added up
+* @param[out] polar_histogram, represents cropped_cloud
+* @param[in]  cropped_cloud, current frame filtered pointcloud
+* @param[in]  position, current vehicle position
+* @param      pool, workers binning a block each besides the calling thread,
+*the cloud is binned in one pass if it is null
+* @param      workspaces, scratch buffers reused between calls, one per block
+**/
+void generateNewHistogram(Histogram<ALPHA_RES>& polar_histogram,
+                          const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+                          const Eigen::Vector3f& position, ThreadPool* pool,
+                          std::vector<HistogramWorkspace>& workspaces);
+
+/**
+* @brief      calculates a histogram from the voxels of the current frame
+*pointcloud, each voxel centroid is weighted by its number of points
+* @param[out] polar_histogram, represents the voxels
+* @param[in]  voxels, voxel index of the current frame filtered pointcloud
+* @param[in]  position, center of the histogram
+* @param      workspace, scratch buffers reused between calls
+**/
+void generateNewHistogram(Histogram<ALPHA_RES>& polar_histogram,
+                          const VoxelIndex& voxels,
+                          const Eigen::Vector3f& position,
+                          HistogramWorkspace& workspace);
 
 /**
 * @brief      merges together the histogram calculated with the current frame
@@ -94,15 +318,29 @@ void generateNewHistogram(Histogram& polar_histogram,
 * @param[in]  propagated_hist, histofram calculated with points from previous
 *frames
 * @param[in]  waypoint_outside_FOV, true if the waypoint is outside the FOV
-* @param[in]  z_FOV_idx, array of azimuth indexes inside the FOV
-* @param[in]  e_FOV_min, minimum elevation index inside the FOV
-* @param[in]  e_FOV_max, maximum elevation index inside the FOV
+* @param[in]  fov, histogram cells inside the FOV
 **/
-void combinedHistogram(bool& hist_empty, Histogram& new_hist,
-                       const Histogram& propagated_hist,
-                       bool waypoint_outside_FOV,
-                       const std::vector<int>& z_FOV_idx, int e_FOV_min,
-                       int e_FOV_max);
+void combinedHistogram(bool& hist_empty, Histogram<ALPHA_RES>& new_hist,
+                       const Histogram<ALPHA_RES>& propagated_hist,
+                       bool waypoint_outside_FOV, const FOV& fov);
+
+/**
+* @brief      reduces the histogram to a resolution of 2 * ALPHA_RES away from
+*             the obstacles close to the vehicle and from the goal direction,
+*             each 2x2 block of cells there is marked coarse and holds the
+*             closest obstacle of the block in all of its cells
+* @param      histogram, histogram at ALPHA_RES, partly coarse afterwards
+* @param[in]  position, position the histogram was built around
+* @param[in]  goal, current goal position
+* @param[in]  fine_distance, blocks with an obstacle closer than this [m]
+*             keep the full resolution
+* @param[in]  fine_sector, blocks overlapping the goal direction by this angle
+*             [deg] in elevation and azimuth keep the full resolution
+**/
+void adaptHistogramResolution(Histogram<ALPHA_RES>& histogram,
+                              const Eigen::Vector3f& position,
+                              const Eigen::Vector3f& goal, float fine_distance,
+                              float fine_sector);
 
 /**
 * @brief      compresses the histogram such that for each azimuth the minimum
@@ -110,11 +348,12 @@ void combinedHistogram(bool& hist_empty, Histogram& new_hist,
 * @param[out] new_hist, compressed elevation histogram
 * @param[int] input_hist, original histogram
 **/
-void compressHistogramElevation(Histogram& new_hist,
-                                const Histogram& input_hist);
+void compressHistogramElevation(Histogram<ALPHA_RES>& new_hist,
+                                const Histogram<ALPHA_RES>& input_hist);
 /**
 * @brief      calculates each histogram bin cost and stores it in a cost matrix
-* @param[in]  histogram, polar histogram representing obstacles
+* @param[in]  histogram, polar histogram representing obstacles, the cost of
+*             the cells of a coarse block is evaluated once at its centre
 * @param[in]  goal, current goal position
 * @param[in]  position, current vehicle position
 * @param[in]  current vehicle heading in histogram angle convention
@@ -125,15 +364,32 @@ void compressHistogramElevation(Histogram& new_hist,
 * @param[out] cost_matrix
 * @param[out] image of the cost matrix for visualization
 **/
-void getCostMatrix(const Histogram& histogram, const Eigen::Vector3f& goal,
+void getCostMatrix(const Histogram<ALPHA_RES>& histogram,
+                   const Eigen::Vector3f& goal,
                    const Eigen::Vector3f& position,
                    const float yaw_angle_histogram_frame,
                    const Eigen::Vector3f& last_sent_waypoint,
-                   costParameters cost_params, bool only_yawed,
+                   const costParameters& cost_params, bool only_yawed,
                    const float smoothing_margin_degrees,
                    Eigen::MatrixXf& cost_matrix,
                    std::vector<uint8_t>& image_data);
 
+/**
+* @brief      calculates the cost matrix reusing the buffers of workspace
+* @param[out] image_data, image of the cost matrix for visualization, the
+*             image is not generated if nullptr
+* @details    see above for the other parameters
+**/
+void getCostMatrix(const Histogram<ALPHA_RES>& histogram,
+                   const Eigen::Vector3f& goal,
+                   const Eigen::Vector3f& position,
+                   const float yaw_angle_histogram_frame,
+                   const Eigen::Vector3f& last_sent_waypoint,
+                   const costParameters& cost_params, bool only_yawed,
+                   const float smoothing_margin_degrees,
+                   Eigen::MatrixXf& cost_matrix, CostMatrixWorkspace& workspace,
+                   std::vector<uint8_t>* image_data);
+
 /**
 * @brief      get the index in the data vector of a color image
 *             from the histogram index
@@ -162,6 +418,27 @@ void getBestCandidatesFromCostMatrix(
     const Eigen::MatrixXf& matrix, unsigned int number_of_candidates,
     std::vector<candidateDirection>& candidate_vector);
 
+/**
+* @brief      finds the same candidates as getCostMatrix followed by
+*             getBestCandidatesFromCostMatrix without evaluating the cost
+*             function for every cell
+* @param[in]  number_of_candidates, number of candidate direction to consider
+* @param[out] candidate_vector, array of candidate polar direction arranged from
+*the least to the most expensive
+* @details    the histogram is split into sectors with a lower bound on their
+*             costs from the cost function at the sector center. Sectors are
+*             evaluated best-first until no remaining sector can beat the
+*             kept candidates. See getCostMatrix for the other parameters
+**/
+void getBestCandidatesFromHistogram(
+    const Histogram<ALPHA_RES>& histogram, const Eigen::Vector3f& goal,
+    const Eigen::Vector3f& position, const float yaw_angle_histogram_frame,
+    const Eigen::Vector3f& last_sent_waypoint,
+    const costParameters& cost_params,
+    const float smoothing_margin_degrees, unsigned int number_of_candidates,
+    CostMatrixWorkspace& workspace,
+    std::vector<candidateDirection>& candidate_vector);
+
 /**
 * @brief   computes the cost of each direction in the polar histogram
 * @param[] e_angle, elevation angle [deg]
@@ -178,15 +455,20 @@ void costFunction(float e_angle, float z_angle, float obstacle_distance,
                   const Eigen::Vector3f& goal, const Eigen::Vector3f& position,
                   const float yaw_angle_histogram_frame,
                   const Eigen::Vector3f& last_sent_waypoint,
-                  costParameters cost_params, float& distance_cost,
+                  const costParameters& cost_params, float& distance_cost,
                   float& other_costs);
 
 /**
-* @brief   max-median filtes the cost matrix
+* @brief   smoothes the cost matrix with the conic kernel of getConicKernel in
+*elevation and azimuth, wrapping around like padPolarMatrix
 * @param   matrix, cost matrix
-* @param[] smoothing_radius, median filter window size
+* @param[] smoothing_radius, radius of the kernel
+* @details the triangular kernel is applied as two cascaded box filters with
+*running sums, so the cost per cell does not depend on the radius
 **/
 void smoothPolarMatrix(Eigen::MatrixXf& matrix, unsigned int smoothing_radius);
+void smoothPolarMatrix(Eigen::MatrixXf& matrix, unsigned int smoothing_radius,
+                       CostMatrixWorkspace& workspace);
 
 /**
 * @brief       pads the cost matrix to wrap around elevation and azimuth when
@@ -205,12 +487,13 @@ void padPolarMatrix(const Eigen::MatrixXf& matrix, unsigned int n_lines_padding,
  * @return the smoothing kernel
  **/
 Eigen::ArrayXf getConicKernel(int radius);
+void getConicKernel(int radius, Eigen::ArrayXf& kernel);
 
 /**
 * @brief   helper method to output on the console the histogram
 * @param[] histogram, polar histogram
 **/
-void printHistogram(Histogram& histogram);
+void printHistogram(const Histogram<ALPHA_RES>& histogram);
 
 /**
 * @brief      finds the minimum cost direction in the tree
@@ -0,0 +1,91 @@
+#ifndef PLANNER_SNAPSHOT_H
+#define PLANNER_SNAPSHOT_H
+
+#include "obstacle_memory.h"
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace avoidance {
+
+/**
+* @brief state of the planner which is not rebuilt from the first frame after
+*        a restart: the obstacle memory and the take off and goal state. The
+*        polar histogram, the reprojected points and the tree are computed
+*        from the memory and the first cloud
+**/
+struct PlannerSnapshot {
+  double stamp = 0.0;  // ROS time the snapshot was taken [s]
+  Eigen::Vector3f goal = Eigen::Vector3f::Zero();
+  Eigen::Vector3f take_off_pose = Eigen::Vector3f::Zero();
+  bool reach_altitude = false;
+  ObstacleMemory obstacle_memory;
+};
+
+/**
+* @brief memory-mapped file holding the latest PlannerSnapshot of the node
+* @details the file has two slots which are written in turn, each with a
+*          sequence number and a checksum. A crash while writing one slot
+*          leaves the other one intact, read() returns the newest slot whose
+*          checksum matches. The file grows when a snapshot does not fit into
+*          a slot, the mapping is kept between writes so that writing costs
+*          no system call besides the asynchronous flush.
+**/
+class SnapshotFile {
+ public:
+  SnapshotFile() = default;
+  ~SnapshotFile();
+  SnapshotFile(const SnapshotFile&) = delete;
+  SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+  /**
+  * @brief     opens or creates the snapshot file, an existing file keeps its
+  *            snapshots if it has the current format
+  * @param[in] path, location of the snapshot file
+  * @returns   true, if the file could be mapped
+  **/
+  bool open(const std::string& path);
+
+  /**
+  * @brief     unmaps and closes the file
+  **/
+  void close();
+
+  bool isOpen() const { return data_ != nullptr; }
+
+  /**
+  * @brief     writes a snapshot into the older slot
+  * @param[in] snapshot, state of the planner
+  * @returns   true, if the snapshot was written
+  **/
+  bool write(const PlannerSnapshot& snapshot);
+
+  /**
+  * @brief      reads the newest complete snapshot
+  * @param[out] snapshot, state of the planner
+  * @returns    false, if the file holds no complete snapshot
+  **/
+  bool read(PlannerSnapshot& snapshot) const;
+
+ private:
+  int fd_ = -1;
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  uint64_t sequence_ = 0;  // sequence number of the newest slot
+
+  size_t slotCapacity() const;
+  char* slot(int index) const;
+
+  /**
+  * @brief     resizes the file to hold two slots of the given capacity and
+  *            maps it, the previous snapshots are dropped
+  * @returns   true, if the file could be mapped
+  **/
+  bool resize(size_t slot_capacity);
+};
+}
+
+#endif  // PLANNER_SNAPSHOT_H
@@ -0,0 +1,70 @@
+#ifndef PLANNING_TRIGGER_H
+#define PLANNING_TRIGGER_H
+
+#include <cstddef>
+#include <functional>
+
+namespace avoidance {
+
+/**
+* @brief events which start a planner iteration, the values match the
+*        planning_trigger_ dynamic reconfigure parameter
+**/
+enum class PlanningTrigger : int {
+  allCameras = 0,  ///< every camera delivered a new cloud
+  anyCamera = 1,   ///< at least one camera delivered a new cloud, the last
+                   /// cloud of the other cameras is reused
+  fixedRate = 2,   ///< the planner period elapsed, the freshest cloud of
+                   /// every camera is used
+};
+
+/**
+* @brief     converts the dynamic reconfigure value, unknown values fall back
+*            to PlanningTrigger::allCameras
+**/
+PlanningTrigger toPlanningTrigger(int value);
+
+/**
+* @brief     decides if a planner iteration should be started
+* @param[in] trigger, scheduling policy
+* @param[in] num_cameras, number of cameras the planner subscribes to
+* @param[in] num_new_clouds, number of cameras which delivered a cloud since
+*            the last iteration
+* @param[in] num_usable_clouds, number of cameras whose latest cloud is young
+*            enough to be used
+* @param[in] since_last_plan, time since the last iteration was started [s]
+* @param[in] planning_rate, rate of the fixedRate policy [Hz]
+* @returns   true, if the latest clouds should be handed to the planner
+**/
+bool readyToPlan(PlanningTrigger trigger, size_t num_cameras,
+                 size_t num_new_clouds, size_t num_usable_clouds,
+                 double since_last_plan, double planning_rate);
+
+/**
+* @brief     decides if the latest cloud of a camera may be handed to the
+*            planner, the allCameras trigger waits for all clouds instead of
+*            dropping old ones
+* @param[in] trigger, scheduling policy
+* @param[in] cloud_age, time since the cloud was taken [s]
+* @param[in] max_cloud_age, oldest cloud the other triggers reuse [s]
+**/
+bool isCloudUsable(PlanningTrigger trigger, double cloud_age,
+                   double max_cloud_age);
+
+/**
+* @brief     checks that the clouds of an iteration can be staged: every
+*            usable cloud needs a transform, and the allCameras trigger needs
+*            a usable cloud of every camera
+* @param[in] trigger, scheduling policy
+* @param[in] num_cameras, number of cameras the planner subscribes to
+* @param[in] usable, tells if the latest cloud of a camera is usable
+* @param[in] has_transform, tells if the transform of the latest cloud of a
+*            camera is available, only asked for usable clouds
+* @returns   true, if the clouds can be handed to the planner
+**/
+bool canStageClouds(PlanningTrigger trigger, size_t num_cameras,
+                    const std::function<bool(size_t)>& usable,
+                    const std::function<bool(size_t)>& has_transform);
+}
+
+#endif  // PLANNING_TRIGGER_H
@@ -0,0 +1,81 @@
+#ifndef POLAR_BINNING_H
+#define POLAR_BINNING_H
+
+#include <Eigen/Core>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace avoidance {
+
+/**
+* @brief structure of arrays holding the points to be binned and the result of
+*        the binning, kept between calls so that repeated binning of similar
+*        sized clouds does not allocate
+**/
+struct PolarBinningBuffer {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+  std::vector<int> bin;
+  std::vector<float> dist;
+
+  /**
+  * @brief     copies the cloud into the coordinate arrays and sizes the
+  *            output arrays accordingly
+  * @param[in] cloud, points to be binned
+  **/
+  void load(const pcl::PointCloud<pcl::PointXYZ>& cloud);
+
+  /**
+  * @brief     copies the points [begin, end) of the cloud, see load
+  * @param[in] cloud, points to be binned
+  * @param[in] begin, end, range of point indices
+  **/
+  void load(const pcl::PointCloud<pcl::PointXYZ>& cloud, size_t begin,
+            size_t end);
+
+  size_t size() const { return x.size(); }
+};
+
+/**
+* @brief     approximation of atan2 with a maximum error of about 1e-5 rad
+* @param[in] y, ordinate
+* @param[in] x, abscissa
+* @returns   angle in radians in [-pi, pi], atan2(0, 0) = 0
+* @note      this is the scalar reference of the vectorized kernels, all code
+*            paths evaluate the same polynomial so the bins do not depend on
+*            the instruction set the planner is built for
+**/
+float fastAtan2(float y, float x);
+
+/**
+* @brief     bins a batch of points into a polar histogram
+* @param[in] x, y, z, coordinates of the n points
+* @param[in] n, number of points
+* @param[in] origin, center of the histogram
+* @param[in] res, resolution of the histogram in degrees
+* @param[out] bin, flattened histogram index e * (360 / res) + z of each point,
+*            with the same wrapping and clamping as polarToHistogramIndex
+* @param[out] dist, distance of each point to the origin
+* @details   uses AVX2 or NEON (aarch64) when the compiler targets them and
+*            falls back to scalar code otherwise
+**/
+void polarBinning(const float* x, const float* y, const float* z, size_t n,
+                  const Eigen::Vector3f& origin, int res, int* bin,
+                  float* dist);
+
+/**
+* @brief     bins all points held by the buffer, see polarBinning
+* @param     buffer, loaded points in, bins and distances out
+* @param[in] origin, center of the histogram
+* @param[in] res, resolution of the histogram in degrees
+**/
+void polarBinning(PolarBinningBuffer& buffer, const Eigen::Vector3f& origin,
+                  int res);
+}
+
+#endif  // POLAR_BINNING_H
@@ -0,0 +1,76 @@
+#ifndef POSE_BUFFER_H
+#define POSE_BUFFER_H
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <cstddef>
+#include <vector>
+
+namespace avoidance {
+
+// transform which can be stored in std containers without aligned allocators
+typedef Eigen::Transform<float, 3, Eigen::Affine, Eigen::DontAlign>
+    UnalignedAffine3f;
+
+/**
+* @brief ring buffer of the latest vehicle poses, gives the pose at the time a
+*        cloud was taken without a lookup in the TF buffer
+* @details the poses are interpolated linearly in position and spherically in
+*          orientation. Poses have to be added in the order of their stamps,
+*          older ones are dropped. The buffer is not synchronized, it is
+*          written and read by the callback thread of the node.
+**/
+class PoseBuffer {
+ public:
+  /**
+  * @param[in] capacity, number of poses kept, at the pose rate of the FCU it
+  *            determines the oldest cloud which can be transformed
+  **/
+  explicit PoseBuffer(size_t capacity = 100);
+  ~PoseBuffer() = default;
+
+  /**
+  * @brief     appends a pose, replacing the oldest one once the buffer is full
+  * @param[in] stamp, time of the pose [s]
+  * @param[in] position, vehicle position
+  * @param[in] orientation, vehicle orientation
+  **/
+  void add(double stamp, const Eigen::Vector3f& position,
+           const Eigen::Quaternionf& orientation);
+
+  /**
+  * @brief      computes the vehicle pose at a given time
+  * @param[in]  stamp, time of the pose [s]
+  * @param[out] pose, transform from the vehicle to the world frame
+  * @param[in]  tolerance, a stamp up to this much outside of the buffered
+  *             poses gets the closest one instead of failing [s]
+  * @returns    false, if the stamp is not covered by the buffer
+  **/
+  bool interpolate(double stamp, Eigen::Affine3f& pose,
+                   double tolerance = 0.05) const;
+
+  void clear() { size_ = 0; }
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+ private:
+  struct Pose {
+    double stamp;
+    Eigen::Vector3f position;
+    Eigen::Quaternion<float, Eigen::DontAlign> orientation;
+  };
+  std::vector<Pose> poses_;
+  size_t oldest_ = 0;  // index of the oldest pose in poses_
+  size_t size_ = 0;
+
+  /**
+  * @brief     pose at a position counted from the oldest one
+  **/
+  const Pose& at(size_t i) const {
+    return poses_[(oldest_ + i) % poses_.size()];
+  }
+};
+}
+
+#endif  // POSE_BUFFER_H
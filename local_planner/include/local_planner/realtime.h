@@ -0,0 +1,48 @@
+#ifndef LOCAL_PLANNER_REALTIME_H
+#define LOCAL_PLANNER_REALTIME_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace avoidance {
+
+/**
+* @brief scheduling of a thread of the real time profile
+**/
+struct ThreadProfile {
+  std::vector<int> cpus;  ///< CPUs the thread may run on, empty for all
+  int priority = 0;       ///< SCHED_FIFO priority 1-99, 0 keeps the policy
+};
+
+/**
+* @brief     pins the calling thread to CPUs and switches it to SCHED_FIFO,
+*            threads it starts afterwards inherit both
+* @param[in] profile, CPUs and priority of the thread
+* @param[out] error, reason of a failure, e.g. a missing CAP_SYS_NICE
+* @returns   true, if the whole profile could be applied
+**/
+bool applyThreadProfile(const ThreadProfile& profile, std::string& error);
+
+/**
+* @brief     locks the current and future pages of the process in memory and
+*            keeps freed heap memory in the process, so that the buffers the
+*            planner reuses between iterations do not fault again. Called
+*            after the warm-up, when the buffers have grown to their size
+* @param[in] stack_bytes, stack of the calling thread which is faulted in
+* @param[out] error, reason of a failure, e.g. a too small RLIMIT_MEMLOCK
+* @returns   true, if the memory could be locked
+**/
+bool lockMemory(size_t stack_bytes, std::string& error);
+
+/**
+* @brief     limit of the locked memory of the process. Once lockMemory has
+*            locked the future pages, mmap, the heap and new thread stacks
+*            fail with ENOMEM or EAGAIN when they would exceed it
+* @param[out] bytes, RLIMIT_MEMLOCK, if it is set
+* @returns   true, if the locked memory is limited
+**/
+bool lockedMemoryLimit(size_t& bytes);
+}
+
+#endif  // LOCAL_PLANNER_REALTIME_H
@@ -0,0 +1,237 @@
+#ifndef STAGE_TIMER_H
+#define STAGE_TIMER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace avoidance {
+
+/**
+* @brief stages of the planner pipeline which are timed
+**/
+enum class PlannerStage : int {
+  ingest,
+  filterPointCloud,
+  downsample,
+  histogram,
+  propagation,
+  costMatrix,
+  smoothPolarMatrix,
+  treeBuild,
+  waypointGenerator,
+  planner,
+  count
+};
+
+/**
+* @brief     name of a stage as used on the diagnostics topic and in traces
+**/
+const char* stageName(PlannerStage stage);
+
+/**
+* @brief latency statistics of a stage over the samples in its window
+**/
+struct StageStatistics {
+  size_t samples = 0;
+  double p50_ms = 0.0;
+  double p99_ms = 0.0;
+  double max_ms = 0.0;
+  double total_ms = 0.0;  ///< sum of the samples in the window
+  size_t overruns = 0;    ///< samples over the deadline since the last reset
+};
+
+/**
+* @brief one timed section in the Chrome trace event format, times are in
+*        microseconds of the steady clock
+**/
+struct TraceEvent {
+  PlannerStage stage;
+  int thread_id;
+  int64_t start_us;
+  int64_t duration_us;
+};
+
+/**
+* @brief wall clock durations of the planner stages, each stage keeps its
+*        last window_size samples in a ring buffer
+* @details recording is thread safe and does not allocate unless tracing is
+*          enabled, each stage has its own lock so that stages running on
+*          different threads do not contend
+**/
+class StageTimings {
+ public:
+  typedef std::chrono::steady_clock Clock;
+  static const size_t window_size = 512;
+  static const size_t max_trace_events = 100000;
+
+  StageTimings() = default;
+  StageTimings(const StageTimings&) = delete;
+  StageTimings& operator=(const StageTimings&) = delete;
+
+  /**
+  * @brief     timings the planner stages of the calling thread record into,
+  *            the process wide ones unless a ScopedStageTimings selects others
+  **/
+  static StageTimings& instance();
+
+  /**
+  * @brief     adds a sample to a stage, and a trace event if tracing is
+  *            enabled
+  * @param[in] stage, timed stage
+  * @param[in] start, end, time points of the steady clock
+  **/
+  void record(PlannerStage stage, Clock::time_point start,
+              Clock::time_point end);
+
+  /**
+  * @brief     sets the deadline of a stage, longer samples are counted as
+  *            overruns
+  * @param[in] stage, timed stage
+  * @param[in] deadline_ms, longest expected duration, 0 disables the count
+  **/
+  void setDeadline(PlannerStage stage, double deadline_ms);
+
+  /**
+  * @brief     number of samples of a stage over its deadline since the last
+  *            reset, without computing the statistics
+  **/
+  size_t overruns(PlannerStage stage) const;
+
+  /**
+  * @brief     sum of all samples of a stage since the last reset, the
+  *            difference between two calls is the time spent in between
+  * @returns   total time [ms]
+  **/
+  double totalMs(PlannerStage stage) const;
+
+  /**
+  * @brief     computes the statistics of the samples in the window of a stage
+  **/
+  StageStatistics statistics(PlannerStage stage) const;
+
+  /**
+  * @brief     removes all samples and trace events
+  **/
+  void reset();
+
+  /**
+  * @brief     enables or disables the collection of trace events
+  **/
+  void setTraceEnabled(bool enabled) { trace_enabled_ = enabled; }
+  bool traceEnabled() const { return trace_enabled_; }
+
+  /**
+  * @brief     moves the collected trace events to the caller
+  * @param[out] events, events collected since the last call
+  * @returns   number of events that were dropped because the buffer was full
+  **/
+  size_t takeTraceEvents(std::vector<TraceEvent>& events);
+
+ private:
+  struct StageSamples {
+    mutable std::mutex mutex;
+    std::array<int64_t, window_size> duration_ns;
+    size_t next = 0;
+    size_t count = 0;
+    int64_t deadline_ns = 0;
+    size_t overruns = 0;
+    int64_t total_ns = 0;
+  };
+
+  std::array<StageSamples, static_cast<size_t>(PlannerStage::count)> stages_;
+
+  std::atomic<bool> trace_enabled_{false};
+  std::mutex trace_mutex_;
+  std::vector<TraceEvent> trace_events_;
+  size_t dropped_trace_events_ = 0;
+};
+
+/**
+* @brief selects the timings returned by StageTimings::instance() on the
+*        calling thread for its lifetime, so that several planners in one
+*        process keep separate statistics
+**/
+class ScopedStageTimings {
+ public:
+  explicit ScopedStageTimings(StageTimings& timings);
+  ~ScopedStageTimings();
+
+  ScopedStageTimings(const ScopedStageTimings&) = delete;
+  ScopedStageTimings& operator=(const ScopedStageTimings&) = delete;
+
+ private:
+  StageTimings* previous_;
+};
+
+/**
+* @brief records the wall clock time between its construction and destruction
+*        for a stage
+**/
+class ScopedStageTimer {
+ public:
+  explicit ScopedStageTimer(PlannerStage stage,
+                            StageTimings& timings = StageTimings::instance())
+      : stage_(stage), timings_(timings), start_(StageTimings::Clock::now()) {}
+  ~ScopedStageTimer() {
+    timings_.record(stage_, start_, StageTimings::Clock::now());
+  }
+
+  ScopedStageTimer(const ScopedStageTimer&) = delete;
+  ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+  /**
+  * @brief     getter method for the time since construction
+  * @returns   elapsed time [ms]
+  **/
+  double elapsedMs() const {
+    return std::chrono::duration<double, std::milli>(
+               StageTimings::Clock::now() - start_)
+        .count();
+  }
+
+ private:
+  PlannerStage stage_;
+  StageTimings& timings_;
+  StageTimings::Clock::time_point start_;
+};
+
+/**
+* @brief writes trace events to a file in the JSON array format of the Chrome
+*        trace viewer (chrome://tracing, ui.perfetto.dev)
+* @details the closing bracket is optional in this format, so a file is valid
+*          even if the planner is killed
+**/
+class ChromeTraceWriter {
+ public:
+  /**
+  * @brief     opens the trace file, an existing file is overwritten
+  * @param[in] path, location of the trace file
+  * @returns   true, if the file could be opened
+  **/
+  bool open(const std::string& path);
+
+  /**
+  * @brief     appends events to the trace file
+  **/
+  void write(const std::vector<TraceEvent>& events);
+
+  /**
+  * @brief     terminates the JSON array and closes the file
+  **/
+  void close();
+
+  bool isOpen() const { return file_.is_open(); }
+
+ private:
+  std::ofstream file_;
+};
+}
+
+#endif  // STAGE_TIMER_H
@@ -2,8 +2,14 @@
 #define STAR_PLANNER_H
 
 #include "box.h"
+#include "candidate_direction.h"
 #include "cost_parameters.h"
 #include "histogram.h"
+#include "histogram_batch.h"
+#include "obstacle_memory.h"
+#include "planner_functions.h"
+#include "thread_pool.h"
+#include "voxel_index.h"
 
 #include <Eigen/Dense>
 
@@ -15,11 +21,29 @@
 #include <dynamic_reconfigure/server.h>
 #include <local_planner/LocalPlannerNodeConfig.h>
 
+#include <memory>
 #include <vector>
 
 namespace avoidance {
 class TreeNode;
 
+/**
+* @brief buffers and result of the expansion of a single tree node, reused
+*        between expansions so that building the tree does not allocate
+**/
+struct NodeExpansion {
+  int origin = 0;
+  Histogram<ALPHA_RES> propagated_histogram;
+  Histogram<ALPHA_RES> histogram;
+  HistogramWorkspace histogram_workspace;
+  CostMatrixWorkspace cost_workspace;
+  Eigen::MatrixXf cost_matrix;
+  FOV fov;
+  std::vector<candidateDirection> candidates;
+  // the current frame histogram was built by the batch of the tree
+  bool histogram_built = false;
+};
+
 class StarPlanner {
   float h_FOV_ = 59.0f;
   float v_FOV_ = 46.0f;
@@ -30,12 +54,37 @@ class StarPlanner {
   float max_path_length_ = 4.f;
   float curr_yaw_fcu_frame_;
   float smoothing_margin_degrees_ = 30.f;
+  int expansion_batch_size_ = 1;
+  bool lazy_cost_matrix_ = true;
+  bool adaptive_resolution_ = false;
+  float fine_resolution_distance_ = 4.f;
+  float fine_resolution_sector_ = 30.f;
+  int max_tree_reuse_ = 0;
+  int tree_reuse_count_ = 0;
 
-  std::vector<int> reprojected_points_age_;
   std::vector<int> path_node_origins_;
 
-  pcl::PointCloud<pcl::PointXYZ> pointcloud_;
-  pcl::PointCloud<pcl::PointXYZ> reprojected_points_;
+  // the clouds are owned by the caller, see setCloud/setObstacleMemory
+  const pcl::PointCloud<pcl::PointXYZ>* pointcloud_ = nullptr;
+  const ObstacleMemory* obstacle_memory_ = nullptr;
+  const VoxelIndex* cloud_voxels_ = nullptr;
+
+  // one slot per node expanded in a batch of buildLookAheadTree
+  std::vector<NodeExpansion> expansions_;
+  std::vector<int> expansion_batch_;
+  std::vector<int> open_nodes_;
+  std::shared_ptr<ThreadPool> expansion_pool_;
+  bool shared_pool_ = false;
+
+  // current frame histograms of a batch on the GPU, see HistogramBatch
+  HistogramBatch histogram_batch_;
+  std::vector<Eigen::Vector3f> batch_origins_;
+  std::vector<Histogram<ALPHA_RES>*> batch_histograms_;
+
+  // slots of tree_ which are not part of the tree, they are filled before the
+  // tree grows so that the storage of the nodes is kept between builds
+  std::vector<int> free_nodes_;
+  std::vector<int> kept_nodes_;
 
   Eigen::Vector3f goal_ = Eigen::Vector3f(NAN, NAN, NAN);
   Eigen::Vector3f projected_last_wp_ = Eigen::Vector3f::Zero();
@@ -57,6 +106,57 @@ class StarPlanner {
   **/
   float treeHeuristicFunction(int node_number);
 
+  /**
+  * @brief     inserts a node into a free slot of the tree or appends it
+  * @param[in] node, node to insert
+  * @returns   index of the node in the tree
+  **/
+  int addNode(const TreeNode& node);
+
+  /**
+  * @brief     sets the heuristic and the total cost of a node from the ones of
+  *            its origin, which must be up to date
+  * @param[in] node_number, sequential number of entry in the tree
+  **/
+  void updateNodeCosts(int node_number);
+
+  /**
+  * @brief     re-roots the tree of the previous build at the expanded child of
+  *            the root closest to the vehicle, the other branches are freed
+  * @details   the new root is at the vehicle position and is expanded again
+  *            with the current cloud, the kept branch hangs from it and its
+  *            expanded nodes count against the expansion budget
+  * @returns   false if the tree has to be built from scratch instead, because
+  *            reusing is disabled, the goal changed, the tree was not built in
+  *            the previous cycle or it has been re-rooted max_tree_reuse_
+  *            times in a row
+  **/
+  bool reRootTree();
+
+  /**
+  * @brief     builds the histogram and cost matrix of a node and picks its
+  *            best candidate directions
+  * @param     expansion, origin in, candidates out
+  * @note      only reads the tree, expansions of different nodes can run
+  *            concurrently
+  **/
+  void expandNode(NodeExpansion& expansion) const;
+
+  /**
+  * @brief     inserts the candidates of an expanded node into the tree and
+  *            closes the node
+  * @param[in] expansion, result of expandNode
+  **/
+  void addChildren(const NodeExpansion& expansion);
+
+  /**
+  * @brief     finds the cheapest open nodes within the maximum path length
+  * @param[in] max_nodes, maximum number of nodes to return
+  * @param[out] nodes, node indices sorted by increasing cost, ties are broken
+  *            by the lower index
+  **/
+  void selectOpenNodes(size_t max_nodes, std::vector<int>& nodes);
+
  public:
   std::vector<Eigen::Vector3f> path_node_positions_;
   std::vector<int> closed_set_;
@@ -86,15 +186,12 @@ class StarPlanner {
   void setFOV(float h_FOV, float v_FOV);
 
   /**
-  * @brief     setter method for reprojected pointcloud
-  * @param[in] reprojected_points, pointcloud from previous frames reprojected
-  *            around the vehicle current position
-  * @param[in] reprojected_points_age, array containing the age of each
-  *            reprojected point
+  * @brief     setter method for the obstacles of previous frames
+  * @param[in] obstacle_memory, world frame memory of previous frames
+  * @warning   the memory is referenced, not copied, and must stay valid until
+  *            the tree has been built
   **/
-  void setReprojectedPoints(
-      const pcl::PointCloud<pcl::PointXYZ>& reprojected_points,
-      const std::vector<int>& reprojected_points_age);
+  void setObstacleMemory(const ObstacleMemory& obstacle_memory);
 
   /**
   * @brief     setter method for vehicle position
@@ -112,11 +209,28 @@ class StarPlanner {
   /**
   * @brief     setter method for pointcloud
   * @param[in] cropped_cloud, current point cloud cropped around the vehicle
+  * @warning   the cloud is referenced, not copied, and must stay valid until
+  *            the tree has been built
   **/
   void setCloud(const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud);
 
+  /**
+  * @brief     setter method for pointcloud and its voxel index, the node
+  *            histograms are built from the voxels instead of the raw points
+  * @param[in] cropped_cloud, current point cloud cropped around the vehicle
+  * @param[in] cloud_voxels, voxel index of cropped_cloud
+  * @warning   both are referenced, not copied, and must stay valid until the
+  *            tree has been built
+  **/
+  void setCloud(const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+                const VoxelIndex& cloud_voxels);
+
   /**
   * @brief     build tree of candidates directions towards the goal
+  * @details   with a batch size K > 1 the K cheapest open nodes are expanded
+  *            concurrently and their children are inserted in order of
+  *            increasing cost, so the tree does not depend on the thread
+  *            timing. K = 1 is the serial best-first expansion.
   **/
   void buildLookAheadTree();
 
@@ -125,6 +239,19 @@ class StarPlanner {
   **/
   void dynamicReconfigureSetStarParams(
       const avoidance::LocalPlannerNodeConfig& config, uint32_t level);
+
+  /**
+  * @brief     expands the batches on a pool shared with other planners instead
+  *            of an own one sized by the batch size
+  * @param[in] pool, shared workers, null to use an own pool again
+  **/
+  void setThreadPool(std::shared_ptr<ThreadPool> pool);
+
+  /**
+  * @brief     getter method for the number of nodes in the tree, tree_ also
+  *            holds free slots
+  **/
+  size_t numberOfNodes() const { return tree_.size() - free_nodes_.size(); }
 };
 }
 #endif  // STAR_PLANNER_H
@@ -0,0 +1,88 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace avoidance {
+
+class StageTimings;
+
+/**
+* @brief fixed set of worker threads serving one queue of tasks
+* @details several threads may call parallelFor concurrently, also from within
+*          a task of the same pool, each call only waits for its own items.
+*          The stage timings of the caller are recorded into by its items, see
+*          ScopedStageTimings.
+**/
+class ThreadPool {
+ public:
+  /**
+  * @brief     starts a fixed number of worker threads
+  * @param[in] n_threads, number of workers, at least one is started
+  **/
+  ThreadPool(size_t n_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /**
+  * @brief     runs fn(i) for every i in [0, n) on the workers and blocks until
+  *            all of them have returned, the calling thread executes queued
+  *            items while it waits
+  * @param[in] n, number of work items
+  * @param[in] fn, work item, must not throw and must be safe to run
+  *            concurrently for different i
+  **/
+  void parallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+  /**
+  * @brief     queues a task and returns without waiting for it, the queued
+  *            tasks are finished before the pool is destroyed
+  * @param[in] task, work item, must not throw
+  **/
+  void submit(std::function<void()> task);
+
+  /**
+  * @brief     getter method for the number of worker threads
+  * @returns   number of workers
+  **/
+  size_t size() const { return workers_.size(); }
+
+ private:
+  // items of one parallelFor call which are not finished yet
+  struct Batch {
+    size_t pending;
+  };
+  struct Task {
+    std::function<void()> fn;
+    Batch* batch;           // null for submitted tasks
+    StageTimings* timings;  // timings of the thread which queued the task
+  };
+
+  std::vector<std::thread> workers_;
+  std::deque<Task> tasks_;
+  std::mutex mutex_;
+  std::condition_variable task_cv_;
+  std::condition_variable done_cv_;
+  bool stop_ = false;
+
+  /**
+  * @brief     main loop of a worker thread, executes queued tasks
+  **/
+  void workerLoop();
+
+  /**
+  * @brief     runs a task outside of the lock and marks it as done
+  * @param     lock, lock of mutex_, held on entry and on return
+  **/
+  void run(Task& task, std::unique_lock<std::mutex>& lock);
+};
+}
+
+#endif  // THREAD_POOL_H
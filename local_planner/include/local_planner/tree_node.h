@@ -17,6 +17,8 @@ class TreeNode {
   int origin_;
   int depth_;
   float yaw_;
+  bool closed_;  // true once the node has been expanded
+  bool free_;    // true if the slot is on the free list of the tree
 
   TreeNode();
   TreeNode(int from, int d, const Eigen::Vector3f& pos);
@@ -33,7 +35,7 @@ class TreeNode {
   * @brief     getter method for tree node position
   * @returns   node position in 3D cartesian coordinates
   **/
-  Eigen::Vector3f getPosition();
+  Eigen::Vector3f getPosition() const;
 };
 }
 
@@ -0,0 +1,72 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+namespace avoidance {
+
+/**
+* @brief     lock-free single producer, single consumer exchange of the newest
+*            value. The writer fills back() and publishes it, the reader
+*            fetches the newest published value into front(). Neither side
+*            ever blocks, a value that is overwritten before the reader fetches
+*            it is replaced by the newer one.
+**/
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() : state_(1), back_(0), front_(2) {}
+
+  /**
+  * @brief     slot owned by the writer, fill it before calling publish()
+  **/
+  T& back() { return slots_[back_]; }
+
+  /**
+  * @brief     makes the content of back() available to the reader
+  **/
+  void publish() {
+    uint8_t prev = state_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+    back_ = prev & kIndexMask;
+  }
+
+  /**
+  * @brief     true if a published value has not been fetched yet
+  **/
+  bool pending() const {
+    return state_.load(std::memory_order_acquire) & kFresh;
+  }
+
+  /**
+  * @brief     replaces front() with the newest published value
+  * @returns   true, if there was a value that has not been fetched yet
+  **/
+  bool fetch() {
+    if (!(state_.load(std::memory_order_acquire) & kFresh)) {
+      return false;
+    }
+    uint8_t prev = state_.exchange(front_, std::memory_order_acq_rel);
+    front_ = prev & kIndexMask;
+    return true;
+  }
+
+  /**
+  * @brief     slot owned by the reader, valid after a successful fetch()
+  **/
+  T& front() { return slots_[front_]; }
+  const T& front() const { return slots_[front_]; }
+
+ private:
+  static constexpr uint8_t kIndexMask = 0x3;
+  static constexpr uint8_t kFresh = 0x4;
+
+  T slots_[3];
+  // index of the middle slot, plus kFresh if it has not been fetched yet
+  std::atomic<uint8_t> state_;
+  uint8_t back_;
+  uint8_t front_;
+};
+}
+
+#endif  // TRIPLE_BUFFER_H
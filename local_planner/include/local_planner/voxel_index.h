@@ -0,0 +1,102 @@
+#ifndef VOXEL_INDEX_H
+#define VOXEL_INDEX_H
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace avoidance {
+
+/**
+* @brief     packs the integer coordinates of the voxel containing a point
+* @param[in] x, y, z, point coordinates [m]
+* @param[in] inv_size, inverse of the voxel edge length [1/m]
+* @returns   key with 21 bits per axis, which covers +-1e6 voxels
+**/
+inline uint64_t voxelKey(float x, float y, float z, float inv_size) {
+  const int64_t offset = 1 << 20;
+  const uint64_t mask = (1 << 21) - 1;
+  uint64_t ix = static_cast<uint64_t>(
+      static_cast<int64_t>(std::floor(x * inv_size)) + offset);
+  uint64_t iy = static_cast<uint64_t>(
+      static_cast<int64_t>(std::floor(y * inv_size)) + offset);
+  uint64_t iz = static_cast<uint64_t>(
+      static_cast<int64_t>(std::floor(z * inv_size)) + offset);
+  return ((ix & mask) << 42) | ((iy & mask) << 21) | (iz & mask);
+}
+
+/**
+* @brief     hash of a voxel key, the finalizer of MurmurHash3 spreads
+*            neighbouring voxels over the table
+**/
+inline size_t hashVoxelKey(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return static_cast<size_t>(key);
+}
+
+/**
+* @brief voxel hash of a point cloud, stores the centroid and the number of
+*        points of every occupied voxel as a structure of arrays
+* @details built once per frame and shared by all nodes of the look-ahead
+*          tree, so that the cost of a node histogram depends on the number of
+*          occupied voxels instead of the sensor density. The buffers are kept
+*          between builds and only grow.
+**/
+class VoxelIndex {
+ public:
+  VoxelIndex() = default;
+  ~VoxelIndex() = default;
+
+  /**
+  * @brief     replaces the content of the index with the voxels of a cloud
+  * @param[in] cloud, points to be indexed, non finite points are skipped
+  * @param[in] voxel_size, edge length of the voxels [m], with a size <= 0
+  *            every point is kept as its own voxel
+  **/
+  void build(const pcl::PointCloud<pcl::PointXYZ>& cloud, float voxel_size);
+
+  /**
+  * @brief     removes all voxels
+  **/
+  void clear();
+
+  /**
+  * @brief     getter method for the number of occupied voxels
+  **/
+  size_t size() const { return count_.size(); }
+  bool empty() const { return count_.empty(); }
+
+  /**
+  * @brief     getter method for the voxel edge length used by the last build
+  **/
+  float voxelSize() const { return voxel_size_; }
+
+  /**
+  * @brief     getter methods for the voxel centroids and point counts, all
+  *            arrays have size() elements
+  **/
+  const std::vector<float>& x() const { return x_; }
+  const std::vector<float>& y() const { return y_; }
+  const std::vector<float>& z() const { return z_; }
+  const std::vector<int>& count() const { return count_; }
+
+ private:
+  float voxel_size_ = 0.f;
+  std::vector<float> x_;
+  std::vector<float> y_;
+  std::vector<float> z_;
+  std::vector<int> count_;
+
+  // open addressing hash table, slots hold voxel indices or -1
+  std::vector<uint64_t> keys_;
+  std::vector<int> slots_;
+};
+}
+
+#endif  // VOXEL_INDEX_H
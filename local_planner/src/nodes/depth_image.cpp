@@ -0,0 +1,58 @@
+#include "local_planner/depth_image.h"
+
+#include <sensor_msgs/image_encodings.h>
+
+namespace avoidance {
+
+namespace {
+
+// the projection holds the intrinsics of the rectified image
+void getIntrinsics(const sensor_msgs::CameraInfo& info, double& fx,
+                   double& fy, double& cx, double& cy) {
+  bool has_projection = info.P[0] > 0.0 && info.P[5] > 0.0;
+  fx = has_projection ? info.P[0] : info.K[0];
+  fy = has_projection ? info.P[5] : info.K[4];
+  cx = has_projection ? info.P[2] : info.K[2];
+  cy = has_projection ? info.P[6] : info.K[5];
+}
+
+}  // namespace
+
+bool DepthRays::update(const sensor_msgs::CameraInfo& info) {
+  getIntrinsics(info, fx_, fy_, cx_, cy_);
+  x_.clear();
+  y_.clear();
+  if (fx_ <= 0.0 || fy_ <= 0.0) {
+    return false;
+  }
+  x_.resize(info.width);
+  y_.resize(info.height);
+  for (size_t u = 0; u < x_.size(); ++u) {
+    x_[u] = static_cast<float>((static_cast<double>(u) - cx_) / fx_);
+  }
+  for (size_t v = 0; v < y_.size(); ++v) {
+    y_[v] = static_cast<float>((static_cast<double>(v) - cy_) / fy_);
+  }
+  return true;
+}
+
+bool DepthRays::matches(const sensor_msgs::CameraInfo& info) const {
+  double fx, fy, cx, cy;
+  getIntrinsics(info, fx, fy, cx, cy);
+  return !empty() && info.width == x_.size() && info.height == y_.size() &&
+         fx == fx_ && fy == fy_ && cx == cx_ && cy == cy_;
+}
+
+bool depthImageScale(const std::string& encoding, float& scale) {
+  if (encoding == sensor_msgs::image_encodings::TYPE_16UC1) {
+    scale = 0.001f;
+    return true;
+  }
+  if (encoding == sensor_msgs::image_encodings::TYPE_32FC1) {
+    scale = 1.f;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace avoidance
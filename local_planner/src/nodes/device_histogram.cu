@@ -0,0 +1,191 @@
+#include "local_planner/device_histogram.h"
+
+#include <cuda_runtime.h>
+
+#include <math.h>
+
+namespace avoidance {
+
+namespace {
+// same polynomial as fastAtan2 in polar_binning.cpp, so that a voxel falls
+// into the same bin on the device and on the CPU
+__device__ float deviceAtan2(float y, float x) {
+  const float a1 = 0.9998660f;
+  const float a3 = -0.3302995f;
+  const float a5 = 0.1801410f;
+  const float a7 = -0.0851330f;
+  const float a9 = 0.0208351f;
+  const float pi = 3.14159265358979323846f;
+  const float ax = fabsf(x);
+  const float ay = fabsf(y);
+  const float mx = fmaxf(ax, ay);
+  const float a = mx > 0.0f ? fminf(ax, ay) / mx : 0.0f;
+  const float s = a * a;
+  float r = a * (a1 + s * (a3 + s * (a5 + s * (a7 + s * a9))));
+  if (ay > ax) r = 0.5f * pi - r;
+  if (x < 0.0f) r = pi - r;
+  if (y < 0.0f) r = -r;
+  return r;
+}
+
+struct DeviceBinning {
+  float rad_to_bin;
+  float e_offset;
+  float z_offset;
+  int e_max;
+  int z_max;
+  int z_dim;
+  int bins;
+};
+
+// One thread per voxel and histogram, blockIdx.y selects the origin
+__global__ void binVoxels(const float* x, const float* y, const float* z,
+                          const int* count, int n, const float* origins,
+                          DeviceBinning c, int* counter, float* dist_sum) {
+  const int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= n) return;
+  const int o = blockIdx.y;
+  const float dx = x[i] - origins[3 * o];
+  const float dy = y[i] - origins[3 * o + 1];
+  const float dz = z[i] - origins[3 * o + 2];
+  const float dxy2 = dx * dx + dy * dy;
+  const float e = deviceAtan2(dz, sqrtf(dxy2));
+  const float az = deviceAtan2(dx, dy);
+  int e_idx = static_cast<int>(floorf(e * c.rad_to_bin + c.e_offset));
+  int z_idx = static_cast<int>(floorf(az * c.rad_to_bin + c.z_offset));
+  if (z_idx > c.z_max) z_idx -= c.z_dim;
+  e_idx = min(max(e_idx, 0), c.e_max);
+  z_idx = min(max(z_idx, 0), c.z_max);
+  const int bin = o * c.bins + e_idx * c.z_dim + z_idx;
+  const float dist = sqrtf(dxy2 + dz * dz);
+  atomicAdd(counter + bin, count[i]);
+  atomicAdd(dist_sum + bin, count[i] * dist);
+}
+
+__global__ void meanDistance(const int* counter, const float* dist_sum,
+                             int n, float* dist) {
+  const int i = blockIdx.x * blockDim.x + threadIdx.x;
+  if (i >= n) return;
+  dist[i] = counter[i] > 0 ? dist_sum[i] / counter[i] : 0.f;
+}
+
+const int THREADS_PER_BLOCK = 256;
+
+// Replaces a device array with one of n elements, the content is not kept
+template <typename T>
+bool resizeDevice(T*& data, size_t n) {
+  cudaFree(data);
+  data = nullptr;
+  return cudaMalloc(&data, n * sizeof(T)) == cudaSuccess;
+}
+}
+
+struct DeviceHistogramBuffers {
+  float* x = nullptr;
+  float* y = nullptr;
+  float* z = nullptr;
+  int* count = nullptr;
+  size_t voxel_capacity = 0;
+  size_t n_voxels = 0;
+
+  float* origins = nullptr;
+  size_t origin_capacity = 0;
+  int* counter = nullptr;
+  float* dist_sum = nullptr;
+  float* dist = nullptr;
+  size_t bin_capacity = 0;
+};
+
+DeviceHistogramBuffers* createDeviceHistogramBuffers() {
+  int n_devices = 0;
+  if (cudaGetDeviceCount(&n_devices) != cudaSuccess || n_devices == 0) {
+    return nullptr;
+  }
+  return new DeviceHistogramBuffers();
+}
+
+void destroyDeviceHistogramBuffers(DeviceHistogramBuffers* buffers) {
+  if (!buffers) return;
+  cudaFree(buffers->x);
+  cudaFree(buffers->y);
+  cudaFree(buffers->z);
+  cudaFree(buffers->count);
+  cudaFree(buffers->origins);
+  cudaFree(buffers->counter);
+  cudaFree(buffers->dist_sum);
+  cudaFree(buffers->dist);
+  delete buffers;
+}
+
+bool uploadDeviceVoxels(DeviceHistogramBuffers& b, const float* x,
+                        const float* y, const float* z, const int* count,
+                        size_t n) {
+  b.n_voxels = 0;
+  if (n > b.voxel_capacity) {
+    b.voxel_capacity = 0;
+    if (!resizeDevice(b.x, n) || !resizeDevice(b.y, n) ||
+        !resizeDevice(b.z, n) || !resizeDevice(b.count, n)) {
+      return false;
+    }
+    b.voxel_capacity = n;
+  }
+  const size_t bytes = n * sizeof(float);
+  if (cudaMemcpy(b.x, x, bytes, cudaMemcpyHostToDevice) != cudaSuccess ||
+      cudaMemcpy(b.y, y, bytes, cudaMemcpyHostToDevice) != cudaSuccess ||
+      cudaMemcpy(b.z, z, bytes, cudaMemcpyHostToDevice) != cudaSuccess ||
+      cudaMemcpy(b.count, count, n * sizeof(int), cudaMemcpyHostToDevice) !=
+          cudaSuccess) {
+    return false;
+  }
+  b.n_voxels = n;
+  return true;
+}
+
+bool buildDeviceHistograms(DeviceHistogramBuffers& b, const float* origins,
+                           size_t n_origins, int res, float* dist) {
+  DeviceBinning c;
+  c.rad_to_bin = 180.0f / 3.14159265358979323846f / res;
+  c.e_offset = 90.0f / res;
+  c.z_offset = 180.0f / res;
+  c.e_max = 180 / res - 1;
+  c.z_max = 360 / res - 1;
+  c.z_dim = 360 / res;
+  c.bins = (180 / res) * c.z_dim;
+  const size_t n_bins = n_origins * c.bins;
+
+  if (n_bins > b.bin_capacity) {
+    b.bin_capacity = 0;
+    if (!resizeDevice(b.counter, n_bins) ||
+        !resizeDevice(b.dist_sum, n_bins) || !resizeDevice(b.dist, n_bins)) {
+      return false;
+    }
+    b.bin_capacity = n_bins;
+  }
+  if (n_origins > b.origin_capacity) {
+    b.origin_capacity = 0;
+    if (!resizeDevice(b.origins, 3 * n_origins)) return false;
+    b.origin_capacity = n_origins;
+  }
+  if (cudaMemcpy(b.origins, origins, 3 * n_origins * sizeof(float),
+                 cudaMemcpyHostToDevice) != cudaSuccess ||
+      cudaMemset(b.counter, 0, n_bins * sizeof(int)) != cudaSuccess ||
+      cudaMemset(b.dist_sum, 0, n_bins * sizeof(float)) != cudaSuccess) {
+    return false;
+  }
+
+  if (b.n_voxels > 0) {
+    dim3 grid((b.n_voxels + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK,
+              n_origins);
+    binVoxels<<<grid, THREADS_PER_BLOCK>>>(b.x, b.y, b.z, b.count,
+                                           static_cast<int>(b.n_voxels),
+                                           b.origins, c, b.counter,
+                                           b.dist_sum);
+  }
+  meanDistance<<<(n_bins + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK,
+                 THREADS_PER_BLOCK>>>(b.counter, b.dist_sum,
+                                      static_cast<int>(n_bins), b.dist);
+  return cudaGetLastError() == cudaSuccess &&
+         cudaMemcpy(dist, b.dist, n_bins * sizeof(float),
+                    cudaMemcpyDeviceToHost) == cudaSuccess;
+}
+}
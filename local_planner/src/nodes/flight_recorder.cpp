@@ -0,0 +1,354 @@
+#include "local_planner/flight_recorder.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace avoidance {
+
+namespace {
+
+const char kMagic[8] = {'L', 'P', 'F', 'L', 'I', 'G', 'H', 'T'};
+const uint32_t kVersion = 2;
+const size_t kStageCount = static_cast<size_t>(PlannerStage::count);
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t num_frames;
+  uint64_t frame_capacity;
+};
+
+struct SlotHeader {
+  uint64_t sequence;  // 0 while the frame is empty or being written
+  uint64_t size;
+  uint32_t checksum;
+  uint32_t reserved;
+};
+
+struct FrameHeader {
+  double stamp;
+  float position[3];
+  float velocity[3];
+  float goal[3];
+  float last_sent_waypoint[3];
+  float yaw;
+  float pitch;
+  float ground_distance;
+  float h_fov;
+  float v_fov;
+  uint32_t flags;
+  int32_t waypoint_type;
+  int32_t histogram_resolution;
+  uint32_t num_cells;
+  uint32_t num_candidates;
+  uint32_t num_points;
+  float stage_ms[kStageCount];
+};
+
+const uint32_t kArmed = 1;
+const uint32_t kOffboard = 2;
+const uint32_t kMission = 4;
+
+// the candidates and the points are stored as they are laid out in memory,
+// a point includes the padding of PCL
+const size_t kCandidateSize = sizeof(candidateDirection);
+const size_t kPointSize = sizeof(pcl::PointXYZ);
+
+static_assert(kCandidateSize == 3 * sizeof(float) &&
+                  kPointSize % sizeof(float) == 0,
+              "candidates and points are copied as blocks of floats");
+
+static_assert(sizeof(RecordedCell) == 4 && sizeof(FrameHeader) % 4 == 0,
+              "the payload is checked in 32 bit words");
+
+size_t payloadSize(size_t num_cells, size_t num_candidates,
+                   size_t num_points) {
+  return sizeof(FrameHeader) + num_cells * sizeof(RecordedCell) +
+         num_candidates * kCandidateSize + num_points * kPointSize;
+}
+
+// FNV-1a over 32 bit words, the frames are only checked for torn writes
+uint32_t checksum(const char* data, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i + 4 <= size; i += 4) {
+    uint32_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * 16777619u;
+  }
+  return hash;
+}
+
+size_t slotSize(size_t frame_capacity) {
+  return sizeof(SlotHeader) + frame_capacity;
+}
+
+void toArray(const Eigen::Vector3f& v, float* out) {
+  out[0] = v.x();
+  out[1] = v.y();
+  out[2] = v.z();
+}
+
+bool readHeader(int fd, FileHeader& header) {
+  struct stat st;
+  return fstat(fd, &st) == 0 &&
+         static_cast<size_t>(st.st_size) >= sizeof(FileHeader) &&
+         pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+         std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+         header.version == kVersion && header.frame_capacity % 8 == 0 &&
+         header.num_frames > 0 &&
+         static_cast<size_t>(st.st_size) ==
+             sizeof(FileHeader) +
+                 header.num_frames * slotSize(header.frame_capacity);
+}
+}
+
+FlightRecorder::~FlightRecorder() { close(); }
+
+bool FlightRecorder::open(const std::string& path, size_t num_frames,
+                          size_t frame_capacity) {
+  close();
+  num_frames = std::max<size_t>(1, num_frames);
+  frame_capacity =
+      (std::max(frame_capacity, sizeof(FrameHeader)) + 7) & ~size_t(7);
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  // keep the frames of an existing recording of the same format and size
+  FileHeader header;
+  bool keep = readHeader(fd_, header) && header.num_frames == num_frames &&
+              header.frame_capacity == frame_capacity;
+  size_t size = sizeof(FileHeader) + num_frames * slotSize(frame_capacity);
+  if (!keep && ftruncate(fd_, size) != 0) {
+    close();
+    return false;
+  }
+  void* data =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    close();
+    return false;
+  }
+  data_ = static_cast<char*>(data);
+  size_ = size;
+  num_frames_ = num_frames;
+  frame_capacity_ = frame_capacity;
+
+  if (keep) {
+    for (size_t i = 0; i < num_frames_; i++) {
+      SlotHeader slot_header;
+      std::memcpy(&slot_header,
+                  data_ + sizeof(FileHeader) + i * slotSize(frame_capacity_),
+                  sizeof(slot_header));
+      sequence_ = std::max(sequence_, slot_header.sequence);
+    }
+    return true;
+  }
+
+  header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_frames = num_frames_;
+  header.frame_capacity = frame_capacity_;
+  std::memcpy(data_, &header, sizeof(header));
+  SlotHeader empty = {};
+  for (size_t i = 0; i < num_frames_; i++) {
+    std::memcpy(data_ + sizeof(FileHeader) + i * slotSize(frame_capacity_),
+                &empty, sizeof(empty));
+  }
+  return true;
+}
+
+void FlightRecorder::close() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  fd_ = -1;
+  data_ = nullptr;
+  size_ = 0;
+  num_frames_ = 0;
+  frame_capacity_ = 0;
+  sequence_ = 0;
+  truncated_frames_ = 0;
+}
+
+size_t FlightRecorder::pointCapacity(size_t num_cells,
+                                     size_t num_candidates) const {
+  const size_t used = sizeof(FrameHeader) + num_cells * sizeof(RecordedCell) +
+                      num_candidates * kCandidateSize;
+  return used < frame_capacity_ ? (frame_capacity_ - used) / kPointSize : 0;
+}
+
+bool FlightRecorder::write(const FlightFrame& frame,
+                           const std::vector<candidateDirection>& candidates,
+                           const pcl::PointCloud<pcl::PointXYZ>& cloud) {
+  if (!isOpen()) {
+    return false;
+  }
+
+  // the histogram is always kept, what is left of the frame goes to the
+  // candidates and then to the points
+  size_t available = frame_capacity_ - sizeof(FrameHeader);
+  const size_t num_cells = std::min(frame.histogram.size(),
+                                    available / sizeof(RecordedCell));
+  available -= num_cells * sizeof(RecordedCell);
+  const size_t num_candidates =
+      std::min(candidates.size(), available / kCandidateSize);
+  available -= num_candidates * kCandidateSize;
+  const size_t num_points =
+      std::min(cloud.points.size(), available / kPointSize);
+  if (num_cells < frame.histogram.size() ||
+      num_candidates < candidates.size() ||
+      num_points < cloud.points.size()) {
+    truncated_frames_++;
+  }
+
+  // the frame is marked empty until it is complete
+  const uint64_t sequence = sequence_ + 1;
+  char* out = data_ + sizeof(FileHeader) +
+              (sequence % num_frames_) * slotSize(frame_capacity_);
+  SlotHeader slot_header = {};
+  std::memcpy(out, &slot_header, sizeof(slot_header));
+
+  char* payload = out + sizeof(SlotHeader);
+  FrameHeader frame_header = {};
+  frame_header.stamp = frame.stamp;
+  toArray(frame.position, frame_header.position);
+  toArray(frame.velocity, frame_header.velocity);
+  toArray(frame.goal, frame_header.goal);
+  toArray(frame.last_sent_waypoint, frame_header.last_sent_waypoint);
+  frame_header.yaw = frame.yaw;
+  frame_header.pitch = frame.pitch;
+  frame_header.ground_distance = frame.ground_distance;
+  frame_header.h_fov = frame.h_fov;
+  frame_header.v_fov = frame.v_fov;
+  frame_header.flags = (frame.armed ? kArmed : 0) |
+                       (frame.offboard ? kOffboard : 0) |
+                       (frame.mission ? kMission : 0);
+  frame_header.waypoint_type = frame.waypoint_type;
+  frame_header.histogram_resolution = frame.histogram_resolution;
+  frame_header.num_cells = static_cast<uint32_t>(num_cells);
+  frame_header.num_candidates = static_cast<uint32_t>(num_candidates);
+  frame_header.num_points = static_cast<uint32_t>(num_points);
+  std::copy(frame.stage_ms.begin(), frame.stage_ms.end(),
+            frame_header.stage_ms);
+  std::memcpy(payload, &frame_header, sizeof(frame_header));
+
+  char* end = payload + sizeof(frame_header);
+  std::memcpy(end, frame.histogram.data(), num_cells * sizeof(RecordedCell));
+  end += num_cells * sizeof(RecordedCell);
+  std::memcpy(end, candidates.data(), num_candidates * kCandidateSize);
+  end += num_candidates * kCandidateSize;
+  std::memcpy(end, cloud.points.data(), num_points * kPointSize);
+  end += num_points * kPointSize;
+
+  // the checksum reads the slot back while it is still in the cache, it is
+  // what tells a frame torn by a power loss from a complete one
+  const size_t size = end - payload;
+  slot_header.size = size;
+  slot_header.checksum = checksum(payload, size);
+  slot_header.sequence = sequence;
+  std::memcpy(out, &slot_header, sizeof(slot_header));
+  sequence_ = sequence;
+  return true;
+}
+
+bool readFlightRecording(const std::string& path,
+                         std::vector<FlightFrame>& frames) {
+  frames.clear();
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  FileHeader header;
+  if (!readHeader(fd, header)) {
+    ::close(fd);
+    return false;
+  }
+  const size_t size = sizeof(FileHeader) +
+                      header.num_frames * slotSize(header.frame_capacity);
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  // complete frames, ordered by their sequence number
+  std::vector<std::pair<uint64_t, const char*>> payloads;
+  for (size_t i = 0; i < header.num_frames; i++) {
+    const char* in = static_cast<const char*>(data) + sizeof(FileHeader) +
+                     i * slotSize(header.frame_capacity);
+    SlotHeader slot_header;
+    std::memcpy(&slot_header, in, sizeof(slot_header));
+    if (slot_header.sequence == 0 ||
+        slot_header.size < sizeof(FrameHeader) ||
+        slot_header.size > header.frame_capacity) {
+      continue;
+    }
+    FrameHeader frame_header;
+    std::memcpy(&frame_header, in + sizeof(SlotHeader),
+                sizeof(frame_header));
+    if (slot_header.size != payloadSize(frame_header.num_cells,
+                                        frame_header.num_candidates,
+                                        frame_header.num_points) ||
+        slot_header.checksum !=
+            checksum(in + sizeof(SlotHeader), slot_header.size)) {
+      continue;
+    }
+    payloads.emplace_back(slot_header.sequence, in + sizeof(SlotHeader));
+  }
+  std::sort(payloads.begin(), payloads.end());
+
+  frames.resize(payloads.size());
+  for (size_t i = 0; i < payloads.size(); i++) {
+    FlightFrame& frame = frames[i];
+    FrameHeader frame_header;
+    std::memcpy(&frame_header, payloads[i].second, sizeof(frame_header));
+    frame.stamp = frame_header.stamp;
+    frame.position = Eigen::Vector3f(frame_header.position);
+    frame.velocity = Eigen::Vector3f(frame_header.velocity);
+    frame.goal = Eigen::Vector3f(frame_header.goal);
+    frame.last_sent_waypoint =
+        Eigen::Vector3f(frame_header.last_sent_waypoint);
+    frame.yaw = frame_header.yaw;
+    frame.pitch = frame_header.pitch;
+    frame.ground_distance = frame_header.ground_distance;
+    frame.h_fov = frame_header.h_fov;
+    frame.v_fov = frame_header.v_fov;
+    frame.armed = (frame_header.flags & kArmed) != 0;
+    frame.offboard = (frame_header.flags & kOffboard) != 0;
+    frame.mission = (frame_header.flags & kMission) != 0;
+    frame.waypoint_type =
+        static_cast<waypoint_choice>(frame_header.waypoint_type);
+    frame.histogram_resolution = frame_header.histogram_resolution;
+    std::copy(frame_header.stage_ms, frame_header.stage_ms + kStageCount,
+              frame.stage_ms.begin());
+
+    const char* in = payloads[i].second + sizeof(frame_header);
+    frame.histogram.resize(frame_header.num_cells);
+    std::memcpy(frame.histogram.data(), in,
+                frame_header.num_cells * sizeof(RecordedCell));
+    in += frame_header.num_cells * sizeof(RecordedCell);
+    frame.candidates.assign(frame_header.num_candidates,
+                            candidateDirection(0.f, 0.f, 0.f));
+    std::memcpy(frame.candidates.data(), in,
+                frame_header.num_candidates * kCandidateSize);
+    in += frame_header.num_candidates * kCandidateSize;
+    frame.cloud.resize(frame_header.num_points);
+    std::memcpy(frame.cloud.points.data(), in,
+                frame_header.num_points * kPointSize);
+  }
+  munmap(data, size);
+  return true;
+}
+}
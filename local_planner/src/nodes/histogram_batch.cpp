@@ -0,0 +1,74 @@
+#include "local_planner/histogram_batch.h"
+
+#include <algorithm>
+
+#ifdef LOCAL_PLANNER_CUDA
+#include "local_planner/device_histogram.h"
+
+#include <ros/console.h>
+#endif
+
+namespace avoidance {
+
+void DeviceHistogramDeleter::operator()(
+    DeviceHistogramBuffers* buffers) const {
+#ifdef LOCAL_PLANNER_CUDA
+  destroyDeviceHistogramBuffers(buffers);
+#endif
+}
+
+HistogramBatch::HistogramBatch() {
+#ifdef LOCAL_PLANNER_CUDA
+  device_.reset(createDeviceHistogramBuffers());
+  if (!device_) {
+    ROS_WARN("[HistogramBatch] No CUDA device, using the CPU histograms");
+  }
+#endif
+}
+
+void HistogramBatch::setVoxels(const VoxelIndex& voxels) {
+  voxels_ = &voxels;
+#ifdef LOCAL_PLANNER_CUDA
+  if (device_ &&
+      !uploadDeviceVoxels(*device_, voxels.x().data(), voxels.y().data(),
+                          voxels.z().data(), voxels.count().data(),
+                          voxels.size())) {
+    ROS_WARN("[HistogramBatch] Voxel upload failed, using the CPU histograms");
+    device_.reset();
+  }
+#endif
+}
+
+void HistogramBatch::build(
+    const std::vector<Eigen::Vector3f>& origins,
+    const std::vector<Histogram<ALPHA_RES>*>& histograms) {
+#ifdef LOCAL_PLANNER_CUDA
+  if (device_) {
+    origin_buffer_.resize(3 * origins.size());
+    for (size_t i = 0; i < origins.size(); i++) {
+      origin_buffer_[3 * i] = origins[i].x();
+      origin_buffer_[3 * i + 1] = origins[i].y();
+      origin_buffer_[3 * i + 2] = origins[i].z();
+    }
+    const size_t bins = GRID_LENGTH_E * GRID_LENGTH_Z;
+    dist_buffer_.resize(bins * origins.size());
+    if (buildDeviceHistograms(*device_, origin_buffer_.data(), origins.size(),
+                              ALPHA_RES, dist_buffer_.data())) {
+      for (size_t i = 0; i < origins.size(); i++) {
+        const float* dist = dist_buffer_.data() + i * bins;
+        for (int e = 0; e < GRID_LENGTH_E; e++) {
+          std::copy(dist + e * GRID_LENGTH_Z, dist + (e + 1) * GRID_LENGTH_Z,
+                    histograms[i]->dist_row(e));
+        }
+      }
+      return;
+    }
+    ROS_WARN("[HistogramBatch] Kernel failed, using the CPU histograms");
+    device_.reset();
+  }
+#endif
+  for (size_t i = 0; i < origins.size(); i++) {
+    generateNewHistogram(*histograms[i], *voxels_, origins[i], workspace_);
+  }
+}
+}
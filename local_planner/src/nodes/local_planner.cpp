@@ -2,6 +2,7 @@
 
 #include "local_planner/common.h"
 #include "local_planner/planner_functions.h"
+#include "local_planner/stage_timer.h"
 #include "local_planner/star_planner.h"
 #include "local_planner/tree_node.h"
 
@@ -40,6 +41,7 @@ void LocalPlanner::dynamicReconfigureSetParams(
       static_cast<float>(config.velocity_far_from_obstacles_);
   keep_distance_ = config.keep_distance_;
   reproj_age_ = static_cast<float>(config.reproj_age_);
+  memory_confidence_decay_ = config.memory_confidence_decay_;
   velocity_sigmoid_slope_ = static_cast<float>(config.velocity_sigmoid_slope_);
   no_progress_slope_ = static_cast<float>(config.no_progress_slope_);
   min_cloud_size_ = config.min_cloud_size_;
@@ -51,6 +53,15 @@ void LocalPlanner::dynamicReconfigureSetParams(
   n_expanded_nodes_ = config.n_expanded_nodes_;
   smoothing_margin_degrees_ =
       static_cast<float>(config.smoothing_margin_degrees_);
+  tree_voxel_size_ = static_cast<float>(config.tree_voxel_size_);
+  cloud_voxel_size_ = static_cast<float>(config.cloud_voxel_size_);
+  max_cloud_points_ = config.max_cloud_points_;
+  depth_image_stride_ = config.depth_image_stride_;
+  lazy_cost_matrix_ = config.lazy_cost_matrix_;
+  adaptive_resolution_ = config.adaptive_resolution_;
+  fine_resolution_distance_ =
+      static_cast<float>(config.fine_resolution_distance_);
+  fine_resolution_sector_ = static_cast<float>(config.fine_resolution_sector_);
 
   if (getGoal().z() != config.goal_z_param) {
     auto goal = getGoal();
@@ -84,51 +95,156 @@ void LocalPlanner::applyGoal() {
   goal_dist_incline_.clear();
 }
 
+size_t LocalPlanner::numCameras() const {
+  return std::max(complete_cloud_.size(),
+                  std::max(complete_cloud_msgs_.size(),
+                           complete_depth_images_.size()));
+}
+
 void LocalPlanner::runPlanner() {
   stop_in_front_active_ = false;
 
   ROS_INFO("\033[1;35m[OA] Planning started, using %i cameras\n \033[0m",
-           static_cast<int>(complete_cloud_.size()));
+           static_cast<int>(numCameras()));
 
-  // calculate Field of View
-  z_FOV_idx_.clear();
-  calculateFOV(h_FOV_, v_FOV_, z_FOV_idx_, e_FOV_min_, e_FOV_max_,
-               curr_yaw_fcu_frame_, curr_pitch_fcu_frame_);
+  preparePointCloud(final_cloud_, fov_, histogram_box_, closest_point_,
+                    distance_to_closest_point_, counter_close_points_backoff_);
 
-  histogram_box_.setBoxLimits(position_, ground_distance_);
+  determineStrategy();
+}
 
-  filterPointCloud(final_cloud_, closest_point_, distance_to_closest_point_,
-                   counter_close_points_backoff_, complete_cloud_,
-                   min_cloud_size_, min_dist_backoff_, histogram_box_,
-                   position_, min_realsense_dist_);
+void LocalPlanner::runObstacleDistance() {
+  // the cloud, FOV, box and back off state only follow the clouds the
+  // planner plans with, they are visualized and recorded after it ran
+  FOV fov;
+  Box box = histogram_box_;
+  Eigen::Vector3f closest_point;
+  float distance_to_closest_point;
+  int counter_close_points_backoff = counter_close_points_backoff_;
+  preparePointCloud(obstacle_distance_cloud_, fov, box, closest_point,
+                    distance_to_closest_point, counter_close_points_backoff);
+
+  Histogram<ALPHA_RES> propagated_histogram;
+  Histogram<ALPHA_RES> new_histogram;
+  propagateHistogram(propagated_histogram, obstacle_memory_, position_,
+                     propagation_workspace_);
+  generateNewHistogram(new_histogram, obstacle_distance_cloud_, position_,
+                       histogram_pool_.get(), histogram_workspaces_);
+  bool hist_is_empty;
+  combinedHistogram(hist_is_empty, new_histogram, propagated_histogram,
+                    waypoint_outside_FOV_, fov);
+  to_fcu_histogram_.setZero();
+  compressHistogramElevation(to_fcu_histogram_, new_histogram);
+  updateObstacleDistanceMsg(to_fcu_histogram_, fov);
+}
 
-  determineStrategy();
+void LocalPlanner::preparePointCloud(pcl::PointCloud<pcl::PointXYZ> &cloud,
+                                     FOV &fov, Box &box,
+                                     Eigen::Vector3f &closest_point,
+                                     float &distance_to_closest_point,
+                                     int &counter_close_points_backoff) {
+  // calculate Field of View
+  bool has_camera_fov =
+      complete_depth_images_.empty()
+          ? calculateFOV(camera_FOVs_, complete_cloud_msgs_,
+                         complete_cloud_transforms_, fov)
+          : calculateFOV(camera_FOVs_, complete_depth_images_,
+                         complete_cloud_transforms_, fov);
+  if (!has_camera_fov) {
+    calculateFOV(h_FOV_, v_FOV_, fov, curr_yaw_fcu_frame_,
+                 curr_pitch_fcu_frame_);
+  }
+
+  // the clouds of several cameras are binned concurrently
+  size_t n_cameras = numCameras();
+  size_t n_workers =
+      std::min<size_t>(n_cameras, std::thread::hardware_concurrency());
+  n_workers = n_workers > 1 ? n_workers - 1 : 0;
+  if (shared_pool_) {
+    // the shared pool serves all the cameras
+  } else if (n_workers == 0) {
+    histogram_pool_.reset();
+  } else if (!histogram_pool_ || histogram_pool_->size() != n_workers) {
+    histogram_pool_.reset(new ThreadPool(n_workers));
+  }
+
+  box.setBoxLimits(position_, ground_distance_);
+
+  {
+    ScopedStageTimer timer(PlannerStage::filterPointCloud);
+    if (!complete_depth_images_.empty()) {
+      filterPointCloud(cloud, closest_point, distance_to_closest_point,
+                       counter_close_points_backoff, complete_depth_images_,
+                       complete_depth_rays_, complete_cloud_transforms_,
+                       depth_image_stride_, min_cloud_size_, min_dist_backoff_,
+                       box, position_, min_realsense_dist_);
+    } else if (!complete_cloud_msgs_.empty()) {
+      filterPointCloud(cloud, closest_point, distance_to_closest_point,
+                       counter_close_points_backoff, complete_cloud_msgs_,
+                       complete_cloud_transforms_, min_cloud_size_,
+                       min_dist_backoff_, box, position_, min_realsense_dist_);
+    } else {
+      filterPointCloud(cloud, closest_point, distance_to_closest_point,
+                       counter_close_points_backoff, complete_cloud_,
+                       min_cloud_size_, min_dist_backoff_, box, position_,
+                       min_realsense_dist_);
+    }
+  }
+  {
+    ScopedStageTimer timer(PlannerStage::downsample);
+    downsamplePointCloud(cloud, position_, cloud_voxel_size_,
+                         static_cast<size_t>(std::max(0, max_cloud_points_)),
+                         downsample_workspace_);
+  }
 }
 
 void LocalPlanner::create2DObstacleRepresentation(const bool send_to_fcu) {
   // construct histogram if it is needed
   // or if it is required by the FCU
-  reprojectPoints(polar_histogram_);
-  Histogram propagated_histogram = Histogram(2 * ALPHA_RES);
-  Histogram new_histogram = Histogram(ALPHA_RES);
+  Histogram<ALPHA_RES> propagated_histogram;
+  Histogram<ALPHA_RES> new_histogram;
   to_fcu_histogram_.setZero();
 
-  propagateHistogram(propagated_histogram, reprojected_points_,
-                     reprojected_points_age_, position_);
-  generateNewHistogram(new_histogram, final_cloud_, position_);
-  combinedHistogram(hist_is_empty_, new_histogram, propagated_histogram,
-                    waypoint_outside_FOV_, z_FOV_idx_, e_FOV_min_, e_FOV_max_);
+  // the current frame replaces the remembered obstacles inside the FOV, the
+  // memory is kept in world frame and binned around the current position
+  {
+    ScopedStageTimer timer(PlannerStage::propagation);
+    obstacle_memory_.update(final_cloud_voxels_, position_, fov_,
+                            !waypoint_outside_FOV_, reproj_age_,
+                            2.0f * histogram_box_.radius_,
+                            memory_confidence_decay_);
+    propagateHistogram(propagated_histogram, obstacle_memory_, position_,
+                       propagation_workspace_);
+  }
+  {
+    ScopedStageTimer timer(PlannerStage::histogram);
+    generateNewHistogram(new_histogram, final_cloud_, position_,
+                         histogram_pool_.get(), histogram_workspaces_);
+    combinedHistogram(hist_is_empty_, new_histogram, propagated_histogram,
+                      waypoint_outside_FOV_, fov_);
+  }
   if (send_to_fcu) {
     compressHistogramElevation(to_fcu_histogram_, new_histogram);
-    updateObstacleDistanceMsg(to_fcu_histogram_);
+    updateObstacleDistanceMsg(to_fcu_histogram_, fov_);
+  }
+  // the FCU always gets the full resolution
+  if (adaptive_resolution_) {
+    adaptHistogramResolution(new_histogram, position_, goal_,
+                             fine_resolution_distance_,
+                             fine_resolution_sector_);
   }
   polar_histogram_ = new_histogram;
 
   // generate histogram image for logging
-  generateHistogramImage(polar_histogram_);
+  if (generate_histogram_image_) {
+    generateHistogramImage(polar_histogram_);
+  } else {
+    histogram_image_data_.clear();
+  }
 }
 
-void LocalPlanner::generateHistogramImage(Histogram &histogram) {
+void LocalPlanner::generateHistogramImage(
+    const Histogram<ALPHA_RES>& histogram) {
   histogram_image_data_.clear();
   histogram_image_data_.reserve(GRID_LENGTH_E * GRID_LENGTH_Z);
 
@@ -146,9 +262,19 @@ void LocalPlanner::generateHistogramImage(Histogram &histogram) {
 void LocalPlanner::determineStrategy() {
   star_planner_->tree_age_++;
 
+  // only the costmap strategy chooses from candidates, the other ones must
+  // not be recorded with the candidates of an earlier iteration
+  candidate_vector_.clear();
+
+  // the obstacle memory and the tree nodes use the voxels of the cloud, which
+  // are built only once per frame
+  final_cloud_voxels_.build(final_cloud_, tree_voxel_size_);
+
   // clear cost image
   cost_image_data_.clear();
-  cost_image_data_.resize(3 * GRID_LENGTH_E * GRID_LENGTH_Z, 0);
+  if (generate_cost_image_) {
+    cost_image_data_.resize(3 * GRID_LENGTH_E * GRID_LENGTH_Z, 0);
+  }
 
   if (disable_rise_to_goal_altitude_) {
     reach_altitude_ = true;
@@ -215,17 +341,25 @@ void LocalPlanner::determineStrategy() {
 
         float yaw_angle_histogram_frame =
             std::round((-curr_yaw_fcu_frame_ * 180.0f / M_PI_F)) + 90.0f;
-        getCostMatrix(
-            polar_histogram_, goal_, position_, yaw_angle_histogram_frame,
-            last_sent_waypoint_, cost_params_, velocity_.norm() < 0.1f,
-            smoothing_margin_degrees_, cost_matrix_, cost_image_data_);
+        // the tree computes its own costs, so without visualization the
+        // cost matrix of the current position is only needed for the best
+        // direction
+        bool full_cost_matrix = generate_cost_image_ || !lazy_cost_matrix_;
+        if (full_cost_matrix) {
+          ScopedStageTimer timer(PlannerStage::costMatrix);
+          getCostMatrix(polar_histogram_, goal_, position_,
+                        yaw_angle_histogram_frame, last_sent_waypoint_,
+                        cost_params_, velocity_.norm() < 0.1f,
+                        smoothing_margin_degrees_, cost_matrix_,
+                        cost_workspace_,
+                        generate_cost_image_ ? &cost_image_data_ : nullptr);
+        }
 
         if (use_VFH_star_) {
           star_planner_->setParams(cost_params_);
           star_planner_->setFOV(h_FOV_, v_FOV_);
-          star_planner_->setReprojectedPoints(reprojected_points_,
-                                              reprojected_points_age_);
-          star_planner_->setCloud(final_cloud_);
+          star_planner_->setObstacleMemory(obstacle_memory_);
+          star_planner_->setCloud(final_cloud_, final_cloud_voxels_);
 
           // set last chosen direction for smoothing
           PolarPoint last_wp_pol =
@@ -241,7 +375,15 @@ void LocalPlanner::determineStrategy() {
           waypoint_type_ = tryPath;
           last_path_time_ = ros::Time::now();
         } else {
-          getBestCandidatesFromCostMatrix(cost_matrix_, 1, candidate_vector_);
+          if (full_cost_matrix) {
+            getBestCandidatesFromCostMatrix(cost_matrix_, 1, candidate_vector_);
+          } else {
+            ScopedStageTimer timer(PlannerStage::costMatrix);
+            getBestCandidatesFromHistogram(
+                polar_histogram_, goal_, position_, yaw_angle_histogram_frame,
+                last_sent_waypoint_, cost_params_, smoothing_margin_degrees_, 1,
+                cost_workspace_, candidate_vector_);
+          }
 
           if (candidate_vector_.empty()) {
             stopInFrontObstacles();
@@ -264,117 +406,41 @@ void LocalPlanner::determineStrategy() {
   position_old_ = position_;
 }
 
-void LocalPlanner::updateObstacleDistanceMsg(Histogram hist) {
-  sensor_msgs::LaserScan msg = {};
-  msg.header.stamp = ros::Time::now();
-  msg.header.frame_id = "local_origin";
-  msg.angle_increment = static_cast<double>(ALPHA_RES) * M_PI / 180.0;
-  msg.range_min = 0.2f;
-  msg.range_max = 20.0f;
+void LocalPlanner::updateObstacleDistanceMsg(const Histogram<ALPHA_RES>& hist,
+                                             const FOV& fov) {
+  // the message is filled in place, its ranges keep their storage
+  updateObstacleDistanceMsg();
+  distance_data_.ranges.resize(GRID_LENGTH_Z);
 
   // turn idxs 180 degress to point to local north instead of south
-  std::vector<int> z_FOV_idx_north;
-  z_FOV_idx_north.reserve(z_FOV_idx_.size());
-
-  for (size_t i = 0; i < z_FOV_idx_.size(); i++) {
-    int new_idx = z_FOV_idx_[i] + GRID_LENGTH_Z / 2;
-
-    if (new_idx >= GRID_LENGTH_Z) {
-      new_idx = new_idx - GRID_LENGTH_Z;
-    }
-
-    z_FOV_idx_north.push_back(new_idx);
-  }
-
-  msg.ranges.reserve(GRID_LENGTH_Z);
   for (int idx = 0; idx < GRID_LENGTH_Z; idx++) {
     float range;
+    int hist_idx = idx - GRID_LENGTH_Z / 2;
 
-    if (std::find(z_FOV_idx_north.begin(), z_FOV_idx_north.end(), idx) ==
-        z_FOV_idx_north.end()) {
+    if (hist_idx < 0) {
+      hist_idx = hist_idx + GRID_LENGTH_Z;
+    }
+
+    if (!fov.containsAzimuth(hist_idx)) {
       range = UINT16_MAX;
+    } else if (hist.get_dist(0, hist_idx) == 0.0f) {
+      range = distance_data_.range_max + 1.0f;
     } else {
-      int hist_idx = idx - GRID_LENGTH_Z / 2;
-
-      if (hist_idx < 0) {
-        hist_idx = hist_idx + GRID_LENGTH_Z;
-      }
-
-      if (hist.get_dist(0, hist_idx) == 0.0f) {
-        range = msg.range_max + 1.0f;
-      } else {
-        range = hist.get_dist(0, hist_idx);
-      }
+      range = hist.get_dist(0, hist_idx);
     }
 
-    msg.ranges.push_back(range);
+    distance_data_.ranges[idx] = range;
   }
-
-  distance_data_ = msg;
 }
 
 void LocalPlanner::updateObstacleDistanceMsg() {
-  sensor_msgs::LaserScan msg = {};
+  sensor_msgs::LaserScan &msg = distance_data_;
   msg.header.stamp = ros::Time::now();
   msg.header.frame_id = "local_origin";
   msg.angle_increment = static_cast<double>(ALPHA_RES) * M_PI / 180.0;
   msg.range_min = 0.2f;
   msg.range_max = 20.0f;
-
-  distance_data_ = msg;
-}
-
-// get 3D points from old histogram
-void LocalPlanner::reprojectPoints(Histogram histogram) {
-  float dist;
-  int age;
-  // ALPHA_RES%2=0 as per definition, see histogram.h
-  int half_res = ALPHA_RES / 2;
-  Eigen::Vector3f temp_array[4];
-
-  std::array<PolarPoint, 4> p_pol;
-  reprojected_points_age_.clear();
-
-  reprojected_points_.points.clear();
-  reprojected_points_.header.stamp = final_cloud_.header.stamp;
-  reprojected_points_.header.frame_id = "local_origin";
-
-  for (int e = 0; e < GRID_LENGTH_E; e++) {
-    for (int z = 0; z < GRID_LENGTH_Z; z++) {
-      if (histogram.get_dist(e, z) > FLT_MIN) {
-        for (auto &i : p_pol) {
-          i.r = histogram.get_dist(e, z);
-          i = histogramIndexToPolar(e, z, ALPHA_RES, i.r);
-        }
-        // transform from array index to angle
-        p_pol[0].e += half_res;
-        p_pol[0].z += half_res;
-        p_pol[1].e -= half_res;
-        p_pol[1].z += half_res;
-        p_pol[2].e += half_res;
-        p_pol[2].z -= half_res;
-        p_pol[3].e -= half_res;
-        p_pol[3].z -= half_res;
-
-        // transform from Polar to Cartesian
-        temp_array[0] = polarToCartesian(p_pol[0], position_old_);
-        temp_array[1] = polarToCartesian(p_pol[1], position_old_);
-        temp_array[2] = polarToCartesian(p_pol[2], position_old_);
-        temp_array[3] = polarToCartesian(p_pol[3], position_old_);
-
-        for (int i = 0; i < 4; i++) {
-          dist = (position_ - temp_array[i]).norm();
-          age = histogram.get_age(e, z);
-
-          if (dist < 2.0f * histogram_box_.radius_ && dist > 0.3f &&
-              age < reproj_age_) {
-            reprojected_points_.points.push_back(toXYZ(temp_array[i]));
-            reprojected_points_age_.push_back(age);
-          }
-        }
-      }
-    }
-  }
+  msg.ranges.clear();
 }
 
 // calculate the correct weight between fly over and fly around
@@ -447,20 +513,29 @@ Eigen::Vector3f LocalPlanner::getPosition() { return position_; }
 
 void LocalPlanner::getCloudsForVisualization(
     pcl::PointCloud<pcl::PointXYZ> &final_cloud,
-    pcl::PointCloud<pcl::PointXYZ> &reprojected_points) {
+    pcl::PointCloud<pcl::PointXYZ> &reprojected_points,
+    bool get_reprojected_points) {
   final_cloud = final_cloud_;
-  reprojected_points = reprojected_points_;
+  reprojected_points.points.clear();
+  if (get_reprojected_points) {
+    obstacle_memory_.toCloud(reprojected_points);
+  }
+  reprojected_points.header.stamp = final_cloud_.header.stamp;
+  reprojected_points.header.frame_id = "local_origin";
 }
 
 void LocalPlanner::setCurrentVelocity(const Eigen::Vector3f &vel) {
   velocity_ = vel;
 }
 
-void LocalPlanner::getTree(std::vector<TreeNode> &tree,
-                           std::vector<int> &closed_set,
+void LocalPlanner::getTree(std::vector<Eigen::Vector3f> &tree_edges,
                            std::vector<Eigen::Vector3f> &path_node_positions) {
-  tree = star_planner_->tree_;
-  closed_set = star_planner_->closed_set_;
+  const std::vector<TreeNode> &tree = star_planner_->tree_;
+  tree_edges.clear();
+  for (int node_nr : star_planner_->closed_set_) {
+    tree_edges.push_back(tree[node_nr].getPosition());
+    tree_edges.push_back(tree[tree[node_nr].origin_].getPosition());
+  }
   path_node_positions = star_planner_->path_node_positions_;
 }
 
@@ -489,4 +564,69 @@ avoidanceOutput LocalPlanner::getAvoidanceOutput() {
   out.path_node_positions = star_planner_->path_node_positions_;
   return out;
 }
+
+void LocalPlanner::getSnapshot(PlannerSnapshot &snapshot) const {
+  snapshot.goal = goal_;
+  snapshot.take_off_pose = take_off_pose_;
+  snapshot.reach_altitude = reach_altitude_;
+  snapshot.obstacle_memory = obstacle_memory_;
+}
+
+void LocalPlanner::restoreSnapshot(const PlannerSnapshot &snapshot) {
+  obstacle_memory_ = snapshot.obstacle_memory;
+  take_off_pose_ = snapshot.take_off_pose;
+  reach_altitude_ = snapshot.reach_altitude;
+  setGoal(snapshot.goal);
+}
+
+bool LocalPlanner::writeFlightFrame(FlightRecorder &recorder,
+                                    FlightFrame &frame) {
+  frame.position = position_;
+  frame.velocity = velocity_;
+  frame.goal = goal_;
+  frame.last_sent_waypoint = last_sent_waypoint_;
+  frame.yaw = curr_yaw_fcu_frame_;
+  frame.pitch = curr_pitch_fcu_frame_;
+  frame.ground_distance = ground_distance_;
+  frame.h_fov = h_FOV_;
+  frame.v_fov = v_FOV_;
+  frame.armed = currently_armed_;
+  frame.offboard = offboard_;
+  frame.mission = mission_;
+  frame.waypoint_type = waypoint_type_;
+
+  // distances are stored in cm, the ages are not needed for a replay
+  frame.histogram_resolution = ALPHA_RES;
+  frame.histogram.clear();
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    const float *dist = polar_histogram_.dist_row(e);
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      if (dist[z] > 0.f) {
+        RecordedCell cell;
+        cell.index = static_cast<uint16_t>(e * GRID_LENGTH_Z + z);
+        cell.distance_cm = static_cast<uint16_t>(
+            std::min(dist[z] * 100.f + 0.5f, 65535.f));
+        frame.histogram.push_back(cell);
+      }
+    }
+  }
+
+  // a cloud which is not downsampled by the planner rarely fits into a frame,
+  // the histogram built from the recorded one has the same occupied bins
+  const size_t max_points =
+      recorder.pointCapacity(frame.histogram.size(), candidate_vector_.size());
+  if (final_cloud_.points.size() <= max_points) {
+    return recorder.write(frame, candidate_vector_, final_cloud_);
+  }
+  recorded_cloud_.points = final_cloud_.points;
+  downsamplePointCloud(recorded_cloud_, position_, 0.f,
+                       std::max<size_t>(1, max_points), recorded_workspace_);
+  return recorder.write(frame, candidate_vector_, recorded_cloud_);
+}
+
+void LocalPlanner::setThreadPool(const std::shared_ptr<ThreadPool> &pool) {
+  shared_pool_ = static_cast<bool>(pool);
+  histogram_pool_ = pool;
+  star_planner_->setThreadPool(pool);
+}
 }
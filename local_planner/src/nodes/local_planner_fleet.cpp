@@ -0,0 +1,90 @@
+#include "local_planner/local_planner_node.h"
+#include "local_planner/thread_pool.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace avoidance {
+
+/**
+* @brief one vehicle of the fleet, its callbacks are served from its own queue
+*        so that a busy vehicle does not delay the messages of the others
+**/
+struct FleetVehicle {
+  ros::CallbackQueue callback_queue;
+  std::unique_ptr<LocalPlannerNode> node;
+  bool started = false;
+};
+}
+
+/**
+* @brief hosts the planners of several vehicles in one process, e.g. for a
+*        SITL fleet on a few cores
+* @details all planners share one transform listener and one pool of workers
+*          which runs their planner and visualization iterations. The main
+*          thread is the frame scheduler, it serves the callbacks of every
+*          vehicle in turn, starts the vehicles whose inputs arrived and
+*          steps the started vehicles whose setpoint is due
+**/
+int main(int argc, char** argv) {
+  using namespace avoidance;
+  ros::init(argc, argv, "local_planner_fleet");
+  ros::NodeHandle nh("~");
+
+  // namespaces of the vehicles, the parameters of a vehicle are read from
+  // ~<namespace>/ and its topics are resolved in /<namespace>/
+  std::vector<std::string> namespaces;
+  nh.getParam("vehicles", namespaces);
+  if (namespaces.empty()) {
+    ROS_ERROR("\033[1;35m[OA] No vehicles given in ~vehicles \033[0m");
+    return 1;
+  }
+  int n_threads = 0;
+  nh.param<int>("threads", n_threads, 0);
+  if (n_threads <= 0) {
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // the pool and the listener outlive the vehicles which use them
+  std::shared_ptr<ThreadPool> pool(new ThreadPool(n_threads));
+  tf::TransformListener tf_listener(
+      ros::Duration(tf::Transformer::DEFAULT_CACHE_TIME), true);
+
+  std::vector<std::unique_ptr<FleetVehicle>> vehicles;
+  for (const std::string& ns : namespaces) {
+    std::unique_ptr<FleetVehicle> vehicle(new FleetVehicle());
+    ros::NodeHandle private_nh(nh, ns);
+    private_nh.setCallbackQueue(&vehicle->callback_queue);
+    ros::NodeHandle topic_nh(private_nh, "/" + ns);
+    vehicle->node.reset(
+        new LocalPlannerNode(private_nh, topic_nh, &tf_listener, pool));
+    vehicles.push_back(std::move(vehicle));
+  }
+  ROS_INFO("\033[1;35m[OA] Hosting %zu planners on %d threads \033[0m",
+           vehicles.size(), n_threads);
+
+  // the vehicles wait for their inputs concurrently, the scheduler serves the
+  // ones which are not started next to the started ones
+  while (ros::ok()) {
+    bool stepped = false;
+    for (std::unique_ptr<FleetVehicle>& vehicle : vehicles) {
+      if (!vehicle->started) {
+        vehicle->started = vehicle->node->startOnce(vehicle->callback_queue);
+        continue;
+      }
+      stepped = vehicle->node->spinOnce(vehicle->callback_queue) || stepped;
+    }
+    // nothing was due, the setpoints are at most this late
+    if (!stepped) {
+      ros::WallDuration(0.001).sleep();
+    }
+  }
+
+  for (std::unique_ptr<FleetVehicle>& vehicle : vehicles) {
+    vehicle->node->stop();
+  }
+  return 0;
+}
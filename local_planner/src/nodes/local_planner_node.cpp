@@ -2,27 +2,70 @@
 
 #include "local_planner/local_planner.h"
 #include "local_planner/planner_functions.h"
+#include "local_planner/realtime.h"
+#include "local_planner/thread_pool.h"
 #include "local_planner/tree_node.h"
 #include "local_planner/waypoint_generator.h"
 
 #include <boost/algorithm/string.hpp>
 
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <cstdlib>
+#include <map>
 #include <mutex>
 #include <string>
 #include <thread>
 
 namespace avoidance {
 
-LocalPlannerNode::LocalPlannerNode(const bool tf_spin_thread) {
+LocalPlannerNode::LocalPlannerNode(const bool tf_spin_thread)
+    : LocalPlannerNode(ros::NodeHandle("~"), tf_spin_thread) {}
+
+LocalPlannerNode::LocalPlannerNode(const ros::NodeHandle& nh,
+                                   const bool tf_spin_thread)
+    : LocalPlannerNode(nh, ros::NodeHandle(nh, "/"), nullptr, nullptr,
+                       tf_spin_thread) {}
+
+LocalPlannerNode::LocalPlannerNode(const ros::NodeHandle& nh,
+                                   const ros::NodeHandle& topic_nh,
+                                   tf::TransformListener* tf_listener,
+                                   const std::shared_ptr<ThreadPool>& pool,
+                                   const bool tf_spin_thread)
+    : nh_(nh), topic_nh_(topic_nh), hosted_(static_cast<bool>(pool)) {
   local_planner_.reset(new LocalPlanner());
   wp_generator_.reset(new WaypointGenerator());
-  nh_ = ros::NodeHandle("~");
   readParams();
 
-  tf_listener_ = new tf::TransformListener(
-      ros::Duration(tf::Transformer::DEFAULT_CACHE_TIME), tf_spin_thread);
+  if (hosted_) {
+    // the planners of all vehicles in the process share the workers
+    cloud_pool_ = pool;
+    local_planner_->setThreadPool(pool);
+  } else {
+    // one worker per camera, the clouds are prepared concurrently
+    cloud_pool_.reset(new ThreadPool(std::min<size_t>(
+        cameras_.size(), std::max(1u, std::thread::hardware_concurrency()))));
+  }
+
+  if (!tf_listener) {
+    own_tf_listener_.reset(new tf::TransformListener(
+        ros::Duration(tf::Transformer::DEFAULT_CACHE_TIME), tf_spin_thread));
+    tf_listener = own_tf_listener_.get();
+  }
+  tf_listener_ = tf_listener;
+
+  // the vehicles of a host are told apart by the namespace of their topics
+  diagnostics_name_ = "local_planner";
+  if (hosted_) {
+    diagnostics_name_ += " " + topic_nh_.getNamespace();
+  }
 
   // Set up Dynamic Reconfigure Server
   server_ = new dynamic_reconfigure::Server<avoidance::LocalPlannerNodeConfig>(
@@ -41,87 +84,100 @@ LocalPlannerNode::LocalPlannerNode(const bool tf_spin_thread) {
     dynamicReconfigureCallback(rqt_param_config_, 1);
   }
 
-  // initialize subscribers and publishers
-  pose_sub_ = nh_.subscribe<const geometry_msgs::PoseStamped&>(
-      "/mavros/local_position/pose", 1, &LocalPlannerNode::positionCallback,
+  // initialize subscribers and publishers, the topic names are relative to
+  // the namespace of the vehicle
+  pose_sub_ = topic_nh_.subscribe<const geometry_msgs::PoseStamped&>(
+      "mavros/local_position/pose", 1, &LocalPlannerNode::positionCallback,
       this);
-  velocity_sub_ = nh_.subscribe<const geometry_msgs::TwistStamped&>(
-      "/mavros/local_position/velocity_local", 1,
+  velocity_sub_ = topic_nh_.subscribe<const geometry_msgs::TwistStamped&>(
+      "mavros/local_position/velocity_local", 1,
       &LocalPlannerNode::velocityCallback, this);
-  state_sub_ =
-      nh_.subscribe("/mavros/state", 1, &LocalPlannerNode::stateCallback, this);
-  clicked_point_sub_ = nh_.subscribe(
-      "/clicked_point", 1, &LocalPlannerNode::clickedPointCallback, this);
+  state_sub_ = topic_nh_.subscribe("mavros/state", 1,
+                                   &LocalPlannerNode::stateCallback, this);
+  clicked_point_sub_ = topic_nh_.subscribe(
+      "clicked_point", 1, &LocalPlannerNode::clickedPointCallback, this);
   clicked_goal_sub_ =
-      nh_.subscribe("/move_base_simple/goal", 1,
-                    &LocalPlannerNode::clickedGoalCallback, this);
-  fcu_input_sub_ = nh_.subscribe("/mavros/trajectory/desired", 1,
-                                 &LocalPlannerNode::fcuInputGoalCallback, this);
-  goal_topic_sub_ = nh_.subscribe("/input/goal_position", 1,
-                                  &LocalPlannerNode::updateGoalCallback, this);
-  distance_sensor_sub_ = nh_.subscribe(
-      "/mavros/altitude", 1, &LocalPlannerNode::distanceSensorCallback, this);
-  px4_param_sub_ = nh_.subscribe("/mavros/param/param_value", 1,
-                                 &LocalPlannerNode::px4ParamsCallback, this);
-
-  world_pub_ = nh_.advertise<visualization_msgs::MarkerArray>("/world", 1);
-  drone_pub_ = nh_.advertise<visualization_msgs::Marker>("/drone", 1);
-  local_pointcloud_pub_ =
-      nh_.advertise<pcl::PointCloud<pcl::PointXYZ>>("/local_pointcloud", 1);
+      topic_nh_.subscribe("move_base_simple/goal", 1,
+                          &LocalPlannerNode::clickedGoalCallback, this);
+  fcu_input_sub_ =
+      topic_nh_.subscribe("mavros/trajectory/desired", 1,
+                          &LocalPlannerNode::fcuInputGoalCallback, this);
+  goal_topic_sub_ =
+      topic_nh_.subscribe("input/goal_position", 1,
+                          &LocalPlannerNode::updateGoalCallback, this);
+  distance_sensor_sub_ = topic_nh_.subscribe(
+      "mavros/altitude", 1, &LocalPlannerNode::distanceSensorCallback, this);
+  px4_param_sub_ =
+      topic_nh_.subscribe("mavros/param/param_value", 1,
+                          &LocalPlannerNode::px4ParamsCallback, this);
+
+  world_pub_ =
+      topic_nh_.advertise<visualization_msgs::MarkerArray>("world", 1);
+  drone_pub_ = topic_nh_.advertise<visualization_msgs::Marker>("drone", 1);
+  local_pointcloud_pub_ = topic_nh_.advertise<pcl::PointCloud<pcl::PointXYZ>>(
+      "local_pointcloud", 1);
   reprojected_points_pub_ =
-      nh_.advertise<pcl::PointCloud<pcl::PointXYZ>>("/reprojected_points", 1);
+      topic_nh_.advertise<pcl::PointCloud<pcl::PointXYZ>>(
+          "reprojected_points", 1);
   bounding_box_pub_ =
-      nh_.advertise<visualization_msgs::MarkerArray>("/bounding_box", 1);
+      topic_nh_.advertise<visualization_msgs::MarkerArray>("bounding_box", 1);
   ground_measurement_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/ground_measurement", 1);
+      topic_nh_.advertise<visualization_msgs::Marker>("ground_measurement", 1);
   original_wp_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/original_waypoint", 1);
+      topic_nh_.advertise<visualization_msgs::Marker>("original_waypoint", 1);
   adapted_wp_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/adapted_waypoint", 1);
+      topic_nh_.advertise<visualization_msgs::Marker>("adapted_waypoint", 1);
   smoothed_wp_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/smoothed_waypoint", 1);
+      topic_nh_.advertise<visualization_msgs::Marker>("smoothed_waypoint", 1);
   complete_tree_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/complete_tree", 1);
-  tree_path_pub_ = nh_.advertise<visualization_msgs::Marker>("/tree_path", 1);
+      topic_nh_.advertise<visualization_msgs::Marker>("complete_tree", 1);
+  tree_path_pub_ =
+      topic_nh_.advertise<visualization_msgs::Marker>("tree_path", 1);
   marker_goal_pub_ =
-      nh_.advertise<visualization_msgs::MarkerArray>("/goal_position", 1);
+      topic_nh_.advertise<visualization_msgs::MarkerArray>("goal_position", 1);
   path_actual_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/path_actual", 1);
+      topic_nh_.advertise<visualization_msgs::Marker>("path_actual", 1);
   path_waypoint_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/path_waypoint", 1);
-  path_adapted_waypoint_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/path_adapted_waypoint", 1);
-  mavros_vel_setpoint_pub_ = nh_.advertise<geometry_msgs::Twist>(
-      "/mavros/setpoint_velocity/cmd_vel_unstamped", 10);
-  mavros_pos_setpoint_pub_ = nh_.advertise<geometry_msgs::PoseStamped>(
-      "/mavros/setpoint_position/local", 10);
-  mavros_obstacle_free_path_pub_ = nh_.advertise<mavros_msgs::Trajectory>(
-      "/mavros/trajectory/generated", 10);
+      topic_nh_.advertise<visualization_msgs::Marker>("path_waypoint", 1);
+  path_adapted_waypoint_pub_ = topic_nh_.advertise<visualization_msgs::Marker>(
+      "path_adapted_waypoint", 1);
+  mavros_vel_setpoint_pub_ = topic_nh_.advertise<geometry_msgs::Twist>(
+      "mavros/setpoint_velocity/cmd_vel_unstamped", 10);
+  mavros_pos_setpoint_pub_ = topic_nh_.advertise<geometry_msgs::PoseStamped>(
+      "mavros/setpoint_position/local", 10);
+  mavros_obstacle_free_path_pub_ =
+      topic_nh_.advertise<mavros_msgs::Trajectory>(
+          "mavros/trajectory/generated", 10);
   mavros_obstacle_distance_pub_ =
-      nh_.advertise<sensor_msgs::LaserScan>("/mavros/obstacle/send", 10);
+      topic_nh_.advertise<sensor_msgs::LaserScan>("mavros/obstacle/send", 10);
   mavros_system_status_pub_ =
-      nh_.advertise<mavros_msgs::CompanionProcessStatus>(
-          "/mavros/companion_process/status", 1);
+      topic_nh_.advertise<mavros_msgs::CompanionProcessStatus>(
+          "mavros/companion_process/status", 1);
   current_waypoint_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/current_setpoint", 1);
+      topic_nh_.advertise<visualization_msgs::Marker>("current_setpoint", 1);
   takeoff_pose_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/take_off_pose", 1);
+      topic_nh_.advertise<visualization_msgs::Marker>("take_off_pose", 1);
   initial_height_pub_ =
-      nh_.advertise<visualization_msgs::Marker>("/initial_height", 1);
+      topic_nh_.advertise<visualization_msgs::Marker>("initial_height", 1);
   histogram_image_pub_ =
-      nh_.advertise<sensor_msgs::Image>("/histogram_image", 1);
-  cost_image_pub_ = nh_.advertise<sensor_msgs::Image>("/cost_image", 1);
+      topic_nh_.advertise<sensor_msgs::Image>("histogram_image", 1);
+  cost_image_pub_ = topic_nh_.advertise<sensor_msgs::Image>("cost_image", 1);
+  latency_pub_ =
+      topic_nh_.advertise<std_msgs::Float64>("sensor_to_setpoint_latency", 1);
+  stage_timing_pub_ =
+      topic_nh_.advertise<diagnostic_msgs::DiagnosticArray>("diagnostics", 1);
   mavros_set_mode_client_ =
-      nh_.serviceClient<mavros_msgs::SetMode>("/mavros/set_mode");
+      topic_nh_.serviceClient<mavros_msgs::SetMode>("mavros/set_mode");
   get_px4_param_client_ =
-      nh_.serviceClient<mavros_msgs::ParamGet>("/mavros/param/get");
+      topic_nh_.serviceClient<mavros_msgs::ParamGet>("mavros/param/get");
 
   local_planner_->applyGoal();
 }
 
 LocalPlannerNode::~LocalPlannerNode() {
+  stage_timings_.setTraceEnabled(false);
+  stage_trace_writer_.close();
   delete server_;
-  delete tf_listener_;
 }
 
 void LocalPlannerNode::readParams() {
@@ -134,17 +190,122 @@ void LocalPlannerNode::readParams() {
                   disable_rise_to_goal_altitude_, false);
   nh_.param<bool>("accept_goal_input_topic", accept_goal_input_topic_, false);
 
+  // depth images are binned without the conversion to pointclouds
   std::vector<std::string> camera_topics;
-  nh_.getParam("pointcloud_topics", camera_topics);
-  initializeCameraSubscribers(camera_topics);
+  nh_.getParam("depth_image_topics", camera_topics);
+  bool depth_images = !camera_topics.empty();
+  if (!depth_images) {
+    nh_.getParam("pointcloud_topics", camera_topics);
+  }
+  initializeCameraSubscribers(camera_topics, depth_images);
 
   nh_.param<std::string>("world_name", world_path_, "");
+
+  // optional trace of the planner stages for chrome://tracing
+  std::string stage_trace_file;
+  nh_.param<std::string>("stage_trace_file", stage_trace_file, "");
+  if (!stage_trace_file.empty()) {
+    if (stage_trace_writer_.open(stage_trace_file)) {
+      stage_timings_.setTraceEnabled(true);
+      ROS_INFO("\033[1;35m[OA] Writing stage trace to %s \033[0m",
+               stage_trace_file.c_str());
+    } else {
+      ROS_WARN("\033[1;35m[OA] Cannot open stage trace file %s \033[0m",
+               stage_trace_file.c_str());
+    }
+  }
   goal_msg_.pose.position = goal;
+
+  // the clouds are transformed with the vehicle pose and static extrinsics
+  // of the cameras instead of TF lookups of every cloud
+  nh_.param<bool>("cache_extrinsics", cache_extrinsics_, true);
+  nh_.param<std::string>("body_frame", body_frame_, "fcu");
+  nh_.param<std::string>("world_frame", world_frame_, "/local_origin");
+
+  // optional snapshot of the obstacle memory for a warm restart
+  std::string snapshot_file;
+  nh_.param<std::string>("snapshot_file", snapshot_file, "");
+  nh_.param<double>("snapshot_period", snapshot_period_, 1.0);
+  nh_.param<double>("snapshot_max_age", snapshot_max_age_, 10.0);
+  nh_.param<double>("startup_timeout", startup_timeout_, 2.0);
+  if (!snapshot_file.empty() && !snapshot_file_.open(snapshot_file)) {
+    ROS_WARN("\033[1;35m[OA] Cannot open snapshot file %s \033[0m",
+             snapshot_file.c_str());
+  }
+
+  // always-on recording of the latest planner iterations into the ROS home
+  // directory, the vehicles of a host write to files of their own
+  std::string flight_recorder_dir;
+  if (const char* ros_home = std::getenv("ROS_HOME")) {
+    flight_recorder_dir = ros_home;
+  } else if (const char* home = std::getenv("HOME")) {
+    flight_recorder_dir = std::string(home) + "/.ros";
+  } else {
+    flight_recorder_dir = "/tmp";
+  }
+  std::string flight_recorder_file =
+      flight_recorder_dir + "/local_planner_flight.rec";
+  if (hosted_) {
+    std::string vehicle = topic_nh_.getNamespace();
+    std::replace(vehicle.begin(), vehicle.end(), '/', '_');
+    flight_recorder_file =
+        flight_recorder_dir + "/local_planner" + vehicle + "_flight.rec";
+  }
+  int flight_recorder_frames, flight_recorder_frame_kb;
+  nh_.param<std::string>("flight_recorder_file", flight_recorder_file,
+                         flight_recorder_file);
+  nh_.param<int>("flight_recorder_frames", flight_recorder_frames, 300);
+  nh_.param<int>("flight_recorder_frame_kb", flight_recorder_frame_kb, 64);
+  if (!flight_recorder_file.empty() &&
+      !flight_recorder_.open(flight_recorder_file,
+                             std::max(1, flight_recorder_frames),
+                             std::max(1, flight_recorder_frame_kb) * 1024)) {
+    ROS_WARN("\033[1;35m[OA] Cannot open flight recorder %s \033[0m",
+             flight_recorder_file.c_str());
+  }
+
+  // opt-in real time scheduling of the planner and ingest threads
+  nh_.param<bool>("realtime_profile", realtime_profile_, false);
+  nh_.getParam("planner_cpus", planner_profile_.cpus);
+  nh_.param<int>("planner_priority", planner_profile_.priority, 50);
+  nh_.getParam("ingest_cpus", ingest_profile_.cpus);
+  nh_.param<int>("ingest_priority", ingest_profile_.priority, 40);
+  nh_.param<bool>("lock_memory", lock_memory_, true);
+  nh_.param<int>("realtime_warmup", realtime_warmup_, 20);
+
+  // longest expected durations of the stages [ms], longer ones are reported
+  std::map<std::string, double> deadlines;
+  if (!nh_.getParam("stage_deadlines", deadlines)) {
+    deadlines[stageName(PlannerStage::planner)] = 100.0;
+  }
+  for (int i = 0; i < static_cast<int>(PlannerStage::count); i++) {
+    PlannerStage stage = static_cast<PlannerStage>(i);
+    auto deadline = deadlines.find(stageName(stage));
+    if (deadline != deadlines.end()) {
+      stage_timings_.setDeadline(stage, deadline->second);
+    }
+  }
+}
+
+// applies a thread profile of the real time profile, failures only degrade
+// the latency so the node keeps running
+static void applyRealtimeProfile(const ThreadProfile& profile,
+                                 const char* thread) {
+  std::string error;
+  if (applyThreadProfile(profile, error)) {
+    ROS_INFO("\033[1;35m[OA] Real time profile of the %s thread applied "
+             "\033[0m",
+             thread);
+  } else {
+    ROS_WARN("\033[1;35m[OA] Real time profile of the %s thread: %s \033[0m",
+             thread, error.c_str());
+  }
 }
 
 void LocalPlannerNode::initializeCameraSubscribers(
-    std::vector<std::string>& camera_topics) {
+    std::vector<std::string>& camera_topics, bool depth_images) {
   cameras_.resize(camera_topics.size());
+  depth_image_input_ = depth_images;
 
   // create sting containing the topic with the camera info from
   // the pointcloud topic
@@ -153,9 +314,16 @@ void LocalPlannerNode::initializeCameraSubscribers(
   std::vector<std::string> camera_info(camera_topics.size(), s);
 
   for (size_t i = 0; i < camera_topics.size(); i++) {
-    cameras_[i].pointcloud_sub_ = nh_.subscribe<sensor_msgs::PointCloud2>(
-        camera_topics[i], 1,
-        boost::bind(&LocalPlannerNode::pointCloudCallback, this, _1, i));
+    if (depth_images) {
+      cameras_[i].depth_image_sub_ = topic_nh_.subscribe<sensor_msgs::Image>(
+          camera_topics[i], 1,
+          boost::bind(&LocalPlannerNode::depthImageCallback, this, _1, i));
+    } else {
+      cameras_[i].pointcloud_sub_ =
+          topic_nh_.subscribe<sensor_msgs::PointCloud2>(
+              camera_topics[i], 1,
+              boost::bind(&LocalPlannerNode::pointCloudCallback, this, _1, i));
+    }
     cameras_[i].topic_ = camera_topics[i];
 
     // get each namespace in the pointcloud topic and construct the camera_info
@@ -167,9 +335,10 @@ void LocalPlannerNode::initializeCameraSubscribers(
       camera_info[i].append("/");
     }
     camera_info[i].append("camera_info");
-    cameras_[i].camera_info_sub_ = nh_.subscribe<sensor_msgs::CameraInfo>(
-        camera_info[i], 1,
-        boost::bind(&LocalPlannerNode::cameraInfoCallback, this, _1, i));
+    cameras_[i].camera_info_sub_ =
+        topic_nh_.subscribe<sensor_msgs::CameraInfo>(
+            camera_info[i], 1,
+            boost::bind(&LocalPlannerNode::cameraInfoCallback, this, _1, i));
   }
 }
 
@@ -181,103 +350,289 @@ size_t LocalPlannerNode::numReceivedClouds() {
   return num_received_clouds;
 }
 
+bool LocalPlannerNode::isCloudUsable(size_t index,
+                                     const ros::Time& now) const {
+  const std_msgs::Header* header = cameras_[index].newestHeader();
+  if (!header) {
+    return false;
+  }
+  return avoidance::isCloudUsable(planning_trigger_,
+                                  (now - header->stamp).toSec(),
+                                  max_cloud_age_);
+}
+
 void LocalPlannerNode::updatePlanner() {
-  if (cameras_.size() == numReceivedClouds() && cameras_.size() != 0) {
+  ros::Time now = ros::Time::now();
+  size_t num_usable_clouds = 0;
+  for (size_t i = 0; i < cameras_.size(); i++) {
+    if (isCloudUsable(i, now)) num_usable_clouds++;
+  }
+
+  if (readyToPlan(planning_trigger_, cameras_.size(), numReceivedClouds(),
+                  num_usable_clouds, (now - last_plan_time_).toSec(),
+                  planning_rate_)) {
     if (canUpdatePlannerInfo()) {
-      if (running_mutex_.try_lock()) {
-        updatePlannerInfo();
-        // reset all clouds to not yet received
-        for (size_t i = 0; i < cameras_.size(); i++) {
-          cameras_[i].received_ = false;
-        }
-        wp_generator_->setPlannerInfo(local_planner_->getAvoidanceOutput());
-        if (local_planner_->stop_in_front_active_) {
-          goal_msg_.pose.position = toPoint(local_planner_->getGoal());
-        }
-        running_mutex_.unlock();
-        // Wake up the planner
-        std::unique_lock<std::mutex> lck(data_ready_mutex_);
-        data_ready_ = true;
-        data_ready_cv_.notify_one();
+      stageCameraClouds();
+      last_plan_time_ = now;
+      // the plan sends the obstacle distance of these clouds too
+      last_obstacle_distance_time_ = now;
+      obstacle_distance_cloud_stamp_ = newestUsableCloudStamp(now);
+      // reset all clouds to not yet received
+      for (size_t i = 0; i < cameras_.size(); i++) {
+        cameras_[i].received_ = false;
       }
+      // the snapshot replaces any previous one the planner has not picked up
+      // yet, so the planner always works on the newest data
+      planner_input_.back().obstacle_distance_only = false;
+      updatePlannerInfo();
+      wakePlanner();
+    }
+  } else if (obstacleDistanceDue(now) && canUpdatePlannerInfo()) {
+    // between the plans the planner only updates the obstacle distance, the
+    // received flags are left for the next plan
+    stageCameraClouds();
+    last_obstacle_distance_time_ = now;
+    planner_input_.back().obstacle_distance_only = true;
+    updatePlannerInfo();
+    wakePlanner();
+  }
+
+  // forward the newest planner result to the waypoint generator
+  if (planner_output_.fetch()) {
+    const plannerOutput& output = planner_output_.front();
+    wp_generator_->setPlannerInfo(output.avoidance_output);
+    if (output.stop_in_front_active) {
+      goal_msg_.pose.position = toPoint(output.goal);
+    }
+    planned_cloud_stamp_ = output.cloud_stamp;
+  }
+}
+
+bool LocalPlannerNode::obstacleDistanceDue(const ros::Time& now) {
+  if (!local_planner_->send_obstacles_fcu_ || obstacle_distance_rate_ <= 0.0 ||
+      planner_input_.pending() ||
+      (now - last_obstacle_distance_time_).toSec() <
+          1.0 / obstacle_distance_rate_) {
+    return false;
+  }
+
+  ros::Time newest_stamp = newestUsableCloudStamp(now);
+  if (newest_stamp <= obstacle_distance_cloud_stamp_) {
+    return false;
+  }
+  obstacle_distance_cloud_stamp_ = newest_stamp;
+  return true;
+}
+
+ros::Time LocalPlannerNode::newestUsableCloudStamp(
+    const ros::Time& now) const {
+  ros::Time newest_stamp;
+  for (size_t i = 0; i < cameras_.size(); i++) {
+    if (isCloudUsable(i, now) &&
+        cameras_[i].newestHeader()->stamp > newest_stamp) {
+      newest_stamp = cameras_[i].newestHeader()->stamp;
     }
   }
+  return newest_stamp;
 }
 
 bool LocalPlannerNode::canUpdatePlannerInfo() {
   // Check if we have a transformation available at the time of the current
   // point cloud
-  size_t missing_transforms = 0;
-  for (size_t i = 0; i < cameras_.size(); ++i) {
-    if (!tf_listener_->canTransform(
-            "/local_origin", cameras_[i].newest_cloud_msg_.header.frame_id,
-            ros::Time(0))) {
-      missing_transforms++;
-    }
+  ros::Time now = ros::Time::now();
+  return canStageClouds(
+      planning_trigger_, cameras_.size(),
+      [this, &now](size_t i) { return isCloudUsable(i, now); },
+      [this](size_t i) { return cloudTransform(i, nullptr); });
+}
+
+bool LocalPlannerNode::cloudTransform(size_t index,
+                                      Eigen::Affine3f* transform) {
+  cameraData& camera = cameras_[index];
+  const std_msgs::Header* header = camera.newestHeader();
+  if (!header) {
+    return false;
   }
+  try {
+    tf::StampedTransform tf_transform;
+    Eigen::Matrix4f matrix;
+    if (!cache_extrinsics_) {
+      if (!transform) {
+        return tf_listener_->canTransform(world_frame_, header->frame_id,
+                                          ros::Time(0));
+      }
+      tf_listener_->lookupTransform(world_frame_, header->frame_id,
+                                    header->stamp, tf_transform);
+      pcl_ros::transformAsMatrix(tf_transform, matrix);
+      transform->matrix() = matrix;
+      return true;
+    }
 
-  return missing_transforms == 0;
-}
-void LocalPlannerNode::updatePlannerInfo() {
-  // update the point cloud
-  local_planner_->complete_cloud_.clear();
-  for (size_t i = 0; i < cameras_.size(); ++i) {
-    pcl::PointCloud<pcl::PointXYZ> pcl_cloud;
-    try {
-      // transform message to pcl type
-      pcl::fromROSMsg(cameras_[i].newest_cloud_msg_, pcl_cloud);
-
-      // remove nan padding
-      std::vector<int> dummy_index;
-      dummy_index.reserve(pcl_cloud.points.size());
-      pcl::removeNaNFromPointCloud(pcl_cloud, pcl_cloud, dummy_index);
-
-      // transform cloud to /local_origin frame
-      pcl_ros::transformPointCloud("/local_origin", pcl_cloud, pcl_cloud,
-                                   *tf_listener_);
-
-      local_planner_->complete_cloud_.push_back(std::move(pcl_cloud));
-    } catch (tf::TransformException& ex) {
-      ROS_ERROR("Received an exception trying to transform a pointcloud: %s",
-                ex.what());
+    // the camera is fixed to the vehicle, only the vehicle pose changes
+    // between the clouds and it is taken from the pose messages
+    if (!camera.has_extrinsics_) {
+      if (!tf_listener_->canTransform(body_frame_, header->frame_id,
+                                      ros::Time(0))) {
+        return false;
+      }
+      tf_listener_->lookupTransform(body_frame_, header->frame_id,
+                                    ros::Time(0), tf_transform);
+      pcl_ros::transformAsMatrix(tf_transform, matrix);
+      camera.extrinsics_.matrix() = matrix;
+      camera.has_extrinsics_ = true;
+    }
+    Eigen::Affine3f pose;
+    if (!pose_buffer_.interpolate(header->stamp.toSec(), pose)) {
+      return false;
     }
+    if (transform) {
+      transform->matrix() = pose.matrix() * camera.extrinsics_.matrix();
+    }
+  } catch (tf::TransformException& ex) {
+    ROS_ERROR("Received an exception trying to transform a pointcloud: %s",
+              ex.what());
+    return false;
+  }
+  return true;
+}
+void LocalPlannerNode::stageCameraClouds() {
+  ScopedStageTimer timer(PlannerStage::ingest);
+  plannerInput& input = planner_input_.back();
+  input.cloud_msgs.resize(cameras_.size());
+  input.depth_images.resize(cameras_.size());
+  input.depth_rays.resize(cameras_.size());
+  input.cloud_transforms.resize(cameras_.size());
+  input.camera_FOVs.resize(cameras_.size());
+  for (size_t i = 0; i < cameras_.size(); i++) {
+    input.camera_FOVs[i] = cameras_[i].fov_;
   }
 
-  // update position
-  local_planner_->setPose(toEigen(newest_pose_.pose.position),
-                          toEigen(newest_pose_.pose.orientation));
+  // every camera writes only to its own slot, the order stays deterministic
+  ros::Time now = ros::Time::now();
+  cloud_pool_->parallelFor(cameras_.size(), [this, &input, &now](size_t i) {
+    sensor_msgs::PointCloud2::ConstPtr& cloud_msg = input.cloud_msgs[i];
+    sensor_msgs::Image::ConstPtr& depth_image = input.depth_images[i];
+    cloud_msg.reset();
+    depth_image.reset();
+    input.depth_rays[i].reset();
+    if (!isCloudUsable(i, now)) {
+      return;
+    }
+    // get transform from the camera frame to /local_origin at the time the
+    // cloud was taken, which also compensates the motion since then if a
+    // cloud is reused by the anyCamera and fixedRate triggers
+    if (!cloudTransform(i, &input.cloud_transforms[i])) {
+      return;
+    }
 
-  // Update velocity
-  local_planner_->setCurrentVelocity(toEigen(vel_msg_.twist.linear));
+    // share the message buffer with the subscriber instead of copying it
+    if (cameras_[i].newest_depth_msg_) {
+      depth_image = cameras_[i].newest_depth_msg_;
+      input.depth_rays[i] = cameras_[i].depth_rays_;
+    } else {
+      cloud_msg = cameras_[i].newest_cloud_msg_;
+    }
+  });
+
+  // the oldest cloud determines the age of the snapshot
+  input.cloud_stamp = ros::Time();
+  for (size_t i = 0; i < cameras_.size(); i++) {
+    ros::Time stamp;
+    if (input.depth_images[i]) {
+      stamp = input.depth_images[i]->header.stamp;
+    } else if (input.cloud_msgs[i]) {
+      stamp = input.cloud_msgs[i]->header.stamp;
+    }
+    if (!stamp.isZero() &&
+        (input.cloud_stamp.isZero() || stamp < input.cloud_stamp)) {
+      input.cloud_stamp = stamp;
+    }
+  }
+}
 
-  // update state
-  local_planner_->currently_armed_ = armed_;
-  local_planner_->offboard_ = offboard_;
-  local_planner_->mission_ = mission_;
+void LocalPlannerNode::updatePlannerInfo() {
+  plannerInput& input = planner_input_.back();
+
+  // update position, velocity and state
+  input.pose = newest_pose_;
+  input.velocity = vel_msg_;
+  input.armed = armed_;
+  input.offboard = offboard_;
+  input.mission = mission_;
 
   // update goal
   if (new_goal_) {
-    local_planner_->setGoal(toEigen(goal_msg_.pose.position));
+    goal_seq_++;
     new_goal_ = false;
   }
+  input.goal = goal_msg_.pose.position;
+  input.goal_seq = goal_seq_;
 
   // update ground distance
   if (ros::Time::now() - ground_distance_msg_.header.stamp <
       ros::Duration(0.5)) {
-    local_planner_->ground_distance_ = ground_distance_msg_.bottom_clearance;
+    input.ground_distance = ground_distance_msg_.bottom_clearance;
   } else {
-    local_planner_->ground_distance_ = 2.0;  // in case where no range data is
+    input.ground_distance = 2.0;  // in case where no range data is
     // available assume vehicle is close to ground
   }
 
   // update last sent waypoint
-  local_planner_->last_sent_waypoint_ = toEigen(newest_waypoint_position_);
+  input.last_sent_waypoint = newest_waypoint_position_;
+  input.last_adapted_waypoint = newest_adapted_waypoint_position_;
+
+  planner_input_.publish();
+}
+
+void LocalPlannerNode::applyPlannerInput(plannerInput& input) {
+  // hand the point clouds over to the planner, they are transformed and
+  // filtered in a single pass when the planner runs
+  local_planner_->complete_cloud_.clear();
+  std::swap(local_planner_->complete_cloud_msgs_, input.cloud_msgs);
+  std::swap(local_planner_->complete_cloud_transforms_, input.cloud_transforms);
+  bool has_depth_images = false;
+  for (const auto& depth_image : input.depth_images) {
+    has_depth_images |= static_cast<bool>(depth_image);
+  }
+  if (has_depth_images) {
+    std::swap(local_planner_->complete_depth_images_, input.depth_images);
+    std::swap(local_planner_->complete_depth_rays_, input.depth_rays);
+  } else {
+    local_planner_->complete_depth_images_.clear();
+    local_planner_->complete_depth_rays_.clear();
+  }
+  std::swap(local_planner_->camera_FOVs_, input.camera_FOVs);
+
+  // update state, before the position so that the take off pose of a
+  // restored snapshot is not reset in flight
+  local_planner_->currently_armed_ = input.armed;
+  local_planner_->offboard_ = input.offboard;
+  local_planner_->mission_ = input.mission;
+
+  // update position
+  local_planner_->setPose(toEigen(input.pose.pose.position),
+                          toEigen(input.pose.pose.orientation));
+
+  // Update velocity
+  local_planner_->setCurrentVelocity(toEigen(input.velocity.twist.linear));
+
+  // update goal
+  if (input.goal_seq != applied_goal_seq_) {
+    local_planner_->setGoal(toEigen(input.goal));
+    applied_goal_seq_ = input.goal_seq;
+  }
+
+  local_planner_->ground_distance_ = input.ground_distance;
+  local_planner_->last_sent_waypoint_ = toEigen(input.last_sent_waypoint);
 }
 
 void LocalPlannerNode::positionCallback(const geometry_msgs::PoseStamped& msg) {
   last_pose_ = newest_pose_;
   newest_pose_ = msg;
   position_received_ = true;
+  last_pose_time_ = ros::Time::now();
+  pose_buffer_.add(msg.header.stamp.toSec(), toEigen(msg.pose.position),
+                   toEigen(msg.pose.orientation));
 
 #ifndef DISABLE_SIMULATION
   // visualize drone in RVIZ
@@ -297,6 +652,7 @@ void LocalPlannerNode::velocityCallback(
 
 void LocalPlannerNode::stateCallback(const mavros_msgs::State& msg) {
   armed_ = msg.armed;
+  state_received_ = true;
 
   if (msg.mode == "AUTO.MISSION") {
     offboard_ = false;
@@ -310,71 +666,57 @@ void LocalPlannerNode::stateCallback(const mavros_msgs::State& msg) {
   }
 }
 
+// publishes a line strip segment from p1 to p2 if someone listens
+static void publishPathSegment(ros::Publisher& pub, int id, double width,
+                               double r, double g, double b,
+                               const geometry_msgs::Point& p1,
+                               const geometry_msgs::Point& p2) {
+  if (pub.getNumSubscribers() == 0) return;
+
+  visualization_msgs::Marker marker;
+  marker.header.frame_id = "local_origin";
+  marker.header.stamp = ros::Time::now();
+  marker.id = id;
+  marker.type = visualization_msgs::Marker::LINE_STRIP;
+  marker.action = visualization_msgs::Marker::ADD;
+  marker.pose.orientation.w = 1.0;
+  marker.scale.x = width;
+  marker.color.a = 1.0;
+  marker.color.r = r;
+  marker.color.g = g;
+  marker.color.b = b;
+
+  marker.points.push_back(p1);
+  marker.points.push_back(p2);
+  pub.publish(marker);
+}
+
 void LocalPlannerNode::publishPaths() {
   // publish actual path
-  visualization_msgs::Marker path_actual_marker;
-  path_actual_marker.header.frame_id = "local_origin";
-  path_actual_marker.header.stamp = ros::Time::now();
-  path_actual_marker.id = path_length_;
-  path_actual_marker.type = visualization_msgs::Marker::LINE_STRIP;
-  path_actual_marker.action = visualization_msgs::Marker::ADD;
-  path_actual_marker.pose.orientation.w = 1.0;
-  path_actual_marker.scale.x = 0.03;
-  path_actual_marker.color.a = 1.0;
-  path_actual_marker.color.r = 0.0;
-  path_actual_marker.color.g = 1.0;
-  path_actual_marker.color.b = 0.0;
-
-  path_actual_marker.points.push_back(last_pose_.pose.position);
-  path_actual_marker.points.push_back(newest_pose_.pose.position);
-  path_actual_pub_.publish(path_actual_marker);
+  publishPathSegment(path_actual_pub_, path_length_, 0.03, 0.0, 1.0, 0.0,
+                     last_pose_.pose.position, newest_pose_.pose.position);
 
   // publish path set by calculated waypoints
-  visualization_msgs::Marker path_waypoint_marker;
-  path_waypoint_marker.header.frame_id = "local_origin";
-  path_waypoint_marker.header.stamp = ros::Time::now();
-  path_waypoint_marker.id = path_length_;
-  path_waypoint_marker.type = visualization_msgs::Marker::LINE_STRIP;
-  path_waypoint_marker.action = visualization_msgs::Marker::ADD;
-  path_waypoint_marker.pose.orientation.w = 1.0;
-  path_waypoint_marker.scale.x = 0.02;
-  path_waypoint_marker.color.a = 1.0;
-  path_waypoint_marker.color.r = 1.0;
-  path_waypoint_marker.color.g = 0.0;
-  path_waypoint_marker.color.b = 0.0;
-
-  path_waypoint_marker.points.push_back(last_waypoint_position_);
-  path_waypoint_marker.points.push_back(newest_waypoint_position_);
-  path_waypoint_pub_.publish(path_waypoint_marker);
+  publishPathSegment(path_waypoint_pub_, path_length_, 0.02, 1.0, 0.0, 0.0,
+                     last_waypoint_position_, newest_waypoint_position_);
 
-  // publish path set by calculated waypoints
-  visualization_msgs::Marker path_adapted_waypoint_marker;
-  path_adapted_waypoint_marker.header.frame_id = "local_origin";
-  path_adapted_waypoint_marker.header.stamp = ros::Time::now();
-  path_adapted_waypoint_marker.id = path_length_;
-  path_adapted_waypoint_marker.type = visualization_msgs::Marker::LINE_STRIP;
-  path_adapted_waypoint_marker.action = visualization_msgs::Marker::ADD;
-  path_adapted_waypoint_marker.pose.orientation.w = 1.0;
-  path_adapted_waypoint_marker.scale.x = 0.02;
-  path_adapted_waypoint_marker.color.a = 1.0;
-  path_adapted_waypoint_marker.color.r = 0.0;
-  path_adapted_waypoint_marker.color.g = 0.0;
-  path_adapted_waypoint_marker.color.b = 1.0;
-
-  path_adapted_waypoint_marker.points.push_back(
-      last_adapted_waypoint_position_);
-  path_adapted_waypoint_marker.points.push_back(
-      newest_adapted_waypoint_position_);
-  path_adapted_waypoint_pub_.publish(path_adapted_waypoint_marker);
+  // publish path set by adapted waypoints
+  publishPathSegment(path_adapted_waypoint_pub_, path_length_, 0.02, 0.0, 0.0,
+                     1.0, last_adapted_waypoint_position_,
+                     newest_adapted_waypoint_position_);
 
+  // the segment ids keep counting without subscribers so that a late
+  // subscriber does not overwrite old segments
   path_length_++;
 }
 
-void LocalPlannerNode::publishGoal() {
+void LocalPlannerNode::publishGoal(const plannerVisualization& data) {
+  if (marker_goal_pub_.getNumSubscribers() == 0) return;
+
   visualization_msgs::MarkerArray marker_goal;
   visualization_msgs::Marker m;
 
-  geometry_msgs::Point goal = toPoint(local_planner_->getGoal());
+  geometry_msgs::Point goal = toPoint(data.goal);
 
   m.header.frame_id = "local_origin";
   m.header.stamp = ros::Time::now();
@@ -394,53 +736,58 @@ void LocalPlannerNode::publishGoal() {
   marker_goal_pub_.publish(marker_goal);
 }
 
-void LocalPlannerNode::publishReachHeight() {
-  visualization_msgs::Marker m;
-  m.header.frame_id = "local_origin";
-  m.header.stamp = ros::Time::now();
-  m.type = visualization_msgs::Marker::CUBE;
-  m.pose.position.x = local_planner_->take_off_pose_.x();
-  m.pose.position.y = local_planner_->take_off_pose_.y();
-  m.pose.position.z = local_planner_->starting_height_;
-  m.pose.orientation.x = 0.0;
-  m.pose.orientation.y = 0.0;
-  m.pose.orientation.z = 0.0;
-  m.pose.orientation.w = 1.0;
-  m.scale.x = 10;
-  m.scale.y = 10;
-  m.scale.z = 0.001;
-  m.color.a = 0.5;
-  m.color.r = 0.0;
-  m.color.g = 0.0;
-  m.color.b = 1.0;
-  m.lifetime = ros::Duration(0.5);
-  m.id = 0;
+void LocalPlannerNode::publishReachHeight(const plannerVisualization& data) {
+  if (initial_height_pub_.getNumSubscribers() > 0) {
+    visualization_msgs::Marker m;
+    m.header.frame_id = "local_origin";
+    m.header.stamp = ros::Time::now();
+    m.type = visualization_msgs::Marker::CUBE;
+    m.pose.position.x = data.take_off_pose.x();
+    m.pose.position.y = data.take_off_pose.y();
+    m.pose.position.z = data.starting_height;
+    m.pose.orientation.x = 0.0;
+    m.pose.orientation.y = 0.0;
+    m.pose.orientation.z = 0.0;
+    m.pose.orientation.w = 1.0;
+    m.scale.x = 10;
+    m.scale.y = 10;
+    m.scale.z = 0.001;
+    m.color.a = 0.5;
+    m.color.r = 0.0;
+    m.color.g = 0.0;
+    m.color.b = 1.0;
+    m.lifetime = ros::Duration(0.5);
+    m.id = 0;
+
+    initial_height_pub_.publish(m);
+  }
+
+  if (takeoff_pose_pub_.getNumSubscribers() > 0) {
+    visualization_msgs::Marker t;
+    t.header.frame_id = "local_origin";
+    t.header.stamp = ros::Time::now();
+    t.type = visualization_msgs::Marker::SPHERE;
+    t.action = visualization_msgs::Marker::ADD;
+    t.scale.x = 0.2;
+    t.scale.y = 0.2;
+    t.scale.z = 0.2;
+    t.color.a = 1.0;
+    t.color.r = 1.0;
+    t.color.g = 0.0;
+    t.color.b = 0.0;
+    t.lifetime = ros::Duration();
+    t.id = 0;
+    t.pose.position = toPoint(data.take_off_pose);
+    takeoff_pose_pub_.publish(t);
+  }
+}
+
+void LocalPlannerNode::publishBox(const plannerVisualization& data) {
+  if (bounding_box_pub_.getNumSubscribers() == 0) return;
 
-  initial_height_pub_.publish(m);
-
-  visualization_msgs::Marker t;
-  t.header.frame_id = "local_origin";
-  t.header.stamp = ros::Time::now();
-  t.type = visualization_msgs::Marker::SPHERE;
-  t.action = visualization_msgs::Marker::ADD;
-  t.scale.x = 0.2;
-  t.scale.y = 0.2;
-  t.scale.z = 0.2;
-  t.color.a = 1.0;
-  t.color.r = 1.0;
-  t.color.g = 0.0;
-  t.color.b = 0.0;
-  t.lifetime = ros::Duration();
-  t.id = 0;
-  t.pose.position = toPoint(local_planner_->take_off_pose_);
-  takeoff_pose_pub_.publish(t);
-}
-
-void LocalPlannerNode::publishBox() {
   visualization_msgs::MarkerArray marker_array;
-  Eigen::Vector3f drone_pos = local_planner_->getPosition();
-  double histogram_box_radius =
-      static_cast<double>(local_planner_->histogram_box_.radius_);
+  Eigen::Vector3f drone_pos = data.position;
+  double histogram_box_radius = static_cast<double>(data.box_radius);
 
   visualization_msgs::Marker box;
   box.header.frame_id = "local_origin";
@@ -469,7 +816,7 @@ void LocalPlannerNode::publishBox() {
   plane.type = visualization_msgs::Marker::CUBE;
   plane.action = visualization_msgs::Marker::ADD;
   plane.pose.position = toPoint(drone_pos);
-  plane.pose.position.z = local_planner_->histogram_box_.zmin_;
+  plane.pose.position.z = data.box_zmin;
   plane.pose.orientation.x = 0.0;
   plane.pose.orientation.y = 0.0;
   plane.pose.orientation.z = 0.0;
@@ -486,6 +833,33 @@ void LocalPlannerNode::publishBox() {
   bounding_box_pub_.publish(marker_array);
 }
 
+// publishes a sphere marking a waypoint if someone listens
+static void publishWaypointSphere(ros::Publisher& pub, const ros::Time& stamp,
+                                  double r, double g, double b,
+                                  const Eigen::Vector3f& position) {
+  if (pub.getNumSubscribers() == 0) return;
+
+  visualization_msgs::Marker sphere;
+  sphere.header.frame_id = "local_origin";
+  sphere.header.stamp = stamp;
+  sphere.id = 0;
+  sphere.type = visualization_msgs::Marker::SPHERE;
+  sphere.action = visualization_msgs::Marker::ADD;
+  sphere.pose.position = toPoint(position);
+  sphere.pose.orientation.x = 0.0;
+  sphere.pose.orientation.y = 0.0;
+  sphere.pose.orientation.z = 0.0;
+  sphere.pose.orientation.w = 1.0;
+  sphere.scale.x = 0.2;
+  sphere.scale.y = 0.2;
+  sphere.scale.z = 0.2;
+  sphere.color.a = 0.8;
+  sphere.color.r = r;
+  sphere.color.g = g;
+  sphere.color.b = b;
+  pub.publish(sphere);
+}
+
 void LocalPlannerNode::publishWaypoints(bool hover) {
   bool is_airborne = armed_ && (mission_ || offboard_ || hover);
 
@@ -493,71 +867,19 @@ void LocalPlannerNode::publishWaypoints(bool hover) {
       toEigen(newest_pose_.pose.position),
       toEigen(newest_pose_.pose.orientation), toEigen(goal_msg_.pose.position),
       toEigen(vel_msg_.twist.linear), hover, is_airborne);
-  waypointResult result = wp_generator_->getWaypoints();
-
-  visualization_msgs::Marker sphere1;
-  visualization_msgs::Marker sphere2;
-  visualization_msgs::Marker sphere3;
+  waypointResult result;
+  {
+    ScopedStageTimer timer(PlannerStage::waypointGenerator);
+    result = wp_generator_->getWaypoints();
+  }
 
   ros::Time now = ros::Time::now();
-
-  sphere1.header.frame_id = "local_origin";
-  sphere1.header.stamp = now;
-  sphere1.id = 0;
-  sphere1.type = visualization_msgs::Marker::SPHERE;
-  sphere1.action = visualization_msgs::Marker::ADD;
-  sphere1.pose.position = toPoint(result.goto_position);
-  sphere1.pose.orientation.x = 0.0;
-  sphere1.pose.orientation.y = 0.0;
-  sphere1.pose.orientation.z = 0.0;
-  sphere1.pose.orientation.w = 1.0;
-  sphere1.scale.x = 0.2;
-  sphere1.scale.y = 0.2;
-  sphere1.scale.z = 0.2;
-  sphere1.color.a = 0.8;
-  sphere1.color.r = 0.5;
-  sphere1.color.g = 1.0;
-  sphere1.color.b = 0.0;
-
-  sphere2.header.frame_id = "local_origin";
-  sphere2.header.stamp = now;
-  sphere2.id = 0;
-  sphere2.type = visualization_msgs::Marker::SPHERE;
-  sphere2.action = visualization_msgs::Marker::ADD;
-  sphere2.pose.position = toPoint(result.adapted_goto_position);
-  sphere2.pose.orientation.x = 0.0;
-  sphere2.pose.orientation.y = 0.0;
-  sphere2.pose.orientation.z = 0.0;
-  sphere2.pose.orientation.w = 1.0;
-  sphere2.scale.x = 0.2;
-  sphere2.scale.y = 0.2;
-  sphere2.scale.z = 0.2;
-  sphere2.color.a = 0.8;
-  sphere2.color.r = 1.0;
-  sphere2.color.g = 1.0;
-  sphere2.color.b = 0.0;
-
-  sphere3.header.frame_id = "local_origin";
-  sphere3.header.stamp = now;
-  sphere3.id = 0;
-  sphere3.type = visualization_msgs::Marker::SPHERE;
-  sphere3.action = visualization_msgs::Marker::ADD;
-  sphere3.pose.position = toPoint(result.smoothed_goto_position);
-  sphere3.pose.orientation.x = 0.0;
-  sphere3.pose.orientation.y = 0.0;
-  sphere3.pose.orientation.z = 0.0;
-  sphere3.pose.orientation.w = 1.0;
-  sphere3.scale.x = 0.2;
-  sphere3.scale.y = 0.2;
-  sphere3.scale.z = 0.2;
-  sphere3.color.a = 0.8;
-  sphere3.color.r = 1.0;
-  sphere3.color.g = 0.5;
-  sphere3.color.b = 0.0;
-
-  original_wp_pub_.publish(sphere1);
-  adapted_wp_pub_.publish(sphere2);
-  smoothed_wp_pub_.publish(sphere3);
+  publishWaypointSphere(original_wp_pub_, now, 0.5, 1.0, 0.0,
+                        result.goto_position);
+  publishWaypointSphere(adapted_wp_pub_, now, 1.0, 1.0, 0.0,
+                        result.adapted_goto_position);
+  publishWaypointSphere(smoothed_wp_pub_, now, 1.0, 0.5, 0.0,
+                        result.smoothed_goto_position);
 
   last_waypoint_position_ = newest_waypoint_position_;
   newest_waypoint_position_ = toPoint(result.smoothed_goto_position);
@@ -585,9 +907,31 @@ void LocalPlannerNode::publishWaypoints(bool hover) {
         toPoseStamped(result.position_wp, result.orientation_wp));
   }
   mavros_obstacle_free_path_pub_.publish(obst_free_path);
+
+  // time from the sensor data to the setpoint that is based on it
+  if (!planned_cloud_stamp_.isZero()) {
+    std_msgs::Float64 latency;
+    latency.data = (ros::Time::now() - planned_cloud_stamp_).toSec();
+    latency_pub_.publish(latency);
+  }
 }
 
-void LocalPlannerNode::publishDataImages() {
+void LocalPlannerNode::publishDataImages(const plannerVisualization& data) {
+  // histogram image
+  if (data.publish_histogram_image) {
+    sensor_msgs::Image hist_img;
+    hist_img.header.stamp = ros::Time::now();
+    hist_img.height = GRID_LENGTH_E;
+    hist_img.width = GRID_LENGTH_Z;
+    hist_img.encoding = sensor_msgs::image_encodings::MONO8;
+    hist_img.is_bigendian = 0;
+    hist_img.step = 255;
+    hist_img.data = data.histogram_image;
+    histogram_image_pub_.publish(hist_img);
+  }
+
+  if (!data.publish_cost_image) return;
+
   sensor_msgs::Image cost_img;
   cost_img.header.stamp = ros::Time::now();
   cost_img.height = GRID_LENGTH_E;
@@ -595,11 +939,11 @@ void LocalPlannerNode::publishDataImages() {
   cost_img.encoding = "rgb8";
   cost_img.is_bigendian = 0;
   cost_img.step = 3 * cost_img.width;
-  cost_img.data = local_planner_->cost_image_data_;
+  cost_img.data = data.cost_image;
 
   // current orientation
   float curr_yaw_fcu_frame =
-      getYawFromQuaternion(toEigen(newest_pose_.pose.orientation));
+      getYawFromQuaternion(toEigen(data.pose.pose.orientation));
   float yaw_angle_histogram_frame =
       std::round((-static_cast<float>(curr_yaw_fcu_frame) * 180.0f / M_PI_F)) +
       90.0f;
@@ -607,13 +951,12 @@ void LocalPlannerNode::publishDataImages() {
   Eigen::Vector2i heading_index = polarToHistogramIndex(heading_pol, ALPHA_RES);
 
   // current setpoint
-  PolarPoint waypoint_pol = cartesianToPolar(
-      toEigen(newest_waypoint_position_), toEigen(newest_pose_.pose.position));
+  PolarPoint waypoint_pol = cartesianToPolar(toEigen(data.waypoint),
+                                             toEigen(data.pose.pose.position));
   Eigen::Vector2i waypoint_index =
       polarToHistogramIndex(waypoint_pol, ALPHA_RES);
-  PolarPoint adapted_waypoint_pol =
-      cartesianToPolar(toEigen(newest_adapted_waypoint_position_),
-                       toEigen(newest_pose_.pose.position));
+  PolarPoint adapted_waypoint_pol = cartesianToPolar(
+      toEigen(data.adapted_waypoint), toEigen(data.pose.pose.position));
   Eigen::Vector2i adapted_waypoint_index =
       polarToHistogramIndex(adapted_waypoint_pol, ALPHA_RES);
 
@@ -638,21 +981,12 @@ void LocalPlannerNode::publishDataImages() {
                                   adapted_waypoint_index.x(), 2)] = 255.f;
   }
 
-  // histogram image
-  sensor_msgs::Image hist_img;
-  hist_img.header.stamp = ros::Time::now();
-  hist_img.height = GRID_LENGTH_E;
-  hist_img.width = GRID_LENGTH_Z;
-  hist_img.encoding = sensor_msgs::image_encodings::MONO8;
-  hist_img.is_bigendian = 0;
-  hist_img.step = 255;
-  hist_img.data = local_planner_->histogram_image_data_;
-
-  histogram_image_pub_.publish(hist_img);
   cost_image_pub_.publish(cost_img);
 }
 
-void LocalPlannerNode::publishTree() {
+void LocalPlannerNode::publishTree(const plannerVisualization& data) {
+  if (!data.publish_tree) return;
+
   visualization_msgs::Marker tree_marker;
   tree_marker.header.frame_id = "local_origin";
   tree_marker.header.stamp = ros::Time::now();
@@ -679,25 +1013,18 @@ void LocalPlannerNode::publishTree() {
   path_marker.color.g = 0.0;
   path_marker.color.b = 0.0;
 
-  std::vector<TreeNode> tree;
-  std::vector<int> closed_set;
-
-  local_planner_->getTree(tree, closed_set, path_node_positions_);
+  const std::vector<Eigen::Vector3f>& path_node_positions =
+      data.path_node_positions;
 
-  tree_marker.points.reserve(closed_set.size() * 2);
-  for (size_t i = 0; i < closed_set.size(); i++) {
-    int node_nr = closed_set[i];
-    geometry_msgs::Point p1 = toPoint(tree[node_nr].getPosition());
-    int origin = tree[node_nr].origin_;
-    geometry_msgs::Point p2 = toPoint(tree[origin].getPosition());
-    tree_marker.points.push_back(p1);
-    tree_marker.points.push_back(p2);
+  tree_marker.points.reserve(data.tree_edges.size());
+  for (const Eigen::Vector3f& point : data.tree_edges) {
+    tree_marker.points.push_back(toPoint(point));
   }
 
-  path_marker.points.reserve(path_node_positions_.size() * 2);
-  for (size_t i = 1; i < path_node_positions_.size(); i++) {
-    path_marker.points.push_back(toPoint(path_node_positions_[i - 1]));
-    path_marker.points.push_back(toPoint(path_node_positions_[i]));
+  path_marker.points.reserve(path_node_positions.size() * 2);
+  for (size_t i = 1; i < path_node_positions.size(); i++) {
+    path_marker.points.push_back(toPoint(path_node_positions[i - 1]));
+    path_marker.points.push_back(toPoint(path_node_positions[i]));
   }
 
   complete_tree_pub_.publish(tree_marker);
@@ -709,6 +1036,99 @@ void LocalPlannerNode::publishSystemStatus() {
   status_msg_.component = 196;  // MAV_COMPONENT_ID_AVOIDANCE
   mavros_system_status_pub_.publish(status_msg_);
   t_status_sent_ = ros::Time::now();
+
+  // the status only carries the state, which is left to the failsafe, so
+  // the overruns since the last status are logged along with it
+  std::string overrun_stages;
+  for (int i = 0; i < static_cast<int>(PlannerStage::count); i++) {
+    PlannerStage stage = static_cast<PlannerStage>(i);
+    size_t overruns = stage_timings_.overruns(stage);
+    if (overruns > status_overruns_[i]) {
+      overrun_stages += std::string(" ") + stageName(stage) + " (" +
+                        std::to_string(overruns - status_overruns_[i]) + ")";
+    }
+    status_overruns_[i] = overruns;
+  }
+  if (!overrun_stages.empty()) {
+    ROS_WARN("\033[1;35m[OA] Deadline overruns:%s \033[0m",
+             overrun_stages.c_str());
+  }
+}
+
+void LocalPlannerNode::publishStageTimings() {
+  diagnostic_msgs::DiagnosticArray msg;
+  msg.header.stamp = ros::Time::now();
+  for (int i = 0; i < static_cast<int>(PlannerStage::count); i++) {
+    PlannerStage stage = static_cast<PlannerStage>(i);
+    StageStatistics statistics = stage_timings_.statistics(stage);
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = diagnostics_name_ + ": " + stageName(stage);
+    status.hardware_id = diagnostics_name_;
+    status.message = statistics.samples > 0 ? "timing" : "no samples";
+    diagnostic_msgs::KeyValue value;
+    value.key = "samples";
+    value.value = std::to_string(statistics.samples);
+    status.values.push_back(value);
+    value.key = "p50_ms";
+    value.value = std::to_string(statistics.p50_ms);
+    status.values.push_back(value);
+    value.key = "p99_ms";
+    value.value = std::to_string(statistics.p99_ms);
+    status.values.push_back(value);
+    value.key = "max_ms";
+    value.value = std::to_string(statistics.max_ms);
+    status.values.push_back(value);
+    value.key = "overruns";
+    value.value = std::to_string(statistics.overruns);
+    status.values.push_back(value);
+    if (statistics.overruns > reported_overruns_[i]) {
+      status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+      status.message = "deadline overrun";
+    }
+    reported_overruns_[i] = statistics.overruns;
+    msg.status.push_back(status);
+  }
+
+  // age of the latest cloud of every camera, a stalled camera shows up here
+  // before the pointcloud timeout triggers
+  ros::Time now = ros::Time::now();
+  for (const cameraData& camera : cameras_) {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = diagnostics_name_ + ": camera " + camera.topic_;
+    status.hardware_id = diagnostics_name_;
+    diagnostic_msgs::KeyValue value;
+    if (!camera.newestHeader()) {
+      status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+      status.message = "no cloud received";
+    } else {
+      double age = (now - camera.newestHeader()->stamp).toSec();
+      bool stale = age > max_cloud_age_;
+      status.level = stale ? diagnostic_msgs::DiagnosticStatus::WARN
+                           : diagnostic_msgs::DiagnosticStatus::OK;
+      status.message = stale ? "stale" : "ok";
+      value.key = "age_ms";
+      value.value = std::to_string(1000.0 * age);
+      status.values.push_back(value);
+      value.key = "since_received_ms";
+      value.value =
+          std::to_string(1000.0 * (now - camera.receive_time_).toSec());
+      status.values.push_back(value);
+    }
+    msg.status.push_back(status);
+  }
+  stage_timing_pub_.publish(msg);
+
+  if (stage_trace_writer_.isOpen()) {
+    size_t dropped = stage_timings_.takeTraceEvents(trace_events_);
+    stage_trace_writer_.write(trace_events_);
+    if (dropped > 0) {
+      ROS_WARN("\033[1;35m[OA] Dropped %zu stage trace events \033[0m",
+               dropped);
+    }
+  }
+  t_timing_sent_ = ros::Time::now();
 }
 
 void LocalPlannerNode::clickedPointCallback(
@@ -804,6 +1224,8 @@ void LocalPlannerNode::px4ParamsCallback(const mavros_msgs::Param& msg) {
 }
 
 void LocalPlannerNode::publishGround() {
+  if (ground_measurement_pub_.getNumSubscribers() == 0) return;
+
   Eigen::Vector3f drone_pos = local_planner_->getPosition();
   visualization_msgs::Marker plane;
   double histogram_box_radius =
@@ -851,7 +1273,17 @@ void LocalPlannerNode::printPointInfo(double x, double y, double z) {
 
 void LocalPlannerNode::pointCloudCallback(
     const sensor_msgs::PointCloud2::ConstPtr& msg, int index) {
-  cameras_[index].newest_cloud_msg_ = *msg;  // FIXME: avoid a copy
+  // keep a reference only, in a nodelet manager the buffer is the one the
+  // publisher filled
+  cameras_[index].newest_cloud_msg_ = msg;
+  cameras_[index].receive_time_ = ros::Time::now();
+  cameras_[index].received_ = true;
+}
+
+void LocalPlannerNode::depthImageCallback(
+    const sensor_msgs::Image::ConstPtr& msg, int index) {
+  cameras_[index].newest_depth_msg_ = msg;
+  cameras_[index].receive_time_ = ros::Time::now();
   cameras_[index].received_ = true;
 }
 
@@ -861,19 +1293,38 @@ void LocalPlannerNode::cameraInfoCallback(
   // focal length:
   // h_fov = 2 * atan (image_width / (2 * focal_length_x))
   // v_fov = 2 * atan (image_height / (2 * focal_length_y))
-  // Assumption: if there are n cameras the total horizonal field of view is n
-  // times the horizontal field of view of a single camera
-  local_planner_->h_FOV_ = static_cast<float>(
-      static_cast<double>(cameras_.size()) * 2.0 *
-      atan(static_cast<double>(msg->width) / (2.0 * msg->K[0])) * 180.0 / M_PI);
-  local_planner_->v_FOV_ = static_cast<float>(
+  CameraFOV& fov = cameras_[index].fov_;
+  fov.h_FOV = static_cast<float>(
+      2.0 * atan(static_cast<double>(msg->width) / (2.0 * msg->K[0])) * 180.0 /
+      M_PI);
+  fov.v_FOV = static_cast<float>(
       2.0 * atan(static_cast<double>(msg->height) / (2.0 * msg->K[4])) * 180.0 /
       M_PI);
+
+  // the histogram is built within the frusta of the single cameras, the tree
+  // and the waypoints still assume that if there are n cameras the total
+  // horizonal field of view is n times the one of a single camera
+  local_planner_->h_FOV_ = static_cast<float>(cameras_.size()) * fov.h_FOV;
+  local_planner_->v_FOV_ = fov.v_FOV;
   wp_generator_->setFOV(local_planner_->h_FOV_, local_planner_->v_FOV_);
+
+  // the rays are shared with the snapshots, so they are replaced instead of
+  // updated in place
+  std::shared_ptr<const DepthRays>& rays = cameras_[index].depth_rays_;
+  if (depth_image_input_ && (!rays || !rays->matches(*msg))) {
+    std::shared_ptr<DepthRays> new_rays = std::make_shared<DepthRays>();
+    if (!new_rays->update(*msg)) {
+      ROS_WARN("\033[1;35m[OA] Invalid intrinsics of camera %s \033[0m",
+               cameras_[index].topic_.c_str());
+    }
+    rays = new_rays;
+  }
 }
 
 void LocalPlannerNode::publishSetpoint(const geometry_msgs::Twist& wp,
                                        waypoint_choice& waypoint_type) {
+  if (current_waypoint_pub_.getNumSubscribers() == 0) return;
+
   visualization_msgs::Marker setpoint;
   setpoint.header.frame_id = "local_origin";
   setpoint.header.stamp = ros::Time::now();
@@ -1002,25 +1453,129 @@ void LocalPlannerNode::transformVelocityToTrajectory(
 }
 
 void LocalPlannerNode::publishPlannerData() {
-  pcl::PointCloud<pcl::PointXYZ> final_cloud, reprojected_points;
-  local_planner_->getCloudsForVisualization(final_cloud, reprojected_points);
-  local_pointcloud_pub_.publish(final_cloud);
-  reprojected_points_pub_.publish(reprojected_points);
-
-  publishTree();
-
   last_wp_time_ = ros::Time::now();
 
   if (local_planner_->send_obstacles_fcu_) {
-    sensor_msgs::LaserScan distance_data_to_fcu;
-    local_planner_->sendObstacleDistanceDataToFcu(distance_data_to_fcu);
-    mavros_obstacle_distance_pub_.publish(distance_data_to_fcu);
+    publishObstacleDistance();
   }
 
-  publishGoal();
-  publishBox();
-  publishReachHeight();
-  publishDataImages();
+  // the markers and images are built and serialized by the visualization
+  // thread
+  fillPlannerVisualization(planner_visualization_.back());
+  planner_visualization_.publish();
+  std::lock_guard<std::mutex> lk(visualization_ready_mutex_);
+  visualization_ready_ = true;
+  if (!hosted_) {
+    visualization_ready_cv_.notify_one();
+  } else if (!visualization_task_active_) {
+    visualization_task_active_ = true;
+    cloud_pool_->submit([this]() { visualizationTask(); });
+  }
+}
+
+void LocalPlannerNode::publishObstacleDistance() {
+  local_planner_->sendObstacleDistanceDataToFcu(obstacle_distance_msg_);
+  mavros_obstacle_distance_pub_.publish(obstacle_distance_msg_);
+}
+
+void LocalPlannerNode::fillPlannerVisualization(plannerVisualization& data) {
+  data.position = local_planner_->getPosition();
+  data.goal = local_planner_->getGoal();
+  data.take_off_pose = local_planner_->take_off_pose_;
+  data.starting_height = local_planner_->starting_height_;
+  data.box_radius = local_planner_->histogram_box_.radius_;
+  data.box_zmin = local_planner_->histogram_box_.zmin_;
+
+  // the obstacle memory is only converted to points if someone listens
+  data.publish_final_cloud = local_pointcloud_pub_.getNumSubscribers() > 0;
+  data.publish_reprojected_points =
+      reprojected_points_pub_.getNumSubscribers() > 0;
+  if (data.publish_final_cloud || data.publish_reprojected_points) {
+    local_planner_->getCloudsForVisualization(data.final_cloud,
+                                              data.reprojected_points,
+                                              data.publish_reprojected_points);
+  }
+
+  data.publish_tree = complete_tree_pub_.getNumSubscribers() > 0 ||
+                      tree_path_pub_.getNumSubscribers() > 0;
+  if (data.publish_tree) {
+    local_planner_->getTree(data.tree_edges, data.path_node_positions);
+  }
+
+  // the images are only generated by the planner if they have subscribers
+  data.publish_histogram_image = !local_planner_->histogram_image_data_.empty();
+  data.publish_cost_image = !local_planner_->cost_image_data_.empty();
+  if (data.publish_histogram_image) {
+    data.histogram_image = local_planner_->histogram_image_data_;
+  }
+  if (data.publish_cost_image) {
+    data.cost_image = local_planner_->cost_image_data_;
+    const plannerInput& input = planner_input_.front();
+    data.pose = input.pose;
+    data.waypoint = input.last_sent_waypoint;
+    data.adapted_waypoint = input.last_adapted_waypoint;
+  }
+}
+
+// lets the scheduler prefer all other threads of the node
+static void lowerThreadPriority() {
+#ifdef __linux__
+  id_t tid = static_cast<id_t>(syscall(SYS_gettid));
+  if (setpriority(PRIO_PROCESS, tid, 19) != 0) {
+    ROS_WARN("\033[1;35m[OA] Cannot lower the visualization priority \033[0m");
+  }
+#endif
+}
+
+void LocalPlannerNode::visualizationThreadFunction() {
+  lowerThreadPriority();
+  ScopedStageTimings scope(stage_timings_);
+
+  while (!should_exit_) {
+    // wait for data
+    {
+      std::unique_lock<std::mutex> lk(visualization_ready_mutex_);
+      visualization_ready_cv_.wait(
+          lk, [this] { return visualization_ready_ || should_exit_; });
+      visualization_ready_ = false;
+    }
+
+    if (should_exit_) break;
+
+    publishVisualization();
+  }
+}
+
+void LocalPlannerNode::visualizationTask() {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lk(visualization_ready_mutex_);
+      if (!visualization_ready_ || should_exit_) {
+        visualization_task_active_ = false;
+        visualization_ready_cv_.notify_all();
+        return;
+      }
+      visualization_ready_ = false;
+    }
+    publishVisualization();
+  }
+}
+
+void LocalPlannerNode::publishVisualization() {
+  if (planner_visualization_.fetch()) {
+    const plannerVisualization& data = planner_visualization_.front();
+    if (data.publish_final_cloud) {
+      local_pointcloud_pub_.publish(data.final_cloud);
+    }
+    if (data.publish_reprojected_points) {
+      reprojected_points_pub_.publish(data.reprojected_points);
+    }
+    publishTree(data);
+    publishGoal(data);
+    publishBox(data);
+    publishReachHeight(data);
+    publishDataImages(data);
+  }
 }
 
 void LocalPlannerNode::dynamicReconfigureCallback(
@@ -1029,33 +1584,386 @@ void LocalPlannerNode::dynamicReconfigureCallback(
   local_planner_->dynamicReconfigureSetParams(config, level);
   wp_generator_->setSmoothingSpeed(config.smoothing_speed_xy_,
                                    config.smoothing_speed_z_);
+  planning_trigger_ = toPlanningTrigger(config.planning_trigger_);
+  planning_rate_ = config.planning_rate_;
+  max_cloud_age_ = config.max_cloud_age_;
+  setpoint_rate_ = config.setpoint_rate_;
+  obstacle_distance_rate_ = config.obstacle_distance_rate_;
   rqt_param_config_ = config;
 }
 
+void LocalPlannerNode::run(ros::CallbackQueue& callback_queue) {
+  ScopedStageTimings scope(stage_timings_);
+  // the callbacks and the staging of the clouds run on this thread, the
+  // cloud workers are restarted to inherit its profile
+  if (realtime_profile_ && !hosted_) {
+    applyRealtimeProfile(ingest_profile_, "ingest");
+    cloud_pool_.reset(new ThreadPool(cloud_pool_->size()));
+  }
+  start(callback_queue);
+
+  // spin node, execute callbacks
+  while (ros::ok() && !should_exit_) {
+    // Process callbacks & wait for a position update, or for the next
+    // setpoint if they are sent at a fixed rate
+    if (setpoint_rate_ > 0.0) {
+      waitForSetpointTime(callback_queue);
+    } else {
+      while (!position_received_ && ros::ok() && !should_exit_) {
+        callback_queue.callAvailable(ros::WallDuration(0.1));
+      }
+    }
+    runIteration();
+  }
+
+  stop();
+}
+
+void LocalPlannerNode::start(ros::CallbackQueue& callback_queue) {
+  ScopedStageTimings scope(stage_timings_);
+  waitUntilReady(callback_queue);
+  startPlanning();
+}
+
+bool LocalPlannerNode::startOnce(ros::CallbackQueue& callback_queue) {
+  ScopedStageTimings scope(stage_timings_);
+  if (startup_deadline_.isZero()) {
+    startup_deadline_ =
+        ros::WallTime::now() + ros::WallDuration(startup_timeout_);
+  }
+  callback_queue.callAvailable();
+  if (!isReady() && ros::WallTime::now() < startup_deadline_) {
+    return false;
+  }
+  startPlanning();
+  return true;
+}
+
+void LocalPlannerNode::startPlanning() {
+  restoreSnapshot();
+  start_time_ = ros::Time::now();
+  planner_is_healthy_ = true;
+  local_planner_->disable_rise_to_goal_altitude_ =
+      disable_rise_to_goal_altitude_;
+  startup_ = true;
+  status_msg_.state = (int)MAV_STATE::MAV_STATE_BOOT;
+
+  // a host runs the planner and visualization iterations on its pool
+  if (hosted_ && realtime_profile_) {
+    ROS_WARN("\033[1;35m[OA] No real time profile on a shared pool \033[0m");
+  }
+  if (!hosted_) {
+    worker_ = std::thread(&LocalPlannerNode::threadFunction, this);
+    visualizer_ =
+        std::thread(&LocalPlannerNode::visualizationThreadFunction, this);
+  }
+}
+
+bool LocalPlannerNode::spinOnce(ros::CallbackQueue& callback_queue) {
+  ScopedStageTimings scope(stage_timings_);
+  callback_queue.callAvailable();
+  if (setpoint_rate_ > 0.0) {
+    if (!setpointDue(ros::Time::now())) {
+      return false;
+    }
+    pose_is_fresh_ = true;
+  } else if (!position_received_) {
+    return false;
+  }
+  runIteration();
+  return true;
+}
+
+void LocalPlannerNode::runIteration() {
+  bool hover = false;
+
+#ifdef DISABLE_SIMULATION
+  startup_ = false;
+#else
+  // visualize world in RVIZ
+  if (!world_path_.empty() && startup_) {
+    visualization_msgs::MarkerArray marker_array;
+    if (!visualizeRVIZWorld(world_path_, marker_array)) {
+      world_pub_.publish(marker_array);
+    }
+    startup_ = false;
+  }
+
+#endif
+
+  // Check if all information was received
+  ros::Time now = ros::Time::now();
+  ros::Duration since_last_cloud = now - last_wp_time_;
+  ros::Duration since_start = now - start_time_;
+
+  checkFailsafe(since_last_cloud, since_start, planner_is_healthy_, hover);
+
+  // If planner is not running, update planner info and get last results
+  updatePlanner();
+
+  // send waypoint
+  if (!never_run_ && planner_is_healthy_) {
+    publishWaypoints(hover);
+    if (!hover) status_msg_.state = (int)MAV_STATE::MAV_STATE_ACTIVE;
+  } else {
+    for (size_t i = 0; i < cameras_.size(); ++i) {
+      // once the camera info have been set once, unsubscribe from topic,
+      // the depth images cannot be used without it
+      if (!depth_image_input_) cameras_[i].camera_info_sub_.shutdown();
+    }
+  }
+
+  position_received_ = false;
+  pose_is_fresh_ = false;
+
+  // publish system status
+  if (now - t_status_sent_ > ros::Duration(0.2)) publishSystemStatus();
+
+  // publish stage timings
+  if (now - t_timing_sent_ > ros::Duration(1.0)) publishStageTimings();
+
+  if (setpoint_rate_ > 0.0) {
+    const ros::Duration period(1.0 / setpoint_rate_);
+    now = ros::Time::now();
+    next_setpoint_time_ += period;
+    // restart the schedule after falling behind instead of sending a burst
+    // of setpoints to catch up
+    if (next_setpoint_time_ < now - period) {
+      next_setpoint_time_ = now;
+    }
+  }
+}
+
+void LocalPlannerNode::stop() {
+  should_exit_ = true;
+  {
+    std::unique_lock<std::mutex> lk(data_ready_mutex_);
+    data_ready_cv_.notify_all();
+    // the task of a host sees should_exit_ and returns without planning
+    data_ready_cv_.wait(lk, [this] { return !planner_task_active_; });
+  }
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+  {
+    std::unique_lock<std::mutex> lk(visualization_ready_mutex_);
+    visualization_ready_cv_.notify_all();
+    visualization_ready_cv_.wait(
+        lk, [this] { return !visualization_task_active_; });
+  }
+  if (visualizer_.joinable()) {
+    visualizer_.join();
+  }
+}
+
+void LocalPlannerNode::waitUntilReady(ros::CallbackQueue& callback_queue) {
+  // the main loop starts as soon as its inputs are there instead of after a
+  // fixed delay, the cameras which did not send data yet are waited for by
+  // the planning trigger
+  const ros::WallTime deadline =
+      ros::WallTime::now() + ros::WallDuration(startup_timeout_);
+  while (ros::ok() && !should_exit_ && ros::WallTime::now() < deadline) {
+    if (isReady()) {
+      break;
+    }
+    callback_queue.callAvailable(ros::WallDuration(0.01));
+  }
+}
+
+bool LocalPlannerNode::isReady() {
+  bool ready = !last_pose_time_.isZero() && state_received_;
+  for (size_t i = 0; ready && i < cameras_.size(); ++i) {
+    ready = !cameras_[i].newestHeader() || cloudTransform(i, nullptr);
+  }
+  return ready;
+}
+
+void LocalPlannerNode::restoreSnapshot() {
+  PlannerSnapshot snapshot;
+  if (!snapshot_file_.read(snapshot)) {
+    return;
+  }
+  double age = ros::Time::now().toSec() - snapshot.stamp;
+  if (age < 0.0 || age > snapshot_max_age_) {
+    ROS_INFO("\033[1;35m[OA] Snapshot is %.1f s old, not restored \033[0m",
+             age);
+    return;
+  }
+  std::lock_guard<std::mutex> guard(running_mutex_);
+  local_planner_->restoreSnapshot(snapshot);
+  goal_msg_.pose.position = toPoint(snapshot.goal);
+  ROS_INFO("\033[1;35m[OA] Restored %zu obstacle voxels of %.1f s ago \033[0m",
+           snapshot.obstacle_memory.size(), age);
+}
+
+void LocalPlannerNode::writeSnapshot() {
+  ros::Time now = ros::Time::now();
+  if (!snapshot_file_.isOpen() ||
+      (now - last_snapshot_time_).toSec() < snapshot_period_) {
+    return;
+  }
+  last_snapshot_time_ = now;
+  local_planner_->getSnapshot(snapshot_);
+  snapshot_.stamp = now.toSec();
+  if (!snapshot_file_.write(snapshot_)) {
+    ROS_WARN("\033[1;35m[OA] Cannot write snapshot, disabled \033[0m");
+  }
+}
+
+void LocalPlannerNode::writeFlightFrame(double planner_ms) {
+  if (!flight_recorder_.isOpen()) {
+    return;
+  }
+  flight_frame_.stamp = ros::Time::now().toSec();
+
+  // the planner stage is still running, it gets the time so far
+  for (size_t i = 0; i < recorded_stage_ms_.size(); i++) {
+    PlannerStage stage = static_cast<PlannerStage>(i);
+    double total_ms = stage_timings_.totalMs(stage);
+    flight_frame_.stage_ms[i] =
+        static_cast<float>(total_ms - recorded_stage_ms_[i]);
+    recorded_stage_ms_[i] = total_ms;
+  }
+  const size_t planner = static_cast<size_t>(PlannerStage::planner);
+  flight_frame_.stage_ms[planner] = static_cast<float>(planner_ms);
+
+  size_t truncated = flight_recorder_.truncatedFrames();
+  local_planner_->writeFlightFrame(flight_recorder_, flight_frame_);
+  if (truncated == 0 && flight_recorder_.truncatedFrames() > 0) {
+    ROS_WARN("\033[1;35m[OA] Flight recorder frames are too small, the "
+             "clouds are truncated \033[0m");
+  }
+}
+
+bool LocalPlannerNode::setpointDue(const ros::Time& now) const {
+  // a pose older than this is not used to generate setpoints
+  const ros::Duration pose_timeout(0.5);
+  bool pose_is_fresh =
+      !last_pose_time_.isZero() && now - last_pose_time_ < pose_timeout;
+  return now >= next_setpoint_time_ && pose_is_fresh;
+}
+
+void LocalPlannerNode::waitForSetpointTime(ros::CallbackQueue& callback_queue) {
+  while (ros::ok() && !should_exit_) {
+    ros::Time now = ros::Time::now();
+    if (setpointDue(now)) {
+      break;
+    }
+    // once the setpoint is due the loop polls for a fresh pose
+    double timeout = now < next_setpoint_time_
+                         ? (next_setpoint_time_ - now).toSec()
+                         : 0.1;
+    callback_queue.callAvailable(
+        ros::WallDuration(std::min(std::max(timeout, 0.0), 0.1)));
+  }
+  pose_is_fresh_ = true;
+}
+
+void LocalPlannerNode::wakePlanner() {
+  std::lock_guard<std::mutex> lk(data_ready_mutex_);
+  data_ready_ = true;
+  if (!hosted_) {
+    data_ready_cv_.notify_one();
+  } else if (!planner_task_active_) {
+    // a task which is already queued or running picks the snapshot up
+    planner_task_active_ = true;
+    cloud_pool_->submit([this]() { plannerTask(); });
+  }
+}
+
+void LocalPlannerNode::plannerTask() {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lk(data_ready_mutex_);
+      if (!data_ready_ || should_exit_) {
+        planner_task_active_ = false;
+        data_ready_cv_.notify_all();
+        return;
+      }
+      data_ready_ = false;
+    }
+    planIteration();
+  }
+}
+
 void LocalPlannerNode::threadFunction() {
+  ScopedStageTimings scope(stage_timings_);
+  // the workers the planner starts on this thread, for the histograms of
+  // several cameras and for the expansion of the tree, inherit its profile
+  if (realtime_profile_) {
+    applyRealtimeProfile(planner_profile_, "planner");
+  }
+  int warmup_iterations = realtime_profile_ && lock_memory_ ? realtime_warmup_
+                                                            : -1;
   while (!should_exit_) {
     // wait for data
     {
       std::unique_lock<std::mutex> lk(data_ready_mutex_);
-      data_ready_cv_.wait(lk, [this] { return data_ready_ && !should_exit_; });
+      data_ready_cv_.wait(lk, [this] { return data_ready_ || should_exit_; });
       data_ready_ = false;
     }
 
     if (should_exit_) break;
 
-    {
-      std::lock_guard<std::mutex> guard(running_mutex_);
-      never_run_ = false;
-      std::clock_t start_time = std::clock();
-      local_planner_->runPlanner();
-      publishPlannerData();
-
-      ROS_DEBUG("\033[0;35m[OA]Planner calculation time: %2.2f ms \n \033[0m",
-                (std::clock() - start_time) / (double)(CLOCKS_PER_SEC / 1000));
+    planIteration();
+
+    // the buffers of the planner have grown to their size during the
+    // warm-up, locking them keeps the later iterations free of page faults
+    if (warmup_iterations >= 0 && warmup_iterations-- == 0) {
+      std::string error;
+      size_t limit = 0;
+      if (lockMemory(512 * 1024, error)) {
+        ROS_INFO("\033[1;35m[OA] Memory of the planner locked \033[0m");
+        if (lockedMemoryLimit(limit)) {
+          // every later mapping and allocation is locked as well
+          ROS_WARN("\033[1;35m[OA] Locked memory is limited to %zu kB, new "
+                   "mappings, e.g. of the flight recorder or a snapshot, "
+                   "and new worker threads fail beyond it \033[0m",
+                   limit / 1024);
+        }
+      } else {
+        ROS_WARN("\033[1;35m[OA] Cannot lock memory: %s \033[0m",
+                 error.c_str());
+      }
     }
   }
 }
 
+void LocalPlannerNode::planIteration() {
+  if (!planner_input_.fetch()) return;
+
+  if (planner_input_.front().obstacle_distance_only) {
+    std::lock_guard<std::mutex> guard(running_mutex_);
+    applyPlannerInput(planner_input_.front());
+    local_planner_->runObstacleDistance();
+    publishObstacleDistance();
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(running_mutex_);
+  ScopedStageTimer timer(PlannerStage::planner);
+  applyPlannerInput(planner_input_.front());
+  local_planner_->generate_cost_image_ =
+      cost_image_pub_.getNumSubscribers() > 0;
+  local_planner_->generate_histogram_image_ =
+      histogram_image_pub_.getNumSubscribers() > 0;
+  local_planner_->runPlanner();
+  publishPlannerData();
+
+  plannerOutput& output = planner_output_.back();
+  output.avoidance_output = local_planner_->getAvoidanceOutput();
+  output.stop_in_front_active = local_planner_->stop_in_front_active_;
+  output.goal = local_planner_->getGoal();
+  output.cloud_stamp = planner_input_.front().cloud_stamp;
+  planner_output_.publish();
+  never_run_ = false;
+  writeSnapshot();
+  writeFlightFrame(timer.elapsedMs());
+
+  ROS_DEBUG("\033[0;35m[OA]Planner calculation time: %2.2f ms \n \033[0m",
+            timer.elapsedMs());
+}
+
 void LocalPlannerNode::checkFailsafe(ros::Duration since_last_cloud,
                                      ros::Duration since_start,
                                      bool& planner_is_healthy, bool& hover) {
@@ -1073,7 +1981,7 @@ void LocalPlannerNode::checkFailsafe(ros::Duration since_last_cloud,
     }
   } else {
     if (since_last_cloud > timeout_critical && since_start > timeout_critical) {
-      if (position_received_) {
+      if (position_received_ || pose_is_fresh_) {
         hover = true;
         status_msg_.state = (int)MAV_STATE::MAV_STATE_CRITICAL;
         std::string not_received = "";
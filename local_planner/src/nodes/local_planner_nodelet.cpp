@@ -0,0 +1,46 @@
+#include "local_planner/local_planner_node.h"
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include <memory>
+#include <thread>
+
+namespace avoidance {
+
+/**
+* @brief LocalPlannerNode loaded into a nodelet manager, the pointclouds of
+*        drivers and conversion nodelets in the same manager are received as
+*        shared pointers to the published messages, without serialization
+**/
+class LocalPlannerNodelet : public nodelet::Nodelet {
+ public:
+  LocalPlannerNodelet() = default;
+  ~LocalPlannerNodelet() {
+    if (node_) {
+      node_->should_exit_ = true;
+    }
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+ private:
+  // the main loop of the node waits on its own queue, so the callbacks are
+  // served by the loop thread like in the standalone node and not by the
+  // manager threads
+  ros::CallbackQueue callback_queue_;
+  std::unique_ptr<LocalPlannerNode> node_;
+  std::thread thread_;
+
+  void onInit() override {
+    ros::NodeHandle nh(getPrivateNodeHandle());
+    nh.setCallbackQueue(&callback_queue_);
+    node_.reset(new LocalPlannerNode(nh, true));
+    thread_ = std::thread(&LocalPlannerNode::run, node_.get(),
+                          std::ref(callback_queue_));
+  }
+};
+}
+
+PLUGINLIB_EXPORT_CLASS(avoidance::LocalPlannerNodelet, nodelet::Nodelet)
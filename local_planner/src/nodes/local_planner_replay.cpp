@@ -0,0 +1,709 @@
+#include "local_planner/common.h"
+#include "local_planner/flight_recorder.h"
+#include "local_planner/local_planner.h"
+#include "local_planner/planner_snapshot.h"
+#include "local_planner/planning_trigger.h"
+#include "local_planner/stage_timer.h"
+#include "local_planner/waypoint_generator.h"
+
+#include <dynamic_reconfigure/Config.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/TwistStamped.h>
+#include <mavros_msgs/Altitude.h>
+#include <mavros_msgs/State.h>
+#include <pcl_ros/transforms.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf/transform_datatypes.h>
+#include <tf2_msgs/TFMessage.h>
+#include <visualization_msgs/MarkerArray.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace avoidance {
+
+/**
+* @brief settings of a replay, parsed from the command line
+**/
+struct ReplayOptions {
+  std::string bag_path;
+  std::string recording_path;  // flight recording replayed instead of a bag
+  std::string frames_path = "replay_frames.csv";
+  std::string timings_path;
+  std::vector<std::string> pointcloud_topics = {"/local_pointcloud"};
+  std::string parameter_topic = "/local_planner_node/parameter_updates";
+  double rate = 0.0;  // multiple of real time, 0 replays as fast as possible
+  Eigen::Vector3f goal = Eigen::Vector3f(9.f, 13.f, 3.5f);
+  bool accept_goal_input_topic = false;
+  bool disable_rise_to_goal_altitude = false;
+  bool bag_parameters = true;
+};
+
+/**
+* @brief drives LocalPlanner and WaypointGenerator with the messages of a bag,
+*        without a ROS master and independent of the wall clock
+* @details ros::Time::now() follows the record time of the messages, so that
+*          every run of the same bag produces the same outputs. Each pose
+*          message is one iteration of the node loop: the planner runs
+*          synchronously once the planning trigger fires and the waypoint
+*          generator is updated afterwards. Unlike the node there is no
+*          failsafe and no second planning thread, so a planner result is
+*          always used by the frame which computed it. A flight recording
+*          is replayed frame by frame instead, with the recorded cloud, pose
+*          and goal of each planner iteration and an obstacle memory seeded
+*          from the histogram of the first one.
+**/
+class LocalPlannerReplay {
+ public:
+  explicit LocalPlannerReplay(const ReplayOptions& options);
+
+  /**
+  * @brief     replays the whole bag or flight recording
+  * @returns   true, if the input could be read and the outputs written
+  **/
+  bool run();
+
+ private:
+  struct ReplayCamera {
+    std::string topic;
+    std::string info_topic;
+    sensor_msgs::PointCloud2::ConstPtr newest_cloud_msg;
+    bool received = false;
+  };
+
+  ReplayOptions options_;
+  LocalPlanner planner_;
+  WaypointGenerator wp_generator_;
+  LocalPlannerNodeConfig config_;
+  tf::Transformer transformer_;
+  std::vector<ReplayCamera> cameras_;
+
+  PlanningTrigger planning_trigger_ = PlanningTrigger::allCameras;
+  double planning_rate_ = 10.0;
+  double max_cloud_age_ = 0.5;
+
+  geometry_msgs::PoseStamped pose_;
+  geometry_msgs::TwistStamped velocity_;
+  mavros_msgs::Altitude ground_distance_msg_;
+  Eigen::Vector3f goal_;
+  Eigen::Vector3f last_sent_waypoint_ = Eigen::Vector3f::Zero();
+  bool armed_ = false;
+  bool offboard_ = false;
+  bool mission_ = false;
+  bool goal_changed_ = false;
+  bool never_run_ = true;
+  ros::Time last_plan_time_;
+
+  std::ofstream frames_file_;
+  std::ofstream timings_file_;
+  size_t num_frames_ = 0;
+  size_t num_planner_runs_ = 0;
+  size_t num_changed_decisions_ = 0;  // recorded frames planned differently
+  std::array<double, static_cast<size_t>(PlannerStage::count)> stage_total_ms_;
+  std::array<double, static_cast<size_t>(PlannerStage::count)> stage_max_ms_;
+
+  void applyConfig(const LocalPlannerNodeConfig& config);
+  bool openOutputs();
+  bool runBag();
+  bool runRecording();
+  void printSummary(double duration, double wall_time) const;
+  void handleMessage(const rosbag::MessageInstance& message);
+  void cameraInfo(const sensor_msgs::CameraInfo& msg, size_t index);
+  bool isCloudUsable(size_t index, const ros::Time& now) const;
+
+  /**
+  * @brief     one iteration of the loop of LocalPlannerNode at a pose update
+  **/
+  void step(const ros::Time& now);
+
+  /**
+  * @brief     hands the clouds of the cameras to the planner and runs it if the
+  *            planning trigger fires and all transforms are available
+  * @returns   true, if the planner ran
+  **/
+  bool plan(const ros::Time& now);
+
+  /**
+  * @brief     seeds the obstacle memory with the histogram of the first
+  *            recorded iteration, which holds the obstacles the planner
+  *            remembered when the recording starts
+  * @returns   false, if the histogram has another resolution than the planner
+  **/
+  bool seedMemory(const FlightFrame& frame);
+
+  /**
+  * @brief     runs the planner and the waypoint generator on the inputs of a
+  *            recorded iteration
+  **/
+  void replayFrame(const FlightFrame& frame);
+
+  void writeFrame(const ros::Time& now, bool planned,
+                  const waypointResult& result);
+  void writeTimings(const ros::Time& now);
+};
+
+LocalPlannerReplay::LocalPlannerReplay(const ReplayOptions& options)
+    : options_(options),
+      config_(LocalPlannerNodeConfig::__getDefault__()),
+      transformer_(true, ros::Duration(tf::Transformer::DEFAULT_CACHE_TIME)),
+      goal_(options.goal) {
+  cameras_.resize(options_.pointcloud_topics.size());
+  for (size_t i = 0; i < cameras_.size(); i++) {
+    // the camera info is published next to the pointcloud, like in the node
+    const std::string& topic = options_.pointcloud_topics[i];
+    cameras_[i].topic = topic;
+    cameras_[i].info_topic = topic.substr(0, topic.rfind('/') + 1);
+    cameras_[i].info_topic.append("camera_info");
+  }
+  planner_.camera_FOVs_.resize(cameras_.size());
+  planner_.disable_rise_to_goal_altitude_ =
+      options_.disable_rise_to_goal_altitude;
+  planner_.setGoal(goal_);
+  applyConfig(config_);
+  stage_total_ms_.fill(0.0);
+  stage_max_ms_.fill(0.0);
+}
+
+void LocalPlannerReplay::applyConfig(const LocalPlannerNodeConfig& config) {
+  config_ = config;
+  planner_.dynamicReconfigureSetParams(config_, ~0u);
+  wp_generator_.setSmoothingSpeed(config.smoothing_speed_xy_,
+                                  config.smoothing_speed_z_);
+  planning_trigger_ = toPlanningTrigger(config.planning_trigger_);
+  planning_rate_ = config.planning_rate_;
+  max_cloud_age_ = config.max_cloud_age_;
+}
+
+bool LocalPlannerReplay::run() {
+  return options_.recording_path.empty() ? runBag() : runRecording();
+}
+
+bool LocalPlannerReplay::openOutputs() {
+  frames_file_.open(options_.frames_path);
+  if (!frames_file_) {
+    std::fprintf(stderr, "Cannot write %s\n", options_.frames_path.c_str());
+    return false;
+  }
+  frames_file_ << "stamp,planned,waypoint_type,goto_x,goto_y,goto_z,"
+                  "adapted_x,adapted_y,adapted_z,smoothed_x,smoothed_y,"
+                  "smoothed_z,velocity_x,velocity_y,velocity_z,yaw_rate\n";
+  if (!options_.timings_path.empty()) {
+    timings_file_.open(options_.timings_path);
+    if (!timings_file_) {
+      std::fprintf(stderr, "Cannot write %s\n", options_.timings_path.c_str());
+      return false;
+    }
+    timings_file_ << "stamp";
+    for (int i = 0; i < static_cast<int>(PlannerStage::count); i++) {
+      timings_file_ << "," << stageName(static_cast<PlannerStage>(i)) << "_ms";
+    }
+    timings_file_ << "\n";
+  }
+  return true;
+}
+
+bool LocalPlannerReplay::runBag() {
+  rosbag::Bag bag;
+  try {
+    bag.open(options_.bag_path, rosbag::bagmode::Read);
+  } catch (rosbag::BagException& ex) {
+    std::fprintf(stderr, "Cannot open %s: %s\n", options_.bag_path.c_str(),
+                 ex.what());
+    return false;
+  }
+  if (!openOutputs()) {
+    return false;
+  }
+
+  // only the topics the planner consumes are deserialized
+  std::vector<std::string> topics = {
+      "/tf",
+      "/tf_static",
+      "/mavros/local_position/pose",
+      "/mavros/local_position/velocity_local",
+      "/mavros/state",
+      "/mavros/altitude",
+      "/input/goal_position"};
+  if (options_.bag_parameters) topics.push_back(options_.parameter_topic);
+  for (const ReplayCamera& camera : cameras_) {
+    topics.push_back(camera.topic);
+    topics.push_back(camera.info_topic);
+  }
+  rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+  const ros::Time bag_start = view.getBeginTime();
+  const std::chrono::steady_clock::time_point wall_start =
+      std::chrono::steady_clock::now();
+  for (const rosbag::MessageInstance& message : view) {
+    const ros::Time stamp = message.getTime();
+    if (options_.rate > 0.0) {
+      std::this_thread::sleep_until(
+          wall_start + std::chrono::duration_cast<
+                           std::chrono::steady_clock::duration>(
+                           std::chrono::duration<double>(
+                               (stamp - bag_start).toSec() / options_.rate)));
+    }
+    ros::Time::setNow(stamp);
+    handleMessage(message);
+  }
+  const double wall_time =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    wall_start)
+          .count();
+  const double bag_time = (view.getEndTime() - bag_start).toSec();
+  bag.close();
+  printSummary(bag_time, wall_time);
+  return true;
+}
+
+bool LocalPlannerReplay::runRecording() {
+  std::vector<FlightFrame> frames;
+  if (!readFlightRecording(options_.recording_path, frames)) {
+    std::fprintf(stderr, "Cannot read %s\n", options_.recording_path.c_str());
+    return false;
+  }
+  if (!openOutputs()) {
+    return false;
+  }
+
+  if (!frames.empty() && !seedMemory(frames.front())) {
+    return false;
+  }
+
+  const std::chrono::steady_clock::time_point wall_start =
+      std::chrono::steady_clock::now();
+  for (const FlightFrame& frame : frames) {
+    replayFrame(frame);
+  }
+  const double wall_time =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    wall_start)
+          .count();
+  printSummary(
+      frames.empty() ? 0.0 : frames.back().stamp - frames.front().stamp,
+      wall_time);
+  std::printf("%zu of %zu frames chose another waypoint type than recorded\n",
+              num_changed_decisions_, frames.size());
+  return true;
+}
+
+void LocalPlannerReplay::printSummary(double duration,
+                                      double wall_time) const {
+  std::printf("%zu frames, %zu planner runs, %.1f s of input in %.1f s "
+              "(%.1fx)\n",
+              num_frames_, num_planner_runs_, duration, wall_time,
+              wall_time > 0.0 ? duration / wall_time : 0.0);
+  for (int i = 0; i < static_cast<int>(PlannerStage::count); i++) {
+    if (stage_total_ms_[i] == 0.0) continue;
+    std::printf("  %-18s mean %8.3f ms  max %8.3f ms per frame\n",
+                stageName(static_cast<PlannerStage>(i)),
+                stage_total_ms_[i] / std::max<size_t>(1, num_frames_),
+                stage_max_ms_[i]);
+  }
+}
+
+void LocalPlannerReplay::handleMessage(const rosbag::MessageInstance& message) {
+  const std::string& topic = message.getTopic();
+  const ros::Time now = message.getTime();
+
+  if (topic == "/tf" || topic == "/tf_static") {
+    tf2_msgs::TFMessage::ConstPtr msg =
+        message.instantiate<tf2_msgs::TFMessage>();
+    if (!msg) return;
+    for (const geometry_msgs::TransformStamped& transform : msg->transforms) {
+      tf::StampedTransform stamped_transform;
+      tf::transformStampedMsgToTF(transform, stamped_transform);
+      transformer_.setTransform(stamped_transform, "replay");
+    }
+  } else if (topic == "/mavros/local_position/pose") {
+    geometry_msgs::PoseStamped::ConstPtr msg =
+        message.instantiate<geometry_msgs::PoseStamped>();
+    if (!msg) return;
+    pose_ = *msg;
+    step(now);
+  } else if (topic == "/mavros/local_position/velocity_local") {
+    geometry_msgs::TwistStamped::ConstPtr msg =
+        message.instantiate<geometry_msgs::TwistStamped>();
+    if (msg) velocity_ = *msg;
+  } else if (topic == "/mavros/state") {
+    mavros_msgs::State::ConstPtr msg =
+        message.instantiate<mavros_msgs::State>();
+    if (!msg) return;
+    armed_ = msg->armed;
+    offboard_ = msg->mode == "OFFBOARD";
+    mission_ = msg->mode == "AUTO.MISSION";
+  } else if (topic == "/mavros/altitude") {
+    mavros_msgs::Altitude::ConstPtr msg =
+        message.instantiate<mavros_msgs::Altitude>();
+    if (msg && !std::isnan(msg->bottom_clearance)) ground_distance_msg_ = *msg;
+  } else if (topic == "/input/goal_position") {
+    visualization_msgs::MarkerArray::ConstPtr msg =
+        message.instantiate<visualization_msgs::MarkerArray>();
+    if (options_.accept_goal_input_topic && msg && msg->markers.size() > 0) {
+      goal_ = toEigen(msg->markers[0].pose.position);
+      goal_changed_ = true;
+    }
+  } else if (topic == options_.parameter_topic) {
+    dynamic_reconfigure::Config::ConstPtr msg =
+        message.instantiate<dynamic_reconfigure::Config>();
+    if (!msg) return;
+    dynamic_reconfigure::Config update = *msg;
+    LocalPlannerNodeConfig config = config_;
+    if (config.__fromMessage__(update)) applyConfig(config);
+  }
+
+  for (size_t i = 0; i < cameras_.size(); i++) {
+    if (topic == cameras_[i].topic) {
+      sensor_msgs::PointCloud2::ConstPtr msg =
+          message.instantiate<sensor_msgs::PointCloud2>();
+      if (!msg) continue;
+      cameras_[i].newest_cloud_msg = msg;
+      cameras_[i].received = true;
+    } else if (topic == cameras_[i].info_topic) {
+      sensor_msgs::CameraInfo::ConstPtr msg =
+          message.instantiate<sensor_msgs::CameraInfo>();
+      if (msg) cameraInfo(*msg, i);
+    }
+  }
+}
+
+void LocalPlannerReplay::cameraInfo(const sensor_msgs::CameraInfo& msg,
+                                    size_t index) {
+  // same field of view as LocalPlannerNode::cameraInfoCallback
+  CameraFOV& fov = planner_.camera_FOVs_[index];
+  fov.h_FOV = static_cast<float>(
+      2.0 * atan(static_cast<double>(msg.width) / (2.0 * msg.K[0])) * 180.0 /
+      M_PI);
+  fov.v_FOV = static_cast<float>(
+      2.0 * atan(static_cast<double>(msg.height) / (2.0 * msg.K[4])) * 180.0 /
+      M_PI);
+  planner_.h_FOV_ = static_cast<float>(cameras_.size()) * fov.h_FOV;
+  planner_.v_FOV_ = fov.v_FOV;
+  wp_generator_.setFOV(planner_.h_FOV_, planner_.v_FOV_);
+}
+
+bool LocalPlannerReplay::isCloudUsable(size_t index,
+                                       const ros::Time& now) const {
+  const sensor_msgs::PointCloud2::ConstPtr& msg =
+      cameras_[index].newest_cloud_msg;
+  if (!msg) {
+    return false;
+  }
+  return avoidance::isCloudUsable(planning_trigger_,
+                                  (now - msg->header.stamp).toSec(),
+                                  max_cloud_age_);
+}
+
+bool LocalPlannerReplay::plan(const ros::Time& now) {
+  size_t num_new_clouds = 0;
+  size_t num_usable_clouds = 0;
+  for (size_t i = 0; i < cameras_.size(); i++) {
+    if (cameras_[i].received) num_new_clouds++;
+    if (isCloudUsable(i, now)) num_usable_clouds++;
+  }
+  if (!readyToPlan(planning_trigger_, cameras_.size(), num_new_clouds,
+                   num_usable_clouds, (now - last_plan_time_).toSec(),
+                   planning_rate_)) {
+    return false;
+  }
+
+  // wait for the transforms of all clouds which are handed over, by the same
+  // rules as the node
+  if (!canStageClouds(
+          planning_trigger_, cameras_.size(),
+          [this, &now](size_t i) { return isCloudUsable(i, now); },
+          [this](size_t i) {
+            return transformer_.canTransform(
+                "/local_origin",
+                cameras_[i].newest_cloud_msg->header.frame_id, ros::Time(0));
+          })) {
+    return false;
+  }
+
+  ScopedStageTimer timer(PlannerStage::planner);
+  planner_.complete_cloud_.clear();
+  planner_.complete_cloud_msgs_.assign(cameras_.size(),
+                                       sensor_msgs::PointCloud2::ConstPtr());
+  planner_.complete_cloud_transforms_.resize(cameras_.size());
+  {
+    ScopedStageTimer ingest_timer(PlannerStage::ingest);
+    for (size_t i = 0; i < cameras_.size(); i++) {
+      cameras_[i].received = false;
+      if (!isCloudUsable(i, now)) continue;
+      const sensor_msgs::PointCloud2::ConstPtr& msg =
+          cameras_[i].newest_cloud_msg;
+      try {
+        tf::StampedTransform transform;
+        transformer_.lookupTransform("/local_origin", msg->header.frame_id,
+                                     msg->header.stamp, transform);
+        Eigen::Matrix4f transform_matrix;
+        pcl_ros::transformAsMatrix(transform, transform_matrix);
+        planner_.complete_cloud_transforms_[i].matrix() = transform_matrix;
+        planner_.complete_cloud_msgs_[i] = msg;
+      } catch (tf::TransformException& ex) {
+        ROS_ERROR("Received an exception trying to transform a pointcloud: %s",
+                  ex.what());
+      }
+    }
+  }
+  last_plan_time_ = now;
+
+  planner_.setPose(toEigen(pose_.pose.position),
+                   toEigen(pose_.pose.orientation));
+  planner_.setCurrentVelocity(toEigen(velocity_.twist.linear));
+  planner_.currently_armed_ = armed_;
+  planner_.offboard_ = offboard_;
+  planner_.mission_ = mission_;
+  if (goal_changed_) {
+    planner_.setGoal(goal_);
+    goal_changed_ = false;
+  }
+  planner_.ground_distance_ =
+      now - ground_distance_msg_.header.stamp < ros::Duration(0.5)
+          ? ground_distance_msg_.bottom_clearance
+          : 2.0f;
+  planner_.last_sent_waypoint_ = last_sent_waypoint_;
+
+  planner_.runPlanner();
+  wp_generator_.setPlannerInfo(planner_.getAvoidanceOutput());
+  if (planner_.stop_in_front_active_) {
+    goal_ = planner_.getGoal();
+  }
+  num_planner_runs_++;
+  never_run_ = false;
+  return true;
+}
+
+bool LocalPlannerReplay::seedMemory(const FlightFrame& frame) {
+  if (frame.histogram_resolution == 0) {
+    return true;
+  }
+  if (frame.histogram_resolution != ALPHA_RES) {
+    std::fprintf(stderr, "The recording has a histogram resolution of %d deg, "
+                         "the planner of %d deg\n",
+                 frame.histogram_resolution, ALPHA_RES);
+    return false;
+  }
+
+  // every occupied cell becomes a voxel at its distance, the first frame
+  // replaces the ones inside its field of view like in the recorded run
+  std::vector<float> x, y, z;
+  for (const RecordedCell& cell : frame.histogram) {
+    if (cell.index >= GRID_LENGTH_E * GRID_LENGTH_Z) continue;
+    const PolarPoint p_pol = histogramIndexToPolar(
+        cell.index / GRID_LENGTH_Z, cell.index % GRID_LENGTH_Z, ALPHA_RES,
+        cell.distance_cm / 100.f);
+    const Eigen::Vector3f point = polarToCartesian(p_pol, frame.position);
+    x.push_back(point.x());
+    y.push_back(point.y());
+    z.push_back(point.z());
+  }
+  PlannerSnapshot snapshot;
+  planner_.getSnapshot(snapshot);
+  snapshot.goal = frame.goal;
+  snapshot.obstacle_memory.assign(
+      x, y, z, std::vector<int>(x.size(), 1), std::vector<int>(x.size(), 1),
+      std::vector<uint8_t>(x.size(), CONFIDENCE_HIT));
+  planner_.restoreSnapshot(snapshot);
+  return true;
+}
+
+void LocalPlannerReplay::replayFrame(const FlightFrame& frame) {
+  const ros::Time now(frame.stamp);
+  ros::Time::setNow(now);
+  StageTimings::instance().reset();
+
+  // the recorded cloud is already cropped and downsampled, filtering it again
+  // around the same position keeps it as it is
+  const Eigen::Quaternionf orientation(
+      Eigen::AngleAxisf(frame.yaw, Eigen::Vector3f::UnitZ()) *
+      Eigen::AngleAxisf(frame.pitch, Eigen::Vector3f::UnitY()));
+  {
+    ScopedStageTimer timer(PlannerStage::planner);
+    planner_.complete_cloud_msgs_.clear();
+    planner_.complete_cloud_.assign(1, frame.cloud);
+    planner_.camera_FOVs_.assign(1, CameraFOV());
+    planner_.camera_FOVs_[0].h_FOV = frame.h_fov;
+    planner_.camera_FOVs_[0].v_FOV = frame.v_fov;
+    planner_.h_FOV_ = frame.h_fov;
+    planner_.v_FOV_ = frame.v_fov;
+    wp_generator_.setFOV(frame.h_fov, frame.v_fov);
+
+    planner_.setPose(frame.position, orientation);
+    planner_.setCurrentVelocity(frame.velocity);
+    planner_.currently_armed_ = frame.armed;
+    planner_.offboard_ = frame.offboard;
+    planner_.mission_ = frame.mission;
+    if (frame.goal != planner_.getGoal()) {
+      planner_.setGoal(frame.goal);
+    }
+    planner_.ground_distance_ = frame.ground_distance;
+    planner_.last_sent_waypoint_ = frame.last_sent_waypoint;
+    planner_.runPlanner();
+  }
+  const avoidanceOutput output = planner_.getAvoidanceOutput();
+  if (output.waypoint_type != frame.waypoint_type) {
+    num_changed_decisions_++;
+  }
+  wp_generator_.setPlannerInfo(output);
+  num_planner_runs_++;
+
+  bool is_airborne = frame.armed && (frame.mission || frame.offboard);
+  wp_generator_.updateState(frame.position, orientation, frame.goal,
+                            frame.velocity, false, is_airborne);
+  waypointResult result;
+  {
+    ScopedStageTimer timer(PlannerStage::waypointGenerator);
+    result = wp_generator_.getWaypoints();
+  }
+
+  writeFrame(now, true, result);
+  writeTimings(now);
+  num_frames_++;
+}
+
+void LocalPlannerReplay::step(const ros::Time& now) {
+  StageTimings::instance().reset();
+  bool planned = plan(now);
+  if (never_run_) return;
+
+  bool is_airborne = armed_ && (mission_ || offboard_);
+  wp_generator_.updateState(toEigen(pose_.pose.position),
+                            toEigen(pose_.pose.orientation), goal_,
+                            toEigen(velocity_.twist.linear), false,
+                            is_airborne);
+  waypointResult result;
+  {
+    ScopedStageTimer timer(PlannerStage::waypointGenerator);
+    result = wp_generator_.getWaypoints();
+  }
+  last_sent_waypoint_ = result.smoothed_goto_position;
+
+  writeFrame(now, planned, result);
+  writeTimings(now);
+  num_frames_++;
+}
+
+void LocalPlannerReplay::writeFrame(const ros::Time& now, bool planned,
+                                    const waypointResult& result) {
+  // fixed precision so that the files of two runs can be compared with diff
+  char line[512];
+  std::snprintf(
+      line, sizeof(line),
+      "%.6f,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,"
+      "%.4f,%.4f\n",
+      now.toSec(), planned ? 1 : 0, static_cast<int>(result.waypoint_type),
+      result.goto_position.x(), result.goto_position.y(),
+      result.goto_position.z(), result.adapted_goto_position.x(),
+      result.adapted_goto_position.y(), result.adapted_goto_position.z(),
+      result.smoothed_goto_position.x(), result.smoothed_goto_position.y(),
+      result.smoothed_goto_position.z(), result.linear_velocity_wp.x(),
+      result.linear_velocity_wp.y(), result.linear_velocity_wp.z(),
+      result.angular_velocity_wp.z());
+  frames_file_ << line;
+}
+
+void LocalPlannerReplay::writeTimings(const ros::Time& now) {
+  if (timings_file_.is_open()) timings_file_ << std::fixed << now.toSec();
+  for (int i = 0; i < static_cast<int>(PlannerStage::count); i++) {
+    double total_ms =
+        StageTimings::instance().statistics(static_cast<PlannerStage>(i))
+            .total_ms;
+    stage_total_ms_[i] += total_ms;
+    stage_max_ms_[i] = std::max(stage_max_ms_[i], total_ms);
+    if (timings_file_.is_open()) timings_file_ << "," << total_ms;
+  }
+  if (timings_file_.is_open()) timings_file_ << "\n";
+}
+}
+
+static void printUsage(const char* name) {
+  std::fprintf(
+      stderr,
+      "usage: %s <bag> [options]\n"
+      "       %s --recording <file> [options]\n"
+      "  --output <file>           per frame waypoints [replay_frames.csv]\n"
+      "  --timings <file>          per frame stage timings\n"
+      "  --rate <factor>           multiple of real time, 0 is as fast as\n"
+      "                            possible [0]\n"
+      "  --pointcloud_topics <a,b> clouds of the cameras [/local_pointcloud]\n"
+      "  --goal <x,y,z>            initial goal [9,13,3.5]\n"
+      "  --accept_goal_input_topic follow /input/goal_position\n"
+      "  --disable_rise_to_goal_altitude\n"
+      "  --ignore_bag_parameters   keep the default parameters instead of the\n"
+      "                            recorded parameter updates\n"
+      "  --recording <file>        replay the frames of a flight recording\n"
+      "                            instead of a bag\n",
+      name, name);
+}
+
+static std::vector<std::string> splitList(const std::string& list) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) items.push_back(item);
+  }
+  return items;
+}
+
+int main(int argc, char** argv) {
+  using namespace avoidance;
+  ReplayOptions options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--output" && has_value) {
+      options.frames_path = argv[++i];
+    } else if (arg == "--recording" && has_value) {
+      options.recording_path = argv[++i];
+    } else if (arg == "--timings" && has_value) {
+      options.timings_path = argv[++i];
+    } else if (arg == "--rate" && has_value) {
+      options.rate = std::atof(argv[++i]);
+    } else if (arg == "--pointcloud_topics" && has_value) {
+      options.pointcloud_topics = splitList(argv[++i]);
+    } else if (arg == "--goal" && has_value) {
+      std::vector<std::string> goal = splitList(argv[++i]);
+      if (goal.size() != 3) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      for (int k = 0; k < 3; k++) options.goal[k] = std::stof(goal[k]);
+    } else if (arg == "--accept_goal_input_topic") {
+      options.accept_goal_input_topic = true;
+    } else if (arg == "--disable_rise_to_goal_altitude") {
+      options.disable_rise_to_goal_altitude = true;
+    } else if (arg == "--ignore_bag_parameters") {
+      options.bag_parameters = false;
+    } else if (arg[0] != '-' && options.bag_path.empty()) {
+      options.bag_path = arg;
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if ((options.bag_path.empty() && options.recording_path.empty()) ||
+      options.pointcloud_topics.empty()) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  // the planner reads the time through ros::Time::now(), which returns the
+  // record time of the current message set by the replay
+  ros::Time::init();
+  LocalPlannerReplay replay(options);
+  return replay.run() ? 0 : 1;
+}
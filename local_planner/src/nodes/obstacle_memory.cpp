@@ -0,0 +1,185 @@
+#include "local_planner/obstacle_memory.h"
+
+#include "local_planner/histogram.h"
+#include "local_planner/polar_binning.h"
+
+#include <algorithm>
+
+namespace avoidance {
+
+void ObstacleMemory::clear() {
+  x_.clear();
+  y_.clear();
+  z_.clear();
+  count_.clear();
+  age_.clear();
+  confidence_.clear();
+  keys_.clear();
+}
+
+void ObstacleMemory::assign(const std::vector<float>& x,
+                            const std::vector<float>& y,
+                            const std::vector<float>& z,
+                            const std::vector<int>& count,
+                            const std::vector<int>& age,
+                            const std::vector<uint8_t>& confidence) {
+  x_ = x;
+  y_ = y;
+  z_ = z;
+  count_ = count;
+  age_ = age;
+  confidence_ = confidence;
+  // the keys are computed from the centroids by the next update
+  keys_.assign(x_.size(), 0);
+}
+
+void ObstacleMemory::resize(size_t n) {
+  keys_.resize(n);
+  x_.resize(n);
+  y_.resize(n);
+  z_.resize(n);
+  count_.resize(n);
+  age_.resize(n);
+  confidence_.resize(n);
+}
+
+void ObstacleMemory::push_back(uint64_t key, float x, float y, float z,
+                               int count, int age, int confidence) {
+  keys_.push_back(key);
+  x_.push_back(x);
+  y_.push_back(y);
+  z_.push_back(z);
+  count_.push_back(count);
+  age_.push_back(age);
+  confidence_.push_back(static_cast<uint8_t>(confidence));
+}
+
+void ObstacleMemory::update(const VoxelIndex& voxels,
+                            const Eigen::Vector3f& position,
+                            const FOV& fov, bool age_voxels, int max_age,
+                            float max_distance, int confidence_decay) {
+  // the current frame replaces the memory inside the field of view, outside
+  // of it the voxels grow older and lose confidence until they are forgotten.
+  // Voxels inside of it are kept with age 0 until the current frame is merged
+  // so that the ones seen again keep their confidence
+  const bool merge = voxels.voxelSize() > 0.f;
+  const float decay_per_meter =
+      max_distance > 0.f ? confidence_decay / max_distance : 0.f;
+  bin_.resize(size());
+  dist_.resize(size());
+  polarBinning(x_.data(), y_.data(), z_.data(), size(), position, ALPHA_RES,
+               bin_.data(), dist_.data());
+  size_t kept = 0;
+  size_t pending = 0;
+  for (size_t i = 0; i < size(); i++) {
+    int e = bin_[i] / GRID_LENGTH_Z;
+    int z = bin_[i] % GRID_LENGTH_Z;
+    bool inside_FOV = fov.contains(e, z);
+    int age = age_voxels ? age_[i] + 1 : age_[i];
+    int confidence = confidence_[i];
+    if (age_voxels && confidence_decay > 0) {
+      int decay = static_cast<int>(decay_per_meter * dist_[i] + 0.5f);
+      confidence -= std::max(1, decay);
+    }
+    bool confident = confidence_decay <= 0 || confidence > 0;
+    bool in_range = dist_[i] < max_distance && dist_[i] > 0.3f;
+    if (inside_FOV && merge && in_range) {
+      age = 0;
+      confidence = confidence_[i];
+      pending++;
+    } else if (inside_FOV || !confident || age >= max_age || !in_range) {
+      continue;
+    }
+    x_[kept] = x_[i];
+    y_[kept] = y_[i];
+    z_[kept] = z_[i];
+    count_[kept] = count_[i];
+    age_[kept] = age;
+    confidence_[kept] = static_cast<uint8_t>(confidence);
+    kept++;
+  }
+  resize(kept);
+
+  // without voxels every point is kept on its own
+  if (!merge) {
+    for (size_t i = 0; i < voxels.size(); i++) {
+      push_back(0, voxels.x()[i], voxels.y()[i], voxels.z()[i],
+                voxels.count()[i], 1, CONFIDENCE_HIT);
+    }
+    return;
+  }
+
+  // hash the remaining voxels and merge the current ones, a voxel seen again
+  // is replaced by the new measurement and gains confidence
+  size_t n_slots = 16;
+  while (n_slots < 2 * (kept + voxels.size())) {
+    n_slots <<= 1;
+  }
+  slots_.assign(n_slots, -1);
+  const size_t slot_mask = n_slots - 1;
+  const float inv_size = 1.f / voxels.voxelSize();
+  for (size_t i = 0; i < kept; i++) {
+    keys_[i] = voxelKey(x_[i], y_[i], z_[i], inv_size);
+    size_t slot = hashVoxelKey(keys_[i]) & slot_mask;
+    while (slots_[slot] >= 0 && keys_[slots_[slot]] != keys_[i]) {
+      slot = (slot + 1) & slot_mask;
+    }
+    // a voxel size change can map two voxels to the same key, the older one
+    // is shadowed and ages out
+    if (slots_[slot] < 0) {
+      slots_[slot] = static_cast<int>(i);
+    }
+  }
+
+  for (size_t i = 0; i < voxels.size(); i++) {
+    float x = voxels.x()[i], y = voxels.y()[i], z = voxels.z()[i];
+    uint64_t key = voxelKey(x, y, z, inv_size);
+    size_t slot = hashVoxelKey(key) & slot_mask;
+    while (slots_[slot] >= 0 && keys_[slots_[slot]] != key) {
+      slot = (slot + 1) & slot_mask;
+    }
+
+    if (slots_[slot] < 0) {
+      slots_[slot] = static_cast<int>(size());
+      push_back(key, x, y, z, voxels.count()[i], 1, CONFIDENCE_HIT);
+    } else {
+      int voxel = slots_[slot];
+      x_[voxel] = x;
+      y_[voxel] = y;
+      z_[voxel] = z;
+      count_[voxel] = voxels.count()[i];
+      age_[voxel] = 1;
+      confidence_[voxel] = static_cast<uint8_t>(
+          std::min(CONFIDENCE_MAX, confidence_[voxel] + CONFIDENCE_HIT));
+    }
+  }
+
+  // the voxels inside the field of view that were not seen again are gone
+  if (pending > 0) {
+    size_t n = 0;
+    for (size_t i = 0; i < size(); i++) {
+      if (age_[i] > 0) {
+        keys_[n] = keys_[i];
+        x_[n] = x_[i];
+        y_[n] = y_[i];
+        z_[n] = z_[i];
+        count_[n] = count_[i];
+        age_[n] = age_[i];
+        confidence_[n] = confidence_[i];
+        n++;
+      }
+    }
+    resize(n);
+  }
+}
+
+void ObstacleMemory::toCloud(pcl::PointCloud<pcl::PointXYZ>& cloud) const {
+  cloud.points.clear();
+  cloud.points.reserve(size());
+  for (size_t i = 0; i < size(); i++) {
+    cloud.points.push_back(pcl::PointXYZ(x_[i], y_[i], z_[i]));
+  }
+  cloud.width = cloud.points.size();
+  cloud.height = 1;
+}
+}
@@ -1,9 +1,17 @@
 #include "local_planner/planner_functions.h"
 
 #include "local_planner/common.h"
+#include "local_planner/polar_binning.h"
+#include "local_planner/stage_timer.h"
 
+#include <pcl_conversions/pcl_conversions.h>
 #include <ros/console.h>
+#include <sensor_msgs/image_encodings.h>
+#include <sensor_msgs/point_cloud2_iterator.h>
 
+#include <algorithm>
+#include <cstring>
+#include <functional>
 #include <numeric>
 
 namespace avoidance {
@@ -55,9 +63,270 @@ void filterPointCloud(
   }
 }
 
+// read the raw sensor buffers and trim them to the bounding box in one pass,
+// without converting them to intermediate pcl clouds first
+void filterPointCloud(
+    pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+    Eigen::Vector3f& closest_point, float& distance_to_closest_point,
+    int& counter_backoff,
+    const std::vector<sensor_msgs::PointCloud2::ConstPtr>& cloud_msgs,
+    const std::vector<Eigen::Affine3f,
+                      Eigen::aligned_allocator<Eigen::Affine3f>>& transforms,
+    int min_cloud_size, float min_dist_backoff, Box histogram_box,
+    const Eigen::Vector3f& position, float min_realsense_dist) {
+  cropped_cloud.points.clear();
+  cropped_cloud.width = 0;
+  distance_to_closest_point = HUGE_VAL;
+  counter_backoff = 0;
+
+  size_t n_points = 0;
+  for (const auto& msg : cloud_msgs) {
+    if (msg) n_points += msg->width * msg->height;
+  }
+  cropped_cloud.points.reserve(n_points);
+
+  for (size_t i = 0; i < cloud_msgs.size() && i < transforms.size(); ++i) {
+    if (!cloud_msgs[i] || cloud_msgs[i]->width * cloud_msgs[i]->height == 0) {
+      continue;
+    }
+    const sensor_msgs::PointCloud2& msg = *cloud_msgs[i];
+    const Eigen::Affine3f& transform = transforms[i];
+
+    for (sensor_msgs::PointCloud2ConstIterator<float> it(msg, "x");
+         it != it.end(); ++it) {
+      // Check if the point is invalid
+      if (std::isnan(it[0]) || std::isnan(it[1]) || std::isnan(it[2])) {
+        continue;
+      }
+      const Eigen::Vector3f xyz =
+          transform * Eigen::Vector3f(it[0], it[1], it[2]);
+      if (histogram_box.isPointWithinBox(xyz.x(), xyz.y(), xyz.z())) {
+        float distance = (position - xyz).norm();
+        if (distance > min_realsense_dist && distance < histogram_box.radius_) {
+          cropped_cloud.points.push_back(toXYZ(xyz));
+          if (distance < distance_to_closest_point) {
+            distance_to_closest_point = distance;
+            closest_point = xyz;
+          }
+          if (distance < min_dist_backoff) {
+            counter_backoff++;
+          }
+        }
+      }
+    }
+  }
+
+  if (!cloud_msgs.empty() && cloud_msgs[0]) {
+    cropped_cloud.header.stamp =
+        pcl_conversions::toPCL(cloud_msgs[0]->header.stamp);
+  }
+  cropped_cloud.header.frame_id = "/local_origin";
+  cropped_cloud.height = 1;
+  cropped_cloud.width = cropped_cloud.points.size();
+  if (cropped_cloud.points.size() <= min_cloud_size) {
+    cropped_cloud.points.clear();
+    cropped_cloud.width = 0;
+  }
+}
+
+void filterPointCloud(
+    pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+    Eigen::Vector3f& closest_point, float& distance_to_closest_point,
+    int& counter_backoff,
+    const std::vector<sensor_msgs::Image::ConstPtr>& depth_images,
+    const std::vector<std::shared_ptr<const DepthRays>>& depth_rays,
+    const std::vector<Eigen::Affine3f,
+                      Eigen::aligned_allocator<Eigen::Affine3f>>& transforms,
+    int stride, int min_cloud_size, float min_dist_backoff, Box histogram_box,
+    const Eigen::Vector3f& position, float min_realsense_dist) {
+  cropped_cloud.points.clear();
+  cropped_cloud.width = 0;
+  distance_to_closest_point = HUGE_VAL;
+  counter_backoff = 0;
+  stride = std::max(1, stride);
+
+  size_t n_images =
+      std::min(depth_images.size(), std::min(depth_rays.size(),
+                                             transforms.size()));
+  size_t n_points = 0;
+  for (size_t i = 0; i < n_images; ++i) {
+    if (depth_images[i]) {
+      n_points += (depth_images[i]->width / stride + 1) *
+                  (depth_images[i]->height / stride + 1);
+    }
+  }
+  cropped_cloud.points.reserve(n_points);
+
+  for (size_t i = 0; i < n_images; ++i) {
+    float scale;
+    if (!depth_images[i] || !depth_rays[i] ||
+        !depth_rays[i]->fits(*depth_images[i]) ||
+        !depthImageScale(depth_images[i]->encoding, scale)) {
+      continue;
+    }
+    const sensor_msgs::Image& image = *depth_images[i];
+    const bool is_16bit =
+        image.encoding == sensor_msgs::image_encodings::TYPE_16UC1;
+    const size_t pixel_size = is_16bit ? sizeof(uint16_t) : sizeof(float);
+    const size_t width = image.width;
+    const size_t height = image.height;
+    const size_t step = image.step;
+    if (image.data.size() < height * step || step < width * pixel_size) {
+      continue;
+    }
+    const uint8_t* data = image.data.data();
+    const float* ray_x = depth_rays[i]->x().data();
+    const float* ray_y = depth_rays[i]->y().data();
+
+    // the ray of a pixel rotated to local_origin is the sum of the rotated
+    // column and row parts, so only a multiply-add is left per pixel. The
+    // outputs are kept in locals, the stores into the cloud could alias them
+    const Eigen::Matrix4f& matrix = transforms[i].matrix();
+    const Eigen::Vector4f column_axis = matrix.col(0);
+    const Eigen::Vector4f translation = matrix.col(3);
+    float closest_distance = distance_to_closest_point;
+    int backoff = counter_backoff;
+    for (size_t v = 0; v < height; v += stride) {
+      const uint8_t* row = data + v * step;
+      const Eigen::Vector4f row_ray = ray_y[v] * matrix.col(1) + matrix.col(2);
+      for (size_t u = 0; u < width; u += stride) {
+        float depth;
+        if (is_16bit) {
+          uint16_t raw;
+          std::memcpy(&raw, row + u * pixel_size, sizeof(raw));
+          depth = scale * raw;
+        } else {
+          std::memcpy(&depth, row + u * pixel_size, sizeof(depth));
+        }
+        // no measurement
+        if (!(depth > 0.f) || !std::isfinite(depth)) {
+          continue;
+        }
+        const Eigen::Vector3f xyz =
+            (depth * (row_ray + ray_x[u] * column_axis) + translation)
+                .head<3>();
+        if (histogram_box.isPointWithinBox(xyz.x(), xyz.y(), xyz.z())) {
+          float distance = (position - xyz).norm();
+          if (distance > min_realsense_dist &&
+              distance < histogram_box.radius_) {
+            cropped_cloud.points.push_back(toXYZ(xyz));
+            if (distance < closest_distance) {
+              closest_distance = distance;
+              closest_point = xyz;
+            }
+            if (distance < min_dist_backoff) {
+              backoff++;
+            }
+          }
+        }
+      }
+    }
+    distance_to_closest_point = closest_distance;
+    counter_backoff = backoff;
+  }
+
+  if (!depth_images.empty() && depth_images[0]) {
+    cropped_cloud.header.stamp =
+        pcl_conversions::toPCL(depth_images[0]->header.stamp);
+  }
+  cropped_cloud.header.frame_id = "/local_origin";
+  cropped_cloud.height = 1;
+  cropped_cloud.width = cropped_cloud.points.size();
+  if (cropped_cloud.points.size() <= min_cloud_size) {
+    cropped_cloud.points.clear();
+    cropped_cloud.width = 0;
+  }
+}
+
+void downsamplePointCloud(pcl::PointCloud<pcl::PointXYZ>& cloud,
+                          const Eigen::Vector3f& position, float voxel_size,
+                          size_t max_points, DownsampleWorkspace& workspace) {
+  bool exceeds_budget = max_points > 0 && cloud.points.size() > max_points;
+  if (cloud.points.empty() || (voxel_size <= 0.f && !exceeds_budget)) {
+    return;
+  }
+
+  // closest point of every occupied bin, these are always kept
+  PolarBinningBuffer& binning = workspace.binning;
+  binning.load(cloud);
+  polarBinning(binning, position, ALPHA_RES);
+  std::vector<int>& closest_in_bin = workspace.closest_in_bin;
+  closest_in_bin.assign(GRID_LENGTH_E * GRID_LENGTH_Z, -1);
+  size_t n_bins = 0;
+  for (size_t i = 0; i < binning.size(); i++) {
+    int& closest = closest_in_bin[binning.bin[i]];
+    if (closest < 0) {
+      n_bins++;
+      closest = static_cast<int>(i);
+    } else if (binning.dist[i] < binning.dist[closest]) {
+      closest = static_cast<int>(i);
+    }
+  }
+
+  pcl::PointCloud<pcl::PointXYZ>& output = workspace.output;
+  output.points.clear();
+  if (voxel_size > 0.f) {
+    // the centroids replace the points, a bin which got no centroid because
+    // its points were averaged into a neighbouring bin keeps its closest point
+    VoxelIndex& voxels = workspace.voxels;
+    voxels.build(cloud, voxel_size);
+    workspace.centroid_bins.resize(voxels.size());
+    binning.dist.resize(voxels.size());
+    polarBinning(voxels.x().data(), voxels.y().data(), voxels.z().data(),
+                 voxels.size(), position, ALPHA_RES,
+                 workspace.centroid_bins.data(), binning.dist.data());
+    workspace.bin_covered.assign(closest_in_bin.size(), 0);
+    output.points.reserve(voxels.size() + n_bins);
+    for (size_t i = 0; i < voxels.size(); i++) {
+      workspace.bin_covered[workspace.centroid_bins[i]] = 1;
+      output.points.push_back(
+          pcl::PointXYZ(voxels.x()[i], voxels.y()[i], voxels.z()[i]));
+    }
+    for (size_t bin = 0; bin < closest_in_bin.size(); bin++) {
+      if (closest_in_bin[bin] >= 0 && !workspace.bin_covered[bin]) {
+        output.points.push_back(cloud.points[closest_in_bin[bin]]);
+      }
+    }
+  } else {
+    output.points = cloud.points;
+  }
+
+  if (max_points > 0 && output.points.size() > max_points) {
+    // the closest point of every bin first, then an even stride over the
+    // remaining candidates up to the budget
+    pcl::PointCloud<pcl::PointXYZ>& candidates = workspace.candidates;
+    candidates.points.swap(output.points);
+    output.points.clear();
+    output.points.reserve(std::max(max_points, n_bins));
+    for (size_t bin = 0; bin < closest_in_bin.size(); bin++) {
+      if (closest_in_bin[bin] >= 0) {
+        output.points.push_back(cloud.points[closest_in_bin[bin]]);
+      }
+    }
+    if (max_points > n_bins) {
+      size_t remaining = max_points - n_bins;
+      double stride = static_cast<double>(candidates.points.size()) / remaining;
+      for (size_t i = 0; i < remaining; i++) {
+        output.points.push_back(
+            candidates.points[static_cast<size_t>(i * stride)]);
+      }
+    }
+  }
+
+  cloud.points.swap(output.points);
+  cloud.width = cloud.points.size();
+  cloud.height = 1;
+}
+
+// Sets the azimuth indices in [begin, end) inside the FOV
+static void setAzimuthRange(FOV& fov, int begin, int end) {
+  for (int z = std::max(begin, 0); z < std::min(end, GRID_LENGTH_Z); z++) {
+    fov.azimuth.set(z);
+  }
+}
+
 // Calculate FOV. Azimuth angle is wrapped, elevation is not!
-void calculateFOV(float h_fov, float v_fov, std::vector<int>& z_FOV_idx,
-                  int& e_FOV_min, int& e_FOV_max, float yaw_fcu_frame,
+void calculateFOV(float h_fov, float v_fov, FOV& fov, float yaw_fcu_frame,
                   float pitch_fcu_frame) {
   int z_FOV_max = static_cast<int>(std::round(
                       (-yaw_fcu_frame * RAD_TO_DEG + h_fov / 2.0f + 270.0f) /
@@ -67,11 +336,11 @@ void calculateFOV(float h_fov, float v_fov, std::vector<int>& z_FOV_idx,
                       (-yaw_fcu_frame * RAD_TO_DEG - h_fov / 2.0f + 270.0f) /
                       static_cast<float>(ALPHA_RES))) -
                   1;
-  e_FOV_max = static_cast<int>(std::round(
+  fov.e_max = static_cast<int>(std::round(
                   (-pitch_fcu_frame * RAD_TO_DEG + v_fov / 2.0f + 90.0f) /
                   static_cast<float>(ALPHA_RES))) -
               1;
-  e_FOV_min = static_cast<int>(std::round(
+  fov.e_min = static_cast<int>(std::round(
                   (-pitch_fcu_frame * RAD_TO_DEG - v_fov / 2.0f + 90.0f) /
                   static_cast<float>(ALPHA_RES))) -
               1;
@@ -85,144 +354,378 @@ void calculateFOV(float h_fov, float v_fov, std::vector<int>& z_FOV_idx,
     z_FOV_min += GRID_LENGTH_Z;
   }
 
-  z_FOV_idx.clear();
+  fov.azimuth.reset();
   if (z_FOV_max >= GRID_LENGTH_Z && z_FOV_min < GRID_LENGTH_Z) {
-    for (int i = 0; i < z_FOV_max - GRID_LENGTH_Z; i++) {
-      z_FOV_idx.push_back(i);
-    }
-    for (int i = z_FOV_min; i < GRID_LENGTH_Z; i++) {
-      z_FOV_idx.push_back(i);
-    }
+    setAzimuthRange(fov, 0, z_FOV_max - GRID_LENGTH_Z);
+    setAzimuthRange(fov, z_FOV_min, GRID_LENGTH_Z);
   } else if (z_FOV_min < 0 && z_FOV_max >= 0) {
-    for (int i = 0; i < z_FOV_max; i++) {
-      z_FOV_idx.push_back(i);
-    }
-    for (int i = z_FOV_min + GRID_LENGTH_Z; i < GRID_LENGTH_Z; i++) {
-      z_FOV_idx.push_back(i);
-    }
+    setAzimuthRange(fov, 0, z_FOV_max);
+    setAzimuthRange(fov, z_FOV_min + GRID_LENGTH_Z, GRID_LENGTH_Z);
   } else {
-    for (int i = z_FOV_min; i < z_FOV_max; i++) {
-      z_FOV_idx.push_back(i);
-    }
-  }
-}
-
-// Build histogram estimate from reprojected points
-void propagateHistogram(
-    Histogram& polar_histogram_est,
-    const pcl::PointCloud<pcl::PointXYZ>& reprojected_points,
-    const std::vector<int>& reprojected_points_age,
-    const Eigen::Vector3f& position) {
-  Eigen::MatrixXi counter(GRID_LENGTH_E / 2, GRID_LENGTH_Z / 2);
-  counter.fill(0);
-
-  for (size_t i = 0; i < reprojected_points.points.size(); i++) {
-    PolarPoint p_pol =
-        cartesianToPolar(toEigen(reprojected_points.points[i]), position);
-    Eigen::Vector2i p_ind = polarToHistogramIndex(p_pol, 2 * ALPHA_RES);
-    float point_distance =
-        (position - toEigen(reprojected_points.points[i])).norm();
-
-    counter(p_ind.y(), p_ind.x()) += 1;
-    polar_histogram_est.set_age(
-        p_ind.y(), p_ind.x(),
-        polar_histogram_est.get_age(p_ind.y(), p_ind.x()) +
-            reprojected_points_age[i]);
-    polar_histogram_est.set_dist(
-        p_ind.y(), p_ind.x(),
-        polar_histogram_est.get_dist(p_ind.y(), p_ind.x()) + point_distance);
-  }
-
-  for (int e = 0; e < GRID_LENGTH_E / 2; e++) {
-    for (int z = 0; z < GRID_LENGTH_Z / 2; z++) {
-      if (counter(e, z) >= 6) {
-        polar_histogram_est.set_dist(
-            e, z, polar_histogram_est.get_dist(e, z) / counter(e, z));
-        polar_histogram_est.set_age(
-            e, z, static_cast<int>(polar_histogram_est.get_age(e, z) /
-                                   counter(e, z)));
+    setAzimuthRange(fov, z_FOV_min, z_FOV_max);
+  }
+}
+
+namespace {
+
+// Union of the camera frusta, every camera which has a message covers the
+// azimuth and elevation around its optical axis
+template <typename MsgPtr>
+bool calculateFrustaFOV(
+    const std::vector<CameraFOV>& camera_FOVs,
+    const std::vector<MsgPtr>& cloud_msgs,
+    const std::vector<Eigen::Affine3f,
+                      Eigen::aligned_allocator<Eigen::Affine3f>>& transforms,
+    FOV& fov) {
+  fov.azimuth.reset();
+  fov.e_min = 0;
+  fov.e_max = 0;
+  bool found_camera = false;
+  for (size_t i = 0; i < camera_FOVs.size() && i < cloud_msgs.size() &&
+                     i < transforms.size();
+       ++i) {
+    const CameraFOV& camera = camera_FOVs[i];
+    if (!cloud_msgs[i] || camera.h_FOV <= 0.f || camera.v_FOV <= 0.f) {
+      continue;
+    }
+    // yaw and pitch of the optical axis, the same angles as the ones of the
+    // vehicle attitude given by getYawFromQuaternion and
+    // getPitchFromQuaternion
+    const Eigen::Vector3f axis =
+        transforms[i].linear() * Eigen::Vector3f::UnitZ();
+    const float yaw = std::atan2(axis.y(), axis.x());
+    const float pitch = std::atan2(-axis.z(), axis.head<2>().norm());
+    FOV camera_fov;
+    calculateFOV(camera.h_FOV, camera.v_FOV, camera_fov, yaw, pitch);
+
+    fov.azimuth |= camera_fov.azimuth;
+    fov.e_min = found_camera ? std::min(fov.e_min, camera_fov.e_min)
+                             : camera_fov.e_min;
+    fov.e_max = found_camera ? std::max(fov.e_max, camera_fov.e_max)
+                             : camera_fov.e_max;
+    found_camera = true;
+  }
+  return found_camera;
+}
+
+}  // namespace
+
+bool calculateFOV(
+    const std::vector<CameraFOV>& camera_FOVs,
+    const std::vector<sensor_msgs::PointCloud2::ConstPtr>& cloud_msgs,
+    const std::vector<Eigen::Affine3f,
+                      Eigen::aligned_allocator<Eigen::Affine3f>>& transforms,
+    FOV& fov) {
+  return calculateFrustaFOV(camera_FOVs, cloud_msgs, transforms, fov);
+}
+
+bool calculateFOV(
+    const std::vector<CameraFOV>& camera_FOVs,
+    const std::vector<sensor_msgs::Image::ConstPtr>& depth_images,
+    const std::vector<Eigen::Affine3f,
+                      Eigen::aligned_allocator<Eigen::Affine3f>>& transforms,
+    FOV& fov) {
+  return calculateFrustaFOV(camera_FOVs, depth_images, transforms, fov);
+}
+
+// Build histogram estimate from the obstacle memory
+void propagateHistogram(Histogram<ALPHA_RES>& polar_histogram_est,
+                        const ObstacleMemory& memory,
+                        const Eigen::Vector3f& position) {
+  HistogramWorkspace workspace;
+  propagateHistogram(polar_histogram_est, memory, position, workspace);
+}
+
+void propagateHistogram(Histogram<ALPHA_RES>& polar_histogram_est,
+                        const ObstacleMemory& memory,
+                        const Eigen::Vector3f& position,
+                        HistogramWorkspace& workspace) {
+  std::vector<int>& counter = workspace.counter;
+  std::vector<int>& age_sum = workspace.age_sum;
+  std::vector<float>& dist_sum = workspace.dist_sum;
+  counter.assign(GRID_LENGTH_E * GRID_LENGTH_Z, 0);
+  age_sum.assign(counter.size(), 0);
+  dist_sum.assign(counter.size(), 0.f);
+
+  PolarBinningBuffer& binning = workspace.binning;
+  binning.bin.resize(memory.size());
+  binning.dist.resize(memory.size());
+  polarBinning(memory.x().data(), memory.y().data(), memory.z().data(),
+               memory.size(), position, ALPHA_RES, binning.bin.data(),
+               binning.dist.data());
+
+  const std::vector<int>& count = memory.count();
+  const std::vector<int>& age = memory.age();
+  for (size_t i = 0; i < memory.size(); i++) {
+    counter[binning.bin[i]] += count[i];
+    age_sum[binning.bin[i]] += count[i] * age[i];
+    dist_sum[binning.bin[i]] += count[i] * binning.dist[i];
+  }
+
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      const int bin = e * GRID_LENGTH_Z + z;
+      if (counter[bin] >= 6) {
+        polar_histogram_est.dist(e, z) = dist_sum[bin] / counter[bin];
+        polar_histogram_est.age(e, z) = age_sum[bin] / counter[bin];
       } else {  // not enough points to confidently block cell
-        polar_histogram_est.set_dist(e, z, 0.f);
-        polar_histogram_est.set_age(e, z, 0);
+        polar_histogram_est.dist(e, z) = 0.f;
+        polar_histogram_est.age(e, z) = 0;
       }
     }
   }
-
-  // Upsample propagated histogram
-  polar_histogram_est.upsample();
 }
 
 // Generate new histogram from pointcloud
-void generateNewHistogram(Histogram& polar_histogram,
+// Normalize and get mean in distance bins
+static void meanHistogramDistance(Histogram<ALPHA_RES>& polar_histogram,
+                                  const std::vector<int>& counter,
+                                  const std::vector<float>& dist_sum) {
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      const int bin = e * GRID_LENGTH_Z + z;
+      polar_histogram.dist(e, z) =
+          counter[bin] > 0 ? dist_sum[bin] / counter[bin] : 0.f;
+    }
+  }
+}
+
+void generateNewHistogram(Histogram<ALPHA_RES>& polar_histogram,
                           const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
                           const Eigen::Vector3f& position) {
-  Eigen::MatrixXi counter(GRID_LENGTH_E, GRID_LENGTH_Z);
-  counter.fill(0);
-  for (auto xyz : cropped_cloud) {
-    Eigen::Vector3f p = toEigen(xyz);
-    float dist = (p - position).norm();
-    PolarPoint p_pol = cartesianToPolar(p, position);
-    Eigen::Vector2i p_ind = polarToHistogramIndex(p_pol, ALPHA_RES);
+  HistogramWorkspace workspace;
+  generateNewHistogram(polar_histogram, cropped_cloud, position, workspace);
+}
 
-    counter(p_ind.y(), p_ind.x()) += 1;
-    polar_histogram.set_dist(
-        p_ind.y(), p_ind.x(),
-        polar_histogram.get_dist(p_ind.y(), p_ind.x()) + dist);
+// Counts the points [begin, end) of the cloud and sums up their distances in
+// the bins of the workspace
+static void sumHistogramBins(HistogramWorkspace& workspace,
+                             const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                             size_t begin, size_t end,
+                             const Eigen::Vector3f& position) {
+  std::vector<int>& counter = workspace.counter;
+  std::vector<float>& dist_sum = workspace.dist_sum;
+  counter.assign(GRID_LENGTH_E * GRID_LENGTH_Z, 0);
+  dist_sum.assign(counter.size(), 0.f);
+
+  PolarBinningBuffer& binning = workspace.binning;
+  binning.load(cloud, begin, end);
+  polarBinning(binning, position, ALPHA_RES);
+
+  for (size_t i = 0; i < binning.size(); i++) {
+    counter[binning.bin[i]] += 1;
+    dist_sum[binning.bin[i]] += binning.dist[i];
   }
+}
 
-  // Normalize and get mean in distance bins
-  for (int e = 0; e < GRID_LENGTH_E; e++) {
-    for (int z = 0; z < GRID_LENGTH_Z; z++) {
-      if (counter(e, z) > 0) {
-        polar_histogram.set_dist(
-            e, z, polar_histogram.get_dist(e, z) / counter(e, z));
-      } else {
-        polar_histogram.set_dist(e, z, 0.f);
-      }
+void generateNewHistogram(Histogram<ALPHA_RES>& polar_histogram,
+                          const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+                          const Eigen::Vector3f& position,
+                          HistogramWorkspace& workspace) {
+  sumHistogramBins(workspace, cropped_cloud, 0, cropped_cloud.points.size(),
+                   position);
+  meanHistogramDistance(polar_histogram, workspace.counter,
+                        workspace.dist_sum);
+}
+
+// Smaller blocks are not worth the handover to a worker
+static const size_t MIN_POINTS_PER_BLOCK = 4096;
+
+void generateNewHistogram(Histogram<ALPHA_RES>& polar_histogram,
+                          const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+                          const Eigen::Vector3f& position, ThreadPool* pool,
+                          std::vector<HistogramWorkspace>& workspaces) {
+  const size_t n_points = cropped_cloud.points.size();
+  size_t n_blocks = 1;
+  if (pool) {
+    n_blocks = std::max<size_t>(
+        1, std::min(pool->size() + 1, n_points / MIN_POINTS_PER_BLOCK));
+  }
+  if (workspaces.size() < n_blocks) {
+    workspaces.resize(n_blocks);
+  }
+  if (n_blocks == 1) {
+    generateNewHistogram(polar_histogram, cropped_cloud, position,
+                         workspaces[0]);
+    return;
+  }
+
+  pool->parallelFor(n_blocks, [&](size_t block) {
+    sumHistogramBins(workspaces[block], cropped_cloud,
+                     n_points * block / n_blocks,
+                     n_points * (block + 1) / n_blocks, position);
+  });
+
+  // the sums of the blocks add up to the ones of a single pass, so the mean
+  // distances do not depend on how the cloud was split
+  std::vector<int>& counter = workspaces[0].counter;
+  std::vector<float>& dist_sum = workspaces[0].dist_sum;
+  for (size_t block = 1; block < n_blocks; block++) {
+    const HistogramWorkspace& workspace = workspaces[block];
+    for (size_t bin = 0; bin < counter.size(); bin++) {
+      counter[bin] += workspace.counter[bin];
+      dist_sum[bin] += workspace.dist_sum[bin];
     }
   }
+  meanHistogramDistance(polar_histogram, counter, dist_sum);
+}
+
+void generateNewHistogram(Histogram<ALPHA_RES>& polar_histogram,
+                          const VoxelIndex& voxels,
+                          const Eigen::Vector3f& position,
+                          HistogramWorkspace& workspace) {
+  std::vector<int>& counter = workspace.counter;
+  std::vector<float>& dist_sum = workspace.dist_sum;
+  counter.assign(GRID_LENGTH_E * GRID_LENGTH_Z, 0);
+  dist_sum.assign(counter.size(), 0.f);
+
+  // the centroids are binned directly, each weighted by its number of points
+  PolarBinningBuffer& binning = workspace.binning;
+  binning.bin.resize(voxels.size());
+  binning.dist.resize(voxels.size());
+  polarBinning(voxels.x().data(), voxels.y().data(), voxels.z().data(),
+               voxels.size(), position, ALPHA_RES, binning.bin.data(),
+               binning.dist.data());
+
+  const std::vector<int>& count = voxels.count();
+  for (size_t i = 0; i < voxels.size(); i++) {
+    counter[binning.bin[i]] += count[i];
+    dist_sum[binning.bin[i]] += count[i] * binning.dist[i];
+  }
+
+  meanHistogramDistance(polar_histogram, counter, dist_sum);
+}
+
+// Merges the azimuth indices [begin, end) of row e inside the FOV, where only
+// the current frame counts. Returns true if any of the cells is occupied.
+static bool combineInsideFOV(Histogram<ALPHA_RES>& new_hist, int e, int begin,
+                             int end) {
+  int* age = new_hist.age_row(e);
+  const float* dist = new_hist.dist_row(e);
+  int occupied = 0;
+  for (int z = begin; z < end; z++) {
+    const int new_occupied = dist[z] > 0.f;
+    age[z] = new_occupied ? 1 : age[z];
+    occupied |= new_occupied;
+  }
+  return occupied != 0;
+}
+
+// Merges the azimuth indices [begin, end) of row e outside the FOV, where the
+// propagated cells fill in for the ones the current frame did not see.
+// Returns true if any of the cells is occupied.
+static bool combineOutsideFOV(Histogram<ALPHA_RES>& new_hist,
+                              const Histogram<ALPHA_RES>& propagated_hist,
+                              int e, int begin, int end, int age_increment) {
+  int* age = new_hist.age_row(e);
+  float* dist = new_hist.dist_row(e);
+  const int* propagated_age = propagated_hist.age_row(e);
+  const float* propagated_dist = propagated_hist.dist_row(e);
+  int occupied = 0;
+  for (int z = begin; z < end; z++) {
+    // every value is loaded unconditionally so that the loop has no branches
+    const float new_dist = dist[z];
+    const float old_dist = propagated_dist[z];
+    const int new_age = age[z];
+    const int old_age = propagated_age[z] + age_increment;
+    const int new_occupied = new_dist > 0.f;
+    const int propagated_occupied = old_dist > 0.f;
+    const int cell_age = propagated_occupied ? old_age : new_age;
+    age[z] = new_occupied ? 1 : cell_age;
+    dist[z] = new_dist < FLT_MIN ? (propagated_occupied ? old_dist : new_dist)
+                                 : new_dist;
+    occupied |= new_occupied | propagated_occupied;
+  }
+  return occupied != 0;
 }
 
 // Combine propagated histogram and new histogram to the final binary histogram
-void combinedHistogram(bool& hist_empty, Histogram& new_hist,
-                       const Histogram& propagated_hist,
-                       bool waypoint_outside_FOV,
-                       const std::vector<int>& z_FOV_idx, int e_FOV_min,
-                       int e_FOV_max) {
-  hist_empty = true;
+void combinedHistogram(bool& hist_empty, Histogram<ALPHA_RES>& new_hist,
+                       const Histogram<ALPHA_RES>& propagated_hist,
+                       bool waypoint_outside_FOV, const FOV& fov) {
+  // the azimuth indices form runs that are entirely inside or outside of the
+  // FOV, the rows are merged one run at a time
+  int run_begin[GRID_LENGTH_Z + 1];
+  int n_runs = 0;
   for (int z = 0; z < GRID_LENGTH_Z; z++) {
-    bool inside_FOV_z =
-        std::find(z_FOV_idx.begin(), z_FOV_idx.end(), z) != z_FOV_idx.end();
-    for (int e = 0; e < GRID_LENGTH_E; e++) {
-      if (inside_FOV_z && e > e_FOV_min && e < e_FOV_max) {  // inside FOV
-        if (new_hist.get_dist(e, z) > 0) {
-          new_hist.set_age(e, z, 1);
-          hist_empty = false;
-        }
+    if (z == 0 || fov.containsAzimuth(z) != fov.containsAzimuth(z - 1)) {
+      run_begin[n_runs++] = z;
+    }
+  }
+  run_begin[n_runs] = GRID_LENGTH_Z;
+
+  const int age_increment = waypoint_outside_FOV ? 0 : 1;
+  bool occupied = false;
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    if (!fov.containsElevation(e)) {
+      occupied |= combineOutsideFOV(new_hist, propagated_hist, e, 0,
+                                    GRID_LENGTH_Z, age_increment);
+      continue;
+    }
+    for (int r = 0; r < n_runs; r++) {
+      if (fov.containsAzimuth(run_begin[r])) {
+        occupied |=
+            combineInsideFOV(new_hist, e, run_begin[r], run_begin[r + 1]);
       } else {
-        if (propagated_hist.get_dist(e, z) > 0) {
-          if (waypoint_outside_FOV) {
-            new_hist.set_age(e, z, propagated_hist.get_age(e, z));
-          } else {
-            new_hist.set_age(e, z, propagated_hist.get_age(e, z) + 1);
+        occupied |= combineOutsideFOV(new_hist, propagated_hist, e,
+                                      run_begin[r], run_begin[r + 1],
+                                      age_increment);
+      }
+    }
+  }
+  hist_empty = !occupied;
+}
+
+void adaptHistogramResolution(Histogram<ALPHA_RES>& histogram,
+                              const Eigen::Vector3f& position,
+                              const Eigen::Vector3f& goal, float fine_distance,
+                              float fine_sector) {
+  // a block overlaps the sector if its centre is less than half a block away
+  const float sector = fine_sector + ALPHA_RES;
+  const PolarPoint goal_pol = cartesianToPolar(goal, position);
+  for (int be = 0; be < GRID_LENGTH_E / 2; be++) {
+    const int e = 2 * be;
+    const PolarPoint center_e =
+        histogramIndexToPolar(be, 0, 2 * ALPHA_RES, 1.f);
+    const bool goal_elevation = std::abs(center_e.e - goal_pol.e) < sector;
+    for (int bz = 0; bz < GRID_LENGTH_Z / 2; bz++) {
+      const int z = 2 * bz;
+      float closest = 0.f;
+      int closest_age = 0;
+      for (int i = e; i < e + 2; i++) {
+        for (int j = z; j < z + 2; j++) {
+          float dist = histogram.dist(i, j);
+          if (dist > 0.f && (closest == 0.f || dist < closest)) {
+            closest = dist;
+            closest_age = histogram.age(i, j);
           }
-          hist_empty = false;
-        }
-        if (new_hist.get_dist(e, z) > 0) {
-          new_hist.set_age(e, z, 1);
-          hist_empty = false;
         }
-        if (propagated_hist.get_dist(e, z) > 0 &&
-            new_hist.get_dist(e, z) < FLT_MIN) {
-          new_hist.set_dist(e, z, propagated_hist.get_dist(e, z));
+      }
+
+      const PolarPoint center =
+          histogramIndexToPolar(be, bz, 2 * ALPHA_RES, 1.f);
+      bool near = closest > 0.f && closest < fine_distance;
+      bool goal_facing =
+          goal_elevation && indexAngleDifference(center.z, goal_pol.z) < sector;
+      if (near || goal_facing) {
+        histogram.setCoarse(be, bz, false);
+        continue;
+      }
+
+      // any obstacle blocks the whole coarse cell
+      for (int i = e; i < e + 2; i++) {
+        for (int j = z; j < z + 2; j++) {
+          histogram.dist(i, j) = closest;
+          histogram.age(i, j) = closest_age;
         }
       }
+      histogram.setCoarse(be, bz, true);
     }
   }
 }
 
-void compressHistogramElevation(Histogram& new_hist,
-                                const Histogram& input_hist) {
+void compressHistogramElevation(Histogram<ALPHA_RES>& new_hist,
+                                const Histogram<ALPHA_RES>& input_hist) {
   float vertical_FOV_range_sensor = 20.0;
   PolarPoint p_pol_lower(-1.0f * vertical_FOV_range_sensor / 2.0f, 0.0f, 0.0f);
   PolarPoint p_pol_upper(vertical_FOV_range_sensor / 2.0f, 0.0f, 0.0f);
@@ -240,86 +743,481 @@ void compressHistogramElevation(Histogram& new_hist,
   }
 }
 
-void getCostMatrix(const Histogram& histogram, const Eigen::Vector3f& goal,
+// cost of an obstacle at the given distance, 0 if the cell is empty
+static inline float obstacleDistanceCost(float obstacle_distance) {
+  return obstacle_distance > 0.0f ? 700.0f / obstacle_distance : 0.0f;
+}
+
+void getCostMatrix(const Histogram<ALPHA_RES>& histogram,
+                   const Eigen::Vector3f& goal,
                    const Eigen::Vector3f& position,
                    const float yaw_angle_histogram_frame,
                    const Eigen::Vector3f& last_sent_waypoint,
-                   costParameters cost_params, bool only_yawed,
+                   const costParameters& cost_params, bool only_yawed,
                    const float smoothing_margin_degrees,
                    Eigen::MatrixXf& cost_matrix,
                    std::vector<uint8_t>& image_data) {
-  Eigen::MatrixXf distance_matrix(GRID_LENGTH_E, GRID_LENGTH_Z);
-  distance_matrix.fill(NAN);
-  float distance_cost = 0.f;
-  float other_costs = 0.f;
-  // reset cost matrix to zero
+  CostMatrixWorkspace workspace;
+  getCostMatrix(histogram, goal, position, yaw_angle_histogram_frame,
+                last_sent_waypoint, cost_params, only_yawed,
+                smoothing_margin_degrees, cost_matrix, workspace, &image_data);
+}
+
+// the terms of costFunction which are the same for every candidate direction
+struct CostFunctionFrame {
+  float goal_dist;
+  float sin_yaw;
+  float cos_yaw;
+  Eigen::Vector3f projected_last_wp;
+};
+
+static CostFunctionFrame costFunctionFrame(
+    const Eigen::Vector3f& goal, const Eigen::Vector3f& position,
+    const float yaw_angle_histogram_frame,
+    const Eigen::Vector3f& last_sent_waypoint) {
+  CostFunctionFrame frame;
+  frame.goal_dist = (position - goal).norm();
+  frame.sin_yaw = std::sin(yaw_angle_histogram_frame * DEG_TO_RAD);
+  frame.cos_yaw = std::cos(yaw_angle_histogram_frame * DEG_TO_RAD);
+  PolarPoint last_wp_pol = cartesianToPolar(last_sent_waypoint, position);
+  last_wp_pol.r = frame.goal_dist;
+  frame.projected_last_wp = polarToCartesian(last_wp_pol, position);
+  return frame;
+}
+
+// costfunction of a candidate direction given by the sine and cosine of its
+// elevation and azimuth angle, the points are projected like polarToCartesian
+// does so the results do not depend on where the sines come from
+static void costFunction(float cos_e, float sin_e, float cos_z, float sin_z,
+                         float obstacle_distance,
+                         const CostFunctionFrame& frame,
+                         const Eigen::Vector3f& goal,
+                         const Eigen::Vector3f& position,
+                         const costParameters& cost_params,
+                         float& distance_cost, float& other_costs) {
+  const float r_cos_e = frame.goal_dist * cos_e;
+  Eigen::Vector3f projected_candidate(position.x() + r_cos_e * sin_z,
+                                      position.y() + r_cos_e * cos_z,
+                                      position.z() + frame.goal_dist * sin_e);
+  Eigen::Vector3f projected_heading(position.x() + r_cos_e * frame.sin_yaw,
+                                    position.y() + r_cos_e * frame.cos_yaw,
+                                    position.z() + frame.goal_dist * sin_e);
+  const Eigen::Vector3f& projected_goal = goal;
+  const Eigen::Vector3f& projected_last_wp = frame.projected_last_wp;
+
+  // goal costs
+  float yaw_cost =
+      cost_params.goal_cost_param *
+      (projected_goal.topRows<2>() - projected_candidate.topRows<2>()).norm();
+  float pitch_cost_up = 0.0f;
+  float pitch_cost_down = 0.0f;
+  if (projected_candidate.z() > projected_goal.z()) {
+    pitch_cost_up = cost_params.goal_cost_param *
+                    std::abs(projected_goal.z() - projected_candidate.z());
+  } else {
+    pitch_cost_down = cost_params.goal_cost_param *
+                      std::abs(projected_goal.z() - projected_candidate.z());
+  }
+
+  // smooth costs
+  float yaw_cost_smooth =
+      cost_params.smooth_cost_param *
+      (projected_last_wp.topRows<2>() - projected_candidate.topRows<2>())
+          .norm();
+  float pitch_cost_smooth =
+      cost_params.smooth_cost_param *
+      std::abs(projected_last_wp.z() - projected_candidate.z());
+
+  // heading cost
+  float heading_cost =
+      cost_params.heading_cost_param *
+      (projected_heading.topRows<2>() - projected_candidate.topRows<2>())
+          .norm();
+
+  // distance cost
+  distance_cost = obstacleDistanceCost(obstacle_distance);
+
+  // combine costs
+  other_costs = 0.0f;
+  other_costs = yaw_cost +
+                cost_params.height_change_cost_param_adapted * pitch_cost_up +
+                cost_params.height_change_cost_param * pitch_cost_down +
+                yaw_cost_smooth + pitch_cost_smooth + heading_cost;
+}
+
+// goal and smoothness costs of the coarse block of a cell, evaluated once at
+// the centre of the block and cached in coarse_costs
+static float coarseCellCost(int e_index, int z_index,
+                            const CostFunctionFrame& frame,
+                            const Eigen::Vector3f& goal,
+                            const Eigen::Vector3f& position,
+                            const costParameters& cost_params,
+                            Eigen::MatrixXf& coarse_costs) {
+  const int be = e_index / 2, bz = z_index / 2;
+  float& cost = coarse_costs(be, bz);
+  if (std::isnan(cost)) {
+    const BinCenters<2 * ALPHA_RES>& blocks =
+        BinCenters<2 * ALPHA_RES>::instance();
+    float distance_cost;
+    costFunction(blocks.cos_e[be], blocks.sin_e[be], blocks.cos_z[bz],
+                 blocks.sin_z[bz], 0.f, frame, goal, position, cost_params,
+                 distance_cost, cost);
+  }
+  return cost;
+}
+
+// determine how many bins at this elevation angle would be equivalent to
+// a single bin at horizontal, the cost function is evaluated in steps of that
+// size
+static int costMatrixStepSize(int e_index) {
+  const float bin_width = BinCenters<ALPHA_RES>::instance().cos_e[e_index];
+  return static_cast<int>(std::round(1 / bin_width));
+}
+
+// horizontally interpolate all of the un-calculated values of a row, each
+// span between two computed values is filled in at once
+static void interpolateCostRow(Eigen::ArrayXf& row, int step_size) {
+  static const Eigen::ArrayXf ramp =
+      Eigen::ArrayXf::LinSpaced(GRID_LENGTH_Z, 0.f, GRID_LENGTH_Z - 1.f);
+  int last_index = 0;
+  for (int z_index = step_size; z_index < GRID_LENGTH_Z; z_index += step_size) {
+    float gradient = (row(z_index) - row(last_index)) / step_size;
+    row.segment(last_index + 1, step_size - 1) =
+        row(last_index) + gradient * ramp.segment(1, step_size - 1);
+    last_index = z_index;
+  }
+
+  // special case the last columns wrapping around back to 0
+  int clamped_z_scale = GRID_LENGTH_Z - last_index;
+  if (clamped_z_scale > 1) {
+    float gradient = (row(0) - row(last_index)) / clamped_z_scale;
+    row.segment(last_index + 1, clamped_z_scale - 1) =
+        row(last_index) + gradient * ramp.segment(1, clamped_z_scale - 1);
+  }
+}
+
+// every step_size-th entry of an array of GRID_LENGTH_Z values, the columns
+// of a row which are evaluated before interpolateCostRow
+typedef Eigen::Map<Eigen::ArrayXf, 0, Eigen::InnerStride<>> SampledColumns;
+typedef Eigen::Map<const Eigen::ArrayXf, 0, Eigen::InnerStride<>>
+    ConstSampledColumns;
+
+static int sampledColumnCount(int step_size) {
+  return (GRID_LENGTH_Z + step_size - 1) / step_size;
+}
+
+// obstacle costs of every step_size-th cell of a histogram row, see
+// obstacleDistanceCost
+static void distanceCostRow(const Histogram<ALPHA_RES>& histogram,
+                            int e_index, int step_size, Eigen::ArrayXf& row) {
+  const int n = sampledColumnCount(step_size);
+  ConstSampledColumns dist(histogram.dist_row(e_index), n,
+                           Eigen::InnerStride<>(step_size));
+  row.resize(GRID_LENGTH_Z);
+  SampledColumns(row.data(), n, Eigen::InnerStride<>(step_size)) =
+      (dist > 0.0f).select(700.0f / dist, 0.0f);
+}
+
+// goal and smoothness costs of costFunction for every step_size-th cell of
+// row e_index, the cells in between are left to interpolateCostRow. The
+// candidate points of a row share their height and their distance to the
+// vertical axis through the position, so the terms are combined from the
+// per-row scalars and the per-column sines with array expressions. The
+// operations are the same as in costFunction so the results are too.
+static void costFunctionRow(int e_index, int step_size,
+                            const CostFunctionFrame& frame,
+                            const Eigen::Vector3f& goal,
+                            const Eigen::Vector3f& position,
+                            const costParameters& cost_params,
+                            CostMatrixWorkspace& workspace,
+                            Eigen::ArrayXf& row) {
+  const BinCenters<ALPHA_RES>& bins = BinCenters<ALPHA_RES>::instance();
+  const int n = sampledColumnCount(step_size);
+  ConstSampledColumns sin_z(bins.sin_z, n, Eigen::InnerStride<>(step_size));
+  ConstSampledColumns cos_z(bins.cos_z, n, Eigen::InnerStride<>(step_size));
+  const float r_cos_e = frame.goal_dist * bins.cos_e[e_index];
+  const float candidate_z =
+      position.z() + frame.goal_dist * bins.sin_e[e_index];
+  Eigen::ArrayXf& candidate_x = workspace.candidate_x;
+  Eigen::ArrayXf& candidate_y = workspace.candidate_y;
+  candidate_x = position.x() + r_cos_e * sin_z;
+  candidate_y = position.y() + r_cos_e * cos_z;
+  const float heading_x = position.x() + r_cos_e * frame.sin_yaw;
+  const float heading_y = position.y() + r_cos_e * frame.cos_yaw;
+  const Eigen::Vector3f& last_wp = frame.projected_last_wp;
+
+  // one of the height change costs is zero
+  const float pitch_diff =
+      cost_params.goal_cost_param * std::abs(goal.z() - candidate_z);
+  const float pitch_cost =
+      candidate_z > goal.z()
+          ? cost_params.height_change_cost_param_adapted * pitch_diff
+          : cost_params.height_change_cost_param * pitch_diff;
+  const float pitch_cost_smooth =
+      cost_params.smooth_cost_param * std::abs(last_wp.z() - candidate_z);
+
+  row.resize(GRID_LENGTH_Z);
+  SampledColumns(row.data(), n, Eigen::InnerStride<>(step_size)) =
+      cost_params.goal_cost_param *
+          ((goal.x() - candidate_x).square() +
+           (goal.y() - candidate_y).square())
+              .sqrt() +
+      pitch_cost +
+      cost_params.smooth_cost_param *
+          ((last_wp.x() - candidate_x).square() +
+           (last_wp.y() - candidate_y).square())
+              .sqrt() +
+      pitch_cost_smooth +
+      cost_params.heading_cost_param *
+          ((heading_x - candidate_x).square() +
+           (heading_y - candidate_y).square())
+              .sqrt();
+}
+
+void getCostMatrix(const Histogram<ALPHA_RES>& histogram,
+                   const Eigen::Vector3f& goal,
+                   const Eigen::Vector3f& position,
+                   const float yaw_angle_histogram_frame,
+                   const Eigen::Vector3f& last_sent_waypoint,
+                   const costParameters& cost_params, bool only_yawed,
+                   const float smoothing_margin_degrees,
+                   Eigen::MatrixXf& cost_matrix, CostMatrixWorkspace& workspace,
+                   std::vector<uint8_t>* image_data) {
+  Eigen::MatrixXf& distance_matrix = workspace.distance_matrix;
+  distance_matrix.resize(GRID_LENGTH_E, GRID_LENGTH_Z);
   cost_matrix.resize(GRID_LENGTH_E, GRID_LENGTH_Z);
-  cost_matrix.fill(NAN);
+  Eigen::ArrayXf& row_costs = workspace.row_costs;
+  Eigen::ArrayXf& row_distance_costs = workspace.row_distance_costs;
 
-  // fill in cost matrix
+  // fill in cost matrix row by row, the cells between the steps are
+  // interpolated
+  const CostFunctionFrame frame = costFunctionFrame(
+      goal, position, yaw_angle_histogram_frame, last_sent_waypoint);
+  const bool mixed_resolution = histogram.hasCoarseCells();
+  if (mixed_resolution) {
+    workspace.coarse_costs.resize(GRID_LENGTH_E / 2, GRID_LENGTH_Z / 2);
+    workspace.coarse_costs.fill(NAN);
+  }
   for (int e_index = 0; e_index < GRID_LENGTH_E; e_index++) {
-    // determine how many bins at this elevation angle would be equivalent to
-    // a single bin at horizontal, then work in steps of that size
-    const float bin_width = std::cos(
-        histogramIndexToPolar(e_index, 0, ALPHA_RES, 1).e * DEG_TO_RAD);
-    const int step_size = static_cast<int>(std::round(1 / bin_width));
+    const int step_size = costMatrixStepSize(e_index);
+    costFunctionRow(e_index, step_size, frame, goal, position, cost_params,
+                    workspace, row_costs);
+    distanceCostRow(histogram, e_index, step_size, row_distance_costs);
 
-    for (int z_index = 0; z_index < GRID_LENGTH_Z; z_index += step_size) {
-      float obstacle_distance = histogram.get_dist(e_index, z_index);
-      PolarPoint p_pol =
-          histogramIndexToPolar(e_index, z_index, ALPHA_RES, obstacle_distance);
-
-      costFunction(p_pol.e, p_pol.z, obstacle_distance, goal, position,
-                   yaw_angle_histogram_frame, last_sent_waypoint, cost_params,
-                   distance_cost, other_costs);
-      cost_matrix(e_index, z_index) = other_costs;
-      distance_matrix(e_index, z_index) = distance_cost;
-    }
-    if (step_size > 1) {
-      // horizontally interpolate all of the un-calculated values
-      int last_index = 0;
-      for (int z_index = step_size; z_index < GRID_LENGTH_Z;
-           z_index += step_size) {
-        float other_costs_gradient =
-            (cost_matrix(e_index, z_index) - cost_matrix(e_index, last_index)) /
-            step_size;
-        float distance_cost_gradient = (distance_matrix(e_index, z_index) -
-                                        distance_matrix(e_index, last_index)) /
-                                       step_size;
-        for (int i = 1; i < step_size; i++) {
-          cost_matrix(e_index, last_index + i) =
-              cost_matrix(e_index, last_index) + other_costs_gradient * i;
-          distance_matrix(e_index, last_index + i) =
-              distance_matrix(e_index, last_index) + distance_cost_gradient * i;
+    if (mixed_resolution) {
+      for (int z_index = 0; z_index < GRID_LENGTH_Z; z_index += step_size) {
+        if (histogram.isCoarse(e_index, z_index)) {
+          row_costs(z_index) =
+              coarseCellCost(e_index, z_index, frame, goal, position,
+                             cost_params, workspace.coarse_costs);
         }
-        last_index = z_index;
-      }
-
-      // special case the last columns wrapping around back to 0
-      int clamped_z_scale = GRID_LENGTH_Z - last_index;
-      float other_costs_gradient =
-          (cost_matrix(e_index, 0) - cost_matrix(e_index, last_index)) /
-          clamped_z_scale;
-      float distance_cost_gradient =
-          (distance_matrix(e_index, 0) - distance_matrix(e_index, last_index)) /
-          clamped_z_scale;
-
-      for (int i = 1; i < clamped_z_scale; i++) {
-        cost_matrix(e_index, last_index + i) =
-            cost_matrix(e_index, last_index) + other_costs_gradient * i;
-        distance_matrix(e_index, last_index + i) =
-            distance_matrix(e_index, last_index) + distance_cost_gradient * i;
       }
     }
+    if (step_size > 1) {
+      interpolateCostRow(row_costs, step_size);
+      interpolateCostRow(row_distance_costs, step_size);
+    }
+    cost_matrix.row(e_index) = row_costs.matrix().transpose();
+    distance_matrix.row(e_index) = row_distance_costs.matrix().transpose();
   }
 
   unsigned int smooth_radius = ceil(smoothing_margin_degrees / ALPHA_RES);
-  smoothPolarMatrix(distance_matrix, smooth_radius);
+  smoothPolarMatrix(distance_matrix, smooth_radius, workspace);
 
-  generateCostImage(cost_matrix, distance_matrix, image_data);
+  if (image_data) {
+    generateCostImage(cost_matrix, distance_matrix, *image_data);
+  }
   cost_matrix = cost_matrix + distance_matrix;
 }
 
+// keeps the number_of_candidates cheapest candidates in the max-heap
+// candidate_vector
+static void pushCandidate(const candidateDirection& candidate,
+                          unsigned int number_of_candidates,
+                          std::vector<candidateDirection>& candidate_vector) {
+  if (candidate_vector.size() < number_of_candidates) {
+    candidate_vector.push_back(candidate);
+    std::push_heap(candidate_vector.begin(), candidate_vector.end());
+  } else if (candidate < candidate_vector.front()) {
+    candidate_vector.push_back(candidate);
+    std::push_heap(candidate_vector.begin(), candidate_vector.end());
+    std::pop_heap(candidate_vector.begin(), candidate_vector.end());
+    candidate_vector.pop_back();
+  }
+}
+
+// number of histogram cells along each side of the sectors of
+// getBestCandidatesFromHistogram
+static const int COST_SECTOR_SIZE = 18 / ALPHA_RES > 0 ? 18 / ALPHA_RES : 1;
+
+void getBestCandidatesFromHistogram(
+    const Histogram<ALPHA_RES>& histogram, const Eigen::Vector3f& goal,
+    const Eigen::Vector3f& position, const float yaw_angle_histogram_frame,
+    const Eigen::Vector3f& last_sent_waypoint,
+    const costParameters& cost_params,
+    const float smoothing_margin_degrees, unsigned int number_of_candidates,
+    CostMatrixWorkspace& workspace,
+    std::vector<candidateDirection>& candidate_vector) {
+  candidate_vector.clear();
+  if (number_of_candidates == 0) return;
+  candidate_vector.reserve(number_of_candidates + 1);
+
+  // the obstacle costs are cheap and the smoothing needs all of them, so the
+  // distance matrix is built completely like in getCostMatrix
+  std::vector<int>& step_sizes = workspace.step_sizes;
+  step_sizes.resize(GRID_LENGTH_E);
+  Eigen::MatrixXf& distance_matrix = workspace.distance_matrix;
+  distance_matrix.resize(GRID_LENGTH_E, GRID_LENGTH_Z);
+  for (int e_index = 0; e_index < GRID_LENGTH_E; e_index++) {
+    const int step_size = costMatrixStepSize(e_index);
+    step_sizes[e_index] = step_size;
+    distanceCostRow(histogram, e_index, step_size,
+                    workspace.row_distance_costs);
+    if (step_size > 1) {
+      interpolateCostRow(workspace.row_distance_costs, step_size);
+    }
+    distance_matrix.row(e_index) =
+        workspace.row_distance_costs.matrix().transpose();
+  }
+  unsigned int smooth_radius = ceil(smoothing_margin_degrees / ALPHA_RES);
+  smoothPolarMatrix(distance_matrix, smooth_radius, workspace);
+
+  Eigen::MatrixXf& other_costs = workspace.other_costs;
+  other_costs.resize(GRID_LENGTH_E, GRID_LENGTH_Z);
+  other_costs.fill(NAN);
+  const BinCenters<ALPHA_RES>& bins = BinCenters<ALPHA_RES>::instance();
+  const CostFunctionFrame frame = costFunctionFrame(
+      goal, position, yaw_angle_histogram_frame, last_sent_waypoint);
+  const bool mixed_resolution = histogram.hasCoarseCells();
+  if (mixed_resolution) {
+    workspace.coarse_costs.resize(GRID_LENGTH_E / 2, GRID_LENGTH_Z / 2);
+    workspace.coarse_costs.fill(NAN);
+  }
+  auto computed_cost = [&](int e_index, int z_index) {
+    float& cost = other_costs(e_index, z_index);
+    if (std::isnan(cost) && mixed_resolution &&
+        histogram.isCoarse(e_index, z_index)) {
+      cost = coarseCellCost(e_index, z_index, frame, goal, position,
+                            cost_params, workspace.coarse_costs);
+    } else if (std::isnan(cost)) {
+      float obstacle_distance = histogram.get_dist(e_index, z_index);
+      float distance_cost;
+      costFunction(bins.cos_e[e_index], bins.sin_e[e_index],
+                   bins.cos_z[z_index], bins.sin_z[z_index], obstacle_distance,
+                   frame, goal, position, cost_params, distance_cost, cost);
+    }
+    return cost;
+  };
+  // same interpolation as interpolateCostRow, evaluating only the two
+  // computed cells around z_index
+  auto cell_cost = [&](int e_index, int z_index) {
+    const int step_size = step_sizes[e_index];
+    int last_index = z_index / step_size * step_size;
+    if (last_index == z_index) return computed_cost(e_index, z_index);
+    int next_index = last_index + step_size;
+    int span = step_size;
+    if (next_index >= GRID_LENGTH_Z) {
+      next_index = 0;
+      span = GRID_LENGTH_Z - last_index;
+    }
+    float gradient = (computed_cost(e_index, next_index) -
+                      computed_cost(e_index, last_index)) /
+                     span;
+    return computed_cost(e_index, last_index) +
+           gradient * (z_index - last_index);
+  };
+
+  // The goal and smoothness costs compare points at the goal distance R in
+  // the candidate direction to fixed points. Moving the direction by de and
+  // dz [rad] moves these points by at most R * (|de| + |dz|), the heading term
+  // also depends on the elevation so it changes by up to 2 * R * |de|.
+  const float goal_dist = (position - goal).norm();
+  const float goal_weight = std::abs(cost_params.goal_cost_param);
+  const float smooth_weight = std::abs(cost_params.smooth_cost_param);
+  const float heading_weight = std::abs(cost_params.heading_cost_param);
+  const float height_weight =
+      std::max(std::abs(cost_params.height_change_cost_param),
+               std::abs(cost_params.height_change_cost_param_adapted));
+  const float slope_e =
+      goal_dist * (goal_weight * (1.f + height_weight) + 2.f * smooth_weight +
+                   2.f * heading_weight);
+  const float slope_z =
+      goal_dist * (goal_weight + smooth_weight + heading_weight);
+
+  // lower bound of the cost in each sector, interpolated cells lie between
+  // two computed cells up to step_size - 1 cells away from them
+  std::vector<std::pair<float, int>>& sector_bounds = workspace.sector_bounds;
+  sector_bounds.clear();
+  const int n_sectors_z =
+      (GRID_LENGTH_Z + COST_SECTOR_SIZE - 1) / COST_SECTOR_SIZE;
+  for (int e0 = 0; e0 < GRID_LENGTH_E; e0 += COST_SECTOR_SIZE) {
+    const int e1 = std::min(e0 + COST_SECTOR_SIZE, GRID_LENGTH_E);
+    int max_step_size = 1;
+    for (int e_index = e0; e_index < e1; e_index++) {
+      max_step_size = std::max(max_step_size, step_sizes[e_index]);
+    }
+    for (int z0 = 0; z0 < GRID_LENGTH_Z; z0 += COST_SECTOR_SIZE) {
+      const int z1 = std::min(z0 + COST_SECTOR_SIZE, GRID_LENGTH_Z);
+      PolarPoint first = histogramIndexToPolar(e0, z0, ALPHA_RES, 1.f);
+      PolarPoint last = histogramIndexToPolar(e1 - 1, z1 - 1, ALPHA_RES, 1.f);
+      float distance_cost, center_cost;
+      const float center_e = 0.5f * (first.e + last.e) * DEG_TO_RAD;
+      const float center_z = 0.5f * (first.z + last.z) * DEG_TO_RAD;
+      costFunction(std::cos(center_e), std::sin(center_e), std::cos(center_z),
+                   std::sin(center_z), 0.f, frame, goal, position, cost_params,
+                   distance_cost, center_cost);
+      // the cost of a coarse block is evaluated up to half a cell away, the
+      // bin centres are rounded to whole degrees
+      const float coarse_offset =
+          mixed_resolution ? static_cast<float>((ALPHA_RES + 1) / 2) : 0.f;
+      const float de =
+          (0.5f * (last.e - first.e) + coarse_offset) * DEG_TO_RAD;
+      const float dz =
+          (0.5f * (last.z - first.z) + (max_step_size - 1) * ALPHA_RES +
+           coarse_offset) *
+          DEG_TO_RAD;
+      // margin for the rounding of the cost function
+      const float margin = 1e-3f * (std::abs(center_cost) + 1.f);
+      float bound = center_cost - slope_e * de - slope_z * dz - margin +
+                    distance_matrix.block(e0, z0, e1 - e0, z1 - z0).minCoeff();
+      int sector =
+          (e0 / COST_SECTOR_SIZE) * n_sectors_z + z0 / COST_SECTOR_SIZE;
+      sector_bounds.push_back(std::make_pair(bound, sector));
+    }
+  }
+
+  // evaluate the sectors best-first until none of the remaining ones can
+  // contain a cheaper cell than the most expensive kept candidate
+  std::greater<std::pair<float, int>> cheaper_first;
+  std::make_heap(sector_bounds.begin(), sector_bounds.end(), cheaper_first);
+  while (!sector_bounds.empty()) {
+    std::pop_heap(sector_bounds.begin(), sector_bounds.end(), cheaper_first);
+    std::pair<float, int> sector = sector_bounds.back();
+    sector_bounds.pop_back();
+    if (candidate_vector.size() == number_of_candidates &&
+        !(sector.first < candidate_vector.front().cost)) {
+      break;
+    }
+
+    const int e0 = sector.second / n_sectors_z * COST_SECTOR_SIZE;
+    const int z0 = sector.second % n_sectors_z * COST_SECTOR_SIZE;
+    const int e1 = std::min(e0 + COST_SECTOR_SIZE, GRID_LENGTH_E);
+    const int z1 = std::min(z0 + COST_SECTOR_SIZE, GRID_LENGTH_Z);
+    for (int e_index = e0; e_index < e1; e_index++) {
+      for (int z_index = z0; z_index < z1; z_index++) {
+        PolarPoint p_pol =
+            histogramIndexToPolar(e_index, z_index, ALPHA_RES, 1.0);
+        float cost =
+            cell_cost(e_index, z_index) + distance_matrix(e_index, z_index);
+        pushCandidate(candidateDirection(cost, p_pol.e, p_pol.z),
+                      number_of_candidates, candidate_vector);
+      }
+    }
+  }
+  // change order such that lowest cost is at the front
+  std::sort_heap(candidate_vector.begin(), candidate_vector.end());
+}
+
 void generateCostImage(const Eigen::MatrixXf& cost_matrix,
                        const Eigen::MatrixXf& distance_matrix,
                        std::vector<uint8_t>& image_data) {
@@ -348,72 +1246,120 @@ int colorImageIndex(int e_ind, int z_ind, int color) {
 void getBestCandidatesFromCostMatrix(
     const Eigen::MatrixXf& matrix, unsigned int number_of_candidates,
     std::vector<candidateDirection>& candidate_vector) {
-  std::priority_queue<candidateDirection, std::vector<candidateDirection>,
-                      std::less<candidateDirection>>
-      queue;
+  // the candidate vector is used as max-heap such that the most expensive of
+  // the kept candidates is at the front, this reuses its storage between calls
+  candidate_vector.clear();
+  candidate_vector.reserve(number_of_candidates + 1);
 
   for (int row_index = 0; row_index < matrix.rows(); row_index++) {
     for (int col_index = 0; col_index < matrix.cols(); col_index++) {
       PolarPoint p_pol =
           histogramIndexToPolar(row_index, col_index, ALPHA_RES, 1.0);
       float cost = matrix(row_index, col_index);
-      candidateDirection candidate(cost, p_pol.e, p_pol.z);
-
-      if (queue.size() < number_of_candidates) {
-        queue.push(candidate);
-      } else if (candidate < queue.top()) {
-        queue.push(candidate);
-        queue.pop();
-      }
+      pushCandidate(candidateDirection(cost, p_pol.e, p_pol.z),
+                    number_of_candidates, candidate_vector);
     }
   }
-  // copy queue to vector and change order such that lowest cost is at the front
-  candidate_vector.clear();
-  candidate_vector.reserve(queue.size());
-  while (!queue.empty()) {
-    candidate_vector.push_back(queue.top());
-    queue.pop();
-  }
-  std::reverse(candidate_vector.begin(), candidate_vector.end());
+  // change order such that lowest cost is at the front
+  std::sort_heap(candidate_vector.begin(), candidate_vector.end());
 }
 
 void smoothPolarMatrix(Eigen::MatrixXf& matrix, unsigned int smoothing_radius) {
-  // pad matrix by smoothing radius respecting all wrapping rules
-  Eigen::MatrixXf matrix_padded;
-  padPolarMatrix(matrix, smoothing_radius, matrix_padded);
-  Eigen::ArrayXf kernel1d = getConicKernel(smoothing_radius);
+  CostMatrixWorkspace workspace;
+  smoothPolarMatrix(matrix, smoothing_radius, workspace);
+}
+
+// Smoothes line with the conic kernel of the given radius, line holds the
+// values [-radius, n + radius) of the line with the wrapping already applied.
+// The triangle of width 2 * radius + 1 is the convolution of two boxes of
+// width radius + 1, the boxes are evaluated with running sums.
+static void conicFilterLine(const Eigen::ArrayXf& line, int n, int radius,
+                            std::vector<double>& box_sum, float* out,
+                            int out_stride) {
+  const int width = radius + 1;
+  // box_sum[s] is the sum of line[s, s + radius], s in [0, n + radius)
+  box_sum.resize(n + radius);
+  double sum = 0.0;
+  for (int t = 0; t < radius; t++) {
+    sum += line(t);
+  }
+  for (int s = 0; s < n + radius; s++) {
+    sum += line(s + radius);
+    box_sum[s] = sum;
+    sum -= line(s);
+  }
+
+  // out[i] sums the boxes s in [i, i + radius] and normalizes the peak to one
+  const double scale = 1.0 / width;
+  sum = 0.0;
+  for (int s = 0; s < radius; s++) {
+    sum += box_sum[s];
+  }
+  for (int i = 0; i < n; i++) {
+    sum += box_sum[i + radius];
+    out[i * out_stride] = static_cast<float>(sum * scale);
+    sum -= box_sum[i];
+  }
+}
 
-  Eigen::ArrayXf temp_col(matrix_padded.rows());
-  for (int col_index = 0; col_index < matrix_padded.cols(); col_index++) {
-    temp_col = matrix_padded.col(col_index);
-    for (int row_index = 0; row_index < matrix.rows(); row_index++) {
-      float smooth_val =
-          (temp_col.segment(row_index, 2 * smoothing_radius + 1) * kernel1d)
-              .sum();
-      matrix_padded(row_index + smoothing_radius, col_index) = smooth_val;
+void smoothPolarMatrix(Eigen::MatrixXf& matrix, unsigned int smoothing_radius,
+                       CostMatrixWorkspace& workspace) {
+  ScopedStageTimer timer(PlannerStage::smoothPolarMatrix);
+  const int rows = matrix.rows();
+  const int cols = matrix.cols();
+  const int radius = static_cast<int>(smoothing_radius);
+  if (rows == 0 || cols == 0) {
+    return;
+  }
+  if (cols % 2 > 0) {
+    ROS_ERROR("invalid resolution: 180 mod (2* resolution) must be zero");
+  }
+  const int middle_index = cols / 2;
+
+  // elevation: beyond the poles the line continues on the opposite azimuth
+  // in reverse order, see padPolarMatrix
+  Eigen::MatrixXf& smoothed = workspace.smoothed_columns;
+  smoothed.resize(rows, cols);
+  Eigen::ArrayXf& line = workspace.line;
+  line.resize(rows + 2 * radius);
+  for (int c = 0; c < cols; c++) {
+    for (int i = -radius; i < rows + radius; i++) {
+      int row = i;
+      int col = c;
+      while (row < 0 || row >= rows) {
+        row = row < 0 ? -1 - row : 2 * rows - 1 - row;
+        col = (col + middle_index) % cols;
+      }
+      line(i + radius) = matrix(row, col);
     }
+    conicFilterLine(line, rows, radius, workspace.box_sum, &smoothed(0, c), 1);
   }
 
-  Eigen::ArrayXf temp_row(matrix_padded.cols());
-  for (int row_index = 0; row_index < matrix.rows(); row_index++) {
-    temp_row = matrix_padded.row(row_index + smoothing_radius);
-    for (int col_index = 0; col_index < matrix.cols(); col_index++) {
-      float smooth_val =
-          (temp_row.segment(col_index, 2 * smoothing_radius + 1) * kernel1d)
-              .sum();
-      matrix(row_index, col_index) = smooth_val;
+  // azimuth: the line wraps around
+  line.resize(cols + 2 * radius);
+  for (int r = 0; r < rows; r++) {
+    for (int i = -radius; i < cols + radius; i++) {
+      int col = i % cols;
+      line(i + radius) = smoothed(r, col < 0 ? col + cols : col);
     }
+    conicFilterLine(line, cols, radius, workspace.box_sum, &matrix(r, 0),
+                    static_cast<int>(matrix.outerStride()));
   }
 }
 
 Eigen::ArrayXf getConicKernel(int radius) {
-  Eigen::ArrayXf kernel(radius * 2 + 1);
+  Eigen::ArrayXf kernel;
+  getConicKernel(radius, kernel);
+  return kernel;
+}
+
+void getConicKernel(int radius, Eigen::ArrayXf& kernel) {
+  kernel.resize(radius * 2 + 1);
   for (int row = 0; row < kernel.rows(); row++) {
     kernel(row) = std::max(0.f, 1.f + radius - std::abs(row - radius));
   }
 
   kernel *= 1.f / kernel.maxCoeff();
-  return kernel;
 }
 
 void padPolarMatrix(const Eigen::MatrixXf& matrix, unsigned int n_lines_padding,
@@ -473,59 +1419,14 @@ void costFunction(float e_angle, float z_angle, float obstacle_distance,
                   const Eigen::Vector3f& goal, const Eigen::Vector3f& position,
                   const float yaw_angle_histogram_frame,
                   const Eigen::Vector3f& last_sent_waypoint,
-                  costParameters cost_params, float& distance_cost,
+                  const costParameters& cost_params, float& distance_cost,
                   float& other_costs) {
-  float goal_dist = (position - goal).norm();
-  PolarPoint p_pol(e_angle, z_angle, goal_dist);
-  Eigen::Vector3f projected_candidate = polarToCartesian(p_pol, position);
-  PolarPoint heading_pol(e_angle, yaw_angle_histogram_frame, goal_dist);
-  Eigen::Vector3f projected_heading = polarToCartesian(heading_pol, position);
-  Eigen::Vector3f projected_goal = goal;
-  PolarPoint last_wp_pol = cartesianToPolar(last_sent_waypoint, position);
-  last_wp_pol.r = goal_dist;
-  Eigen::Vector3f projected_last_wp = polarToCartesian(last_wp_pol, position);
-
-  // goal costs
-  float yaw_cost =
-      cost_params.goal_cost_param *
-      (projected_goal.topRows<2>() - projected_candidate.topRows<2>()).norm();
-  float pitch_cost_up = 0.0f;
-  float pitch_cost_down = 0.0f;
-  if (projected_candidate.z() > projected_goal.z()) {
-    pitch_cost_up = cost_params.goal_cost_param *
-                    std::abs(projected_goal.z() - projected_candidate.z());
-  } else {
-    pitch_cost_down = cost_params.goal_cost_param *
-                      std::abs(projected_goal.z() - projected_candidate.z());
-  }
-
-  // smooth costs
-  float yaw_cost_smooth =
-      cost_params.smooth_cost_param *
-      (projected_last_wp.topRows<2>() - projected_candidate.topRows<2>())
-          .norm();
-  float pitch_cost_smooth =
-      cost_params.smooth_cost_param *
-      std::abs(projected_last_wp.z() - projected_candidate.z());
-
-  // heading cost
-  float heading_cost =
-      cost_params.heading_cost_param *
-      (projected_heading.topRows<2>() - projected_candidate.topRows<2>())
-          .norm();
-
-  // distance cost
-  distance_cost = 0.0f;
-  if (obstacle_distance > 0.0f) {
-    distance_cost = 700.0f / obstacle_distance;
-  }
-
-  // combine costs
-  other_costs = 0.0f;
-  other_costs = yaw_cost +
-                cost_params.height_change_cost_param_adapted * pitch_cost_up +
-                cost_params.height_change_cost_param * pitch_cost_down +
-                yaw_cost_smooth + pitch_cost_smooth + heading_cost;
+  CostFunctionFrame frame = costFunctionFrame(
+      goal, position, yaw_angle_histogram_frame, last_sent_waypoint);
+  costFunction(std::cos(e_angle * DEG_TO_RAD), std::sin(e_angle * DEG_TO_RAD),
+               std::cos(z_angle * DEG_TO_RAD), std::sin(z_angle * DEG_TO_RAD),
+               obstacle_distance, frame, goal, position, cost_params,
+               distance_cost, other_costs);
 }
 
 bool getDirectionFromTree(
@@ -606,7 +1507,7 @@ bool getDirectionFromTree(
   return tree_available;
 }
 
-void printHistogram(Histogram& histogram) {
+void printHistogram(const Histogram<ALPHA_RES>& histogram) {
   std::cout << "------------------------------------------Histogram------------"
                "------------------------------------\n";
   for (int e = 0; e < GRID_LENGTH_E; e++) {
@@ -0,0 +1,269 @@
+#include "local_planner/planner_snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace avoidance {
+
+namespace {
+
+const char kMagic[8] = {'L', 'P', 'S', 'N', 'A', 'P', '\0', '\0'};
+const uint32_t kVersion = 1;
+const size_t kInitialSlotCapacity = 64 * 1024;
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t slot_capacity;
+};
+
+struct SlotHeader {
+  uint64_t sequence;  // 0 while the slot is empty or being written
+  uint64_t size;
+  uint32_t checksum;
+  uint32_t reserved;
+};
+
+struct PayloadHeader {
+  double stamp;
+  float goal[3];
+  float take_off_pose[3];
+  uint32_t reach_altitude;
+  uint32_t num_voxels;
+};
+
+static_assert(sizeof(int) == sizeof(int32_t),
+              "the voxel counts and ages are stored as 32 bit integers");
+
+// bytes of a voxel in the payload: centroid, count, age and confidence
+const size_t kVoxelSize = 3 * sizeof(float) + 2 * sizeof(int32_t) + 1;
+
+size_t payloadSize(size_t num_voxels) {
+  return sizeof(PayloadHeader) + num_voxels * kVoxelSize;
+}
+
+// FNV-1a, the snapshot is only checked for torn writes
+uint32_t checksum(const char* data, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+  }
+  return hash;
+}
+
+template <typename T>
+char* writeArray(char* out, const std::vector<T>& values) {
+  std::memcpy(out, values.data(), values.size() * sizeof(T));
+  return out + values.size() * sizeof(T);
+}
+
+template <typename T>
+const char* readArray(const char* in, size_t n, std::vector<T>& values) {
+  values.resize(n);
+  std::memcpy(values.data(), in, n * sizeof(T));
+  return in + n * sizeof(T);
+}
+}
+
+SnapshotFile::~SnapshotFile() { close(); }
+
+bool SnapshotFile::open(const std::string& path) {
+  close();
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+
+  // keep the snapshots of an existing file of the same format
+  struct stat st;
+  FileHeader header;
+  if (fstat(fd_, &st) == 0 &&
+      static_cast<size_t>(st.st_size) >= sizeof(FileHeader) &&
+      pread(fd_, &header, sizeof(header), 0) == sizeof(header) &&
+      std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+      header.version == kVersion && header.slot_capacity % 8 == 0 &&
+      static_cast<size_t>(st.st_size) ==
+          sizeof(FileHeader) +
+              2 * (sizeof(SlotHeader) + header.slot_capacity)) {
+    void* data = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd_, 0);
+    if (data != MAP_FAILED) {
+      data_ = static_cast<char*>(data);
+      size_ = st.st_size;
+      for (int i = 0; i < 2; i++) {
+        SlotHeader slot_header;
+        std::memcpy(&slot_header, slot(i), sizeof(slot_header));
+        sequence_ = std::max(sequence_, slot_header.sequence);
+      }
+      return true;
+    }
+  }
+
+  if (!resize(kInitialSlotCapacity)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void SnapshotFile::close() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  fd_ = -1;
+  data_ = nullptr;
+  size_ = 0;
+  sequence_ = 0;
+}
+
+size_t SnapshotFile::slotCapacity() const {
+  return (size_ - sizeof(FileHeader)) / 2 - sizeof(SlotHeader);
+}
+
+char* SnapshotFile::slot(int index) const {
+  return data_ + sizeof(FileHeader) +
+         index * (sizeof(SlotHeader) + slotCapacity());
+}
+
+bool SnapshotFile::resize(size_t slot_capacity) {
+  if (data_) {
+    munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+  slot_capacity = (slot_capacity + 7) & ~size_t(7);
+  size_t size =
+      sizeof(FileHeader) + 2 * (sizeof(SlotHeader) + slot_capacity);
+  if (ftruncate(fd_, size) != 0) {
+    return false;
+  }
+  void* data =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<char*>(data);
+  size_ = size;
+
+  FileHeader header = {};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.slot_capacity = slot_capacity;
+  std::memcpy(data_, &header, sizeof(header));
+  SlotHeader empty = {};
+  std::memcpy(slot(0), &empty, sizeof(empty));
+  std::memcpy(slot(1), &empty, sizeof(empty));
+  return true;
+}
+
+bool SnapshotFile::write(const PlannerSnapshot& snapshot) {
+  if (!isOpen()) {
+    return false;
+  }
+  const ObstacleMemory& memory = snapshot.obstacle_memory;
+  const size_t size = payloadSize(memory.size());
+  if (size > slotCapacity() &&
+      !resize(std::max(size + size / 2, 2 * slotCapacity()))) {
+    close();
+    return false;
+  }
+
+  // the slot is marked empty until it is complete, the other one keeps the
+  // previous snapshot
+  const uint64_t sequence = sequence_ + 1;
+  char* out = slot(sequence % 2);
+  SlotHeader slot_header = {};
+  std::memcpy(out, &slot_header, sizeof(slot_header));
+
+  char* payload = out + sizeof(SlotHeader);
+  PayloadHeader payload_header = {};
+  payload_header.stamp = snapshot.stamp;
+  for (int i = 0; i < 3; i++) {
+    payload_header.goal[i] = snapshot.goal[i];
+    payload_header.take_off_pose[i] = snapshot.take_off_pose[i];
+  }
+  payload_header.reach_altitude = snapshot.reach_altitude;
+  payload_header.num_voxels = static_cast<uint32_t>(memory.size());
+  std::memcpy(payload, &payload_header, sizeof(payload_header));
+  char* end = payload + sizeof(payload_header);
+  end = writeArray(end, memory.x());
+  end = writeArray(end, memory.y());
+  end = writeArray(end, memory.z());
+  end = writeArray(end, memory.count());
+  end = writeArray(end, memory.age());
+  end = writeArray(end, memory.confidence());
+
+  slot_header.size = size;
+  slot_header.checksum = checksum(payload, size);
+  slot_header.sequence = sequence;
+  std::memcpy(out, &slot_header, sizeof(slot_header));
+  sequence_ = sequence;
+
+  // the page cache survives a crash of the node, the flush only bounds the
+  // loss on a power cut
+  msync(data_, size_, MS_ASYNC);
+  return true;
+}
+
+bool SnapshotFile::read(PlannerSnapshot& snapshot) const {
+  if (!isOpen()) {
+    return false;
+  }
+  const char* payload = nullptr;
+  uint64_t newest = 0;
+  for (int i = 0; i < 2; i++) {
+    const char* in = slot(i);
+    SlotHeader slot_header;
+    std::memcpy(&slot_header, in, sizeof(slot_header));
+    if (slot_header.sequence <= newest ||
+        slot_header.size < sizeof(PayloadHeader) ||
+        slot_header.size > slotCapacity()) {
+      continue;
+    }
+    PayloadHeader payload_header;
+    std::memcpy(&payload_header, in + sizeof(SlotHeader),
+                sizeof(payload_header));
+    if (slot_header.size != payloadSize(payload_header.num_voxels) ||
+        slot_header.checksum !=
+            checksum(in + sizeof(SlotHeader), slot_header.size)) {
+      continue;
+    }
+    payload = in + sizeof(SlotHeader);
+    newest = slot_header.sequence;
+  }
+  if (!payload) {
+    return false;
+  }
+
+  PayloadHeader payload_header;
+  std::memcpy(&payload_header, payload, sizeof(payload_header));
+  snapshot.stamp = payload_header.stamp;
+  snapshot.goal = Eigen::Vector3f(payload_header.goal);
+  snapshot.take_off_pose = Eigen::Vector3f(payload_header.take_off_pose);
+  snapshot.reach_altitude = payload_header.reach_altitude != 0;
+
+  const size_t n = payload_header.num_voxels;
+  std::vector<float> x, y, z;
+  std::vector<int> count, age;
+  std::vector<uint8_t> confidence;
+  const char* in = payload + sizeof(payload_header);
+  in = readArray(in, n, x);
+  in = readArray(in, n, y);
+  in = readArray(in, n, z);
+  in = readArray(in, n, count);
+  in = readArray(in, n, age);
+  readArray(in, n, confidence);
+  snapshot.obstacle_memory.assign(x, y, z, count, age, confidence);
+  return true;
+}
+}
@@ -0,0 +1,59 @@
+#include "local_planner/planning_trigger.h"
+
+namespace avoidance {
+
+PlanningTrigger toPlanningTrigger(int value) {
+  switch (value) {
+    case static_cast<int>(PlanningTrigger::anyCamera):
+      return PlanningTrigger::anyCamera;
+    case static_cast<int>(PlanningTrigger::fixedRate):
+      return PlanningTrigger::fixedRate;
+    default:
+      return PlanningTrigger::allCameras;
+  }
+}
+
+bool readyToPlan(PlanningTrigger trigger, size_t num_cameras,
+                 size_t num_new_clouds, size_t num_usable_clouds,
+                 double since_last_plan, double planning_rate) {
+  if (num_cameras == 0) {
+    return false;
+  }
+
+  switch (trigger) {
+    case PlanningTrigger::anyCamera:
+      return num_new_clouds > 0 && num_usable_clouds > 0;
+    case PlanningTrigger::fixedRate:
+      return num_usable_clouds > 0 && planning_rate > 0.0 &&
+             since_last_plan >= 1.0 / planning_rate;
+    case PlanningTrigger::allCameras:
+    default:
+      return num_new_clouds == num_cameras;
+  }
+}
+
+bool isCloudUsable(PlanningTrigger trigger, double cloud_age,
+                   double max_cloud_age) {
+  return trigger == PlanningTrigger::allCameras || cloud_age <= max_cloud_age;
+}
+
+bool canStageClouds(PlanningTrigger trigger, size_t num_cameras,
+                    const std::function<bool(size_t)>& usable,
+                    const std::function<bool(size_t)>& has_transform) {
+  // every camera is asked, the transform lookups may cache the extrinsics
+  size_t missing_transforms = 0;
+  for (size_t i = 0; i < num_cameras; ++i) {
+    // clouds left out of the snapshot do not need a transform
+    if (!usable(i)) {
+      if (trigger == PlanningTrigger::allCameras) {
+        missing_transforms++;
+      }
+      continue;
+    }
+    if (!has_transform(i)) {
+      missing_transforms++;
+    }
+  }
+  return missing_transforms == 0;
+}
+}
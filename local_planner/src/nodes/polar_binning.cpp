@@ -0,0 +1,246 @@
+#include "local_planner/polar_binning.h"
+
+#include "local_planner/common.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace avoidance {
+
+namespace {
+// minimax polynomial for atan on [0, 1] (Abramowitz & Stegun 4.4.49)
+const float kAtanA1 = 0.9998660f;
+const float kAtanA3 = -0.3302995f;
+const float kAtanA5 = 0.1801410f;
+const float kAtanA7 = -0.0851330f;
+const float kAtanA9 = 0.0208351f;
+const float kPiHalf = 0.5f * M_PI_F;
+
+// Scaling from radians to bins and offsets moving -90° / -180° to bin 0
+struct BinningConstants {
+  BinningConstants(int res)
+      : rad_to_bin(RAD_TO_DEG / res),
+        e_offset(90.0f / res),
+        z_offset(180.0f / res),
+        e_max(180 / res - 1),
+        z_max(360 / res - 1),
+        z_dim(360 / res) {}
+  float rad_to_bin;
+  float e_offset;
+  float z_offset;
+  int e_max;
+  int z_max;
+  int z_dim;
+};
+
+inline void binPoint(float dx, float dy, float dz, const BinningConstants& c,
+                     int& bin, float& dist) {
+  float dxy2 = dx * dx + dy * dy;
+  float e = fastAtan2(dz, std::sqrt(dxy2));
+  float z = fastAtan2(dx, dy);
+  int e_idx = static_cast<int>(std::floor(e * c.rad_to_bin + c.e_offset));
+  int z_idx = static_cast<int>(std::floor(z * c.rad_to_bin + c.z_offset));
+  // +180° azimuth wraps to -180°, elevation is clamped
+  if (z_idx > c.z_max) z_idx -= c.z_dim;
+  e_idx = std::min(std::max(e_idx, 0), c.e_max);
+  z_idx = std::min(std::max(z_idx, 0), c.z_max);
+  bin = e_idx * c.z_dim + z_idx;
+  dist = std::sqrt(dxy2 + dz * dz);
+}
+
+#if defined(__AVX2__)
+inline __m256 fastAtan2x8(__m256 y, __m256 x) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 ax = _mm256_andnot_ps(sign, x);
+  __m256 ay = _mm256_andnot_ps(sign, y);
+  __m256 mx = _mm256_max_ps(ax, ay);
+  __m256 a = _mm256_div_ps(_mm256_min_ps(ax, ay), mx);
+  a = _mm256_and_ps(a, _mm256_cmp_ps(mx, zero, _CMP_GT_OQ));
+  __m256 s = _mm256_mul_ps(a, a);
+  __m256 r = _mm256_add_ps(_mm256_set1_ps(kAtanA7),
+                           _mm256_mul_ps(s, _mm256_set1_ps(kAtanA9)));
+  r = _mm256_add_ps(_mm256_set1_ps(kAtanA5), _mm256_mul_ps(s, r));
+  r = _mm256_add_ps(_mm256_set1_ps(kAtanA3), _mm256_mul_ps(s, r));
+  r = _mm256_add_ps(_mm256_set1_ps(kAtanA1), _mm256_mul_ps(s, r));
+  r = _mm256_mul_ps(a, r);
+  r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(kPiHalf), r),
+                       _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+  r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(M_PI_F), r),
+                       _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+  return _mm256_xor_ps(
+      r, _mm256_and_ps(sign, _mm256_cmp_ps(y, zero, _CMP_LT_OQ)));
+}
+
+// indices above max_idx are moved down by wrap before clamping
+inline __m256i toBinIndex(__m256 angle, __m256 scale, __m256 offset,
+                          __m256i max_idx, __m256i wrap) {
+  __m256 idx = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(angle, scale),
+                                             offset));
+  __m256i i = _mm256_cvttps_epi32(idx);
+  i = _mm256_sub_epi32(i,
+                       _mm256_and_si256(_mm256_cmpgt_epi32(i, max_idx), wrap));
+  return _mm256_min_epi32(_mm256_max_epi32(i, _mm256_setzero_si256()),
+                          max_idx);
+}
+
+size_t polarBinningSimd(const float* x, const float* y, const float* z,
+                        size_t n, const Eigen::Vector3f& origin,
+                        const BinningConstants& c, int* bin, float* dist) {
+  const __m256 ox = _mm256_set1_ps(origin.x());
+  const __m256 oy = _mm256_set1_ps(origin.y());
+  const __m256 oz = _mm256_set1_ps(origin.z());
+  const __m256 scale = _mm256_set1_ps(c.rad_to_bin);
+  const __m256 e_offset = _mm256_set1_ps(c.e_offset);
+  const __m256 z_offset = _mm256_set1_ps(c.z_offset);
+  const __m256i e_max = _mm256_set1_epi32(c.e_max);
+  const __m256i z_max = _mm256_set1_epi32(c.z_max);
+  const __m256i z_dim = _mm256_set1_epi32(c.z_dim);
+  const __m256i zero = _mm256_setzero_si256();
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), ox);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), oy);
+    __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), oz);
+    __m256 dxy2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    __m256 e = fastAtan2x8(dz, _mm256_sqrt_ps(dxy2));
+    __m256 az = fastAtan2x8(dx, dy);
+    __m256i e_idx = toBinIndex(e, scale, e_offset, e_max, zero);
+    __m256i z_idx = toBinIndex(az, scale, z_offset, z_max, z_dim);
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(bin + i),
+        _mm256_add_epi32(_mm256_mullo_epi32(e_idx, z_dim), z_idx));
+    _mm256_storeu_ps(dist + i, _mm256_sqrt_ps(_mm256_add_ps(
+                                   dxy2, _mm256_mul_ps(dz, dz))));
+  }
+  return i;
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+inline float32x4_t fastAtan2x4(float32x4_t y, float32x4_t x) {
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  float32x4_t ax = vabsq_f32(x);
+  float32x4_t ay = vabsq_f32(y);
+  float32x4_t mx = vmaxq_f32(ax, ay);
+  float32x4_t a = vdivq_f32(vminq_f32(ax, ay), mx);
+  a = vreinterpretq_f32_u32(
+      vandq_u32(vreinterpretq_u32_f32(a), vcgtq_f32(mx, zero)));
+  float32x4_t s = vmulq_f32(a, a);
+  float32x4_t r =
+      vaddq_f32(vdupq_n_f32(kAtanA7), vmulq_f32(s, vdupq_n_f32(kAtanA9)));
+  r = vaddq_f32(vdupq_n_f32(kAtanA5), vmulq_f32(s, r));
+  r = vaddq_f32(vdupq_n_f32(kAtanA3), vmulq_f32(s, r));
+  r = vaddq_f32(vdupq_n_f32(kAtanA1), vmulq_f32(s, r));
+  r = vmulq_f32(a, r);
+  r = vbslq_f32(vcgtq_f32(ay, ax), vsubq_f32(vdupq_n_f32(kPiHalf), r), r);
+  r = vbslq_f32(vcltq_f32(x, zero), vsubq_f32(vdupq_n_f32(M_PI_F), r), r);
+  return vbslq_f32(vcltq_f32(y, zero), vnegq_f32(r), r);
+}
+
+// indices above max_idx are moved down by wrap before clamping
+inline int32x4_t toBinIndex(float32x4_t angle, float32x4_t scale,
+                            float32x4_t offset, int32x4_t max_idx,
+                            int32x4_t wrap) {
+  float32x4_t idx = vrndmq_f32(vaddq_f32(vmulq_f32(angle, scale), offset));
+  int32x4_t i = vcvtq_s32_f32(idx);
+  i = vsubq_s32(
+      i, vandq_s32(vreinterpretq_s32_u32(vcgtq_s32(i, max_idx)), wrap));
+  return vminq_s32(vmaxq_s32(i, vdupq_n_s32(0)), max_idx);
+}
+
+size_t polarBinningSimd(const float* x, const float* y, const float* z,
+                        size_t n, const Eigen::Vector3f& origin,
+                        const BinningConstants& c, int* bin, float* dist) {
+  const float32x4_t ox = vdupq_n_f32(origin.x());
+  const float32x4_t oy = vdupq_n_f32(origin.y());
+  const float32x4_t oz = vdupq_n_f32(origin.z());
+  const float32x4_t scale = vdupq_n_f32(c.rad_to_bin);
+  const float32x4_t e_offset = vdupq_n_f32(c.e_offset);
+  const float32x4_t z_offset = vdupq_n_f32(c.z_offset);
+  const int32x4_t e_max = vdupq_n_s32(c.e_max);
+  const int32x4_t z_max = vdupq_n_s32(c.z_max);
+  const int32x4_t z_dim = vdupq_n_s32(c.z_dim);
+  const int32x4_t zero = vdupq_n_s32(0);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t dx = vsubq_f32(vld1q_f32(x + i), ox);
+    float32x4_t dy = vsubq_f32(vld1q_f32(y + i), oy);
+    float32x4_t dz = vsubq_f32(vld1q_f32(z + i), oz);
+    float32x4_t dxy2 = vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy));
+    float32x4_t e = fastAtan2x4(dz, vsqrtq_f32(dxy2));
+    float32x4_t az = fastAtan2x4(dx, dy);
+    int32x4_t e_idx = toBinIndex(e, scale, e_offset, e_max, zero);
+    int32x4_t z_idx = toBinIndex(az, scale, z_offset, z_max, z_dim);
+    vst1q_s32(bin + i, vmlaq_s32(z_idx, e_idx, z_dim));
+    vst1q_f32(dist + i, vsqrtq_f32(vaddq_f32(dxy2, vmulq_f32(dz, dz))));
+  }
+  return i;
+}
+#else
+size_t polarBinningSimd(const float* x, const float* y, const float* z,
+                        size_t n, const Eigen::Vector3f& origin,
+                        const BinningConstants& c, int* bin, float* dist) {
+  return 0;
+}
+#endif
+}
+
+void PolarBinningBuffer::load(const pcl::PointCloud<pcl::PointXYZ>& cloud) {
+  load(cloud, 0, cloud.points.size());
+}
+
+void PolarBinningBuffer::load(const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                              size_t begin, size_t end) {
+  const size_t n = end - begin;
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+  bin.resize(n);
+  dist.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    x[i] = cloud.points[begin + i].x;
+    y[i] = cloud.points[begin + i].y;
+    z[i] = cloud.points[begin + i].z;
+  }
+}
+
+float fastAtan2(float y, float x) {
+  const float ax = std::abs(x);
+  const float ay = std::abs(y);
+  const float mx = std::max(ax, ay);
+  const float a = mx > 0.0f ? std::min(ax, ay) / mx : 0.0f;
+  const float s = a * a;
+  float r =
+      a * (kAtanA1 + s * (kAtanA3 + s * (kAtanA5 + s * (kAtanA7 +
+                                                         s * kAtanA9))));
+  if (ay > ax) r = kPiHalf - r;
+  if (x < 0.0f) r = M_PI_F - r;
+  if (y < 0.0f) r = -r;
+  return r;
+}
+
+void polarBinning(const float* x, const float* y, const float* z, size_t n,
+                  const Eigen::Vector3f& origin, int res, int* bin,
+                  float* dist) {
+  const BinningConstants c(res);
+  size_t i = polarBinningSimd(x, y, z, n, origin, c, bin, dist);
+  for (; i < n; ++i) {
+    binPoint(x[i] - origin.x(), y[i] - origin.y(), z[i] - origin.z(), c,
+             bin[i], dist[i]);
+  }
+}
+
+void polarBinning(PolarBinningBuffer& buffer, const Eigen::Vector3f& origin,
+                  int res) {
+  polarBinning(buffer.x.data(), buffer.y.data(), buffer.z.data(),
+               buffer.size(), origin, res, buffer.bin.data(),
+               buffer.dist.data());
+}
+}
@@ -0,0 +1,66 @@
+#include "local_planner/pose_buffer.h"
+
+#include <algorithm>
+
+namespace avoidance {
+
+PoseBuffer::PoseBuffer(size_t capacity)
+    : poses_(std::max<size_t>(1, capacity)) {}
+
+void PoseBuffer::add(double stamp, const Eigen::Vector3f& position,
+                     const Eigen::Quaternionf& orientation) {
+  // a pose older than the newest one would break the search order, it is
+  // also useless for the newer clouds
+  if (size_ > 0 && stamp <= at(size_ - 1).stamp) {
+    return;
+  }
+  Pose& pose = poses_[(oldest_ + size_) % poses_.size()];
+  if (size_ < poses_.size()) {
+    size_++;
+  } else {
+    oldest_ = (oldest_ + 1) % poses_.size();
+  }
+  pose.stamp = stamp;
+  pose.position = position;
+  pose.orientation = orientation;
+}
+
+bool PoseBuffer::interpolate(double stamp, Eigen::Affine3f& pose,
+                             double tolerance) const {
+  if (size_ == 0 || stamp < at(0).stamp - tolerance ||
+      stamp > at(size_ - 1).stamp + tolerance) {
+    return false;
+  }
+
+  // first pose not older than the stamp
+  size_t lo = 0, hi = size_;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (at(mid).stamp < stamp) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  Eigen::Vector3f position;
+  Eigen::Quaternionf orientation;
+  if (lo == 0 || lo == size_) {
+    const Pose& closest = at(lo == 0 ? 0 : size_ - 1);
+    position = closest.position;
+    orientation = closest.orientation;
+  } else {
+    const Pose& before = at(lo - 1);
+    const Pose& after = at(lo);
+    float t = static_cast<float>((stamp - before.stamp) /
+                                 (after.stamp - before.stamp));
+    position = before.position + t * (after.position - before.position);
+    orientation = Eigen::Quaternionf(before.orientation)
+                      .slerp(t, Eigen::Quaternionf(after.orientation));
+  }
+  pose.setIdentity();
+  pose.translate(position);
+  pose.rotate(orientation);
+  return true;
+}
+}
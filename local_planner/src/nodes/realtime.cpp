@@ -0,0 +1,99 @@
+#include "local_planner/realtime.h"
+
+#ifdef __linux__
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+namespace avoidance {
+
+bool applyThreadProfile(const ThreadProfile& profile, std::string& error) {
+#ifdef __linux__
+  bool ok = true;
+  if (!profile.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : profile.cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &set);
+      }
+    }
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (result != 0) {
+      error = std::string("affinity: ") + std::strerror(result);
+      ok = false;
+    }
+  }
+  if (profile.priority > 0) {
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = profile.priority;
+    int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (result != 0) {
+      error = std::string("SCHED_FIFO: ") + std::strerror(result);
+      ok = false;
+    }
+  }
+  return ok;
+#else
+  error = "not supported on this platform";
+  return profile.cpus.empty() && profile.priority <= 0;
+#endif
+}
+
+// writes to the pages below the current frame so that they are mapped before
+// mlockall locks them. Only volatile stores are used, they are neither
+// optimized away nor read memory that was never written
+static void prefaultStack(size_t stack_bytes) {
+  const size_t chunk = 4096;
+  unsigned char page[chunk];
+  volatile unsigned char* bytes = page;
+  for (size_t i = 0; i < chunk; i += 64) {
+    bytes[i] = 0;
+  }
+  if (stack_bytes > chunk) {
+    prefaultStack(stack_bytes - chunk);
+  }
+  // a store after the call keeps the frame, it is not a tail call
+  bytes[chunk - 1] = 0;
+}
+
+bool lockMemory(size_t stack_bytes, std::string& error) {
+#ifdef __linux__
+  // freed memory stays in the heap instead of being returned to the kernel,
+  // and large blocks come from the heap too, so a reallocation after the
+  // warm-up does not map new pages
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+  prefaultStack(stack_bytes);
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    error = std::string("mlockall: ") + std::strerror(errno);
+    return false;
+  }
+  return true;
+#else
+  error = "not supported on this platform";
+  return false;
+#endif
+}
+
+bool lockedMemoryLimit(size_t& bytes) {
+#ifdef __linux__
+  rlimit limit;
+  if (getrlimit(RLIMIT_MEMLOCK, &limit) != 0 ||
+      limit.rlim_cur == RLIM_INFINITY) {
+    return false;
+  }
+  bytes = static_cast<size_t>(limit.rlim_cur);
+  return true;
+#else
+  return false;
+#endif
+}
+}
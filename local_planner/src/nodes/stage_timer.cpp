@@ -0,0 +1,198 @@
+#include "local_planner/stage_timer.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace avoidance {
+
+const size_t StageTimings::window_size;
+const size_t StageTimings::max_trace_events;
+
+const char* stageName(PlannerStage stage) {
+  switch (stage) {
+    case PlannerStage::ingest:
+      return "ingest";
+    case PlannerStage::filterPointCloud:
+      return "filter_point_cloud";
+    case PlannerStage::downsample:
+      return "downsample";
+    case PlannerStage::histogram:
+      return "histogram";
+    case PlannerStage::propagation:
+      return "propagation";
+    case PlannerStage::costMatrix:
+      return "cost_matrix";
+    case PlannerStage::smoothPolarMatrix:
+      return "smooth_polar_matrix";
+    case PlannerStage::treeBuild:
+      return "tree_build";
+    case PlannerStage::waypointGenerator:
+      return "waypoint_generator";
+    case PlannerStage::planner:
+      return "planner";
+    default:
+      return "unknown";
+  }
+}
+
+// small sequential ids are easier to read in the trace viewer than hashes of
+// std::thread::id
+static int currentThreadId() {
+  static std::atomic<int> next_id{1};
+  thread_local int id = next_id++;
+  return id;
+}
+
+// timings selected by a ScopedStageTimings on this thread
+static thread_local StageTimings* current_timings = nullptr;
+
+StageTimings& StageTimings::instance() {
+  static StageTimings timings;
+  return current_timings ? *current_timings : timings;
+}
+
+ScopedStageTimings::ScopedStageTimings(StageTimings& timings)
+    : previous_(current_timings) {
+  current_timings = &timings;
+}
+
+ScopedStageTimings::~ScopedStageTimings() { current_timings = previous_; }
+
+void StageTimings::record(PlannerStage stage, Clock::time_point start,
+                          Clock::time_point end) {
+  int64_t duration_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+          .count();
+
+  StageSamples& samples = stages_[static_cast<size_t>(stage)];
+  {
+    std::lock_guard<std::mutex> lock(samples.mutex);
+    samples.duration_ns[samples.next] = duration_ns;
+    samples.next = (samples.next + 1) % window_size;
+    samples.count = std::min(samples.count + 1, window_size);
+    samples.total_ns += duration_ns;
+    if (samples.deadline_ns > 0 && duration_ns > samples.deadline_ns) {
+      samples.overruns++;
+    }
+  }
+
+  if (trace_enabled_) {
+    TraceEvent event;
+    event.stage = stage;
+    event.thread_id = currentThreadId();
+    event.start_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         start.time_since_epoch())
+                         .count();
+    event.duration_us = duration_ns / 1000;
+
+    std::lock_guard<std::mutex> lock(trace_mutex_);
+    if (trace_events_.size() < max_trace_events) {
+      trace_events_.push_back(event);
+    } else {
+      dropped_trace_events_++;
+    }
+  }
+}
+
+void StageTimings::setDeadline(PlannerStage stage, double deadline_ms) {
+  StageSamples& samples = stages_[static_cast<size_t>(stage)];
+  std::lock_guard<std::mutex> lock(samples.mutex);
+  samples.deadline_ns = static_cast<int64_t>(std::max(0.0, deadline_ms) * 1e6);
+}
+
+size_t StageTimings::overruns(PlannerStage stage) const {
+  const StageSamples& samples = stages_[static_cast<size_t>(stage)];
+  std::lock_guard<std::mutex> lock(samples.mutex);
+  return samples.overruns;
+}
+
+double StageTimings::totalMs(PlannerStage stage) const {
+  const StageSamples& samples = stages_[static_cast<size_t>(stage)];
+  std::lock_guard<std::mutex> lock(samples.mutex);
+  return samples.total_ns * 1e-6;
+}
+
+StageStatistics StageTimings::statistics(PlannerStage stage) const {
+  std::array<int64_t, window_size> sorted;
+  size_t n;
+  StageStatistics statistics;
+  {
+    const StageSamples& samples = stages_[static_cast<size_t>(stage)];
+    std::lock_guard<std::mutex> lock(samples.mutex);
+    n = samples.count;
+    std::copy(samples.duration_ns.begin(), samples.duration_ns.begin() + n,
+              sorted.begin());
+    statistics.overruns = samples.overruns;
+  }
+
+  statistics.samples = n;
+  if (n == 0) {
+    return statistics;
+  }
+
+  // nearest rank percentiles
+  std::sort(sorted.begin(), sorted.begin() + n);
+  size_t p50 = (n * 50 + 99) / 100 - 1;
+  size_t p99 = (n * 99 + 99) / 100 - 1;
+  statistics.p50_ms = sorted[p50] * 1e-6;
+  statistics.p99_ms = sorted[p99] * 1e-6;
+  statistics.max_ms = sorted[n - 1] * 1e-6;
+  statistics.total_ms =
+      std::accumulate(sorted.begin(), sorted.begin() + n, int64_t(0)) * 1e-6;
+  return statistics;
+}
+
+void StageTimings::reset() {
+  for (StageSamples& samples : stages_) {
+    std::lock_guard<std::mutex> lock(samples.mutex);
+    samples.next = 0;
+    samples.count = 0;
+    samples.overruns = 0;
+    samples.total_ns = 0;
+  }
+  std::lock_guard<std::mutex> lock(trace_mutex_);
+  trace_events_.clear();
+  dropped_trace_events_ = 0;
+}
+
+size_t StageTimings::takeTraceEvents(std::vector<TraceEvent>& events) {
+  events.clear();
+  std::lock_guard<std::mutex> lock(trace_mutex_);
+  std::swap(events, trace_events_);
+  size_t dropped = dropped_trace_events_;
+  dropped_trace_events_ = 0;
+  return dropped;
+}
+
+bool ChromeTraceWriter::open(const std::string& path) {
+  file_.open(path, std::ios::out | std::ios::trunc);
+  if (!file_.is_open()) {
+    return false;
+  }
+  file_ << "[\n";
+  return true;
+}
+
+void ChromeTraceWriter::write(const std::vector<TraceEvent>& events) {
+  if (!file_.is_open()) {
+    return;
+  }
+  for (const TraceEvent& event : events) {
+    file_ << "{\"name\":\"" << stageName(event.stage)
+          << "\",\"cat\":\"local_planner\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+          << event.thread_id << ",\"ts\":" << event.start_us
+          << ",\"dur\":" << event.duration_us << "},\n";
+  }
+  file_.flush();
+}
+
+void ChromeTraceWriter::close() {
+  if (!file_.is_open()) {
+    return;
+  }
+  // the metadata event terminates the list without a trailing comma
+  file_ << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+           "\"args\":{\"name\":\"local_planner\"}}\n]\n";
+  file_.close();
+}
+}
@@ -1,10 +1,13 @@
 #include "local_planner/star_planner.h"
 #include "local_planner/common.h"
 #include "local_planner/planner_functions.h"
+#include "local_planner/stage_timer.h"
 #include "local_planner/tree_node.h"
 
 #include <ros/console.h>
 
+#include <algorithm>
+
 namespace avoidance {
 
 StarPlanner::StarPlanner() : tree_age_(0) {}
@@ -19,6 +22,19 @@ void StarPlanner::dynamicReconfigureSetStarParams(
   max_path_length_ = static_cast<float>(config.max_path_length_);
   smoothing_margin_degrees_ =
       static_cast<float>(config.smoothing_margin_degrees_);
+  lazy_cost_matrix_ = config.lazy_cost_matrix_;
+  adaptive_resolution_ = config.adaptive_resolution_;
+  fine_resolution_distance_ =
+      static_cast<float>(config.fine_resolution_distance_);
+  fine_resolution_sector_ = static_cast<float>(config.fine_resolution_sector_);
+  max_tree_reuse_ = config.max_tree_reuse_;
+
+  expansion_batch_size_ = std::max(1, config.tree_expansion_batch_size_);
+}
+
+void StarPlanner::setThreadPool(std::shared_ptr<ThreadPool> pool) {
+  shared_pool_ = static_cast<bool>(pool);
+  expansion_pool_ = std::move(pool);
 }
 
 void StarPlanner::setParams(costParameters cost_params) {
@@ -41,7 +57,17 @@ void StarPlanner::setPose(const Eigen::Vector3f& pos, float curr_yaw) {
 
 void StarPlanner::setCloud(
     const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud) {
-  pointcloud_ = cropped_cloud;
+  pointcloud_ = &cropped_cloud;
+  cloud_voxels_ = nullptr;
+}
+
+void StarPlanner::setCloud(const pcl::PointCloud<pcl::PointXYZ>& cropped_cloud,
+                           const VoxelIndex& cloud_voxels) {
+  pointcloud_ = &cropped_cloud;
+  cloud_voxels_ = &cloud_voxels;
+  if (histogram_batch_.onDevice()) {
+    histogram_batch_.setVoxels(cloud_voxels);
+  }
 }
 
 void StarPlanner::setGoal(const Eigen::Vector3f& goal) {
@@ -49,11 +75,8 @@ void StarPlanner::setGoal(const Eigen::Vector3f& goal) {
   tree_age_ = 1000;
 }
 
-void StarPlanner::setReprojectedPoints(
-    const pcl::PointCloud<pcl::PointXYZ>& reprojected_points,
-    const std::vector<int>& reprojected_points_age) {
-  reprojected_points_ = reprojected_points;
-  reprojected_points_age_ = reprojected_points_age;
+void StarPlanner::setObstacleMemory(const ObstacleMemory& obstacle_memory) {
+  obstacle_memory_ = &obstacle_memory;
 }
 
 float StarPlanner::treeCostFunction(int node_number) {
@@ -115,112 +138,300 @@ float StarPlanner::treeHeuristicFunction(int node_number) {
          (smooth_cost + goal_cost);
 }
 
-void StarPlanner::buildLookAheadTree() {
-  std::clock_t start_time = std::clock();
-  tree_.clear();
-  closed_set_.clear();
+int StarPlanner::addNode(const TreeNode& node) {
+  if (free_nodes_.empty()) {
+    tree_.push_back(node);
+    return static_cast<int>(tree_.size()) - 1;
+  }
+  int index = free_nodes_.back();
+  free_nodes_.pop_back();
+  tree_[index] = node;
+  return index;
+}
 
-  // insert first node
-  tree_.push_back(TreeNode(0, 0, position_));
-  tree_.back().setCosts(treeHeuristicFunction(0), treeHeuristicFunction(0));
-  tree_.back().yaw_ =
-      std::round((-curr_yaw_fcu_frame_ * 180.0f / M_PI_F)) +
-      90.0f;  // from radian to angle and shift reference to y-axis
-  tree_.back().last_z_ = tree_.back().yaw_;
+void StarPlanner::updateNodeCosts(int node_number) {
+  float h = treeHeuristicFunction(node_number);
+  float c = treeCostFunction(node_number);
+  TreeNode& node = tree_[node_number];
+  const TreeNode& origin = tree_[node.origin_];
+  node.heuristic_ = h;
+  node.total_cost_ = origin.total_cost_ - origin.heuristic_ + c + h;
+}
 
-  int origin = 0;
+// yaw of a node reached from origin_position, from radian to angle and
+// shifted to the reference of the y-axis
+static float nodeYaw(const Eigen::Vector3f& origin_position,
+                     const Eigen::Vector3f& node_position) {
+  Eigen::Vector3f diff = node_position - origin_position;
+  float yaw_radians = atan2(diff.y(), diff.x());
+  return std::round((-yaw_radians * 180.0f / M_PI_F)) + 90.0f;
+}
 
-  for (int n = 0; n < n_expanded_nodes_; n++) {
-    Eigen::Vector3f origin_position = tree_[origin].getPosition();
-    int old_origin = tree_[origin].origin_;
-    Eigen::Vector3f origin_origin_position = tree_[old_origin].getPosition();
-    bool hist_is_empty = false;  // unused
-
-    // build new histogram
-    std::vector<int> z_FOV_idx;
-    int e_FOV_min, e_FOV_max;
-    calculateFOV(h_FOV_, v_FOV_, z_FOV_idx, e_FOV_min, e_FOV_max,
-                 tree_[origin].yaw_,
-                 0.0f);  // assume pitch is zero at every node
-
-    Histogram propagated_histogram = Histogram(2 * ALPHA_RES);
-    Histogram histogram = Histogram(ALPHA_RES);
-
-    propagateHistogram(propagated_histogram, reprojected_points_,
-                       reprojected_points_age_, origin_position);
-    generateNewHistogram(histogram, pointcloud_, origin_position);
-    combinedHistogram(hist_is_empty, histogram, propagated_histogram, false,
-                      z_FOV_idx, e_FOV_min, e_FOV_max);
-
-    // calculate candidates
-    Eigen::MatrixXf cost_matrix;
-    std::vector<uint8_t> cost_image_data;
-    std::vector<candidateDirection> candidate_vector;
-    getCostMatrix(histogram, goal_, origin_position, tree_[origin].yaw_,
+void StarPlanner::expandNode(NodeExpansion& expansion) const {
+  const TreeNode& node = tree_[expansion.origin];
+  Eigen::Vector3f origin_position = node.getPosition();
+  bool hist_is_empty = false;  // unused
+
+  // build new histogram
+  calculateFOV(h_FOV_, v_FOV_, expansion.fov, node.yaw_,
+               0.0f);  // assume pitch is zero at every node
+
+  propagateHistogram(expansion.propagated_histogram, *obstacle_memory_,
+                     origin_position, expansion.histogram_workspace);
+  if (!expansion.histogram_built) {
+    expansion.histogram.setZero();
+    if (cloud_voxels_) {
+      generateNewHistogram(expansion.histogram, *cloud_voxels_,
+                           origin_position, expansion.histogram_workspace);
+    } else {
+      generateNewHistogram(expansion.histogram, *pointcloud_, origin_position,
+                           expansion.histogram_workspace);
+    }
+  }
+  combinedHistogram(hist_is_empty, expansion.histogram,
+                    expansion.propagated_histogram, false, expansion.fov);
+  if (adaptive_resolution_) {
+    adaptHistogramResolution(expansion.histogram, origin_position, goal_,
+                             fine_resolution_distance_,
+                             fine_resolution_sector_);
+  }
+
+  // calculate candidates, the cost image is only used for the main
+  // histogram and not generated here
+  if (lazy_cost_matrix_) {
+    getBestCandidatesFromHistogram(
+        expansion.histogram, goal_, origin_position, node.yaw_,
+        projected_last_wp_, cost_params_, smoothing_margin_degrees_,
+        children_per_node_, expansion.cost_workspace, expansion.candidates);
+  } else {
+    getCostMatrix(expansion.histogram, goal_, origin_position, node.yaw_,
                   projected_last_wp_, cost_params_, false,
-                  smoothing_margin_degrees_, cost_matrix, cost_image_data);
-    getBestCandidatesFromCostMatrix(cost_matrix, children_per_node_,
-                                    candidate_vector);
+                  smoothing_margin_degrees_, expansion.cost_matrix,
+                  expansion.cost_workspace, nullptr);
+    getBestCandidatesFromCostMatrix(expansion.cost_matrix, children_per_node_,
+                                    expansion.candidates);
+  }
+}
 
-    // add candidates as nodes
-    if (candidate_vector.empty()) {
-      tree_[origin].total_cost_ = HUGE_VAL;
-    } else {
-      // insert new nodes
-      int depth = tree_[origin].depth_ + 1;
-      int children = 0;
-      for (candidateDirection candidate : candidate_vector) {
-        PolarPoint p_pol(candidate.elevation_angle, candidate.azimuth_angle,
-                         tree_node_distance_);
-
-        // check if another close node has been added
-        Eigen::Vector3f node_location =
-            polarToCartesian(p_pol, origin_position);
-        int close_nodes = 0;
-        for (size_t i = 0; i < tree_.size(); i++) {
-          float dist = (tree_[i].getPosition() - node_location).norm();
-          if (dist < 0.2f) {
-            close_nodes++;
-          }
-        }
+void StarPlanner::addChildren(const NodeExpansion& expansion) {
+  int origin = expansion.origin;
+  Eigen::Vector3f origin_position = tree_[origin].getPosition();
 
-        if (children < children_per_node_ && close_nodes == 0) {
-          tree_.push_back(TreeNode(origin, depth, node_location));
-          tree_.back().last_e_ = p_pol.e;
-          tree_.back().last_z_ = p_pol.z;
-          float h = treeHeuristicFunction(tree_.size() - 1);
-          float c = treeCostFunction(tree_.size() - 1);
-          tree_.back().heuristic_ = h;
-          tree_.back().total_cost_ =
-              tree_[origin].total_cost_ - tree_[origin].heuristic_ + c + h;
-          Eigen::Vector3f diff = node_location - origin_position;
-          float yaw_radians = atan2(diff.y(), diff.x());
-          tree_.back().yaw_ =
-              std::round((-yaw_radians * 180.0f / M_PI_F)) + 90.0f;
-          children++;
+  // add candidates as nodes
+  if (expansion.candidates.empty()) {
+    tree_[origin].total_cost_ = HUGE_VAL;
+  } else {
+    // insert new nodes
+    int depth = tree_[origin].depth_ + 1;
+    int children = 0;
+    for (const candidateDirection& candidate : expansion.candidates) {
+      PolarPoint p_pol(candidate.elevation_angle, candidate.azimuth_angle,
+                       tree_node_distance_);
+
+      // check if another close node has been added
+      Eigen::Vector3f node_location = polarToCartesian(p_pol, origin_position);
+      int close_nodes = 0;
+      for (size_t i = 0; i < tree_.size(); i++) {
+        if (tree_[i].free_) continue;
+        float dist = (tree_[i].getPosition() - node_location).norm();
+        if (dist < 0.2f) {
+          close_nodes++;
         }
       }
+
+      if (children < children_per_node_ && close_nodes == 0) {
+        int index = addNode(TreeNode(origin, depth, node_location));
+        tree_[index].last_e_ = p_pol.e;
+        tree_[index].last_z_ = p_pol.z;
+        updateNodeCosts(index);
+        tree_[index].yaw_ = nodeYaw(origin_position, node_location);
+        children++;
+      }
     }
+  }
 
-    closed_set_.push_back(origin);
+  tree_[origin].closed_ = true;
+  closed_set_.push_back(origin);
+}
 
-    // find best node to continue
-    float minimal_cost = HUGE_VAL;
-    for (size_t i = 0; i < tree_.size(); i++) {
-      bool closed = false;
-      for (size_t j = 0; j < closed_set_.size(); j++) {
-        if (closed_set_[j] == (int)i) {
-          closed = true;
-        }
+void StarPlanner::selectOpenNodes(size_t max_nodes, std::vector<int>& nodes) {
+  open_nodes_.clear();
+  for (size_t i = 0; i < tree_.size(); i++) {
+    if (tree_[i].free_ || tree_[i].closed_) continue;
+    float node_distance = (tree_[i].getPosition() - position_).norm();
+    if (tree_[i].total_cost_ < HUGE_VAL && node_distance < max_path_length_) {
+      open_nodes_.push_back(static_cast<int>(i));
+    }
+  }
+
+  size_t n = std::min(max_nodes, open_nodes_.size());
+  std::partial_sort(open_nodes_.begin(), open_nodes_.begin() + n,
+                    open_nodes_.end(), [this](int a, int b) {
+                      return tree_[a].total_cost_ < tree_[b].total_cost_ ||
+                             (tree_[a].total_cost_ == tree_[b].total_cost_ &&
+                              a < b);
+                    });
+  nodes.assign(open_nodes_.begin(), open_nodes_.begin() + n);
+}
+
+bool StarPlanner::reRootTree() {
+  kept_nodes_.clear();
+  // tree_age_ is 1 if the tree was built in the previous planner cycle, a new
+  // goal sets it to 1000
+  if (tree_reuse_count_ >= max_tree_reuse_ || tree_.empty() || tree_age_ > 1) {
+    tree_reuse_count_ = 0;
+    return false;
+  }
+
+  // expanded child of the root closest to the vehicle
+  int branch = -1;
+  float branch_distance = HUGE_VAL;
+  for (size_t i = 1; i < tree_.size(); i++) {
+    const TreeNode& node = tree_[i];
+    if (!node.free_ && node.closed_ && node.origin_ == 0) {
+      float distance = (node.getPosition() - position_).norm();
+      if (distance < branch_distance) {
+        branch = static_cast<int>(i);
+        branch_distance = distance;
+      }
+    }
+  }
+  if (branch < 0 || branch_distance > tree_node_distance_) {
+    tree_reuse_count_ = 0;
+    return false;
+  }
+
+  // keep the nodes of the branch and free the others, the root slot is
+  // reused by the new root
+  for (size_t i = 1; i < tree_.size(); i++) {
+    if (tree_[i].free_) continue;
+    int ancestor = static_cast<int>(i);
+    while (ancestor != branch && ancestor != 0) {
+      ancestor = tree_[ancestor].origin_;
+    }
+    if (ancestor == branch) {
+      kept_nodes_.push_back(static_cast<int>(i));
+    } else {
+      tree_[i].free_ = true;
+      free_nodes_.push_back(static_cast<int>(i));
+    }
+  }
+  closed_set_.erase(std::remove_if(closed_set_.begin(), closed_set_.end(),
+                                   [this](int i) {
+                                     return i == 0 || tree_[i].free_;
+                                   }),
+                    closed_set_.end());
+
+  // the costs are updated from the root downwards
+  std::sort(kept_nodes_.begin(), kept_nodes_.end(), [this](int a, int b) {
+    return tree_[a].depth_ < tree_[b].depth_ ||
+           (tree_[a].depth_ == tree_[b].depth_ && a < b);
+  });
+  tree_reuse_count_++;
+  return true;
+}
+
+void StarPlanner::buildLookAheadTree() {
+  if (!pointcloud_ || !obstacle_memory_) {
+    ROS_WARN("\033[0;35m[SP] No pointcloud set, cannot build tree.\033[0m");
+    return;
+  }
+  ScopedStageTimer timer(PlannerStage::treeBuild);
+
+  // the thread building the tree takes part in the expansion, so a batch of
+  // K nodes needs K - 1 workers. They are started here and not by the
+  // reconfigure thread so that they inherit the profile of the planner thread
+  size_t n_workers = static_cast<size_t>(expansion_batch_size_ - 1);
+  if (shared_pool_) {
+    // the shared pool serves the expansion
+  } else if (n_workers == 0) {
+    expansion_pool_.reset();
+  } else if (!expansion_pool_ || expansion_pool_->size() != n_workers) {
+    expansion_pool_.reset(new ThreadPool(n_workers));
+  }
+
+  if (!reRootTree()) {
+    tree_.clear();
+    free_nodes_.clear();
+    closed_set_.clear();
+    tree_.resize(1);
+  }
+
+  // insert first node
+  tree_[0] = TreeNode(0, 0, position_);
+  tree_[0].setCosts(treeHeuristicFunction(0), treeHeuristicFunction(0));
+  tree_[0].yaw_ =
+      std::round((-curr_yaw_fcu_frame_ * 180.0f / M_PI_F)) +
+      90.0f;  // from radian to angle and shift reference to y-axis
+  tree_[0].last_z_ = tree_[0].yaw_;
+
+  // a kept branch now starts at the new root
+  for (int index : kept_nodes_) {
+    TreeNode& node = tree_[index];
+    if (node.origin_ == 0) {
+      PolarPoint p_pol = cartesianToPolar(node.getPosition(), position_);
+      node.last_e_ = p_pol.e;
+      node.last_z_ = p_pol.z;
+      node.yaw_ = nodeYaw(position_, node.getPosition());
+    }
+    updateNodeCosts(index);
+  }
+
+  // the expanded nodes of a kept branch count against the budget, the new
+  // root is always expanded with the current cloud
+  int origin = 0;
+  int n_expanded = std::max(
+      0, std::min(static_cast<int>(closed_set_.size()), n_expanded_nodes_ - 1));
+  expansion_batch_.assign(1, origin);
+
+  while (n_expanded < n_expanded_nodes_) {
+    size_t batch_size = expansion_batch_.size();
+    if (expansions_.size() < batch_size) {
+      expansions_.resize(batch_size);
+    }
+    for (size_t i = 0; i < batch_size; i++) {
+      expansions_[i].origin = expansion_batch_[i];
+      expansions_[i].histogram_built = false;
+    }
+
+    // the histograms of the whole batch are binned in one kernel launch
+    if (cloud_voxels_ && histogram_batch_.onDevice()) {
+      batch_origins_.resize(batch_size);
+      batch_histograms_.resize(batch_size);
+      for (size_t i = 0; i < batch_size; i++) {
+        batch_origins_[i] = tree_[expansion_batch_[i]].getPosition();
+        batch_histograms_[i] = &expansions_[i].histogram;
+        expansions_[i].histogram.setZero();
+        expansions_[i].histogram_built = true;
       }
+      histogram_batch_.build(batch_origins_, batch_histograms_);
+    }
 
-      float node_distance = (tree_[i].getPosition() - position_).norm();
-      if (tree_[i].total_cost_ < minimal_cost && !closed &&
-          node_distance < max_path_length_) {
-        minimal_cost = tree_[i].total_cost_;
-        origin = i;
+    if (expansion_pool_ && batch_size > 1) {
+      expansion_pool_->parallelFor(
+          batch_size, [this](size_t i) { expandNode(expansions_[i]); });
+    } else {
+      for (size_t i = 0; i < batch_size; i++) {
+        expandNode(expansions_[i]);
       }
     }
+
+    // the batch is sorted by cost, inserting the children in this order keeps
+    // the tree independent of which expansion finished first
+    for (size_t i = 0; i < batch_size; i++) {
+      addChildren(expansions_[i]);
+    }
+    n_expanded += static_cast<int>(batch_size);
+
+    // find best nodes to continue, never expand more than n_expanded_nodes_
+    int remaining = n_expanded_nodes_ - n_expanded;
+    int next_batch_size =
+        std::max(1, std::min(expansion_batch_size_, remaining));
+    selectOpenNodes(static_cast<size_t>(next_batch_size), expansion_batch_);
+    if (expansion_batch_.empty()) {
+      expansion_batch_.assign(1, origin);
+    }
+    origin = expansion_batch_.front();
   }
   // smoothing between trees
   int tree_end = origin;
@@ -238,9 +449,9 @@ void StarPlanner::buildLookAheadTree() {
   ROS_INFO(
       "\033[0;35m[SP]Tree (%.0f nodes, %.0f path nodes, %.0f expanded) "
       "calculated in %2.2fms.\033[0m",
-      (double)tree_.size(), (double)path_node_positions_.size(),
+      (double)numberOfNodes(), (double)path_node_positions_.size(),
       (double)closed_set_.size(),
-      (std::clock() - start_time) / (double)(CLOCKS_PER_SEC / 1000));
+      timer.elapsedMs());
   for (int j = 0; j < path_node_positions_.size(); j++) {
     ROS_DEBUG("\033[0;35m[SP] node %.0f : [ %f, %f, %f]\033[0m", (double)j,
               (double)path_node_positions_[j].x(),
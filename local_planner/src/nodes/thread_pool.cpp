@@ -0,0 +1,95 @@
+#include "local_planner/thread_pool.h"
+
+#include "local_planner/stage_timer.h"
+
+#include <algorithm>
+
+namespace avoidance {
+
+ThreadPool::ThreadPool(size_t n_threads) {
+  n_threads = std::max<size_t>(1, n_threads);
+  workers_.reserve(n_threads);
+  for (size_t i = 0; i < n_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  task_cv_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::parallelFor(size_t n, const std::function<void(size_t)>& fn) {
+  if (n == 0) {
+    return;
+  }
+  // a single item is not worth the handover to a worker
+  if (n == 1) {
+    fn(0);
+    return;
+  }
+
+  Batch batch = {n};
+  StageTimings* timings = &StageTimings::instance();
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < n; ++i) {
+    tasks_.push_back(Task{[&fn, i]() { fn(i); }, &batch, timings});
+  }
+  task_cv_.notify_all();
+
+  // the calling thread takes its own items from the queue as well instead of
+  // idling, the tasks of other callers may take much longer
+  while (true) {
+    auto own = std::find_if(
+        tasks_.begin(), tasks_.end(),
+        [&batch](const Task& task) { return task.batch == &batch; });
+    if (own == tasks_.end()) {
+      break;
+    }
+    Task task = std::move(*own);
+    tasks_.erase(own);
+    run(task, lock);
+  }
+  done_cv_.wait(lock, [&batch] { return batch.pending == 0; });
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(
+        Task{std::move(task), nullptr, &StageTimings::instance()});
+  }
+  task_cv_.notify_one();
+}
+
+void ThreadPool::run(Task& task, std::unique_lock<std::mutex>& lock) {
+  lock.unlock();
+  {
+    ScopedStageTimings scope(*task.timings);
+    task.fn();
+  }
+  lock.lock();
+  if (task.batch && --task.batch->pending == 0) {
+    done_cv_.notify_all();
+  }
+}
+
+void ThreadPool::workerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    task_cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+    if (stop_ && tasks_.empty()) {
+      return;
+    }
+    Task task = std::move(tasks_.front());
+    tasks_.pop_front();
+    run(task, lock);
+  }
+}
+}
@@ -9,7 +9,9 @@ TreeNode::TreeNode()
       last_z_{0.0f},
       origin_{0},
       depth_{0},
-      yaw_{0.0f} {
+      yaw_{0.0f},
+      closed_{false},
+      free_{false} {
   position_ = Eigen::Vector3f::Zero();
 }
 
@@ -20,7 +22,9 @@ TreeNode::TreeNode(int from, int d, const Eigen::Vector3f& pos)
       last_z_{0.0f},
       origin_{from},
       depth_{d},
-      yaw_{0.0f} {
+      yaw_{0.0f},
+      closed_{false},
+      free_{false} {
   position_ = pos;
 }
 
@@ -29,5 +33,5 @@ void TreeNode::setCosts(float h, float c) {
   total_cost_ = c;
 }
 
-Eigen::Vector3f TreeNode::getPosition() { return position_; }
+Eigen::Vector3f TreeNode::getPosition() const { return position_; }
 }
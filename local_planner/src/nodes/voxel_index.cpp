@@ -0,0 +1,73 @@
+#include "local_planner/voxel_index.h"
+
+#include <cmath>
+
+namespace avoidance {
+
+void VoxelIndex::clear() {
+  x_.clear();
+  y_.clear();
+  z_.clear();
+  count_.clear();
+  keys_.clear();
+}
+
+void VoxelIndex::build(const pcl::PointCloud<pcl::PointXYZ>& cloud,
+                       float voxel_size) {
+  clear();
+  voxel_size_ = voxel_size;
+
+  if (voxel_size <= 0.f) {
+    for (const pcl::PointXYZ& p : cloud) {
+      if (std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z)) {
+        x_.push_back(p.x);
+        y_.push_back(p.y);
+        z_.push_back(p.z);
+        count_.push_back(1);
+      }
+    }
+    return;
+  }
+
+  // keep the load factor below one half
+  size_t n_slots = 16;
+  while (n_slots < 2 * cloud.size()) {
+    n_slots <<= 1;
+  }
+  slots_.assign(n_slots, -1);
+  const size_t slot_mask = n_slots - 1;
+  const float inv_size = 1.f / voxel_size;
+
+  for (const pcl::PointXYZ& p : cloud) {
+    if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) {
+      continue;
+    }
+    uint64_t key = voxelKey(p.x, p.y, p.z, inv_size);
+    size_t slot = hashVoxelKey(key) & slot_mask;
+    while (slots_[slot] >= 0 && keys_[slots_[slot]] != key) {
+      slot = (slot + 1) & slot_mask;
+    }
+
+    if (slots_[slot] < 0) {
+      slots_[slot] = static_cast<int>(keys_.size());
+      keys_.push_back(key);
+      x_.push_back(0.f);
+      y_.push_back(0.f);
+      z_.push_back(0.f);
+      count_.push_back(0);
+    }
+    int voxel = slots_[slot];
+    x_[voxel] += p.x;
+    y_[voxel] += p.y;
+    z_[voxel] += p.z;
+    count_[voxel]++;
+  }
+
+  for (size_t i = 0; i < count_.size(); i++) {
+    float inv_count = 1.f / static_cast<float>(count_[i]);
+    x_[i] *= inv_count;
+    y_[i] *= inv_count;
+    z_[i] *= inv_count;
+  }
+}
+}
@@ -377,6 +377,25 @@ TEST(Common, IndexPolarIndex) {
   }
 }
 
+TEST(Common, binCentersMatchPolarToCartesian) {
+  // GIVEN: the bin centre table of the histogram resolution
+  const BinCenters<ALPHA_RES>& bins = BinCenters<ALPHA_RES>::instance();
+  Eigen::Vector3f origin(0.f, 0.f, 0.f);
+
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      // WHEN: we convert the bin centre to a unit vector
+      PolarPoint p_pol = histogramIndexToPolar(e, z, ALPHA_RES, 1.f);
+      Eigen::Vector3f expected = polarToCartesian(p_pol, origin);
+
+      // THEN: the table gives exactly the same direction
+      EXPECT_EQ(expected.x(), bins.direction(e, z).x());
+      EXPECT_EQ(expected.y(), bins.direction(e, z).y());
+      EXPECT_EQ(expected.z(), bins.direction(e, z).z());
+    }
+  }
+}
+
 TEST(Common, wrapPolar) {
   // GIVEN: some polar points with elevation and azimuth angles which need to be
   // wrapped
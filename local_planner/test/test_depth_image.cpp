@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/depth_image.h"
+
+#include <sensor_msgs/image_encodings.h>
+
+using namespace avoidance;
+
+namespace {
+
+sensor_msgs::CameraInfo cameraInfo(uint32_t width, uint32_t height, double f,
+                                   double cx, double cy) {
+  sensor_msgs::CameraInfo info;
+  info.width = width;
+  info.height = height;
+  info.K = {f, 0.0, cx, 0.0, f, cy, 0.0, 0.0, 1.0};
+  info.P = {f, 0.0, cx, 0.0, 0.0, f, cy, 0.0, 0.0, 0.0, 1.0, 0.0};
+  return info;
+}
+
+}  // namespace
+
+TEST(DepthImage, raysOfTheIntrinsics) {
+  // GIVEN: a 4x3 camera with the principal point in the middle
+  sensor_msgs::CameraInfo info = cameraInfo(4, 3, 2.0, 1.5, 1.0);
+
+  // WHEN: we build the rays
+  DepthRays rays;
+  ASSERT_TRUE(rays.update(info));
+
+  // THEN: we expect one entry per column and row, zero at the principal point
+  ASSERT_EQ(4u, rays.x().size());
+  ASSERT_EQ(3u, rays.y().size());
+  EXPECT_FLOAT_EQ(-0.75f, rays.x()[0]);
+  EXPECT_FLOAT_EQ(0.75f, rays.x()[3]);
+  EXPECT_FLOAT_EQ(-0.5f, rays.y()[0]);
+  EXPECT_FLOAT_EQ(0.f, rays.y()[1]);
+
+  // and the same info to match, but not a different size or focal length
+  EXPECT_TRUE(rays.matches(info));
+  EXPECT_FALSE(rays.matches(cameraInfo(8, 3, 2.0, 1.5, 1.0)));
+  EXPECT_FALSE(rays.matches(cameraInfo(4, 3, 3.0, 1.5, 1.0)));
+
+  sensor_msgs::Image image;
+  image.width = 4;
+  image.height = 3;
+  EXPECT_TRUE(rays.fits(image));
+  image.height = 4;
+  EXPECT_FALSE(rays.fits(image));
+}
+
+TEST(DepthImage, projectionBeforeCameraMatrix) {
+  // GIVEN: a camera matrix which differs from the projection of the
+  // rectified image, and one without any intrinsics
+  sensor_msgs::CameraInfo info = cameraInfo(2, 2, 2.0, 0.5, 0.5);
+  info.K[0] = 4.0;
+  sensor_msgs::CameraInfo uncalibrated = cameraInfo(2, 2, 0.0, 0.5, 0.5);
+
+  // WHEN: we build the rays
+  DepthRays rays;
+  DepthRays uncalibrated_rays;
+  bool valid = rays.update(info);
+  bool uncalibrated_valid = uncalibrated_rays.update(uncalibrated);
+
+  // THEN: we expect the projection to be used and no rays without intrinsics
+  EXPECT_TRUE(valid);
+  EXPECT_FLOAT_EQ(0.25f, rays.x()[1]);
+  EXPECT_FALSE(uncalibrated_valid);
+  EXPECT_TRUE(uncalibrated_rays.empty());
+  EXPECT_FALSE(uncalibrated_rays.matches(uncalibrated));
+}
+
+TEST(DepthImage, depthImageScale) {
+  float scale = 0.f;
+  EXPECT_TRUE(
+      depthImageScale(sensor_msgs::image_encodings::TYPE_16UC1, scale));
+  EXPECT_FLOAT_EQ(0.001f, scale);
+  EXPECT_TRUE(
+      depthImageScale(sensor_msgs::image_encodings::TYPE_32FC1, scale));
+  EXPECT_FLOAT_EQ(1.f, scale);
+  EXPECT_FALSE(depthImageScale(sensor_msgs::image_encodings::MONO8, scale));
+}
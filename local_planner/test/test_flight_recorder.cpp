@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/flight_recorder.h"
+
+#include <unistd.h>
+#include <cstdio>
+#include <string>
+
+using namespace avoidance;
+
+class FlightRecorderTests : public ::testing::Test {
+ public:
+  std::string path;
+  FlightFrame frame;
+
+  void SetUp() override {
+    path = "/tmp/test_flight_recorder_" + std::to_string(getpid());
+    std::remove(path.c_str());
+
+    frame.stamp = 12.5;
+    frame.position = Eigen::Vector3f(1.f, 2.f, 3.f);
+    frame.velocity = Eigen::Vector3f(0.5f, 0.f, -0.1f);
+    frame.goal = Eigen::Vector3f(10.f, 5.f, 3.f);
+    frame.last_sent_waypoint = Eigen::Vector3f(1.5f, 2.f, 3.f);
+    frame.yaw = 0.3f;
+    frame.pitch = -0.05f;
+    frame.ground_distance = 2.5f;
+    frame.h_fov = 59.f;
+    frame.v_fov = 46.f;
+    frame.armed = true;
+    frame.offboard = false;
+    frame.mission = true;
+    frame.waypoint_type = tryPath;
+    frame.histogram_resolution = 6;
+    frame.histogram.push_back(RecordedCell{10, 350});
+    frame.histogram.push_back(RecordedCell{11, 420});
+    frame.candidates.emplace_back(1.5f, 0.f, 12.f);
+    frame.candidates.emplace_back(2.5f, 6.f, 18.f);
+    for (int i = 0; i < 100; i++) {
+      frame.cloud.push_back(pcl::PointXYZ(3.f, 0.01f * i, -0.02f * i));
+    }
+    for (size_t i = 0; i < frame.stage_ms.size(); i++) {
+      frame.stage_ms[i] = 0.1f * i;
+    }
+  }
+
+  void TearDown() override { std::remove(path.c_str()); }
+
+  void expectEqual(const FlightFrame& expected, const FlightFrame& actual) {
+    EXPECT_DOUBLE_EQ(expected.stamp, actual.stamp);
+    EXPECT_EQ(expected.position, actual.position);
+    EXPECT_EQ(expected.velocity, actual.velocity);
+    EXPECT_EQ(expected.goal, actual.goal);
+    EXPECT_EQ(expected.last_sent_waypoint, actual.last_sent_waypoint);
+    EXPECT_EQ(expected.yaw, actual.yaw);
+    EXPECT_EQ(expected.pitch, actual.pitch);
+    EXPECT_EQ(expected.ground_distance, actual.ground_distance);
+    EXPECT_EQ(expected.h_fov, actual.h_fov);
+    EXPECT_EQ(expected.v_fov, actual.v_fov);
+    EXPECT_EQ(expected.armed, actual.armed);
+    EXPECT_EQ(expected.offboard, actual.offboard);
+    EXPECT_EQ(expected.mission, actual.mission);
+    EXPECT_EQ(expected.waypoint_type, actual.waypoint_type);
+    EXPECT_EQ(expected.histogram_resolution, actual.histogram_resolution);
+    ASSERT_EQ(expected.histogram.size(), actual.histogram.size());
+    for (size_t i = 0; i < expected.histogram.size(); i++) {
+      EXPECT_EQ(expected.histogram[i].index, actual.histogram[i].index);
+      EXPECT_EQ(expected.histogram[i].distance_cm,
+                actual.histogram[i].distance_cm);
+    }
+    ASSERT_EQ(expected.candidates.size(), actual.candidates.size());
+    for (size_t i = 0; i < expected.candidates.size(); i++) {
+      EXPECT_EQ(expected.candidates[i].cost, actual.candidates[i].cost);
+      EXPECT_EQ(expected.candidates[i].elevation_angle,
+                actual.candidates[i].elevation_angle);
+      EXPECT_EQ(expected.candidates[i].azimuth_angle,
+                actual.candidates[i].azimuth_angle);
+    }
+    ASSERT_EQ(expected.cloud.size(), actual.cloud.size());
+    for (size_t i = 0; i < expected.cloud.size(); i++) {
+      EXPECT_EQ(expected.cloud.points[i].x, actual.cloud.points[i].x);
+      EXPECT_EQ(expected.cloud.points[i].y, actual.cloud.points[i].y);
+      EXPECT_EQ(expected.cloud.points[i].z, actual.cloud.points[i].z);
+    }
+    EXPECT_EQ(expected.stage_ms, actual.stage_ms);
+  }
+};
+
+TEST_F(FlightRecorderTests, readAfterWrite) {
+  // GIVEN: a recorder with one frame
+  FlightRecorder recorder;
+  ASSERT_TRUE(recorder.open(path, 4, 8 * 1024));
+  ASSERT_TRUE(recorder.write(frame));
+
+  // WHEN: we read the recording while it is still open
+  std::vector<FlightFrame> frames;
+  ASSERT_TRUE(readFlightRecording(path, frames));
+
+  // THEN: the frame is complete
+  ASSERT_EQ(1u, frames.size());
+  expectEqual(frame, frames[0]);
+  EXPECT_EQ(0u, recorder.truncatedFrames());
+}
+
+TEST_F(FlightRecorderTests, ringKeepsNewestFrames) {
+  // GIVEN: a ring of three frames
+  FlightRecorder recorder;
+  ASSERT_TRUE(recorder.open(path, 3, 8 * 1024));
+  for (int i = 0; i < 5; i++) {
+    frame.stamp = i;
+    ASSERT_TRUE(recorder.write(frame));
+  }
+
+  // WHEN: the node is restarted and writes one more frame
+  recorder.close();
+  ASSERT_TRUE(recorder.open(path, 3, 8 * 1024));
+  frame.stamp = 5;
+  ASSERT_TRUE(recorder.write(frame));
+
+  // THEN: the three newest frames are read, from the oldest to the newest
+  std::vector<FlightFrame> frames;
+  ASSERT_TRUE(readFlightRecording(path, frames));
+  ASSERT_EQ(3u, frames.size());
+  EXPECT_DOUBLE_EQ(3.0, frames[0].stamp);
+  EXPECT_DOUBLE_EQ(4.0, frames[1].stamp);
+  EXPECT_DOUBLE_EQ(5.0, frames[2].stamp);
+
+  // THEN: a recorder of another size starts over
+  ASSERT_TRUE(recorder.open(path, 4, 8 * 1024));
+  ASSERT_TRUE(readFlightRecording(path, frames));
+  EXPECT_TRUE(frames.empty());
+}
+
+TEST_F(FlightRecorderTests, tornWriteIsSkipped) {
+  // GIVEN: a recording of two frames
+  FlightRecorder recorder;
+  ASSERT_TRUE(recorder.open(path, 2, 8 * 1024));
+  ASSERT_TRUE(recorder.write(frame));
+  FlightFrame newer = frame;
+  newer.stamp = 13.5;
+  ASSERT_TRUE(recorder.write(newer));
+  recorder.close();
+
+  // WHEN: the points of the newer one are corrupted. The first frame has
+  // sequence one and goes to the second slot, so the newer one is first
+  FILE* f = std::fopen(path.c_str(), "r+b");
+  ASSERT_TRUE(f != nullptr);
+  std::fseek(f, 1000, SEEK_SET);
+  std::fputc(0x5a, f);
+  std::fclose(f);
+
+  // THEN: only the older frame is read
+  std::vector<FlightFrame> frames;
+  ASSERT_TRUE(readFlightRecording(path, frames));
+  ASSERT_EQ(1u, frames.size());
+  expectEqual(frame, frames[0]);
+
+  // THEN: a missing recording is rejected
+  EXPECT_FALSE(readFlightRecording(path + "_missing", frames));
+}
+
+TEST_F(FlightRecorderTests, truncatesLargeClouds) {
+  // GIVEN: frames with room for fewer points than the cloud has
+  FlightRecorder recorder;
+  ASSERT_TRUE(recorder.open(path, 2, 1024));
+
+  // WHEN: the frame is written
+  ASSERT_TRUE(recorder.write(frame));
+
+  // THEN: the histogram and the candidates are kept, the cloud is cut
+  std::vector<FlightFrame> frames;
+  ASSERT_TRUE(readFlightRecording(path, frames));
+  ASSERT_EQ(1u, frames.size());
+  EXPECT_EQ(frame.histogram.size(), frames[0].histogram.size());
+  EXPECT_EQ(frame.candidates.size(), frames[0].candidates.size());
+  EXPECT_GT(frames[0].cloud.size(), 0u);
+  EXPECT_LT(frames[0].cloud.size(), frame.cloud.size());
+  EXPECT_EQ(1u, recorder.truncatedFrames());
+}
+
+TEST_F(FlightRecorderTests, pointCapacityOfFrame) {
+  // GIVEN: frames with room for fewer points than the cloud has
+  FlightRecorder recorder;
+  ASSERT_TRUE(recorder.open(path, 2, 1024));
+  const size_t max_points =
+      recorder.pointCapacity(frame.histogram.size(), frame.candidates.size());
+  ASSERT_LT(max_points, frame.cloud.size());
+
+  // WHEN: a cloud of exactly that many points is written
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.points.assign(frame.cloud.points.begin(),
+                      frame.cloud.points.begin() + max_points);
+  ASSERT_TRUE(recorder.write(frame, frame.candidates, cloud));
+
+  // THEN: the frame is complete, one more point would not fit
+  std::vector<FlightFrame> frames;
+  ASSERT_TRUE(readFlightRecording(path, frames));
+  ASSERT_EQ(1u, frames.size());
+  EXPECT_EQ(max_points, frames[0].cloud.size());
+  EXPECT_EQ(0u, recorder.truncatedFrames());
+  EXPECT_EQ(0u, recorder.pointCapacity(1024, 0));
+}
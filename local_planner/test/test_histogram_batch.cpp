@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/histogram_batch.h"
+#include "../include/local_planner/planner_functions.h"
+#include "../include/local_planner/voxel_index.h"
+
+#include <vector>
+
+using namespace avoidance;
+
+TEST(HistogramBatch, matchesSingleHistograms) {
+  // GIVEN: two walls and the voxel index of their points, also a few origins
+  // as they appear in one expansion batch of the tree
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float x = -2.f; x < 2.f; x += 0.02f) {
+    for (float z = 2.f; z < 6.f; z += 0.02f) {
+      cloud.push_back(pcl::PointXYZ(x, 3.f, z));
+      cloud.push_back(pcl::PointXYZ(-3.f, x, z));
+    }
+  }
+  VoxelIndex voxels;
+  voxels.build(cloud, 0.1f);
+  std::vector<Eigen::Vector3f> origins = {
+      Eigen::Vector3f(0.f, 0.f, 4.f), Eigen::Vector3f(0.7f, 1.f, 4.2f),
+      Eigen::Vector3f(-1.f, 0.5f, 3.5f), Eigen::Vector3f(0.f, -1.f, 5.f)};
+
+  // WHEN: we build the histograms of all origins in one batch
+  HistogramBatch batch;
+  batch.setVoxels(voxels);
+  std::vector<Histogram<ALPHA_RES>> histograms(origins.size());
+  std::vector<Histogram<ALPHA_RES>*> outputs;
+  for (Histogram<ALPHA_RES>& histogram : histograms) {
+    outputs.push_back(&histogram);
+  }
+  batch.build(origins, outputs);
+
+  // THEN: every histogram should match the one of its origin alone, up to the
+  // summation order of the device
+  HistogramWorkspace workspace;
+  for (size_t i = 0; i < origins.size(); i++) {
+    Histogram<ALPHA_RES> expected;
+    generateNewHistogram(expected, voxels, origins[i], workspace);
+    int occupied = 0;
+    for (int e = 0; e < GRID_LENGTH_E; e++) {
+      for (int z = 0; z < GRID_LENGTH_Z; z++) {
+        EXPECT_NEAR(expected.get_dist(e, z), histograms[i].get_dist(e, z),
+                    1e-3f);
+        EXPECT_EQ(0, histograms[i].get_age(e, z));
+        occupied += histograms[i].get_dist(e, z) > 0.f;
+      }
+    }
+    EXPECT_GT(occupied, 0);
+  }
+}
+
+TEST(HistogramBatch, emptyVoxels) {
+  // GIVEN: an empty voxel index
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  VoxelIndex voxels;
+  voxels.build(cloud, 0.1f);
+  HistogramBatch batch;
+  batch.setVoxels(voxels);
+
+  // WHEN: we build the histograms of two origins into histograms that were
+  // used before
+  std::vector<Eigen::Vector3f> origins = {Eigen::Vector3f(0.f, 0.f, 0.f),
+                                          Eigen::Vector3f(1.f, 0.f, 0.f)};
+  std::vector<Histogram<ALPHA_RES>> histograms(origins.size());
+  std::vector<Histogram<ALPHA_RES>*> outputs;
+  for (Histogram<ALPHA_RES>& histogram : histograms) {
+    histogram.set_dist(3, 4, 2.f);
+    outputs.push_back(&histogram);
+  }
+  batch.build(origins, outputs);
+
+  // THEN: all bins should be empty
+  for (const Histogram<ALPHA_RES>& histogram : histograms) {
+    for (int e = 0; e < GRID_LENGTH_E; e++) {
+      for (int z = 0; z < GRID_LENGTH_Z; z++) {
+        EXPECT_FLOAT_EQ(0.f, histogram.get_dist(e, z));
+      }
+    }
+  }
+}
@@ -1,6 +1,10 @@
 #include <gtest/gtest.h>
 
+#include <unistd.h>
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <string>
 
 #include "../include/local_planner/common.h"
 #include "../include/local_planner/local_planner.h"
@@ -115,6 +119,52 @@ TEST_F(LocalPlannerTests, all_obstacles) {
   EXPECT_TRUE(steer_clear);
 }
 
+TEST_F(LocalPlannerTests, obstacleDistanceWithoutPlanning) {
+  // GIVEN: a local planner and a scan with an obstacle in front
+  float distance = 2.f;
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float y = -0.5f; y <= 0.5f; y += 0.01f) {
+    for (float z = -1.f; z <= 1.f; z += 0.1f) {
+      cloud.push_back(pcl::PointXYZ(distance, y, z + 30.f));
+    }
+  }
+  planner.complete_cloud_.push_back(cloud);
+
+  // WHEN: only the obstacle distance is updated
+  planner.runObstacleDistance();
+
+  // THEN: the scan shows the obstacle ahead but nothing was planned
+  sensor_msgs::LaserScan scan;
+  planner.sendObstacleDistanceDataToFcu(scan);
+  ASSERT_EQ(GRID_LENGTH_Z, scan.ranges.size());
+  EXPECT_LT(*std::min_element(scan.ranges.begin(), scan.ranges.end()),
+            distance * 1.5f);
+  EXPECT_FALSE(planner.getAvoidanceOutput().obstacle_ahead);
+
+  // WHEN: it is updated again into the same message
+  const float* ranges = scan.ranges.data();
+  planner.runObstacleDistance();
+  planner.sendObstacleDistanceDataToFcu(scan);
+
+  // THEN: the storage of the message is reused
+  EXPECT_EQ(ranges, scan.ranges.data());
+  EXPECT_LT(*std::min_element(scan.ranges.begin(), scan.ranges.end()),
+            distance * 1.5f);
+
+  // WHEN: the planner ran and the obstacle distance is updated without clouds
+  planner.runPlanner();
+  pcl::PointCloud<pcl::PointXYZ> planned_cloud, reprojected_points;
+  planner.getCloudsForVisualization(planned_cloud, reprojected_points, false);
+  planner.complete_cloud_.clear();
+  planner.runObstacleDistance();
+
+  // THEN: the cloud of the planner iteration is kept
+  pcl::PointCloud<pcl::PointXYZ> kept_cloud;
+  planner.getCloudsForVisualization(kept_cloud, reprojected_points, false);
+  EXPECT_GT(planned_cloud.size(), 0u);
+  EXPECT_EQ(planned_cloud.size(), kept_cloud.size());
+}
+
 TEST_F(LocalPlannerTests, obstacles_right) {
   // GIVEN: a local planner, a scan with obstacles on the right, pose and goal
   float shift = -0.5f;
@@ -208,3 +258,162 @@ TEST_F(LocalPlannerTests, obstacles_left) {
   }
   EXPECT_LT(node_min_y, min_y);
 }
+
+TEST_F(LocalPlannerTests, imagesOnlyWhenRequested) {
+  // GIVEN: a local planner with an obstacle in front which is not asked for
+  // the debug images
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float y = -1.f; y <= 1.f; y += 0.01f) {
+    for (float z = -1.f; z <= 1.f; z += 0.1f) {
+      cloud.push_back(pcl::PointXYZ(2.f, y, z + 30.f));
+    }
+  }
+  planner.generate_cost_image_ = false;
+  planner.generate_histogram_image_ = false;
+
+  // WHEN: we run the local planner twice
+  for (int i = 0; i < 2; i++) {
+    planner.complete_cloud_.clear();
+    planner.complete_cloud_.push_back(cloud);
+    planner.runPlanner();
+  }
+
+  // THEN: the obstacle should be avoided without generating the images
+  EXPECT_TRUE(planner.getAvoidanceOutput().obstacle_ahead);
+  EXPECT_TRUE(planner.cost_image_data_.empty());
+  EXPECT_TRUE(planner.histogram_image_data_.empty());
+
+  // WHEN: the images are requested
+  planner.generate_cost_image_ = true;
+  planner.generate_histogram_image_ = true;
+  planner.complete_cloud_.clear();
+  planner.complete_cloud_.push_back(cloud);
+  planner.runPlanner();
+
+  // THEN: they should be there
+  EXPECT_EQ(3 * GRID_LENGTH_E * GRID_LENGTH_Z, planner.cost_image_data_.size());
+  EXPECT_EQ(GRID_LENGTH_E * GRID_LENGTH_Z,
+            planner.histogram_image_data_.size());
+}
+
+TEST_F(LocalPlannerTests, flightFrameOfIteration) {
+  // GIVEN: a local planner which planned around a wall 2m ahead
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float y = -1.f; y <= 1.f; y += 0.05f) {
+    for (float z = -1.f; z <= 1.f; z += 0.1f) {
+      cloud.push_back(pcl::PointXYZ(2.f, y, z + 30.f));
+    }
+  }
+  planner.complete_cloud_.push_back(cloud);
+  planner.runPlanner();
+
+  // WHEN: the iteration is written to a flight recorder and read back
+  const std::string path =
+      "/tmp/test_local_planner_flight_" + std::to_string(getpid());
+  FlightRecorder recorder;
+  ASSERT_TRUE(recorder.open(path, 2, 64 * 1024));
+  FlightFrame written;
+  ASSERT_TRUE(planner.writeFlightFrame(recorder, written));
+  std::vector<FlightFrame> frames;
+  ASSERT_TRUE(readFlightRecording(path, frames));
+  recorder.close();
+  std::remove(path.c_str());
+  ASSERT_EQ(1u, frames.size());
+  const FlightFrame& frame = frames[0];
+
+  // THEN: it holds the inputs and the decision of the iteration
+  EXPECT_EQ(Eigen::Vector3f(0.f, 0.f, 30.f), frame.position);
+  EXPECT_EQ(planner.getGoal(), frame.goal);
+  EXPECT_TRUE(frame.armed);
+  EXPECT_EQ(planner.getAvoidanceOutput().waypoint_type, frame.waypoint_type);
+  EXPECT_EQ(ALPHA_RES, frame.histogram_resolution);
+  EXPECT_GT(frame.cloud.size(), 0u);
+  EXPECT_LE(frame.cloud.size(), cloud.size());
+  ASSERT_FALSE(frame.histogram.empty());
+  for (const RecordedCell& cell : frame.histogram) {
+    EXPECT_LT(cell.index, GRID_LENGTH_E * GRID_LENGTH_Z);
+    EXPECT_NEAR(200, cell.distance_cm, 50);
+  }
+
+  // THEN: the candidates and the cloud are not copied into the buffer
+  EXPECT_TRUE(written.candidates.empty());
+  EXPECT_TRUE(written.cloud.empty());
+}
+
+TEST_F(LocalPlannerTests, flightFrameDownsamplesLargeClouds) {
+  // GIVEN: a local planner which planned around a dense wall 2m ahead
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float y = -1.f; y <= 1.f; y += 0.01f) {
+    for (float z = -1.f; z <= 1.f; z += 0.05f) {
+      cloud.push_back(pcl::PointXYZ(2.f, y, z + 30.f));
+    }
+  }
+  planner.complete_cloud_.push_back(cloud);
+  planner.runPlanner();
+
+  // WHEN: the iteration is written to frames smaller than the cloud
+  const std::string path =
+      "/tmp/test_local_planner_dense_" + std::to_string(getpid());
+  FlightRecorder recorder;
+  ASSERT_TRUE(recorder.open(path, 2, 16 * 1024));
+  FlightFrame written;
+  ASSERT_TRUE(planner.writeFlightFrame(recorder, written));
+  std::vector<FlightFrame> frames;
+  ASSERT_TRUE(readFlightRecording(path, frames));
+  recorder.close();
+  std::remove(path.c_str());
+
+  // THEN: the cloud is downsampled to the frame instead of being cut
+  ASSERT_EQ(1u, frames.size());
+  EXPECT_EQ(0u, recorder.truncatedFrames());
+  EXPECT_GT(frames[0].cloud.size(), 0u);
+  EXPECT_LT(frames[0].cloud.size(), cloud.size());
+  EXPECT_LE(frames[0].cloud.size(), 1024u);
+}
+
+TEST_F(LocalPlannerTests, flightFrameCandidatesOfIteration) {
+  // GIVEN: a local planner which chose a direction of the cost matrix
+  avoidance::LocalPlannerNodeConfig config =
+      avoidance::LocalPlannerNodeConfig::__getDefault__();
+  config.use_VFH_star_ = false;
+  planner.dynamicReconfigureSetParams(config, 1);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float y = -1.f; y <= 1.f; y += 0.05f) {
+    for (float z = -1.f; z <= 1.f; z += 0.1f) {
+      cloud.push_back(pcl::PointXYZ(2.f, y, z + 30.f));
+    }
+  }
+  planner.complete_cloud_.push_back(cloud);
+  planner.runPlanner();  // reaches the altitude
+  planner.runPlanner();
+  ASSERT_EQ(costmap, planner.getAvoidanceOutput().waypoint_type);
+
+  const std::string path =
+      "/tmp/test_local_planner_candidates_" + std::to_string(getpid());
+  FlightRecorder recorder;
+  ASSERT_TRUE(recorder.open(path, 2, 64 * 1024));
+  FlightFrame frame;
+  std::vector<FlightFrame> frames;
+
+  // WHEN: the iteration is recorded
+  ASSERT_TRUE(planner.writeFlightFrame(recorder, frame));
+  ASSERT_TRUE(readFlightRecording(path, frames));
+
+  // THEN: it holds the candidates the direction was chosen from
+  ASSERT_EQ(1u, frames.size());
+  EXPECT_FALSE(frames[0].candidates.empty());
+
+  // WHEN: the next iteration plans with the tree and is recorded
+  config.use_VFH_star_ = true;
+  planner.dynamicReconfigureSetParams(config, 1);
+  planner.runPlanner();
+  ASSERT_TRUE(planner.writeFlightFrame(recorder, frame));
+  ASSERT_TRUE(readFlightRecording(path, frames));
+  recorder.close();
+  std::remove(path.c_str());
+
+  // THEN: the candidates of the earlier iteration are not recorded again
+  ASSERT_EQ(2u, frames.size());
+  EXPECT_EQ(tryPath, frames[1].waypoint_type);
+  EXPECT_TRUE(frames[1].candidates.empty());
+}
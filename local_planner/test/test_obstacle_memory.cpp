@@ -0,0 +1,155 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "../include/local_planner/common.h"
+#include "../include/local_planner/obstacle_memory.h"
+#include "../include/local_planner/planner_functions.h"
+
+using namespace avoidance;
+
+class ObstacleMemoryTests : public ::testing::Test {
+ public:
+  ObstacleMemory memory;
+  VoxelIndex voxels;
+  Eigen::Vector3f position = Eigen::Vector3f(0.f, 0.f, 0.f);
+  FOV fov;
+  pcl::PointCloud<pcl::PointXYZ> wall;
+
+  void SetUp() override {
+    // field of view looking along the x axis, a wall in front of the vehicle
+    calculateFOV(60.f, 40.f, fov, 0.f, 0.f);
+    for (float y = -0.5f; y < 0.5f; y += 0.05f) {
+      for (float z = -0.5f; z < 0.5f; z += 0.05f) {
+        wall.push_back(pcl::PointXYZ(3.f, y, z));
+      }
+    }
+  }
+};
+
+TEST_F(ObstacleMemoryTests, fieldOfViewReplacesMemory) {
+  // GIVEN: a memory holding the wall
+  voxels.build(wall, 0.1f);
+  memory.update(voxels, position, fov, true, 10, 20.f, 0);
+  ASSERT_EQ(voxels.size(), memory.size());
+  EXPECT_EQ(1, memory.age().front());
+
+  // WHEN: the wall is seen again
+  memory.update(voxels, position, fov, true, 10, 20.f, 0);
+
+  // THEN: the voxels are replaced, not duplicated
+  EXPECT_EQ(voxels.size(), memory.size());
+  EXPECT_EQ(1, memory.age().front());
+
+  // WHEN: the wall disappears inside the field of view
+  voxels.build(pcl::PointCloud<pcl::PointXYZ>(), 0.1f);
+  memory.update(voxels, position, fov, true, 10, 20.f, 0);
+
+  // THEN: it is removed from the memory
+  EXPECT_TRUE(memory.empty());
+}
+
+TEST_F(ObstacleMemoryTests, agingOutsideFieldOfView) {
+  // GIVEN: a memory holding the wall
+  voxels.build(wall, 0.1f);
+  memory.update(voxels, position, fov, true, 3, 20.f, 0);
+  size_t wall_voxels = memory.size();
+
+  // WHEN: the vehicle looks the other way and sees nothing
+  FOV fov_back;
+  calculateFOV(60.f, 40.f, fov_back, M_PI_F, 0.f);
+  voxels.build(pcl::PointCloud<pcl::PointXYZ>(), 0.1f);
+  memory.update(voxels, position, fov_back, true, 3, 20.f, 0);
+
+  // THEN: the wall is remembered and older
+  ASSERT_EQ(wall_voxels, memory.size());
+  EXPECT_EQ(2, memory.age().front());
+
+  // WHEN: the waypoint is outside of the field of view
+  memory.update(voxels, position, fov_back, false, 3, 20.f, 0);
+
+  // THEN: the voxels keep their age
+  EXPECT_EQ(2, memory.age().front());
+
+  // WHEN: they reach the maximum age
+  memory.update(voxels, position, fov_back, true, 3, 20.f, 0);
+
+  // THEN: they are forgotten
+  EXPECT_TRUE(memory.empty());
+}
+
+TEST_F(ObstacleMemoryTests, confidenceOutsideFieldOfView) {
+  // GIVEN: a memory holding the wall seen once and a wall behind it seen
+  // three times
+  pcl::PointCloud<pcl::PointXYZ> seen_often;
+  for (const pcl::PointXYZ& p : wall) {
+    seen_often.push_back(pcl::PointXYZ(p.x + 2.f, p.y, p.z));
+  }
+  voxels.build(seen_often, 0.1f);
+  size_t wall_voxels = voxels.size();
+  memory.update(voxels, position, fov, true, 100, 20.f, 20);
+  memory.update(voxels, position, fov, true, 100, 20.f, 20);
+  pcl::PointCloud<pcl::PointXYZ> both = seen_often;
+  both += wall;
+  voxels.build(both, 0.1f);
+  memory.update(voxels, position, fov, true, 100, 20.f, 20);
+  EXPECT_EQ(3 * CONFIDENCE_HIT, *std::max_element(memory.confidence().begin(),
+                                                  memory.confidence().end()));
+  EXPECT_EQ(CONFIDENCE_HIT, *std::min_element(memory.confidence().begin(),
+                                              memory.confidence().end()));
+
+  // WHEN: the vehicle looks the other way for a few frames
+  FOV fov_back;
+  calculateFOV(60.f, 40.f, fov_back, M_PI_F, 0.f);
+  voxels.build(pcl::PointCloud<pcl::PointXYZ>(), 0.1f);
+  for (int i = 0; i < 25; i++) {
+    memory.update(voxels, position, fov_back, true, 100, 20.f, 20);
+  }
+
+  // THEN: the wall seen once is forgotten long before the maximum age while
+  // the wall seen often is still remembered
+  ASSERT_EQ(wall_voxels, memory.size());
+  for (float x : memory.x()) {
+    EXPECT_GT(x, 4.f);
+  }
+
+  // WHEN: the waypoint is outside of the field of view
+  std::vector<uint8_t> confidence = memory.confidence();
+  memory.update(voxels, position, fov_back, false, 100, 20.f, 20);
+
+  // THEN: the voxels keep their confidence
+  EXPECT_EQ(confidence, memory.confidence());
+
+  // WHEN: the decay is disabled
+  for (int i = 0; i < 50; i++) {
+    memory.update(voxels, position, fov_back, true, 100, 20.f, 0);
+  }
+
+  // THEN: the voxels are forgotten by age only
+  EXPECT_EQ(wall_voxels, memory.size());
+}
+
+TEST_F(ObstacleMemoryTests, propagatedHistogramFollowsVehicle) {
+  // GIVEN: a memory holding the wall
+  voxels.build(wall, 0.1f);
+  memory.update(voxels, position, fov, true, 10, 20.f, 0);
+
+  // WHEN: the vehicle moves sideways and we bin the memory
+  Eigen::Vector3f new_position(0.f, 3.f, 0.f);
+  Histogram<ALPHA_RES> histogram;
+  propagateHistogram(histogram, memory, new_position);
+
+  // THEN: the wall is found at its world position seen from the new position
+  PolarPoint wall_pol =
+      cartesianToPolar(Eigen::Vector3f(3.f, 0.f, 0.f), new_position);
+  Eigen::Vector2i wall_idx = polarToHistogramIndex(wall_pol, ALPHA_RES);
+  EXPECT_NEAR(wall_pol.r, histogram.get_dist(wall_idx.y(), wall_idx.x()),
+              0.2f);
+  EXPECT_EQ(1, histogram.get_age(wall_idx.y(), wall_idx.x()));
+
+  // THEN: the cell the wall was in before is free
+  PolarPoint old_pol =
+      cartesianToPolar(Eigen::Vector3f(3.f, 0.f, 0.f), position);
+  Eigen::Vector2i old_idx = polarToHistogramIndex(old_pol, ALPHA_RES);
+  EXPECT_FLOAT_EQ(0.f, histogram.get_dist(old_idx.y(), old_idx.x()));
+}
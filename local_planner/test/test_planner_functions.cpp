@@ -1,16 +1,22 @@
 #include <gtest/gtest.h>
 #include <cmath>
+#include <cstring>
+#include <memory>
+#include <type_traits>
 
 #include "../include/local_planner/planner_functions.h"
 
 #include "../include/local_planner/common.h"
 
+#include <pcl_conversions/pcl_conversions.h>
+#include <sensor_msgs/image_encodings.h>
+
 using namespace avoidance;
 
 TEST(PlannerFunctions, generateNewHistogramEmpty) {
   // GIVEN: an empty pointcloud
   pcl::PointCloud<pcl::PointXYZ> empty_cloud;
-  Histogram histogram_output = Histogram(ALPHA_RES);
+  Histogram<ALPHA_RES> histogram_output;
   geometry_msgs::PoseStamped location;
   location.pose.position.x = 0;
   location.pose.position.y = 0;
@@ -30,7 +36,7 @@ TEST(PlannerFunctions, generateNewHistogramEmpty) {
 
 TEST(PlannerFunctions, generateNewHistogramSpecificCells) {
   // GIVEN: a pointcloud with an object of one cell size
-  Histogram histogram_output = Histogram(ALPHA_RES);
+  Histogram<ALPHA_RES> histogram_output;
   Eigen::Vector3f location(0.0f, 0.0f, 0.0f);
   float distance = 1.0f;
 
@@ -92,21 +98,18 @@ TEST(PlannerFunctions, calculateFOV) {
   float pitch = 0.0f;
 
   // WHEN: we calculate the Field of View
-  std::vector<int> z_FOV_idx_z_greater_grid_length;
-  std::vector<int> z_FOV_idx_z_max_greater_grid;
-  std::vector<int> z_FOV_idx3_z_min_smaller_zero;
-  std::vector<int> z_FOV_idx_z_smaller_zero;
-  int e_FOV_min;
-  int e_FOV_max;
-
-  calculateFOV(h_fov, v_fov, z_FOV_idx_z_greater_grid_length, e_FOV_min,
-               e_FOV_max, yaw_z_greater_grid_length, pitch);
-  calculateFOV(h_fov, v_fov, z_FOV_idx_z_max_greater_grid, e_FOV_min, e_FOV_max,
-               yaw_z_max_greater_grid, pitch);
-  calculateFOV(h_fov, v_fov, z_FOV_idx3_z_min_smaller_zero, e_FOV_min,
-               e_FOV_max, yaw_z_min_smaller_zero, pitch);
-  calculateFOV(h_fov, v_fov, z_FOV_idx_z_smaller_zero, e_FOV_min, e_FOV_max,
-               yaw_z_smaller_zero, pitch);
+  FOV fov_z_greater_grid_length;
+  FOV fov_z_max_greater_grid;
+  FOV fov_z_min_smaller_zero;
+  FOV fov_z_smaller_zero;
+
+  calculateFOV(h_fov, v_fov, fov_z_greater_grid_length,
+               yaw_z_greater_grid_length, pitch);
+  calculateFOV(h_fov, v_fov, fov_z_max_greater_grid, yaw_z_max_greater_grid,
+               pitch);
+  calculateFOV(h_fov, v_fov, fov_z_min_smaller_zero, yaw_z_min_smaller_zero,
+               pitch);
+  calculateFOV(h_fov, v_fov, fov_z_smaller_zero, yaw_z_smaller_zero, pitch);
 
   // THEN: we expect polar histogram indexes that are in the Field of View
   std::vector<int> output_z_greater_grid_length = {
@@ -116,30 +119,138 @@ TEST(PlannerFunctions, calculateFOV) {
   std::vector<int> output_z_min_smaller_zero = {0, 1, 2,  3,  4,  5,  6, 7,
                                                 8, 9, 10, 11, 12, 13, 59};
   std::vector<int> output_z_smaller_zero = {43, 44, 45, 46, 47, 48, 49, 50,
-                                            51, 52, 53, 54, 55, 56, 57, 58};
+                                            51, 52, 53, 54, 55, 56, 57};
 
-  EXPECT_EQ(18, e_FOV_max);
-  EXPECT_EQ(10, e_FOV_min);
-  for (size_t i = 0; i < z_FOV_idx_z_greater_grid_length.size(); i++) {
-    EXPECT_EQ(output_z_greater_grid_length.at(i),
-              z_FOV_idx_z_greater_grid_length.at(i));
-  }
+  EXPECT_EQ(18, fov_z_smaller_zero.e_max);
+  EXPECT_EQ(10, fov_z_smaller_zero.e_min);
+  auto azimuth_indices = [](const FOV& fov) {
+    std::vector<int> indices;
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      if (fov.containsAzimuth(z)) {
+        indices.push_back(z);
+      }
+    }
+    return indices;
+  };
+  EXPECT_EQ(output_z_greater_grid_length,
+            azimuth_indices(fov_z_greater_grid_length));
+  EXPECT_EQ(output_z_max_greater_grid, azimuth_indices(fov_z_max_greater_grid));
+  EXPECT_EQ(output_z_min_smaller_zero, azimuth_indices(fov_z_min_smaller_zero));
+  EXPECT_EQ(output_z_smaller_zero, azimuth_indices(fov_z_smaller_zero));
+}
 
-  for (size_t i = 0; i < z_FOV_idx_z_max_greater_grid.size(); i++) {
-    EXPECT_EQ(output_z_max_greater_grid.at(i),
-              z_FOV_idx_z_max_greater_grid.at(i));
-  }
+TEST(PlannerFunctions, calculateFOVOfCameras) {
+  // GIVEN: a camera looking forward, one looking to the left and one which
+  // has not sent its camera info yet, all optical frames looking along z
+  std::vector<CameraFOV> camera_FOVs(3);
+  camera_FOVs[0].h_FOV = camera_FOVs[1].h_FOV = 60.0f;
+  camera_FOVs[0].v_FOV = camera_FOVs[1].v_FOV = 45.0f;
+  std::vector<Eigen::Affine3f, Eigen::aligned_allocator<Eigen::Affine3f>>
+      transforms(3, Eigen::Affine3f::Identity());
+  Eigen::Matrix3f front, left;
+  front << 0.f, 0.f, 1.f, -1.f, 0.f, 0.f, 0.f, -1.f, 0.f;
+  left << 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, -1.f, 0.f;
+  transforms[0].linear() = front;
+  transforms[1].linear() = left;
+  sensor_msgs::PointCloud2::Ptr msg(new sensor_msgs::PointCloud2);
+  std::vector<sensor_msgs::PointCloud2::ConstPtr> cloud_msgs(3, msg);
+
+  // WHEN: we calculate the Field of View of all cameras
+  FOV fov;
+  bool found = calculateFOV(camera_FOVs, cloud_msgs, transforms, fov);
+
+  // THEN: it is the union of the Field of View of the two known cameras
+  FOV fov_front, fov_left;
+  calculateFOV(60.0f, 45.0f, fov_front, 0.0f, 0.0f);
+  calculateFOV(60.0f, 45.0f, fov_left, M_PI_F / 2.0f, 0.0f);
+  EXPECT_TRUE(found);
+  EXPECT_EQ(fov_front.azimuth | fov_left.azimuth, fov.azimuth);
+  EXPECT_EQ(fov_front.e_min, fov.e_min);
+  EXPECT_EQ(fov_front.e_max, fov.e_max);
+
+  // WHEN: the left camera has no cloud
+  cloud_msgs[1].reset();
+  calculateFOV(camera_FOVs, cloud_msgs, transforms, fov);
+
+  // THEN: only the front camera is in the Field of View
+  EXPECT_EQ(fov_front.azimuth, fov.azimuth);
+
+  // WHEN: no camera with a cloud has a known Field of View
+  cloud_msgs[0].reset();
+
+  // THEN: there is no Field of View
+  EXPECT_FALSE(calculateFOV(camera_FOVs, cloud_msgs, transforms, fov));
+  EXPECT_TRUE(fov.azimuth.none());
+}
 
-  for (size_t i = 0; i < z_FOV_idx3_z_min_smaller_zero.size(); i++) {
-    EXPECT_EQ(output_z_min_smaller_zero.at(i),
-              z_FOV_idx3_z_min_smaller_zero.at(i));
+TEST(PlannerFunctions, generateNewHistogramInBlocks) {
+  // GIVEN: a cloud large enough to be split into blocks
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (int i = 0; i < 20000; i++) {
+    float angle = 0.001f * i;
+    cloud.push_back(pcl::PointXYZ(3.f * std::cos(angle), 3.f * std::sin(angle),
+                                  0.0001f * i - 1.f));
   }
+  Eigen::Vector3f position(0.5f, 0.f, 0.f);
+
+  // WHEN: we build the histogram in one pass and in blocks
+  Histogram<ALPHA_RES> serial_histogram;
+  generateNewHistogram(serial_histogram, cloud, position);
+  ThreadPool pool(2);
+  std::vector<HistogramWorkspace> workspaces;
+  Histogram<ALPHA_RES> block_histogram;
+  generateNewHistogram(block_histogram, cloud, position, &pool, workspaces);
 
-  for (size_t i = 0; i < z_FOV_idx_z_smaller_zero.size(); i++) {
-    EXPECT_EQ(output_z_smaller_zero.at(i), z_FOV_idx_z_smaller_zero.at(i));
+  // THEN: both histograms are the same
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      EXPECT_NEAR(serial_histogram.get_dist(e, z),
+                  block_histogram.get_dist(e, z), 1e-4f);
+    }
   }
 }
 
+TEST(PlannerFunctions, combinedHistogram) {
+  // GIVEN: a Field of View wrapping around azimuth index 0 and a propagated
+  // histogram with an obstacle inside and one outside of it
+  FOV fov;
+  calculateFOV(90.0f, 45.0f, fov, -2.3f, 0.0f);
+  ASSERT_TRUE(fov.contains(14, 0));
+  ASSERT_FALSE(fov.contains(14, 30));
+  Histogram<ALPHA_RES> propagated_hist;
+  propagated_hist.set_dist(14, 0, 3.f);
+  propagated_hist.set_age(14, 0, 4);
+  propagated_hist.set_dist(14, 30, 5.f);
+  propagated_hist.set_age(14, 30, 4);
+  propagated_hist.set_dist(2, 0, 6.f);
+  propagated_hist.set_age(2, 0, 2);
+
+  // WHEN: we combine it with an empty new histogram
+  Histogram<ALPHA_RES> new_hist;
+  bool hist_empty = true;
+  combinedHistogram(hist_empty, new_hist, propagated_hist, false, fov);
+
+  // THEN: the obstacles outside of the FOV are kept and grow older, the one
+  // inside of it is replaced by the new histogram
+  EXPECT_FALSE(hist_empty);
+  EXPECT_FLOAT_EQ(0.f, new_hist.get_dist(14, 0));
+  EXPECT_FLOAT_EQ(5.f, new_hist.get_dist(14, 30));
+  EXPECT_EQ(5, new_hist.get_age(14, 30));
+  EXPECT_FLOAT_EQ(6.f, new_hist.get_dist(2, 0));
+  EXPECT_EQ(3, new_hist.get_age(2, 0));
+
+  // WHEN: the new histogram sees an obstacle inside of the FOV and the
+  // waypoint is outside of it
+  Histogram<ALPHA_RES> seen_hist;
+  seen_hist.set_dist(14, 0, 2.f);
+  combinedHistogram(hist_empty, seen_hist, propagated_hist, true, fov);
+
+  // THEN: the new obstacle is fresh and the propagated ones keep their age
+  EXPECT_FLOAT_EQ(2.f, seen_hist.get_dist(14, 0));
+  EXPECT_EQ(1, seen_hist.get_age(14, 0));
+  EXPECT_EQ(4, seen_hist.get_age(14, 30));
+}
+
 TEST(PlannerFunctionsTests, filterPointCloud) {
   // GIVEN: two point clouds
   const Eigen::Vector3f position(1.5f, 1.0f, 4.5f);
@@ -201,6 +312,197 @@ TEST(PlannerFunctionsTests, filterPointCloud) {
   EXPECT_EQ(0, cropped_cloud2.points.size());
 }
 
+TEST(PlannerFunctionsTests, filterPointCloudFromMessages) {
+  // GIVEN: two point cloud messages in a sensor frame which is translated
+  // with respect to local_origin, one of them containing NaN padding
+  const Eigen::Vector3f position(1.5f, 1.0f, 4.5f);
+  const Eigen::Vector3f sensor_offset(0.5f, -0.5f, 0.2f);
+  pcl::PointCloud<pcl::PointXYZ> p1;
+  p1.push_back(toXYZ(Eigen::Vector3f(1.1f, 0.8f, 0.1f)));
+  p1.push_back(toXYZ(Eigen::Vector3f(2.2f, 1.0f, 1.0f)));
+  p1.push_back(pcl::PointXYZ(NAN, NAN, NAN));
+  p1.push_back(
+      toXYZ(Eigen::Vector3f(0.3f, 0.6f, -0.5f)));  // < min_dist_backoff
+  p1.push_back(toXYZ(Eigen::Vector3f(-1.0f, 1.0f, 1.0f)));
+
+  pcl::PointCloud<pcl::PointXYZ> p2;
+  p2.push_back(
+      toXYZ(Eigen::Vector3f(100.0f, 5.0f, 1.0f)));  // > histogram_box.radius
+  p2.push_back(
+      toXYZ(Eigen::Vector3f(-0.45f, 0.52f, -0.17f)));  // < min_realsense_dist
+
+  sensor_msgs::PointCloud2::Ptr msg1(new sensor_msgs::PointCloud2);
+  sensor_msgs::PointCloud2::Ptr msg2(new sensor_msgs::PointCloud2);
+  pcl::toROSMsg(p1, *msg1);
+  pcl::toROSMsg(p2, *msg2);
+  std::vector<sensor_msgs::PointCloud2::ConstPtr> cloud_msgs = {msg1, msg2};
+  std::vector<Eigen::Affine3f, Eigen::aligned_allocator<Eigen::Affine3f>>
+      transforms(2, Eigen::Affine3f::Identity());
+  for (auto& transform : transforms) {
+    transform.translation() = position + sensor_offset;
+  }
+
+  float min_dist_backoff = 1.0f;
+  Box histogram_box(5.0f);
+  histogram_box.setBoxLimits(position, 4.5f);
+  float min_realsense_dist = 0.2f;
+
+  pcl::PointCloud<pcl::PointXYZ> cropped_cloud;
+  Eigen::Vector3f closest_point;
+  float distance_to_closest_point;
+  int counter_backoff;
+
+  // WHEN: we filter the messages
+  filterPointCloud(cropped_cloud, closest_point, distance_to_closest_point,
+                   counter_backoff, cloud_msgs, transforms, 2, min_dist_backoff,
+                   histogram_box, position, min_realsense_dist);
+
+  // THEN: we expect the NaN and out of range points to be removed and the
+  // remaining points to be transformed to the local_origin frame
+  Eigen::Vector3f closest = Eigen::Vector3f(0.3f, 0.6f, -0.5f) + sensor_offset;
+  ASSERT_EQ(4, cropped_cloud.points.size());
+  EXPECT_EQ(4, cropped_cloud.width);
+  EXPECT_FLOAT_EQ((position + closest).x(), closest_point.x());
+  EXPECT_FLOAT_EQ((position + closest).y(), closest_point.y());
+  EXPECT_FLOAT_EQ((position + closest).z(), closest_point.z());
+  EXPECT_NEAR(closest.norm(), distance_to_closest_point, 1e-5f);
+  EXPECT_EQ(1, counter_backoff);
+  EXPECT_FLOAT_EQ(p1.points[0].x + position.x() + sensor_offset.x(),
+                  cropped_cloud.points[0].x);
+  EXPECT_FLOAT_EQ(p1.points[4].z + position.z() + sensor_offset.z(),
+                  cropped_cloud.points[3].z);
+}
+
+TEST(PlannerFunctionsTests, filterPointCloudFromDepthImages) {
+  // GIVEN: a 16UC1 depth image with an invalid pixel of a camera which looks
+  // along the x axis, and the same pixels projected into a point cloud
+  const Eigen::Vector3f position(1.5f, 1.0f, 4.5f);
+  const int width = 8;
+  const int height = 6;
+  sensor_msgs::CameraInfo info;
+  info.width = width;
+  info.height = height;
+  info.K = {4.0, 0.0, 3.5, 0.0, 4.0, 2.5, 0.0, 0.0, 1.0};
+  info.P = {4.0, 0.0, 3.5, 0.0, 0.0, 4.0, 2.5, 0.0, 0.0, 0.0, 1.0, 0.0};
+  std::shared_ptr<DepthRays> rays = std::make_shared<DepthRays>();
+  ASSERT_TRUE(rays->update(info));
+
+  sensor_msgs::Image::Ptr image(new sensor_msgs::Image);
+  image->width = width;
+  image->height = height;
+  image->encoding = sensor_msgs::image_encodings::TYPE_16UC1;
+  image->step = width * sizeof(uint16_t);
+  image->data.resize(image->step * height);
+  pcl::PointCloud<pcl::PointXYZ> sampled_pixels;
+  for (int v = 0; v < height; v++) {
+    for (int u = 0; u < width; u++) {
+      uint16_t depth_mm = (u == 2 && v == 2) ? 0 : 1000 + 200 * u + 50 * v;
+      std::memcpy(&image->data[v * image->step + u * sizeof(uint16_t)],
+                  &depth_mm, sizeof(depth_mm));
+      if (depth_mm > 0 && u % 2 == 0 && v % 2 == 0) {
+        float depth = 0.001f * depth_mm;
+        sampled_pixels.push_back(pcl::PointXYZ((u - 3.5f) / 4.f * depth,
+                                               (v - 2.5f) / 4.f * depth,
+                                               depth));
+      }
+    }
+  }
+  sensor_msgs::PointCloud2::Ptr cloud_msg(new sensor_msgs::PointCloud2);
+  pcl::toROSMsg(sampled_pixels, *cloud_msg);
+
+  // optical frame: z forward, x right, y down
+  std::vector<Eigen::Affine3f, Eigen::aligned_allocator<Eigen::Affine3f>>
+      transforms(1, Eigen::Affine3f::Identity());
+  transforms[0].linear() << 0.f, 0.f, 1.f, -1.f, 0.f, 0.f, 0.f, -1.f, 0.f;
+  transforms[0].translation() = position;
+  Box histogram_box(5.0f);
+  histogram_box.setBoxLimits(position, 4.5f);
+
+  // WHEN: we filter every second pixel of the image and the projected cloud
+  pcl::PointCloud<pcl::PointXYZ> image_cloud, projected_cloud;
+  Eigen::Vector3f image_closest, projected_closest;
+  float image_distance, projected_distance;
+  int image_backoff, projected_backoff;
+  filterPointCloud(image_cloud, image_closest, image_distance, image_backoff,
+                   {image}, {rays}, transforms, 2, 0, 1.5f, histogram_box,
+                   position, 0.2f);
+  filterPointCloud(projected_cloud, projected_closest, projected_distance,
+                   projected_backoff, {cloud_msg}, transforms, 0, 1.5f,
+                   histogram_box, position, 0.2f);
+
+  // THEN: we expect the same points without the invalid pixel
+  ASSERT_EQ(11u, projected_cloud.points.size());
+  ASSERT_EQ(projected_cloud.points.size(), image_cloud.points.size());
+  for (size_t i = 0; i < image_cloud.points.size(); i++) {
+    EXPECT_NEAR(projected_cloud.points[i].x, image_cloud.points[i].x, 1e-5f);
+    EXPECT_NEAR(projected_cloud.points[i].y, image_cloud.points[i].y, 1e-5f);
+    EXPECT_NEAR(projected_cloud.points[i].z, image_cloud.points[i].z, 1e-5f);
+  }
+  EXPECT_NEAR(projected_distance, image_distance, 1e-5f);
+  EXPECT_EQ(projected_backoff, image_backoff);
+  EXPECT_GT(image_cloud.points[0].x, position.x());
+
+  // and an image which does not fit the rays to be skipped
+  info.width = width + 1;
+  ASSERT_TRUE(rays->update(info));
+  filterPointCloud(image_cloud, image_closest, image_distance, image_backoff,
+                   {image}, {rays}, transforms, 2, 0, 1.5f, histogram_box,
+                   position, 0.2f);
+  EXPECT_TRUE(image_cloud.points.empty());
+}
+
+TEST(PlannerFunctions, downsamplePointCloudKeepsOccupiedBins) {
+  // GIVEN: a dense cloud around the vehicle
+  const Eigen::Vector3f position(1.f, -2.f, 3.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (int i = 0; i < 20000; i++) {
+    float a = 0.001f * i;
+    float r = 1.f + 0.0003f * i;
+    cloud.push_back(pcl::PointXYZ(position.x() + r * std::cos(7.f * a),
+                                  position.y() + r * std::sin(3.f * a),
+                                  position.z() + r * std::sin(11.f * a)));
+  }
+  Histogram<ALPHA_RES> raw_histogram;
+  generateNewHistogram(raw_histogram, cloud, position);
+  size_t n_bins = 0;
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      if (raw_histogram.dist(e, z) > 0.f) n_bins++;
+    }
+  }
+
+  for (float voxel_size : {0.f, 0.2f, 1.f}) {
+    for (size_t max_points : {size_t(0), size_t(10), size_t(3000)}) {
+      // WHEN: we downsample it
+      pcl::PointCloud<pcl::PointXYZ> downsampled = cloud;
+      DownsampleWorkspace workspace;
+      downsamplePointCloud(downsampled, position, voxel_size, max_points,
+                           workspace);
+      Histogram<ALPHA_RES> histogram;
+      generateNewHistogram(histogram, downsampled, position);
+
+      // THEN: every occupied bin is still occupied and the budget is only
+      // exceeded by the points representing the bins
+      if (voxel_size <= 0.f && max_points == 0) {
+        EXPECT_EQ(cloud.size(), downsampled.size());
+      } else {
+        EXPECT_LT(downsampled.size(), cloud.size());
+      }
+      if (max_points > 0) {
+        EXPECT_LE(downsampled.size(), std::max(max_points, n_bins));
+      }
+      EXPECT_EQ(downsampled.size(), downsampled.width);
+      for (int e = 0; e < GRID_LENGTH_E; e++) {
+        for (int z = 0; z < GRID_LENGTH_Z; z++) {
+          if (raw_histogram.dist(e, z) > 0.f) {
+            EXPECT_GT(histogram.dist(e, z), 0.f);
+          }
+        }
+      }
+    }
+  }
+}
+
 TEST(PlannerFunctions, testDirectionTree) {
   // GIVEN: the node positions in a tree and some possible vehicle positions
   float n1_x = 0.8f;
@@ -406,6 +708,58 @@ TEST(PlannerFunctions, smoothPolarMatrix) {
   EXPECT_TRUE(greater_equal);
 }
 
+// dense implementation of smoothPolarMatrix on the padded matrix as it was
+// before the running sum kernel, kept as reference
+static void smoothPolarMatrixReference(Eigen::MatrixXf& matrix,
+                                       unsigned int smoothing_radius) {
+  Eigen::MatrixXf matrix_padded;
+  padPolarMatrix(matrix, smoothing_radius, matrix_padded);
+  Eigen::ArrayXf kernel1d = getConicKernel(smoothing_radius);
+
+  Eigen::ArrayXf temp_col(matrix_padded.rows());
+  for (int col_index = 0; col_index < matrix_padded.cols(); col_index++) {
+    temp_col = matrix_padded.col(col_index);
+    for (int row_index = 0; row_index < matrix.rows(); row_index++) {
+      matrix_padded(row_index + smoothing_radius, col_index) =
+          (temp_col.segment(row_index, 2 * smoothing_radius + 1) * kernel1d)
+              .sum();
+    }
+  }
+
+  Eigen::ArrayXf temp_row(matrix_padded.cols());
+  for (int row_index = 0; row_index < matrix.rows(); row_index++) {
+    temp_row = matrix_padded.row(row_index + smoothing_radius);
+    for (int col_index = 0; col_index < matrix.cols(); col_index++) {
+      matrix(row_index, col_index) =
+          (temp_row.segment(col_index, 2 * smoothing_radius + 1) * kernel1d)
+              .sum();
+    }
+  }
+}
+
+TEST(PlannerFunctions, smoothPolarMatrixMatchesDenseKernel) {
+  // GIVEN: random cost matrices at the default and at finer resolutions
+  std::srand(17);
+  CostMatrixWorkspace workspace;
+  for (int res : {ALPHA_RES, 3, 1}) {
+    Eigen::MatrixXf matrix =
+        500.f * (Eigen::MatrixXf::Random(180 / res, 360 / res).array() + 1.f);
+    for (unsigned int radius = 0; radius <= 30 / res + 5; radius++) {
+      // WHEN: we smooth them with the running sums and the dense kernel
+      Eigen::MatrixXf smoothed = matrix;
+      Eigen::MatrixXf reference = matrix;
+      smoothPolarMatrix(smoothed, radius, workspace);
+      smoothPolarMatrixReference(reference, radius);
+
+      // THEN: both implementations should agree
+      float max_value = reference.cwiseAbs().maxCoeff();
+      EXPECT_LT((smoothed - reference).cwiseAbs().maxCoeff(),
+                1e-5f * max_value)
+          << "resolution " << res << " radius " << radius;
+    }
+  }
+}
+
 TEST(PlannerFunctions, smoothMatrix) {
   // GIVEN: a matrix with a single cell set
   unsigned int smooth_radius = 4;
@@ -438,6 +792,240 @@ TEST(PlannerFunctions, smoothMatrix) {
   EXPECT_LT((expected_matrix - matrix).cwiseAbs().maxCoeff(), 1e-5);
 }
 
+TEST(PlannerFunctions, getCostMatrixWorkspaceReuse) {
+  // GIVEN: a histogram with an obstacle and a workspace
+  Eigen::Vector3f position(0.f, 0.f, 0.f);
+  Eigen::Vector3f goal(0.f, 5.f, 0.f);
+  Eigen::Vector3f last_sent_waypoint(0.f, 1.f, 0.f);
+  costParameters cost_params;
+  Histogram<ALPHA_RES> histogram;
+  for (int z = 25; z < 35; z++) {
+    histogram.set_dist(GRID_LENGTH_E / 2, z, 2.f);
+  }
+  CostMatrixWorkspace workspace;
+
+  // WHEN: we calculate the cost matrix with and without the workspace
+  Eigen::MatrixXf cost_matrix, cost_matrix_workspace;
+  std::vector<uint8_t> cost_image_data;
+  getCostMatrix(histogram, goal, position, 0.f, last_sent_waypoint,
+                cost_params, false, 30.f, cost_matrix, cost_image_data);
+  for (int i = 0; i < 2; i++) {
+    getCostMatrix(histogram, goal, position, 0.f, last_sent_waypoint,
+                  cost_params, false, 30.f, cost_matrix_workspace, workspace,
+                  nullptr);
+  }
+
+  // THEN: reusing the workspace should not change the result and no image is
+  // needed to get it
+  EXPECT_TRUE(cost_matrix.isApprox(cost_matrix_workspace));
+  EXPECT_EQ(3 * GRID_LENGTH_E * GRID_LENGTH_Z, cost_image_data.size());
+}
+
+TEST(PlannerFunctions, getBestCandidatesFromHistogramMatchesCostMatrix) {
+  // GIVEN: histograms with random obstacles and goals in different directions
+  std::srand(3);
+  costParameters cost_params;
+  cost_params.height_change_cost_param_adapted = 1.f;
+  CostMatrixWorkspace workspace;
+  Eigen::MatrixXf cost_matrix;
+  std::vector<candidateDirection> reference, candidates;
+  Eigen::Vector3f position(1.f, -2.f, 3.f);
+  for (int i = 0; i < 20; i++) {
+    Histogram<ALPHA_RES> histogram;
+    for (int e = 0; e < GRID_LENGTH_E; e++) {
+      for (int z = 0; z < GRID_LENGTH_Z; z++) {
+        if (std::rand() % 4 == 0) {
+          histogram.set_dist(e, z, 0.5f + (std::rand() % 100) * 0.1f);
+        }
+      }
+    }
+    Eigen::Vector3f goal = position + 10.f * Eigen::Vector3f::Random();
+    Eigen::Vector3f last_sent_waypoint = position + Eigen::Vector3f::Random();
+    float yaw = static_cast<float>(std::rand() % 360 - 180);
+    unsigned int n_candidates = i < 10 ? 1 : 50;
+
+    // WHEN: we look for the best candidates with and without building the
+    // whole cost matrix
+    getCostMatrix(histogram, goal, position, yaw, last_sent_waypoint,
+                  cost_params, false, 30.f, cost_matrix, workspace, nullptr);
+    getBestCandidatesFromCostMatrix(cost_matrix, n_candidates, reference);
+    getBestCandidatesFromHistogram(histogram, goal, position, yaw,
+                                   last_sent_waypoint, cost_params, 30.f,
+                                   n_candidates, workspace, candidates);
+
+    // THEN: the candidates should have the same costs
+    ASSERT_EQ(reference.size(), candidates.size());
+    for (size_t j = 0; j < reference.size(); j++) {
+      EXPECT_FLOAT_EQ(reference[j].cost, candidates[j].cost);
+    }
+    EXPECT_FLOAT_EQ(reference[0].elevation_angle,
+                    candidates[0].elevation_angle);
+    EXPECT_FLOAT_EQ(reference[0].azimuth_angle, candidates[0].azimuth_angle);
+  }
+}
+
+TEST(PlannerFunctions, adaptHistogramResolution) {
+  // GIVEN: a thin obstacle close to the vehicle, one far away behind it and
+  // one far away in the goal direction
+  Eigen::Vector3f position(0.f, 0.f, 0.f);
+  Eigen::Vector3f goal(10.f, 0.f, 0.f);
+  Histogram<ALPHA_RES> histogram;
+  Eigen::Vector2i close_idx = polarToHistogramIndex(
+      cartesianToPolar(Eigen::Vector3f(0.f, 2.f, 0.f), position), ALPHA_RES);
+  Eigen::Vector2i behind_idx = polarToHistogramIndex(
+      cartesianToPolar(Eigen::Vector3f(-8.f, 0.f, 0.f), position), ALPHA_RES);
+  Eigen::Vector2i goal_idx = polarToHistogramIndex(
+      cartesianToPolar(Eigen::Vector3f(8.f, 0.f, 0.f), position), ALPHA_RES);
+  histogram.set_dist(close_idx.y(), close_idx.x(), 2.f);
+  histogram.set_dist(behind_idx.y(), behind_idx.x(), 8.f);
+  histogram.set_dist(goal_idx.y(), goal_idx.x(), 8.f);
+
+  // WHEN: we adapt the resolution
+  adaptHistogramResolution(histogram, position, goal, 4.f, 30.f);
+
+  // THEN: the close obstacle and the goal direction keep the full resolution
+  EXPECT_TRUE(histogram.hasCoarseCells());
+  EXPECT_FALSE(histogram.isCoarse(close_idx.y(), close_idx.x()));
+  EXPECT_FALSE(histogram.isCoarse(goal_idx.y(), goal_idx.x()));
+  EXPECT_FLOAT_EQ(0.f, histogram.get_dist(goal_idx.y(), goal_idx.x() ^ 1));
+
+  // THEN: the obstacle behind blocks its whole coarse cell
+  EXPECT_TRUE(histogram.isCoarse(behind_idx.y(), behind_idx.x()));
+  for (int e = behind_idx.y() / 2 * 2; e < behind_idx.y() / 2 * 2 + 2; e++) {
+    for (int z = behind_idx.x() / 2 * 2; z < behind_idx.x() / 2 * 2 + 2; z++) {
+      EXPECT_FLOAT_EQ(8.f, histogram.get_dist(e, z));
+    }
+  }
+
+  // WHEN: the histogram is reset
+  histogram.setZero();
+
+  // THEN: all of it is fine again
+  EXPECT_FALSE(histogram.hasCoarseCells());
+}
+
+TEST(PlannerFunctions, mixedResolutionCostMatrix) {
+  // GIVEN: histograms with random obstacles at mixed resolution
+  std::srand(5);
+  costParameters cost_params;
+  CostMatrixWorkspace workspace;
+  Eigen::MatrixXf cost_matrix;
+  std::vector<candidateDirection> reference, candidates;
+  Eigen::Vector3f position(1.f, -2.f, 3.f);
+  for (int i = 0; i < 10; i++) {
+    Histogram<ALPHA_RES> histogram;
+    for (int e = 0; e < GRID_LENGTH_E; e++) {
+      for (int z = 0; z < GRID_LENGTH_Z; z++) {
+        if (std::rand() % 4 == 0) {
+          histogram.set_dist(e, z, 0.5f + (std::rand() % 100) * 0.1f);
+        }
+      }
+    }
+    Eigen::Vector3f goal = position + 10.f * Eigen::Vector3f::Random();
+    Eigen::Vector3f last_sent_waypoint = position + Eigen::Vector3f::Random();
+    float yaw = static_cast<float>(std::rand() % 360 - 180);
+    adaptHistogramResolution(histogram, position, goal, 3.f, 20.f);
+    ASSERT_TRUE(histogram.hasCoarseCells());
+
+    // WHEN: we build the cost matrix and look for the best candidates
+    getCostMatrix(histogram, goal, position, yaw, last_sent_waypoint,
+                  cost_params, false, 30.f, cost_matrix, workspace, nullptr);
+    getBestCandidatesFromCostMatrix(cost_matrix, 20, reference);
+    getBestCandidatesFromHistogram(histogram, goal, position, yaw,
+                                   last_sent_waypoint, cost_params, 30.f, 20,
+                                   workspace, candidates);
+
+    // THEN: the cells of a coarse block share their goal and smoothness
+    // costs in the rows where every cell is evaluated
+    Eigen::MatrixXf distance_matrix = workspace.distance_matrix;
+    for (int e = 0; e < GRID_LENGTH_E; e++) {
+      float elevation = histogramIndexToPolar(e, 0, ALPHA_RES, 1.f).e;
+      if (std::round(1.f / std::cos(elevation * DEG_TO_RAD)) > 1.f) continue;
+      for (int z = 0; z + 1 < GRID_LENGTH_Z; z += 2) {
+        if (histogram.isCoarse(e, z)) {
+          float cost = cost_matrix(e, z) - distance_matrix(e, z);
+          EXPECT_NEAR(cost, cost_matrix(e, z + 1) - distance_matrix(e, z + 1),
+                      1e-5f * cost_matrix(e, z));
+        }
+      }
+    }
+
+    // THEN: the lazy evaluation finds the same candidates
+    ASSERT_EQ(reference.size(), candidates.size());
+    for (size_t j = 0; j < reference.size(); j++) {
+      EXPECT_FLOAT_EQ(reference[j].cost, candidates[j].cost);
+    }
+  }
+}
+
+TEST(PlannerFunctions, getCostMatrixMatchesCostFunction) {
+  // GIVEN: an empty histogram and a heading away from the goal
+  Eigen::Vector3f position(1.f, 2.f, 3.f);
+  Eigen::Vector3f goal(4.f, 8.f, 5.f);
+  Eigen::Vector3f last_sent_waypoint(1.5f, 2.5f, 2.f);
+  float heading = 40.f;
+  costParameters cost_params;
+  Histogram<ALPHA_RES> histogram;
+  Eigen::MatrixXf cost_matrix;
+  std::vector<uint8_t> cost_image_data;
+
+  // WHEN: we calculate the cost matrix
+  getCostMatrix(histogram, goal, position, heading, last_sent_waypoint,
+                cost_params, false, 0.f, cost_matrix, cost_image_data);
+
+  // THEN: the cells which are not interpolated have the cost of the
+  // costFunction of their bin centre
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    PolarPoint p_pol = histogramIndexToPolar(e, 0, ALPHA_RES, 0.f);
+    float distance_cost, other_costs;
+    costFunction(p_pol.e, p_pol.z, 0.f, goal, position, heading,
+                 last_sent_waypoint, cost_params, distance_cost, other_costs);
+    float expected = distance_cost + other_costs;
+    EXPECT_NEAR(expected, cost_matrix(e, 0), 1e-5f * std::abs(expected));
+  }
+}
+
+TEST(PlannerFunctions, getCostMatrixRowsMatchCostFunction) {
+  // GIVEN: a histogram with obstacles, a goal below the vehicle and a
+  // heading away from the goal
+  Eigen::Vector3f position(1.f, 2.f, 3.f);
+  Eigen::Vector3f goal(-4.f, 8.f, 1.f);
+  Eigen::Vector3f last_sent_waypoint(1.5f, 2.5f, 3.5f);
+  float heading = 130.f;
+  costParameters cost_params;
+  cost_params.heading_cost_param = 0.5f;
+  cost_params.height_change_cost_param_adapted = 3.f;
+  Histogram<ALPHA_RES> histogram;
+  for (int e = 0; e < GRID_LENGTH_E; e += 3) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      histogram.set_dist(e, z, 1.f + 0.1f * z);
+    }
+  }
+  Eigen::MatrixXf cost_matrix;
+  std::vector<uint8_t> cost_image_data;
+
+  // WHEN: we calculate the cost matrix without smoothing
+  getCostMatrix(histogram, goal, position, heading, last_sent_waypoint,
+                cost_params, false, 0.f, cost_matrix, cost_image_data);
+
+  // THEN: every cell which is not interpolated, above and below the goal,
+  // should have the cost of the costFunction of its bin centre
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    PolarPoint p_pol = histogramIndexToPolar(e, 0, ALPHA_RES, 0.f);
+    int step_size =
+        static_cast<int>(std::round(1.f / std::cos(p_pol.e * DEG_TO_RAD)));
+    for (int z = 0; z < GRID_LENGTH_Z; z += step_size) {
+      p_pol = histogramIndexToPolar(e, z, ALPHA_RES, 0.f);
+      float distance_cost, other_costs;
+      costFunction(p_pol.e, p_pol.z, histogram.get_dist(e, z), goal, position,
+                   heading, last_sent_waypoint, cost_params, distance_cost,
+                   other_costs);
+      float expected = distance_cost + other_costs;
+      EXPECT_NEAR(expected, cost_matrix(e, z), 1e-5f * std::abs(expected));
+    }
+  }
+}
+
 TEST(PlannerFunctions, getCostMatrixNoObstacles) {
   // GIVEN: a position, goal and an empty histogram
   Eigen::Vector3f position(0.f, 0.f, 0.f);
@@ -450,7 +1038,7 @@ TEST(PlannerFunctions, getCostMatrixNoObstacles) {
   cost_params.height_change_cost_param = 4.f;
   cost_params.height_change_cost_param_adapted = 4.f;
   Eigen::MatrixXf cost_matrix;
-  Histogram histogram = Histogram(ALPHA_RES);
+  Histogram<ALPHA_RES> histogram;
   float smoothing_radius = 30.f;
 
   // WHEN: we calculate the cost matrix from the input data
@@ -657,7 +1245,7 @@ TEST(PlannerFunctions, CostfunctionSmoothingCost) {
 
 TEST(Histogram, HistogramDownsampleCorrectUsage) {
   // GIVEN: a histogram of the correct resolution
-  Histogram histogram = Histogram(ALPHA_RES);
+  Histogram<ALPHA_RES> histogram;
   histogram.set_dist(0, 0, 1.3);
   histogram.set_dist(1, 0, 1.3);
   histogram.set_dist(0, 1, 1.3);
@@ -668,21 +1256,21 @@ TEST(Histogram, HistogramDownsampleCorrectUsage) {
   histogram.set_age(3, 3, 3);
 
   // WHEN: we downsample the histogram to have a larger bin size
-  histogram.downsample();
+  Histogram<2 * ALPHA_RES> low_res_histogram = histogram.downsample();
 
   // THEN: The downsampled histogram should fuse four cells of the regular
   // resolution histogram into one
   for (int i = 0; i < GRID_LENGTH_E / 2; ++i) {
     for (int j = 0; j < GRID_LENGTH_Z / 2; ++j) {
       if (i == 0 && j == 0) {
-        EXPECT_FLOAT_EQ(1.3, histogram.get_dist(i, j));
-        EXPECT_FLOAT_EQ(0.0, histogram.get_age(i, j));
+        EXPECT_FLOAT_EQ(1.3, low_res_histogram.get_dist(i, j));
+        EXPECT_FLOAT_EQ(0.0, low_res_histogram.get_age(i, j));
       } else if (i == 1 && j == 1) {
-        EXPECT_FLOAT_EQ(3, histogram.get_age(i, j));
-        EXPECT_FLOAT_EQ(0.0, histogram.get_dist(i, j));
+        EXPECT_FLOAT_EQ(3, low_res_histogram.get_age(i, j));
+        EXPECT_FLOAT_EQ(0.0, low_res_histogram.get_dist(i, j));
       } else {
-        EXPECT_FLOAT_EQ(0.0, histogram.get_dist(i, j));
-        EXPECT_FLOAT_EQ(0.0, histogram.get_age(i, j));
+        EXPECT_FLOAT_EQ(0.0, low_res_histogram.get_dist(i, j));
+        EXPECT_FLOAT_EQ(0.0, low_res_histogram.get_age(i, j));
       }
     }
   }
@@ -690,12 +1278,12 @@ TEST(Histogram, HistogramDownsampleCorrectUsage) {
 
 TEST(Histogram, HistogramUpsampleCorrectUsage) {
   // GIVEN: a histogram of the correct resolution
-  Histogram histogram = Histogram(ALPHA_RES * 2);
-  histogram.set_dist(0, 0, 1.3);
-  histogram.set_age(1, 1, 3);
+  Histogram<ALPHA_RES * 2> low_res_histogram;
+  low_res_histogram.set_dist(0, 0, 1.3);
+  low_res_histogram.set_age(1, 1, 3);
 
   // WHEN: we upsample the histogram to have regular bin size
-  histogram.upsample();
+  Histogram<ALPHA_RES> histogram = low_res_histogram.upsample();
 
   // THEN: The upsampled histogram should split every cell of the lower
   // resolution histogram into four cells
@@ -717,13 +1305,33 @@ TEST(Histogram, HistogramUpsampleCorrectUsage) {
   }
 }
 
-TEST(Histogram, HistogramUpDownpsampleInorrectUsage) {
-  // GIVEN: a histogram of the correct resolution
-  Histogram low_res_histogram = Histogram(ALPHA_RES * 2);
-  Histogram high_res_histogram = Histogram(ALPHA_RES);
+TEST(Histogram, HistogramResolutionIsPartOfTheType) {
+  // GIVEN: histograms of regular and large bin size
+  Histogram<ALPHA_RES> high_res_histogram;
+  Histogram<ALPHA_RES * 2> low_res_histogram;
+
+  // THEN: the dimensions should follow from the resolution and up- and
+  // downsampling should convert between the two types
+  EXPECT_EQ(GRID_LENGTH_E, Histogram<ALPHA_RES>::e_dim);
+  EXPECT_EQ(GRID_LENGTH_Z, Histogram<ALPHA_RES>::z_dim);
+  EXPECT_EQ(GRID_LENGTH_E / 2, Histogram<ALPHA_RES * 2>::e_dim);
+  EXPECT_EQ(GRID_LENGTH_Z / 2, Histogram<ALPHA_RES * 2>::z_dim);
+  EXPECT_TRUE((std::is_same<decltype(high_res_histogram.downsample()),
+                            Histogram<ALPHA_RES * 2>>::value));
+  EXPECT_TRUE((std::is_same<decltype(low_res_histogram.upsample()),
+                            Histogram<ALPHA_RES>>::value));
+}
 
-  // THEN: We expect the functions to throw if the input histogram has the wrong
-  // resolution
-  EXPECT_THROW(low_res_histogram.downsample(), std::logic_error);
-  EXPECT_THROW(high_res_histogram.upsample(), std::logic_error);
+TEST(Histogram, HistogramIndexWrapping) {
+  // GIVEN: a histogram with a single filled cell at the upper azimuth border
+  Histogram<ALPHA_RES> histogram;
+  histogram.set_dist(0, GRID_LENGTH_Z - 1, 2.5f);
+
+  // THEN: the getters should wrap indices around the histogram while the
+  // unchecked accessor reads the same cell
+  EXPECT_FLOAT_EQ(2.5f, histogram.get_dist(0, -1));
+  EXPECT_FLOAT_EQ(2.5f,
+                  histogram.get_dist(GRID_LENGTH_E, 2 * GRID_LENGTH_Z - 1));
+  EXPECT_FLOAT_EQ(2.5f, histogram.dist(0, GRID_LENGTH_Z - 1));
+  EXPECT_FLOAT_EQ(0.f, histogram.get_dist(0, GRID_LENGTH_Z));
 }
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/planner_functions.h"
+#include "../include/local_planner/planner_snapshot.h"
+
+#include <unistd.h>
+#include <cstdio>
+#include <string>
+
+using namespace avoidance;
+
+class PlannerSnapshotTests : public ::testing::Test {
+ public:
+  std::string path;
+  PlannerSnapshot snapshot;
+
+  void SetUp() override {
+    path = "/tmp/test_planner_snapshot_" + std::to_string(getpid());
+    std::remove(path.c_str());
+
+    // a memory holding a wall in front of the vehicle
+    pcl::PointCloud<pcl::PointXYZ> wall;
+    for (float y = -1.f; y < 1.f; y += 0.05f) {
+      for (float z = -1.f; z < 1.f; z += 0.05f) {
+        wall.push_back(pcl::PointXYZ(3.f, y, z));
+      }
+    }
+    VoxelIndex voxels;
+    voxels.build(wall, 0.1f);
+    FOV fov;
+    calculateFOV(60.f, 40.f, fov, 0.f, 0.f);
+    snapshot.obstacle_memory.update(voxels, Eigen::Vector3f::Zero(), fov, true,
+                                    10, 20.f, 0);
+    snapshot.stamp = 12.5;
+    snapshot.goal = Eigen::Vector3f(10.f, 5.f, 3.f);
+    snapshot.take_off_pose = Eigen::Vector3f(0.f, 1.f, 0.f);
+    snapshot.reach_altitude = true;
+  }
+
+  void TearDown() override { std::remove(path.c_str()); }
+
+  void expectEqual(const PlannerSnapshot& expected,
+                   const PlannerSnapshot& actual) {
+    EXPECT_DOUBLE_EQ(expected.stamp, actual.stamp);
+    EXPECT_EQ(expected.goal, actual.goal);
+    EXPECT_EQ(expected.take_off_pose, actual.take_off_pose);
+    EXPECT_EQ(expected.reach_altitude, actual.reach_altitude);
+    const ObstacleMemory& a = expected.obstacle_memory;
+    const ObstacleMemory& b = actual.obstacle_memory;
+    ASSERT_EQ(a.size(), b.size());
+    EXPECT_EQ(a.x(), b.x());
+    EXPECT_EQ(a.y(), b.y());
+    EXPECT_EQ(a.z(), b.z());
+    EXPECT_EQ(a.count(), b.count());
+    EXPECT_EQ(a.age(), b.age());
+    EXPECT_EQ(a.confidence(), b.confidence());
+  }
+};
+
+TEST_F(PlannerSnapshotTests, restoredAfterReopen) {
+  // GIVEN: a snapshot written to the file
+  ASSERT_FALSE(snapshot.obstacle_memory.empty());
+  {
+    SnapshotFile file;
+    ASSERT_TRUE(file.open(path));
+    EXPECT_TRUE(file.write(snapshot));
+  }
+
+  // WHEN: the file is opened again, as by a restarted node
+  SnapshotFile file;
+  ASSERT_TRUE(file.open(path));
+  PlannerSnapshot restored;
+
+  // THEN: it holds the same snapshot
+  ASSERT_TRUE(file.read(restored));
+  expectEqual(snapshot, restored);
+}
+
+TEST_F(PlannerSnapshotTests, emptyFile) {
+  // GIVEN: a new snapshot file
+  SnapshotFile file;
+  ASSERT_TRUE(file.open(path));
+
+  // THEN: there is nothing to restore
+  PlannerSnapshot restored;
+  EXPECT_FALSE(file.read(restored));
+}
+
+TEST_F(PlannerSnapshotTests, tornWriteKeepsPreviousSnapshot) {
+  // GIVEN: two snapshots written in turn
+  SnapshotFile file;
+  ASSERT_TRUE(file.open(path));
+  ASSERT_TRUE(file.write(snapshot));
+  PlannerSnapshot newer = snapshot;
+  newer.stamp = 13.5;
+  ASSERT_TRUE(file.write(newer));
+  file.close();
+
+  // WHEN: the payload of the newer one is corrupted, like by a power cut
+  // while it was written
+  FILE* f = std::fopen(path.c_str(), "r+b");
+  ASSERT_TRUE(f != nullptr);
+  // the slots are written in turn starting with the second one, so the first
+  // slot holds the newer snapshot. Its voxels follow the file, slot and
+  // payload headers
+  std::fseek(f, 100, SEEK_SET);
+  std::fputc(0x5a, f);
+  std::fclose(f);
+
+  // THEN: the older snapshot is restored
+  ASSERT_TRUE(file.open(path));
+  PlannerSnapshot restored;
+  ASSERT_TRUE(file.read(restored));
+  expectEqual(snapshot, restored);
+}
+
+TEST_F(PlannerSnapshotTests, growsForLargeMemory) {
+  // GIVEN: a memory too large for the initial slots
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float x = -5.f; x < 5.f; x += 0.1f) {
+    for (float z = -5.f; z < 5.f; z += 0.1f) {
+      cloud.push_back(pcl::PointXYZ(x, 5.f, z));
+    }
+  }
+  VoxelIndex voxels;
+  voxels.build(cloud, 0.1f);
+  FOV fov;
+  calculateFOV(60.f, 40.f, fov, M_PI_F / 2.f, 0.f);
+  snapshot.obstacle_memory.update(voxels, Eigen::Vector3f::Zero(), fov, true,
+                                  10, 20.f, 0);
+  ASSERT_GT(snapshot.obstacle_memory.size(), 4000u);
+
+  // WHEN: it is written after a small one
+  SnapshotFile file;
+  ASSERT_TRUE(file.open(path));
+  PlannerSnapshot small;
+  ASSERT_TRUE(file.write(small));
+  ASSERT_TRUE(file.write(snapshot));
+
+  // THEN: the large one is read back
+  PlannerSnapshot restored;
+  ASSERT_TRUE(file.read(restored));
+  expectEqual(snapshot, restored);
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/planning_trigger.h"
+
+#include <vector>
+
+using namespace avoidance;
+
+TEST(PlanningTrigger, allCamerasWaitsForEveryCamera) {
+  // GIVEN: three cameras of which two delivered a new cloud
+  const PlanningTrigger trigger = PlanningTrigger::allCameras;
+
+  // WHEN: we ask if the planner should run
+  // THEN: it only runs once the third cloud arrived, regardless of the time
+  EXPECT_FALSE(readyToPlan(trigger, 3, 2, 3, 10.0, 10.0));
+  EXPECT_TRUE(readyToPlan(trigger, 3, 3, 3, 0.0, 10.0));
+  EXPECT_FALSE(readyToPlan(trigger, 0, 0, 0, 10.0, 10.0));
+}
+
+TEST(PlanningTrigger, anyCameraRunsOnEveryNewCloud) {
+  // GIVEN: three cameras, one of them stalled
+  const PlanningTrigger trigger = PlanningTrigger::anyCamera;
+
+  // WHEN: we ask if the planner should run
+  // THEN: a single new cloud is enough, but not if there is no new cloud or
+  // every cloud is too old
+  EXPECT_TRUE(readyToPlan(trigger, 3, 1, 2, 0.0, 10.0));
+  EXPECT_FALSE(readyToPlan(trigger, 3, 0, 2, 10.0, 10.0));
+  EXPECT_FALSE(readyToPlan(trigger, 3, 1, 0, 10.0, 10.0));
+}
+
+TEST(PlanningTrigger, fixedRateRunsWhenThePeriodElapsed) {
+  // GIVEN: a planner rate of 10Hz
+  const PlanningTrigger trigger = PlanningTrigger::fixedRate;
+
+  // WHEN: we ask if the planner should run
+  // THEN: it runs on the freshest data once 100ms elapsed, even without a
+  // new cloud, as long as some cloud can still be used
+  EXPECT_FALSE(readyToPlan(trigger, 3, 3, 3, 0.05, 10.0));
+  EXPECT_TRUE(readyToPlan(trigger, 3, 0, 1, 0.1, 10.0));
+  EXPECT_FALSE(readyToPlan(trigger, 3, 0, 0, 1.0, 10.0));
+  EXPECT_FALSE(readyToPlan(trigger, 3, 3, 3, 1.0, 0.0));
+}
+
+TEST(PlanningTrigger, unknownValuesFallBackToAllCameras) {
+  // GIVEN: the values of the dynamic reconfigure enum and an invalid one
+  // WHEN: we convert them
+  // THEN: the invalid one maps to the default policy
+  EXPECT_EQ(PlanningTrigger::allCameras, toPlanningTrigger(0));
+  EXPECT_EQ(PlanningTrigger::anyCamera, toPlanningTrigger(1));
+  EXPECT_EQ(PlanningTrigger::fixedRate, toPlanningTrigger(2));
+  EXPECT_EQ(PlanningTrigger::allCameras, toPlanningTrigger(7));
+}
+
+TEST(PlanningTrigger, stagingNeedsTransformsOfUsableClouds) {
+  // GIVEN: three cameras, the second one with an old cloud and the third one
+  // without a transform
+  auto usable = [](PlanningTrigger trigger, size_t i) {
+    const double ages[] = {0.1, 2.0, 0.1};
+    return isCloudUsable(trigger, ages[i], 0.5);
+  };
+  std::vector<size_t> asked;
+  auto has_transform = [&asked](size_t i) {
+    asked.push_back(i);
+    return i != 2;
+  };
+
+  // WHEN: we check if the clouds can be staged
+  // THEN: allCameras uses every cloud and needs every transform
+  const PlanningTrigger all = PlanningTrigger::allCameras;
+  EXPECT_FALSE(canStageClouds(all, 3, [&](size_t i) { return usable(all, i); },
+                              has_transform));
+  EXPECT_EQ(3u, asked.size());
+
+  // THEN: the other triggers leave the old cloud out, but a usable cloud
+  // without a transform still blocks
+  const PlanningTrigger any = PlanningTrigger::anyCamera;
+  asked.clear();
+  EXPECT_FALSE(canStageClouds(any, 3, [&](size_t i) { return usable(any, i); },
+                              has_transform));
+  EXPECT_EQ(std::vector<size_t>({0, 2}), asked);
+  EXPECT_TRUE(canStageClouds(any, 2, [&](size_t i) { return usable(any, i); },
+                             has_transform));
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/common.h"
+#include "../include/local_planner/histogram.h"
+#include "../include/local_planner/polar_binning.h"
+
+#include <cmath>
+#include <random>
+
+using namespace avoidance;
+
+TEST(PolarBinning, fastAtan2MatchesAtan2) {
+  // GIVEN: angles all around the unit circle and some degenerate inputs
+  float max_error = 0.f;
+  for (int i = -1800; i <= 1800; i++) {
+    float angle = i * 0.1f * DEG_TO_RAD;
+    for (float r : {0.01f, 1.f, 100.f}) {
+      float y = r * std::sin(angle);
+      float x = r * std::cos(angle);
+      // WHEN: we evaluate the approximation
+      float error = std::abs(fastAtan2(y, x) - std::atan2(y, x));
+      // wrap around +-pi
+      error = std::min(error, 2.f * M_PI_F - error);
+      max_error = std::max(max_error, error);
+    }
+  }
+
+  // THEN: the error should be far below one histogram bin
+  EXPECT_LT(max_error, 1e-4f);
+  EXPECT_FLOAT_EQ(0.f, fastAtan2(0.f, 0.f));
+  EXPECT_FLOAT_EQ(0.5f * M_PI_F, fastAtan2(1.f, 0.f));
+  EXPECT_NEAR(M_PI_F, fastAtan2(0.f, -1.f), 1e-6f);
+}
+
+TEST(PolarBinning, matchesPolarToHistogramIndex) {
+  // GIVEN: random points around a position, the count is not a multiple of the
+  // vector width so that the scalar tail is exercised as well
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> coord(-20.f, 20.f);
+  Eigen::Vector3f position(1.5f, -2.3f, 4.f);
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (int i = 0; i < 10003; i++) {
+    cloud.push_back(pcl::PointXYZ(coord(rng), coord(rng), coord(rng)));
+  }
+
+  for (int res : {ALPHA_RES, 2 * ALPHA_RES}) {
+    // WHEN: we bin them with the batched kernel
+    PolarBinningBuffer buffer;
+    buffer.load(cloud);
+    polarBinning(buffer, position, res);
+
+    // THEN: the bins and distances should be the same as the ones of the
+    // reference conversion, except for points lying on a bin border
+    const float border = 0.01f;
+    for (size_t i = 0; i < cloud.size(); i++) {
+      Eigen::Vector3f p = toEigen(cloud.points[i]);
+      PolarPoint p_pol = cartesianToPolar(p, position);
+      Eigen::Vector2i p_ind = polarToHistogramIndex(p_pol, res);
+      EXPECT_NEAR((p - position).norm(), buffer.dist[i], 1e-4f);
+
+      float e_rem = std::fmod(p_pol.e + 90.f, static_cast<float>(res));
+      float z_rem = std::fmod(p_pol.z + 180.f, static_cast<float>(res));
+      if (e_rem < border || e_rem > res - border || z_rem < border ||
+          z_rem > res - border) {
+        continue;
+      }
+      EXPECT_EQ(p_ind.y() * (360 / res) + p_ind.x(), buffer.bin[i]);
+    }
+  }
+}
+
+TEST(PolarBinning, emptyBuffer) {
+  // GIVEN: an empty cloud
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  PolarBinningBuffer buffer;
+
+  // WHEN: we bin it
+  buffer.load(cloud);
+  polarBinning(buffer, Eigen::Vector3f(0.f, 0.f, 0.f), ALPHA_RES);
+
+  // THEN: there is nothing to bin
+  EXPECT_EQ(0u, buffer.size());
+  EXPECT_TRUE(buffer.bin.empty());
+}
+
+TEST(PolarBinning, azimuthWrapsAtPlusMinus180) {
+  // GIVEN: points right behind the origin on both sides of the -y axis,
+  // enough of them to fill the vectorized and the scalar part of the kernel
+  std::vector<float> x, y, z;
+  for (int i = 0; i < 9; i++) {
+    x.push_back((i % 3 - 1) * 1e-7f);
+    y.push_back(-1.f);
+    z.push_back(0.f);
+  }
+  std::vector<int> bin(x.size());
+  std::vector<float> dist(x.size());
+
+  // WHEN: we bin them
+  polarBinning(x.data(), y.data(), z.data(), x.size(),
+               Eigen::Vector3f(0.f, 0.f, 0.f), ALPHA_RES, bin.data(),
+               dist.data());
+
+  // THEN: they should all end up in the first azimuth bin like they do with
+  // polarToHistogramIndex
+  for (size_t i = 0; i < x.size(); i++) {
+    EXPECT_EQ(GRID_LENGTH_E / 2 * GRID_LENGTH_Z, bin[i]);
+    EXPECT_FLOAT_EQ(1.f, dist[i]);
+  }
+}
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/pose_buffer.h"
+
+#include <cmath>
+
+using namespace avoidance;
+
+TEST(PoseBuffer, interpolatesBetweenPoses) {
+  // GIVEN: two poses 0.1 s apart, turning by 90 degrees around z
+  PoseBuffer buffer;
+  Eigen::Quaternionf q0 = Eigen::Quaternionf::Identity();
+  Eigen::Quaternionf q1(Eigen::AngleAxisf(static_cast<float>(M_PI / 2.0),
+                                          Eigen::Vector3f::UnitZ()));
+  buffer.add(1.0, Eigen::Vector3f(0.f, 0.f, 2.f), q0);
+  buffer.add(1.1, Eigen::Vector3f(1.f, 0.f, 2.f), q1);
+
+  // WHEN: we get the pose halfway between them
+  Eigen::Affine3f pose;
+  ASSERT_TRUE(buffer.interpolate(1.05, pose));
+
+  // THEN: it is in the middle, turned by 45 degrees
+  Eigen::Vector3f origin = pose * Eigen::Vector3f::Zero();
+  EXPECT_NEAR(0.5f, origin.x(), 1e-5f);
+  EXPECT_NEAR(0.f, origin.y(), 1e-5f);
+  EXPECT_NEAR(2.f, origin.z(), 1e-5f);
+  Eigen::Vector3f forward = pose.linear() * Eigen::Vector3f::UnitX();
+  EXPECT_NEAR(std::sqrt(0.5f), forward.x(), 1e-5f);
+  EXPECT_NEAR(std::sqrt(0.5f), forward.y(), 1e-5f);
+
+  // AND: the stamps of the poses give the poses themselves
+  ASSERT_TRUE(buffer.interpolate(1.1, pose));
+  EXPECT_TRUE(pose.isApprox(Eigen::Translation3f(1.f, 0.f, 2.f) * q1));
+}
+
+TEST(PoseBuffer, stampsOutsideOfBuffer) {
+  // GIVEN: a buffer of three poses, filled with five
+  PoseBuffer buffer(3);
+  Eigen::Affine3f pose;
+  EXPECT_FALSE(buffer.interpolate(0.0, pose));
+  for (int i = 0; i < 5; i++) {
+    buffer.add(0.1 * i, Eigen::Vector3f(i, 0.f, 0.f),
+               Eigen::Quaternionf::Identity());
+  }
+  EXPECT_EQ(3u, buffer.size());
+
+  // WHEN: an older pose is added
+  buffer.add(0.25, Eigen::Vector3f(-1.f, 0.f, 0.f),
+             Eigen::Quaternionf::Identity());
+
+  // THEN: it is dropped
+  ASSERT_TRUE(buffer.interpolate(0.25, pose));
+  EXPECT_NEAR(2.5f, pose.translation().x(), 1e-5f);
+
+  // THEN: the dropped poses and the future are not covered
+  EXPECT_FALSE(buffer.interpolate(0.1, pose));
+  EXPECT_FALSE(buffer.interpolate(0.5, pose));
+
+  // THEN: stamps just outside of the buffer get the closest pose
+  ASSERT_TRUE(buffer.interpolate(0.43, pose));
+  EXPECT_NEAR(4.f, pose.translation().x(), 1e-5f);
+  ASSERT_TRUE(buffer.interpolate(0.17, pose));
+  EXPECT_NEAR(2.f, pose.translation().x(), 1e-5f);
+}
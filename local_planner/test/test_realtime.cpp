@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/realtime.h"
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <string>
+#include <thread>
+
+using namespace avoidance;
+
+TEST(Realtime, pinsThreadToCpu) {
+  // GIVEN: the first CPU the process may run on
+  cpu_set_t allowed;
+  ASSERT_EQ(0, sched_getaffinity(0, sizeof(allowed), &allowed));
+  int first_cpu = 0;
+  while (!CPU_ISSET(first_cpu, &allowed)) {
+    first_cpu++;
+  }
+
+  // WHEN: a thread is pinned to it without changing its priority
+  bool applied = false;
+  int cpu = -1;
+  std::string error;
+  std::thread pinned([&]() {
+    ThreadProfile profile;
+    profile.cpus = {first_cpu};
+    applied = applyThreadProfile(profile, error);
+    cpu = sched_getcpu();
+  });
+  pinned.join();
+
+  // THEN: it runs on that CPU
+  EXPECT_TRUE(applied) << error;
+  EXPECT_EQ(first_cpu, cpu);
+}
+
+TEST(Realtime, emptyProfileKeepsThread) {
+  // GIVEN: a profile without CPUs and priority
+  ThreadProfile profile;
+  std::string error;
+
+  // THEN: applying it changes nothing and succeeds
+  EXPECT_TRUE(applyThreadProfile(profile, error));
+  EXPECT_TRUE(error.empty());
+}
+
+TEST(Realtime, reportsLockedMemoryLimit) {
+  // GIVEN: the memlock limit of the process
+  rlimit limit;
+  ASSERT_EQ(0, getrlimit(RLIMIT_MEMLOCK, &limit));
+
+  // WHEN: we ask for the limit of the locked memory
+  size_t bytes = 0;
+  bool limited = lockedMemoryLimit(bytes);
+
+  // THEN: it is the soft limit, if there is one
+  EXPECT_EQ(limit.rlim_cur != RLIM_INFINITY, limited);
+  if (limited) {
+    EXPECT_EQ(static_cast<size_t>(limit.rlim_cur), bytes);
+  }
+}
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/stage_timer.h"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace avoidance;
+
+TEST(StageTimer, percentilesOfWindow) {
+  // GIVEN: timings with the samples 1ms, 2ms, ..., 100ms
+  StageTimings timings;
+  StageTimings::Clock::time_point t0 = StageTimings::Clock::now();
+  for (int i = 1; i <= 100; i++) {
+    timings.record(PlannerStage::histogram, t0,
+                   t0 + std::chrono::milliseconds(i));
+  }
+
+  // WHEN: we compute the statistics of the stage
+  StageStatistics statistics = timings.statistics(PlannerStage::histogram);
+
+  // THEN: we expect nearest rank percentiles and the sum of the samples,
+  // other stages are empty
+  EXPECT_EQ(100u, statistics.samples);
+  EXPECT_DOUBLE_EQ(50.0, statistics.p50_ms);
+  EXPECT_DOUBLE_EQ(99.0, statistics.p99_ms);
+  EXPECT_DOUBLE_EQ(100.0, statistics.max_ms);
+  EXPECT_DOUBLE_EQ(5050.0, statistics.total_ms);
+  EXPECT_EQ(0u, timings.statistics(PlannerStage::treeBuild).samples);
+}
+
+TEST(StageTimer, ringBufferKeepsNewestSamples) {
+  // GIVEN: timings with one slow sample followed by a full window of fast ones
+  StageTimings timings;
+  StageTimings::Clock::time_point t0 = StageTimings::Clock::now();
+  timings.record(PlannerStage::treeBuild, t0, t0 + std::chrono::seconds(1));
+  for (size_t i = 0; i < StageTimings::window_size; i++) {
+    timings.record(PlannerStage::treeBuild, t0,
+                   t0 + std::chrono::milliseconds(2));
+  }
+
+  // WHEN: we compute the statistics of the stage
+  StageStatistics statistics = timings.statistics(PlannerStage::treeBuild);
+
+  // THEN: the slow sample has left the window, but not the total
+  EXPECT_EQ(StageTimings::window_size, statistics.samples);
+  EXPECT_DOUBLE_EQ(2.0, statistics.max_ms);
+  EXPECT_DOUBLE_EQ(1000.0 + 2.0 * StageTimings::window_size,
+                   timings.totalMs(PlannerStage::treeBuild));
+
+  // WHEN: we reset the timings
+  timings.reset();
+
+  // THEN: there are no samples left
+  EXPECT_EQ(0u, timings.statistics(PlannerStage::treeBuild).samples);
+  EXPECT_DOUBLE_EQ(0.0, timings.totalMs(PlannerStage::treeBuild));
+}
+
+TEST(StageTimer, scopedTimerAndTrace) {
+  // GIVEN: timings collecting trace events
+  StageTimings timings;
+  timings.setTraceEnabled(true);
+
+  // WHEN: we time a section on two threads
+  auto work = [&timings]() {
+    ScopedStageTimer timer(PlannerStage::costMatrix, timings);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    EXPECT_GE(timer.elapsedMs(), 2.0);
+  };
+  std::thread other(work);
+  work();
+  other.join();
+
+  // THEN: we expect two samples and two trace events from different threads
+  StageStatistics statistics = timings.statistics(PlannerStage::costMatrix);
+  EXPECT_EQ(2u, statistics.samples);
+  EXPECT_GE(statistics.p50_ms, 2.0);
+  std::vector<TraceEvent> events;
+  EXPECT_EQ(0u, timings.takeTraceEvents(events));
+  ASSERT_EQ(2u, events.size());
+  EXPECT_NE(events[0].thread_id, events[1].thread_id);
+  EXPECT_GE(events[0].duration_us, 2000);
+
+  // WHEN: we write them to a trace file
+  std::string path = ::testing::TempDir() + "stage_timer_trace.json";
+  ChromeTraceWriter writer;
+  ASSERT_TRUE(writer.open(path));
+  writer.write(events);
+  writer.close();
+
+  // THEN: the file is a JSON array of complete events
+  std::ifstream file(path);
+  std::stringstream content;
+  content << file.rdbuf();
+  std::string trace = content.str();
+  EXPECT_EQ('[', trace.front());
+  EXPECT_NE(std::string::npos, trace.find("\"name\":\"cost_matrix\""));
+  EXPECT_NE(std::string::npos, trace.find("\"ph\":\"X\""));
+  EXPECT_NE(std::string::npos, trace.rfind("]"));
+  std::remove(path.c_str());
+
+  // THEN: the events have been moved out of the timings
+  timings.takeTraceEvents(events);
+  EXPECT_TRUE(events.empty());
+}
+
+TEST(StageTimer, scopedTimingsSelectInstance) {
+  // GIVEN: timings of two planners in the same process
+  StageTimings first, second;
+  StageTimings& global = StageTimings::instance();
+
+  // WHEN: the scopes are nested
+  {
+    ScopedStageTimings outer(first);
+    EXPECT_EQ(&first, &StageTimings::instance());
+    {
+      ScopedStageTimings inner(second);
+      { ScopedStageTimer timer(PlannerStage::histogram); }
+      EXPECT_EQ(&second, &StageTimings::instance());
+
+      // THEN: other threads keep the process wide timings
+      std::thread other(
+          [&global]() { EXPECT_EQ(&global, &StageTimings::instance()); });
+      other.join();
+    }
+    EXPECT_EQ(&first, &StageTimings::instance());
+  }
+
+  // THEN: the previous timings are restored and the sample went to the
+  // innermost ones
+  EXPECT_EQ(&global, &StageTimings::instance());
+  EXPECT_EQ(1u, second.statistics(PlannerStage::histogram).samples);
+  EXPECT_EQ(0u, first.statistics(PlannerStage::histogram).samples);
+}
+
+TEST(StageTimer, overrunsOfDeadline) {
+  // GIVEN: a planner deadline of 100ms
+  StageTimings timings;
+  timings.setDeadline(PlannerStage::planner, 100.0);
+  StageTimings::Clock::time_point t0 = StageTimings::Clock::now();
+
+  // WHEN: the samples 50ms, 100ms, 150ms and 200ms are recorded
+  for (int i = 1; i <= 4; i++) {
+    timings.record(PlannerStage::planner, t0,
+                   t0 + std::chrono::milliseconds(50 * i));
+  }
+  timings.record(PlannerStage::histogram, t0, t0 + std::chrono::seconds(1));
+
+  // THEN: we expect the two samples over the deadline to be counted, stages
+  // without deadline have no overruns
+  EXPECT_EQ(2u, timings.statistics(PlannerStage::planner).overruns);
+  EXPECT_EQ(2u, timings.overruns(PlannerStage::planner));
+  EXPECT_EQ(0u, timings.statistics(PlannerStage::histogram).overruns);
+
+  // THEN: the count is cleared by a reset, the deadline is kept
+  timings.reset();
+  EXPECT_EQ(0u, timings.statistics(PlannerStage::planner).overruns);
+  timings.record(PlannerStage::planner, t0, t0 + std::chrono::seconds(1));
+  EXPECT_EQ(1u, timings.statistics(PlannerStage::planner).overruns);
+}
@@ -20,6 +20,8 @@ class StarPlannerTests : public ::testing::Test {
   float obstacle_y = 2.0f;
   Eigen::Vector3f goal;
   Eigen::Vector3f position;
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  ObstacleMemory obstacle_memory;
 
   void SetUp() override {
     ros::Time::init();
@@ -38,7 +40,6 @@ class StarPlannerTests : public ::testing::Test {
     goal.y() = 14.0f;
     goal.z() = 4.0f;
 
-    pcl::PointCloud<pcl::PointXYZ> cloud;
     for (float x = obstacle_min_x; x < obstacle_max_x; x += 0.05f) {
       for (float z = goal.z() - obstacle_half_height;
            z < goal.z() + obstacle_half_height; z += 0.05f) {
@@ -46,13 +47,10 @@ class StarPlannerTests : public ::testing::Test {
       }
     }
     costParameters cost_params;
-    const pcl::PointCloud<pcl::PointXYZ> reprojected_points;
-    const std::vector<int> reprojected_points_age;
 
     star_planner.setParams(cost_params);
     star_planner.setFOV(270.0f, 45.0f);
-    star_planner.setReprojectedPoints(reprojected_points,
-                                      reprojected_points_age);
+    star_planner.setObstacleMemory(obstacle_memory);
     star_planner.setPose(position, 0.0f);
     star_planner.setGoal(goal);
     star_planner.setCloud(cloud);
@@ -94,6 +92,95 @@ TEST_F(StarPlannerTests, buildTree) {
   }
 }
 
+TEST_F(StarPlannerTests, buildTreeBatchedExpansion) {
+  // GIVEN: the same scene planned with a serial and a batched expansion
+  avoidance::LocalPlannerNodeConfig config =
+      avoidance::LocalPlannerNodeConfig::__getDefault__();
+  config.children_per_node_ = 2;
+  config.n_expanded_nodes_ = 10;
+  config.tree_expansion_batch_size_ = 4;
+  star_planner.dynamicReconfigureSetStarParams(config, 1);
+
+  // WHEN: we build the batched tree twice
+  star_planner.buildLookAheadTree();
+  std::vector<Eigen::Vector3f> first_path = star_planner.path_node_positions_;
+  star_planner.buildLookAheadTree();
+
+  // THEN: we expect the node budget to be respected, the path to be the same
+  // for both builds and to make progress towards the goal
+  EXPECT_EQ(config.n_expanded_nodes_, star_planner.closed_set_.size());
+  ASSERT_EQ(first_path.size(), star_planner.path_node_positions_.size());
+  for (size_t i = 0; i < first_path.size(); i++) {
+    EXPECT_TRUE(first_path[i].isApprox(star_planner.path_node_positions_[i]));
+  }
+  ASSERT_GT(first_path.size(), 1u);
+  EXPECT_LT((goal - first_path.front()).norm(), (goal - position).norm());
+  for (auto node : star_planner.tree_) {
+    Eigen::Vector3f n = node.getPosition();
+    bool node_inside_obstacle =
+        n.x() > obstacle_min_x && n.x() < obstacle_max_x &&
+        n.y() > obstacle_y - 0.1f && n.y() < obstacle_y + 0.1f &&
+        n.z() > 4.0f - obstacle_half_height &&
+        n.z() < 4.0f + obstacle_half_height;
+    EXPECT_FALSE(node_inside_obstacle);
+  }
+}
+
+TEST_F(StarPlannerTests, reRootTree) {
+  // GIVEN: a tree which may be reused and a vehicle which moved to the first
+  // node of its path in the next planner cycle
+  avoidance::LocalPlannerNodeConfig config =
+      avoidance::LocalPlannerNodeConfig::__getDefault__();
+  config.children_per_node_ = 2;
+  config.n_expanded_nodes_ = 10;
+  config.max_tree_reuse_ = 5;
+  star_planner.dynamicReconfigureSetStarParams(config, 1);
+  star_planner.buildLookAheadTree();
+  std::vector<Eigen::Vector3f> first_path = star_planner.path_node_positions_;
+  ASSERT_GT(first_path.size(), 2u);
+  position = first_path[first_path.size() - 2];
+  star_planner.setPose(position, 0.0f);
+  star_planner.tree_age_ = 1;
+
+  // WHEN: we build the tree again
+  star_planner.buildLookAheadTree();
+
+  // THEN: the branch of the vehicle is kept below the new root, the other
+  // branches are freed and the node budget is respected
+  EXPECT_TRUE(star_planner.tree_[0].getPosition().isApprox(position));
+  EXPECT_EQ(config.n_expanded_nodes_, star_planner.closed_set_.size());
+  bool kept_second_node = false;
+  for (size_t i = 1; i < star_planner.tree_.size(); i++) {
+    const TreeNode& node = star_planner.tree_[i];
+    if (node.free_) continue;
+    if (node.depth_ == 2 &&
+        node.getPosition().isApprox(first_path[first_path.size() - 3])) {
+      kept_second_node = true;
+    }
+    int ancestor = static_cast<int>(i);
+    for (int depth = node.depth_; depth > 0; depth--) {
+      ASSERT_FALSE(star_planner.tree_[ancestor].free_);
+      ancestor = star_planner.tree_[ancestor].origin_;
+    }
+    EXPECT_EQ(0, ancestor);
+  }
+  EXPECT_TRUE(kept_second_node);
+  for (int node_nr : star_planner.closed_set_) {
+    EXPECT_TRUE(star_planner.tree_[node_nr].closed_);
+    EXPECT_FALSE(star_planner.tree_[node_nr].free_);
+  }
+  EXPECT_LT((goal - star_planner.path_node_positions_.front()).norm(),
+            (goal - position).norm());
+
+  // WHEN: the goal changes
+  star_planner.setGoal(goal);
+  star_planner.buildLookAheadTree();
+
+  // THEN: the tree is built from scratch
+  EXPECT_EQ(star_planner.tree_.size(), star_planner.numberOfNodes());
+  EXPECT_EQ(config.n_expanded_nodes_, star_planner.closed_set_.size());
+}
+
 TEST_F(StarPlannerBasicTests, treeCostFunctionTargetCost) {
   // GIVEN: a tree, the last path and two different goal locations
   Eigen::Vector3f goal1(5.f, 1.f, 0.f);
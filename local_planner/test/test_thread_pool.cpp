@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/stage_timer.h"
+#include "../include/local_planner/thread_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace avoidance;
+
+TEST(ThreadPool, parallelForVisitsEveryIndexOnce) {
+  // GIVEN: a thread pool and a vector of counters
+  ThreadPool pool(3);
+  std::vector<int> visits(100, 0);
+
+  // WHEN: we run a work item for every index
+  pool.parallelFor(visits.size(), [&visits](size_t i) { visits[i]++; });
+
+  // THEN: we expect every index to be visited exactly once
+  EXPECT_EQ(3, pool.size());
+  for (size_t i = 0; i < visits.size(); ++i) {
+    EXPECT_EQ(1, visits[i]);
+  }
+}
+
+TEST(ThreadPool, parallelForBlocksUntilDone) {
+  // GIVEN: a thread pool with a single worker
+  ThreadPool pool(0);
+  std::atomic<int> sum{0};
+
+  // WHEN: we run several batches of work
+  for (int batch = 0; batch < 10; ++batch) {
+    pool.parallelFor(10, [&sum](size_t i) { sum += static_cast<int>(i); });
+  }
+
+  // THEN: we expect all batches to be finished once parallelFor returns
+  EXPECT_EQ(1, pool.size());
+  EXPECT_EQ(450, sum);
+}
+
+TEST(ThreadPool, concurrentAndNestedCalls) {
+  // GIVEN: a pool shared by two callers
+  ThreadPool pool(2);
+  std::atomic<int> first{0};
+  std::atomic<int> second{0};
+
+  // WHEN: both run batches at the same time, the first one nested in its items
+  std::thread other([&pool, &second]() {
+    for (int batch = 0; batch < 20; ++batch) {
+      pool.parallelFor(10, [&second](size_t) { second++; });
+    }
+  });
+  for (int batch = 0; batch < 20; ++batch) {
+    pool.parallelFor(4, [&pool, &first](size_t) {
+      pool.parallelFor(5, [&first](size_t) { first++; });
+    });
+  }
+  other.join();
+
+  // THEN: we expect every item of both callers to be run once
+  EXPECT_EQ(400, first);
+  EXPECT_EQ(200, second);
+}
+
+TEST(ThreadPool, submittedTasksFinishBeforeDestruction) {
+  std::atomic<int> done{0};
+  {
+    // GIVEN: a pool with a single worker
+    ThreadPool pool(1);
+
+    // WHEN: we submit tasks without waiting for them
+    for (int i = 0; i < 50; ++i) {
+      pool.submit([&done]() { done++; });
+    }
+  }
+
+  // THEN: we expect all of them to have run once the pool is gone
+  EXPECT_EQ(50, done);
+}
+
+TEST(ThreadPool, itemsRecordIntoTimingsOfCaller) {
+  // GIVEN: a pool and timings selected by the calling thread
+  ThreadPool pool(2);
+  StageTimings timings;
+  ScopedStageTimings scope(timings);
+
+  // WHEN: the items time a stage on the workers
+  pool.parallelFor(8, [](size_t) {
+    ScopedStageTimer timer(PlannerStage::histogram);
+  });
+
+  // THEN: we expect the samples in the timings of the caller
+  EXPECT_EQ(8u, timings.statistics(PlannerStage::histogram).samples);
+}
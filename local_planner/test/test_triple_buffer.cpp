@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/triple_buffer.h"
+
+#include <thread>
+
+using namespace avoidance;
+
+TEST(TripleBuffer, fetchReturnsNewestValue) {
+  // GIVEN: a triple buffer
+  TripleBuffer<int> buffer;
+
+  // WHEN: nothing has been published
+  // THEN: there is nothing to fetch
+  EXPECT_FALSE(buffer.fetch());
+  EXPECT_FALSE(buffer.pending());
+
+  // WHEN: two values are published before the reader fetches
+  buffer.back() = 1;
+  buffer.publish();
+  buffer.back() = 2;
+  buffer.publish();
+
+  // THEN: the reader gets only the newest one, and only once
+  EXPECT_TRUE(buffer.pending());
+  ASSERT_TRUE(buffer.fetch());
+  EXPECT_FALSE(buffer.pending());
+  EXPECT_EQ(2, buffer.front());
+  EXPECT_FALSE(buffer.fetch());
+  EXPECT_EQ(2, buffer.front());
+}
+
+TEST(TripleBuffer, concurrentWriterAndReader) {
+  // GIVEN: a writer thread publishing increasing values
+  TripleBuffer<int> buffer;
+  const int n_values = 100000;
+  std::thread writer([&buffer, n_values]() {
+    for (int i = 1; i <= n_values; ++i) {
+      buffer.back() = i;
+      buffer.publish();
+    }
+  });
+
+  // WHEN: the reader fetches while the writer is running
+  int last = 0;
+  bool monotonic = true;
+  while (last < n_values) {
+    if (buffer.fetch()) {
+      monotonic &= buffer.front() > last;
+      last = buffer.front();
+    }
+  }
+  writer.join();
+
+  // THEN: the values are never torn or going back in time
+  EXPECT_TRUE(monotonic);
+  EXPECT_EQ(n_values, last);
+}
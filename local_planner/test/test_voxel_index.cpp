@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include "../include/local_planner/common.h"
+#include "../include/local_planner/planner_functions.h"
+#include "../include/local_planner/voxel_index.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace avoidance;
+
+TEST(VoxelIndex, centroidAndCount) {
+  // GIVEN: three points in one voxel and one point in another one, also one
+  // invalid point
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  cloud.push_back(pcl::PointXYZ(0.1f, 0.1f, 0.1f));
+  cloud.push_back(pcl::PointXYZ(0.2f, 0.3f, 0.1f));
+  cloud.push_back(pcl::PointXYZ(0.3f, 0.2f, 0.4f));
+  cloud.push_back(pcl::PointXYZ(-0.1f, 0.1f, 0.1f));
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  cloud.push_back(pcl::PointXYZ(nan, 0.f, 0.f));
+
+  // WHEN: we build the index with a voxel size of 0.5m
+  VoxelIndex voxels;
+  voxels.build(cloud, 0.5f);
+
+  // THEN: we expect two voxels with the mean of their points
+  ASSERT_EQ(2u, voxels.size());
+  EXPECT_FLOAT_EQ(0.5f, voxels.voxelSize());
+  EXPECT_EQ(3, voxels.count()[0]);
+  EXPECT_NEAR(0.2f, voxels.x()[0], 1e-6f);
+  EXPECT_NEAR(0.2f, voxels.y()[0], 1e-6f);
+  EXPECT_NEAR(0.2f, voxels.z()[0], 1e-6f);
+  EXPECT_EQ(1, voxels.count()[1]);
+  EXPECT_FLOAT_EQ(-0.1f, voxels.x()[1]);
+
+  // WHEN: we rebuild it without voxelization
+  voxels.build(cloud, 0.f);
+
+  // THEN: we expect every valid point to be kept
+  EXPECT_EQ(4u, voxels.size());
+}
+
+TEST(VoxelIndex, histogramMatchesRawPoints) {
+  // GIVEN: a dense wall in front of the vehicle and its voxel index
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  for (float x = -2.f; x < 2.f; x += 0.01f) {
+    for (float z = 3.f; z < 5.f; z += 0.01f) {
+      cloud.push_back(pcl::PointXYZ(x, 3.f, z));
+    }
+  }
+  VoxelIndex voxels;
+  voxels.build(cloud, 0.1f);
+  Eigen::Vector3f position(0.f, 0.f, 4.f);
+
+  // WHEN: we build the histogram from the points and from the voxels
+  HistogramWorkspace workspace;
+  Histogram<ALPHA_RES> raw_histogram;
+  Histogram<ALPHA_RES> voxel_histogram;
+  generateNewHistogram(raw_histogram, cloud, position, workspace);
+  generateNewHistogram(voxel_histogram, voxels, position, workspace);
+
+  // THEN: we expect far fewer voxels than points, and the occupied cells and
+  // their distances to agree, centroids close to a bin border can move to the
+  // neighbouring bin which only happens along the outline of the wall
+  EXPECT_LT(voxels.size() * 50, cloud.size());
+  int raw_cells = 0, mismatches = 0;
+  for (int e = 0; e < GRID_LENGTH_E; e++) {
+    for (int z = 0; z < GRID_LENGTH_Z; z++) {
+      bool raw_occupied = raw_histogram.get_dist(e, z) > 0.f;
+      bool voxel_occupied = voxel_histogram.get_dist(e, z) > 0.f;
+      raw_cells += raw_occupied;
+      mismatches += raw_occupied != voxel_occupied;
+      if (raw_occupied && voxel_occupied) {
+        EXPECT_NEAR(raw_histogram.get_dist(e, z),
+                    voxel_histogram.get_dist(e, z), 0.1f);
+      }
+    }
+  }
+  EXPECT_GT(raw_cells, 20);
+  EXPECT_LT(mismatches * 4, raw_cells);
+}